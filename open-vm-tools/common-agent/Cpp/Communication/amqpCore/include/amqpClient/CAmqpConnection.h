@@ -13,6 +13,7 @@
 #include "Memory/DynamicArray/DynamicArrayInc.h"
 #include "amqpClient/CAmqpAuthMechanism.h"
 #include "amqpClient/CAmqpFrame.h"
+#include "amqpClient/CAmqpPublishFrames.h"
 #include "amqpClient/api/Address.h"
 #include "amqpClient/api/CertInfo.h"
 
@@ -43,6 +44,8 @@ private:
 	typedef std::set<amqp_channel_t> COpenChannels;
 	CAF_DECLARE_SMART_POINTER(COpenChannels);
 
+	typedef std::deque<SmartPtrCAmqpPublishFrames> CPublishFrames;
+
 public:
 	CAmqpConnection();
 	virtual ~CAmqpConnection();
@@ -221,6 +224,15 @@ private:
 	void restartListener(
 			const std::string& reason) const;
 
+	bool isVectoredPublish() const;
+
+	void flushPublishFrames();
+
+#ifndef WIN32
+	void abortConnection(
+			const std::string& reason);
+#endif
+
 private:
 	amqp_connection_state_t _connectionState;
 	amqp_socket_t* _socket;
@@ -242,6 +254,10 @@ private:
 	Csetstr _cachedStrings;
 	COpenChannels _openChannels;
 
+	// Encoded publishes waiting for the next holder of the connection lock
+	SmartPtrCAutoMutex _publishMutex;
+	CPublishFrames _publishFrames;
+
 private:
 	CAF_CM_CREATE;
 	CAF_CM_CREATE_THREADSAFE;
@@ -0,0 +1,146 @@
+/*
+ *	Copyright (C) 2016 VMware, Inc.  All rights reserved. -- VMware Confidential
+ */
+
+#ifndef AMQPCLIENT_CAMQPPUBLISHFRAMES_H_
+#define AMQPCLIENT_CAMQPPUBLISHFRAMES_H_
+
+#include "amqp.h"
+#include "Memory/DynamicArray/DynamicArrayInc.h"
+
+#ifndef WIN32
+#include <sys/uio.h>
+#endif
+
+namespace Caf { namespace AmqpClient {
+
+/**
+ * @ingroup AmqpApiImpl
+ * @remark LIBRARY IMPLEMENTATION - NOT PART OF THE PUBLIC API
+ * @brief The wire-encoded frames of a single basic.publish.
+ * <p>
+ * The method and content header frames, along with the frame headers and
+ * trailers of the body frames, are encoded into a small owned buffer.  The body
+ * frames reference the caller's payload directly, so publishing a large message
+ * does not copy it.  The frames are written by the connection, which coalesces
+ * the frames of several publishes into a single vectored write.
+ */
+class CAmqpPublishFrames {
+public:
+	CAmqpPublishFrames();
+	virtual ~CAmqpPublishFrames();
+
+public:
+	int32 initialize(
+			const amqp_channel_t& channel,
+			const uint32 frameMax,
+			const std::string& exchange,
+			const std::string& routingKey,
+			const bool mandatory,
+			const bool immediate,
+			const amqp_basic_properties_t *basicProps,
+			const SmartPtrCDynamicByteArray& body);
+
+	amqp_channel_t getChannel() const;
+
+#ifndef WIN32
+	void appendIovecs(
+			std::vector<struct iovec>& iovecs) const;
+#endif
+
+	void setSent(
+			const int32 status);
+
+	bool isSent() const;
+
+	int32 getStatus() const;
+
+#ifndef WIN32
+	/**
+	 * @brief Writes the iovecs to a non-blocking socket
+	 * <p>
+	 * Waits at most timeoutMs in total for the socket to drain.  Partially
+	 * written iovecs are trimmed in place.
+	 * @param sockfd the socket
+	 * @param timeoutMs the longest time to wait for the socket to become writable
+	 * @param iovecs the iovecs to write
+	 * @param bytesWritten the number of bytes written, even when the write fails
+	 * @return AMQP_STATUS_OK, AMQP_STATUS_TIMEOUT or AMQP_STATUS_SOCKET_ERROR.
+	 * Unless bytesWritten is zero, a failed write leaves a partial frame on the
+	 * socket and the connection cannot be used again.
+	 */
+	static int32 writeIovecs(
+			const int sockfd,
+			const int32 timeoutMs,
+			std::vector<struct iovec>& iovecs,
+			size_t& bytesWritten);
+#endif
+
+private:
+	struct SSegment {
+		bool _isBody;
+		size_t _offset;
+		size_t _length;
+	};
+
+private:
+	int32 appendMethodFrame(
+			const size_t maxPayloadLen,
+			amqp_basic_publish_t& method);
+
+	int32 appendHeaderFrame(
+			const size_t maxPayloadLen,
+			const uint64_t bodySize,
+			const amqp_basic_properties_t *basicProps);
+
+	void appendBodyFrame(
+			const size_t bodyOffset,
+			const size_t fragmentLen);
+
+	size_t beginFrame(
+			const size_t payloadLen);
+
+	void endFrame(
+			const size_t frameOffset,
+			const uint8_t frameType,
+			const size_t payloadLen);
+
+	void appendSegment(
+			const bool isBody,
+			const size_t offset,
+			const size_t length);
+
+	void putUint8(
+			const size_t offset,
+			const uint8_t value);
+
+	void putUint16(
+			const size_t offset,
+			const uint16_t value);
+
+	void putUint32(
+			const size_t offset,
+			const uint32_t value);
+
+	void putUint64(
+			const size_t offset,
+			const uint64_t value);
+
+private:
+	bool _isInitialized;
+	amqp_channel_t _channel;
+	SmartPtrCDynamicByteArray _body;
+	std::string _frameBytes;
+	std::vector<SSegment> _segments;
+	bool _isSent;
+	int32 _status;
+
+private:
+	CAF_CM_CREATE;
+	CAF_CM_DECLARE_NOCOPY(CAmqpPublishFrames);
+};
+CAF_DECLARE_SMART_POINTER(CAmqpPublishFrames);
+
+}}
+
+#endif /* AMQPCLIENT_CAMQPPUBLISHFRAMES_H_ */
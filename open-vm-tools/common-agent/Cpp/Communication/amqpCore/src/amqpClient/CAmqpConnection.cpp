@@ -16,6 +16,14 @@
 #include "amqpClient/CAmqpConnection.h"
 #include "Exception/CCafException.h"
 
+#ifndef WIN32
+#include <sys/socket.h>
+#endif
+
+// The longest a publish waits, holding the connection lock, for a peer that
+// has stopped reading
+static const int32 PUBLISH_WRITE_TIMEOUT_MS = 30 * 1000;
+
 using namespace Caf::AmqpClient;
 
 CAmqpConnection::CAmqpConnection() :
@@ -32,6 +40,8 @@ CAmqpConnection::CAmqpConnection() :
 	_secondsToWait(0),
 	CAF_CM_INIT_LOG("CAmqpConnection") {
 	CAF_CM_INIT_THREADSAFE;
+	_publishMutex.CreateInstance();
+	_publishMutex->initialize();
 }
 
 CAmqpConnection::~CAmqpConnection() {
@@ -471,26 +481,69 @@ AMQPStatus CAmqpConnection::basicPublish(
 			"Calling amqp_basic_publish - channel: %d, exchange: %s, routingKey: %s",
 			channel, exchange.c_str(), routingKey.c_str());
 
-	CAF_CM_LOCK_UNLOCK;
-	CAF_CM_VALIDATE_PTR(_connectionState);
-	CAF_CM_VALIDATE_BOOL(_connectionStateEnum == AMQP_STATE_CONNECTED);
-	validateOpenChannel(channel);
+	uint32 frameMax = 0;
+	{
+		CAF_CM_LOCK_UNLOCK;
+		CAF_CM_VALIDATE_PTR(_connectionState);
+		CAF_CM_VALIDATE_BOOL(_connectionStateEnum == AMQP_STATE_CONNECTED);
+		validateOpenChannel(channel);
+
+		if (! isVectoredPublish()) {
+			amqp_bytes_t bodyRaw;
+			bodyRaw.bytes = body->getNonConstPtr();
+			bodyRaw.len = body->getByteCount();
+
+			_lastStatus = AmqpCommon::validateStatus(
+					"amqp_basic_publish",
+					amqp_basic_publish(
+							_connectionState,
+							channel,
+							amqp_cstring_bytes(exchange.c_str()),
+							amqp_cstring_bytes(routingKey.c_str()),
+							mandatory ? TRUE : FALSE,
+							immediate ? TRUE : FALSE,
+							basicProps,
+							bodyRaw));
+
+			return AMQP_ERROR_OK;
+		}
 
-	amqp_bytes_t bodyRaw;
-	bodyRaw.bytes = body->getNonConstPtr();
-	bodyRaw.len = body->getByteCount();
+		frameMax = static_cast<uint32>(amqp_get_frame_max(_connectionState));
+	}
+
+	// Encoded outside of the connection lock; the body is referenced, not copied
+	SmartPtrCAmqpPublishFrames publishFrames;
+	publishFrames.CreateInstance();
+	const int32 status = publishFrames->initialize(
+			channel,
+			frameMax,
+			exchange,
+			routingKey,
+			mandatory,
+			immediate,
+			basicProps,
+			body);
+	if (status < 0) {
+		CAF_CM_LOCK_UNLOCK;
+		_lastStatus = AmqpCommon::validateStatus("amqp_basic_publish", status);
+		return AMQP_ERROR_OK;
+	}
+
+	{
+		CAF_CM_LOCK_UNLOCK1(_publishMutex);
+		_publishFrames.push_back(publishFrames);
+	}
+
+	// The next holder of the connection lock writes every publish queued so
+	// far, so publishers that pile up behind a write share a single syscall.
+	CAF_CM_LOCK_UNLOCK;
+	if (! publishFrames->isSent()) {
+		flushPublishFrames();
+	}
 
 	_lastStatus = AmqpCommon::validateStatus(
 			"amqp_basic_publish",
-			amqp_basic_publish(
-					_connectionState,
-					channel,
-					amqp_cstring_bytes(exchange.c_str()),
-					amqp_cstring_bytes(routingKey.c_str()),
-					mandatory ? TRUE : FALSE,
-					immediate ? TRUE : FALSE,
-					basicProps,
-					bodyRaw));
+			publishFrames->getStatus());
 
 	return AMQP_ERROR_OK;
 }
@@ -1057,3 +1110,92 @@ void CAmqpConnection::restartListener(
 
 	FileSystemUtils::saveTextFile(monitorDirExp, "restartListener.txt", reason);
 }
+
+bool CAmqpConnection::isVectoredPublish() const {
+#ifdef WIN32
+	return false;
+#else
+	// TLS connections write through the SSL socket, so only plain TCP
+	// connections can hand the frames to the kernel directly
+	return (PROTOCOL_AMQP == _address->getProtocol());
+#endif
+}
+
+void CAmqpConnection::flushPublishFrames() {
+	CAF_CM_FUNCNAME_VALIDATE("flushPublishFrames");
+
+	CPublishFrames publishFrames;
+	{
+		CAF_CM_LOCK_UNLOCK1(_publishMutex);
+		publishFrames.swap(_publishFrames);
+	}
+
+#ifndef WIN32
+	std::vector<struct iovec> iovecs;
+	CPublishFrames writeFrames;
+	for (TConstIterator<CPublishFrames> publishFramesIter(publishFrames);
+			publishFramesIter; publishFramesIter++) {
+		const SmartPtrCAmqpPublishFrames publishFramesTmp = *publishFramesIter;
+
+		// The connection or channel may have been closed since the publish
+		// was queued
+		if ((NULL == _connectionState) ||
+				(_connectionStateEnum != AMQP_STATE_CONNECTED)) {
+			publishFramesTmp->setSent(AMQP_STATUS_CONNECTION_CLOSED);
+		} else if (_openChannels.end() == _openChannels.find(publishFramesTmp->getChannel())) {
+			publishFramesTmp->setSent(AMQP_STATUS_INVALID_PARAMETER);
+		} else {
+			publishFramesTmp->appendIovecs(iovecs);
+			writeFrames.push_back(publishFramesTmp);
+		}
+	}
+
+	if (! writeFrames.empty()) {
+		CAF_CM_LOG_DEBUG_VA2(
+				"Writing publishes - count: %d, iovecs: %d",
+				static_cast<int32>(writeFrames.size()), static_cast<int32>(iovecs.size()));
+
+		size_t bytesWritten = 0;
+		const int32 status = CAmqpPublishFrames::writeIovecs(
+				amqp_get_sockfd(_connectionState),
+				PUBLISH_WRITE_TIMEOUT_MS,
+				iovecs,
+				bytesWritten);
+		for (TConstIterator<CPublishFrames> writeFramesIter(writeFrames);
+				writeFramesIter; writeFramesIter++) {
+			(*writeFramesIter)->setSent(status);
+		}
+
+		// The broker would read whatever follows a partial frame as part of
+		// it, so nothing else can be sent on this connection
+		if ((AMQP_STATUS_OK != status) && (bytesWritten > 0)) {
+			abortConnection(amqp_error_string2(status));
+		}
+	}
+#else
+	CAF_CM_VALIDATE_BOOL(publishFrames.empty());
+#endif
+}
+
+#ifndef WIN32
+void CAmqpConnection::abortConnection(
+		const std::string& reason) {
+	CAF_CM_FUNCNAME_VALIDATE("abortConnection");
+	CAF_CM_VALIDATE_PTR(_connectionState);
+	CAF_CM_VALIDATE_STRING(reason);
+
+	CAF_CM_LOG_ERROR_VA1("Partial publish write... aborting connection - %s",
+		reason.c_str());
+
+	// The close handshake would follow the partial frame, so skip it.  Shutting
+	// the socket down makes the broker drop the connection and fails every
+	// later read and write, which restarts the listener like any other lost
+	// connection.
+	::shutdown(amqp_get_sockfd(_connectionState), SHUT_RDWR);
+
+	if (! _isConnectionLost) {
+		_isConnectionLost = true;
+		restartListener(reason);
+	}
+}
+#endif
@@ -0,0 +1,355 @@
+/*
+ *	Copyright (C) 2016 VMware, Inc.  All rights reserved. -- VMware Confidential
+ */
+
+#include "stdafx.h"
+#include "amqpClient/CAmqpPublishFrames.h"
+
+#ifndef WIN32
+#include <sys/socket.h>
+#include <errno.h>
+#include <limits.h>
+#include <poll.h>
+#endif
+
+#ifndef IOV_MAX
+#define IOV_MAX 16
+#endif
+
+using namespace Caf::AmqpClient;
+
+// Frame type (1), channel (2) and payload size (4)
+static const size_t FRAME_HEADER_SIZE = 7;
+
+// Frame end octet
+static const size_t FRAME_FOOTER_SIZE = 1;
+
+// Method id (4)
+static const size_t METHOD_PREFIX_SIZE = 4;
+
+// Class id (2), weight (2) and body size (8)
+static const size_t HEADER_PREFIX_SIZE = 12;
+
+// Method arguments and typical properties fit; larger ones are retried
+// with the full frame size
+static const size_t INITIAL_ENCODE_SIZE = 4096;
+
+CAmqpPublishFrames::CAmqpPublishFrames() :
+	_isInitialized(false),
+	_channel(0),
+	_isSent(false),
+	_status(AMQP_STATUS_OK),
+	CAF_CM_INIT("CAmqpPublishFrames") {
+}
+
+CAmqpPublishFrames::~CAmqpPublishFrames() {
+}
+
+int32 CAmqpPublishFrames::initialize(
+		const amqp_channel_t& channel,
+		const uint32 frameMax,
+		const std::string& exchange,
+		const std::string& routingKey,
+		const bool mandatory,
+		const bool immediate,
+		const amqp_basic_properties_t *basicProps,
+		const SmartPtrCDynamicByteArray& body) {
+	CAF_CM_FUNCNAME_VALIDATE("initialize");
+	CAF_CM_PRECOND_ISNOTINITIALIZED(_isInitialized);
+	CAF_CM_VALIDATE_PTR(basicProps);
+	CAF_CM_VALIDATE_SMARTPTR(body);
+	CAF_CM_VALIDATE_BOOL(frameMax > (FRAME_HEADER_SIZE + FRAME_FOOTER_SIZE + HEADER_PREFIX_SIZE));
+
+	_channel = channel;
+	_body = body;
+
+	const size_t maxPayloadLen = frameMax - FRAME_HEADER_SIZE - FRAME_FOOTER_SIZE;
+	const size_t bodyLen = _body->getByteCount();
+
+	amqp_basic_publish_t method = {};
+	method.exchange = amqp_cstring_bytes(exchange.c_str());
+	method.routing_key = amqp_cstring_bytes(routingKey.c_str());
+	AmqpCommon::boolToAmqpBool(mandatory, method.mandatory);
+	AmqpCommon::boolToAmqpBool(immediate, method.immediate);
+
+	int32 status = appendMethodFrame(maxPayloadLen, method);
+	if (status >= 0) {
+		status = appendHeaderFrame(maxPayloadLen, bodyLen, basicProps);
+	}
+
+	if (status >= 0) {
+		size_t bodyOffset = 0;
+		while (bodyOffset < bodyLen) {
+			const size_t fragmentLen = std::min(maxPayloadLen, bodyLen - bodyOffset);
+			appendBodyFrame(bodyOffset, fragmentLen);
+			bodyOffset += fragmentLen;
+		}
+		status = AMQP_STATUS_OK;
+	}
+
+	_isInitialized = true;
+
+	return status;
+}
+
+amqp_channel_t CAmqpPublishFrames::getChannel() const {
+	CAF_CM_FUNCNAME_VALIDATE("getChannel");
+	CAF_CM_PRECOND_ISINITIALIZED(_isInitialized);
+
+	return _channel;
+}
+
+#ifndef WIN32
+void CAmqpPublishFrames::appendIovecs(
+		std::vector<struct iovec>& iovecs) const {
+	CAF_CM_FUNCNAME_VALIDATE("appendIovecs");
+	CAF_CM_PRECOND_ISINITIALIZED(_isInitialized);
+
+	const byte* bodyBytes = _body->getPtr();
+	for (std::vector<SSegment>::const_iterator segment = _segments.begin();
+			segment != _segments.end(); segment++) {
+		struct iovec iov;
+		if (segment->_isBody) {
+			iov.iov_base = const_cast<byte*>(bodyBytes + segment->_offset);
+		} else {
+			iov.iov_base = const_cast<char*>(_frameBytes.data() + segment->_offset);
+		}
+		iov.iov_len = segment->_length;
+		iovecs.push_back(iov);
+	}
+}
+
+int32 CAmqpPublishFrames::writeIovecs(
+		const int sockfd,
+		const int32 timeoutMs,
+		std::vector<struct iovec>& iovecs,
+		size_t& bytesWritten) {
+	int flags = 0;
+#ifdef MSG_NOSIGNAL
+	flags |= MSG_NOSIGNAL;
+#endif
+
+	bytesWritten = 0;
+	const gint64 deadline = g_get_monotonic_time() +
+			(static_cast<gint64>(timeoutMs) * G_GINT64_CONSTANT(1000));
+
+	size_t iovIndex = 0;
+	while (iovIndex < iovecs.size()) {
+		struct msghdr msg = {};
+		msg.msg_iov = &iovecs[iovIndex];
+		msg.msg_iovlen = std::min(iovecs.size() - iovIndex, static_cast<size_t>(IOV_MAX));
+
+		const ssize_t written = ::sendmsg(sockfd, &msg, flags);
+		if (written < 0) {
+			if (EINTR == errno) {
+				continue;
+			}
+
+			// librabbitmq leaves the socket non-blocking.  The caller holds the
+			// connection lock, so a peer that stops reading must not block it
+			// forever.
+			if ((EAGAIN == errno) || (EWOULDBLOCK == errno)) {
+				const gint64 remainingMs = (deadline - g_get_monotonic_time()) / 1000;
+				if (remainingMs <= 0) {
+					return AMQP_STATUS_TIMEOUT;
+				}
+
+				struct pollfd pfd;
+				pfd.fd = sockfd;
+				pfd.events = POLLOUT;
+				pfd.revents = 0;
+				if ((::poll(&pfd, 1, static_cast<int>(remainingMs)) < 0) && (EINTR != errno)) {
+					return AMQP_STATUS_SOCKET_ERROR;
+				}
+				continue;
+			}
+
+			return AMQP_STATUS_SOCKET_ERROR;
+		}
+
+		bytesWritten += static_cast<size_t>(written);
+
+		// Skip what was written, trimming a partially written iovec
+		size_t remaining = static_cast<size_t>(written);
+		while ((iovIndex < iovecs.size()) && (remaining >= iovecs[iovIndex].iov_len)) {
+			remaining -= iovecs[iovIndex].iov_len;
+			iovIndex++;
+		}
+		if (remaining > 0) {
+			iovecs[iovIndex].iov_base = static_cast<char*>(iovecs[iovIndex].iov_base) + remaining;
+			iovecs[iovIndex].iov_len -= remaining;
+		}
+	}
+
+	return AMQP_STATUS_OK;
+}
+#endif
+
+void CAmqpPublishFrames::setSent(
+		const int32 status) {
+	CAF_CM_FUNCNAME_VALIDATE("setSent");
+	CAF_CM_PRECOND_ISINITIALIZED(_isInitialized);
+
+	_isSent = true;
+	_status = status;
+}
+
+bool CAmqpPublishFrames::isSent() const {
+	CAF_CM_FUNCNAME_VALIDATE("isSent");
+	CAF_CM_PRECOND_ISINITIALIZED(_isInitialized);
+
+	return _isSent;
+}
+
+int32 CAmqpPublishFrames::getStatus() const {
+	CAF_CM_FUNCNAME_VALIDATE("getStatus");
+	CAF_CM_PRECOND_ISINITIALIZED(_isInitialized);
+
+	return _status;
+}
+
+int32 CAmqpPublishFrames::appendMethodFrame(
+		const size_t maxPayloadLen,
+		amqp_basic_publish_t& method) {
+	size_t encodeLen = std::min(maxPayloadLen, INITIAL_ENCODE_SIZE);
+	int32 status = AMQP_STATUS_OK;
+	while (true) {
+		const size_t frameOffset = beginFrame(encodeLen);
+		const size_t payloadOffset = frameOffset + FRAME_HEADER_SIZE;
+		putUint32(payloadOffset, AMQP_BASIC_PUBLISH_METHOD);
+
+		amqp_bytes_t encoded;
+		encoded.bytes = &_frameBytes[payloadOffset + METHOD_PREFIX_SIZE];
+		encoded.len = encodeLen - METHOD_PREFIX_SIZE;
+		status = amqp_encode_method(AMQP_BASIC_PUBLISH_METHOD, &method, encoded);
+		if (status >= 0) {
+			endFrame(frameOffset, AMQP_FRAME_METHOD, METHOD_PREFIX_SIZE + status);
+			break;
+		}
+
+		_frameBytes.resize(frameOffset);
+		if (encodeLen == maxPayloadLen) {
+			break;
+		}
+		encodeLen = maxPayloadLen;
+	}
+
+	return status;
+}
+
+int32 CAmqpPublishFrames::appendHeaderFrame(
+		const size_t maxPayloadLen,
+		const uint64_t bodySize,
+		const amqp_basic_properties_t *basicProps) {
+	size_t encodeLen = std::min(maxPayloadLen, INITIAL_ENCODE_SIZE);
+	int32 status = AMQP_STATUS_OK;
+	while (true) {
+		const size_t frameOffset = beginFrame(encodeLen);
+		const size_t payloadOffset = frameOffset + FRAME_HEADER_SIZE;
+		putUint16(payloadOffset, AMQP_BASIC_CLASS);
+		putUint16(payloadOffset + 2, 0);
+		putUint64(payloadOffset + 4, bodySize);
+
+		amqp_bytes_t encoded;
+		encoded.bytes = &_frameBytes[payloadOffset + HEADER_PREFIX_SIZE];
+		encoded.len = encodeLen - HEADER_PREFIX_SIZE;
+		status = amqp_encode_properties(AMQP_BASIC_CLASS,
+				const_cast<amqp_basic_properties_t*>(basicProps), encoded);
+		if (status >= 0) {
+			endFrame(frameOffset, AMQP_FRAME_HEADER, HEADER_PREFIX_SIZE + status);
+			break;
+		}
+
+		_frameBytes.resize(frameOffset);
+		if (encodeLen == maxPayloadLen) {
+			break;
+		}
+		encodeLen = maxPayloadLen;
+	}
+
+	return status;
+}
+
+void CAmqpPublishFrames::appendBodyFrame(
+		const size_t bodyOffset,
+		const size_t fragmentLen) {
+	size_t frameOffset = beginFrame(0);
+	putUint8(frameOffset, AMQP_FRAME_BODY);
+	putUint16(frameOffset + 1, _channel);
+	putUint32(frameOffset + 3, static_cast<uint32_t>(fragmentLen));
+	appendSegment(false, frameOffset, FRAME_HEADER_SIZE);
+
+	appendSegment(true, bodyOffset, fragmentLen);
+
+	frameOffset = _frameBytes.size();
+	_frameBytes.push_back(static_cast<char>(AMQP_FRAME_END));
+	appendSegment(false, frameOffset, FRAME_FOOTER_SIZE);
+}
+
+size_t CAmqpPublishFrames::beginFrame(
+		const size_t payloadLen) {
+	const size_t frameOffset = _frameBytes.size();
+	_frameBytes.resize(frameOffset + FRAME_HEADER_SIZE + payloadLen);
+
+	return frameOffset;
+}
+
+void CAmqpPublishFrames::endFrame(
+		const size_t frameOffset,
+		const uint8_t frameType,
+		const size_t payloadLen) {
+	putUint8(frameOffset, frameType);
+	putUint16(frameOffset + 1, _channel);
+	putUint32(frameOffset + 3, static_cast<uint32_t>(payloadLen));
+
+	_frameBytes.resize(frameOffset + FRAME_HEADER_SIZE + payloadLen);
+	_frameBytes.push_back(static_cast<char>(AMQP_FRAME_END));
+	appendSegment(false, frameOffset, FRAME_HEADER_SIZE + payloadLen + FRAME_FOOTER_SIZE);
+}
+
+void CAmqpPublishFrames::appendSegment(
+		const bool isBody,
+		const size_t offset,
+		const size_t length) {
+	// Adjacent owned bytes are written as one segment
+	if (! isBody && ! _segments.empty()) {
+		SSegment& last = _segments.back();
+		if (! last._isBody && ((last._offset + last._length) == offset)) {
+			last._length += length;
+			return;
+		}
+	}
+
+	SSegment segment;
+	segment._isBody = isBody;
+	segment._offset = offset;
+	segment._length = length;
+	_segments.push_back(segment);
+}
+
+void CAmqpPublishFrames::putUint8(
+		const size_t offset,
+		const uint8_t value) {
+	_frameBytes[offset] = static_cast<char>(value);
+}
+
+void CAmqpPublishFrames::putUint16(
+		const size_t offset,
+		const uint16_t value) {
+	putUint8(offset, static_cast<uint8_t>(value >> 8));
+	putUint8(offset + 1, static_cast<uint8_t>(value));
+}
+
+void CAmqpPublishFrames::putUint32(
+		const size_t offset,
+		const uint32_t value) {
+	putUint16(offset, static_cast<uint16_t>(value >> 16));
+	putUint16(offset + 2, static_cast<uint16_t>(value));
+}
+
+void CAmqpPublishFrames::putUint64(
+		const size_t offset,
+		const uint64_t value) {
+	putUint32(offset, static_cast<uint32_t>(value >> 32));
+	putUint32(offset + 4, static_cast<uint32_t>(value));
+}
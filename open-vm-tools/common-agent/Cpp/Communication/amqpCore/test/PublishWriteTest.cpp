@@ -0,0 +1,301 @@
+/*
+ *	Copyright (C) 2016 VMware, Inc.  All rights reserved. -- VMware Confidential
+ *
+ *	Writes publish frames over a socketpair and checks that every frame
+ *	arrives intact, that a peer which stops reading only holds the writer up
+ *	to its timeout, and that a write which fails part way reports the bytes
+ *	it left on the socket.
+ */
+
+#include "stdafx.h"
+
+#include "amqpClient/CAmqpPublishFrames.h"
+#include "Exception/CCafException.h"
+#include <fcntl.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+using namespace Caf;
+using namespace Caf::AmqpClient;
+
+static uint32 _gFailures = 0;
+
+#define TEST_CHECK(cond) \
+	do { \
+		if (! (cond)) { \
+			::fprintf(stderr, "%s:%d: check failed: %s\n", __FILE__, __LINE__, #cond); \
+			++_gFailures; \
+		} \
+	} while (0)
+
+static const uint32 FRAME_MAX = 4096;
+
+// Small enough that the writer regularly finds the socket full
+static const int SEND_BUFFER_SIZE = 16 * 1024;
+
+struct SPeer {
+	int _fd;
+	bool _isReading;
+	gulong _closeAfterUs;
+	size_t _bytesRead;
+	uint32 _publishes;
+	bool _isValid;
+};
+
+static uint32 getUint32(const byte* bytes) {
+	return (static_cast<uint32>(bytes[0]) << 24) | (static_cast<uint32>(bytes[1]) << 16) |
+			(static_cast<uint32>(bytes[2]) << 8) | static_cast<uint32>(bytes[3]);
+}
+
+static uint64 getUint64(const byte* bytes) {
+	return (static_cast<uint64>(getUint32(bytes)) << 32) | getUint32(bytes + 4);
+}
+
+// Reads the frame stream until EOF, counting the publishes whose method,
+// content header and body frames all arrived intact
+static gpointer peerThread(gpointer data) {
+	SPeer* peer = static_cast<SPeer*>(data);
+
+	if (! peer->_isReading) {
+		::g_usleep(peer->_closeAfterUs);
+		::close(peer->_fd);
+		return NULL;
+	}
+
+	std::string stream;
+	uint64 bodyRemaining = 0;
+	byte buffer[65536];
+	ssize_t bytesRead = 0;
+	while ((bytesRead = ::read(peer->_fd, buffer, sizeof(buffer))) > 0) {
+		peer->_bytesRead += static_cast<size_t>(bytesRead);
+		stream.append(reinterpret_cast<char*>(buffer), static_cast<size_t>(bytesRead));
+
+		size_t offset = 0;
+		while ((stream.size() - offset) >= 8) {
+			const byte* frame = reinterpret_cast<const byte*>(stream.data() + offset);
+			const uint32 payloadLen = getUint32(frame + 3);
+			if ((stream.size() - offset) < (static_cast<size_t>(payloadLen) + 8)) {
+				break;
+			}
+
+			if ((frame[7 + payloadLen] != AMQP_FRAME_END) ||
+					(((frame[1] << 8) | frame[2]) != 1)) {
+				peer->_isValid = false;
+			}
+
+			switch (frame[0]) {
+			case AMQP_FRAME_METHOD:
+				if ((bodyRemaining != 0) ||
+						(getUint32(frame + 7) != AMQP_BASIC_PUBLISH_METHOD)) {
+					peer->_isValid = false;
+				}
+				break;
+			case AMQP_FRAME_HEADER:
+				bodyRemaining = getUint64(frame + 7 + 4);
+				if (0 == bodyRemaining) {
+					++peer->_publishes;
+				}
+				break;
+			case AMQP_FRAME_BODY:
+				if (payloadLen > bodyRemaining) {
+					peer->_isValid = false;
+				} else {
+					bodyRemaining -= payloadLen;
+					if (0 == bodyRemaining) {
+						++peer->_publishes;
+					}
+				}
+				break;
+			default:
+				peer->_isValid = false;
+			}
+
+			offset += static_cast<size_t>(payloadLen) + 8;
+		}
+		stream.erase(0, offset);
+	}
+
+	::close(peer->_fd);
+	return NULL;
+}
+
+static void createSocketPair(int fds[2]) {
+	const int rc = ::socketpair(AF_UNIX, SOCK_STREAM, 0, fds);
+	TEST_CHECK(0 == rc);
+
+	// librabbitmq leaves its sockets non-blocking
+	TEST_CHECK(::fcntl(fds[0], F_SETFL, ::fcntl(fds[0], F_GETFL) | O_NONBLOCK) == 0);
+	TEST_CHECK(::setsockopt(fds[0], SOL_SOCKET, SO_SNDBUF,
+			&SEND_BUFFER_SIZE, sizeof(SEND_BUFFER_SIZE)) == 0);
+}
+
+static SmartPtrCAmqpPublishFrames createPublish(const size_t bodyLen) {
+	SmartPtrCDynamicByteArray body;
+	body.CreateInstance();
+	body->allocateBytes(bodyLen);
+	byte* bodyBytes = body->getNonConstPtr();
+	for (size_t index = 0; index < bodyLen; index++) {
+		bodyBytes[index] = static_cast<byte>('a' + (index % 26));
+	}
+
+	amqp_basic_properties_t basicProps = {};
+	SmartPtrCAmqpPublishFrames publishFrames;
+	publishFrames.CreateInstance();
+	TEST_CHECK(publishFrames->initialize(1, FRAME_MAX, "amq.direct", "routingKey",
+			false, false, &basicProps, body) == AMQP_STATUS_OK);
+
+	return publishFrames;
+}
+
+static size_t getByteCount(const std::vector<struct iovec>& iovecs) {
+	size_t byteCount = 0;
+	for (std::vector<struct iovec>::const_iterator iov = iovecs.begin();
+			iov != iovecs.end(); iov++) {
+		byteCount += iov->iov_len;
+	}
+
+	return byteCount;
+}
+
+// Enough publishes that the write takes several IOV_MAX sized chunks, each
+// of which the small send buffer splits
+static void checkFullWrite(const uint32 numPublishes) {
+	int fds[2];
+	createSocketPair(fds);
+
+	SPeer peer = { fds[1], true, 0, 0, 0, true };
+	GThread* thread = ::g_thread_new("peer", peerThread, &peer);
+
+	std::vector<SmartPtrCAmqpPublishFrames> publishes;
+	std::vector<struct iovec> iovecs;
+	for (uint32 index = 0; index < numPublishes; index++) {
+		publishes.push_back(createPublish((index % 3) * FRAME_MAX + index + 1));
+		publishes.back()->appendIovecs(iovecs);
+	}
+	const size_t byteCount = getByteCount(iovecs);
+
+	size_t bytesWritten = 0;
+	const int32 status = CAmqpPublishFrames::writeIovecs(
+			fds[0], 10 * 1000, iovecs, bytesWritten);
+	::close(fds[0]);
+	::g_thread_join(thread);
+
+	TEST_CHECK(AMQP_STATUS_OK == status);
+	TEST_CHECK(bytesWritten == byteCount);
+	TEST_CHECK(peer._bytesRead == byteCount);
+	TEST_CHECK(peer._publishes == numPublishes);
+	TEST_CHECK(peer._isValid);
+}
+
+// A peer that never reads holds the writer up only until the timeout, and
+// the frame it left on the socket is reported
+static void checkBoundedWait(const int32 timeoutMs) {
+	int fds[2];
+	createSocketPair(fds);
+
+	std::vector<struct iovec> iovecs;
+	const SmartPtrCAmqpPublishFrames publish = createPublish(4 * 1024 * 1024);
+	publish->appendIovecs(iovecs);
+	const size_t byteCount = getByteCount(iovecs);
+
+	size_t bytesWritten = 0;
+	const gint64 startUs = ::g_get_monotonic_time();
+	const int32 status = CAmqpPublishFrames::writeIovecs(
+			fds[0], timeoutMs, iovecs, bytesWritten);
+	const gint64 elapsedMs = (::g_get_monotonic_time() - startUs) / 1000;
+
+	TEST_CHECK(AMQP_STATUS_TIMEOUT == status);
+	TEST_CHECK(elapsedMs >= (timeoutMs - 10));
+	TEST_CHECK(elapsedMs < (timeoutMs + 1000));
+	TEST_CHECK((bytesWritten > 0) && (bytesWritten < byteCount));
+
+	::close(fds[0]);
+	::close(fds[1]);
+}
+
+// A peer that goes away while the writer waits fails the write right away,
+// part way through the frame
+static void checkPeerCloseDuringWrite() {
+	int fds[2];
+	createSocketPair(fds);
+
+	SPeer peer = { fds[1], false, 100 * 1000, 0, 0, true };
+	GThread* thread = ::g_thread_new("peer", peerThread, &peer);
+
+	std::vector<struct iovec> iovecs;
+	const SmartPtrCAmqpPublishFrames publish = createPublish(4 * 1024 * 1024);
+	publish->appendIovecs(iovecs);
+	const size_t byteCount = getByteCount(iovecs);
+
+	size_t bytesWritten = 0;
+	const gint64 startUs = ::g_get_monotonic_time();
+	const int32 status = CAmqpPublishFrames::writeIovecs(
+			fds[0], 30 * 1000, iovecs, bytesWritten);
+	const gint64 elapsedMs = (::g_get_monotonic_time() - startUs) / 1000;
+	::g_thread_join(thread);
+
+	TEST_CHECK(AMQP_STATUS_SOCKET_ERROR == status);
+	TEST_CHECK(elapsedMs < 5000);
+	TEST_CHECK((bytesWritten > 0) && (bytesWritten < byteCount));
+
+	::close(fds[0]);
+}
+
+// A write that fails before sending anything leaves the stream intact
+static void checkPeerClosedBeforeWrite() {
+	int fds[2];
+	createSocketPair(fds);
+	::close(fds[1]);
+
+	std::vector<struct iovec> iovecs;
+	const SmartPtrCAmqpPublishFrames publish = createPublish(FRAME_MAX);
+	publish->appendIovecs(iovecs);
+
+	size_t bytesWritten = 1;
+	const int32 status = CAmqpPublishFrames::writeIovecs(
+			fds[0], 1000, iovecs, bytesWritten);
+
+	TEST_CHECK(AMQP_STATUS_SOCKET_ERROR == status);
+	TEST_CHECK(0 == bytesWritten);
+
+	::close(fds[0]);
+}
+
+int32 main(int32 argc, char** argv) {
+	uint32 numPublishes = 2000;
+	int32 timeoutMs = 200;
+
+	int32 opt = 0;
+	while ((opt = ::getopt(argc, argv, "n:w:")) != -1) {
+		switch (opt) {
+		case 'n':
+			numPublishes = ::strtoul(optarg, NULL, 0);
+			break;
+		case 'w':
+			timeoutMs = ::strtol(optarg, NULL, 0);
+			break;
+		default:
+			::fprintf(stderr, "Usage: %s [-n publishes] [-w timeoutMs]\n", argv[0]);
+			return 2;
+		}
+	}
+
+	try {
+		checkFullWrite(numPublishes);
+		checkBoundedWait(timeoutMs);
+		checkPeerCloseDuringWrite();
+		checkPeerClosedBeforeWrite();
+	} catch (CCafException* ex) {
+		::fprintf(stderr, "Exception: %s\n", ex->getFullMsg().c_str());
+		ex->Release();
+		return 1;
+	}
+
+	if (_gFailures > 0) {
+		::fprintf(stderr, "%u check(s) failed\n", _gFailures);
+		return 1;
+	}
+
+	::printf("All checks passed\n");
+	return 0;
+}
@@ -0,0 +1,243 @@
+/*
+ *	Copyright (C) 2016 VMware, Inc.  All rights reserved. -- VMware Confidential
+ *
+ *	Checks that CIniFile picks up rewrites that keep the size, inode and
+ *	whole-second mtime of the file, and times lookups, change checks and
+ *	reparses.
+ */
+
+#include "stdafx.h"
+
+#include "Common/CIniFile.h"
+#include "Exception/CCafException.h"
+#include <fcntl.h>
+#include <fstream>
+#include <sys/stat.h>
+#include <unistd.h>
+
+using namespace Caf;
+
+static uint32 _gFailures = 0;
+
+#define BENCH_CHECK(cond) \
+	do { \
+		if (! (cond)) { \
+			::fprintf(stderr, "%s:%d: check failed: %s\n", __FILE__, __LINE__, #cond); \
+			++_gFailures; \
+		} \
+	} while (0)
+
+// Just past the CIniFile check interval
+static const gulong CHECK_INTERVAL_US = 1100 * 1000;
+
+// Just past the CIniFile racy window, after which a check only stats
+static const gulong RACY_WINDOW_US = 2100 * 1000;
+
+static double benchNowUs() {
+	return static_cast<double>(::g_get_monotonic_time());
+}
+
+// Rewrites the file in place, so the inode stays the same
+static void writeFile(const std::string& path, const std::string& contents) {
+	std::ofstream file(path.c_str(), std::ios::out | std::ios::binary | std::ios::trunc);
+	file << contents;
+}
+
+static std::string sectionContents(const char* value) {
+	std::string contents = "[globals]\nroot=/opt/caf\n[section]\nkey=";
+	contents += value;
+	contents += "\n";
+	return contents;
+}
+
+static void checkRewrites(const std::string& dir) {
+	const std::string path = dir + "/IniFileBench.check.ini";
+
+	// A same-size rewrite within the same second
+	writeFile(path, sectionContents("aaaa"));
+	CIniFile iniFile;
+	iniFile.initialize(path);
+	BENCH_CHECK(iniFile.findOptionalString("section", "key") == "aaaa");
+
+	::g_usleep(10 * 1000);
+	writeFile(path, sectionContents("bbbb"));
+	::g_usleep(CHECK_INTERVAL_US);
+	BENCH_CHECK(iniFile.findOptionalString("section", "key") == "bbbb");
+
+	// A same-size rewrite that puts the old mtime back
+	::g_usleep(RACY_WINDOW_US);
+	BENCH_CHECK(iniFile.findOptionalString("section", "key") == "bbbb");
+	struct stat statBuf;
+	BENCH_CHECK(::stat(path.c_str(), &statBuf) == 0);
+	writeFile(path, sectionContents("cccc"));
+	struct timespec times[2] = { statBuf.st_atim, statBuf.st_mtim };
+	BENCH_CHECK(::utimensat(AT_FDCWD, path.c_str(), times, 0) == 0);
+	::g_usleep(CHECK_INTERVAL_US);
+	BENCH_CHECK(iniFile.findOptionalString("section", "key") == "cccc");
+
+	// Replacing the file is seen as well
+	const std::string tmpPath = path + ".tmp";
+	writeFile(tmpPath, sectionContents("dddd"));
+	BENCH_CHECK(::rename(tmpPath.c_str(), path.c_str()) == 0);
+	::g_usleep(CHECK_INTERVAL_US);
+	BENCH_CHECK(iniFile.findOptionalString("section", "key") == "dddd");
+
+	// As are the object's own writes, straight away
+	iniFile.setValue("section", "key", "eeee");
+	BENCH_CHECK(iniFile.findOptionalString("section", "key") == "eeee");
+
+	::unlink(path.c_str());
+}
+
+static std::string benchContents(const uint32 numSections, const uint32 numKeys, const uint32 generation) {
+	char buf[128];
+	std::string contents = "[globals]\nroot=/opt/caf\n";
+	for (uint32 section = 0; section < numSections; section++) {
+		::snprintf(buf, sizeof(buf), "[section%u]\n", section);
+		contents += buf;
+		for (uint32 key = 0; key < numKeys; key++) {
+			::snprintf(buf, sizeof(buf), "key%u=${root}/gen%u/value%u\n", key, generation, key);
+			contents += buf;
+		}
+	}
+	return contents;
+}
+
+static void runBench(
+	const std::string& dir,
+	const uint32 numSections,
+	const uint32 numKeys,
+	const uint32 numLookups,
+	const uint32 rounds) {
+	const std::string path = dir + "/IniFileBench.bench.ini";
+	writeFile(path, benchContents(numSections, numKeys, 0));
+
+	CIniFile iniFile;
+	double start = benchNowUs();
+	iniFile.initialize(path);
+	iniFile.findOptionalString("section0", "key0");
+	const double loadUs = benchNowUs() - start;
+
+	std::deque<std::string> sectionNames;
+	std::deque<std::string> keyNames;
+	char buf[32];
+	for (uint32 section = 0; section < numSections; section++) {
+		::snprintf(buf, sizeof(buf), "section%u", section);
+		sectionNames.push_back(buf);
+	}
+	for (uint32 key = 0; key < numKeys; key++) {
+		::snprintf(buf, sizeof(buf), "key%u", key);
+		keyNames.push_back(buf);
+	}
+
+	size_t totalLen = 0;
+	start = benchNowUs();
+	for (uint32 lookup = 0; lookup < numLookups; lookup++) {
+		totalLen += iniFile.findOptionalString(
+			sectionNames[lookup % numSections], keyNames[(lookup * 7) % numKeys]).size();
+	}
+	const double lookupUs = benchNowUs() - start;
+	BENCH_CHECK(totalLen > 0);
+
+	// Once the file is out of the racy window a check is a stat and a compare
+	::g_usleep(RACY_WINDOW_US);
+	iniFile.findOptionalString("section0", "key0");
+	double checkUs = 0;
+	for (uint32 round = 0; round < rounds; round++) {
+		::g_usleep(CHECK_INTERVAL_US);
+		start = benchNowUs();
+		iniFile.findOptionalString("section0", "key0");
+		checkUs += benchNowUs() - start;
+	}
+
+	double reparseUs = 0;
+	for (uint32 round = 0; round < rounds; round++) {
+		writeFile(path, benchContents(numSections, numKeys, round + 1));
+		::g_usleep(CHECK_INTERVAL_US);
+		start = benchNowUs();
+		const std::string value = iniFile.findOptionalString("section0", "key0");
+		reparseUs += benchNowUs() - start;
+		::snprintf(buf, sizeof(buf), "/gen%u/", round + 1);
+		BENCH_CHECK(value.find(buf) != std::string::npos);
+	}
+
+	::unlink(path.c_str());
+
+	::printf("%u sections x %u keys\n", numSections, numKeys);
+	::printf("  initial load   %10.1f us\n", loadUs);
+	::printf("  lookup         %10.3f us  (%u lookups)\n", lookupUs / numLookups, numLookups);
+	::printf("  change check   %10.1f us  (stat, no reparse)\n", checkUs / rounds);
+	::printf("  reparse        %10.1f us\n", reparseUs / rounds);
+}
+
+static void usage(const char* progName) {
+	::fprintf(stderr,
+			"Usage: %s [-s sections] [-k keys] [-n lookups] [-r rounds] [-d dir] [-b | -t]\n"
+			"  -b  run the benchmark only\n"
+			"  -t  run the checks only\n",
+			progName);
+}
+
+int32 main(int32 argc, char** argv) {
+	uint32 numSections = 50;
+	uint32 numKeys = 40;
+	uint32 numLookups = 1000000;
+	uint32 rounds = 3;
+	std::string dir = "/tmp";
+	bool runCheck = true;
+	bool runBenchmark = true;
+
+	int32 opt;
+	while ((opt = ::getopt(argc, argv, "s:k:n:r:d:bt")) != -1) {
+		switch (opt) {
+		case 's':
+			numSections = ::strtoul(optarg, NULL, 0);
+			break;
+		case 'k':
+			numKeys = ::strtoul(optarg, NULL, 0);
+			break;
+		case 'n':
+			numLookups = ::strtoul(optarg, NULL, 0);
+			break;
+		case 'r':
+			rounds = ::strtoul(optarg, NULL, 0);
+			break;
+		case 'd':
+			dir = optarg;
+			break;
+		case 'b':
+			runCheck = false;
+			break;
+		case 't':
+			runBenchmark = false;
+			break;
+		default:
+			usage(argv[0]);
+			return 1;
+		}
+	}
+	if ((numSections == 0) || (numKeys == 0) || (numLookups == 0) || (rounds == 0)) {
+		usage(argv[0]);
+		return 1;
+	}
+
+	try {
+		if (runCheck) {
+			checkRewrites(dir);
+		}
+		if (runBenchmark) {
+			runBench(dir, numSections, numKeys, numLookups, rounds);
+		}
+	}
+	catch (CCafException* ex) {
+		::fprintf(stderr, "%s\n", ex->getFullMsg().c_str());
+		ex->Release();
+		return 1;
+	}
+
+	if (_gFailures) {
+		::fprintf(stderr, "%u checks failed\n", _gFailures);
+		return 1;
+	}
+	return 0;
+}
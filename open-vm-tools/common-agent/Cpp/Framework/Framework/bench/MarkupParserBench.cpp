@@ -0,0 +1,260 @@
+/*
+ *	Copyright (C) 2016 VMware, Inc.  All rights reserved. -- VMware Confidential
+ *
+ *	Checks the findChild/findAttribute name indexes against a linear scan and
+ *	times both on elements with many children and attributes.
+ */
+
+#include "stdafx.h"
+
+#include "Xml/MarkupParser/CMarkupParser.h"
+#include "Exception/CCafException.h"
+#include <algorithm>
+#include <unistd.h>
+
+using namespace Caf;
+using namespace Caf::MarkupParser;
+
+static uint32 _gFailures = 0;
+
+#define BENCH_CHECK(cond) \
+	do { \
+		if (! (cond)) { \
+			::fprintf(stderr, "%s:%d: check failed: %s\n", __FILE__, __LINE__, #cond); \
+			++_gFailures; \
+		} \
+	} while (0)
+
+static double benchNowMs() {
+	return ::g_get_monotonic_time() / 1000.0;
+}
+
+// The pre-index findChild: the last child of the given name wins
+static ChildIterator linearFindChild(SmartPtrElement& element, const std::string& name) {
+	ChildIterator rc = element->children.end();
+	for (ChildIterator childIter = element->children.begin();
+		childIter != element->children.end();
+		childIter++) {
+		if ((*childIter)->name.compare(name) == 0) {
+			rc = childIter;
+		}
+	}
+	return rc;
+}
+
+static std::string childName(const uint32 num) {
+	char name[32];
+	::snprintf(name, sizeof(name), "rec%u", num);
+	return name;
+}
+
+static std::string attributeName(const uint32 num) {
+	char name[32];
+	::snprintf(name, sizeof(name), "attr%u", num);
+	return name;
+}
+
+/*
+ * Every child name appears twice so that last-match semantics are exercised,
+ * and the root carries numAttributes distinct attributes.
+ */
+static std::string buildDocument(const uint32 numChildren, const uint32 numAttributes) {
+	const uint32 numNames = (numChildren + 1) / 2;
+	char buf[128];
+
+	std::string xml = "<?xml version=\"1.0\" encoding=\"UTF-8\"?><bench";
+	for (uint32 attr = 0; attr < numAttributes; attr++) {
+		::snprintf(buf, sizeof(buf), " attr%u=\"v%u\"", attr, attr);
+		xml += buf;
+	}
+	xml += ">";
+	for (uint32 child = 0; child < numChildren; child++) {
+		::snprintf(buf, sizeof(buf), "<rec%u seq=\"%u\">x</rec%u>",
+				child % numNames, child, child % numNames);
+		xml += buf;
+	}
+	xml += "</bench>";
+	return xml;
+}
+
+static void checkChildren(SmartPtrElement& root, const uint32 numChildren) {
+	const uint32 numNames = (numChildren + 1) / 2;
+
+	for (uint32 num = 0; num <= numNames; num++) {
+		const std::string name = childName(num);
+		BENCH_CHECK(findChild(root, name) == linearFindChild(root, name));
+	}
+	BENCH_CHECK(root->childIndexValid == (numChildren > 8));
+
+	// Removing the last match falls back to the earlier child of that name
+	const std::string name = childName(0);
+	ChildIterator last = findChild(root, name);
+	BENCH_CHECK(last != root->children.end());
+	removeChild(root, last);
+	ChildIterator earlier = findChild(root, name);
+	BENCH_CHECK(earlier == linearFindChild(root, name));
+	BENCH_CHECK((earlier != root->children.end()) &&
+			(getAttributeValue(*earlier, "seq") == "0"));
+
+	// A child added afterwards becomes the match
+	SmartPtrElement added;
+	added.CreateInstance();
+	added->name = name;
+	addChild(root, added);
+	BENCH_CHECK(findChild(root, name) == --root->children.end());
+
+	// Removing a child that is not the last match keeps the index
+	removeChild(root, earlier);
+	BENCH_CHECK(findChild(root, name) == --root->children.end());
+	BENCH_CHECK(findChild(root, "missing") == root->children.end());
+}
+
+static void checkAttributes(SmartPtrElement& root, const uint32 numAttributes) {
+	for (uint32 num = 0; num <= numAttributes; num++) {
+		const std::string name = attributeName(num);
+		BENCH_CHECK(findAttribute(root, name) == findAttribute(root->attributes, name));
+	}
+
+	if (numAttributes > 0) {
+		// The first attribute of a name wins, even once a duplicate is added
+		const std::string name = attributeName(0);
+		addAttribute(root, name, "second");
+		BENCH_CHECK(findAttribute(root, name)->second == "v0");
+		removeAttribute(root, findAttribute(root, name));
+		BENCH_CHECK(findAttribute(root, name)->second == "second");
+		BENCH_CHECK(findAttribute(root, name) == findAttribute(root->attributes, name));
+	}
+}
+
+static void runBench(const uint32 numChildren, const uint32 numAttributes, const uint32 rounds) {
+	const std::string xml = buildDocument(numChildren, numAttributes);
+	const uint32 numNames = (numChildren + 1) / 2;
+
+	double start = benchNowMs();
+	SmartPtrElement root;
+	for (uint32 round = 0; round < rounds; round++) {
+		root = parseString(xml);
+	}
+	const double parseMs = (benchNowMs() - start) / rounds;
+
+	std::deque<std::string> names;
+	for (uint32 num = 0; num < numNames; num++) {
+		names.push_back(childName(num));
+	}
+
+	uint32 hits = 0;
+	start = benchNowMs();
+	for (uint32 round = 0; round < rounds; round++) {
+		for (std::deque<std::string>::const_iterator name = names.begin(); name != names.end(); name++) {
+			hits += (linearFindChild(root, *name) != root->children.end());
+		}
+	}
+	const double linearMs = (benchNowMs() - start) / rounds;
+
+	start = benchNowMs();
+	for (uint32 round = 0; round < rounds; round++) {
+		for (std::deque<std::string>::const_iterator name = names.begin(); name != names.end(); name++) {
+			hits += (findChild(root, *name) != root->children.end());
+		}
+	}
+	const double indexedMs = (benchNowMs() - start) / rounds;
+	BENCH_CHECK(hits == 2 * rounds * numNames);
+
+	std::deque<std::string> attrNames;
+	for (uint32 num = 0; num < numAttributes; num++) {
+		attrNames.push_back(attributeName(num));
+	}
+
+	start = benchNowMs();
+	for (uint32 round = 0; round < rounds; round++) {
+		for (std::deque<std::string>::const_iterator name = attrNames.begin(); name != attrNames.end(); name++) {
+			hits += (findAttribute(root->attributes, *name) != root->attributes.end());
+		}
+	}
+	const double attrLinearMs = (benchNowMs() - start) / rounds;
+
+	start = benchNowMs();
+	for (uint32 round = 0; round < rounds; round++) {
+		for (std::deque<std::string>::const_iterator name = attrNames.begin(); name != attrNames.end(); name++) {
+			hits += (findAttribute(root, *name) != root->attributes.end());
+		}
+	}
+	const double attrIndexedMs = (benchNowMs() - start) / rounds;
+
+	::printf("%8u children %5u attrs  parse %9.3f ms  findChild linear %10.3f ms indexed %8.3f ms"
+			"  findAttribute linear %8.3f ms indexed %8.3f ms\n",
+			numChildren, numAttributes, parseMs, linearMs, indexedMs, attrLinearMs, attrIndexedMs);
+}
+
+static void usage(const char* progName) {
+	::fprintf(stderr,
+			"Usage: %s [-n children] [-a attributes] [-r rounds] [-b | -t]\n"
+			"  -b  run the benchmark only\n"
+			"  -t  run the checks only\n",
+			progName);
+}
+
+int32 main(int32 argc, char** argv) {
+	uint32 maxChildren = 20000;
+	uint32 numAttributes = 256;
+	uint32 rounds = 3;
+	bool runChecks = true;
+	bool runBenchmark = true;
+
+	int32 opt;
+	while ((opt = ::getopt(argc, argv, "n:a:r:bt")) != -1) {
+		switch (opt) {
+		case 'n':
+			maxChildren = ::strtoul(optarg, NULL, 0);
+			break;
+		case 'a':
+			numAttributes = ::strtoul(optarg, NULL, 0);
+			break;
+		case 'r':
+			rounds = ::strtoul(optarg, NULL, 0);
+			break;
+		case 'b':
+			runChecks = false;
+			break;
+		case 't':
+			runBenchmark = false;
+			break;
+		default:
+			usage(argv[0]);
+			return 1;
+		}
+	}
+	if ((maxChildren == 0) || (rounds == 0)) {
+		usage(argv[0]);
+		return 1;
+	}
+
+	try {
+		if (runChecks) {
+			const uint32 sizes[] = { 4, 9, 64, maxChildren };
+			for (size_t idx = 0; idx < sizeof(sizes) / sizeof(sizes[0]); idx++) {
+				SmartPtrElement root = parseString(buildDocument(sizes[idx], sizes[idx]));
+				checkChildren(root, sizes[idx]);
+				checkAttributes(root, sizes[idx]);
+			}
+		}
+
+		if (runBenchmark) {
+			for (uint32 numChildren = 16; numChildren < maxChildren; numChildren *= 8) {
+				runBench(numChildren, std::min(numChildren, numAttributes), rounds);
+			}
+			runBench(maxChildren, numAttributes, rounds);
+		}
+	}
+	catch (CCafException* ex) {
+		::fprintf(stderr, "%s\n", ex->getFullMsg().c_str());
+		ex->Release();
+		return 1;
+	}
+
+	if (_gFailures) {
+		::fprintf(stderr, "%u checks failed\n", _gFailures);
+		return 1;
+	}
+	return 0;
+}
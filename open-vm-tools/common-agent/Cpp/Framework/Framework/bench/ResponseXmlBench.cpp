@@ -0,0 +1,292 @@
+/*
+ *	Copyright (C) 2016 VMware, Inc.  All rights reserved. -- VMware Confidential
+ *
+ *	Checks the streaming provider response parse against the DOM parse and
+ *	compares the time and peak memory of the two on a large response.
+ */
+
+#include "stdafx.h"
+
+#include "Doc/CafCoreTypesDoc/CAttachmentCollectionDoc.h"
+#include "Doc/CafCoreTypesDoc/CAttachmentDoc.h"
+#include "Doc/CafCoreTypesDoc/CAttachmentNameCollectionDoc.h"
+#include "Doc/ResponseDoc/CManifestDoc.h"
+#include "Doc/ResponseDoc/CProviderResponseDoc.h"
+#include "Doc/DocXml/ResponseXml/ProviderResponseXml.h"
+#include "Doc/DocXml/ResponseXml/ResponseXmlRoots.h"
+#include "Exception/CCafException.h"
+#include <fstream>
+#include <iterator>
+#include <sys/stat.h>
+#include <sys/resource.h>
+#include <unistd.h>
+
+using namespace Caf;
+
+static uint32 _gFailures = 0;
+
+#define BENCH_CHECK(cond) \
+	do { \
+		if (! (cond)) { \
+			::fprintf(stderr, "%s:%d: check failed: %s\n", __FILE__, __LINE__, #cond); \
+			++_gFailures; \
+		} \
+	} while (0)
+
+static const char* CLIENT_ID = "4e3bd0a4-6d6a-4d54-b5ed-3d8b1a1f3d01";
+static const char* REQUEST_ID = "9c1b4f72-2c0b-4a57-a0a7-6a2e0f6a4b02";
+static const char* JOB_ID = "1f0e4c4b-55c0-4b7d-9d4f-b8a1c2d3e403";
+
+static double benchNowMs() {
+	return ::g_get_monotonic_time() / 1000.0;
+}
+
+static long benchPeakRssKb() {
+	struct rusage usage;
+	::getrusage(RUSAGE_SELF, &usage);
+	return usage.ru_maxrss;
+}
+
+/*
+ * A stale manifest and attachment collection come first, so last-child-wins
+ * is exercised; the real ones carry numRecords attachment names and
+ * attachments.
+ */
+static void writeResponse(
+	const std::string& path,
+	const std::string& rootName,
+	const uint32 numRecords) {
+	std::ofstream file(path.c_str(), std::ios::out | std::ios::binary | std::ios::trunc);
+
+	file << "<?xml version=\"1.0\" encoding=\"UTF-8\"?>\n"
+		<< "<caf:" << rootName << " xmlns:caf=\"http://schemas.vmware.com/caf/schema/fx\""
+		<< " clientId=\"" << CLIENT_ID << "\" requestId=\"" << REQUEST_ID << "\" pmeId=\"pme\">\n"
+		<< "<responseHeader version=\"1.0\" createdDateTime=\"2016-10-17T12:00:00.000Z\""
+		<< " sequenceNumber=\"0\" isFinalResponse=\"true\"/>\n"
+		<< "<manifest classNamespace=\"stale\" className=\"stale\" classVersion=\"0.0.0\""
+		<< " jobId=\"" << JOB_ID << "\" operationName=\"stale\">"
+		<< "<attachmentNameCollection><attachmentName name=\"stale\"/></attachmentNameCollection>"
+		<< "</manifest>\n"
+		<< "<attachmentCollection><attachment name=\"stale\" type=\"cdif\" uri=\"file:///stale\""
+		<< " isReference=\"true\"/></attachmentCollection>\n";
+
+	file << "<manifest classNamespace=\"bench\" className=\"results\" classVersion=\"1.0.0\""
+		<< " jobId=\"" << JOB_ID << "\" operationName=\"collect\">\n<attachmentNameCollection>\n";
+	for (uint32 record = 0; record < numRecords; record++) {
+		file << "<attachmentName name=\"attachment" << record << "\"/>\n";
+	}
+	file << "</attachmentNameCollection>\n</manifest>\n<attachmentCollection>\n";
+	for (uint32 record = 0; record < numRecords; record++) {
+		file << "<attachment name=\"attachment" << record << "\" type=\"cdif\""
+			<< " uri=\"file:///var/lib/caf/output/attachment" << record << ".xml\""
+			<< " isReference=\"" << ((record % 2) ? "true" : "false") << "\"/>\n";
+	}
+	file << "</attachmentCollection>\n</caf:" << rootName << ">\n";
+}
+
+static SmartPtrCProviderResponseDoc parseDom(const std::string& path) {
+	return ProviderResponseXml::parse(CXmlUtils::parseFile(path, "caf:providerResponse"));
+}
+
+static void checkResponse(
+	const SmartPtrCProviderResponseDoc& response,
+	const uint32 numRecords) {
+	BENCH_CHECK(BasePlatform::UuidToString(response->getClientId()) == CLIENT_ID);
+	BENCH_CHECK(BasePlatform::UuidToString(response->getRequestId()) == REQUEST_ID);
+	BENCH_CHECK(response->getPmeId() == "pme");
+	BENCH_CHECK(! response->getResponseHeader().IsNull());
+	BENCH_CHECK(response->getStatistics().IsNull());
+
+	const SmartPtrCManifestDoc manifest = response->getManifest();
+	BENCH_CHECK(! manifest.IsNull());
+	if (manifest.IsNull()) {
+		return;
+	}
+	BENCH_CHECK(manifest->getClassName() == "results");
+	BENCH_CHECK(manifest->getOperationName() == "collect");
+	const std::deque<std::string> names = manifest->getAttachmentNameCollection()->getName();
+	BENCH_CHECK(names.size() == numRecords);
+
+	const SmartPtrCAttachmentCollectionDoc attachmentCollection =
+		response->getAttachmentCollection();
+	BENCH_CHECK(! attachmentCollection.IsNull());
+	if (attachmentCollection.IsNull()) {
+		return;
+	}
+	const std::deque<SmartPtrCAttachmentDoc> attachments = attachmentCollection->getAttachment();
+	BENCH_CHECK(attachments.size() == numRecords);
+	if ((names.size() != numRecords) || (attachments.size() != numRecords)) {
+		return;
+	}
+
+	char expected[64];
+	for (uint32 record = 0; record < numRecords; record++) {
+		::snprintf(expected, sizeof(expected), "attachment%u", record);
+		BENCH_CHECK(names[record] == expected);
+		BENCH_CHECK(attachments[record]->getName() == expected);
+		BENCH_CHECK(attachments[record]->getIsReference() == ((record % 2) != 0));
+	}
+}
+
+static std::string parseError(const std::string& path, const bool streamed) {
+	std::string msg;
+	try {
+		if (streamed) {
+			XmlRoots::parseProviderResponseFromFile(path);
+		} else {
+			parseDom(path);
+		}
+	}
+	catch (CCafException* ex) {
+		msg = ex->getFullMsg();
+		ex->Release();
+		if (msg.empty()) {
+			msg = "exception";
+		}
+	}
+	return msg;
+}
+
+static void runChecks(const std::string& dir) {
+	const std::string path = dir + "/ResponseXmlBench.check.xml";
+
+	const uint32 sizes[] = { 1, 2, 100 };
+	for (size_t idx = 0; idx < sizeof(sizes) / sizeof(sizes[0]); idx++) {
+		writeResponse(path, "providerResponse", sizes[idx]);
+		const SmartPtrCProviderResponseDoc streamed = XmlRoots::parseProviderResponseFromFile(path);
+		const SmartPtrCProviderResponseDoc dom = parseDom(path);
+		checkResponse(streamed, sizes[idx]);
+		checkResponse(dom, sizes[idx]);
+	}
+
+	// A wrong root is reported before any attachment is turned into a doc
+	{
+		std::ofstream file(path.c_str(), std::ios::out | std::ios::trunc);
+		file << "<caf:providerEventResponse><attachmentCollection><attachment/>"
+			<< "</attachmentCollection></caf:providerEventResponse>";
+	}
+	BENCH_CHECK(parseError(path, true).find("root not valid") != std::string::npos);
+
+	// An empty attachment name collection is rejected by both parses
+	{
+		std::ofstream file(path.c_str(), std::ios::out | std::ios::trunc);
+		file << "<caf:providerResponse><manifest classNamespace=\"n\" className=\"c\""
+			<< " classVersion=\"1.0.0\" jobId=\"" << JOB_ID << "\" operationName=\"o\">"
+			<< "<attachmentNameCollection/></manifest></caf:providerResponse>";
+	}
+	BENCH_CHECK(! parseError(path, true).empty());
+	BENCH_CHECK(! parseError(path, false).empty());
+
+	// So is a manifest without one
+	{
+		std::ofstream file(path.c_str(), std::ios::out | std::ios::trunc);
+		file << "<caf:providerResponse><manifest classNamespace=\"n\" className=\"c\""
+			<< " classVersion=\"1.0.0\" jobId=\"" << JOB_ID << "\" operationName=\"o\"/>"
+			<< "</caf:providerResponse>";
+	}
+	BENCH_CHECK(! parseError(path, true).empty());
+	BENCH_CHECK(! parseError(path, false).empty());
+
+	// A truncated response is not mistaken for a complete one
+	writeResponse(path, "providerResponse", 100);
+	{
+		std::ifstream in(path.c_str(), std::ios::in | std::ios::binary);
+		std::string xml((std::istreambuf_iterator<char>(in)), std::istreambuf_iterator<char>());
+		std::ofstream out(path.c_str(), std::ios::out | std::ios::binary | std::ios::trunc);
+		out << xml.substr(0, xml.size() / 2);
+	}
+	BENCH_CHECK(! parseError(path, true).empty());
+
+	::unlink(path.c_str());
+}
+
+/*
+ * ru_maxrss only grows, so the streaming parse runs first and the DOM parse
+ * is reported as the growth on top of it.
+ */
+static void runBench(const std::string& dir, const uint32 numRecords) {
+	const std::string path = dir + "/ResponseXmlBench.bench.xml";
+	writeResponse(path, "providerResponse", numRecords);
+
+	const long baseKb = benchPeakRssKb();
+	double start = benchNowMs();
+	SmartPtrCProviderResponseDoc response = XmlRoots::parseProviderResponseFromFile(path);
+	const double streamMs = benchNowMs() - start;
+	const long streamKb = benchPeakRssKb();
+	checkResponse(response, numRecords);
+	response = SmartPtrCProviderResponseDoc();
+
+	start = benchNowMs();
+	response = parseDom(path);
+	const double domMs = benchNowMs() - start;
+	const long domKb = benchPeakRssKb();
+	checkResponse(response, numRecords);
+
+	struct stat fileStat;
+	const long fileKb = (::stat(path.c_str(), &fileStat) == 0) ? (long) (fileStat.st_size / 1024) : 0;
+	::unlink(path.c_str());
+
+	::printf("%u records, %ld KB file\n", numRecords, fileKb);
+	::printf("  streaming  %9.1f ms  peak RSS +%ld KB\n", streamMs, streamKb - baseKb);
+	::printf("  DOM        %9.1f ms  peak RSS +%ld KB\n", domMs, domKb - baseKb);
+}
+
+static void usage(const char* progName) {
+	::fprintf(stderr,
+			"Usage: %s [-n records] [-d dir] [-b | -t]\n"
+			"  -b  run the benchmark only\n"
+			"  -t  run the checks only\n",
+			progName);
+}
+
+int32 main(int32 argc, char** argv) {
+	uint32 numRecords = 200000;
+	std::string dir = "/tmp";
+	bool runCheck = true;
+	bool runBenchmark = true;
+
+	int32 opt;
+	while ((opt = ::getopt(argc, argv, "n:d:bt")) != -1) {
+		switch (opt) {
+		case 'n':
+			numRecords = ::strtoul(optarg, NULL, 0);
+			break;
+		case 'd':
+			dir = optarg;
+			break;
+		case 'b':
+			runCheck = false;
+			break;
+		case 't':
+			runBenchmark = false;
+			break;
+		default:
+			usage(argv[0]);
+			return 1;
+		}
+	}
+	if (numRecords == 0) {
+		usage(argv[0]);
+		return 1;
+	}
+
+	try {
+		if (runCheck) {
+			runChecks(dir);
+		}
+		if (runBenchmark) {
+			runBench(dir, numRecords);
+		}
+	}
+	catch (CCafException* ex) {
+		::fprintf(stderr, "%s\n", ex->getFullMsg().c_str());
+		ex->Release();
+		return 1;
+	}
+
+	if (_gFailures) {
+		::fprintf(stderr, "%u checks failed\n", _gFailures);
+		return 1;
+	}
+	return 0;
+}
@@ -0,0 +1,11 @@
+/*
+ *	Copyright (C) 2016 VMware, Inc.  All rights reserved. -- VMware Confidential
+ */
+
+#ifndef STDAFX_H_
+#define STDAFX_H_
+
+#include <CommonDefines.h>
+#include <DocUtils.h>
+
+#endif /* STDAFX_H_ */
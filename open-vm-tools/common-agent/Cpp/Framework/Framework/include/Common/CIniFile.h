@@ -82,10 +82,41 @@ private:
 	};
 	CAF_DECLARE_SMART_POINTER(SReplacement);
 
+	// Times are in nanoseconds; a racy stamp is too recent to be trusted
+	struct SFileStamp {
+		SFileStamp() : _mtime(0), _ctime(0), _size(0), _inode(0), _isRacy(true) {}
+		gint64 _mtime;
+		gint64 _ctime;
+		off_t _size;
+		ino_t _inode;
+		bool _isRacy;
+	};
+
+	typedef std::map<std::string, SmartPtrSIniEntry> CEntryIndex;
+	struct SSectionIndex {
+		SmartPtrSIniSection _section;
+		CEntryIndex _entryIndex;
+	};
+	CAF_DECLARE_SMART_POINTER(SSectionIndex);
+	typedef std::map<std::string, SmartPtrSSectionIndex> CSectionIndex;
+
 private:
 	std::deque<SmartPtrSIniSection> parse(
 		const std::string& configFilePath) const;
 
+	std::deque<SmartPtrSIniSection> parseKeyFile(
+		GKeyFile* gKeyFile) const;
+
+	void refresh();
+
+	void setSnapshot(
+		const std::deque<SmartPtrSIniSection>& sectionCollection);
+
+	SFileStamp getFileStamp() const;
+
+	void saveKeyFile(
+		GKeyFile* gKeyFile);
+
 	SmartPtrSReplacement createReplacement(
 		const std::string& keyName,
 		const std::string& value) const;
@@ -103,7 +134,13 @@ private:
 private:
 	bool _isInitialized;
 	std::string _configFilePath;
+
+	// Parsed snapshot of the file and the stamp it was parsed from
+	bool _isLoaded;
 	std::deque<SmartPtrSIniSection> _sectionCollection;
+	CSectionIndex _sectionIndex;
+	SFileStamp _fileStamp;
+	gint64 _lastCheckTime;
 
 private:
 	CAF_CM_CREATE;
@@ -31,6 +31,13 @@ namespace Caf {
 		/// Parses the ManifestDoc from the XML.
 		SmartPtrCManifestDoc RESPONSEXML_LINKAGE parse(
 			const SmartPtrCXmlElement thisXml);
+
+		/// Parses the ManifestDoc from the XML, using an attachment name
+		/// collection that a streaming parse has already turned into a doc.
+		/// A NULL collection is looked up in the XML instead.
+		SmartPtrCManifestDoc RESPONSEXML_LINKAGE parse(
+			const SmartPtrCXmlElement thisXml,
+			const SmartPtrCAttachmentNameCollectionDoc parsedAttachmentNameCollection);
 	}
 }
 
@@ -31,6 +31,16 @@ namespace Caf {
 		/// Parses the ProviderResponseDoc from the XML.
 		SmartPtrCProviderResponseDoc RESPONSEXML_LINKAGE parse(
 			const SmartPtrCXmlElement thisXml);
+
+		/// Parses the ProviderResponseDoc from the XML, using the children that
+		/// a streaming parse has already turned into docs.  A NULL child is
+		/// looked up in the XML instead.
+		SmartPtrCProviderResponseDoc RESPONSEXML_LINKAGE parse(
+			const SmartPtrCXmlElement thisXml,
+			const SmartPtrCResponseHeaderDoc parsedResponseHeader,
+			const SmartPtrCManifestDoc parsedManifest,
+			const SmartPtrCAttachmentCollectionDoc parsedAttachmentCollection,
+			const SmartPtrCStatisticsDoc parsedStatistics);
 	}
 }
 
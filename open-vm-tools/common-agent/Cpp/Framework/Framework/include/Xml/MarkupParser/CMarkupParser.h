@@ -31,13 +31,30 @@ struct AttributeName : public std::binary_function<Attribute, std::string, bool>
 struct Element;
 CAF_DECLARE_SMART_POINTER(Element);
 struct Element {
-	Element() {}
+	Element() :
+		childIndexValid(false),
+		attributeIndexValid(false) {}
 	std::string name;
 	std::string value;
 	Attributes attributes;
 	typedef std::list<SmartPtrElement> Children;
 	Children children;
 
+	/*
+	 * Name indexes built on demand by findChild/findAttribute once an element
+	 * has more than a handful of children or attributes.  List iterators stay
+	 * valid across insertions, so the indexes only need maintenance when an
+	 * entry is erased; code that changes children or attributes after parsing
+	 * should use addChild/removeChild/addAttribute/removeAttribute, or call
+	 * invalidateIndexes when it edits the containers directly.
+	 */
+	typedef std::map<std::string, Children::iterator> ChildIndex;
+	typedef std::map<std::string, Attributes::iterator> AttributeIndex;
+	ChildIndex childIndex;
+	bool childIndexValid;
+	AttributeIndex attributeIndex;
+	bool attributeIndexValid;
+
 	CAF_CM_DECLARE_NOCOPY(Element);
 };
 
@@ -51,13 +68,60 @@ SmartPtrElement MARKUPPARSER_LINKAGE parseString(const std::string& xml);
 
 SmartPtrElement MARKUPPARSER_LINKAGE parseFile(const std::string& file);
 
+/*
+ * Receives elements from parseStringStream/parseFileStream as soon as their
+ * end tags have been parsed.  The root is at depth 1 and has no parent.
+ * Returning true drops the element from its parent, so a handler that turns
+ * each record into its own representation keeps only the unconsumed part of
+ * the document in memory.
+ */
+struct MARKUPPARSER_LINKAGE ElementHandler {
+	virtual ~ElementHandler() {}
+
+	// Called with the root, name and attributes only, once its start tag is parsed
+	virtual void onStartRoot(const SmartPtrElement& root) {}
+
+	virtual bool onEndElement(
+			const SmartPtrElement& parent,
+			const SmartPtrElement& element,
+			const uint32 depth) = 0;
+};
+
+// Streaming parse; only elements at depth <= maxDepth are passed to the handler
+SmartPtrElement MARKUPPARSER_LINKAGE parseStringStream(
+		const std::string& xml,
+		ElementHandler& handler,
+		const uint32 maxDepth);
+
+SmartPtrElement MARKUPPARSER_LINKAGE parseFileStream(
+		const std::string& file,
+		ElementHandler& handler,
+		const uint32 maxDepth);
+
 typedef Element::Children::iterator ChildIterator;
 typedef Attributes::iterator AttributeIterator;
 
+// Returns the last child with the given name, or children.end()
 ChildIterator MARKUPPARSER_LINKAGE findChild(SmartPtrElement& element, const std::string& name);
 
+void MARKUPPARSER_LINKAGE addChild(SmartPtrElement& element, const SmartPtrElement& child);
+
+void MARKUPPARSER_LINKAGE removeChild(SmartPtrElement& element, ChildIterator child);
+
+// Returns the first attribute with the given name, or attributes.end()
 AttributeIterator MARKUPPARSER_LINKAGE findAttribute(Attributes& attributes, const std::string& name);
 
+AttributeIterator MARKUPPARSER_LINKAGE findAttribute(SmartPtrElement& element, const std::string& name);
+
+void MARKUPPARSER_LINKAGE addAttribute(
+		SmartPtrElement& element,
+		const std::string& name,
+		const std::string& value);
+
+void MARKUPPARSER_LINKAGE removeAttribute(SmartPtrElement& element, AttributeIterator attribute);
+
+void MARKUPPARSER_LINKAGE invalidateIndexes(SmartPtrElement& element);
+
 std::string MARKUPPARSER_LINKAGE getAttributeValue(SmartPtrElement& element, const std::string& name);
 
 }}
@@ -163,6 +163,8 @@ void CAppConfig::append(const Cdeqstr& configFileCollection) {
 			_configFileCollection.push_back(configPath);
 		}
 	}
+
+	_resolvedValues.clear();
 }
 
 SmartPtrIConfigParams CAppConfig::getParameters(const std::string& sectionName) {
@@ -375,6 +377,7 @@ void CAppConfig::setString(
 	SmartPtrIConfigParams params = getParameters(sectionName);
 	params->insert(g_strdup(parameterName.c_str()), g_variant_new_string(
 		value.c_str()));
+	clearResolvedValues();
 }
 
 void CAppConfig::setUint32(
@@ -389,6 +392,7 @@ void CAppConfig::setUint32(
 	SmartPtrIConfigParams params = getParameters(sectionName);
 	params->insert(g_strdup(parameterName.c_str()), g_variant_new_int32(
 		value));
+	clearResolvedValues();
 }
 
 void CAppConfig::setInt32(
@@ -403,6 +407,7 @@ void CAppConfig::setInt32(
 	SmartPtrIConfigParams params = getParameters(sectionName);
 	params->insert(g_strdup(parameterName.c_str()), g_variant_new_int32(
 		value));
+	clearResolvedValues();
 }
 
 void CAppConfig::setBoolean(
@@ -417,6 +422,7 @@ void CAppConfig::setBoolean(
 	SmartPtrIConfigParams params = getParameters(sectionName);
 	params->insert(g_strdup(parameterName.c_str()), g_variant_new_boolean(
 		value));
+	clearResolvedValues();
 }
 
 void CAppConfig::setGlobalString(
@@ -446,7 +452,22 @@ void CAppConfig::setGlobalBoolean(
 std::string CAppConfig::resolveValue(const std::string& value) {
 	CAF_CM_FUNCNAME("resolveValue");
 	CAF_CM_PRECOND_ISINITIALIZED(_isInitialized);
+
+	// Most values contain no references at all
+	if (value.find("${") == std::string::npos) {
+		return value;
+	}
+
+	{
+		CAutoMutexLockUnlockRaw oLock(&_sOpMutex);
+		const CResolvedValues::const_iterator resolvedValue = _resolvedValues.find(value);
+		if (resolvedValue != _resolvedValues.end()) {
+			return resolvedValue->second;
+		}
+	}
+
 	std::string rc = value;
+	bool isCacheable = true;
 	GMatchInfo *matchInfo = NULL;
 	GError* error = NULL;
 
@@ -555,6 +576,8 @@ std::string CAppConfig::resolveValue(const std::string& value) {
 					rc.c_str(),
 					G_REGEX_MATCH_NOTBOL,
 					&matchInfo)) {
+				// The environment can change underneath us, so don't memoize
+				isCacheable = false;
 				match = g_match_info_fetch(matchInfo, 1);
 				CAF_CM_VALIDATE_STRINGPTRA(match);
 				std::string envVarName(match);
@@ -603,9 +626,20 @@ std::string CAppConfig::resolveValue(const std::string& value) {
 		g_match_info_free(matchInfo);
 	}
 	CAF_CM_THROWEXCEPTION;
+
+	if (isCacheable) {
+		CAutoMutexLockUnlockRaw oLock(&_sOpMutex);
+		_resolvedValues[value] = rc;
+	}
+
 	return rc;
 }
 
+void CAppConfig::clearResolvedValues() {
+	CAutoMutexLockUnlockRaw oLock(&_sOpMutex);
+	_resolvedValues.clear();
+}
+
 SmartPtrIAppConfig CAppConfig::getInstance() {
 	CAutoMutexLockUnlockRaw oLock(&_sOpMutex);
 	if (!_sInstance) {
@@ -156,6 +156,8 @@ private:
 
 	void validateGlobals(const SmartPtrIConfigParams& globals);
 
+	void clearResolvedValues();
+
 private:
 	std::string calcCurrentConfigPath(
 			const std::string& configFile) const;
@@ -181,6 +183,8 @@ private:
 	CGlobalReplacements _globalReplacements;
 	GRegex* _envPattern;
 	GRegex* _varPattern;
+	typedef std::map<std::string, std::string> CResolvedValues;
+	CResolvedValues _resolvedValues;
 	SmartPtrIConfigParams _globals;
 
 	Cdeqstr _configFileCollection;
@@ -10,11 +10,31 @@
 #include "Common/CCafRegex.h"
 #include "Common/CIniFile.h"
 #include "Exception/CCafException.h"
+#include <sys/stat.h>
 
 using namespace Caf;
 
+/*
+ * Lookups are served from a parsed snapshot of the file.  The file is
+ * re-stat'ed at most this often, and reparsed only when its mtime, ctime,
+ * size or inode changed, so get-heavy callers do not reparse or even stat
+ * the file on every lookup while edits made by other processes are still
+ * picked up.
+ */
+static const gint64 FILE_CHECK_INTERVAL_US = G_USEC_PER_SEC;
+
+/*
+ * File times only advance once per kernel tick, or once per second on some
+ * filesystems, so a write landing in the same tick as the stat leaves the
+ * stamp unchanged.  A file changed this recently is reparsed on every check
+ * until its stamp is older than this.
+ */
+static const gint64 FILE_RACY_WINDOW_NS = 2 * G_GINT64_CONSTANT(1000000000);
+
 CIniFile::CIniFile() :
 	_isInitialized(false),
+	_isLoaded(false),
+	_lastCheckTime(0),
 	CAF_CM_INIT_LOG("CIniFile") {
 }
 
@@ -36,14 +56,9 @@ std::deque<CIniFile::SmartPtrSIniSection> CIniFile::getSectionCollection() {
 	CAF_CM_FUNCNAME_VALIDATE("getSectionCollection");
 	CAF_CM_PRECOND_ISINITIALIZED(_isInitialized);
 
-	std::deque<SmartPtrSIniSection> sectionCollection;
-	if (_sectionCollection.empty()) {
-		_sectionCollection = parse(_configFilePath);
-	}
-
-	sectionCollection = _sectionCollection;
+	refresh();
 
-	return sectionCollection;
+	return _sectionCollection;
 }
 
 std::deque<CIniFile::SmartPtrSIniEntry> CIniFile::getEntryCollection(
@@ -52,19 +67,12 @@ std::deque<CIniFile::SmartPtrSIniEntry> CIniFile::getEntryCollection(
 	CAF_CM_PRECOND_ISINITIALIZED(_isInitialized);
 	CAF_CM_VALIDATE_STRING(sectionName);
 
-	std::deque<SmartPtrSIniEntry> entryCollection;
-	if (_sectionCollection.empty()) {
-		_sectionCollection = parse(_configFilePath);
-	}
+	refresh();
 
-	for (TConstIterator<std::deque<SmartPtrSIniSection> > iniSectionIter(_sectionCollection);
-		iniSectionIter; iniSectionIter++) {
-		const SmartPtrSIniSection iniSection = *iniSectionIter;
-		const std::string sectionNameTmp = iniSection->_sectionName;
-
-		if (sectionNameTmp.compare(sectionName) == 0) {
-			entryCollection = iniSection->_entryCollection;
-		}
+	std::deque<SmartPtrSIniEntry> entryCollection;
+	const CSectionIndex::const_iterator sectionIter = _sectionIndex.find(sectionName);
+	if (sectionIter != _sectionIndex.end()) {
+		entryCollection = sectionIter->second->_section->_entryCollection;
 	}
 
 	return entryCollection;
@@ -78,26 +86,15 @@ CIniFile::SmartPtrSIniEntry CIniFile::findOptionalEntry(
 	CAF_CM_VALIDATE_STRING(sectionName);
 	CAF_CM_VALIDATE_STRING(keyName);
 
-	CIniFile::SmartPtrSIniEntry iniEntry;
-	if (_sectionCollection.empty()) {
-		_sectionCollection = parse(_configFilePath);
-	}
+	refresh();
 
-	for (TConstIterator<std::deque<SmartPtrSIniSection> > iniSectionIter(_sectionCollection);
-		iniSectionIter; iniSectionIter++) {
-		const SmartPtrSIniSection iniSection = *iniSectionIter;
-		const std::string sectionNameTmp = iniSection->_sectionName;
-
-		if (sectionNameTmp.compare(sectionName) == 0) {
-			for (TConstIterator<std::deque<SmartPtrSIniEntry> > iniEntryIter(iniSection->_entryCollection);
-				iniEntryIter; iniEntryIter++) {
-				const SmartPtrSIniEntry iniEntryTmp = *iniEntryIter;
-				const std::string keyNameTmp = iniEntryTmp->_name;
-				if (keyNameTmp.compare(keyName) == 0) {
-					iniEntry = iniEntryTmp;
-					break;
-				}
-			}
+	CIniFile::SmartPtrSIniEntry iniEntry;
+	const CSectionIndex::const_iterator sectionIter = _sectionIndex.find(sectionName);
+	if (sectionIter != _sectionIndex.end()) {
+		const CEntryIndex& entryIndex = sectionIter->second->_entryIndex;
+		const CEntryIndex::const_iterator entryIter = entryIndex.find(keyName);
+		if (entryIter != entryIndex.end()) {
+			iniEntry = entryIter->second;
 		}
 	}
 
@@ -183,9 +180,7 @@ void CIniFile::log() {
 	CAF_CM_FUNCNAME_VALIDATE("log");
 	CAF_CM_PRECOND_ISINITIALIZED(_isInitialized);
 
-	if (_sectionCollection.empty()) {
-		_sectionCollection = parse(_configFilePath);
-	}
+	refresh();
 
 	for (TConstIterator<std::deque<SmartPtrSIniSection> > iniSectionIter(_sectionCollection);
 		iniSectionIter; iniSectionIter++) {
@@ -209,7 +204,6 @@ void CIniFile::setValue(
 
 	GKeyFile* gKeyFile = NULL;
 	GError* gError = NULL;
-	gchar* gFileContents = NULL;
 
 	try {
 		CAF_CM_PRECOND_ISINITIALIZED(_isInitialized);
@@ -234,28 +228,7 @@ void CIniFile::setValue(
 				keyName.c_str(),
 				value.c_str());
 
-			gFileContents = g_key_file_to_data(
-				gKeyFile,
-				NULL,
-				&gError);
-			if (gError != NULL) {
-				throw gError;
-			}
-			if (gKeyFile) {
-				g_key_file_free(gKeyFile);
-				gKeyFile = NULL;
-			}
-
-			g_file_set_contents(
-				_configFilePath.c_str(),
-				gFileContents,
-				-1,
-				&gError);
-			if (gError != NULL) {
-				throw gError;
-			}
-
-			_sectionCollection.clear();
+			saveKeyFile(gKeyFile);
 		} catch (GError *gErrorExc) {
 			CAF_CM_EXCEPTION_VA0(gErrorExc->code, gErrorExc->message);
 		}
@@ -271,10 +244,6 @@ void CIniFile::setValue(
 		if (gError) {
 			g_error_free(gError);
 		}
-
-		if (gFileContents) {
-			g_free(gFileContents);
-		}
 	}
     CAF_CM_CATCH_DEFAULT
     CAF_CM_LOG_CRIT_CAFEXCEPTION;
@@ -288,7 +257,6 @@ void CIniFile::deleteValue(
 
 	GKeyFile* gKeyFile = NULL;
 	GError* gError = NULL;
-	gchar* gFileContents = NULL;
 
 	try {
 		CAF_CM_PRECOND_ISINITIALIZED(_isInitialized);
@@ -315,28 +283,7 @@ void CIniFile::deleteValue(
 				throw gError;
 			}
 
-			gFileContents = g_key_file_to_data(
-				gKeyFile,
-				NULL,
-				&gError);
-			if (gError != NULL) {
-				throw gError;
-			}
-			if (gKeyFile) {
-				g_key_file_free(gKeyFile);
-				gKeyFile = NULL;
-			}
-
-			g_file_set_contents(
-				_configFilePath.c_str(),
-				gFileContents,
-				-1,
-				&gError);
-			if (gError != NULL) {
-				throw gError;
-			}
-
-			_sectionCollection.clear();
+			saveKeyFile(gKeyFile);
 		} catch (GError *gErrorExc) {
 			CAF_CM_EXCEPTION_VA0(gErrorExc->code, gErrorExc->message);
 		}
@@ -352,10 +299,6 @@ void CIniFile::deleteValue(
 		if (gError) {
 			g_error_free(gError);
 		}
-
-		if (gFileContents) {
-			g_free(gFileContents);
-		}
 	}
     CAF_CM_CATCH_DEFAULT
     CAF_CM_LOG_CRIT_CAFEXCEPTION;
@@ -367,13 +310,9 @@ std::deque<CIniFile::SmartPtrSIniSection> CIniFile::parse(
 	CAF_CM_FUNCNAME("parse");
 
 	std::deque<SmartPtrSIniSection> iniSectionCollection;
-	std::deque<SmartPtrSReplacement> replacementCollection;
 
 	GKeyFile* gKeyFile = NULL;
-	gchar** gGroupStrCollection = NULL;
-	gchar** gKeyStrCollection = NULL;
 	GError* gError = NULL;
-	gchar* gValueStr = NULL;
 
 	try {
 		CAF_CM_VALIDATE_STRING(configFilePath);
@@ -389,6 +328,46 @@ std::deque<CIniFile::SmartPtrSIniSection> CIniFile::parse(
 				throw gError;
 			}
 
+			iniSectionCollection = parseKeyFile(gKeyFile);
+		} catch (GError *gErrorExc) {
+			CAF_CM_EXCEPTION_VA0(gErrorExc->code, gErrorExc->message);
+		}
+	}
+    CAF_CM_CATCH_CAF
+    CAF_CM_CATCH_DEFAULT
+
+	try {
+		if (gKeyFile) {
+			g_key_file_free(gKeyFile);
+		}
+
+		if (gError) {
+			g_error_free(gError);
+		}
+	}
+    CAF_CM_CATCH_DEFAULT
+    CAF_CM_LOG_CRIT_CAFEXCEPTION;
+    CAF_CM_THROWEXCEPTION;
+
+	return iniSectionCollection;
+}
+
+std::deque<CIniFile::SmartPtrSIniSection> CIniFile::parseKeyFile(
+	GKeyFile* gKeyFile) const {
+	CAF_CM_FUNCNAME("parseKeyFile");
+
+	std::deque<SmartPtrSIniSection> iniSectionCollection;
+	std::deque<SmartPtrSReplacement> replacementCollection;
+
+	gchar** gGroupStrCollection = NULL;
+	gchar** gKeyStrCollection = NULL;
+	GError* gError = NULL;
+	gchar* gValueStr = NULL;
+
+	try {
+		CAF_CM_VALIDATE_PTR(gKeyFile);
+
+		try {
 			gsize numGroups = 0;
 			gGroupStrCollection = g_key_file_get_groups(gKeyFile, &numGroups);
 			for (gsize groupNum = 0; groupNum < numGroups; groupNum++) {
@@ -405,6 +384,9 @@ std::deque<CIniFile::SmartPtrSIniSection> CIniFile::parse(
 					gGroupNameStr,
 					&numKeys,
 					&gError);
+				if (gError != NULL) {
+					throw gError;
+				}
 
 				for (gsize keyNum = 0; keyNum < numKeys; keyNum++) {
 					const gchar* gKeyNameStr = gKeyStrCollection[keyNum];
@@ -423,6 +405,7 @@ std::deque<CIniFile::SmartPtrSIniSection> CIniFile::parse(
 					g_free(gValueStr);
 					gValueStr = NULL;
 
+					// Expansion happens once per parse; lookups return the stored result
 					std::string valueExpanded;
 					if (valueRaw.empty()) {
 						// TODO: Need a way to represent NULL strings as opposed to empty strings.
@@ -431,12 +414,14 @@ std::deque<CIniFile::SmartPtrSIniSection> CIniFile::parse(
 					} else {
 						valueExpanded = CStringUtils::trim(valueRaw);
 						valueExpanded = CStringUtils::expandEnv(valueExpanded);
-						for (TConstIterator<std::deque<SmartPtrSReplacement> > replacementIter(replacementCollection);
-							replacementIter; replacementIter++ ) {
-							const SmartPtrSReplacement replacement = *replacementIter;
-							if (replacement->_regex->isMatched(valueExpanded)) {
-								valueExpanded = replacement->_regex->replaceLiteral(valueExpanded, replacement->_value);
-								break;
+						if (valueExpanded.find("${") != std::string::npos) {
+							for (TConstIterator<std::deque<SmartPtrSReplacement> > replacementIter(replacementCollection);
+								replacementIter; replacementIter++ ) {
+								const SmartPtrSReplacement replacement = *replacementIter;
+								if (replacement->_regex->isMatched(valueExpanded)) {
+									valueExpanded = replacement->_regex->replaceLiteral(valueExpanded, replacement->_value);
+									break;
+								}
 							}
 						}
 
@@ -450,6 +435,9 @@ std::deque<CIniFile::SmartPtrSIniSection> CIniFile::parse(
 					iniSection->_entryCollection.push_back(iniEntry);
 				}
 
+				g_strfreev(gKeyStrCollection);
+				gKeyStrCollection = NULL;
+
 				iniSectionCollection.push_back(iniSection);
 			}
 		} catch (GError *gErrorExc) {
@@ -460,10 +448,6 @@ std::deque<CIniFile::SmartPtrSIniSection> CIniFile::parse(
     CAF_CM_CATCH_DEFAULT
 
 	try {
-		if (gKeyFile) {
-			g_key_file_free(gKeyFile);
-		}
-
 		if (gError) {
 			g_error_free(gError);
 		}
@@ -487,6 +471,133 @@ std::deque<CIniFile::SmartPtrSIniSection> CIniFile::parse(
 	return iniSectionCollection;
 }
 
+void CIniFile::refresh() {
+	CAF_CM_FUNCNAME_VALIDATE("refresh");
+
+	const gint64 now = ::g_get_monotonic_time();
+	if (_isLoaded && ((now - _lastCheckTime) < FILE_CHECK_INTERVAL_US)) {
+		return;
+	}
+	_lastCheckTime = now;
+
+	// Stat before parsing so a change racing with the parse is seen next time
+	const SFileStamp fileStamp = getFileStamp();
+	if (_isLoaded && ! _fileStamp._isRacy &&
+		(fileStamp._mtime == _fileStamp._mtime) &&
+		(fileStamp._ctime == _fileStamp._ctime) &&
+		(fileStamp._size == _fileStamp._size) &&
+		(fileStamp._inode == _fileStamp._inode)) {
+		return;
+	}
+
+	setSnapshot(parse(_configFilePath));
+	_fileStamp = fileStamp;
+}
+
+void CIniFile::setSnapshot(
+	const std::deque<SmartPtrSIniSection>& sectionCollection) {
+	CAF_CM_FUNCNAME_VALIDATE("setSnapshot");
+
+	CSectionIndex sectionIndex;
+	for (TConstIterator<std::deque<SmartPtrSIniSection> > iniSectionIter(sectionCollection);
+		iniSectionIter; iniSectionIter++) {
+		const SmartPtrSIniSection iniSection = *iniSectionIter;
+
+		// A repeated section replaces the earlier one, as the linear scan did
+		SmartPtrSSectionIndex sectionIndexEntry;
+		sectionIndexEntry.CreateInstance();
+		sectionIndexEntry->_section = iniSection;
+		for (TConstIterator<std::deque<SmartPtrSIniEntry> > iniEntryIter(iniSection->_entryCollection);
+			iniEntryIter; iniEntryIter++) {
+			const SmartPtrSIniEntry iniEntry = *iniEntryIter;
+			sectionIndexEntry->_entryIndex.insert(std::make_pair(iniEntry->_name, iniEntry));
+		}
+		sectionIndex[iniSection->_sectionName] = sectionIndexEntry;
+	}
+
+	_sectionCollection = sectionCollection;
+	_sectionIndex.swap(sectionIndex);
+	_isLoaded = true;
+}
+
+CIniFile::SFileStamp CIniFile::getFileStamp() const {
+	CAF_CM_FUNCNAME_VALIDATE("getFileStamp");
+
+	SFileStamp fileStamp;
+	const gint64 now = ::g_get_real_time() * 1000;
+	struct stat statBuf;
+	if (::stat(_configFilePath.c_str(), &statBuf) == 0) {
+		fileStamp._mtime =
+			statBuf.st_mtim.tv_sec * G_GINT64_CONSTANT(1000000000) + statBuf.st_mtim.tv_nsec;
+		fileStamp._ctime =
+			statBuf.st_ctim.tv_sec * G_GINT64_CONSTANT(1000000000) + statBuf.st_ctim.tv_nsec;
+		fileStamp._size = statBuf.st_size;
+		fileStamp._inode = statBuf.st_ino;
+		fileStamp._isRacy =
+			((now - fileStamp._mtime) < FILE_RACY_WINDOW_NS) ||
+			((now - fileStamp._ctime) < FILE_RACY_WINDOW_NS);
+	}
+
+	return fileStamp;
+}
+
+void CIniFile::saveKeyFile(
+	GKeyFile* gKeyFile) {
+	CAF_CM_FUNCNAME("saveKeyFile");
+
+	GError* gError = NULL;
+	gchar* gFileContents = NULL;
+
+	try {
+		CAF_CM_VALIDATE_PTR(gKeyFile);
+
+		try {
+			gFileContents = g_key_file_to_data(
+				gKeyFile,
+				NULL,
+				&gError);
+			if (gError != NULL) {
+				throw gError;
+			}
+
+			// g_file_set_contents writes a temporary file and renames it over
+			// the original, so readers never see a partially written file
+			g_file_set_contents(
+				_configFilePath.c_str(),
+				gFileContents,
+				-1,
+				&gError);
+			if (gError != NULL) {
+				throw gError;
+			}
+
+			// The key file already holds the new contents, so the snapshot
+			// is rebuilt from it instead of rereading the file
+			const SFileStamp fileStamp = getFileStamp();
+			setSnapshot(parseKeyFile(gKeyFile));
+			_fileStamp = fileStamp;
+			_lastCheckTime = ::g_get_monotonic_time();
+		} catch (GError *gErrorExc) {
+			CAF_CM_EXCEPTION_VA0(gErrorExc->code, gErrorExc->message);
+		}
+	}
+    CAF_CM_CATCH_CAF
+    CAF_CM_CATCH_DEFAULT
+
+	try {
+		if (gError) {
+			g_error_free(gError);
+		}
+
+		if (gFileContents) {
+			g_free(gFileContents);
+		}
+	}
+    CAF_CM_CATCH_DEFAULT
+    CAF_CM_LOG_CRIT_CAFEXCEPTION;
+    CAF_CM_THROWEXCEPTION;
+}
+
 CIniFile::SmartPtrSReplacement CIniFile::createReplacement(
 	const std::string& keyName,
 	const std::string& value) const {
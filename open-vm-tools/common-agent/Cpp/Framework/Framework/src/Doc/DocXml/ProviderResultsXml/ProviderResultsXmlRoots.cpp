@@ -12,15 +12,183 @@
 #include "stdafx.h"
 
 #include "Doc/DocXml/ProviderResultsXml/CdifXml.h"
+#include "Doc/DocXml/ProviderResultsXml/RequestIdentifierXml.h"
 #include "Doc/DocXml/ProviderResultsXml/SchemaXml.h"
+#include "Doc/DocXml/SchemaTypesXml/ActionClassXml.h"
+#include "Doc/DocXml/SchemaTypesXml/DataClassXml.h"
+#include "Doc/DocXml/SchemaTypesXml/LogicalRelationshipXml.h"
+#include "Doc/DocXml/SchemaTypesXml/PhysicalRelationshipXml.h"
 
 #include "Doc/ProviderResultsDoc/CCdifDoc.h"
+#include "Doc/ProviderResultsDoc/CDefinitionObjectCollectionDoc.h"
+#include "Doc/ProviderResultsDoc/CRequestIdentifierDoc.h"
 #include "Doc/ProviderResultsDoc/CSchemaDoc.h"
 #include "Xml/XmlUtils/CXmlElement.h"
 #include "Doc/DocXml/ProviderResultsXml/ProviderResultsXmlRoots.h"
 
 using namespace Caf;
 
+/*
+ * Provider results can run to hundreds of megabytes, so the roots below
+ * build the docs from the stream instead of walking a DOM of the whole
+ * document.  Each record (a data class, a definition object, ...) is turned
+ * into its doc as soon as its end tag is parsed and is then dropped, so only
+ * one record's elements are held at a time.  The result is the same as
+ * SchemaXml::parse/CdifXml::parse on the full tree.
+ */
+namespace {
+
+/// Collects the children of a schema element as they are parsed
+class CSchemaStreamBuilder {
+public:
+	CSchemaStreamBuilder() {}
+
+	bool add(const SmartPtrCXmlElement& childXml) {
+		const std::string name = childXml->getName();
+		if (name.compare("dataClass") == 0) {
+			_dataClassVal.push_back(DataClassXml::parse(childXml));
+		} else if (name.compare("actionClass") == 0) {
+			_actionClassVal.push_back(ActionClassXml::parse(childXml));
+		} else if (name.compare("logicalRelationship") == 0) {
+			_logicalRelationshipVal.push_back(LogicalRelationshipXml::parse(childXml));
+		} else if (name.compare("physicalRelationship") == 0) {
+			_physicalRelationshipVal.push_back(PhysicalRelationshipXml::parse(childXml));
+		}
+
+		// Anything else is ignored by SchemaXml::parse as well
+		return true;
+	}
+
+	SmartPtrCSchemaDoc build() {
+		SmartPtrCSchemaDoc schemaDoc;
+		schemaDoc.CreateInstance();
+		schemaDoc->initialize(
+			_dataClassVal,
+			_actionClassVal,
+			_logicalRelationshipVal,
+			_physicalRelationshipVal);
+
+		_dataClassVal.clear();
+		_actionClassVal.clear();
+		_logicalRelationshipVal.clear();
+		_physicalRelationshipVal.clear();
+
+		return schemaDoc;
+	}
+
+private:
+	std::deque<SmartPtrCDataClassDoc> _dataClassVal;
+	std::deque<SmartPtrCActionClassDoc> _actionClassVal;
+	std::deque<SmartPtrCLogicalRelationshipDoc> _logicalRelationshipVal;
+	std::deque<SmartPtrCPhysicalRelationshipDoc> _physicalRelationshipVal;
+
+	CAF_CM_DECLARE_NOCOPY(CSchemaStreamBuilder);
+};
+
+/// Root is caf:schema; its children are the schema records
+class CSchemaStreamHandler : public CXmlUtils::CStreamHandler {
+public:
+	CSchemaStreamHandler() {}
+
+	bool onElement(
+		const std::string& parentName,
+		const SmartPtrCXmlElement& elementXml,
+		const uint32 depth) {
+		return _schema.add(elementXml);
+	}
+
+	SmartPtrCSchemaDoc getSchema() {
+		return _schema.build();
+	}
+
+	static const uint32 MAX_DEPTH = 2;
+
+private:
+	CSchemaStreamBuilder _schema;
+
+	CAF_CM_DECLARE_NOCOPY(CSchemaStreamHandler);
+};
+
+/// Root is caf:cdif; the records are the children of definitionObjectCollection and schema
+class CCdifStreamHandler : public CXmlUtils::CStreamHandler {
+public:
+	CCdifStreamHandler() {}
+
+	bool onElement(
+		const std::string& parentName,
+		const SmartPtrCXmlElement& elementXml,
+		const uint32 depth) {
+		if (depth == 3) {
+			if (parentName.compare("definitionObjectCollection") == 0) {
+				// Ordered by name like CXmlElement::getAllChildren
+				_definitionObjects.insert(std::make_pair(
+					elementXml->getName(), elementXml->saveToStringRaw()));
+				return true;
+			}
+			if (parentName.compare("schema") == 0) {
+				return _schemaBuilder.add(elementXml);
+			}
+			return false;
+		}
+
+		// The last of each required/optional child wins, as with findRequiredChild
+		const std::string name = elementXml->getName();
+		if (name.compare("requestIdentifier") == 0) {
+			_requestIdentifier = RequestIdentifierXml::parse(elementXml);
+			return true;
+		}
+		if (name.compare("definitionObjectCollection") == 0) {
+			std::deque<std::string> valueVal;
+			for (TConstIterator<std::multimap<std::string, std::string> > definitionObjectIter(
+				_definitionObjects); definitionObjectIter; definitionObjectIter++) {
+				valueVal.push_back(definitionObjectIter->second);
+			}
+			_definitionObjects.clear();
+
+			_definitionObjectCollection.CreateInstance();
+			_definitionObjectCollection->initialize(valueVal);
+			return true;
+		}
+		if (name.compare("schema") == 0) {
+			_schema = _schemaBuilder.build();
+			return true;
+		}
+		return false;
+	}
+
+	SmartPtrCCdifDoc getCdif(const SmartPtrCXmlElement& rootXml) {
+		// Whatever required child is missing is still reported by findRequiredChild
+		if (_requestIdentifier.IsNull()) {
+			rootXml->findRequiredChild("requestIdentifier");
+		}
+		if (_schema.IsNull()) {
+			rootXml->findRequiredChild("schema");
+		}
+
+		SmartPtrCCdifDoc cdifDoc;
+		cdifDoc.CreateInstance();
+		cdifDoc->initialize(
+			_requestIdentifier,
+			_definitionObjectCollection,
+			_schema);
+
+		return cdifDoc;
+	}
+
+	static const uint32 MAX_DEPTH = 3;
+
+private:
+	SmartPtrCRequestIdentifierDoc _requestIdentifier;
+	SmartPtrCDefinitionObjectCollectionDoc _definitionObjectCollection;
+	SmartPtrCSchemaDoc _schema;
+	std::multimap<std::string, std::string> _definitionObjects;
+	CSchemaStreamBuilder _schemaBuilder;
+
+	CAF_CM_DECLARE_NOCOPY(CCdifStreamHandler);
+};
+
+}
+
 std::string XmlRoots::saveSchemaToString(
 	const SmartPtrCSchemaDoc schemaDoc) {
 	CAF_CM_STATIC_FUNC_VALIDATE("XmlRoots", "saveSchemaToString");
@@ -53,8 +221,9 @@ SmartPtrCSchemaDoc XmlRoots::parseSchemaFromString(
 	CAF_CM_ENTER {
 		CAF_CM_VALIDATE_STRING(xml);
 
-		const SmartPtrCXmlElement rootXml = CXmlUtils::parseString(xml, "caf:schema");
-		schemaDoc = SchemaXml::parse(rootXml);
+		CSchemaStreamHandler handler;
+		CXmlUtils::parseStringStream(xml, "caf:schema", CSchemaStreamHandler::MAX_DEPTH, handler);
+		schemaDoc = handler.getSchema();
 	}
 	CAF_CM_EXIT;
 
@@ -88,8 +257,9 @@ SmartPtrCSchemaDoc XmlRoots::parseSchemaFromFile(
 	CAF_CM_ENTER {
 		CAF_CM_VALIDATE_STRING(filePath);
 
-		const SmartPtrCXmlElement rootXml = CXmlUtils::parseFile(filePath, "caf:schema");
-		schemaDoc = SchemaXml::parse(rootXml);
+		CSchemaStreamHandler handler;
+		CXmlUtils::parseFileStream(filePath, "caf:schema", CSchemaStreamHandler::MAX_DEPTH, handler);
+		schemaDoc = handler.getSchema();
 	}
 	CAF_CM_EXIT;
 
@@ -128,8 +298,10 @@ SmartPtrCCdifDoc XmlRoots::parseCdifFromString(
 	CAF_CM_ENTER {
 		CAF_CM_VALIDATE_STRING(xml);
 
-		const SmartPtrCXmlElement rootXml = CXmlUtils::parseString(xml, "caf:cdif");
-		cdifDoc = CdifXml::parse(rootXml);
+		CCdifStreamHandler handler;
+		const SmartPtrCXmlElement rootXml = CXmlUtils::parseStringStream(
+			xml, "caf:cdif", CCdifStreamHandler::MAX_DEPTH, handler);
+		cdifDoc = handler.getCdif(rootXml);
 	}
 	CAF_CM_EXIT;
 
@@ -163,8 +335,10 @@ SmartPtrCCdifDoc XmlRoots::parseCdifFromFile(
 	CAF_CM_ENTER {
 		CAF_CM_VALIDATE_STRING(filePath);
 
-		const SmartPtrCXmlElement rootXml = CXmlUtils::parseFile(filePath, "caf:cdif");
-		cdifDoc = CdifXml::parse(rootXml);
+		CCdifStreamHandler handler;
+		const SmartPtrCXmlElement rootXml = CXmlUtils::parseFileStream(
+			filePath, "caf:cdif", CCdifStreamHandler::MAX_DEPTH, handler);
+		cdifDoc = handler.getCdif(rootXml);
 	}
 	CAF_CM_EXIT;
 
@@ -67,6 +67,23 @@ SmartPtrCManifestDoc ManifestXml::parse(
 
 	SmartPtrCManifestDoc manifestDoc;
 
+	CAF_CM_ENTER {
+		CAF_CM_VALIDATE_SMARTPTR(thisXml);
+
+		manifestDoc = parse(thisXml, SmartPtrCAttachmentNameCollectionDoc());
+	}
+	CAF_CM_EXIT;
+
+	return manifestDoc;
+}
+
+SmartPtrCManifestDoc ManifestXml::parse(
+	const SmartPtrCXmlElement thisXml,
+	const SmartPtrCAttachmentNameCollectionDoc parsedAttachmentNameCollection) {
+	CAF_CM_STATIC_FUNC_VALIDATE("ManifestXml", "parse");
+
+	SmartPtrCManifestDoc manifestDoc;
+
 	CAF_CM_ENTER {
 		CAF_CM_VALIDATE_SMARTPTR(thisXml);
 
@@ -93,12 +110,14 @@ SmartPtrCManifestDoc ManifestXml::parse(
 			thisXml->findRequiredAttribute("operationName");
 		const std::string operationNameVal = operationNameStrVal;
 
-		const SmartPtrCXmlElement attachmentNameCollectionXml =
-			thisXml->findRequiredChild("attachmentNameCollection");
-
-		SmartPtrCAttachmentNameCollectionDoc attachmentNameCollectionVal;
-		if (! attachmentNameCollectionXml.IsNull()) {
-			attachmentNameCollectionVal = AttachmentNameCollectionXml::parse(attachmentNameCollectionXml);
+		SmartPtrCAttachmentNameCollectionDoc attachmentNameCollectionVal =
+			parsedAttachmentNameCollection;
+		if (attachmentNameCollectionVal.IsNull()) {
+			const SmartPtrCXmlElement attachmentNameCollectionXml =
+				thisXml->findRequiredChild("attachmentNameCollection");
+			if (! attachmentNameCollectionXml.IsNull()) {
+				attachmentNameCollectionVal = AttachmentNameCollectionXml::parse(attachmentNameCollectionXml);
+			}
 		}
 
 		manifestDoc.CreateInstance();
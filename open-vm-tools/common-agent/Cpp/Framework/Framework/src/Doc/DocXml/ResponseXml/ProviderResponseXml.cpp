@@ -93,6 +93,31 @@ SmartPtrCProviderResponseDoc ProviderResponseXml::parse(
 
 	SmartPtrCProviderResponseDoc providerResponseDoc;
 
+	CAF_CM_ENTER {
+		CAF_CM_VALIDATE_SMARTPTR(thisXml);
+
+		providerResponseDoc = parse(
+			thisXml,
+			SmartPtrCResponseHeaderDoc(),
+			SmartPtrCManifestDoc(),
+			SmartPtrCAttachmentCollectionDoc(),
+			SmartPtrCStatisticsDoc());
+	}
+	CAF_CM_EXIT;
+
+	return providerResponseDoc;
+}
+
+SmartPtrCProviderResponseDoc ProviderResponseXml::parse(
+	const SmartPtrCXmlElement thisXml,
+	const SmartPtrCResponseHeaderDoc parsedResponseHeader,
+	const SmartPtrCManifestDoc parsedManifest,
+	const SmartPtrCAttachmentCollectionDoc parsedAttachmentCollection,
+	const SmartPtrCStatisticsDoc parsedStatistics) {
+	CAF_CM_STATIC_FUNC_VALIDATE("ProviderResponseXml", "parse");
+
+	SmartPtrCProviderResponseDoc providerResponseDoc;
+
 	CAF_CM_ENTER {
 		CAF_CM_VALIDATE_SMARTPTR(thisXml);
 
@@ -113,32 +138,40 @@ SmartPtrCProviderResponseDoc ProviderResponseXml::parse(
 		const std::string pmeIdVal =
 			thisXml->findOptionalAttribute("pmeId");
 
-		const SmartPtrCXmlElement responseHeaderXml =
-			thisXml->findOptionalChild("responseHeader");
-		SmartPtrCResponseHeaderDoc responseHeaderVal;
-		if (! responseHeaderXml.IsNull()) {
-			responseHeaderVal = ResponseHeaderXml::parse(responseHeaderXml);
+		SmartPtrCResponseHeaderDoc responseHeaderVal = parsedResponseHeader;
+		if (responseHeaderVal.IsNull()) {
+			const SmartPtrCXmlElement responseHeaderXml =
+				thisXml->findOptionalChild("responseHeader");
+			if (! responseHeaderXml.IsNull()) {
+				responseHeaderVal = ResponseHeaderXml::parse(responseHeaderXml);
+			}
 		}
 
-		const SmartPtrCXmlElement manifestXml =
-			thisXml->findOptionalChild("manifest");
-		SmartPtrCManifestDoc manifestVal;
-		if (! manifestXml.IsNull()) {
-			manifestVal = ManifestXml::parse(manifestXml);
+		SmartPtrCManifestDoc manifestVal = parsedManifest;
+		if (manifestVal.IsNull()) {
+			const SmartPtrCXmlElement manifestXml =
+				thisXml->findOptionalChild("manifest");
+			if (! manifestXml.IsNull()) {
+				manifestVal = ManifestXml::parse(manifestXml);
+			}
 		}
 
-		const SmartPtrCXmlElement attachmentCollectionXml =
-			thisXml->findOptionalChild("attachmentCollection");
-		SmartPtrCAttachmentCollectionDoc attachmentCollectionVal;
-		if (! attachmentCollectionXml.IsNull()) {
-			attachmentCollectionVal = AttachmentCollectionXml::parse(attachmentCollectionXml);
+		SmartPtrCAttachmentCollectionDoc attachmentCollectionVal = parsedAttachmentCollection;
+		if (attachmentCollectionVal.IsNull()) {
+			const SmartPtrCXmlElement attachmentCollectionXml =
+				thisXml->findOptionalChild("attachmentCollection");
+			if (! attachmentCollectionXml.IsNull()) {
+				attachmentCollectionVal = AttachmentCollectionXml::parse(attachmentCollectionXml);
+			}
 		}
 
-		const SmartPtrCXmlElement statisticsXml =
-			thisXml->findOptionalChild("statistics");
-		SmartPtrCStatisticsDoc statisticsVal;
-		if (! statisticsXml.IsNull()) {
-			statisticsVal = StatisticsXml::parse(statisticsXml);
+		SmartPtrCStatisticsDoc statisticsVal = parsedStatistics;
+		if (statisticsVal.IsNull()) {
+			const SmartPtrCXmlElement statisticsXml =
+				thisXml->findOptionalChild("statistics");
+			if (! statisticsXml.IsNull()) {
+				statisticsVal = StatisticsXml::parse(statisticsXml);
+			}
 		}
 
 		providerResponseDoc.CreateInstance();
@@ -11,12 +11,22 @@
 
 #include "stdafx.h"
 
+#include "Doc/DocXml/CafCoreTypesXml/AttachmentXml.h"
+#include "Doc/DocXml/CafCoreTypesXml/StatisticsXml.h"
+#include "Doc/DocXml/ResponseXml/ManifestXml.h"
+#include "Doc/DocXml/ResponseXml/ResponseHeaderXml.h"
 #include "Doc/DocXml/ResponseXml/ResponseXml.h"
 
+#include "Doc/CafCoreTypesDoc/CAttachmentCollectionDoc.h"
+#include "Doc/CafCoreTypesDoc/CAttachmentDoc.h"
+#include "Doc/CafCoreTypesDoc/CAttachmentNameCollectionDoc.h"
+#include "Doc/CafCoreTypesDoc/CStatisticsDoc.h"
 #include "Doc/ResponseDoc/CErrorResponseDoc.h"
+#include "Doc/ResponseDoc/CManifestDoc.h"
 #include "Doc/ResponseDoc/CProviderEventResponseDoc.h"
 #include "Doc/ResponseDoc/CProviderResponseDoc.h"
 #include "Doc/ResponseDoc/CResponseDoc.h"
+#include "Doc/ResponseDoc/CResponseHeaderDoc.h"
 #include "Xml/XmlUtils/CXmlElement.h"
 #include "Doc/DocXml/ResponseXml/ResponseXmlRoots.h"
 #include "Doc/DocXml/ResponseXml/ErrorResponseXml.h"
@@ -25,6 +35,100 @@
 
 using namespace Caf;
 
+namespace {
+
+/*
+ * Builds the ProviderResponseDoc while the response is being parsed.  The
+ * records of the two collections that grow with the job, each attachment
+ * and each attachment name of the manifest, are turned into docs and
+ * dropped as their end tags are seen, as is every child of the root.  Only
+ * the element tree of one record is held at a time.  The docs are put
+ * together by the same ProviderResponseXml/ManifestXml code as a DOM parse.
+ */
+class CProviderResponseStreamHandler : public CXmlUtils::CStreamHandler {
+public:
+	CProviderResponseStreamHandler() {}
+
+	bool onElement(
+		const std::string& parentName,
+		const SmartPtrCXmlElement& elementXml,
+		const uint32 depth) {
+		const std::string name = elementXml->getName();
+		if (depth == 4) {
+			// attachmentNameCollection only occurs in the manifest
+			if ((parentName.compare("attachmentNameCollection") == 0) &&
+				(name.compare("attachmentName") == 0)) {
+				_attachmentNames.push_back(elementXml->findRequiredAttribute("name"));
+				return true;
+			}
+			return false;
+		}
+
+		if (depth == 3) {
+			if ((parentName.compare("attachmentCollection") == 0) &&
+				(name.compare("attachment") == 0)) {
+				_attachments.push_back(AttachmentXml::parse(elementXml));
+				return true;
+			}
+			if ((parentName.compare("manifest") == 0) &&
+				(name.compare("attachmentNameCollection") == 0)) {
+				if (_attachmentNames.empty()) {
+					// Reports the missing names like findRequiredChildren
+					elementXml->findRequiredChildren("attachmentName");
+				}
+				_attachmentNameCollection.CreateInstance();
+				_attachmentNameCollection->initialize(_attachmentNames);
+				_attachmentNames.clear();
+				return true;
+			}
+			_attachmentNames.clear();
+			return false;
+		}
+
+		// The last of each optional child wins, as with findOptionalChild
+		if (name.compare("responseHeader") == 0) {
+			_responseHeader = ResponseHeaderXml::parse(elementXml);
+		} else if (name.compare("manifest") == 0) {
+			_manifest = ManifestXml::parse(elementXml, _attachmentNameCollection);
+			_attachmentNameCollection = SmartPtrCAttachmentNameCollectionDoc();
+		} else if (name.compare("attachmentCollection") == 0) {
+			_attachmentCollection.CreateInstance();
+			_attachmentCollection->initialize(_attachments);
+			_attachments.clear();
+		} else if (name.compare("statistics") == 0) {
+			_statistics = StatisticsXml::parse(elementXml);
+		} else {
+			return false;
+		}
+		return true;
+	}
+
+	SmartPtrCProviderResponseDoc getProviderResponse(const SmartPtrCXmlElement& rootXml) {
+		return ProviderResponseXml::parse(
+			rootXml,
+			_responseHeader,
+			_manifest,
+			_attachmentCollection,
+			_statistics);
+	}
+
+	static const uint32 MAX_DEPTH = 4;
+
+private:
+	SmartPtrCResponseHeaderDoc _responseHeader;
+	SmartPtrCManifestDoc _manifest;
+	SmartPtrCAttachmentCollectionDoc _attachmentCollection;
+	SmartPtrCStatisticsDoc _statistics;
+
+	std::deque<SmartPtrCAttachmentDoc> _attachments;
+	std::deque<std::string> _attachmentNames;
+	SmartPtrCAttachmentNameCollectionDoc _attachmentNameCollection;
+
+	CAF_CM_DECLARE_NOCOPY(CProviderResponseStreamHandler);
+};
+
+}
+
 std::string XmlRoots::saveErrorResponseToString(
 	const SmartPtrCErrorResponseDoc errorResponseDoc) {
 	CAF_CM_STATIC_FUNC_VALIDATE("XmlRoots", "saveErrorResponseToString");
@@ -132,8 +236,10 @@ SmartPtrCProviderResponseDoc XmlRoots::parseProviderResponseFromString(
 	CAF_CM_ENTER {
 		CAF_CM_VALIDATE_STRING(xml);
 
-		const SmartPtrCXmlElement rootXml = CXmlUtils::parseString(xml, "caf:providerResponse");
-		providerResponseDoc = ProviderResponseXml::parse(rootXml);
+		CProviderResponseStreamHandler handler;
+		const SmartPtrCXmlElement rootXml = CXmlUtils::parseStringStream(
+			xml, "caf:providerResponse", CProviderResponseStreamHandler::MAX_DEPTH, handler);
+		providerResponseDoc = handler.getProviderResponse(rootXml);
 	}
 	CAF_CM_EXIT;
 
@@ -167,8 +273,10 @@ SmartPtrCProviderResponseDoc XmlRoots::parseProviderResponseFromFile(
 	CAF_CM_ENTER {
 		CAF_CM_VALIDATE_STRING(filePath);
 
-		const SmartPtrCXmlElement rootXml = CXmlUtils::parseFile(filePath, "caf:providerResponse");
-		providerResponseDoc = ProviderResponseXml::parse(rootXml);
+		CProviderResponseStreamHandler handler;
+		const SmartPtrCXmlElement rootXml = CXmlUtils::parseFileStream(
+			filePath, "caf:providerResponse", CProviderResponseStreamHandler::MAX_DEPTH, handler);
+		providerResponseDoc = handler.getProviderResponse(rootXml);
 	}
 	CAF_CM_EXIT;
 
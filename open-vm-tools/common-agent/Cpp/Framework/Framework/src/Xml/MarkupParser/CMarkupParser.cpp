@@ -10,19 +10,31 @@
 #include "Exception/CCafException.h"
 #include <deque>
 #include <algorithm>
+#include <fstream>
 
 namespace Caf { namespace MarkupParser {
 
-std::string _xml;
+/*
+ * Below this many entries a linear scan is as fast as a map lookup, so small
+ * elements never pay for building an index.
+ */
+static const size_t INDEX_THRESHOLD = 8;
+
+// Read size used by parseFileStream
+static const std::streamsize STREAM_CHUNK_SIZE = 64 * 1024;
 
 struct SParserState {
 	SParserState() :
-		depth(0) {
+		depth(0),
+		handler(NULL),
+		maxHandlerDepth(0) {
 	}
 
 	SmartPtrElement root;
 	std::deque<SmartPtrElement> stack;
 	uint32 depth;
+	ElementHandler* handler;
+	uint32 maxHandlerDepth;
 
 private:
 	CAF_CM_DECLARE_NOCOPY(SParserState);
@@ -39,31 +51,34 @@ void cb_start_element(GMarkupParseContext *context,
 	try {
 		SParserState& state = *(reinterpret_cast<SParserState*>(user_data));
 		CAF_CM_ASSERT(state.depth == state.stack.size());
-		if (state.depth == 0) {
-			//TODO-BLW: For some reason the root is already created, so temporarily
-			// remove the assert and re-create the root.
-			//CAF_CM_ASSERT(!state.root);
-			state.root.CreateInstance();
-			state.stack.push_back(state.root);
-		}
-		else {
-			SmartPtrElement element;
-			element.CreateInstance();
-			state.stack.back()->children.push_back(element);
-			state.stack.push_back(element);
-		}
-
-		++state.depth;
-		SmartPtrElement element = state.stack.back();
+		SmartPtrElement element;
+		element.CreateInstance();
 		element->name = element_name;
 
 		const gchar **attr_name_cursor = attribute_names;
 		const gchar **attr_value_cursor = attribute_values;
 		while (*attr_name_cursor) {
-			element->attributes.push_back(Attribute(*attr_name_cursor, *attr_value_cursor));
+			element->attributes.push_back(
+					Attribute(*attr_name_cursor, *attr_value_cursor));
 			++attr_name_cursor;
 			++attr_value_cursor;
 		}
+
+		// Named before it is added so an existing child index sees the name
+		if (state.depth == 0) {
+			//TODO-BLW: For some reason the root is already created, so temporarily
+			// remove the assert and re-create the root.
+			//CAF_CM_ASSERT(!state.root);
+			state.root = element;
+			if (state.handler) {
+				state.handler->onStartRoot(element);
+			}
+		}
+		else {
+			addChild(state.stack.back(), element);
+		}
+		state.stack.push_back(element);
+		++state.depth;
 	}
 	catch(CCafException *e) {
 		std::string msg(e->getFullMsg());
@@ -92,14 +107,31 @@ void cb_end_element(GMarkupParseContext *context,
 	try {
 		SParserState& state = *(reinterpret_cast<SParserState*>(user_data));
 		CAF_CM_ASSERT((state.depth) && (state.depth == state.stack.size()));
+		SmartPtrElement element = state.stack.back();
 		--state.depth;
 		state.stack.pop_back();
+
+		if (state.handler && (state.depth < state.maxHandlerDepth)) {
+			SmartPtrElement parent;
+			if (! state.stack.empty()) {
+				parent = state.stack.back();
+			}
+
+			// An element that has just ended is always its parent's last child
+			if (state.handler->onEndElement(parent, element, state.depth + 1) &&
+				! parent.IsNull()) {
+				removeChild(parent, --parent->children.end());
+			}
+		}
 	}
 	catch(CCafException *e) {
 		std::string msg(e->getFullMsg());
 		e->Release();
 		*error = g_error_new_literal(G_MARKUP_ERROR, G_MARKUP_ERROR_INVALID_CONTENT, msg.c_str());
 	}
+	catch(std::exception& e) {
+		*error = g_error_new_literal(G_MARKUP_ERROR, G_MARKUP_ERROR_INVALID_CONTENT, e.what());
+	}
 }
 
 void cb_destroy_user_data(gpointer data) {
@@ -116,8 +148,6 @@ SmartPtrElement parseString(const std::string& xml) {
 	CAF_CM_STATIC_FUNC("MarkupParser", "parseString");
 	CAF_CM_VALIDATE_STRINGPTRA(xml.c_str());
 
-	_xml = xml;
-
 	SParserState *parserState = new SParserState();
 	GError *parserError = NULL;
 	GMarkupParseContext *context =
@@ -200,25 +230,166 @@ SmartPtrElement parseFile(const std::string& file) {
 	return root;
 }
 
+/*
+ * Feeds the stream to a parser whose handler consumes elements as they end.
+ * Unlike parseString/parseFile the document is closed with
+ * g_markup_parse_context_end_parse, since a chunked parse cannot otherwise
+ * tell a truncated document from a complete one.
+ */
+class CStreamParser {
+public:
+	CStreamParser(ElementHandler& handler, const uint32 maxDepth) :
+		_parserState(new SParserState()),
+		_context(NULL) {
+		_parserState->handler = &handler;
+		_parserState->maxHandlerDepth = maxDepth;
+		_context = g_markup_parse_context_new(&_markupParser,
+											  G_MARKUP_TREAT_CDATA_AS_TEXT,
+											  _parserState,
+											  cb_destroy_user_data);
+	}
+
+	~CStreamParser() {
+		if (_context) {
+			g_markup_parse_context_free(_context);
+		}
+	}
+
+	void parse(const gchar* text, const gsize textLen) {
+		GError *parserError = NULL;
+		if (! g_markup_parse_context_parse(_context, text, textLen, &parserError)) {
+			throwError(parserError);
+		}
+	}
+
+	SmartPtrElement finish() {
+		GError *parserError = NULL;
+		if (! g_markup_parse_context_end_parse(_context, &parserError)) {
+			throwError(parserError);
+		}
+		return _parserState->root;
+	}
+
+private:
+	SParserState* _parserState;
+	GMarkupParseContext* _context;
+
+	static void throwError(GError* parserError) {
+		CAF_CM_STATIC_FUNC("MarkupParser", "CStreamParser::throwError");
+
+		const gint code = parserError->code;
+		const std::string msg = parserError->message;
+		g_error_free(parserError);
+		CAF_CM_EXCEPTION_VA0(code, msg.c_str());
+	}
+
+	CAF_CM_DECLARE_NOCOPY(CStreamParser);
+};
+
+SmartPtrElement parseStringStream(
+		const std::string& xml,
+		ElementHandler& handler,
+		const uint32 maxDepth) {
+	CAF_CM_STATIC_FUNC_VALIDATE("MarkupParser", "parseStringStream");
+	CAF_CM_VALIDATE_STRINGPTRA(xml.c_str());
+
+	CStreamParser parser(handler, maxDepth);
+	parser.parse(xml.c_str(), xml.length());
+	return parser.finish();
+}
+
+SmartPtrElement parseFileStream(
+		const std::string& file,
+		ElementHandler& handler,
+		const uint32 maxDepth) {
+	CAF_CM_STATIC_FUNC("MarkupParser", "parseFileStream");
+	CAF_CM_VALIDATE_STRINGPTRA(file.c_str());
+
+	std::ifstream fileStream(file.c_str(), std::ios::in | std::ios::binary);
+	if (! fileStream.is_open()) {
+		CAF_CM_EXCEPTION_VA1(E_UNEXPECTED, "Error opening file - %s", file.c_str());
+	}
+
+	CStreamParser parser(handler, maxDepth);
+	std::string chunk(STREAM_CHUNK_SIZE, '\0');
+	std::streamsize total = 0;
+	while (fileStream) {
+		fileStream.read(&chunk[0], STREAM_CHUNK_SIZE);
+		const std::streamsize chunkLen = fileStream.gcount();
+		if (chunkLen > 0) {
+			parser.parse(chunk.c_str(), static_cast<gsize>(chunkLen));
+			total += chunkLen;
+		}
+	}
+
+	if (fileStream.bad()) {
+		CAF_CM_EXCEPTION_VA1(E_UNEXPECTED, "Error reading file - %s", file.c_str());
+	}
+	if (total == 0) {
+		CAF_CM_EXCEPTION_VA1(ERROR_INVALID_DATA, "File is empty - %s", file.c_str());
+	}
+
+	return parser.finish();
+}
+
 ChildIterator findChild(SmartPtrElement& element, const std::string& name) {
 	CAF_CM_STATIC_FUNC_VALIDATE("MarkupParser", "findChild");
 	CAF_CM_VALIDATE_SMARTPTR(element);
 	CAF_CM_VALIDATE_STRING(name);
 
+	if (element->childIndexValid) {
+		Element::ChildIndex::const_iterator entry = element->childIndex.find(name);
+		return (entry == element->childIndex.end()) ? element->children.end() : entry->second;
+	}
+
+	// The last matching child wins, so the scan cannot stop early
 	ChildIterator rc = element->children.end();
+	size_t count = 0;
 	for(ChildIterator childIter = element->children.begin();
 		childIter != element->children.end();
-		childIter++) {
+		childIter++, count++) {
 		if((*childIter)->name.compare(name) == 0) {
 			rc = childIter;
 		}
 	}
+
+	if (count > INDEX_THRESHOLD) {
+		element->childIndex.clear();
+		for(ChildIterator childIter = element->children.begin();
+			childIter != element->children.end();
+			childIter++) {
+			element->childIndex[(*childIter)->name] = childIter;
+		}
+		element->childIndexValid = true;
+	}
+
 	return rc;
-/*
-	return std::find_if(element->children.begin(),
-						element->children.end(),
-						std::bind2nd(ElementName(), name));
-*/
+}
+
+void addChild(SmartPtrElement& element, const SmartPtrElement& child) {
+	CAF_CM_STATIC_FUNC_VALIDATE("MarkupParser", "addChild");
+	CAF_CM_VALIDATE_SMARTPTR(element);
+	CAF_CM_VALIDATE_SMARTPTR(child);
+
+	element->children.push_back(child);
+	if (element->childIndexValid) {
+		element->childIndex[child->name] = --element->children.end();
+	}
+}
+
+void removeChild(SmartPtrElement& element, ChildIterator child) {
+	CAF_CM_STATIC_FUNC_VALIDATE("MarkupParser", "removeChild");
+	CAF_CM_VALIDATE_SMARTPTR(element);
+
+	if (element->childIndexValid) {
+		// An earlier child of the same name would have to be found again
+		Element::ChildIndex::iterator entry = element->childIndex.find((*child)->name);
+		if ((entry != element->childIndex.end()) && (entry->second == child)) {
+			element->childIndex.clear();
+			element->childIndexValid = false;
+		}
+	}
+	element->children.erase(child);
 }
 
 AttributeIterator findAttribute(Attributes& attributes, const std::string& name) {
@@ -229,13 +400,86 @@ AttributeIterator findAttribute(Attributes& attributes, const std::string& name)
 						std::bind2nd(AttributeName(), name));
 }
 
+AttributeIterator findAttribute(SmartPtrElement& element, const std::string& name) {
+	CAF_CM_STATIC_FUNC_VALIDATE("MarkupParser", "findAttribute");
+	CAF_CM_VALIDATE_SMARTPTR(element);
+	CAF_CM_VALIDATE_STRING(name);
+
+	if (element->attributeIndexValid) {
+		Element::AttributeIndex::const_iterator entry = element->attributeIndex.find(name);
+		return (entry == element->attributeIndex.end()) ? element->attributes.end() : entry->second;
+	}
+
+	size_t count = 0;
+	AttributeIterator rc = element->attributes.end();
+	for(AttributeIterator attrIter = element->attributes.begin();
+		attrIter != element->attributes.end();
+		attrIter++, count++) {
+		if ((rc == element->attributes.end()) && (attrIter->first.compare(name) == 0)) {
+			rc = attrIter;
+		}
+	}
+
+	if (count > INDEX_THRESHOLD) {
+		// insert() keeps the first attribute of a given name
+		element->attributeIndex.clear();
+		for(AttributeIterator attrIter = element->attributes.begin();
+			attrIter != element->attributes.end();
+			attrIter++) {
+			element->attributeIndex.insert(std::make_pair(attrIter->first, attrIter));
+		}
+		element->attributeIndexValid = true;
+	}
+
+	return rc;
+}
+
+void addAttribute(
+		SmartPtrElement& element,
+		const std::string& name,
+		const std::string& value) {
+	CAF_CM_STATIC_FUNC_VALIDATE("MarkupParser", "addAttribute");
+	CAF_CM_VALIDATE_SMARTPTR(element);
+	CAF_CM_VALIDATE_STRING(name);
+
+	element->attributes.push_back(Attribute(name, value));
+	if (element->attributeIndexValid) {
+		element->attributeIndex.insert(std::make_pair(name, --element->attributes.end()));
+	}
+}
+
+void removeAttribute(SmartPtrElement& element, AttributeIterator attribute) {
+	CAF_CM_STATIC_FUNC_VALIDATE("MarkupParser", "removeAttribute");
+	CAF_CM_VALIDATE_SMARTPTR(element);
+
+	if (element->attributeIndexValid) {
+		// A later attribute of the same name would have to be found again
+		Element::AttributeIndex::iterator entry = element->attributeIndex.find(attribute->first);
+		if ((entry != element->attributeIndex.end()) && (entry->second == attribute)) {
+			element->attributeIndex.clear();
+			element->attributeIndexValid = false;
+		}
+	}
+	element->attributes.erase(attribute);
+}
+
+void invalidateIndexes(SmartPtrElement& element) {
+	CAF_CM_STATIC_FUNC_VALIDATE("MarkupParser", "invalidateIndexes");
+	CAF_CM_VALIDATE_SMARTPTR(element);
+
+	element->childIndex.clear();
+	element->childIndexValid = false;
+	element->attributeIndex.clear();
+	element->attributeIndexValid = false;
+}
+
 std::string getAttributeValue(SmartPtrElement& element, const std::string& name) {
 	CAF_CM_STATIC_FUNC("MarkupParser", "getAttributeValue");
 	CAF_CM_VALIDATE_SMARTPTR(element);
 	CAF_CM_VALIDATE_STRING(name);
 	std::string rc;
 
-	AttributeIterator iter = findAttribute(element->attributes, name);
+	AttributeIterator iter = findAttribute(element, name);
 	if (iter != element->attributes.end()) {
 		rc = iter->second;
 	} else {
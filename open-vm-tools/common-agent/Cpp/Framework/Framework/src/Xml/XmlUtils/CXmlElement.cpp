@@ -51,7 +51,7 @@ std::string CXmlElement::findRequiredAttribute(const std::string& name) const {
 		name.c_str(), _path.c_str());
 
 	MarkupParser::AttributeIterator iter = MarkupParser::findAttribute(
-		_element->attributes, name);
+		_element, name);
 	CAF_CM_VALIDATE_COND_VA3(iter != _element->attributes.end(),
 		"element (%s) does not contain required attribute (%s) in %s",
 		_element->name.c_str(), name.c_str(), _path.c_str());
@@ -70,7 +70,7 @@ std::string CXmlElement::findOptionalAttribute(const std::string& name) const {
 	std::string rc;
 	if (!_element->attributes.empty()) {
 		MarkupParser::AttributeIterator iter = MarkupParser::findAttribute(
-			_element->attributes, name);
+			_element, name);
 		if (iter != _element->attributes.end()) {
 			rc = iter->second;
 		}
@@ -249,13 +249,13 @@ void CXmlElement::addAttribute(const std::string& name, const std::string& value
 
 	if (!_element->attributes.empty()) {
 		MarkupParser::AttributeIterator iter = MarkupParser::findAttribute(
-			_element->attributes, name);
+			_element, name);
 		CAF_CM_VALIDATE_COND_VA3(iter == _element->attributes.end(),
 			"element (%s) already contains attribute (%s) in %s", _element->name.c_str(),
 			name.c_str(), _path.c_str());
 	}
 
-	_element->attributes.push_back(std::make_pair(name, value));
+	MarkupParser::addAttribute(_element, name, value);
 }
 
 void CXmlElement::removeAttribute(const std::string& name) {
@@ -266,9 +266,9 @@ void CXmlElement::removeAttribute(const std::string& name) {
 
 	if (!_element->attributes.empty()) {
 		MarkupParser::AttributeIterator iter = MarkupParser::findAttribute(
-			_element->attributes, name);
+			_element, name);
 		if (iter != _element->attributes.end()) {
-			_element->attributes.erase(iter);
+			MarkupParser::removeAttribute(_element, iter);
 		}
 	}
 }
@@ -284,7 +284,7 @@ void CXmlElement::setAttribute(const std::string& name, const std::string& value
 		_element->name.c_str(), name.c_str(), _path.c_str());
 
 	MarkupParser::AttributeIterator iter = MarkupParser::findAttribute(
-		_element->attributes, name);
+		_element, name);
 	CAF_CM_VALIDATE_COND_VA3(iter != _element->attributes.end(),
 		"element (%s) does not contain required attribute (%s) in %s",
 		_element->name.c_str(), name.c_str(), _path.c_str());
@@ -305,7 +305,7 @@ SmartPtrCXmlElement CXmlElement::createAndAddElement(const std::string& name) {
 	rc.CreateInstance();
 	rc->initialize(element, _path);
 
-	_element->children.push_back(element);
+	MarkupParser::addChild(_element, element);
 
 	return rc;
 }
@@ -315,7 +315,7 @@ void CXmlElement::addChild(const SmartPtrCXmlElement& xmlElement) {
 	CAF_CM_PRECOND_ISINITIALIZED(_isInitialized);
 	CAF_CM_VALIDATE_SMARTPTR(xmlElement);
 
-	_element->children.push_back(xmlElement->getInternalElement());
+	MarkupParser::addChild(_element, xmlElement->getInternalElement());
 }
 
 void CXmlElement::removeChild(const std::string& name) {
@@ -325,7 +325,7 @@ void CXmlElement::removeChild(const std::string& name) {
 
 	const MarkupParser::ChildIterator iter = MarkupParser::findChild(_element, name);
 	if (iter != _element->children.end()) {
-		_element->children.erase(iter);
+		MarkupParser::removeChild(_element, iter);
 	}
 }
 
@@ -14,6 +14,76 @@
 
 using namespace Caf;
 
+namespace {
+
+/// Adapts CXmlUtils::CStreamHandler to the MarkupParser callback
+class CStreamAdapter : public MarkupParser::ElementHandler {
+public:
+	CStreamAdapter(
+		CXmlUtils::CStreamHandler& handler,
+		const std::string& path,
+		const std::string& rootName) :
+		_handler(handler),
+		_path(path),
+		_rootName(rootName) {
+	}
+
+	// Rejects a wrong document before the handler turns any of it into docs
+	void onStartRoot(const MarkupParser::SmartPtrElement& root) {
+		CAF_CM_STATIC_FUNC("CXmlUtils", "onStartRoot");
+
+		if (!_rootName.empty()) {
+			CAF_CM_VALIDATE_COND_VA3(root->name == _rootName,
+				"root not valid (\"%s\" != \"%s\") in %s", _rootName.c_str(),
+				root->name.c_str(), _path.c_str());
+		}
+	}
+
+	bool onEndElement(
+		const MarkupParser::SmartPtrElement& parent,
+		const MarkupParser::SmartPtrElement& element,
+		const uint32 depth) {
+		if (depth == 1) {
+			return false;
+		}
+
+		SmartPtrCXmlElement elementXml;
+		elementXml.CreateInstance();
+		elementXml->initialize(element, _path);
+
+		return _handler.onElement(parent->name, elementXml, depth);
+	}
+
+private:
+	CXmlUtils::CStreamHandler& _handler;
+	const std::string& _path;
+	const std::string& _rootName;
+
+	CAF_CM_DECLARE_NOCOPY(CStreamAdapter);
+};
+
+SmartPtrCXmlElement createStreamRoot(
+	const MarkupParser::SmartPtrElement& element,
+	const std::string& path,
+	const std::string& rootName) {
+	CAF_CM_STATIC_FUNC("CXmlUtils", "createStreamRoot");
+	CAF_CM_VALIDATE_SMARTPTR(element);
+	CAF_CM_VALIDATE_STRING(element->name);
+	if (!rootName.empty()) {
+		CAF_CM_VALIDATE_COND_VA3(element->name == rootName,
+			"root not valid (\"%s\" != \"%s\") in %s", rootName.c_str(),
+			element->name.c_str(), path.c_str());
+	}
+
+	SmartPtrCXmlElement xmlElement;
+	xmlElement.CreateInstance();
+	xmlElement->initialize(element, path);
+
+	return xmlElement;
+}
+
+}
+
 SmartPtrCXmlElement CXmlUtils::parseFile(
 	const std::string& path,
 	const std::string& rootName) {
@@ -66,6 +136,44 @@ SmartPtrCXmlElement CXmlUtils::parseString(
 	return xmlElement;
 }
 
+SmartPtrCXmlElement CXmlUtils::parseFileStream(
+	const std::string& path,
+	const std::string& rootName,
+	const uint32 maxDepth,
+	CStreamHandler& handler) {
+	CAF_CM_STATIC_FUNC("CXmlUtils", "parseFileStream");
+	CAF_CM_VALIDATE_STRING(path);
+	// rootName is optional
+
+	if (!FileSystemUtils::doesFileExist(path)) {
+		CAF_CM_EXCEPTION_VA1(ERROR_FILE_NOT_FOUND, "File not found: %s", path.c_str());
+	}
+
+	CStreamAdapter adapter(handler, path, rootName);
+	const MarkupParser::SmartPtrElement element =
+		MarkupParser::parseFileStream(path, adapter, maxDepth);
+
+	return createStreamRoot(element, path, rootName);
+}
+
+SmartPtrCXmlElement CXmlUtils::parseStringStream(
+	const std::string& xml,
+	const std::string& rootName,
+	const uint32 maxDepth,
+	CStreamHandler& handler) {
+	CAF_CM_STATIC_FUNC_VALIDATE("CXmlUtils", "parseStringStream");
+	CAF_CM_VALIDATE_STRING(xml);
+	// rootName is optional
+
+	const std::string path = "fromString";
+
+	CStreamAdapter adapter(handler, path, rootName);
+	const MarkupParser::SmartPtrElement element =
+		MarkupParser::parseStringStream(xml, adapter, maxDepth);
+
+	return createStreamRoot(element, path, rootName);
+}
+
 SmartPtrCXmlElement CXmlUtils::createRootElement(
 	const std::string& rootName,
 	const std::string& rootNamespace) {
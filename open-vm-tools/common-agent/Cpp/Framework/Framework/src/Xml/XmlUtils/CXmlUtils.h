@@ -15,6 +15,23 @@
 namespace Caf {
 
 class XMLUTILS_LINKAGE CXmlUtils {
+public:
+	/// Receives the children of the root while parseFileStream/parseStringStream
+	/// are still parsing.  Called once the end tag of each element between
+	/// depth 2 (children of the root) and maxDepth has been parsed; returning
+	/// true drops the element from the tree that is eventually returned.
+	/// The root name is checked when its start tag is parsed, so no element
+	/// of a wrong document reaches the handler.
+	class XMLUTILS_LINKAGE CStreamHandler {
+	public:
+		virtual ~CStreamHandler() {}
+
+		virtual bool onElement(
+			const std::string& parentName,
+			const SmartPtrCXmlElement& elementXml,
+			const uint32 depth) = 0;
+	};
+
 public:
 	static SmartPtrCXmlElement parseFile(
 		const std::string& path,
@@ -24,6 +41,18 @@ public:
 		const std::string& xml,
 		const std::string& rootName);
 
+	static SmartPtrCXmlElement parseFileStream(
+		const std::string& path,
+		const std::string& rootName,
+		const uint32 maxDepth,
+		CStreamHandler& handler);
+
+	static SmartPtrCXmlElement parseStringStream(
+		const std::string& xml,
+		const std::string& rootName,
+		const uint32 maxDepth,
+		CStreamHandler& handler);
+
 	static SmartPtrCXmlElement createRootElement(
 		const std::string& rootName,
 		const std::string& rootNamespace);
@@ -72,6 +72,7 @@ typedef union {
 typedef struct {
    DMFieldType type;
    DMFieldValue value;
+   Bool borrowed;   /* string payloads point into a deserialized buffer */
 } DataMapEntry;
 
 /* structure used in hashMap iteration callback */
@@ -92,6 +93,92 @@ typedef struct {
 
 static const uint64 magic_cookie = 0x4d41474943ULL;   /* 'MAGIC' */
 
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * EntryEncodedSize --
+ *
+ *      Compute how many bytes are needed to encode an entry, including its
+ *      type and field id.  The map keeps the sum of this over all entries
+ *      up to date, so serialization does not need a sizing pass.
+ *
+ * Result:
+ *      The encoded size.
+ *
+ * Side-effects:
+ *      None
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+static uint64
+EntryEncodedSize(const DataMapEntry *entry)    // IN
+{
+   uint64 size = sizeof(int32) + sizeof(DMKeyType);   /* type, fieldId */
+
+   switch(entry->type) {
+      case DMFIELDTYPE_INT64:
+         size += sizeof(int64);
+         break;
+      case DMFIELDTYPE_STRING:
+         size += sizeof(int32) + entry->value.string.length;
+         break;
+      case DMFIELDTYPE_INT64LIST:
+         size += sizeof(int32) +
+                 sizeof(int64) * (uint64)entry->value.numList.length;
+         break;
+      case DMFIELDTYPE_STRINGLIST:
+         {
+            char **strPtr = entry->value.strList.strings;
+            int32 *lenPtr = entry->value.strList.lengths;
+
+            size += sizeof(int32);    /* list size */
+            for (; *strPtr != NULL; strPtr++, lenPtr++) {
+               size += sizeof(int32) + *lenPtr;
+            }
+            break;
+         }
+      default:
+         ASSERT(0);    /*  we do not expect this to happen */
+   }
+
+   return size;
+}
+
+
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * AddEntry --
+ *
+ *      Low level helper function to add a filled in entry to the map.
+ *      - 'entry': ownership is passed to the map on success, and the entry
+ *        is freed (but not its payload) on failure.
+ *
+ * Result:
+ *      0 on success
+ *      error code otherwise
+ *
+ * Side-effects:
+ *      None
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+static ErrorCode
+AddEntry(DataMap *that,         // IN/OUT
+         DMKeyType key,         // IN
+         DataMapEntry *entry)   // IN
+{
+   if (!HashMap_Put(that->map, &key, &entry)) {
+      free(entry);
+      return DMERR_INSUFFICIENT_MEM;
+   }
+   that->encodedSize += EntryEncodedSize(entry);
+   return DMERR_SUCCESS;
+}
+
+
 /*
  *-----------------------------------------------------------------------------
  *
@@ -121,10 +208,8 @@ AddEntry_Int64(DataMap *that,      // IN/OUT
    }
    entry->type = DMFIELDTYPE_INT64;
    entry->value.number.val = value;
-   if (!HashMap_Put(that->map, &key, &entry)) {
-      return DMERR_INSUFFICIENT_MEM;
-   }
-   return DMERR_SUCCESS;
+   entry->borrowed = FALSE;
+   return AddEntry(that, key, entry);
 }
 
 
@@ -135,6 +220,8 @@ AddEntry_Int64(DataMap *that,      // IN/OUT
  *
  *      Low level helper function to add a string type entry to the map.
  *      - 'str': ownership of the str pointer is passed to the map on success.
+ *      - 'borrowed': if TRUE, str points into a deserialized buffer and is
+ *        never freed by the map.
  *
  * Result:
  *      0 on success
@@ -150,7 +237,8 @@ static ErrorCode
 AddEntry_String(DataMap *that,      // IN/OUT
                 DMKeyType  key,     // IN
                 char *str,          // IN
-                int32 strLen)       // IN
+                int32 strLen,       // IN
+                Bool borrowed)      // IN
 {
    DataMapEntry *entry = (DataMapEntry *)malloc(sizeof(DataMapEntry));
 
@@ -160,11 +248,9 @@ AddEntry_String(DataMap *that,      // IN/OUT
    entry->type = DMFIELDTYPE_STRING;
    entry->value.string.str = str;
    entry->value.string.length = strLen;
+   entry->borrowed = borrowed;
 
-   if (!HashMap_Put(that->map, &key, &entry)) {
-      return DMERR_INSUFFICIENT_MEM;
-   }
-   return DMERR_SUCCESS;
+   return AddEntry(that, key, entry);
 }
 
 
@@ -201,11 +287,9 @@ AddEntry_Int64List(DataMap *that,            // IN/OUT
    entry->type = DMFIELDTYPE_INT64LIST;
    entry->value.numList.numbers = numbers;
    entry->value.numList.length = listLen;
+   entry->borrowed = FALSE;
 
-   if (!HashMap_Put(that->map, &key, &entry)) {
-      return DMERR_INSUFFICIENT_MEM;
-   }
-   return DMERR_SUCCESS;
+   return AddEntry(that, key, entry);
 }
 
 
@@ -222,6 +306,8 @@ AddEntry_Int64List(DataMap *that,            // IN/OUT
  *      - 'strLens': this is an array of integers which indicating the length of
  *        cooresponding string in strList. the ownership is passed to the map
  *        as well on success.
+ *      - 'borrowed': if TRUE, the strings (but not the two arrays) point
+ *        into a deserialized buffer and are never freed by the map.
  *
  * Result:
  *      0 on success
@@ -237,7 +323,8 @@ static ErrorCode
 AddEntry_StringList(DataMap *that,            // IN/OUT
                     DMKeyType key,            // IN
                     char **strList,           // IN
-                    int32 *strLens)           // IN
+                    int32 *strLens,           // IN
+                    Bool borrowed)            // IN
 {
    DataMapEntry *entry = (DataMapEntry *)malloc(sizeof(DataMapEntry));
 
@@ -247,11 +334,9 @@ AddEntry_StringList(DataMap *that,            // IN/OUT
    entry->type = DMFIELDTYPE_STRINGLIST;
    entry->value.strList.strings = strList;
    entry->value.strList.lengths = strLens;
+   entry->borrowed = borrowed;
 
-   if (!HashMap_Put(that->map, &key, &entry)) {
-      return DMERR_INSUFFICIENT_MEM;
-   }
-   return DMERR_SUCCESS;
+   return AddEntry(that, key, entry);
 }
 
 
@@ -273,9 +358,10 @@ AddEntry_StringList(DataMap *that,            // IN/OUT
 
 static void
 FreeStringList(char **strList,    // IN
-               int32 *strLens)    // IN
+               int32 *strLens,    // IN
+               Bool borrowed)     // IN: strings point into a buffer
 {
-   if (*strList != NULL) {
+   if (strList != NULL && !borrowed) {
       char **ptr;
       for (ptr = strList; *ptr != NULL; ptr++) {
          free(*ptr);
@@ -292,7 +378,9 @@ FreeStringList(char **strList,    // IN
  *
  * FreeEntryPayload --
  *
- *      - low level helper function to free entry payload only
+ *      - low level helper function to free entry payload only.  Strings
+ *        of an entry created by DataMap_DeserializeView are not owned by
+ *        the map and are not freed.
  *
  * Result:
  *      None
@@ -314,18 +402,22 @@ FreeEntryPayload(DataMapEntry *entry)    // IN
       case DMFIELDTYPE_INT64:
          break;
       case DMFIELDTYPE_STRING:
-         free(entry->value.string.str);
+         if (!entry->borrowed) {
+            free(entry->value.string.str);
+         }
          break;
       case DMFIELDTYPE_INT64LIST:
          free(entry->value.numList.numbers);
          break;
       case DMFIELDTYPE_STRINGLIST:
          FreeStringList(entry->value.strList.strings,
-                        entry->value.strList.lengths);
+                        entry->value.strList.lengths,
+                        entry->borrowed);
          break;
       default:
          ASSERT(0);    /*  we do not expect this to happen */
    }
+   entry->borrowed = FALSE;
 }
 
 
@@ -498,6 +590,8 @@ EncodeString(char **buf,         // IN/OUT
  * DecodeString --
  *
  *      - low level helper function to decode a string from  a byte buffer
+ *      - 'borrow': if TRUE, *str points into the input buffer instead of
+ *        to a copy.
  *
  * Result:
  *      None
@@ -511,6 +605,7 @@ EncodeString(char **buf,         // IN/OUT
 static ErrorCode
 DecodeString(char **buf,         // IN/OUT
              int32 *left,        // IN/OUT
+             Bool borrow,        // IN
              char **str,         // OUT
              int32 *strLen)      // OUT
 {
@@ -522,16 +617,20 @@ DecodeString(char **buf,         // IN/OUT
       return res;
    }
 
-   if (*left < *strLen) {
+   if (*strLen < 0 || *left < *strLen) {
       return DMERR_TRUNCATED_DATA;
    }
 
-   *str = (char *)malloc(*strLen);
-   if (*str == NULL) {
-      return DMERR_INSUFFICIENT_MEM;
-   }
+   if (borrow) {
+      *str = *buf;
+   } else {
+      *str = (char *)malloc(*strLen);
+      if (*str == NULL) {
+         return DMERR_INSUFFICIENT_MEM;
+      }
 
-   memcpy(*str, *buf, *strLen);
+      memcpy(*str, *buf, *strLen);
+   }
    *buf += *strLen;
    *left -= *strLen;
 
@@ -603,6 +702,11 @@ DecodeInt64List(char **buf,        // IN/OUT
 
    res = DecodeInt32(buf, left, &listLen);
 
+   if (res == DMERR_SUCCESS &&
+       (listLen < 0 || listLen > *left / sizeof(int64))) {
+      res = DMERR_TRUNCATED_DATA;
+   }
+
    if (res == DMERR_SUCCESS) {
       int32 i;
 
@@ -755,6 +859,7 @@ DataMap_Create(DataMap *that)    // IN/OUT
 
    if (that->map != NULL) {
       that->cookie = magic_cookie;
+      that->encodedSize = 0;
       return DMERR_SUCCESS;
    }
 
@@ -1239,95 +1344,6 @@ HashMapToStringEntryCb(void *key,            // IN
 }
 
 
-/*
- *-----------------------------------------------------------------------------
- *
- * HashMapCalcEntrySizeCb --
- *
- *      - calculate how much space is needed to encode an entry
- *
- * Result:
- *      None
- *
- * Side-effects:
- *      None
- *
- *-----------------------------------------------------------------------------
- */
-
-static void
-HashMapCalcEntrySizeCb(void *key,            // IN
-                       void *data,           // IN
-                       void *userData)       // IN/OUT
-{
-   DataMapEntry *entry = *((DataMapEntry **)data);
-   ClientData *clientData = (ClientData *)userData;
-   uint32 oldLen = clientData->buffLen;
-   uint32 *buffLen = &(clientData->buffLen);
-
-   if (clientData->result != DMERR_SUCCESS) {
-      /* a previous error has occurred, so stop. */
-      return;
-   }
-
-   switch(entry->type) {
-      case DMFIELDTYPE_INT64:
-         {
-            *buffLen += sizeof(int32);        /* type */
-            *buffLen += sizeof(DMKeyType);    /* fieldId */
-            *buffLen += sizeof(int64);        /* int value */
-            break;
-         }
-      case DMFIELDTYPE_STRING:
-         {
-            *buffLen += sizeof(int32);        /* type */
-            *buffLen += sizeof(DMKeyType);    /* fieldId */
-            *buffLen += sizeof(int32);        /* string length */
-            *buffLen += entry->value.string.length; /* string payload */
-            break;
-         }
-      case DMFIELDTYPE_INT64LIST:
-         {
-            *buffLen += sizeof(int32);        /* type */
-            *buffLen += sizeof(DMKeyType);    /* fieldId */
-            *buffLen += sizeof(int32);        /* list size */
-            *buffLen += sizeof(int64) * entry->value.numList.length;
-            break;
-         }
-      case DMFIELDTYPE_STRINGLIST:
-         {
-            char **strPtr = entry->value.strList.strings;
-            int32 *lenPtr = entry->value.strList.lengths;
-
-            *buffLen += sizeof(int32);        /* type */
-            *buffLen += sizeof(DMKeyType);    /* fieldId */
-            *buffLen += sizeof(int32);        /* list size */
-
-            for (; *strPtr != NULL; strPtr++, lenPtr++) {
-               if (*buffLen < oldLen) {
-                  clientData->result = DMERR_INTEGER_OVERFLOW;
-                  return;
-               }
-
-               *buffLen += sizeof(int32);   /* string length */
-               *buffLen += *lenPtr;        /* string payload */
-            }
-            break;
-         }
-      default:
-         {
-            clientData->result = DMERR_UNKNOWN_TYPE;
-            return;
-         }
-   }
-
-   if (*buffLen < oldLen) {
-      clientData->result = DMERR_INTEGER_OVERFLOW;
-      return;
-   }
-}
-
-
 /*
  *-----------------------------------------------------------------------------
  *
@@ -1405,6 +1421,7 @@ HashMapSerializeEntryCb(void *key,            // IN
  *      Decode a string list entry and add to the dataMap
  *      - 'buf': *buf points to the input buffer. *buf is advanced accordingly
  *               on success.
+ *      - 'borrow': if TRUE, the strings point into the input buffer.
  *      - 'left': indicates number of bytes left in the input buffer, *left is
  *                updated accordingly on success.
  *
@@ -1420,6 +1437,7 @@ HashMapSerializeEntryCb(void *key,            // IN
 static ErrorCode
 DecodeStringList(char **buf,           // IN
                  int32 *left,          // IN
+                 Bool borrow,          // IN
                  DMKeyType fieldId,    // IN
                  DataMap *that)        // OUT
 {
@@ -1434,27 +1452,32 @@ DecodeStringList(char **buf,           // IN
       return res;
    }
 
+   /* each string takes at least its length */
+   if (listSize < 0 || listSize > *left / sizeof(int32)) {
+      return DMERR_TRUNCATED_DATA;
+   }
+
    strList = (char **)calloc(listSize + 1, sizeof(char *));
    strLens = (int32 *)malloc(sizeof(int32) * listSize);
 
    if (strList == NULL || strLens == NULL) {
-      FreeStringList(strList, strLens);
+      FreeStringList(strList, strLens, FALSE);
       return DMERR_INSUFFICIENT_MEM;
    }
 
    for (i = 0; i < listSize; i++) {
-      res = DecodeString(buf, left, &strList[i], &strLens[i]);
+      res = DecodeString(buf, left, borrow, &strList[i], &strLens[i]);
       if (res != DMERR_SUCCESS) {
          break;
       }
    }
 
    if (res == DMERR_SUCCESS) {
-      res = AddEntry_StringList(that, fieldId, strList, strLens);
+      res = AddEntry_StringList(that, fieldId, strList, strLens, borrow);
    }
 
    if (res != DMERR_SUCCESS) {
-      FreeStringList(strList, strLens);
+      FreeStringList(strList, strLens, borrow);
    }
 
    return res;
@@ -1500,7 +1523,7 @@ CopyStringListEntry(DMKeyType fieldId,                  // IN
    newLens = (int32 *)malloc(sizeof(int32) * listSize);
 
    if (newList == NULL || newLens == NULL) {
-      FreeStringList(newList, newLens);
+      FreeStringList(newList, newLens, FALSE);
       return DMERR_INSUFFICIENT_MEM;
    }
 
@@ -1518,11 +1541,11 @@ CopyStringListEntry(DMKeyType fieldId,                  // IN
    }
 
    if (res == DMERR_SUCCESS) {
-      res = AddEntry_StringList(dst, fieldId, newList, newLens);
+      res = AddEntry_StringList(dst, fieldId, newList, newLens, FALSE);
    }
 
    if (res != DMERR_SUCCESS) {
-      FreeStringList(newList, newLens);
+      FreeStringList(newList, newLens, FALSE);
    }
 
    return res;
@@ -1573,7 +1596,8 @@ HashMapCopyEntryCb(void *key,              // IN
             break;
          }
          memcpy(str, entry->value.string.str, entry->value.string.length);
-         res = AddEntry_String(dst, fieldId, str, entry->value.string.length);
+         res = AddEntry_String(dst, fieldId, str, entry->value.string.length,
+                              FALSE);
          if (res != DMERR_SUCCESS) {
             free(str);
          }
@@ -1666,6 +1690,7 @@ DataMap_Destroy(DataMap *that)    // IN/OUT
 
    that->map = NULL;
    that->cookie = 0;
+   that->encodedSize = 0;
 
    return DMERR_SUCCESS;
 }
@@ -1726,13 +1751,11 @@ DataMap_Copy(const DataMap *src,  // IN
 /*
  *-----------------------------------------------------------------------------
  *
- * DataMap_Serialize --
+ * DataMap_GetSerializedSize --
  *
- *     Serialize a DataMap to a buffer.
- *     - 'buf': on success, this points to the allocated serialize buffer.
- *       The caller *MUST* free this buffer to avoid memory leak.
- *     - 'bufLen': on success, this indicates the length of the allocated
- *       buffer.
+ *     Get the number of bytes DataMap_Serialize would produce for a map,
+ *     including the leading payload length.  The size is maintained as
+ *     entries are set, so this does not walk the map.
  *
  * Result:
  *     0 on success
@@ -1745,41 +1768,75 @@ DataMap_Copy(const DataMap *src,  // IN
  */
 
 ErrorCode
-DataMap_Serialize(const DataMap *that,     // IN
-                  char **buf,              // OUT
-                  uint32 *bufLen)          // OUT
+DataMap_GetSerializedSize(const DataMap *that,     // IN
+                          uint32 *size)            // OUT
 {
-   ClientData clientData;
-
-   if (that == NULL || buf == NULL || bufLen == NULL) {
+   if (that == NULL || size == NULL) {
       return DMERR_INVALID_ARGS;
    }
 
    ASSERT(that->cookie == magic_cookie);
 
-   /* get the buffer size first */
-   memset(&clientData, 0, sizeof clientData);
-   HashMap_Iterate(that->map, HashMapCalcEntrySizeCb, FALSE, &clientData);
-   if (clientData.result != DMERR_SUCCESS) {
-      return clientData.result;
+   /* 4 bytes is payload length, and the payload length must fit in an int32 */
+   if (that->encodedSize > MAX_INT32) {
+      return DMERR_INTEGER_OVERFLOW;
    }
 
-   /* 4 bytes is payload length */
-   *bufLen = clientData.buffLen + sizeof(uint32);
-   if (*bufLen < clientData.buffLen) {
-      return DMERR_INTEGER_OVERFLOW;
+   *size = (uint32)that->encodedSize + sizeof(uint32);
+   return DMERR_SUCCESS;
+}
+
+
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * DataMap_SerializeToBuffer --
+ *
+ *     Serialize a DataMap into a caller supplied buffer, in a single pass
+ *     over the map.
+ *     - 'buf': the output buffer.
+ *     - 'bufLen': the size of buf, see DataMap_GetSerializedSize.
+ *     - 'usedLen': on success, the number of bytes written to buf.
+ *
+ * Result:
+ *     0 on success
+ *     DMERR_BUFFER_TOO_SMALL if bufLen is too small; nothing is written.
+ *     error code on other failures.
+ *
+ * Side-effects:
+ *      None
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+ErrorCode
+DataMap_SerializeToBuffer(const DataMap *that,     // IN
+                          char *buf,               // OUT
+                          uint32 bufLen,           // IN
+                          uint32 *usedLen)         // OUT
+{
+   ClientData clientData;
+   ErrorCode res;
+   uint32 size;
+
+   if (buf == NULL || usedLen == NULL) {
+      return DMERR_INVALID_ARGS;
    }
 
-   *buf = (char *)malloc(*bufLen);
+   res = DataMap_GetSerializedSize(that, &size);
+   if (res != DMERR_SUCCESS) {
+      return res;
+   }
 
-   if (*buf == NULL) {
-      return DMERR_INSUFFICIENT_MEM;
+   if (bufLen < size) {
+      return DMERR_BUFFER_TOO_SMALL;
    }
 
-   /* now serialize the map into the buffer */
+   memset(&clientData, 0, sizeof clientData);
    clientData.map = (DataMap *)that;
    clientData.result = DMERR_SUCCESS;
-   clientData.buffer = *buf;
+   clientData.buffer = buf;
+   clientData.buffLen = size - sizeof(uint32);
 
    /* Encode the payload size */
    EncodeInt32(&(clientData.buffer), clientData.buffLen);
@@ -1789,10 +1846,8 @@ DataMap_Serialize(const DataMap *that,     // IN
    /* sanity check, make sure the buffer size is just used up*/
    ASSERT(clientData.buffLen == 0);
 
-   if (clientData.result != DMERR_SUCCESS) {
-      free(*buf);
-      *buf = NULL;
-      *bufLen = 0;
+   if (clientData.result == DMERR_SUCCESS) {
+      *usedLen = size;
    }
    return clientData.result;
 }
@@ -1801,16 +1856,17 @@ DataMap_Serialize(const DataMap *that,     // IN
 /*
  *-----------------------------------------------------------------------------
  *
- * DataMap_Deserialize --
+ * DataMap_Serialize --
  *
- *      Initialize an empty DataMap from a buffer.
- *      - 'that': the given map should *NOT* be initialized by the caller.
- *        On success, the caller needs to call DataMap_Destropy on 'that' to
- *        avoid any memory leak.
+ *     Serialize a DataMap to a buffer.
+ *     - 'buf': on success, this points to the allocated serialize buffer.
+ *       The caller *MUST* free this buffer to avoid memory leak.
+ *     - 'bufLen': on success, this indicates the length of the allocated
+ *       buffer.
  *
  * Result:
- *      - 0 on success
- *      - error code on failures.
+ *     0 on success
+ *     error code on failures.
  *
  * Side-effects:
  *      None
@@ -1819,44 +1875,47 @@ DataMap_Serialize(const DataMap *that,     // IN
  */
 
 ErrorCode
-DataMap_Deserialize(const char *bufIn ,    // IN
-                    const int32 bufLen,    // IN
-                    DataMap *that)         // OUT
+DataMap_Serialize(const DataMap *that,     // IN
+                  char **buf,              // OUT
+                  uint32 *bufLen)          // OUT
 {
    ErrorCode res;
-   int32 left = bufLen;   /* number of bytes undecoded */
-   int32 len;
-   char *buf = (char *)bufIn;
+   uint32 size;
 
-   if (that == NULL || bufIn == NULL || bufLen < 0) {
+   if (that == NULL || buf == NULL || bufLen == NULL) {
       return DMERR_INVALID_ARGS;
    }
 
-   /* decode the encoded buffer length */
-   res = DecodeInt32(&buf, &left, &len);
+   res = DataMap_GetSerializedSize(that, &size);
    if (res != DMERR_SUCCESS) {
       return res;
    }
 
-   if (len > bufLen - sizeof(int32)) {
-      return DMERR_TRUNCATED_DATA;
+   *buf = (char *)malloc(size);
+
+   if (*buf == NULL) {
+      return DMERR_INSUFFICIENT_MEM;
    }
 
-   left = len;
+   res = DataMap_SerializeToBuffer(that, *buf, size, bufLen);
 
-   return DataMap_DeserializeContent(buf, left, that);
+   if (res != DMERR_SUCCESS) {
+      free(*buf);
+      *buf = NULL;
+      *bufLen = 0;
+   }
+   return res;
 }
 
 
 /*
  *-----------------------------------------------------------------------------
  *
- * DataMap_DeserializeContent --
+ * DeserializeContent --
  *
  *      Initialize an empty DataMap from the content of the data map buffer
- *      - 'that': the given map should *NOT* be initialized by the caller.
- *        On success, the caller needs to call DataMap_Destropy on 'that' to
- *        avoid any memory leak.
+ *      - 'borrow': if TRUE, string values point into content rather than
+ *        to copies.
  *
  * Result:
  *      - 0 on success
@@ -1868,10 +1927,11 @@ DataMap_Deserialize(const char *bufIn ,    // IN
  *-----------------------------------------------------------------------------
  */
 
-ErrorCode
-DataMap_DeserializeContent(const char *content,    // IN
-                           const int32 contentLen, // IN
-                           DataMap *that)          // OUT
+static ErrorCode
+DeserializeContent(const char *content,    // IN
+                   const int32 contentLen, // IN
+                   Bool borrow,            // IN
+                   DataMap *that)          // OUT
 {
    ErrorCode res;
    int32 left = contentLen;   /* number of bytes undecoded */
@@ -1925,12 +1985,12 @@ DataMap_DeserializeContent(const char *content,    // IN
          {
             char *str;
             int32 strLen;
-            res = DecodeString(&buf, &left, &str, &strLen);
+            res = DecodeString(&buf, &left, borrow, &str, &strLen);
             if (res != DMERR_SUCCESS) {
                goto out;
             }
-            res = AddEntry_String(that, fieldId, str, strLen);
-            if (res != DMERR_SUCCESS) {
+            res = AddEntry_String(that, fieldId, str, strLen, borrow);
+            if (res != DMERR_SUCCESS && !borrow) {
                /* clean up memory */
                free(str);
             }
@@ -1943,7 +2003,7 @@ DataMap_DeserializeContent(const char *content,    // IN
          }
          case DMFIELDTYPE_STRINGLIST:
          {
-            res = DecodeStringList(&buf, &left, fieldId, that);
+            res = DecodeStringList(&buf, &left, borrow, fieldId, that);
             break;
          }
          default:
@@ -1963,6 +2023,172 @@ out:
 }
 
 
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * DecodeHeader --
+ *
+ *      Decode the payload length in front of a serialized DataMap.
+ *
+ * Result:
+ *      - 0 on success, with *content and *contentLen set to the payload.
+ *      - error code on failures.
+ *
+ * Side-effects:
+ *      None
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+static ErrorCode
+DecodeHeader(const char *bufIn,      // IN
+             const int32 bufLen,     // IN
+             char **content,         // OUT
+             int32 *contentLen)      // OUT
+{
+   ErrorCode res;
+   int32 left = bufLen;   /* number of bytes undecoded */
+   int32 len;
+   char *buf = (char *)bufIn;
+
+   if (bufIn == NULL || bufLen < 0) {
+      return DMERR_INVALID_ARGS;
+   }
+
+   /* decode the encoded buffer length */
+   res = DecodeInt32(&buf, &left, &len);
+   if (res != DMERR_SUCCESS) {
+      return res;
+   }
+
+   if (len < 0 || len > bufLen - sizeof(int32)) {
+      return DMERR_TRUNCATED_DATA;
+   }
+
+   *content = buf;
+   *contentLen = len;
+   return DMERR_SUCCESS;
+}
+
+
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * DataMap_Deserialize --
+ *
+ *      Initialize an empty DataMap from a buffer.
+ *      - 'that': the given map should *NOT* be initialized by the caller.
+ *        On success, the caller needs to call DataMap_Destropy on 'that' to
+ *        avoid any memory leak.
+ *
+ * Result:
+ *      - 0 on success
+ *      - error code on failures.
+ *
+ * Side-effects:
+ *      None
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+ErrorCode
+DataMap_Deserialize(const char *bufIn ,    // IN
+                    const int32 bufLen,    // IN
+                    DataMap *that)         // OUT
+{
+   ErrorCode res;
+   char *content;
+   int32 contentLen;
+
+   if (that == NULL) {
+      return DMERR_INVALID_ARGS;
+   }
+
+   res = DecodeHeader(bufIn, bufLen, &content, &contentLen);
+   if (res != DMERR_SUCCESS) {
+      return res;
+   }
+
+   return DeserializeContent(content, contentLen, FALSE, that);
+}
+
+
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * DataMap_DeserializeView --
+ *
+ *      Like DataMap_Deserialize, but string and string list values are not
+ *      copied: the pointers returned by DataMap_GetString and
+ *      DataMap_GetStringList point into bufIn.
+ *      - 'bufIn': must stay valid and unmodified until the values have been
+ *        read.  DataMap_Destroy does not access it, so it may be freed
+ *        before the map is destroyed.
+ *      - 'that': the given map should *NOT* be initialized by the caller.
+ *        On success, the caller needs to call DataMap_Destroy on 'that' to
+ *        avoid any memory leak.
+ *
+ * Result:
+ *      - 0 on success
+ *      - error code on failures.
+ *
+ * Side-effects:
+ *      None
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+ErrorCode
+DataMap_DeserializeView(const char *bufIn,     // IN
+                        const int32 bufLen,    // IN
+                        DataMap *that)         // OUT
+{
+   ErrorCode res;
+   char *content;
+   int32 contentLen;
+
+   if (that == NULL) {
+      return DMERR_INVALID_ARGS;
+   }
+
+   res = DecodeHeader(bufIn, bufLen, &content, &contentLen);
+   if (res != DMERR_SUCCESS) {
+      return res;
+   }
+
+   return DeserializeContent(content, contentLen, TRUE, that);
+}
+
+
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * DataMap_DeserializeContent --
+ *
+ *      Initialize an empty DataMap from the content of the data map buffer
+ *      - 'that': the given map should *NOT* be initialized by the caller.
+ *        On success, the caller needs to call DataMap_Destropy on 'that' to
+ *        avoid any memory leak.
+ *
+ * Result:
+ *      - 0 on success
+ *      - error code on failures.
+ *
+ * Side-effects:
+ *      None
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+ErrorCode
+DataMap_DeserializeContent(const char *content,    // IN
+                           const int32 contentLen, // IN
+                           DataMap *that)          // OUT
+{
+   return DeserializeContent(content, contentLen, FALSE, that);
+}
+
+
 /*
  *-----------------------------------------------------------------------------
  *
@@ -2004,6 +2230,7 @@ DataMap_SetInt64(DataMap *that,      // IN/OUT
    } else if (!replace){
       return DMERR_ALREADY_EXIST;
    } else {
+      that->encodedSize -= EntryEncodedSize(entry);
       if ((entry->type != DMFIELDTYPE_INT64)) {
          FreeEntryPayload(entry);
          entry->type = DMFIELDTYPE_INT64;
@@ -2011,6 +2238,7 @@ DataMap_SetInt64(DataMap *that,      // IN/OUT
 
       /* simple update */
       entry->value.number.val = value;
+      that->encodedSize += EntryEncodedSize(entry);
       return DMERR_SUCCESS;
    }
 }
@@ -2060,15 +2288,17 @@ DataMap_SetString(DataMap *that,       // IN/OUT
 
    entry = LookupEntry(that, fieldId);
    if (entry == NULL) {
-      return AddEntry_String(that, fieldId, str, strLen);
+      return AddEntry_String(that, fieldId, str, strLen, FALSE);
    } else if (!replace){
       return DMERR_ALREADY_EXIST;
    } else {
+      that->encodedSize -= EntryEncodedSize(entry);
       FreeEntryPayload(entry);
 
       entry->type = DMFIELDTYPE_STRING;
       entry->value.string.str = str;
       entry->value.string.length = strLen;
+      that->encodedSize += EntryEncodedSize(entry);
 
       return DMERR_SUCCESS;
    }
@@ -2119,11 +2349,13 @@ DataMap_SetInt64List(DataMap *that,        // IN/OUT
    } else if (!replace){
       return DMERR_ALREADY_EXIST;
    } else {
+      that->encodedSize -= EntryEncodedSize(entry);
       FreeEntryPayload(entry);
 
       entry->type = DMFIELDTYPE_INT64LIST;
       entry->value.numList.numbers = numList;
       entry->value.numList.length = listLen;
+      that->encodedSize += EntryEncodedSize(entry);
 
       return DMERR_SUCCESS;
    }
@@ -2175,15 +2407,17 @@ DataMap_SetStringList(DataMap *that,          // IN/OUT
    entry = LookupEntry(that, fieldId);
    if (entry == NULL) {
       /* need to add a new entry */
-      return AddEntry_StringList(that, fieldId, strList, strLens);
+      return AddEntry_StringList(that, fieldId, strList, strLens, FALSE);
    } else if (!replace){
       return DMERR_ALREADY_EXIST;
    } else {
+      that->encodedSize -= EntryEncodedSize(entry);
       FreeEntryPayload(entry);
 
       entry->type = DMFIELDTYPE_STRINGLIST;
       entry->value.strList.strings = strList;
       entry->value.strList.lengths = strLens;
+      that->encodedSize += EntryEncodedSize(entry);
 
       return DMERR_SUCCESS;
    }
@@ -0,0 +1,792 @@
+/*********************************************************
+ * Copyright (C) 2016 VMware, Inc. All rights reserved.
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU Lesser General Public License as published
+ * by the Free Software Foundation version 2.1 and no later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+ * or FITNESS FOR A PARTICULAR PURPOSE.  See the Lesser GNU General Public
+ * License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin St, Fifth Floor, Boston, MA  02110-1301 USA.
+ *
+ *********************************************************/
+
+/*
+ * fileMountTable.c --
+ *
+ *      Process-wide cache of the parsed mount table.
+ *
+ *      The mount table is parsed into an immutable, reference counted
+ *      snapshot.  Besides the entries themselves (in mount table order), a
+ *      snapshot holds a trie of mount point path components which answers
+ *      "which mount point is the nearest ancestor of this path" with one walk
+ *      down the path, instead of one full mount table scan per ancestor.
+ *
+ *      The kernel signals POLLPRI on an open /proc/self/mountinfo whenever
+ *      the mount namespace changes; the snapshot is reparsed only then.  When
+ *      MOUNTED is a regular file maintained by mount(8) rather than a proc
+ *      file, its inode, size and modification time are also checked, as it
+ *      is updated after the mount itself has happened.
+ */
+
+#if defined(__linux__) && !defined(__ANDROID__)
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <sys/poll.h>
+#include <unistd.h>
+#include <mntent.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+
+#include "vmware.h"
+#include "posix.h"
+#include "file.h"
+#include "fileMountTable.h"
+#include "util.h"
+#include "userlock.h"
+
+#define FILE_MOUNTINFO          "/proc/self/mountinfo"
+#define FILE_MOUNT_NONE         MAX_UINT32
+
+typedef struct FileMountNode {
+   const char *name;     // Path component, points into an entry's mountPoint
+   uint32 nameLen;
+   uint32 parent;
+   uint32 lastChild;     // Most recently added child; fill cursor afterwards
+   uint32 firstChild;    // Index of the first child in children[]
+   uint32 numChildren;
+   uint32 entry;         // Entry mounted on this node or FILE_MOUNT_NONE
+} FileMountNode;
+
+struct FileMountTable {
+   Atomic_uint32 refCount;
+   uint32 generation;
+   uint32 numEntries;
+   FileMountEntry *entries;
+   uint32 numNodes;
+   FileMountNode *nodes;   // nodes[0] is "/"
+   uint32 *children;       // Children of each node, sorted by name
+};
+
+static struct {
+   FileMountTable *table;  // Current snapshot, holds one reference
+   uint32 generation;
+   Bool initialized;
+   int mountInfoFd;        // For change notification, -1 if unavailable
+   Bool checkMtab;         // MOUNTED is a regular file, not a proc file
+   struct stat mtabStat;
+} fileMountCache = { NULL, 0, FALSE, -1, FALSE };
+
+
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * FileMountNextComponent --
+ *
+ *      Finds the next component of a path, skipping any leading separators.
+ *
+ * Results:
+ *      Pointer to the component; its length is returned in *len and is zero
+ *      at the end of the path.
+ *
+ * Side effects:
+ *      None
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+static const char *
+FileMountNextComponent(const char *path,  // IN:
+                       size_t *len)       // OUT:
+{
+   while (*path == DIRSEPC) {
+      path++;
+   }
+
+   *len = strcspn(path, DIRSEPS);
+
+   return path;
+}
+
+
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * FileMountCompareComponent --
+ *
+ *      Compares two path components bytewise.
+ *
+ * Results:
+ *      <0, 0 or >0 as for strcmp.
+ *
+ * Side effects:
+ *      None
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+static int
+FileMountCompareComponent(const char *a,  // IN:
+                          size_t aLen,    // IN:
+                          const char *b,  // IN:
+                          size_t bLen)    // IN:
+{
+   int res = memcmp(a, b, MIN(aLen, bLen));
+
+   if (res != 0) {
+      return res;
+   }
+
+   return (aLen > bLen) - (aLen < bLen);
+}
+
+
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * FileMountComparePaths --
+ *
+ *      qsort callback ordering entries by mount point, component by
+ *      component, so that a parent sorts before all of its descendants and
+ *      siblings sort by name.  Entries with the same mount point keep mount
+ *      table order.
+ *
+ * Results:
+ *      <0, 0 or >0 as for strcmp.
+ *
+ * Side effects:
+ *      None
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+static int
+FileMountComparePaths(const void *a,  // IN:
+                      const void *b)  // IN:
+{
+   const FileMountEntry *ea = *(const FileMountEntry * const *)a;
+   const FileMountEntry *eb = *(const FileMountEntry * const *)b;
+   const char *pa = ea->mountPoint;
+   const char *pb = eb->mountPoint;
+
+   for (;;) {
+      size_t la;
+      size_t lb;
+      int res;
+
+      pa = FileMountNextComponent(pa, &la);
+      pb = FileMountNextComponent(pb, &lb);
+      if (la == 0 || lb == 0) {
+         if (la != lb) {
+            return la == 0 ? -1 : 1;
+         }
+         break;
+      }
+
+      res = FileMountCompareComponent(pa, la, pb, lb);
+      if (res != 0) {
+         return res;
+      }
+
+      pa += la;
+      pb += lb;
+   }
+
+   return (ea > eb) - (ea < eb);
+}
+
+
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * FileMountTableBuildIndex --
+ *
+ *      Builds the mount point trie of a freshly parsed table.
+ *
+ *      Entries are visited in path order, so the children of every node are
+ *      created in name order and a path shares a prefix node only with the
+ *      most recently created child.
+ *
+ * Results:
+ *      None
+ *
+ * Side effects:
+ *      Fills in nodes and children.
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+static void
+FileMountTableBuildIndex(FileMountTable *table)  // IN/OUT:
+{
+   const FileMountEntry **sorted;
+   uint32 maxNodes = 1;
+   uint32 next;
+   uint32 i;
+
+   for (i = 0; i < table->numEntries; i++) {
+      const char *p = table->entries[i].mountPoint;
+      size_t len;
+
+      for (;;) {
+         p = FileMountNextComponent(p, &len);
+         if (len == 0) {
+            break;
+         }
+         maxNodes++;
+         p += len;
+      }
+   }
+
+   table->nodes = Util_SafeMalloc(maxNodes * sizeof *table->nodes);
+   table->nodes[0].name = "";
+   table->nodes[0].nameLen = 0;
+   table->nodes[0].parent = FILE_MOUNT_NONE;
+   table->nodes[0].lastChild = FILE_MOUNT_NONE;
+   table->nodes[0].numChildren = 0;
+   table->nodes[0].entry = FILE_MOUNT_NONE;
+   table->numNodes = 1;
+
+   sorted = Util_SafeMalloc(MAX(table->numEntries, 1) * sizeof *sorted);
+   for (i = 0; i < table->numEntries; i++) {
+      sorted[i] = &table->entries[i];
+   }
+   qsort(sorted, table->numEntries, sizeof *sorted, FileMountComparePaths);
+
+   for (i = 0; i < table->numEntries; i++) {
+      const char *p = sorted[i]->mountPoint;
+      uint32 cur = 0;
+      size_t len;
+
+      for (;;) {
+         FileMountNode *node = &table->nodes[cur];
+         uint32 last = node->lastChild;
+
+         p = FileMountNextComponent(p, &len);
+         if (len == 0) {
+            break;
+         }
+
+         if (last != FILE_MOUNT_NONE &&
+             FileMountCompareComponent(table->nodes[last].name,
+                                       table->nodes[last].nameLen,
+                                       p, len) == 0) {
+            cur = last;
+         } else {
+            FileMountNode *child = &table->nodes[table->numNodes];
+
+            ASSERT(table->numNodes < maxNodes);
+            child->name = p;
+            child->nameLen = len;
+            child->parent = cur;
+            child->lastChild = FILE_MOUNT_NONE;
+            child->numChildren = 0;
+            child->entry = FILE_MOUNT_NONE;
+            node->lastChild = table->numNodes;
+            node->numChildren++;
+            cur = table->numNodes++;
+         }
+         p += len;
+      }
+
+      /* Like the mount table scans this replaces, the first entry wins. */
+      if (table->nodes[cur].entry == FILE_MOUNT_NONE) {
+         table->nodes[cur].entry = sorted[i] - table->entries;
+      }
+   }
+
+   free(sorted);
+
+   /* Lay the children of each node out contiguously, in creation order. */
+   table->children = Util_SafeMalloc(table->numNodes *
+                                     sizeof *table->children);
+   next = 0;
+   for (i = 0; i < table->numNodes; i++) {
+      table->nodes[i].firstChild = next;
+      table->nodes[i].lastChild = 0;
+      next += table->nodes[i].numChildren;
+   }
+   for (i = 1; i < table->numNodes; i++) {
+      FileMountNode *parent = &table->nodes[table->nodes[i].parent];
+
+      table->children[parent->firstChild + parent->lastChild++] = i;
+   }
+}
+
+
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * FileMountTableFree --
+ *
+ *      Frees a mount table snapshot.
+ *
+ * Results:
+ *      None
+ *
+ * Side effects:
+ *      None
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+static void
+FileMountTableFree(FileMountTable *table)  // IN:
+{
+   uint32 i;
+
+   for (i = 0; i < table->numEntries; i++) {
+      /* All of an entry's strings share the fsName allocation. */
+      free(table->entries[i].fsName);
+   }
+   free(table->entries);
+   free(table->nodes);
+   free(table->children);
+   free(table);
+}
+
+
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * FileMountTableLoad --
+ *
+ *      Parses a mount table file (in the getmntent(3) format) into a new
+ *      snapshot.
+ *
+ * Results:
+ *      On success: The snapshot, with one reference.
+ *      On failure: NULL.
+ *
+ * Side effects:
+ *      None
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+static FileMountTable *
+FileMountTableLoad(const char *pathName)  // IN:
+{
+   FileMountTable *table;
+   uint32 maxEntries;
+   struct mntent mnt;
+   FILE *f;
+   char *buf;
+   size_t size;
+   size_t used;
+
+   size = 4 * FILE_MAXPATH;  // Should suffice for most locales
+
+retry:
+   f = Posix_Setmntent(pathName, "r");
+   if (f == NULL) {
+      return NULL;
+   }
+
+   table = Util_SafeCalloc(1, sizeof *table);
+   maxEntries = 0;
+   buf = Util_SafeMalloc(size);
+
+   while (Posix_Getmntent_r(f, &mnt, buf, size) != NULL) {
+      FileMountEntry *entry;
+      size_t fsNameLen;
+      size_t dirLen;
+      size_t typeLen;
+      size_t optsLen;
+
+      /*
+       * See how much space getmntent_r used and increase the buffer size if
+       * needed; on UTF-8 based platforms it can silently truncate strings.
+       */
+
+      if (!mnt.mnt_fsname || !mnt.mnt_dir || !mnt.mnt_type ||
+          !mnt.mnt_opts) {
+         used = size;
+      } else {
+         fsNameLen = strlen(mnt.mnt_fsname) + 1;
+         dirLen = strlen(mnt.mnt_dir) + 1;
+         typeLen = strlen(mnt.mnt_type) + 1;
+         optsLen = strlen(mnt.mnt_opts) + 1;
+         used = fsNameLen + dirLen + typeLen + optsLen;
+      }
+      if (used >= size) {
+         size += 4 * FILE_MAXPATH;
+         ASSERT(size <= 32 * FILE_MAXPATH);
+         free(buf);
+         endmntent(f);
+         FileMountTableFree(table);
+         goto retry;
+      }
+
+      if (table->numEntries == maxEntries) {
+         maxEntries = MAX(2 * maxEntries, 64);
+         table->entries = Util_SafeRealloc(table->entries,
+                                           maxEntries *
+                                           sizeof *table->entries);
+      }
+
+      entry = &table->entries[table->numEntries++];
+      entry->fsName = Util_SafeMalloc(used);
+      entry->mountPoint = entry->fsName + fsNameLen;
+      entry->fsType = entry->mountPoint + dirLen;
+      entry->options = entry->fsType + typeLen;
+      memcpy(entry->fsName, mnt.mnt_fsname, fsNameLen);
+      memcpy(entry->mountPoint, mnt.mnt_dir, dirLen);
+      memcpy(entry->fsType, mnt.mnt_type, typeLen);
+      memcpy(entry->options, mnt.mnt_opts, optsLen);
+   }
+
+   endmntent(f);
+   free(buf);
+
+   FileMountTableBuildIndex(table);
+   Atomic_Write32(&table->refCount, 1);
+
+   return table;
+}
+
+
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * FileMountTableChanged --
+ *
+ *      Checks whether the cached snapshot may be stale.  Must be called with
+ *      the cache lock held.
+ *
+ * Results:
+ *      TRUE if the mount table must be reparsed.
+ *
+ * Side effects:
+ *      Consumes a pending mount namespace change notification.
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+static Bool
+FileMountTableChanged(void)
+{
+   struct pollfd pfd;
+   struct stat statBuf;
+
+   if (fileMountCache.mountInfoFd < 0) {
+      return TRUE;
+   }
+
+   /*
+    * POLLPRI (with POLLERR) is only ever reported after a change; errors are
+    * treated as a change too.
+    */
+
+   pfd.fd = fileMountCache.mountInfoFd;
+   pfd.events = POLLPRI;
+   pfd.revents = 0;
+   if (poll(&pfd, 1, 0) != 0) {
+      return TRUE;
+   }
+
+   if (fileMountCache.checkMtab) {
+      if (Posix_Stat(MOUNTED, &statBuf) != 0 ||
+          statBuf.st_ino != fileMountCache.mtabStat.st_ino ||
+          statBuf.st_size != fileMountCache.mtabStat.st_size ||
+          statBuf.st_mtime != fileMountCache.mtabStat.st_mtime) {
+         return TRUE;
+      }
+   }
+
+   return FALSE;
+}
+
+
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * FileMountTable_Get --
+ *
+ *      Returns the current mount table, reparsing it only if it may have
+ *      changed since it was last parsed.
+ *
+ * Results:
+ *      On success: A snapshot which must be released with
+ *                  FileMountTable_Release().
+ *      On failure: NULL.
+ *
+ * Side effects:
+ *      None
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+FileMountTable *
+FileMountTable_Get(void)
+{
+   static Atomic_Ptr lckStorage;
+   FileMountTable *table;
+   MXUserExclLock *lck = MXUser_CreateSingletonExclLock(&lckStorage,
+                                                        "fileMountTableLock",
+                                                        RANK_LEAF);
+
+   MXUser_AcquireExclLock(lck);
+
+   if (UNLIKELY(!fileMountCache.initialized)) {
+      struct stat mountInfoStat;
+
+      /*
+       * Open the notification file before the first parse so that no
+       * change can slip in between the two.
+       */
+
+      fileMountCache.mountInfoFd = Posix_Open(FILE_MOUNTINFO,
+                                              O_RDONLY | O_CLOEXEC);
+      if (fileMountCache.mountInfoFd >= 0 &&
+          fstat(fileMountCache.mountInfoFd, &mountInfoStat) == 0 &&
+          Posix_Stat(MOUNTED, &fileMountCache.mtabStat) == 0) {
+         fileMountCache.checkMtab =
+            fileMountCache.mtabStat.st_dev != mountInfoStat.st_dev;
+      }
+      fileMountCache.initialized = TRUE;
+   }
+
+   if (fileMountCache.table == NULL || FileMountTableChanged()) {
+      if (fileMountCache.checkMtab &&
+          Posix_Stat(MOUNTED, &fileMountCache.mtabStat) != 0) {
+         memset(&fileMountCache.mtabStat, 0, sizeof fileMountCache.mtabStat);
+      }
+
+      table = FileMountTableLoad(MOUNTED);
+      if (table != NULL) {
+         table->generation = ++fileMountCache.generation;
+      }
+
+      FileMountTable_Release(fileMountCache.table);
+      fileMountCache.table = table;
+   }
+
+   table = fileMountCache.table;
+   if (table != NULL) {
+      Atomic_Inc32(&table->refCount);
+   }
+
+   MXUser_ReleaseExclLock(lck);
+
+   return table;
+}
+
+
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * FileMountTable_Load --
+ *
+ *      Parses the given mount table file (in the getmntent(3) format),
+ *      bypassing the cache.  Meant for tools and tests that need a snapshot
+ *      of a table other than MOUNTED.
+ *
+ * Results:
+ *      On success: A snapshot of generation zero, which must be released
+ *                  with FileMountTable_Release().
+ *      On failure: NULL.
+ *
+ * Side effects:
+ *      None
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+FileMountTable *
+FileMountTable_Load(const char *pathName)  // IN:
+{
+   return FileMountTableLoad(pathName);
+}
+
+
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * FileMountTable_Release --
+ *
+ *      Releases a snapshot returned by FileMountTable_Get() or
+ *      FileMountTable_Load().
+ *
+ * Results:
+ *      None
+ *
+ * Side effects:
+ *      The snapshot is freed once it is no longer current nor referenced.
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+void
+FileMountTable_Release(FileMountTable *table)  // IN:
+{
+   if (table != NULL && Atomic_ReadDec32(&table->refCount) == 1) {
+      FileMountTableFree(table);
+   }
+}
+
+
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * FileMountTable_GetGeneration --
+ *
+ *      Returns the generation of a snapshot.  Every reparse of the mount
+ *      table yields a new generation, so callers can cheaply tell whether
+ *      state they derived from an earlier snapshot is still current.
+ *
+ * Results:
+ *      The generation, never zero for snapshots from FileMountTable_Get().
+ *
+ * Side effects:
+ *      None
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+uint32
+FileMountTable_GetGeneration(const FileMountTable *table)  // IN:
+{
+   return table->generation;
+}
+
+
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * FileMountTable_GetCount --
+ *
+ *      Returns the number of entries in a snapshot.
+ *
+ * Results:
+ *      The number of entries.
+ *
+ * Side effects:
+ *      None
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+uint32
+FileMountTable_GetCount(const FileMountTable *table)  // IN:
+{
+   return table->numEntries;
+}
+
+
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * FileMountTable_GetEntry --
+ *
+ *      Returns an entry of a snapshot, in mount table order.
+ *
+ * Results:
+ *      The entry, valid until the snapshot is released.
+ *
+ * Side effects:
+ *      None
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+const FileMountEntry *
+FileMountTable_GetEntry(const FileMountTable *table,  // IN:
+                        uint32 index)                 // IN:
+{
+   ASSERT(index < table->numEntries);
+
+   return &table->entries[index];
+}
+
+
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * FileMountTable_Lookup --
+ *
+ *      Finds the mount point that is the nearest ancestor of (or equal to)
+ *      the canonical path 'canPath'.
+ *
+ * Results:
+ *      The entry mounted there, valid until the snapshot is released, or
+ *      NULL if there is none.  If 'prefixLen' is not NULL, it receives the
+ *      length of the leading part of 'canPath' naming the mount point.
+ *
+ * Side effects:
+ *      None
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+const FileMountEntry *
+FileMountTable_Lookup(const FileMountTable *table,  // IN:
+                      const char *canPath,          // IN:
+                      size_t *prefixLen)            // OUT/OPT:
+{
+   const FileMountNode *node = &table->nodes[0];
+   uint32 best = node->entry;
+   size_t bestLen = 1;
+   const char *p = canPath;
+
+   for (;;) {
+      uint32 lo = 0;
+      uint32 hi = node->numChildren;
+      const FileMountNode *child = NULL;
+      size_t len;
+
+      p = FileMountNextComponent(p, &len);
+      if (len == 0) {
+         break;
+      }
+
+      while (lo < hi) {
+         uint32 mid = lo + (hi - lo) / 2;
+         const FileMountNode *cand =
+            &table->nodes[table->children[node->firstChild + mid]];
+         int res = FileMountCompareComponent(p, len, cand->name,
+                                             cand->nameLen);
+
+         if (res == 0) {
+            child = cand;
+            break;
+         } else if (res < 0) {
+            hi = mid;
+         } else {
+            lo = mid + 1;
+         }
+      }
+
+      if (child == NULL) {
+         break;
+      }
+
+      node = child;
+      p += len;
+      if (node->entry != FILE_MOUNT_NONE) {
+         best = node->entry;
+         bestLen = p - canPath;
+      }
+   }
+
+   if (best == FILE_MOUNT_NONE) {
+      return NULL;
+   }
+
+   if (prefixLen != NULL) {
+      *prefixLen = bestLen;
+   }
+
+   return &table->entries[best];
+}
+
+#endif
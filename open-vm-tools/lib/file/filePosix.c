@@ -67,6 +67,7 @@
 #include "hostType.h"
 #include "vmfs.h"
 #include "hashTable.h"
+#include "fileMountTable.h"
 
 #ifdef VMX86_SERVER
 #include "fs_public.h"
@@ -79,7 +80,7 @@
 
 #if !defined(__FreeBSD__) && !defined(sun)
 #if !defined(__APPLE__)
-static char *FilePosixLookupMountPoint(char const *canPath, Bool *bind);
+static char *FilePosixLookupMountPoint(char *canPath, Bool *bind);
 #endif
 static char *FilePosixNearestExistingAncestor(char const *path);
 
@@ -1699,10 +1700,12 @@ exit:
  *
  * FilePosixLookupMountPoint --
  *
- *      Looks up passed in canonical file path in list of mount points.
- *      If there is a match, it returns the underlying device name of the
- *      mount point along with a flag indicating whether the mount point is
- *      mounted with the "--[r]bind" option.
+ *      Looks up the nearest ancestor of the passed in canonical file path
+ *      (or the path itself) in the list of mount points. If there is a
+ *      match, it truncates the path to that mount point and returns the
+ *      underlying device name of the mount point along with a flag
+ *      indicating whether the mount point is mounted with the "--[r]bind"
+ *      option.
  *
  * Results:
  *      On success: The allocated, NUL-terminated mounted "device".
@@ -1715,100 +1718,54 @@ exit:
  */
 
 static char *
-FilePosixLookupMountPoint(char const *canPath,  // IN: Canonical file path
-                          Bool *bind)           // OUT: Mounted with --[r]bind?
+FilePosixLookupMountPoint(char *canPath,  // IN/OUT: Canonical file path
+                          Bool *bind)     // OUT: Mounted with --[r]bind?
 {
 #if defined NO_SETMNTENT || defined NO_ENDMNTENT
    NOT_IMPLEMENTED();
    errno = ENOSYS;
    return NULL;
 #else
-   FILE *f;
-   struct mntent mnt;
-   char *buf;
-   size_t size;
-   size_t used;
+   FileMountTable *table;
+   const FileMountEntry *entry;
+   size_t len;
    char *ret = NULL;
 
    ASSERT(canPath);
    ASSERT(bind);
 
-   size = 4 * FILE_MAXPATH;  // Should suffice for most locales
-
-retry:
-   f = setmntent(MOUNTED, "r");
-   if (f == NULL) {
+   table = FileMountTable_Get();
+   if (table == NULL) {
       return NULL;
    }
 
-   buf = Util_SafeMalloc(size);
-
-   while (Posix_Getmntent_r(f, &mnt, buf, size) != NULL) {
-
-      /*
-       * Our Posix_Getmntent_r graciously sets errno when the buffer
-       * is too small, but on UTF-8 based platforms Posix_Getmntent_r
-       * is #defined to the system's getmntent_r, which can simply
-       * truncate the strings with no other indication.  See how much
-       * space it used and increase the buffer size if needed.  Note
-       * that if some of the strings are empty, they may share a
-       * common nul in the buffer, and the resulting size calculation
-       * will be a little over-zealous.
-       */
-
-      used = 0;
-      if (mnt.mnt_fsname) {
-         used += strlen(mnt.mnt_fsname) + 1;
-      }
-      if (mnt.mnt_dir) {
-         used += strlen(mnt.mnt_dir) + 1;
-      }
-      if (mnt.mnt_type) {
-         used += strlen(mnt.mnt_type) + 1;
-      }
-      if (mnt.mnt_opts) {
-         used += strlen(mnt.mnt_opts) + 1;
-      }
-      if (used >= size || !mnt.mnt_fsname || !mnt.mnt_dir ||
-          !mnt.mnt_type || !mnt.mnt_opts) {
-         size += 4 * FILE_MAXPATH;
-         ASSERT(size <= 32 * FILE_MAXPATH);
-         free(buf);
-         endmntent(f);
-         goto retry;
-      }
+   /*
+    * NB: A call to realpath is not needed as getmntent() already
+    *     returns mount points in canonical form.  Additionally, it is bad
+    *     to call realpath() as often a mount point is down, and
+    *     realpath calls stat which can block trying to stat
+    *     a filesystem that the caller of the function is not at
+    *     all expecting.
+    */
 
+   entry = FileMountTable_Lookup(table, canPath, &len);
+   if (entry != NULL) {
       /*
-       * NB: A call to realpath is not needed as getmntent() already
-       *     returns it in canonical form.  Additionally, it is bad
-       *     to call realpath() as often a mount point is down, and
-       *     realpath calls stat which can block trying to stat
-       *     a filesystem that the caller of the function is not at
-       *     all expecting.
+       * The --bind and --rbind options behave differently. See
+       * FilePosixGetBlockDevice() for details.
+       *
+       * Sadly (I blame a bug in 'mount'), there is no way to tell them
+       * apart in /etc/mtab: the option recorded there is, in both cases,
+       * always "bind".
        */
 
-      if (strcmp(mnt.mnt_dir, canPath) == 0) {
-         /*
-          * The --bind and --rbind options behave differently. See
-          * FilePosixGetBlockDevice() for details.
-          *
-          * Sadly (I blame a bug in 'mount'), there is no way to tell them
-          * apart in /etc/mtab: the option recorded there is, in both cases,
-          * always "bind".
-          */
-
-         *bind = strstr(mnt.mnt_opts, "bind") != NULL;
+      *bind = strstr(entry->options, "bind") != NULL;
 
-         ret = Util_SafeStrdup(mnt.mnt_fsname);
-
-         break;
-      }
+      ret = Util_SafeStrdup(entry->fsName);
+      canPath[len] = '\0';
    }
 
-   // 'canPath' is not a mount point.
-   endmntent(f);
-
-   free(buf);
+   FileMountTable_Release(table);
 
    return ret;
 #endif
@@ -1840,14 +1797,16 @@ char *
 FilePosixGetBlockDevice(char const *path)  // IN: File path
 {
    char *existPath;
-   Bool failed;
 #if defined(__APPLE__)
+   Bool failed;
    struct statfs buf;
 #else
    char canPath[FILE_MAXPATH];
    char canPath2[FILE_MAXPATH];
    unsigned int retries = 0;
    char *realPath;
+   Bool bind = FALSE;
+   char *ptr;
 #endif
 
    existPath = FilePosixNearestExistingAncestor(path);
@@ -1873,98 +1832,82 @@ FilePosixGetBlockDevice(char const *path)  // IN: File path
 retry:
    Str_Strcpy(canPath2, canPath, sizeof canPath2);
 
-   /* Find the nearest ancestor of 'canPath' that is a mount point. */
-   for (;;) {
-      char *x;
-      Bool bind = FALSE;
-      char *ptr;
+   /*
+    * Find the nearest ancestor of 'canPath' that is a mount point; 'canPath'
+    * is truncated to it.
+    */
 
-      ptr = FilePosixLookupMountPoint(canPath, &bind);
-      if (ptr) {
-
-         if (bind) {
-            /*
-             * 'canPath' is a mount point mounted with --[r]bind. This is the
-             * mount equivalent of a hard link. Follow the rabbit...
-             *
-             * --bind and --rbind behave differently. Consider this mount
-             * table:
-             *
-             *    /dev/sda1              /             ext3
-             *    exit14:/vol/vol0/home  /exit14/home  nfs
-             *    /                      /bind         (mounted with --bind)
-             *    /                      /rbind        (mounted with --rbind)
-             *
-             * then what we _should_ return for these paths is:
-             *
-             *    /bind/exit14/home -> /dev/sda1
-             *    /rbind/exit14/home -> exit14:/vol/vol0/home
-             *
-             * XXX but currently because we cannot easily tell the difference,
-             *     we always assume --rbind and we return:
-             *
-             *    /bind/exit14/home -> exit14:/vol/vol0/home
-             *    /rbind/exit14/home -> exit14:/vol/vol0/home
-             */
-
-            Bool rbind = TRUE;
-
-            if (rbind) {
-               /*
-                * Compute 'canPath = ptr + (canPath2 - canPath)' using and
-                * preserving the structural properties of all canonical
-                * paths involved in the expression.
-                */
-
-               size_t canPathLen = strlen(canPath);
-               char const *diff = canPath2 + (canPathLen > 1 ? canPathLen : 0);
-
-               if (*diff != '\0') {
-                  Str_Sprintf(canPath, sizeof canPath, "%s%s",
-                              strlen(ptr) > 1 ? ptr : "", diff);
-               } else {
-                  Str_Strcpy(canPath, ptr, sizeof canPath);
-               }
-            } else {
-               Str_Strcpy(canPath, ptr, sizeof canPath);
-            }
-
-            free(ptr);
-
-            /*
-             * There could be a series of these chained together.  It is
-             * possible for the mounts to get into a loop, so limit the total
-             * number of retries to something reasonable like 10.
-             */
-
-            retries++;
-            if (retries > 10) {
-               Warning(LGPFX" %s: The --[r]bind mount count exceeds %u. Giving "
-                       "up.\n", __func__, 10);
-               return NULL;
-            }
-
-            goto retry;
-         }
+   ptr = FilePosixLookupMountPoint(canPath, &bind);
+   if (ptr == NULL) {
+      return NULL;
+   }
+
+   if (bind) {
+      /*
+       * 'canPath' is a mount point mounted with --[r]bind. This is the
+       * mount equivalent of a hard link. Follow the rabbit...
+       *
+       * --bind and --rbind behave differently. Consider this mount
+       * table:
+       *
+       *    /dev/sda1              /             ext3
+       *    exit14:/vol/vol0/home  /exit14/home  nfs
+       *    /                      /bind         (mounted with --bind)
+       *    /                      /rbind        (mounted with --rbind)
+       *
+       * then what we _should_ return for these paths is:
+       *
+       *    /bind/exit14/home -> /dev/sda1
+       *    /rbind/exit14/home -> exit14:/vol/vol0/home
+       *
+       * XXX but currently because we cannot easily tell the difference,
+       *     we always assume --rbind and we return:
+       *
+       *    /bind/exit14/home -> exit14:/vol/vol0/home
+       *    /rbind/exit14/home -> exit14:/vol/vol0/home
+       */
+
+      Bool rbind = TRUE;
+
+      if (rbind) {
+         /*
+          * Compute 'canPath = ptr + (canPath2 - canPath)' using and
+          * preserving the structural properties of all canonical
+          * paths involved in the expression.
+          */
+
+         size_t canPathLen = strlen(canPath);
+         char const *diff = canPath2 + (canPathLen > 1 ? canPathLen : 0);
 
-         return ptr;
+         if (*diff != '\0') {
+            Str_Sprintf(canPath, sizeof canPath, "%s%s",
+                        strlen(ptr) > 1 ? ptr : "", diff);
+         } else {
+            Str_Strcpy(canPath, ptr, sizeof canPath);
+         }
+      } else {
+         Str_Strcpy(canPath, ptr, sizeof canPath);
       }
 
-/* XXX temporary work-around until this function is Unicoded. */
-      x = Util_SafeStrdup(canPath);
-      failed = FilePosixGetParent(&x);
-      Str_Strcpy(canPath, x, sizeof canPath);
-      free(x);
+      free(ptr);
 
       /*
-       * Prevent an infinite loop in case FilePosixLookupMountPoint() even
-       * fails on "/".
+       * There could be a series of these chained together.  It is
+       * possible for the mounts to get into a loop, so limit the total
+       * number of retries to something reasonable like 10.
        */
 
-      if (failed) {
+      retries++;
+      if (retries > 10) {
+         Warning(LGPFX" %s: The --[r]bind mount count exceeds %u. Giving "
+                 "up.\n", __func__, 10);
          return NULL;
       }
+
+      goto retry;
    }
+
+   return ptr;
 #endif
 }
 
@@ -43,6 +43,13 @@
 #include "iovector.h"
 #endif
 
+#include "vm_basic_asm.h"
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#elif defined(__aarch64__) && defined(__ARM_NEON)
+#include <arm_neon.h>
+#endif
+
 /*
  * hashMap.c --
  *
@@ -50,10 +57,22 @@
  *    It is not intended to be thread safe nor should it be used in a way that
  *    this may cause problems.
  *
- *    Entries are stored based on a simple hash of their key.  Memory
- *    allocations are kept to a minimum to ensure that this is appropriate for
- *    use in a kernel mode driver.  Linear probing is used to resolve hash
- *    collisions.
+ *    Entries are stored in a dense array in insertion order.  A separate
+ *    open addressing index maps hashes to positions in that array.  The
+ *    index is laid out like a "Swiss table": one control byte per slot
+ *    holds either EMPTY, DELETED, or the low 7 bits of the hash of the
+ *    entry it refers to, so a probe compares a whole group of 16 control
+ *    bytes at once (SSE2 or NEON where available, a scalar loop otherwise)
+ *    and only touches entries whose tag matches.  Groups are probed
+ *    linearly to resolve collisions.
+ *
+ *    Growing the map does not move entries; only the index is rebuilt.
+ *    The rebuild is incremental: while it is in progress lookups consult
+ *    the new index and then the old one, and every HashMap_Put migrates a
+ *    few more entries until the old index can be freed.
+ *
+ *    HashMap_Iterate visits entries in the order in which they were first
+ *    inserted.
  *
  *    This implementation only supports static length keys.  It might be
  *    possible to store the keys outside the table and thus support keys of
@@ -61,7 +80,7 @@
  *    string keys for example.
  *
  *    Callers should not store pointers to objects stored in the map as they may
- *    become invalid as a result of a resize.  If you need to share objects
+ *    become invalid as a result of a HashMap_Put.  If you need to share objects
  *    stored as values in the map, then store pointers to the objects instead.
  *
  *    All objects are copied into the map and must be freed as appropriate by
@@ -74,8 +93,8 @@
  *      supports string and insensitive string keys and only supports pointer
  *      data.  This means its possible to store entire data structures in
  *      HashMap.
- *    - HashMap uses linear probing to resolve collisions while hashTable uses
- *      chaining.  HashMap will dynamically resize itself as necessary.
+ *    - HashMap uses open addressing to resolve collisions while hashTable
+ *      uses chaining.  HashMap will dynamically resize itself as necessary.
  *    - Pointers to HashMap values will be invalidated if the internal structure
  *      is resized.  If this is a problem, you should store the pointer in the
  *      HashMap rather than the object itself.
@@ -88,9 +107,37 @@
 
 #define HASHMAP_DEFAULT_ALPHA 2
 
+/*
+ * Index control bytes.  A FILLED slot stores HASHMAP_TAG(hash), which
+ * always has the top bit clear; EMPTY and DELETED both have it set.
+ */
+
+#define HASHMAP_GROUP_WIDTH   16
+#define HASHMAP_CTRL_EMPTY    ((uint8) 0x80)
+#define HASHMAP_CTRL_DELETED  ((uint8) 0xFE)
+#define HASHMAP_TAG(hash)     ((uint8) ((hash) & 0x7F))
+#define HASHMAP_POS(hash)     ((hash) >> 7)
+
+/*
+ * Number of entries moved to the new index by each HashMap_Put while an
+ * incremental resize is in progress.  The new index has at least twice
+ * the capacity of the old one, so any value above one guarantees that a
+ * resize completes before the next one is due.
+ */
+
+#define HASHMAP_REHASH_STEP   8
+
+typedef struct HashMapIndex {
+   uint8 *ctrl;       // numSlots + HASHMAP_GROUP_WIDTH control bytes
+   uint32 *slots;     // entry number referenced by each FILLED slot
+   uint32 numSlots;
+   uint32 numUsed;    // FILLED + DELETED slots
+} HashMapIndex;
+
 struct HashMap {
    uint8 *entries;
-   uint32 numEntries;
+   uint32 numEntries;    // allocated entries
+   uint32 numAppended;   // entries in use, including removed ones
    uint32 count;
    uint32 alpha;
 
@@ -100,6 +147,17 @@ struct HashMap {
 
    size_t keyOffset;
    size_t dataOffset;
+
+   HashMapIndex index;
+
+   /*
+    * Incremental resize state.  Entries below migrateNext have been added
+    * to index; the ones from migrateNext to migrateEnd are only known to
+    * oldIndex.  oldIndex.ctrl is NULL when no resize is in progress.
+    */
+   HashMapIndex oldIndex;
+   uint32 migrateNext;
+   uint32 migrateEnd;
 };
 
 #ifdef VMX86_SERVER
@@ -139,10 +197,15 @@ static Bool InitMap(struct HashMap *map, uint32 numEntries, uint32 alpha,
 static void CalculateEntrySize(struct HashMap *map);
 static void GetEntry(struct HashMap *map, uint32 index, HashMapEntryHeader **header, void **key, void **data);
 static uint32 ComputeHash(struct HashMap *map, const void *key);
-static Bool LookupKey(struct HashMap* map, const void *key, HashMapEntryHeader **header, void **data, uint32 *freeIndex);
+static Bool LookupKey(struct HashMap* map, const void *key, uint32 hash, HashMapIndex **index, uint32 *slot, uint32 *entry);
 static Bool CompareKeys(struct HashMap *map, const void *key, const void *compare);
 static Bool NeedsResize(struct HashMap *map);
-static void Resize(struct HashMap *map);
+static Bool NeedsCompaction(struct HashMap *map);
+static Bool Resize(struct HashMap *map);
+static Bool InitIndex(HashMapIndex *index, uint32 numSlots);
+static void FreeIndex(HashMapIndex *index);
+static void IndexInsert(HashMapIndex *index, uint32 hash, uint32 entry);
+static void MigrateEntries(struct HashMap *map, uint32 numEntries);
 INLINE void EnsureSanity(HashMap *map);
 
 /*
@@ -168,14 +231,13 @@ CheckSanity(HashMap *map)
    uint32 i, cnt = 0;
 
    ASSERT(map);
-   for (i = 0; i < map->numEntries; i++) {
+   for (i = 0; i < map->numAppended; i++) {
       HashMapEntryHeader *header = NULL;
       void *key, *data;
 
       GetEntry(map, i, &header, &key, &data);
       ASSERT(header);
       ASSERT(header->state == HashMapState_FILLED ||
-             header->state == HashMapState_EMPTY ||
              header->state == HashMapState_DELETED);
       if (header->state == HashMapState_FILLED) {
          cnt++;
@@ -189,7 +251,12 @@ CheckSanity(HashMap *map)
       return FALSE;
    }
 
-   if (!map->numEntries) {
+   if (!map->index.numSlots || map->index.numUsed >= map->index.numSlots + 1) {
+      return FALSE;
+   }
+
+   if (map->migrateNext > map->migrateEnd ||
+       map->migrateEnd > map->numAppended) {
       return FALSE;
    }
    return TRUE;
@@ -284,6 +351,8 @@ HashMap_DestroyMap(struct HashMap *map)  // IN
 {
    if (map) {
       free(map->entries);
+      FreeIndex(&map->index);
+      FreeIndex(&map->oldIndex);
    }
    free(map);
 }
@@ -316,15 +385,17 @@ InitMap(struct HashMap *map,     // IN
         size_t keySize,          // IN
         size_t dataSize)         // IN
 {
+   uint32 numSlots;
+
    ASSERT(map);
    ASSERT(alpha);
    ASSERT(numEntries);
 
    /*
-    * Ensure that the entries map is at least large enough to hold all of the
+    * Ensure that the index is at least large enough to hold all of the
     * entries that were requested taking into account the alpha factor.
     */
-   numEntries *= alpha;
+   Clamped_UMul32(&numSlots, numEntries, alpha);
 
    map->numEntries = numEntries;
    map->alpha = alpha;
@@ -334,11 +405,182 @@ InitMap(struct HashMap *map,     // IN
    CalculateEntrySize(map);
    map->entries = calloc(numEntries, map->entrySize);
 
-   if (map->entries) {
+   if (map->entries && InitIndex(&map->index, numSlots)) {
       EnsureSanity(map);
+      return TRUE;
+   }
+
+   return FALSE;
+}
+
+
+/*
+ * ----------------------------------------------------------------------------
+ *
+ * InitIndex --
+ *
+ *    Allocate an empty index with the given number of slots.
+ *
+ * Results:
+ *    Returns TRUE on success or FALSE if the memory allocation failed.
+ *
+ * Side Effects:
+ *    Allocates memory.
+ *
+ * ----------------------------------------------------------------------------
+ */
+
+static Bool
+InitIndex(HashMapIndex *index,   // OUT
+          uint32 numSlots)       // IN
+{
+   ASSERT(numSlots);
+
+   index->ctrl = malloc((size_t) numSlots + HASHMAP_GROUP_WIDTH);
+   index->slots = malloc((size_t) numSlots * sizeof *index->slots);
+   if (!index->ctrl || !index->slots) {
+      FreeIndex(index);
+      return FALSE;
    }
 
-   return map->entries != NULL;
+   memset(index->ctrl, HASHMAP_CTRL_EMPTY,
+          (size_t) numSlots + HASHMAP_GROUP_WIDTH);
+   index->numSlots = numSlots;
+   index->numUsed = 0;
+
+   return TRUE;
+}
+
+
+/*
+ * ----------------------------------------------------------------------------
+ *
+ * FreeIndex --
+ *
+ *    Free the memory of an index and mark it as unallocated.
+ *
+ * Results:
+ *    None.
+ *
+ * Side Effects:
+ *    Frees memory.
+ *
+ * ----------------------------------------------------------------------------
+ */
+
+static void
+FreeIndex(HashMapIndex *index)   // IN/OUT
+{
+   free(index->ctrl);
+   free(index->slots);
+   memset(index, 0, sizeof *index);
+}
+
+
+/*
+ * ----------------------------------------------------------------------------
+ *
+ * SetCtrl --
+ *
+ *    Set the control byte of a slot.  A group load may start at any slot,
+ *    so the bytes past the end of the array mirror the ones at its start.
+ *
+ * Results:
+ *    None.
+ *
+ * Side Effects:
+ *    The control byte and its mirrors are updated.
+ *
+ * ----------------------------------------------------------------------------
+ */
+
+static INLINE void
+SetCtrl(HashMapIndex *index,  // IN/OUT
+        uint32 slot,          // IN
+        uint8 ctrl)           // IN
+{
+   size_t i;
+
+   ASSERT(slot < index->numSlots);
+
+   index->ctrl[slot] = ctrl;
+   for (i = (size_t) slot + index->numSlots;
+        i < (size_t) index->numSlots + HASHMAP_GROUP_WIDTH;
+        i += index->numSlots) {
+      index->ctrl[i] = ctrl;
+   }
+}
+
+
+/*
+ * ----------------------------------------------------------------------------
+ *
+ * GroupMatch --
+ * GroupMatchNotFilled --
+ *
+ *    Compare the HASHMAP_GROUP_WIDTH control bytes starting at group with
+ *    ctrl, or look for the ones that are EMPTY or DELETED.
+ *
+ * Results:
+ *    A bit mask with bit i set if byte i matched.
+ *
+ * Side Effects:
+ *    None.
+ *
+ * ----------------------------------------------------------------------------
+ */
+
+#if defined(__aarch64__) && defined(__ARM_NEON) && !defined(__SSE2__)
+static INLINE uint32
+GroupMask(uint8x16_t match)  // IN: 0xFF for matching bytes
+{
+   static const uint8 bits[HASHMAP_GROUP_WIDTH] = {
+      1, 2, 4, 8, 16, 32, 64, 128, 1, 2, 4, 8, 16, 32, 64, 128
+   };
+   uint8x16_t masked = vandq_u8(match, vld1q_u8(bits));
+
+   return vaddv_u8(vget_low_u8(masked)) |
+          (vaddv_u8(vget_high_u8(masked)) << 8);
+}
+#endif
+
+static INLINE uint32
+GroupMatch(const uint8 *group,  // IN
+           uint8 ctrl)          // IN
+{
+#if defined(__SSE2__)
+   __m128i v = _mm_loadu_si128((const __m128i *) group);
+
+   return _mm_movemask_epi8(_mm_cmpeq_epi8(v, _mm_set1_epi8((char) ctrl)));
+#elif defined(__aarch64__) && defined(__ARM_NEON)
+   return GroupMask(vceqq_u8(vld1q_u8(group), vdupq_n_u8(ctrl)));
+#else
+   uint32 mask = 0;
+   uint32 i;
+
+   for (i = 0; i < HASHMAP_GROUP_WIDTH; i++) {
+      mask |= (uint32) (group[i] == ctrl) << i;
+   }
+   return mask;
+#endif
+}
+
+static INLINE uint32
+GroupMatchNotFilled(const uint8 *group)  // IN
+{
+#if defined(__SSE2__)
+   return _mm_movemask_epi8(_mm_loadu_si128((const __m128i *) group));
+#elif defined(__aarch64__) && defined(__ARM_NEON)
+   return GroupMask(vcgeq_u8(vld1q_u8(group), vdupq_n_u8(0x80)));
+#else
+   uint32 mask = 0;
+   uint32 i;
+
+   for (i = 0; i < HASHMAP_GROUP_WIDTH; i++) {
+      mask |= (uint32) (group[i] >> 7) << i;
+   }
+   return mask;
+#endif
 }
 
 
@@ -366,37 +608,60 @@ HashMap_Put(struct HashMap *map,    // IN
             const void *key,        // IN
             const void *data)       // IN
 {
-   uint32 freeIndex;
+   uint32 hash = ComputeHash(map, key);
+   HashMapIndex *index;
    HashMapEntryHeader *header;
+   uint32 slot;
+   uint32 entry;
+   void *tableKey;
    void *tableData;
 
-   if (!LookupKey(map, key, &header, &tableData, &freeIndex)) {
-      uint32 hash = ComputeHash(map, key);
-      void *tableKey;
-
-      if (NeedsResize(map)) {
-         Resize(map);
-         if (LookupKey(map, key, &header, &tableData, &freeIndex)) {
-            /*
-             * Somehow our key appeared after resizing the table.
-             */
-            ASSERT(FALSE);
+   if (!LookupKey(map, key, hash, &index, &slot, &entry)) {
+      if (map->oldIndex.ctrl) {
+         MigrateEntries(map, HASHMAP_REHASH_STEP);
+      }
+
+      if (NeedsResize(map) && !Resize(map)) {
+         return FALSE;
+      }
+
+      /*
+       * Removed entries leave holes that only a resize reclaims.  Reclaim
+       * them before growing the entries array, or a map whose keys keep
+       * changing would grow without bound while its count stays small.
+       */
+      if (map->numAppended == map->numEntries &&
+          NeedsCompaction(map) && !Resize(map)) {
+         return FALSE;
+      }
+
+      if (map->numAppended == map->numEntries) {
+         uint32 numEntries;
+         uint8 *entries;
+
+         if (!Clamped_UMul32(&numEntries, map->numEntries, 2) &&
+             numEntries == map->numEntries) {
+            Panic("Ran out of room in the hashtable\n");
          }
-         if (freeIndex == NO_FREE_INDEX) {
-            /*
-             * The resize must have failed.
-             */
+         entries = realloc(map->entries, (size_t) numEntries * map->entrySize);
+         if (!entries) {
             return FALSE;
          }
+         map->entries = entries;
+         map->numEntries = numEntries;
       }
 
+      entry = map->numAppended++;
       map->count++;
-      GetEntry(map, freeIndex, &header, &tableKey, &tableData);
+      GetEntry(map, entry, &header, &tableKey, &tableData);
       ASSERT(header);
 
       header->state = HashMapState_FILLED;
       header->hash = hash;
       memcpy(tableKey, key, map->keySize);
+      IndexInsert(&map->index, hash, entry);
+   } else {
+      GetEntry(map, entry, &header, &tableKey, &tableData);
    }
 
    ASSERT(data || map->dataSize == 0);
@@ -428,11 +693,15 @@ void *
 HashMap_Get(struct HashMap *map,    // IN
             const void *key)        // IN
 {
-   void *data;
-   uint32 freeIndex;
+   HashMapIndex *index;
    HashMapEntryHeader *header;
+   uint32 slot;
+   uint32 entry;
+   void *tableKey;
+   void *data;
 
-   if (LookupKey(map, key, &header, &data, &freeIndex)) {
+   if (LookupKey(map, key, ComputeHash(map, key), &index, &slot, &entry)) {
+      GetEntry(map, entry, &header, &tableKey, &data);
       return data;
    }
 
@@ -459,16 +728,17 @@ HashMap_Get(struct HashMap *map,    // IN
 void
 HashMap_Clear(struct HashMap *map) // IN
 {
-   int i = 0;
-   HashMapEntryHeader *header;
-   void *key, *data;
-
    ASSERT(map);
-   for (i = 0; i < map->numEntries; i++) {
-      GetEntry(map, i, &header, &key, &data);
-      ASSERT(header);
-      header->state = HashMapState_EMPTY;
-   }
+
+   FreeIndex(&map->oldIndex);
+   map->migrateNext = 0;
+   map->migrateEnd = 0;
+
+   memset(map->index.ctrl, HASHMAP_CTRL_EMPTY,
+          (size_t) map->index.numSlots + HASHMAP_GROUP_WIDTH);
+   map->index.numUsed = 0;
+
+   map->numAppended = 0;
    map->count = 0;
    EnsureSanity(map);
 }
@@ -495,20 +765,26 @@ Bool
 HashMap_Remove(struct HashMap *map,   // IN
                const void *key)       // IN
 {
-   uint32 freeIndex;
+   HashMapIndex *index;
    HashMapEntryHeader *header;
+   uint32 slot;
+   uint32 entry;
+   void *tableKey;
    void *tableData;
 
-   if (!LookupKey(map, key, &header, &tableData, &freeIndex)) {
+   if (!LookupKey(map, key, ComputeHash(map, key), &index, &slot, &entry)) {
       return FALSE;
    }
 
    /*
-    * XXX: This could be made slightly smarter.  We could check the next entry
-    * to see if it's EMPTY and then mark this one as empty as well.
+    * The entry stays where it is, so pointers to other entries remain valid;
+    * the hole is reclaimed by the next resize.  The index slot becomes a
+    * tombstone so that probes for other keys continue past it.
     */
-   map->count--;
+   GetEntry(map, entry, &header, &tableKey, &tableData);
    header->state = HashMapState_DELETED;
+   SetCtrl(index, slot, HASHMAP_CTRL_DELETED);
+   map->count--;
 
    EnsureSanity(map);
 
@@ -578,82 +854,154 @@ CalculateEntrySize(struct HashMap *map) // IN
 /*
  * ----------------------------------------------------------------------------
  *
- * LookupKey --
+ * IndexLookup --
  *
- *    Use linear probing to find a free space in the table or the data that
- *    we're interested in.
+ *    Probe an index for a live entry with the given key.  Groups of control
+ *    bytes are scanned for the tag of the hash; the probe ends at the first
+ *    group that contains an EMPTY slot, or once every slot has been seen.
  *
  * Returns:
- *    - TRUE if the key was found in the table, FALSE otherwise.
- *    - Returns the entry header on header, data pointer on data and the first
- *    non-filled index that was encountered on freeIndex
+ *    TRUE if the key was found, with its slot and entry number returned on
+ *    slot and entry.  FALSE otherwise.
  *
  * Side Effects:
- *    - Header and Data are changed.  They should only be considered valid if
- *    the key was found.
- *    - FreeIndex will be updated to point to the first non-filled index.
+ *    None.
  *
  * ----------------------------------------------------------------------------
  */
 
-Bool
-LookupKey(struct HashMap* map,          // IN
-          const void *key,              // IN
-          HashMapEntryHeader **header,  // OUT
-          void **data,                  // OUT
-          uint32 *freeIndex)            // OUT
+static Bool
+IndexLookup(struct HashMap *map,        // IN
+            const HashMapIndex *index,  // IN
+            const void *key,            // IN
+            uint32 hash,                // IN
+            uint32 *slot,               // OUT
+            uint32 *entry)              // OUT
 {
-   uint32 hash = ComputeHash(map, key);
-   uint32 index = hash % map->numEntries;
-   uint32 probe = 0;
+   uint32 pos = HASHMAP_POS(hash) % index->numSlots;
+   uint8 tag = HASHMAP_TAG(hash);
+   uint32 probed;
+
+   for (probed = 0; probed < index->numSlots; probed += HASHMAP_GROUP_WIDTH) {
+      const uint8 *group = index->ctrl + pos;
+      uint32 match = GroupMatch(group, tag);
+
+      while (match != 0) {
+         uint32 current = (pos + lssb32_0(match)) % index->numSlots;
+         HashMapEntryHeader *header;
+         void *tableKey;
+         void *tableData;
+
+         GetEntry(map, index->slots[current], &header, &tableKey, &tableData);
+         if (header->hash == hash && header->state == HashMapState_FILLED &&
+             CompareKeys(map, key, tableKey)) {
+            *slot = current;
+            *entry = index->slots[current];
+            return TRUE;
+         }
+         match &= match - 1;
+      }
 
-   Bool done = FALSE, found = FALSE;
-   void *tableKey;
+      if (GroupMatch(group, HASHMAP_CTRL_EMPTY) != 0) {
+         break;
+      }
+      pos = (pos + HASHMAP_GROUP_WIDTH) % index->numSlots;
+   }
 
-   ASSERT(map);
-   ASSERT(key);
-   ASSERT(data);
-   ASSERT(freeIndex);
+   return FALSE;
+}
 
-   *freeIndex = NO_FREE_INDEX;
 
-   while (!done && probe < map->numEntries + 1) {
-      uint32 currentIndex = (index + probe) % map->numEntries;
+/*
+ * ----------------------------------------------------------------------------
+ *
+ * IndexInsert --
+ *
+ *    Add an entry to an index, in the first EMPTY or DELETED slot of its
+ *    probe sequence.  The caller guarantees that the key is not already in
+ *    the index and that the index is not full.
+ *
+ * Returns:
+ *    None.
+ *
+ * Side Effects:
+ *    The index is updated.
+ *
+ * ----------------------------------------------------------------------------
+ */
 
-      GetEntry(map, currentIndex, header, &tableKey, data);
-      ASSERT(header);
+static void
+IndexInsert(HashMapIndex *index,  // IN/OUT
+            uint32 hash,          // IN
+            uint32 entry)         // IN
+{
+   uint32 pos = HASHMAP_POS(hash) % index->numSlots;
 
-      switch ((*header)->state) {
-      case HashMapState_EMPTY:
-         done = TRUE;
-         /* FALL THROUGH */
-      case HashMapState_DELETED:
-         /*
-          * We're not done if we've found a deleted space.  This may just mean
-          * that the entry was deleted but that the target entry may appear
-          * later.
-          */
-         if (*freeIndex == NO_FREE_INDEX) {
-            *freeIndex = currentIndex;
-         }
-         break;
-      case HashMapState_FILLED:
-         if ((*header)->hash == hash) {
-            found = CompareKeys(map, key, tableKey);
-            if (found) {
-               done = TRUE;
-            }
+   for (;;) {
+      uint32 match = GroupMatchNotFilled(index->ctrl + pos);
+
+      if (match != 0) {
+         uint32 slot = (pos + lssb32_0(match)) % index->numSlots;
+
+         if (index->ctrl[slot] == HASHMAP_CTRL_EMPTY) {
+            index->numUsed++;
          }
-         break;
-      default:
-         NOT_REACHED();
+         SetCtrl(index, slot, HASHMAP_TAG(hash));
+         index->slots[slot] = entry;
+         return;
       }
-      probe++;
+      pos = (pos + HASHMAP_GROUP_WIDTH) % index->numSlots;
    }
+}
 
-   ASSERT(found || *freeIndex != NO_FREE_INDEX || map->count == map->numEntries);
 
-   return found;
+/*
+ * ----------------------------------------------------------------------------
+ *
+ * LookupKey --
+ *
+ *    Find the key in the map.  While a resize is in progress, an entry that
+ *    has not been migrated yet is only present in the old index.
+ *
+ * Returns:
+ *    - TRUE if the key was found in the map, FALSE otherwise.
+ *    - The index in which the key was found on index, its slot in that index
+ *    on slot and its entry number on entry.
+ *
+ * Side Effects:
+ *    None.
+ *
+ * ----------------------------------------------------------------------------
+ */
+
+Bool
+LookupKey(struct HashMap* map,          // IN
+          const void *key,              // IN
+          uint32 hash,                  // IN
+          HashMapIndex **index,         // OUT
+          uint32 *slot,                 // OUT
+          uint32 *entry)                // OUT
+{
+   ASSERT(map);
+   ASSERT(key);
+   ASSERT(index);
+   ASSERT(slot);
+   ASSERT(entry);
+
+   *index = &map->index;
+   if (IndexLookup(map, *index, key, hash, slot, entry)) {
+      return TRUE;
+   }
+
+   if (map->oldIndex.ctrl) {
+      *index = &map->oldIndex;
+      if (IndexLookup(map, *index, key, hash, slot, entry)) {
+         ASSERT(*entry >= map->migrateNext);
+         return TRUE;
+      }
+   }
+
+   return FALSE;
 }
 
 
@@ -688,7 +1036,7 @@ GetEntry(struct HashMap *map,          // IN
    ASSERT(header);
    ASSERT(key);
    ASSERT(data);
-   ASSERT(index < map->numEntries);
+   ASSERT(index < map->numAppended);
 
    entry = ((uint8 *)map->entries) + (map->entrySize * index);
    ASSERT(entry);
@@ -726,6 +1074,9 @@ ComputeHash(struct HashMap *map,  // IN
     * This hash table implementation does a hash compare before comparing the
     * keys so it's inappropriate for the hash function to take the modulo before
     * returning.
+    *
+    * djb2 leaves the low bits of short keys poorly mixed, and the index uses
+    * them as the control byte tag, so finish with the murmur3 fmix32 step.
     */
    uint32 h = 5381;
    const uint8 *keyByte;
@@ -735,6 +1086,13 @@ ComputeHash(struct HashMap *map,  // IN
       h *= 33;
       h += *keyByte;
    }
+
+   h ^= h >> 16;
+   h *= 0x85ebca6b;
+   h ^= h >> 13;
+   h *= 0xc2b2ae35;
+   h ^= h >> 16;
+
    return h;
 }
 
@@ -770,9 +1128,10 @@ CompareKeys(struct HashMap *map,    // IN
  *
  * NeedsResize --
  *
- *    Determine if adding another element to the map will require that the map
- *    be resized.  This takes into account the maximum load factor that is
- *    allowed for this map.
+ *    Determine if adding another element to the map will require that the
+ *    index be rebuilt.  This takes into account the maximum load factor that
+ *    is allowed for this map; tombstones left by removals count as load
+ *    since they lengthen probes just like live entries.
  *
  * Results:
  *    Returns TRUE if the map should be resized.
@@ -788,112 +1147,184 @@ NeedsResize(struct HashMap *map)
 {
    uint32 required;
 
-   Clamped_UMul32(&required, map->count, map->alpha);
+   Clamped_UMul32(&required, map->index.numUsed + 1, map->alpha);
 
-   return required >= map->numEntries;
+   return required > map->index.numSlots;
 }
 
+
 /*
  * ----------------------------------------------------------------------------
  *
- * Resize --
+ * NeedsCompaction --
  *
- *    Doubles the size of the entries array until it is at least large enough
- *    to ensure the maximum load factor is not exceeded.
+ *    Determine if removed entries make up at least half of the entries
+ *    array, in which case a resize compacts the array rather than leaving
+ *    the holes in place.
+ *
+ * Results:
+ *    Returns TRUE if the entries array should be compacted.
+ *
+ * Side Effects:
+ *    None.
+ *
+ * ----------------------------------------------------------------------------
+ */
+
+Bool
+NeedsCompaction(struct HashMap *map)
+{
+   return map->numAppended - map->count >= map->count;
+}
+
+
+/*
+ * ----------------------------------------------------------------------------
+ *
+ * MigrateEntries --
+ *
+ *    Move up to numEntries entries of an incremental resize from the old
+ *    index to the new one, and free the old index once all of them have
+ *    been moved.
  *
  * Results:
  *    None.
  *
  * Side Effects:
- *    The entries list is doubled in size and the entries are copied into the
- *    appropriate location.  Callers should not assume that the locations that
- *    were valid before this was called are still valid as all entries may
- *    appear at different locations after this function completes.
+ *    The indexes are updated.  Entries themselves do not move.
  *
  * ----------------------------------------------------------------------------
  */
 
 void
-Resize(struct HashMap *map)   // IN
+MigrateEntries(struct HashMap *map,  // IN
+               uint32 numEntries)    // IN
 {
-   struct HashMap oldHashMap = *map;
-   int i;
-
-   if (map->numEntries == MAX_UINT32) {
-      if (map->count < MAX_UINT32) {
-         /*
-          * We're already at the maximum size of the array and there's still
-          * room for the new entry, don't bother resizing.
-          */
-         return;
-      } else {
-         /*
-          * This situation is fatal, though we're unlikely to ever hit this with
-          * realistic usage.
-          */
-         Panic("Ran out of room in the hashtable\n");
+   ASSERT(map->oldIndex.ctrl);
+
+   while (numEntries > 0 && map->migrateNext < map->migrateEnd) {
+      HashMapEntryHeader *header;
+      void *key;
+      void *data;
+
+      GetEntry(map, map->migrateNext, &header, &key, &data);
+      if (header->state == HashMapState_FILLED) {
+         IndexInsert(&map->index, header->hash, map->migrateNext);
+         numEntries--;
       }
+      map->migrateNext++;
    }
 
+   if (map->migrateNext == map->migrateEnd) {
+      FreeIndex(&map->oldIndex);
+      map->migrateNext = 0;
+      map->migrateEnd = 0;
+   }
+}
+
+
+/*
+ * ----------------------------------------------------------------------------
+ *
+ * Resize --
+ *
+ *    Replace the index with one that is large enough to ensure the maximum
+ *    load factor is not exceeded.  The index is doubled in size until it is
+ *    at most half full; if most of its load was tombstones it may keep its
+ *    size.
+ *
+ *    Normally the new index is filled incrementally by HashMap_Put.  If
+ *    removed entries make up at least half of the entries array, the array
+ *    is compacted first and the new index is filled right away, which costs
+ *    O(numAppended) but happens at most once per numAppended / 2 removals.
+ *
+ * Results:
+ *    Returns TRUE on success or FALSE if the memory allocation failed, in
+ *    which case the map is unchanged.
+ *
+ * Side Effects:
+ *    Callers should not assume that the locations that were valid before
+ *    this was called are still valid as entries may have moved.
+ *
+ * ----------------------------------------------------------------------------
+ */
+
+Bool
+Resize(struct HashMap *map)   // IN
+{
+   HashMapIndex newIndex;
+   uint32 numSlots = map->index.numSlots;
+   uint32 required;
+
+   /*
+    * A resize is already pending; a new one would otherwise strand the
+    * entries that are only in the old index.
+    */
+   if (map->oldIndex.ctrl) {
+      MigrateEntries(map, MAX_UINT32);
+   }
+
+   Clamped_UMul32(&required, map->count + 1, map->alpha);
+   Clamped_UMul32(&required, required, 2);
+
    /*
     * We might, at some point, want to look at making this grow geometrically
     * until we hit some threshold and then grow arithmetically after that.  To
     * keep it simple for now, however, we'll just grow geometrically all the
     * time.
     */
-   map->entries = calloc(oldHashMap.numEntries * 2, oldHashMap.entrySize);
-   if (!map->entries) {
-      map->entries = oldHashMap.entries;
-      return;
-   }
-
-   do {
-      if (!Clamped_UMul32(&map->numEntries, map->numEntries, 2)) {
+   while (numSlots < required) {
+      if (!Clamped_UMul32(&numSlots, numSlots, 2)) {
          /* Prevent overflow and */
          break;
       }
-   } while (NeedsResize(map));
+   }
 
-   map->count = 0;
+   if (numSlots == MAX_UINT32 && map->index.numUsed >= MAX_UINT32 - 1) {
+      /*
+       * This situation is fatal, though we're unlikely to ever hit this with
+       * realistic usage.
+       */
+      Panic("Ran out of room in the hashtable\n");
+   }
+
+   if (!InitIndex(&newIndex, numSlots)) {
+      return FALSE;
+   }
+
+   if (NeedsCompaction(map)) {
+      uint32 i;
+      uint32 next = 0;
+
+      for (i = 0; i < map->numAppended; i++) {
+         HashMapEntryHeader *header;
+         void *key;
+         void *data;
 
-   for (i = 0; i < oldHashMap.numEntries; i++) {
-      HashMapEntryHeader *oldHeader;
-      HashMapEntryHeader *newHeader;
-      void *oldKey;
-      void *oldData;
-      void *newKey;
-      void *newData;
-      uint32 freeIndex;
-
-      GetEntry(&oldHashMap, i, &oldHeader, &oldKey, &oldData);
-      switch (oldHeader->state) {
-      case HashMapState_EMPTY:
-      case HashMapState_DELETED:
-         continue;
-      case HashMapState_FILLED:
-         if (!LookupKey(map, oldKey, &newHeader, &newData, &freeIndex)) {
-            GetEntry(map, freeIndex, &newHeader, &newKey, &newData);
-
-            newHeader->hash = oldHeader->hash;
-            newHeader->state = HashMapState_FILLED;
-            memcpy(newKey, oldKey, map->keySize);
-            memcpy(newData, oldData, map->dataSize);
-
-            map->count++;
-         } else {
-            /*
-             * There is only one way that this could happen; the key is in the
-             * old map twice.  That's clearly an error.
-             */
-            ASSERT(FALSE);
-            continue;
+         GetEntry(map, i, &header, &key, &data);
+         if (header->state == HashMapState_FILLED) {
+            if (i != next) {
+               memcpy(map->entries + map->entrySize * next, header,
+                      map->entrySize);
+            }
+            IndexInsert(&newIndex, header->hash, next);
+            next++;
          }
       }
+      ASSERT(next == map->count);
+      map->numAppended = next;
+
+      FreeIndex(&map->index);
+      map->index = newIndex;
+   } else {
+      map->oldIndex = map->index;
+      map->index = newIndex;
+      map->migrateNext = 0;
+      map->migrateEnd = map->numAppended;
    }
 
-   ASSERT(oldHashMap.count == map->count);
-   free(oldHashMap.entries);
    EnsureSanity(map);
+   return TRUE;
 }
 
 
@@ -902,8 +1333,8 @@ Resize(struct HashMap *map)   // IN
  *
  * HashMap_Iterate --
  *
- *    Iterate over the contents of the map, optionally clearing each entry as
- *    it's passed.
+ *    Iterate over the contents of the map, in insertion order, optionally
+ *    clearing each entry as it's passed.
  *
  * Results:
  *    None.
@@ -922,27 +1353,23 @@ HashMap_Iterate(HashMap *map,             // IN
                 Bool clear,               // IN
                 void *userData)           // IN/OUT
 {
-   int i = 0;
+   uint32 i;
    HashMapEntryHeader *header;
    void *key, *data;
 
    ASSERT(map);
    ASSERT(itFn);
 
-   for (i = 0; i < map->numEntries; i++) {
+   for (i = 0; i < map->numAppended; i++) {
       GetEntry(map, i, &header, &key, &data);
       if (header->state == HashMapState_FILLED) {
          itFn(key, data, userData);
-         if (clear) {
-            map->count--;
-         }
-      }
-      if (clear) {
-         header->state = HashMapState_EMPTY;
       }
    }
 
-   ASSERT(map->count == 0 || !clear);
+   if (clear) {
+      HashMap_Clear(map);
+   }
 }
 
 
@@ -970,6 +1397,3 @@ EnsureSanity(HashMap *map)
 {
    ASSERT(CheckSanity(map) == TRUE);
 }
-
-
-
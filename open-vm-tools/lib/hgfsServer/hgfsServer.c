@@ -52,6 +52,7 @@
 #include "mutexRankLib.h"
 #include "vm_basic_asm.h"
 #include "unicodeOperations.h"
+#include "hostinfo.h"
 
 #if defined(_WIN32)
 #include <io.h>
@@ -160,6 +161,9 @@ struct HgfsTransportSessionInfo {
    Atomic_uint32 refCount;    /* Reference count for session. */
 
    HgfsServerChannelData channelCapabilities;
+
+   /* Buffers for packets that cannot be used in place. */
+   HgfsPacketBufPool *packetBufPool;
 };
 
 /* The input request paramaters object. */
@@ -175,6 +179,7 @@ typedef struct HgfsInputParam {
    HgfsOp op;                    /* Hgfs operation command code */
    uint32 id;                    /* Request ID to be matched with the reply */
    Bool sessionEnabled;          /* Requests have session enabled headers */
+   VmTimeType startTime;         /* When the request was parsed (statistics) */
 } HgfsInputParam;
 
 /*
@@ -199,6 +204,15 @@ static Atomic_uint32 gHgfsAsyncCounter = {0};
 static MXUserExclLock *gHgfsAsyncLock;
 static MXUserCondVar  *gHgfsAsyncVar;
 
+/*
+ * Request statistics, collected only while enabled. The lock protects the
+ * statistics and their start time.
+ */
+static Bool gHgfsStatsEnabled = FALSE;
+static Atomic_Ptr gHgfsStatsLockStorage;
+static HgfsServerStats gHgfsStats;
+static VmTimeType gHgfsStatsStart;
+
 static HgfsServerMgrCallbacks *gHgfsMgrData = NULL;
 
 /*
@@ -350,6 +364,9 @@ static void HgfsServerDirWatchEvent(HgfsSharedFolderHandle sharedFolder,
                                     uint32 mask,
                                     struct HgfsSessionInfo *session);
 static void HgfsFreeSearchDirents(HgfsSearch *search);
+static void HgfsServerStatsRecord(HgfsInputParam *input,
+                                  HgfsInternalStatus status,
+                                  size_t replyPayloadSize);
 
 static HgfsInternalStatus
 HgfsServerTransportGetDefaultSession(HgfsTransportSessionInfo *transportSession,
@@ -383,6 +400,7 @@ static void HgfsServerClose(HgfsInputParam *input);
 static void HgfsServerSearchClose(HgfsInputParam *input);
 static void HgfsServerSetDirNotifyWatch(HgfsInputParam *input);
 static void HgfsServerRemoveDirNotifyWatch(HgfsInputParam *input);
+static void HgfsServerOplockBreakReply(HgfsInputParam *input);
 
 
 /*
@@ -401,7 +419,7 @@ static void HgfsServerRemoveDirNotifyWatch(HgfsInputParam *input);
  *----------------------------------------------------------------------------
  */
 
-static void
+void
 HgfsServerSessionGet(HgfsSessionInfo *session)   // IN: session context
 {
    ASSERT(session);
@@ -427,7 +445,7 @@ HgfsServerSessionGet(HgfsSessionInfo *session)   // IN: session context
  *----------------------------------------------------------------------------
  */
 
-static void
+void
 HgfsServerSessionPut(HgfsSessionInfo *session)   // IN: session context
 {
    ASSERT(session);
@@ -496,6 +514,9 @@ HgfsServerTransportSessionPut(HgfsTransportSessionInfo *transportSession)   // I
       }
 
       MXUser_ReleaseExclLock(transportSession->sessionArrayLock);
+
+      HSPU_DestroyBufPool(transportSession->packetBufPool);
+      transportSession->packetBufPool = NULL;
    }
 }
 
@@ -1115,6 +1136,7 @@ HgfsGetNodeCopy(HgfsHandle handle,        // IN: Hgfs file handle
    copy->state = original->state;
    copy->handle = original->handle;
    copy->fileCtx = original->fileCtx;
+   copy->serverLock = original->serverLock;
    found = TRUE;
 
 exit:
@@ -1293,6 +1315,17 @@ HgfsUpdateNodeServerLock(fileDesc fd,                // IN: OS handle
       existingFileNode = &session->nodeArray[i];
       if (existingFileNode->state != FILENODE_STATE_UNUSED) {
          if (existingFileNode->fileDesc == fd) {
+            /* Keep the count of cached locked nodes in step. */
+            if (existingFileNode->state == FILENODE_STATE_IN_USE_CACHED) {
+               if (existingFileNode->serverLock == HGFS_LOCK_NONE &&
+                   serverLock != HGFS_LOCK_NONE) {
+                  session->numCachedLockedNodes++;
+               } else if (existingFileNode->serverLock != HGFS_LOCK_NONE &&
+                          serverLock == HGFS_LOCK_NONE) {
+                  ASSERT(session->numCachedLockedNodes > 0);
+                  session->numCachedLockedNodes--;
+               }
+            }
             existingFileNode->serverLock = serverLock;
             updated = TRUE;
             break;
@@ -1957,6 +1990,13 @@ HgfsRemoveFromCacheInternal(HgfsHandle handle,        // IN: Hgfs handle to the
       }
       node->fileCtx = NULL;
 
+      /* Closing the file released its server lock. */
+      if (node->serverLock != HGFS_LOCK_NONE) {
+         ASSERT(session->numCachedLockedNodes > 0);
+         session->numCachedLockedNodes--;
+         node->serverLock = HGFS_LOCK_NONE;
+      }
+
      /*
       * If we have just removed the node then the number of used nodes better
       * be less than the max. If we didn't remove a node, it means the
@@ -2903,6 +2943,18 @@ static struct {
    { HgfsServerRemoveDirNotifyWatch, sizeof (HgfsRequestRemoveWatchV4),            REQ_SYNC},
    { NULL,                       0,                                                REQ_SYNC}, // No Op notify
    { HgfsServerSearchRead,       sizeof (HgfsRequestSearchReadV4),                 REQ_SYNC},
+   { NULL,                       0,                                                REQ_SYNC}, // Open
+   { NULL,                       0,                                                REQ_SYNC}, // Enumerate streams
+   { NULL,                       0,                                                REQ_SYNC}, // Getattr
+   { NULL,                       0,                                                REQ_SYNC}, // Setattr
+   { NULL,                       0,                                                REQ_SYNC}, // Delete
+   { NULL,                       0,                                                REQ_SYNC}, // Linkmove
+   { NULL,                       0,                                                REQ_SYNC}, // FS control
+   { NULL,                       0,                                                REQ_SYNC}, // Access check
+   { NULL,                       0,                                                REQ_SYNC}, // Fsync
+   { NULL,                       0,                                                REQ_SYNC}, // Query volume
+   { NULL,                       0,                                                REQ_SYNC}, // Oplock acquire
+   { HgfsServerOplockBreakReply, sizeof (HgfsReplyOplockBreakV4),                  REQ_SYNC},
 
 };
 
@@ -2950,6 +3002,9 @@ HgfsServerInputAllocInit(HgfsPacket *packet,                        // IN: packe
    localParams->op = requestOp;
    localParams->payload = requestOpArgs;
    localParams->payloadSize = requestOpArgsSize;
+   if (gHgfsStatsEnabled) {
+      localParams->startTime = Hostinfo_SystemTimerUS();
+   }
 
    if (NULL != localParams->payload) {
       localParams->payloadOffset = (char *)localParams->payload -
@@ -3023,7 +3078,9 @@ HgfsServerGetRequest(HgfsPacket *packet,                        // IN: packet
    size_t requestOpArgsSize;
    HgfsInternalStatus parseStatus = HGFS_ERROR_SUCCESS;
 
-   request = HSPU_GetMetaPacket(packet, &requestSize, transportSession->channelCbTable);
+   request = HSPU_GetMetaPacket(packet, &requestSize,
+                                transportSession->channelCbTable,
+                                transportSession->packetBufPool);
 
    if (NULL == request) {
       /*
@@ -3236,6 +3293,7 @@ HgfsServerCompleteRequest(HgfsInternalStatus status,   // IN: Status of the requ
 
    reply = HSPU_GetReplyPacket(input->packet,
                                input->transportSession->channelCbTable,
+                               input->transportSession->packetBufPool,
                                replySize,
                                &replyTotalSize);
 
@@ -3252,6 +3310,10 @@ HgfsServerCompleteRequest(HgfsInternalStatus status,   // IN: Status of the requ
       Log("%s: Error sending reply\n", __FUNCTION__);
    }
 
+   if (gHgfsStatsEnabled && input->startTime != 0) {
+      HgfsServerStatsRecord(input, status, replyPayloadSize);
+   }
+
 exit:
    HgfsServerInputExit(input);
 }
@@ -3280,7 +3342,8 @@ HgfsServerProcessRequest(void *context)
    if (!input->request) {
       input->request = HSPU_GetMetaPacket(input->packet,
                                           &input->requestSize,
-                                          input->transportSession->channelCbTable);
+                                          input->transportSession->channelCbTable,
+                                          input->transportSession->packetBufPool);
    }
 
    input->payload = (char *)input->request + input->payloadOffset;
@@ -3363,7 +3426,8 @@ HgfsServerSessionReceive(HgfsPacket *packet,      // IN: Hgfs Packet
              * Asynchronous processing is supported by the transport.
              * We can release mappings here and reacquire when needed.
              */
-            HSPU_PutMetaPacket(packet, transportSession->channelCbTable);
+            HSPU_PutMetaPacket(packet, transportSession->channelCbTable,
+                               transportSession->packetBufPool);
             input->request = NULL;
             Atomic_Inc(&gHgfsAsyncCounter);
 
@@ -4266,6 +4330,7 @@ HgfsServerSessionConnect(void *transportData,                         // IN: tra
    DblLnkLst_Init(&transportSession->sessionArray);
 
    transportSession->defaultSessionId = HGFS_INVALID_SESSION_ID;
+   transportSession->packetBufPool = HSPU_CreateBufPool();
 
    Atomic_Write(&transportSession->refCount, 0);
 
@@ -4664,6 +4729,161 @@ HgfsServer_SetHandleCounter(uint32 newHandleCounter)
 }
 
 
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * HgfsServerStatsLock --
+ *
+ *    Get the lock protecting the request statistics, creating it on first use.
+ *
+ * Results:
+ *    The lock.
+ *
+ * Side effects:
+ *    None
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+static MXUserExclLock *
+HgfsServerStatsLock(void)
+{
+   return MXUser_CreateSingletonExclLock(&gHgfsStatsLockStorage,
+                                         "hgfsStatsLock",
+                                         RANK_hgfsStatsLock);
+}
+
+
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * HgfsServerStatsRecord --
+ *
+ *    Account a completed request in the per-operation statistics.
+ *
+ * Results:
+ *    None
+ *
+ * Side effects:
+ *    None
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+static void
+HgfsServerStatsRecord(HgfsInputParam *input,          // IN: completed request
+                      HgfsInternalStatus status,      // IN: request status
+                      size_t replyPayloadSize)        // IN: reply payload size
+{
+   MXUserExclLock *lock = HgfsServerStatsLock();
+   VmTimeType latency = Hostinfo_SystemTimerUS() - input->startTime;
+   HgfsServerOpStats *opStats;
+   uint32 bucket;
+
+   if (latency < 0) {
+      latency = 0;
+   }
+   bucket = latency == 0 ? 0 : 1 + mssb64_0(latency);
+   bucket = MIN(bucket, HGFS_SERVER_STATS_BUCKETS - 1);
+
+   MXUser_AcquireExclLock(lock);
+
+   if (input->op < ARRAYSIZE(gHgfsStats.ops) && gHgfsStatsEnabled) {
+      opStats = &gHgfsStats.ops[input->op];
+      opStats->count++;
+      if (HGFS_ERROR_SUCCESS != status) {
+         opStats->errors++;
+      }
+      opStats->bytesIn += input->requestSize;
+      opStats->bytesOut += replyPayloadSize;
+      opStats->totalUS += latency;
+      opStats->maxUS = MAX(opStats->maxUS, latency);
+      opStats->histogram[bucket]++;
+   }
+
+   MXUser_ReleaseExclLock(lock);
+}
+
+
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * HgfsServer_EnableStats --
+ *
+ *    Start or stop collecting per-operation request statistics. Starting
+ *    resets any statistics collected before.
+ *
+ * Results:
+ *    None
+ *
+ * Side effects:
+ *    None
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+void
+HgfsServer_EnableStats(Bool enable)  // IN: collect statistics?
+{
+   MXUserExclLock *lock = HgfsServerStatsLock();
+
+   MXUser_AcquireExclLock(lock);
+   if (enable && !gHgfsStatsEnabled) {
+      memset(&gHgfsStats, 0, sizeof gHgfsStats);
+      HSPU_GetBufStats(NULL, TRUE);
+      gHgfsStatsStart = Hostinfo_SystemTimerUS();
+   }
+   gHgfsStatsEnabled = enable;
+   MXUser_ReleaseExclLock(lock);
+}
+
+
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * HgfsServer_GetStats --
+ *
+ *    Take a snapshot of the per-operation request statistics, optionally
+ *    resetting them afterwards.
+ *
+ * Results:
+ *    TRUE if statistics are being collected, FALSE otherwise.
+ *
+ * Side effects:
+ *    None
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+Bool
+HgfsServer_GetStats(HgfsServerStats *stats,  // OUT: statistics
+                    Bool reset)              // IN: reset after the snapshot?
+{
+   MXUserExclLock *lock = HgfsServerStatsLock();
+   Bool enabled;
+
+   ASSERT(stats);
+   ASSERT_ON_COMPILE(HGFS_OP_MAX <= HGFS_SERVER_STATS_MAX_OPS);
+
+   MXUser_AcquireExclLock(lock);
+   enabled = gHgfsStatsEnabled;
+   if (enabled) {
+      VmTimeType now = Hostinfo_SystemTimerUS();
+
+      *stats = gHgfsStats;
+      stats->elapsedUS = now - gHgfsStatsStart;
+      HSPU_GetBufStats(&stats->buffers, reset);
+      if (reset) {
+         memset(&gHgfsStats, 0, sizeof gHgfsStats);
+         gHgfsStatsStart = now;
+      }
+   }
+   MXUser_ReleaseExclLock(lock);
+
+   return enabled;
+}
+
+
 /*
  *----------------------------------------------------------------------------
  *
@@ -4689,9 +4909,12 @@ HgfsServerSessionSendComplete(HgfsPacket *packet,   // IN/OUT: Hgfs packet
    HgfsTransportSessionInfo *transportSession = clientData;
 
    if (0 != (packet->state & HGFS_STATE_CLIENT_REQUEST)) {
-      HSPU_PutMetaPacket(packet, transportSession->channelCbTable);
-      HSPU_PutReplyPacket(packet, transportSession->channelCbTable);
-      HSPU_PutDataPacketBuf(packet, transportSession->channelCbTable);
+      HSPU_PutMetaPacket(packet, transportSession->channelCbTable,
+                         transportSession->packetBufPool);
+      HSPU_PutReplyPacket(packet, transportSession->channelCbTable,
+                          transportSession->packetBufPool);
+      HSPU_PutDataPacketBuf(packet, transportSession->channelCbTable,
+                            transportSession->packetBufPool);
    } else {
       if (packet->metaPacketIsAllocated) {
          free(packet->metaPacket);
@@ -5132,6 +5355,10 @@ HgfsServerStatFs(const char *pathName, // IN: Path we're interested in
  *    The name returned is allocated and must be freed by the caller.
  *    The name length is optionally returned.
  *
+ *    The name is assembled in a stack buffer and copied out with a single
+ *    allocation of the exact size, unless the case lookup or form D
+ *    conversion already returned an allocated copy.
+ *
  * Results:
  *    A status code indicating either success (correspondent share exists) or
  *    a failure status.
@@ -5153,18 +5380,17 @@ HgfsServerGetLocalNameInfo(const char *cpName,      // IN:  Cross-platform filen
    HgfsNameStatus nameStatus;
    const char *inEnd;
    const char *next;
-   char *myBufOut;
+   char *myBufOut = NULL;
    char *convertedMyBufOut;
    char *out;
    size_t outSize;
-   size_t myBufOutLen;
+   size_t myBufOutLen = 0;
    size_t convertedMyBufOutLen;
    int len;
-   uint32 pathNameLen;
    char tempBuf[HGFS_PATH_MAX];
-   size_t tempSize;
-   char *tempPtr;
-   uint32 startIndex = 0;
+   size_t prefixLen;
+   char *localName;
+   size_t localNameLen;
    HgfsShareOptions shareOptions;
 
    ASSERT(cpName);
@@ -5217,30 +5443,21 @@ HgfsServerGetLocalNameInfo(const char *cpName,      // IN:  Cross-platform filen
    cpName = next;
 
    /*
-    * Allocate space for the string. We trim the unused space later.
+    * Build the local name in the stack buffer and allocate the returned
+    * string only once its final length is known.
     */
 
-   outSize = HGFS_PATH_MAX;
-   myBufOut = (char *) malloc(outSize * sizeof *myBufOut);
-   if (!myBufOut) {
-      LOG(4, ("%s: out of memory allocating string\n", __FUNCTION__));
-
-      return HGFS_NAME_STATUS_OUT_OF_MEMORY;
-   }
-
-   out = myBufOut;
+   out = tempBuf;
+   outSize = sizeof tempBuf;
 
    /*
     * See if we are dealing with a "root" share or regular share
     */
    if (shareInfo->rootDirLen == 0) {
-      size_t prefixLen;
-
       /* Are root shares allowed? If not, we exit with an error. */
       if (0 == (gHgfsCfgSettings.flags & HGFS_CONFIG_SHARE_ALL_HOST_DRIVES_ENABLED)) {
          LOG(4, ("%s: Root share being used\n", __FUNCTION__));
-         nameStatus = HGFS_NAME_STATUS_ACCESS_DENIED;
-         goto error;
+         return HGFS_NAME_STATUS_ACCESS_DENIED;
       }
 
       /*
@@ -5249,53 +5466,31 @@ HgfsServerGetLocalNameInfo(const char *cpName,      // IN:  Cross-platform filen
        * buffer (for Win32) or simply get the prefix for root (for
        * linux).
        */
-      tempSize = sizeof tempBuf;
-      tempPtr = tempBuf;
       nameStatus = CPName_ConvertFromRoot(&cpName,
-                                          &cpNameSize, &tempSize, &tempPtr);
+                                          &cpNameSize, &outSize, &out);
       if (nameStatus != HGFS_NAME_STATUS_COMPLETE) {
          LOG(4, ("%s: ConvertFromRoot not complete\n", __FUNCTION__));
-         goto error;
-      }
-
-      prefixLen = tempPtr - tempBuf;
-
-      /* Copy the UTF8 prefix to the output buffer. */
-      if (prefixLen >= HGFS_PATH_MAX) {
-         Log("%s: error: prefix too long\n", __FUNCTION__);
-         nameStatus = HGFS_NAME_STATUS_TOO_LONG;
-         goto error;
+         return nameStatus;
       }
-
-      memcpy(out, tempBuf, prefixLen);
-      out += prefixLen;
-      *out = 0;
-      outSize -= prefixLen;
    } else {
       /*
        * This is a regular share. Append the path to the out buffer.
        */
       if (outSize < shareInfo->rootDirLen + 1) {
          LOG(4, ("%s: share path too big\n", __FUNCTION__));
-         nameStatus = HGFS_NAME_STATUS_TOO_LONG;
-         goto error;
+         return HGFS_NAME_STATUS_TOO_LONG;
       }
 
       memcpy(out, shareInfo->rootDir, shareInfo->rootDirLen + 1);
       out += shareInfo->rootDirLen;
       outSize -= shareInfo->rootDirLen;
    }
+   prefixLen = out - tempBuf;
 
-   /* Convert the rest of the input name (if any) to a local name */
-   tempSize = sizeof tempBuf;
-   tempPtr = tempBuf;
-
-
-   if (CPName_ConvertFrom(&cpName, &cpNameSize, &tempSize,
-                          &tempPtr) < 0) {
+   /* Convert the rest of the input name (if any) directly after the prefix. */
+   if (CPName_ConvertFrom(&cpName, &cpNameSize, &outSize, &out) < 0) {
       LOG(4, ("%s: CP name conversion failed\n", __FUNCTION__));
-      nameStatus = HGFS_NAME_STATUS_FAILURE;
-      goto error;
+      return HGFS_NAME_STATUS_FAILURE;
    }
 
    /*
@@ -5304,47 +5499,33 @@ HgfsServerGetLocalNameInfo(const char *cpName,      // IN:  Cross-platform filen
     * will skip over the second separator for this case. Bug 166755.
     */
 
-   if ((out != myBufOut) && (*(out - 1) == DIRSEPC) && (tempBuf[0] == DIRSEPC)) {
-      startIndex++;
-   }
-   pathNameLen = tempPtr - &tempBuf[startIndex];
-
-   /* Copy UTF8 to the output buffer. */
-   if (pathNameLen >= outSize) {
-      LOG(4, ("%s: pathname too long\n", __FUNCTION__));
-      nameStatus = HGFS_NAME_STATUS_TOO_LONG;
-      goto error;
+   if (prefixLen > 0 && out > &tempBuf[prefixLen] &&
+       tempBuf[prefixLen - 1] == DIRSEPC && tempBuf[prefixLen] == DIRSEPC) {
+      memmove(&tempBuf[prefixLen], &tempBuf[prefixLen + 1],
+              out - &tempBuf[prefixLen]);
+      out--;
    }
-
-   memcpy(out, &tempBuf[startIndex], pathNameLen);
-   outSize -= pathNameLen;
-   out += pathNameLen;
-   *out = 0;
-   myBufOutLen = out - myBufOut;
+   localName = tempBuf;
+   localNameLen = out - tempBuf;
 
 #if defined(__APPLE__)
    {
-      size_t nameLen;
       /*
        * For Mac hosts the unicode format is decomposed (form D)
        * so there is a need to convert the incoming name from HGFS clients
        * which is assumed to be in the normalized form C (precomposed).
        */
 
-      if (!CodeSet_Utf8FormCToUtf8FormD(myBufOut, myBufOutLen, &tempPtr,
-                                        &nameLen)) {
+      if (!CodeSet_Utf8FormCToUtf8FormD(localName, localNameLen, &myBufOut,
+                                        &myBufOutLen)) {
          LOG(4, ("%s: unicode conversion to form D failed.\n", __FUNCTION__));
-         nameStatus = HGFS_NAME_STATUS_FAILURE;
-         goto error;
+         return HGFS_NAME_STATUS_FAILURE;
       }
 
-      free(myBufOut);
-      LOG(4, ("%s: name is \"%s\"\n", __FUNCTION__, tempPtr));
+      LOG(4, ("%s: name is \"%s\"\n", __FUNCTION__, myBufOut));
 
-      /* Save returned pointers, update buffer length. */
-      myBufOut = tempPtr;
-      out = tempPtr + nameLen;
-      myBufOutLen = nameLen;
+      localName = myBufOut;
+      localNameLen = myBufOutLen;
    }
 #endif /* defined(__APPLE__) */
 
@@ -5357,7 +5538,7 @@ HgfsServerGetLocalNameInfo(const char *cpName,      // IN:  Cross-platform filen
                                           HGFS_SHARE_HOST_DEFAULT_CASE) &&
        HgfsPlatformDoFilenameLookup()) {
       nameStatus = HgfsPlatformFilenameLookup(shareInfo->rootDir, shareInfo->rootDirLen,
-                                              myBufOut, myBufOutLen, caseFlags,
+                                              localName, localNameLen, caseFlags,
                                               &convertedMyBufOut,
                                               &convertedMyBufOutLen);
 
@@ -5374,6 +5555,8 @@ HgfsServerGetLocalNameInfo(const char *cpName,      // IN:  Cross-platform filen
       myBufOut = convertedMyBufOut;
       myBufOutLen = convertedMyBufOutLen;
       ASSERT(myBufOut);
+      localName = myBufOut;
+      localNameLen = myBufOutLen;
    }
 
    /* Check for symlinks if the followSymlinks option is not set. */
@@ -5388,7 +5571,7 @@ HgfsServerGetLocalNameInfo(const char *cpName,      // IN:  Cross-platform filen
        * We should use the resolved file path for further file system
        * operations, instead of using the one passed from the client.
        */
-      nameStatus = HgfsPlatformPathHasSymlink(myBufOut, myBufOutLen, shareInfo->rootDir,
+      nameStatus = HgfsPlatformPathHasSymlink(localName, localNameLen, shareInfo->rootDir,
                                               shareInfo->rootDirLen);
       if (nameStatus != HGFS_NAME_STATUS_COMPLETE) {
          LOG(4, ("%s: parent path failed to be resolved: %d\n",
@@ -5397,22 +5580,21 @@ HgfsServerGetLocalNameInfo(const char *cpName,      // IN:  Cross-platform filen
       }
    }
 
-   {
-      char *p;
+   /* Nothing above handed us an allocated name, so copy the stack buffer. */
+   if (myBufOut == NULL) {
+      myBufOut = (char *) malloc((localNameLen + 1) * sizeof *myBufOut);
+      if (!myBufOut) {
+         LOG(4, ("%s: out of memory allocating string\n", __FUNCTION__));
 
-      /* Trim unused memory */
-
-      /* Enough space for resulting string + NUL termination */
-      p = realloc(myBufOut, (myBufOutLen + 1) * sizeof *p);
-      if (!p) {
-         LOG(4, ("%s: failed to trim memory\n", __FUNCTION__));
-      } else {
-         myBufOut = p;
+         return HGFS_NAME_STATUS_OUT_OF_MEMORY;
       }
 
-      if (outLen) {
-         *outLen = myBufOutLen;
-      }
+      memcpy(myBufOut, localName, localNameLen + 1);
+      myBufOutLen = localNameLen;
+   }
+
+   if (outLen) {
+      *outLen = myBufOutLen;
    }
 
    LOG(4, ("%s: name is \"%s\"\n", __FUNCTION__, myBufOut));
@@ -6027,6 +6209,7 @@ HgfsAllocInitReply(HgfsPacket *packet,           // IN/OUT: Hgfs Packet
    }
    replyHeader = HSPU_GetReplyPacket(packet,
                                      session->transportSession->channelCbTable,
+                                     session->transportSession->packetBufPool,
                                      headerSize + replyDataSize,
                                      &replyPacketSize);
 
@@ -6215,8 +6398,28 @@ HgfsServerRead(HgfsInputParam *input)  // IN: Input params
           * same buffer as the reply arguments.
           */
          if (readUseDataBuffer) {
+#ifdef HGFS_VECTORED_IO
+            HgfsVmxIov *iov;
+            uint32 iovCount;
+
+            /* Read straight into the guest pages if they are not contiguous. */
+            if (HSPU_GetDataPacketIov(input->packet, BUF_WRITEABLE,
+                                      input->transportSession->channelCbTable,
+                                      &iov, &iovCount)) {
+               status = HgfsPlatformReadFileV(readFd, input->session, offset,
+                                              requiredSize, iov, iovCount,
+                                              &reply->actualSize);
+               if (HGFS_ERROR_SUCCESS == status) {
+                  reply->reserved = 0;
+                  replyPayloadSize = sizeof *reply;
+                  HSPU_SetDataPacketSize(input->packet, reply->actualSize);
+               }
+               break;
+            }
+#endif
             payload = HSPU_GetDataPacketBuf(input->packet, BUF_WRITEABLE,
-                                            input->transportSession->channelCbTable);
+                                            input->transportSession->channelCbTable,
+                                            input->transportSession->packetBufPool);
          } else {
             payload = &reply->payload[0];
          }
@@ -6481,10 +6684,37 @@ HgfsServerWrite(HgfsInputParam *input)  // IN: Input params
 
    if (writeSize > 0) {
       if (NULL == writeData) {
+#ifdef HGFS_VECTORED_IO
+         HgfsVmxIov *iov;
+         uint32 iovCount;
+#endif
+
          /* No inline data to write, get it from the transport shared memory. */
          HSPU_SetDataPacketSize(input->packet, writeSize);
+#ifdef HGFS_VECTORED_IO
+         /* Write straight from the guest pages if they are not contiguous. */
+         if (HSPU_GetDataPacketIov(input->packet, BUF_READABLE,
+                                   input->transportSession->channelCbTable,
+                                   &iov, &iovCount)) {
+            status = HgfsPlatformWriteFileV(writeFd,
+                                            input->session,
+                                            writeOffset,
+                                            writeSize,
+                                            writeFlags,
+                                            writeSequential,
+                                            writeAppend,
+                                            iov,
+                                            iovCount,
+                                            &writtenSize);
+            if (HGFS_ERROR_SUCCESS != status) {
+               goto exit;
+            }
+            goto reply;
+         }
+#endif
          writeData = HSPU_GetDataPacketBuf(input->packet, BUF_READABLE,
-                                           input->transportSession->channelCbTable);
+                                           input->transportSession->channelCbTable,
+                                           input->transportSession->packetBufPool);
          if (NULL == writeData) {
             LOG(4, ("%s: Error: Op %d mapping write data buffer\n", __FUNCTION__, input->op));
             status = HGFS_ERROR_PROTOCOL;
@@ -6506,6 +6736,9 @@ HgfsServerWrite(HgfsInputParam *input)  // IN: Input params
       }
    }
 
+#ifdef HGFS_VECTORED_IO
+reply:
+#endif
    if (!HgfsPackWriteReply(input->packet, input->request, input->op,
                            writtenSize, &writeReplySize, input->session)) {
       status = HGFS_ERROR_INTERNAL;
@@ -7783,6 +8016,60 @@ HgfsServerRemoveDirNotifyWatch(HgfsInputParam *input)  // IN: Input params
 }
 
 
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * HgfsServerOplockBreakReply --
+ *
+ *    Handle the client's acknowledgement of an oplock break request.
+ *
+ *    The acknowledgement carries the oplock the client still holds on the file,
+ *    which is then downgraded or released on the host. A client may also send
+ *    it unsolicited to give up an oplock it no longer needs.
+ *
+ * Results:
+ *    None.
+ *
+ * Side effects:
+ *    None
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+static void
+HgfsServerOplockBreakReply(HgfsInputParam *input)  // IN: Input params
+{
+   HgfsHandle file;
+   HgfsLockType replyLock;
+   HgfsInternalStatus status;
+
+   LOG(8, ("%s: entered\n", __FUNCTION__));
+   HGFS_ASSERT_INPUT(input);
+
+   /*
+    * Only sessions that negotiated oplocks can hold any, so bail out with an
+    * error immediately for the others.
+    */
+   if (0 == (input->session->flags & HGFS_SESSION_OPLOCK_ENABLED)) {
+      HgfsServerCompleteRequest(HGFS_ERROR_PROTOCOL, 0, input);
+      return;
+   }
+
+   if (HgfsUnpackOplockBreakAckReply(input->payload, input->payloadSize, input->op,
+                                     &file, &replyLock)) {
+      LOG(8, ("%s: client holds lock %d on handle %u\n", __FUNCTION__,
+              replyLock, file));
+      HgfsServerOplockBreakAck(file, input->session, replyLock);
+      status = HGFS_ERROR_SUCCESS;
+   } else {
+      status = HGFS_ERROR_PROTOCOL;
+   }
+
+   HgfsServerCompleteRequest(status, 0, input);
+   LOG(8, ("%s: exit result %u\n", __FUNCTION__, status));
+}
+
+
 /*
  *-----------------------------------------------------------------------------
  *
@@ -8574,7 +8861,8 @@ HgfsServerSearchRead(HgfsInputParam *input)  // IN: Input params
 
       if (inlineDataSize == 0) {
          info.replyPayload = HSPU_GetDataPacketBuf(input->packet, BUF_WRITEABLE,
-                                                   input->transportSession->channelCbTable);
+                                                   input->transportSession->channelCbTable,
+                                                   input->transportSession->packetBufPool);
       } else {
          info.replyPayload = (char *)info.reply + baseReplySize;
       }
@@ -8717,6 +9005,8 @@ HgfsServerCreateSession(HgfsInputParam *input)  // IN: Input params
       if ((0 != (info.flags & HGFS_SESSION_OPLOCK_ENABLED)) &&
           (0 != (gHgfsCfgSettings.flags & HGFS_CONFIG_OPLOCK_ENABLED))) {
          session->flags |= HGFS_SESSION_OPLOCK_ENABLED;
+         HgfsServerSetSessionCapability(HGFS_OP_OPLOCK_BREAK_V4,
+                                        HGFS_REQUEST_SUPPORTED, session);
       }
 
       if (HgfsPackCreateSessionReply(input->packet, input->request,
@@ -8987,6 +9277,81 @@ exit:
 }
 
 
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * HgfsServerSendOplockBreak --
+ *
+ *    Called by the oplock code when the host file system breaks the oplock
+ *    held on an open file.
+ *
+ *    The function builds an oplock break request and queues it to be sent to
+ *    the client. The client answers it with an HGFS_OP_OPLOCK_BREAK_V4
+ *    acknowledgement once it has flushed or discarded its cached data.
+ *
+ * Results:
+ *    TRUE if the request was queued, FALSE otherwise.
+ *
+ * Side effects:
+ *    None
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+Bool
+HgfsServerSendOplockBreak(HgfsSessionInfo *session,   // IN: session info
+                          HgfsHandle file,            // IN: Hgfs file handle
+                          HgfsLockType serverLock)    // IN: lock left after break
+{
+   HgfsPacket *packet = NULL;
+   HgfsHeader *packetHeader = NULL;
+   size_t sizeNeeded;
+   Bool result = FALSE;
+
+   LOG(4, ("%s: Entered hnd %u lock %d\n", __FUNCTION__, file, serverLock));
+
+   if (session->state == HGFS_SESSION_STATE_CLOSED) {
+      LOG(4, ("%s: session has been closed drop the oplock break %"FMT64"x\n",
+              __FUNCTION__, session->sessionId));
+      goto exit;
+   }
+
+   sizeNeeded = sizeof *packetHeader + sizeof (HgfsRequestOplockBreakV4);
+
+   /*
+    * Use a single buffer zero'd out, as the packet and metapacket have the same
+    * lifespan which is ended at the send complete callback (HgfsServerSessionSendComplete).
+    */
+   packet = Util_SafeCalloc(1, sizeof *packet + sizeNeeded);
+   packetHeader = (HgfsHeader *)((char *)packet + sizeof *packet);
+   packet->metaPacketSize = sizeNeeded;
+   packet->metaPacketDataSize = packet->metaPacketSize;
+   packet->metaPacket = packetHeader;
+
+   if (!HgfsPackOplockBreakRequest(packetHeader, file, serverLock,
+                                   session->sessionId, &sizeNeeded)) {
+      LOG(4, ("%s: failed to pack oplock break request\n", __FUNCTION__));
+      goto exit;
+   }
+
+   if (!HgfsPacketSend(packet, session->transportSession, 0)) {
+      LOG(4, ("%s: failed to send oplock break to the client\n", __FUNCTION__));
+      goto exit;
+   }
+
+   /* The transport will call the server send complete callback to release the packets. */
+   packet = NULL;
+   result = TRUE;
+
+   LOG(4, ("%s: Sent oplock break for hnd %u lock %d\n", __FUNCTION__, file,
+           serverLock));
+
+exit:
+   free(packet);
+   return result;
+}
+
+
 /*
  *-----------------------------------------------------------------------------
  *
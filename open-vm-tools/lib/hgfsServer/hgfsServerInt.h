@@ -620,6 +620,17 @@ HgfsUpdateNodeServerLock(fileDesc fd,                // IN: OS handle
                          HgfsSessionInfo *session,   // IN: session info
                          HgfsLockType serverLock);   // IN: new oplock
 
+void
+HgfsServerSessionGet(HgfsSessionInfo *session);   // IN: session context
+
+void
+HgfsServerSessionPut(HgfsSessionInfo *session);   // IN: session context
+
+Bool
+HgfsServerSendOplockBreak(HgfsSessionInfo *session,   // IN: session info
+                          HgfsHandle file,            // IN: Hgfs file handle
+                          HgfsLockType serverLock);   // IN: lock left after break
+
 Bool
 HgfsUpdateNodeAppendFlag(HgfsHandle handle,        // IN: Hgfs file handle
                          HgfsSessionInfo *session, // IN: session info
@@ -757,6 +768,36 @@ HgfsPlatformWriteFile(fileDesc writeFile,          // IN: file descriptor
                       Bool writeAppend,            // IN: write is appended
                       const void *writeData,       // IN: data to be written
                       uint32 *writtenSize);        // OUT: byte length written
+
+/*
+ * Reads and writes straight into the guest pages of a data packet that
+ * spans several iovs, rather than copying through a bounce buffer.
+ */
+#if defined(__linux__)
+#define HGFS_VECTORED_IO
+#endif
+
+#ifdef HGFS_VECTORED_IO
+HgfsInternalStatus
+HgfsPlatformReadFileV(fileDesc readFile,           // IN: file descriptor
+                      HgfsSessionInfo *session,    // IN: session info
+                      uint64 offset,               // IN: file offset to read from
+                      uint32 requiredSize,         // IN: length of data to read
+                      const HgfsVmxIov *iov,       // IN: buffers for the read data
+                      uint32 iovCount,             // IN: number of buffers
+                      uint32 *actualSize);         // OUT: actual length read
+HgfsInternalStatus
+HgfsPlatformWriteFileV(fileDesc writeFile,          // IN: file descriptor
+                       HgfsSessionInfo *session,    // IN: session info
+                       uint64 writeOffset,          // IN: file offset to write to
+                       uint32 writeDataSize,        // IN: length of data to write
+                       HgfsWriteFlags writeFlags,   // IN: write flags
+                       Bool writeSequential,        // IN: write is sequential
+                       Bool writeAppend,            // IN: write is appended
+                       const HgfsVmxIov *iov,       // IN: data to be written
+                       uint32 iovCount,             // IN: number of buffers
+                       uint32 *writtenSize);        // OUT: byte length written
+#endif
 HgfsInternalStatus
 HgfsPlatformWriteWin32Stream(HgfsHandle file,           // IN: packet header
                              char *dataToWrite,         // IN: data to write
@@ -833,10 +874,24 @@ HgfsPlatformValidateOpen(HgfsFileOpenInfo *openInfo, // IN: Open info struct
                          HgfsLocalId *localId,       // OUT: Local unique file ID
                          fileDesc *newHandle);       // OUT: Handle to the file
 
+/* Per transport session pool of packet buffers. */
+typedef struct HgfsPacketBufPool HgfsPacketBufPool;
+
+HgfsPacketBufPool *
+HSPU_CreateBufPool(void);
+
+void
+HSPU_DestroyBufPool(HgfsPacketBufPool *pool);  // IN: pool
+
+void
+HSPU_GetBufStats(HgfsServerBufStats *stats,    // OUT/OPT: counters
+                 Bool reset);                  // IN: reset the counters?
+
 void *
 HSPU_GetMetaPacket(HgfsPacket *packet,                   // IN/OUT: Hgfs Packet
                    size_t *metaPacketSize,               // OUT: Size of metaPacket
-                   HgfsServerChannelCallbacks *chanCb);  // IN: Channel callbacks
+                   HgfsServerChannelCallbacks *chanCb,   // IN: Channel callbacks
+                   HgfsPacketBufPool *pool);             // IN/OPT: Buffer pool
 
 Bool
 HSPU_ValidateDataPacketSize(HgfsPacket *packet,     // IN: Hgfs Packet
@@ -845,7 +900,15 @@ HSPU_ValidateDataPacketSize(HgfsPacket *packet,     // IN: Hgfs Packet
 void *
 HSPU_GetDataPacketBuf(HgfsPacket *packet,                   // IN/OUT: Hgfs Packet
                       MappingType mappingType,              // IN: Readable/ Writeable ?
-                      HgfsServerChannelCallbacks *chanCb);  // IN: Channel callbacks
+                      HgfsServerChannelCallbacks *chanCb,   // IN: Channel callbacks
+                      HgfsPacketBufPool *pool);             // IN/OPT: Buffer pool
+
+Bool
+HSPU_GetDataPacketIov(HgfsPacket *packet,                   // IN/OUT: Hgfs Packet
+                      MappingType mappingType,              // IN: Readable/ Writeable ?
+                      HgfsServerChannelCallbacks *chanCb,   // IN: Channel callbacks
+                      HgfsVmxIov **iov,                     // OUT: mapped iovs
+                      uint32 *iovCount);                    // OUT: mapped iov count
 
 void
 HSPU_SetDataPacketSize(HgfsPacket *packet,            // IN/OUT: Hgfs Packet
@@ -853,11 +916,13 @@ HSPU_SetDataPacketSize(HgfsPacket *packet,            // IN/OUT: Hgfs Packet
 
 void
 HSPU_PutDataPacketBuf(HgfsPacket *packet,                   // IN/OUT: Hgfs Packet
-                      HgfsServerChannelCallbacks *chanCb);  // IN: Channel callbacks
+                      HgfsServerChannelCallbacks *chanCb,   // IN: Channel callbacks
+                      HgfsPacketBufPool *pool);             // IN/OPT: Buffer pool
 
 void
 HSPU_PutMetaPacket(HgfsPacket *packet,                   // IN/OUT: Hgfs Packet
-                   HgfsServerChannelCallbacks *chanCb);  // IN: Channel callbacks
+                   HgfsServerChannelCallbacks *chanCb,   // IN: Channel callbacks
+                   HgfsPacketBufPool *pool);             // IN/OPT: Buffer pool
 
 Bool
 HSPU_ValidateRequestPacketSize(HgfsPacket *packet,        // IN: Hgfs Packet
@@ -875,10 +940,12 @@ HSPU_ValidateReplyPacketSize(HgfsPacket *packet,         // IN: Hgfs Packet
 void *
 HSPU_GetReplyPacket(HgfsPacket *packet,                  // IN/OUT: Hgfs Packet
                     HgfsServerChannelCallbacks *chanCb,  // IN: Channel callbacks
+                    HgfsPacketBufPool *pool,             // IN/OPT: Buffer pool
                     size_t replyDataSize,                // IN: Size of reply data
                     size_t *replyPacketSize);            // OUT: Size of reply Packet
 
 void
 HSPU_PutReplyPacket(HgfsPacket *packet,                  // IN/OUT: Hgfs Packet
-                    HgfsServerChannelCallbacks *chanCb); // IN: Channel callbacks
+                    HgfsServerChannelCallbacks *chanCb,  // IN: Channel callbacks
+                    HgfsPacketBufPool *pool);            // IN/OPT: Buffer pool
 #endif /* __HGFS_SERVER_INT_H__ */
@@ -44,6 +44,7 @@
 #include <sys/types.h>
 #include <dirent.h>
 #include <sys/resource.h> // for getrlimit
+#include <sys/uio.h>      // for preadv/pwritev
 
 #if defined(__FreeBSD__)
 #   include <sys/param.h>
@@ -227,6 +228,43 @@ getdents_apple(DIR *fd,               // IN
 #define O_NOFOLLOW 0
 #endif
 
+/*
+ * openat2(2) (Linux 5.6) resolves a path beneath a directory fd in a single
+ * syscall and fails with EXDEV rather than let "..", an absolute path or a
+ * symlink escape that directory. The share confinement check uses it in place
+ * of the per-component realpath(3) walk. The syscall number is the same on all
+ * architectures that use the generic syscall table; elsewhere we need it from
+ * the headers. Kernels without openat2 fail with ENOSYS and we fall back.
+ */
+#if defined(linux)
+#   if !defined(SYS_openat2) && \
+       (defined(__x86_64__) || defined(__i386__) || \
+        defined(__aarch64__) || defined(__arm__))
+#      define SYS_openat2 437
+#   endif
+#endif
+
+#if defined(SYS_openat2)
+#   ifndef O_PATH
+#      define O_PATH 010000000
+#   endif
+#   ifndef O_CLOEXEC
+#      define O_CLOEXEC 02000000
+#   endif
+
+#define HGFS_RESOLVE_NO_MAGICLINKS 0x02
+#define HGFS_RESOLVE_BENEATH       0x08
+
+typedef struct HgfsOpenHow {
+   uint64 flags;
+   uint64 mode;
+   uint64 resolve;
+} HgfsOpenHow;
+
+/* Set once openat2 turns out to be unavailable; we stop trying it. */
+static Bool gHgfsOpenat2Unavailable = FALSE;
+#endif
+
 
 #if defined(sun) || defined(linux) || \
     (defined(__FreeBSD_version) && __FreeBSD_version < 490000)
@@ -654,6 +692,9 @@ HgfsInternalStatus
 HgfsPlatformCloseFile(fileDesc fileDesc, // IN: File descriptor
                       void *fileCtx)     // IN: File context
 {
+   /* Closing the file releases its lease, if it has one. */
+   HgfsReleaseServerLock(fileDesc);
+
    if (close(fileDesc) != 0) {
       int error = errno;
 
@@ -4329,6 +4370,199 @@ HgfsPlatformWriteFile(fileDesc writeFd,            // IN: file descriptor
 }
 
 
+
+#ifdef HGFS_VECTORED_IO
+/*
+ * Most data packets span few enough pages that their iovecs fit on the
+ * stack.
+ */
+#define HGFS_LOCAL_IOVECS  32
+
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * HgfsMakeIovec --
+ *
+ *    Fill in iovecs for the first size bytes of the mapped data packet.
+ *
+ * Results:
+ *    The iovecs: localVec if there are no more than localCount of them,
+ *    otherwise an allocated array the caller frees.
+ *
+ * Side effects:
+ *    None
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+static struct iovec *
+HgfsMakeIovec(const HgfsVmxIov *iov,    // IN: mapped data packet
+              uint32 iovCount,          // IN: number of mappings
+              uint32 size,              // IN: bytes to cover
+              struct iovec *localVec,   // IN: caller's array
+              uint32 localCount,        // IN: size of localVec
+              int *vecCount)            // OUT: number of iovecs
+{
+   struct iovec *vec = localVec;
+   uint32 i;
+
+   if (iovCount > localCount) {
+      vec = Util_SafeCalloc(iovCount, sizeof *vec);
+   }
+
+   for (i = 0; i < iovCount && size > 0; i++) {
+      vec[i].iov_base = iov[i].va;
+      vec[i].iov_len = MIN(iov[i].len, size);
+      size -= vec[i].iov_len;
+   }
+   ASSERT(size == 0);
+
+   *vecCount = i;
+   return vec;
+}
+
+
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * HgfsPlatformReadFileV --
+ *
+ *    Reads data from a file into the mappings of a data packet.
+ *
+ * Results:
+ *    Zero on success.
+ *    Non-zero on failure.
+ *
+ * Side effects:
+ *    None
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+HgfsInternalStatus
+HgfsPlatformReadFileV(fileDesc file,               // IN: file descriptor
+                      HgfsSessionInfo *session,    // IN: session info
+                      uint64 offset,               // IN: file offset to read from
+                      uint32 requiredSize,         // IN: length of data to read
+                      const HgfsVmxIov *iov,       // IN: buffers for the read data
+                      uint32 iovCount,             // IN: number of buffers
+                      uint32 *actualSize)          // OUT: actual length read
+{
+   struct iovec localVec[HGFS_LOCAL_IOVECS];
+   struct iovec *vec;
+   int vecCount;
+   ssize_t error;
+   HgfsInternalStatus status = 0;
+   HgfsHandle handle;
+   Bool sequentialOpen;
+
+   ASSERT(session);
+
+   LOG(4, ("%s: read fh %u, offset %"FMT64"u, count %u, iovs %u\n",
+           __FUNCTION__, file, offset, requiredSize, iovCount));
+
+   if (!HgfsFileDesc2Handle(file, session, &handle)) {
+      LOG(4, ("%s: Could not get file handle\n", __FUNCTION__));
+      return EBADF;
+   }
+
+   if (!HgfsHandleIsSequentialOpen(handle, session, &sequentialOpen)) {
+      LOG(4, ("%s: Could not get sequenial open status\n", __FUNCTION__));
+      return EBADF;
+   }
+
+   vec = HgfsMakeIovec(iov, iovCount, requiredSize, localVec,
+                       ARRAYSIZE(localVec), &vecCount);
+   if (sequentialOpen) {
+      error = readv(file, vec, vecCount);
+   } else {
+      error = preadv(file, vec, vecCount, offset);
+   }
+   if (error < 0) {
+      status = errno;
+      LOG(4, ("%s: error reading from file: %s\n", __FUNCTION__,
+              strerror(status)));
+   } else {
+      LOG(4, ("%s: read %"FMTSZ"d bytes\n", __FUNCTION__, error));
+      *actualSize = error;
+   }
+   if (vec != localVec) {
+      free(vec);
+   }
+
+   return status;
+}
+
+
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * HgfsPlatformWriteFileV --
+ *
+ *    Writes data from the mappings of a data packet to a file.
+ *
+ * Results:
+ *    Zero on success.
+ *    Non-zero on failure.
+ *
+ * Side effects:
+ *    None
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+HgfsInternalStatus
+HgfsPlatformWriteFileV(fileDesc writeFd,            // IN: file descriptor
+                       HgfsSessionInfo *session,    // IN: session info
+                       uint64 writeOffset,          // IN: file offset to write to
+                       uint32 writeDataSize,        // IN: length of data to write
+                       HgfsWriteFlags writeFlags,   // IN: write flags
+                       Bool writeSequential,        // IN: write is sequential
+                       Bool writeAppend,            // IN: write is appended
+                       const HgfsVmxIov *iov,       // IN: data to be written
+                       uint32 iovCount,             // IN: number of buffers
+                       uint32 *writtenSize)         // OUT: actual length written
+{
+   struct iovec localVec[HGFS_LOCAL_IOVECS];
+   struct iovec *vec;
+   int vecCount;
+   ssize_t error;
+   HgfsInternalStatus status = 0;
+
+   LOG(4, ("%s: write fh %u offset %"FMT64"u, count %u, iovs %u\n",
+           __FUNCTION__, writeFd, writeOffset, writeDataSize, iovCount));
+
+   if (!writeSequential) {
+      status = HgfsWriteCheckIORange(writeOffset, writeDataSize);
+      if (status != 0) {
+         return status;
+      }
+   }
+
+   vec = HgfsMakeIovec(iov, iovCount, writeDataSize, localVec,
+                       ARRAYSIZE(localVec), &vecCount);
+   if (writeSequential) {
+      error = writev(writeFd, vec, vecCount);
+   } else {
+      error = pwritev(writeFd, vec, vecCount, writeOffset);
+   }
+   if (error < 0) {
+      status = errno;
+      LOG(4, ("%s: error writing to file: %s\n", __FUNCTION__,
+         strerror(status)));
+   } else {
+      *writtenSize = error;
+      LOG(4, ("%s: wrote %d bytes\n", __FUNCTION__, *writtenSize));
+   }
+   if (vec != localVec) {
+      free(vec);
+   }
+
+   return status;
+}
+#endif
+
+
 /*
  *-----------------------------------------------------------------------------
  *
@@ -4853,6 +5087,118 @@ HgfsPlatformSymlinkCreate(char *localSymlinkName,   // IN: symbolic link file na
 }
 
 
+#if defined(SYS_openat2)
+/*
+ *----------------------------------------------------------------------
+ *
+ * HgfsPlatformResolveBeneath --
+ *
+ *      Resolves dirName, which must be a path under sharePath, with a single
+ *      openat2(RESOLVE_BENEATH) relative to the share root. This answers the
+ *      same question as the realpath check in HgfsPlatformPathHasSymlink
+ *      without walking the path component by component.
+ *
+ *      Like that check, this only validates the path as it is right now. The
+ *      fd is closed again and the operation that follows opens the name by
+ *      path, so a directory replaced with a symlink in between is not caught.
+ *
+ *      Symlinks that stay within the share are followed, as with realpath.
+ *      openat2 rejects absolute symlinks even when they point back into the
+ *      share, so EXDEV is not treated as final and the caller falls back to
+ *      the realpath check, as it does for any error other than ENOENT.
+ *      That includes ENOTDIR: realpath accepts a parent that is a regular
+ *      file, which O_DIRECTORY rejects.
+ *
+ * Results:
+ *      TRUE if the name status is final, FALSE if the caller should fall
+ *      back to the realpath check.
+ *
+ * Side effects:
+ *      Disables further openat2 use if the kernel does not support it.
+ *
+ *----------------------------------------------------------------------
+ */
+
+static Bool
+HgfsPlatformResolveBeneath(const char *dirName,         // IN: directory to check
+                           const char *sharePath,       // IN: share root
+                           size_t sharePathLength,      // IN: share root length
+                           HgfsNameStatus *nameStatus)  // OUT: result
+{
+   const char *relPath;
+   char *relPathMBCS;
+   HgfsOpenHow how;
+   int rootFd;
+   int dirFd;
+   int error;
+
+   if (gHgfsOpenat2Unavailable ||
+       Str_Strncmp(dirName, sharePath, sharePathLength) != 0) {
+      return FALSE;
+   }
+
+   /* The share must be a whole leading component sequence of dirName. */
+   relPath = dirName + sharePathLength;
+   if (*relPath != '\0' && *relPath != DIRSEPC &&
+       sharePath[sharePathLength - 1] != DIRSEPC) {
+      return FALSE;
+   }
+   while (*relPath == DIRSEPC) {
+      relPath++;
+   }
+   if (*relPath == '\0') {
+      relPath = ".";
+   }
+
+   relPathMBCS = (char *)Unicode_GetAllocBytes(relPath, STRING_ENCODING_DEFAULT);
+   if (relPathMBCS == NULL) {
+      return FALSE;
+   }
+
+   rootFd = Posix_Open(sharePath, O_PATH | O_DIRECTORY | O_CLOEXEC);
+   if (rootFd < 0) {
+      free(relPathMBCS);
+      return FALSE;
+   }
+
+   memset(&how, 0, sizeof how);
+   how.flags = O_PATH | O_DIRECTORY | O_CLOEXEC;
+   how.resolve = HGFS_RESOLVE_BENEATH | HGFS_RESOLVE_NO_MAGICLINKS;
+   dirFd = syscall(SYS_openat2, rootFd, relPathMBCS, &how, sizeof how);
+   error = errno;
+   close(rootFd);
+   free(relPathMBCS);
+
+   if (dirFd >= 0) {
+      close(dirFd);
+      *nameStatus = HGFS_NAME_STATUS_COMPLETE;
+      return TRUE;
+   }
+
+   switch (error) {
+   case ENOENT:
+      *nameStatus = HGFS_NAME_STATUS_DOES_NOT_EXIST;
+      break;
+   case ENOSYS:
+   case EPERM:    // Filtered by seccomp
+   case EINVAL:   // Unknown resolve flags
+   case E2BIG:
+      LOG(4, ("%s: openat2 unavailable: %s\n", __FUNCTION__, strerror(error)));
+      gHgfsOpenat2Unavailable = TRUE;
+      return FALSE;
+   default:
+      LOG(4, ("%s: openat2 failed, dirName: %s: %s\n",
+              __FUNCTION__, dirName, strerror(error)));
+      return FALSE;
+   }
+
+   LOG(4, ("%s: openat2 failed: dirName: %s: %s\n",
+           __FUNCTION__, dirName, strerror(error)));
+   return TRUE;
+}
+#endif
+
+
 /*
  *----------------------------------------------------------------------
  *
@@ -4949,6 +5295,13 @@ HgfsPlatformPathHasSymlink(const char *fileName,      // IN
       }
    }
 
+#if defined(SYS_openat2)
+   if (HgfsPlatformResolveBeneath(fileDirName, sharePath, sharePathLength,
+                                  &nameStatus)) {
+      goto exit;
+   }
+#endif
+
    /*
     * Resolve parent directory of fileName.
     * Use realpath(2) to resolve the parent.
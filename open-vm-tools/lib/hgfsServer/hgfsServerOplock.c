@@ -37,6 +37,14 @@
 #include "hgfsServerInt.h"
 #include "hgfsServerOplockInt.h"
 
+#if !defined(_WIN32)
+#include <strings.h>
+#define stricmp strcasecmp
+#endif
+
+#define LOGLEVEL_MODULE hgfs
+#include "loglevel_user.h"
+
 
 
 /*
@@ -132,24 +140,16 @@ HgfsHandle2ServerLock(HgfsHandle handle,        // IN: Hgfs file handle
                       HgfsLockType *lock)       // OUT: Server lock
 {
 #ifdef HGFS_OPLOCKS
-   Bool found = FALSE;
-   HgfsFileNode *fileNode = NULL;
+   HgfsFileNode fileNode;
 
    ASSERT(lock);
 
-   MXUser_AcquireExclLock(session->nodeArrayLock);
-   fileNode = HgfsHandle2FileNode(handle, session);
-   if (fileNode == NULL) {
-      goto exit;
+   if (!HgfsGetNodeCopy(handle, session, FALSE, &fileNode)) {
+      return FALSE;
    }
 
-   *lock = fileNode->serverLock;
-   found = TRUE;
-
-exit:
-   MXUser_ReleaseExclLock(session->nodeArrayLock);
-
-   return found;
+   *lock = fileNode.serverLock;
+   return TRUE;
 #else
    *lock = HGFS_LOCK_NONE;
    return TRUE;
@@ -218,18 +218,16 @@ HgfsFileHasServerLock(const char *utf8Name,             // IN: Name in UTF8
 
 
 
-#ifdef HGFS_OPLOCKS
 /*
  *-----------------------------------------------------------------------------
  *
- * HgfsServerOplockBreakReply --
+ * HgfsServerOplockBreakAck --
  *
- *      The client was sent an oplock break request, and responded with this
- *      reply. It contains the oplock status that the client is now in. Since
- *      the break could have actually been a degrade, it is well within the
- *      client's rights to transition to a non-broken state. We need to make
- *      sure that such a transition was legal, acknowledge the brea
- *      appropriately, and update our own state.
+ *      The client was sent an oplock break request, and acknowledged it with
+ *      the oplock it is now holding. Since the break could have actually been
+ *      a downgrade, it is well within the client's rights to keep a shared
+ *      oplock. HgfsAckOplockBreak makes sure that the transition is legal,
+ *      downgrades or releases the lease and updates our own state.
  *
  * Results:
  *      None.
@@ -241,137 +239,86 @@ HgfsFileHasServerLock(const char *utf8Name,             // IN: Name in UTF8
  */
 
 void
-HgfsServerOplockBreakReply(const unsigned char *packetIn, // IN: Reply packet
-                           unsigned int packetSize,       // IN: Size of packet
-                           void *clientData)              // IN: From request
+HgfsServerOplockBreakAck(HgfsHandle file,            // IN: Hgfs file handle
+                         HgfsSessionInfo *session,   // IN: Session info
+                         HgfsLockType replyLock)     // IN: Client has this lock
 {
-   HgfsReplyServerLockChange *reply;
-   ServerLockData *lockData = clientData;
+#ifdef HGFS_OPLOCKS
+   ServerLockData lockData;
 
-   ASSERT(packetIn);
-   ASSERT(clientData);
+   ASSERT(session);
 
-   if (packetSize < sizeof *reply) {
+   if (!HgfsHandle2FileDesc(file, session, &lockData.fileDesc, NULL)) {
+      LOG(4, ("%s: invalid handle %u\n", __FUNCTION__, file));
       return;
    }
-   reply = (HgfsReplyServerLockChange *)packetIn;
 
-   /*
-    * XXX: It should be safe to ignore the status and id from the actual
-    * HgfsReply. The only information we need to properly acknowledge the break
-    * is the original fd and the new lease, which, in the case of a degrade,
-    * is double checked in HgfsAckOplockBreak, so we'd be safe from a garbage
-    * value.
-    */
-   HgfsAckOplockBreak(lockData, reply->serverLock);
+   lockData.event = 0;
+   lockData.serverLock = HGFS_LOCK_NONE;
+   lockData.session = session;
+   HgfsAckOplockBreak(&lockData, replyLock);
+#endif
 }
 
 
+#ifdef HGFS_OPLOCKS
 /*
  *-----------------------------------------------------------------------------
  *
  * HgfsServerOplockBreak --
  *
  *      When the host FS needs to break the oplock so that another client
- *      can open the file, it signals the event in the overlapped structure
- *      that we used to request an oplock.
+ *      can open the file, the platform code calls this function.
  *      This sets off the following chains of events:
- *      1. Send the oplock break request to the guest.
- *      2. Once the guest acknowledges the oplock break, the completion
- *      routine GuestRpcServerRequestCallback will fire, causing
- *      HgfsServerOplockBreakReply to also fire, which will break the oplock
- *      on the host FS.
+ *      1. Send the oplock break request to the client.
+ *      2. Once the client acknowledges the oplock break with an
+ *      HGFS_OP_OPLOCK_BREAK_V4 request, HgfsServerOplockBreakAck fires,
+ *      which downgrades or breaks the oplock on the host FS.
  *
  * Results:
- *      None.
+ *      TRUE if the break request was sent to the client.
+ *      FALSE if the file is not (yet) in the node cache with a lock, or the
+ *      request could not be sent.
  *
  * Side effects:
- *      If successful, allocates memory for the rpc request.
+ *      None.
  *
  *-----------------------------------------------------------------------------
  */
 
-void
-HgfsServerOplockBreak(ServerLockData *lockData)
+Bool
+HgfsServerOplockBreak(ServerLockData *lockData) // IN: server lock info
 {
    HgfsHandle hgfsHandle;
-   char *requestBuffer = NULL;
-   HgfsRequestServerLockChange *request;
    HgfsLockType lock;
 
+   ASSERT(lockData);
+   ASSERT(lockData->session);
+
    LOG(4, ("%s: entered\n", __FUNCTION__));
 
    /*
-    * XXX: Just because the file in not in the cache on the server,
-    * does not mean it was closed on the client. It is possible that
-    * we closed the file on the server because we ran out of space
-    * in cache. That's why for now as long as a file has a lock,
-    * we don't remove it from the node cache. This should be fixed.
-    *
-    * In any case, none of these cache-related failures should cause us to ack
-    * the oplock break locally. That is because if the file wasn't in the
-    * cache, or it had no lock, chances are someone else (maybe the VCPU
-    * thread) broke the oplock and/or closed the file.
+    * The lease is acquired before the file node is added to the cache, so a
+    * break can arrive before there is a handle to send to the client. The
+    * caller retries in that case.
     */
-
-   if (!HgfsFileDesc2Handle(lockData->fileDesc, &hgfsHandle)) {
+   if (!HgfsFileDesc2Handle(lockData->fileDesc, lockData->session,
+                            &hgfsHandle)) {
       LOG(4, ("%s: file is not in the cache\n", __FUNCTION__));
-      goto free_and_exit;
+      return FALSE;
    }
 
-   if (!HgfsHandle2ServerLock(hgfsHandle, &lock)) {
+   if (!HgfsHandle2ServerLock(hgfsHandle, lockData->session, &lock)) {
       LOG(4, ("%s: could not retrieve node's lock info.\n", __FUNCTION__));
-      goto free_and_exit;
+      return FALSE;
    }
 
    if (lock == HGFS_LOCK_NONE) {
       LOG(4, ("%s: the file does not have a server lock.\n", __FUNCTION__));
-      goto free_and_exit;
-   }
-
-   /*
-    * We need to setup the entire request here. The command prefix will be
-    * added later, so save some space for it.
-    *
-    * XXX: This should probably go into a common allocation function that
-    * other out-of-band requests can use.
-    */
-
-   requestBuffer = malloc(sizeof *request + HGFS_CLIENT_CMD_LEN);
-   if (requestBuffer == NULL) {
-      LOG(4, ("%s: could not allocate memory.\n", __FUNCTION__));
-      goto ack_and_exit;
+      return FALSE;
    }
 
-   /* Save space for the command prefix. */
-   request = (HgfsRequestServerLockChange *)
-      (requestBuffer + HGFS_CLIENT_CMD_LEN);
-   request->header.op = HGFS_OP_SERVER_LOCK_CHANGE;
-   request->header.id = 0; /* XXX */
-   request->file = hgfsHandle;
-   request->newServerLock = lockData->serverLock;
-
-   /*
-    * Just send the request size for our actual request; our callee will
-    * write in the command prefix and modify the request size appropriately.
-    *
-    * If for some reason we fail, we'll acknowledge the oplock break
-    * immediately.
-    */
-
-   if (HgfsServerManager_SendRequest(requestBuffer, sizeof *request,
-                                     HgfsServerOplockBreakReply, lockData)) {
-      return;
-   }
-   free(requestBuffer);
-
-  ack_and_exit:
-   HgfsAckOplockBreak(lockData, HGFS_LOCK_NONE);
-
-   return;
-
-  free_and_exit:
-   free(lockData);
+   return HgfsServerSendOplockBreak(lockData->session, hgfsHandle,
+                                    lockData->serverLock);
 }
 #endif
-
@@ -59,6 +59,10 @@ Bool HgfsFileHasServerLock(const char *utf8Name,
 Bool HgfsAcquireServerLock(fileDesc fileDesc,
                            HgfsSessionInfo *session,
                            HgfsLockType *serverLock);
+void HgfsReleaseServerLock(fileDesc fileDesc);
+void HgfsServerOplockBreakAck(HgfsHandle file,
+                              HgfsSessionInfo *session,
+                              HgfsLockType replyLock);
 
 
 #endif // ifndef _HGFS_SERVER_OPLOCK_H_
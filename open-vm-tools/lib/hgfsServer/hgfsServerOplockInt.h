@@ -31,23 +31,22 @@
 
 /*
  * Does this platform have oplock support? We define it here to avoid long
- * ifdefs all over the code. For now, Linux and Windows hosts only.
- *
- * XXX: Just kidding, no oplock support yet.
+ * ifdefs all over the code. For now, Linux only, where oplocks are backed
+ * by kernel file leases.
  */
-#if 0
+#if defined(__linux__) && !defined(__ANDROID__)
 #define HGFS_OPLOCKS
 #endif
 
 /*
- * XXX describe the data structure
+ * Server lock related structure. Identifies the file whose oplock changes,
+ * the session holding it and the lock the session is left with.
  */
-
-/* Server lock related structure */
 typedef struct {
    fileDesc fileDesc;
    int32 event;
    HgfsLockType serverLock;
+   HgfsSessionInfo *session;
 } ServerLockData;
 
 
@@ -62,7 +61,13 @@ typedef struct {
  */
 
 #ifdef HGFS_OPLOCKS
+Bool
+HgfsPlatformOplockInit(void);
+
 void
+HgfsPlatformOplockDestroy(void);
+
+Bool
 HgfsServerOplockBreak(ServerLockData *data);
 
 void
@@ -20,8 +20,18 @@
  * hgfsServerOplockLinux.c --
  *
  *      HGFS server opportunistic lock support for the Linux platform.
+ *
+ *      Oplocks are backed by kernel file leases (F_SETLEASE). Lease break
+ *      notifications are directed with F_SETOWN_EX to a dedicated thread,
+ *      which keeps the signal blocked and collects it with sigtimedwait(),
+ *      so no process-wide signal handler is needed. The thread forwards each
+ *      break to the owning session, and downgrades the lease once the client
+ *      acknowledges it, or once the client fails to do so in time.
  */
 
+#if defined(__linux__) && !defined(_GNU_SOURCE)
+#  define _GNU_SOURCE /* For F_SETLEASE, F_SETSIG and F_SETOWN_EX */
+#endif
 
 #include <stdlib.h>
 #include <stdio.h>
@@ -30,21 +40,83 @@
 
 #include "vmware.h"
 #include "hgfsServerInt.h"
+#include "hgfsServerOplock.h"
 #include "hgfsServerOplockInt.h"
 
 #ifdef HGFS_OPLOCKS
+#   include <fcntl.h>
+#   include <pthread.h>
 #   include <signal.h>
-#   include "sig.h"
+#   include <unistd.h>
+#   include <sys/syscall.h>
+#   include "hostinfo.h"
+#   include "userlock.h"
+#   include "mutexRankLib.h"
+#   include "util.h"
 #endif
 
+#define LOGLEVEL_MODULE hgfs
+#include "loglevel_user.h"
+
 
 /*
  * Local data
  */
 
+#ifdef HGFS_OPLOCKS
+
 /*
- * Global data
+ * Signal the kernel sends to the lease break thread. Real-time signals are
+ * queued, so breaks on several files are not merged into one, and carry the
+ * file descriptor in si_fd. If the real-time signal queue overflows, the
+ * kernel sends SIGIO instead, and every lease is checked.
  */
+#define HGFS_LEASE_BREAK_SIGNAL     (SIGRTMIN + 4)
+
+/* How long a client has to acknowledge an oplock break (ms). */
+#define HGFS_LEASE_BREAK_TIMEOUT    5000
+
+/* How often breaks that could not be sent yet are retried (ms). */
+#define HGFS_LEASE_BREAK_RETRY      50
+
+/* How long the break thread sleeps when no break is outstanding (ms). */
+#define HGFS_LEASE_IDLE_WAIT        60000
+
+typedef enum {
+   HGFS_LEASE_GRANTED,          // Lease held, no break outstanding
+   HGFS_LEASE_BREAK_PENDING,    // Break detected, client not notified yet
+   HGFS_LEASE_BREAK_SENT,       // Client notified, waiting for its ack
+} HgfsLeaseState;
+
+typedef struct HgfsLease {
+   fileDesc fileDesc;           // Leased file, unique while the lease exists
+   uint32 generation;           // Tells apart leases on a reused fileDesc
+   HgfsSessionInfo *session;    // Session that opened the file
+   HgfsLockType serverLock;     // Lock granted to the session
+   HgfsLeaseState state;
+   HgfsLockType breakTo;        // Lock left once the break completes
+   VmTimeType breakDeadline;    // When to stop waiting for the client
+} HgfsLease;
+
+/* A break the break thread acts on once it has dropped the lease lock. */
+typedef struct HgfsLeaseWork {
+   ServerLockData data;
+   uint32 generation;           // Lease the work was collected for
+   Bool expired;                // Client did not acknowledge in time
+} HgfsLeaseWork;
+
+static struct {
+   MXUserExclLock *lock;        // Protects everything below
+   HgfsLease *leases;
+   uint32 numLeases;
+   uint32 maxLeases;
+   uint32 lastGeneration;
+   pthread_t thread;
+   pid_t threadId;              // Kernel id of the break thread, 0 if none
+   Atomic_Bool exit;
+} gHgfsLeases;
+
+#endif
 
 
 /*
@@ -52,13 +124,357 @@
  */
 
 #ifdef HGFS_OPLOCKS
-static void HgfsServerSigOplockBreak(int sigNum,
-                                     siginfo_t *info,
-                                     ucontext_t *u,
-                                     void *clientData);
+static void *HgfsLeaseBreakThread(void *clientData);
+static void HgfsLeaseAck(ServerLockData *lockData, HgfsLockType replyLock,
+                         uint32 generation);
 #endif
 
 
+#ifdef HGFS_OPLOCKS
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * HgfsLeaseFind --
+ *
+ *      Look up the lease held on a file descriptor. A non-zero generation
+ *      only matches the lease it was read from, not a later lease on the
+ *      same, reused, file descriptor. The lease lock must be held.
+ *
+ * Results:
+ *      The lease, or NULL if the file descriptor has no matching lease.
+ *
+ * Side effects:
+ *      None.
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+static HgfsLease *
+HgfsLeaseFind(fileDesc fileDesc,    // IN: OS handle
+              uint32 generation)   // IN: lease generation, 0 for any
+{
+   uint32 i;
+
+   for (i = 0; i < gHgfsLeases.numLeases; i++) {
+      HgfsLease *lease = &gHgfsLeases.leases[i];
+
+      if (lease->fileDesc == fileDesc) {
+         return generation == 0 || lease->generation == generation ? lease
+                                                                   : NULL;
+      }
+   }
+   return NULL;
+}
+
+
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * HgfsLeaseRemove --
+ *
+ *      Remove a lease from the lease table. The lease lock must be held.
+ *
+ * Results:
+ *      None.
+ *
+ * Side effects:
+ *      The last lease in the table is moved into the freed slot.
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+static void
+HgfsLeaseRemove(HgfsLease *lease)  // IN: lease to remove
+{
+   HgfsLease *last = &gHgfsLeases.leases[gHgfsLeases.numLeases - 1];
+
+   ASSERT(gHgfsLeases.numLeases > 0);
+
+   *lease = *last;
+   gHgfsLeases.numLeases--;
+}
+
+
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * HgfsLeaseBreakStart --
+ *
+ *      Record that the kernel wants to break the lease on a file. The break
+ *      thread notifies the client on its next pass. According to locks.c in
+ *      the kernel source, doing F_GETLEASE when a lease break is pending
+ *      returns the lease we should downgrade to: F_RDLCK if we can downgrade,
+ *      or F_UNLCK if we should break altogether.
+ *
+ *      A lease that F_GETLEASE still reports as granted is not being broken.
+ *      That happens when a queued break signal was meant for an earlier file
+ *      whose descriptor has since been closed and reused for this one.
+ *
+ *      The lease lock must be held.
+ *
+ * Results:
+ *      None.
+ *
+ * Side effects:
+ *      None.
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+static void
+HgfsLeaseBreakStart(HgfsLease *lease)  // IN: lease being broken
+{
+   int newLease;
+
+   if (lease->state != HGFS_LEASE_GRANTED) {
+      return;
+   }
+
+   newLease = fcntl(lease->fileDesc, F_GETLEASE);
+   if (newLease == -1) {
+      Log("%s: Could not get old lease for fd %d: %s\n", __FUNCTION__,
+          lease->fileDesc, strerror(errno));
+      newLease = F_UNLCK;
+   } else if (newLease == (lease->serverLock == HGFS_LOCK_EXCLUSIVE ? F_WRLCK
+                                                                   : F_RDLCK)) {
+      LOG(4, ("%s: No break pending on fd %d\n", __FUNCTION__,
+              lease->fileDesc));
+      return;
+   }
+
+   lease->breakTo = newLease == F_RDLCK ? HGFS_LOCK_SHARED : HGFS_LOCK_NONE;
+   lease->state = HGFS_LEASE_BREAK_PENDING;
+   lease->breakDeadline = Hostinfo_SystemTimerMS() + HGFS_LEASE_BREAK_TIMEOUT;
+
+   LOG(4, ("%s: Break of %s lease on fd %d to %s\n", __FUNCTION__,
+           lease->serverLock == HGFS_LOCK_EXCLUSIVE ? "write" : "read",
+           lease->fileDesc,
+           lease->breakTo == HGFS_LOCK_SHARED ? "read" : "none"));
+}
+
+
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * HgfsLeaseBreakSignal --
+ *
+ *      Handle a lease break signal received by the break thread. For
+ *      HGFS_LEASE_BREAK_SIGNAL the file descriptor is known; for SIGIO, sent
+ *      when the real-time signal queue overflowed, every lease is checked
+ *      for a pending break. Either way HgfsLeaseBreakStart asks the kernel
+ *      whether the lease is really being broken.
+ *
+ * Results:
+ *      None.
+ *
+ * Side effects:
+ *      None.
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+static void
+HgfsLeaseBreakSignal(int sigNum,             // IN: Signal number
+                     const siginfo_t *info)  // IN: Additional info about signal
+{
+   MXUser_AcquireExclLock(gHgfsLeases.lock);
+
+   if (sigNum == HGFS_LEASE_BREAK_SIGNAL) {
+      HgfsLease *lease = HgfsLeaseFind(info->si_fd, 0);
+
+      LOG(4, ("%s: Received lease break for fd %d\n", __FUNCTION__,
+              info->si_fd));
+      if (lease != NULL) {
+         HgfsLeaseBreakStart(lease);
+      }
+   } else {
+      uint32 i;
+
+      for (i = 0; i < gHgfsLeases.numLeases; i++) {
+         HgfsLeaseBreakStart(&gHgfsLeases.leases[i]);
+      }
+   }
+
+   MXUser_ReleaseExclLock(gHgfsLeases.lock);
+}
+
+
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * HgfsLeaseProcessBreaks --
+ *
+ *      Notify the clients of pending lease breaks, and break the leases whose
+ *      clients did not acknowledge the break in time. Sending the break and
+ *      updating the file node both take the session's node array lock, so
+ *      the work is collected under the lease lock and done without it.
+ *
+ *      Meanwhile a lease can be released and its file closed, and the file
+ *      descriptor reused for a new lease. So every lease is looked up again
+ *      by the generation it had when the work was collected before acting
+ *      on its file descriptor.
+ *
+ * Results:
+ *      How long the break thread can wait before calling this again, in ms.
+ *
+ * Side effects:
+ *      None.
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+static VmTimeType
+HgfsLeaseProcessBreaks(void)
+{
+   HgfsLeaseWork *work = NULL;
+   uint32 numWork = 0;
+   uint32 i;
+   VmTimeType now = Hostinfo_SystemTimerMS();
+   VmTimeType wait = HGFS_LEASE_IDLE_WAIT;
+
+   MXUser_AcquireExclLock(gHgfsLeases.lock);
+
+   for (i = 0; i < gHgfsLeases.numLeases; i++) {
+      HgfsLease *lease = &gHgfsLeases.leases[i];
+
+      /*
+       * Leases of closed sessions go away as their files are closed, which
+       * also lets the kernel complete the break.
+       */
+      if (lease->state == HGFS_LEASE_GRANTED ||
+          lease->session->state == HGFS_SESSION_STATE_CLOSED) {
+         continue;
+      }
+
+      if (work == NULL) {
+         work = Util_SafeMalloc(gHgfsLeases.numLeases * sizeof *work);
+      }
+
+      if (now >= lease->breakDeadline) {
+         work[numWork].expired = TRUE;
+      } else if (lease->state == HGFS_LEASE_BREAK_PENDING) {
+         work[numWork].expired = FALSE;
+      } else {
+         wait = MIN(wait, lease->breakDeadline - now);
+         continue;
+      }
+
+      /* The session frees its nodes, and so its leases, before it is freed. */
+      HgfsServerSessionGet(lease->session);
+      work[numWork].data.fileDesc = lease->fileDesc;
+      work[numWork].data.event = 0;
+      work[numWork].data.serverLock = lease->breakTo;
+      work[numWork].data.session = lease->session;
+      work[numWork].generation = lease->generation;
+      numWork++;
+   }
+
+   MXUser_ReleaseExclLock(gHgfsLeases.lock);
+
+   for (i = 0; i < numWork; i++) {
+      HgfsLeaseWork *item = &work[i];
+      HgfsLease *lease;
+      Bool current;
+
+      if (item->expired) {
+         Log("%s: Client did not acknowledge break on fd %d, breaking lease\n",
+             __FUNCTION__, item->data.fileDesc);
+         HgfsLeaseAck(&item->data, HGFS_LOCK_NONE, item->generation);
+         HgfsServerSessionPut(item->data.session);
+         continue;
+      }
+
+      /*
+       * The lease is only looked up here, not held across the send, so a
+       * close racing with the send can still get a break sent for its
+       * successor. The client then acknowledges a break the kernel did not
+       * ask for, which just gives the lease up early.
+       */
+      MXUser_AcquireExclLock(gHgfsLeases.lock);
+      lease = HgfsLeaseFind(item->data.fileDesc, item->generation);
+      current = lease != NULL && lease->state == HGFS_LEASE_BREAK_PENDING;
+      MXUser_ReleaseExclLock(gHgfsLeases.lock);
+
+      if (!current) {
+         LOG(4, ("%s: Lease on fd %d went away before its break was sent\n",
+                 __FUNCTION__, item->data.fileDesc));
+      } else if (HgfsServerOplockBreak(&item->data)) {
+         MXUser_AcquireExclLock(gHgfsLeases.lock);
+         lease = HgfsLeaseFind(item->data.fileDesc, item->generation);
+         if (lease != NULL && lease->state == HGFS_LEASE_BREAK_PENDING) {
+            lease->state = HGFS_LEASE_BREAK_SENT;
+            wait = MIN(wait, lease->breakDeadline - now);
+         }
+         MXUser_ReleaseExclLock(gHgfsLeases.lock);
+      } else {
+         /* Most likely the open has not completed yet, retry shortly. */
+         wait = MIN(wait, HGFS_LEASE_BREAK_RETRY);
+      }
+      HgfsServerSessionPut(item->data.session);
+   }
+
+   free(work);
+
+   return wait;
+}
+
+
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * HgfsLeaseBreakThread --
+ *
+ *      Thread that receives the lease break signals. All signals are blocked
+ *      in this thread; the lease break signals are directed to it and
+ *      collected synchronously.
+ *
+ * Results:
+ *      NULL.
+ *
+ * Side effects:
+ *      None.
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+static void *
+HgfsLeaseBreakThread(void *clientData)  // IN: Ignored
+{
+   sigset_t sigs;
+
+   sigemptyset(&sigs);
+   sigaddset(&sigs, HGFS_LEASE_BREAK_SIGNAL);
+   sigaddset(&sigs, SIGIO);
+
+   MXUser_AcquireExclLock(gHgfsLeases.lock);
+   gHgfsLeases.threadId = syscall(SYS_gettid);
+   MXUser_ReleaseExclLock(gHgfsLeases.lock);
+
+   while (!Atomic_ReadBool(&gHgfsLeases.exit)) {
+      VmTimeType wait = HgfsLeaseProcessBreaks();
+      struct timespec timeout;
+      siginfo_t info;
+      int sigNum;
+
+      timeout.tv_sec = wait / 1000;
+      timeout.tv_nsec = (wait % 1000) * 1000000;
+
+      sigNum = sigtimedwait(&sigs, &info, &timeout);
+
+      /* Signals sent by the kernel have a positive si_code. */
+      if (sigNum != -1 && info.si_code > 0) {
+         HgfsLeaseBreakSignal(sigNum, &info);
+      }
+   }
+
+   MXUser_AcquireExclLock(gHgfsLeases.lock);
+   gHgfsLeases.threadId = 0;
+   MXUser_ReleaseExclLock(gHgfsLeases.lock);
+
+   return NULL;
+}
+#endif
+
 
 /*
  *-----------------------------------------------------------------------------
@@ -68,10 +484,10 @@ static void HgfsServerSigOplockBreak(int sigNum,
  *      Set up any state needed to start Linux HGFS server oplock support.
  *
  * Results:
- *      TRUE always.
+ *      TRUE on success, FALSE if the lease break thread could not be started.
  *
  * Side effects:
- *      None.
+ *      Starts the lease break thread.
  *
  *-----------------------------------------------------------------------------
  */
@@ -80,8 +496,32 @@ Bool
 HgfsPlatformOplockInit(void)
 {
 #ifdef HGFS_OPLOCKS
-   /* Register a signal handler to catch oplock break signals. */
-   Sig_Callback(SIGIO, SIG_SAFE, HgfsServerSigOplockBreak, NULL);
+   sigset_t allSigs;
+   sigset_t oldSigs;
+   int error;
+
+   gHgfsLeases.lock = MXUser_CreateExclLock("HgfsOplockLock",
+                                            RANK_hgfsOplockLock);
+   Atomic_WriteBool(&gHgfsLeases.exit, FALSE);
+
+   /*
+    * The break thread inherits a signal mask with everything blocked, so it
+    * never runs the process' signal handlers, and the lease break signals
+    * stay pending until it collects them.
+    */
+   sigfillset(&allSigs);
+   pthread_sigmask(SIG_SETMASK, &allSigs, &oldSigs);
+   error = pthread_create(&gHgfsLeases.thread, NULL, HgfsLeaseBreakThread,
+                          NULL);
+   pthread_sigmask(SIG_SETMASK, &oldSigs, NULL);
+
+   if (error != 0) {
+      Log("%s: Could not start lease break thread: %s\n", __FUNCTION__,
+          strerror(error));
+      MXUser_DestroyExclLock(gHgfsLeases.lock);
+      gHgfsLeases.lock = NULL;
+      return FALSE;
+   }
 #endif
    return TRUE;
 }
@@ -98,7 +538,7 @@ HgfsPlatformOplockInit(void)
  *      None.
  *
  * Side effects:
- *      None.
+ *      Stops the lease break thread.
  *
  *-----------------------------------------------------------------------------
  */
@@ -107,8 +547,23 @@ void
 HgfsPlatformOplockDestroy(void)
 {
 #ifdef HGFS_OPLOCKS
-   /* Tear down oplock state, so we no longer catch signals. */
-   Sig_Callback(SIGIO, SIG_NOHANDLER, NULL, NULL);
+   if (gHgfsLeases.lock == NULL) {
+      return;
+   }
+
+   Atomic_WriteBool(&gHgfsLeases.exit, TRUE);
+   pthread_kill(gHgfsLeases.thread, HGFS_LEASE_BREAK_SIGNAL);
+   pthread_join(gHgfsLeases.thread, NULL);
+
+   /* All sessions are gone by now, and so are their leases. */
+   ASSERT(gHgfsLeases.numLeases == 0);
+   free(gHgfsLeases.leases);
+   gHgfsLeases.leases = NULL;
+   gHgfsLeases.numLeases = 0;
+   gHgfsLeases.maxLeases = 0;
+
+   MXUser_DestroyExclLock(gHgfsLeases.lock);
+   gHgfsLeases.lock = NULL;
 #endif
 }
 
@@ -122,6 +577,9 @@ HgfsPlatformOplockDestroy(void)
  *    lease desired, but if the client asked for HGFS_LOCK_OPPORTUNISTIC, we'll
  *    take the "best" lease we can get.
  *
+ *    Leases are only granted to sessions that negotiated oplock support, since
+ *    the others cannot be told when the lease is broken.
+ *
  * Results:
  *    TRUE on success. serverLock contains the type of the lock acquired.
  *    FALSE on failure. serverLock is HGFS_LOCK_NONE.
@@ -142,33 +600,24 @@ HgfsAcquireServerLock(fileDesc fileDesc,            // IN: OS handle
 {
 #ifdef HGFS_OPLOCKS
    HgfsLockType desiredLock;
-   int leaseType, error;
+   struct f_owner_ex owner;
+   HgfsLease *lease;
+   int leaseType;
+   Bool granted = FALSE;
 
    ASSERT(serverLock);
    ASSERT(session);
 
    desiredLock = *serverLock;
+   *serverLock = HGFS_LOCK_NONE;
 
    if (desiredLock == HGFS_LOCK_NONE) {
       return TRUE;
    }
 
-   if (!HgfsIsServerLockAllowed(session)) {
-      return FALSE;
-   }
-
-   /*
-    * First tell the kernel which signal to send us. SIGIO is already the
-    * default, but if we skip this step, we won't get the siginfo_t when
-    * a lease break occurs.
-    *
-    * XXX: Do I need to do fcntl(fileDesc, F_SETOWN, getpid())?
-    */
-   if (fcntl(fileDesc, F_SETSIG, SIGIO)) {
-      error = errno;
-      Log("%s: Could not set SIGIO as the desired lease break signal for "
-          "fd %d: %s\n", __FUNCTION__, fileDesc, strerror(error));
-
+   if (gHgfsLeases.lock == NULL ||
+       (session->flags & HGFS_SESSION_OPLOCK_ENABLED) == 0 ||
+       !HgfsIsServerLockAllowed(session)) {
       return FALSE;
    }
 
@@ -186,6 +635,48 @@ HgfsAcquireServerLock(fileDesc fileDesc,            // IN: OS handle
 
       return FALSE;
    }
+
+   /*
+    * The lease is entered in the table before it is taken, and the table
+    * stays locked meanwhile, so a break that comes right away finds it.
+    */
+   MXUser_AcquireExclLock(gHgfsLeases.lock);
+
+   if (gHgfsLeases.threadId == 0) {
+      goto exit;
+   }
+
+   /*
+    * Tell the kernel which signal to send, and to send it to the break
+    * thread rather than to the process. Setting the signal is also what
+    * makes the kernel fill in the siginfo_t when a lease break occurs.
+    */
+   owner.type = F_OWNER_TID;
+   owner.pid = gHgfsLeases.threadId;
+   if (fcntl(fileDesc, F_SETSIG, HGFS_LEASE_BREAK_SIGNAL) == -1 ||
+       fcntl(fileDesc, F_SETOWN_EX, &owner) == -1) {
+      Log("%s: Could not direct lease breaks for fd %d: %s\n",
+          __FUNCTION__, fileDesc, strerror(errno));
+      goto exit;
+   }
+
+   if (gHgfsLeases.numLeases == gHgfsLeases.maxLeases) {
+      gHgfsLeases.maxLeases = MAX(2 * gHgfsLeases.maxLeases, 16);
+      gHgfsLeases.leases = Util_SafeRealloc(gHgfsLeases.leases,
+                                            gHgfsLeases.maxLeases *
+                                            sizeof *gHgfsLeases.leases);
+   }
+   lease = &gHgfsLeases.leases[gHgfsLeases.numLeases++];
+   lease->fileDesc = fileDesc;
+   if (++gHgfsLeases.lastGeneration == 0) {
+      gHgfsLeases.lastGeneration = 1;   // 0 matches any lease
+   }
+   lease->generation = gHgfsLeases.lastGeneration;
+   lease->session = session;
+   lease->state = HGFS_LEASE_GRANTED;
+   lease->breakTo = HGFS_LOCK_NONE;
+   lease->breakDeadline = 0;
+
    if (fcntl(fileDesc, F_SETLEASE, leaseType)) {
       /*
        * If our client was opportunistic and we failed to get his lease because
@@ -196,19 +687,17 @@ HgfsAcquireServerLock(fileDesc fileDesc,            // IN: OS handle
           (errno == EAGAIN || errno == EACCES)) {
          leaseType = F_RDLCK;
          if (fcntl(fileDesc, F_SETLEASE, leaseType)) {
-            error = errno;
             LOG(4, ("%s: Could not get any opportunistic lease for fd %d: %s\n",
-                    __FUNCTION__, fileDesc, strerror(error)));
-
-            return FALSE;
+                    __FUNCTION__, fileDesc, strerror(errno)));
+            HgfsLeaseRemove(lease);
+            goto exit;
          }
       } else {
-         error = errno;
          LOG(4, ("%s: Could not get %s lease for fd %d: %s\n",
                  __FUNCTION__, leaseType == F_WRLCK ? "write" : "read",
                  fileDesc, strerror(errno)));
-
-         return FALSE;
+         HgfsLeaseRemove(lease);
+         goto exit;
       }
    }
 
@@ -216,25 +705,69 @@ HgfsAcquireServerLock(fileDesc fileDesc,            // IN: OS handle
    LOG(4, ("%s: Got %s lease for fd %d\n", __FUNCTION__,
            leaseType == F_WRLCK ? "write" : "read", fileDesc));
    *serverLock = leaseType == F_WRLCK ? HGFS_LOCK_EXCLUSIVE : HGFS_LOCK_SHARED;
-   return TRUE;
+   lease->serverLock = *serverLock;
+   granted = TRUE;
+
+exit:
+   MXUser_ReleaseExclLock(gHgfsLeases.lock);
+   return granted;
 #else
    return FALSE;
 #endif
 }
 
 
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * HgfsReleaseServerLock --
+ *
+ *    Forget the lease held on a file that is about to be closed. Closing the
+ *    file releases the lease in the kernel.
+ *
+ * Results:
+ *    None.
+ *
+ * Side effects:
+ *    None.
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+void
+HgfsReleaseServerLock(fileDesc fileDesc)  // IN: OS handle
+{
+#ifdef HGFS_OPLOCKS
+   HgfsLease *lease;
+
+   if (gHgfsLeases.lock == NULL) {
+      return;
+   }
+
+   MXUser_AcquireExclLock(gHgfsLeases.lock);
+   lease = HgfsLeaseFind(fileDesc, 0);
+   if (lease != NULL) {
+      LOG(4, ("%s: Releasing lease on fd %d\n", __FUNCTION__, fileDesc));
+      HgfsLeaseRemove(lease);
+   }
+   MXUser_ReleaseExclLock(gHgfsLeases.lock);
+#endif
+}
+
+
 #ifdef HGFS_OPLOCKS
 /*
  *-----------------------------------------------------------------------------
  *
- * HgfsAckOplockBreak --
+ * HgfsLeaseAck --
  *
- *    Platform-dependent implementation of oplock break acknowledgement.
- *    This function gets called when the oplock break rpc command is completed.
- *    The rpc oplock break command (HgfsServerOplockBreak) is in hgfsServer.c
+ *    Downgrade or release a lease, as acknowledged by the client or because
+ *    the client failed to acknowledge a break in time. A non-zero generation
+ *    limits this to that lease, so a later lease on the same, reused, file
+ *    descriptor is left alone.
  *
  *    On Linux, we use fcntl() to downgrade the lease. Then we update the node
- *    cache, free the clientData, and call it a day.
+ *    cache, and call it a day.
  *
  * Results:
  *    None
@@ -245,133 +778,96 @@ HgfsAcquireServerLock(fileDesc fileDesc,            // IN: OS handle
  *-----------------------------------------------------------------------------
  */
 
-void
-HgfsAckOplockBreak(ServerLockData *lockData, // IN: server lock info
-                   HgfsLockType replyLock)   // IN: client has this lock
+static void
+HgfsLeaseAck(ServerLockData *lockData, // IN: server lock info
+             HgfsLockType replyLock,   // IN: client has this lock
+             uint32 generation)        // IN: lease generation, 0 for any
 {
    int fileDesc, newLock;
+   HgfsLockType allowedLock;
    HgfsLockType actualLock;
+   HgfsLease *lease;
 
    ASSERT(lockData);
    fileDesc = lockData->fileDesc;
    LOG(4, ("%s: Acknowledging break on fd %d\n", __FUNCTION__, fileDesc));
 
+   MXUser_AcquireExclLock(gHgfsLeases.lock);
+
+   lease = HgfsLeaseFind(fileDesc, generation);
+   if (lease == NULL || lease->session != lockData->session) {
+      MXUser_ReleaseExclLock(gHgfsLeases.lock);
+      LOG(4, ("%s: No lease on fd %d\n", __FUNCTION__, fileDesc));
+      return;
+   }
+
    /*
-    * The Linux server supports lock downgrading. We only downgrade to a shared
-    * lock if our previous call to fcntl() said we could, and if the client
-    * wants to downgrade to a shared lock. Otherwise, we break altogether.
+    * The Linux server supports lock downgrading. We only keep a lock that is
+    * no stronger than what the kernel lets us keep, and no stronger than what
+    * the client says it has. Otherwise, we break altogether.
     */
-   if (lockData->serverLock == HGFS_LOCK_SHARED &&
-       replyLock == HGFS_LOCK_SHARED) {
+   allowedLock = lease->state == HGFS_LEASE_GRANTED ? lease->serverLock
+                                                    : lease->breakTo;
+   if (replyLock == HGFS_LOCK_EXCLUSIVE &&
+       allowedLock == HGFS_LOCK_EXCLUSIVE) {
+      newLock = F_WRLCK;
+      actualLock = HGFS_LOCK_EXCLUSIVE;
+   } else if ((replyLock == HGFS_LOCK_SHARED ||
+               replyLock == HGFS_LOCK_EXCLUSIVE) &&
+              allowedLock != HGFS_LOCK_NONE) {
       newLock = F_RDLCK;
-      actualLock = replyLock;
+      actualLock = HGFS_LOCK_SHARED;
    } else {
       newLock = F_UNLCK;
       actualLock = HGFS_LOCK_NONE;
    }
 
    /* Downgrade or acknowledge the break altogether. */
-   if (fcntl(fileDesc, F_SETLEASE, newLock) == -1) {
-      int error = errno;
-      Log("%s: Could not break lease on fd %d: %s\n",
-          __FUNCTION__, fileDesc, strerror(error));
+   if (actualLock != lease->serverLock || lease->state != HGFS_LEASE_GRANTED) {
+      if (fcntl(fileDesc, F_SETLEASE, newLock) == -1) {
+         Log("%s: Could not break lease on fd %d: %s\n",
+             __FUNCTION__, fileDesc, strerror(errno));
+         fcntl(fileDesc, F_SETLEASE, F_UNLCK);
+         actualLock = HGFS_LOCK_NONE;
+      }
    }
 
+   if (actualLock == HGFS_LOCK_NONE) {
+      HgfsLeaseRemove(lease);
+   } else {
+      lease->serverLock = actualLock;
+      lease->state = HGFS_LEASE_GRANTED;
+   }
+
+   MXUser_ReleaseExclLock(gHgfsLeases.lock);
+
    /* Cleanup. */
-   HgfsUpdateNodeServerLock(fileDesc, actualLock);
-   free(lockData);
+   HgfsUpdateNodeServerLock(fileDesc, lockData->session, actualLock);
 }
 
 
 /*
  *-----------------------------------------------------------------------------
  *
- * HgfsServerSigOplockBreak --
+ * HgfsAckOplockBreak --
  *
- *      Handle a pending oplock break. Called from the VMX poll loop context.
- *      All we really do is set up the state for an oplock break and call
- *      HgfsServerOplockBreak which will do the rest of the work.
+ *    Platform-dependent implementation of oplock break acknowledgement.
+ *    This function gets called when the client acknowledges an oplock break,
+ *    or when it voluntarily gives up or downgrades its oplock.
  *
  * Results:
- *      None.
+ *    None
  *
  * Side effects:
- *      None.
+ *    None
  *
  *-----------------------------------------------------------------------------
  */
 
-static void
-HgfsServerSigOplockBreak(int sigNum,       // IN: Signal number
-                         siginfo_t *info,  // IN: Additional info about signal
-                         ucontext_t *u,    // IN: Interrupted context (regs etc)
-                         void *clientData) // IN: Ignored
+void
+HgfsAckOplockBreak(ServerLockData *lockData, // IN: server lock info
+                   HgfsLockType replyLock)   // IN: client has this lock
 {
-   ServerLockData *lockData;
-   int newLease, fd;
-   HgfsLockType newServerLock;
-
-   ASSERT(sigNum == SIGIO);
-   ASSERT(info);
-   ASSERT(clientData == NULL);
-
-   fd = info->si_fd;
-   LOG(4, ("%s: Received SIGIO for fd %d\n", __FUNCTION__, fd));
-
-   /*
-    * We've got all we need from the signal handler, let it continue handling
-    * signals of this type.
-    */
-   Sig_Continue(sigNum);
-
-   /*
-    * According to locks.c in kernel source, doing F_GETLEASE when a lease
-    * break is pending will return the new lease we should use. It'll be
-    * F_RDLCK if we can downgrade, or F_UNLCK if we should break altogether.
-    */
-   newLease = fcntl(fd, F_GETLEASE);
-   if (newLease == F_RDLCK) {
-      newServerLock = HGFS_LOCK_SHARED;
-   } else if (newLease == F_UNLCK) {
-      newServerLock = HGFS_LOCK_NONE;
-   } else if (newLease == -1) {
-      int error = errno;
-      Log("%s: Could not get old lease for fd %d: %s\n", __FUNCTION__,
-          fd, strerror(error));
-      goto error;
-   } else {
-      Log("%s: Unexpected reply to get lease for fd %d: %d\n",
-          __FUNCTION__, fd, newLease);
-      goto error;
-   }
-
-   /*
-    * Setup a ServerLockData struct so that we can make use of
-    * HgfsServerOplockBreak which does the heavy lifting of discovering which
-    * HGFS handle we're interested in breaking, sending the break, receiving
-    * the acknowledgement, and firing the platform-specific acknowledgement
-    * function (where we'll downgrade the lease).
-    */
-   lockData = malloc(sizeof *lockData);
-   if (lockData) {
-      lockData->fileDesc = fd;
-      lockData->serverLock = newServerLock;
-      lockData->event = 0; // not needed
-
-      /*
-       * Relinquish control of this data. It'll get freed later, when the RPC
-       * command completes.
-       */
-      HgfsServerOplockBreak(lockData);
-      return;
-   } else {
-      Log("%s: Could not allocate memory for lease break on behalf of fd %d\n",
-          __FUNCTION__, fd);
-   }
-
-  error:
-   /* Clean up as best we can. */
-   fcntl(fd, F_SETLEASE, F_UNLCK);
-   HgfsUpdateNodeServerLock(fd, HGFS_LOCK_NONE);
+   HgfsLeaseAck(lockData, replyLock, 0);
 }
 #endif /* HGFS_OPLOCKS */
@@ -28,12 +28,62 @@
 #include "vmware.h"
 #include "hgfsServer.h"
 #include "hgfsServerInt.h"
+#include "mutexRankLib.h"
 #include "util.h"
 
 #define LOGLEVEL_MODULE hgfs
 #include "loglevel_user.h"
 
+/*
+ * Packet buffer pool.
+ *
+ * Buffers are kept in power of two size classes from 4KB to 256KB; larger
+ * ones always come from, and go back to, the heap. A pool holds on to at
+ * most HSPU_BUF_POOL_MAX_PER_CLASS buffers of a class and
+ * HSPU_BUF_POOL_MAX_CACHED bytes in total, anything beyond that is freed.
+ */
+#define HSPU_BUF_POOL_MIN_SHIFT        12
+#define HSPU_BUF_POOL_MAX_SHIFT        18
+#define HSPU_BUF_POOL_NUM_CLASSES      (HSPU_BUF_POOL_MAX_SHIFT - \
+                                        HSPU_BUF_POOL_MIN_SHIFT + 1)
+#define HSPU_BUF_POOL_NO_CLASS         HSPU_BUF_POOL_NUM_CLASSES
+#define HSPU_BUF_POOL_MAX_PER_CLASS    8
+#define HSPU_BUF_POOL_MAX_CACHED       (1024 * 1024)
+
+/*
+ * Every buffer handed out by HSPUBufAlloc is preceded by this header, so it
+ * can be returned to the right size class. The union keeps the buffer
+ * itself 16 byte aligned.
+ */
+typedef union HSPUBufHeader {
+   struct {
+      union HSPUBufHeader *next;    // Next free buffer of the class
+      uint32 sizeClass;             // HSPU_BUF_POOL_NO_CLASS if not pooled
+   } s;
+   uint64 align[2];
+} HSPUBufHeader;
+
+struct HgfsPacketBufPool {
+   MXUserExclLock *lock;
+   HSPUBufHeader *freeList[HSPU_BUF_POOL_NUM_CLASSES];
+   uint32 freeCount[HSPU_BUF_POOL_NUM_CLASSES];
+   size_t cachedBytes;
+};
+
+/* Buffer counters, see HgfsServerBufStats. */
+static Atomic_uint64 gHSPUBufAllocs;
+static Atomic_uint64 gHSPUBufReuses;
+static Atomic_uint64 gHSPUBufFrees;
+static Atomic_uint64 gHSPUBounces;
+static Atomic_uint64 gHSPUBounceBytes;
+static Atomic_uint64 gHSPUVectoredIos;
+
+static void *HSPUBufAlloc(HgfsPacketBufPool *pool,
+                          size_t size);
+static void HSPUBufFree(HgfsPacketBufPool *pool,
+                        void *buf);
 static void *HSPUGetBuf(HgfsServerChannelCallbacks *chanCb,
+                        HgfsPacketBufPool *pool,
                         MappingType mappingType,
                         HgfsVmxIov *iov,
                         uint32 iovCount,
@@ -44,6 +94,7 @@ static void *HSPUGetBuf(HgfsServerChannelCallbacks *chanCb,
                         Bool *isAllocated,
                         uint32 *iovMappedCount);
 static void HSPUPutBuf(HgfsServerChannelCallbacks *chanCb,
+                       HgfsPacketBufPool *pool,
                        MappingType mappingType,
                        HgfsVmxIov *iov,
                        uint32 iovCount,
@@ -75,6 +126,214 @@ static void HSPUUnmapBuf(HgfsChannelUnmapVirtAddrFunc unmapVa,
                          uint32 *mappedCount);
 
 
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * HSPU_CreateBufPool --
+ *
+ *    Create a packet buffer pool for a transport session.
+ *
+ * Results:
+ *    The pool.
+ *
+ * Side effects:
+ *    None.
+ *-----------------------------------------------------------------------------
+ */
+
+HgfsPacketBufPool *
+HSPU_CreateBufPool(void)
+{
+   HgfsPacketBufPool *pool = Util_SafeCalloc(1, sizeof *pool);
+
+   pool->lock = MXUser_CreateExclLock("HgfsPacketBufPoolLock",
+                                      RANK_hgfsPacketBufPoolLock);
+   return pool;
+}
+
+
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * HSPU_DestroyBufPool --
+ *
+ *    Free a packet buffer pool and the buffers it holds. Buffers still in
+ *    use may be put afterwards with a NULL pool.
+ *
+ * Results:
+ *    None.
+ *
+ * Side effects:
+ *    None.
+ *-----------------------------------------------------------------------------
+ */
+
+void
+HSPU_DestroyBufPool(HgfsPacketBufPool *pool)   // IN: pool
+{
+   uint32 i;
+
+   if (pool == NULL) {
+      return;
+   }
+
+   for (i = 0; i < ARRAYSIZE(pool->freeList); i++) {
+      while (pool->freeList[i] != NULL) {
+         HSPUBufHeader *hdr = pool->freeList[i];
+
+         pool->freeList[i] = hdr->s.next;
+         free(hdr);
+         Atomic_Inc64(&gHSPUBufFrees);
+      }
+   }
+
+   MXUser_DestroyExclLock(pool->lock);
+   free(pool);
+}
+
+
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * HSPU_GetBufStats --
+ *
+ *    Retrieve the packet buffer counters of all sessions, optionally
+ *    resetting them.
+ *
+ * Results:
+ *    None.
+ *
+ * Side effects:
+ *    None.
+ *-----------------------------------------------------------------------------
+ */
+
+void
+HSPU_GetBufStats(HgfsServerBufStats *stats,   // OUT/OPT: counters
+                 Bool reset)                  // IN: reset the counters?
+{
+   if (stats != NULL) {
+      stats->allocs = Atomic_Read64(&gHSPUBufAllocs);
+      stats->reuses = Atomic_Read64(&gHSPUBufReuses);
+      stats->frees = Atomic_Read64(&gHSPUBufFrees);
+      stats->bounces = Atomic_Read64(&gHSPUBounces);
+      stats->bounceBytes = Atomic_Read64(&gHSPUBounceBytes);
+      stats->vectoredIos = Atomic_Read64(&gHSPUVectoredIos);
+   }
+
+   if (reset) {
+      Atomic_Write64(&gHSPUBufAllocs, 0);
+      Atomic_Write64(&gHSPUBufReuses, 0);
+      Atomic_Write64(&gHSPUBufFrees, 0);
+      Atomic_Write64(&gHSPUBounces, 0);
+      Atomic_Write64(&gHSPUBounceBytes, 0);
+      Atomic_Write64(&gHSPUVectoredIos, 0);
+   }
+}
+
+
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * HSPUBufAlloc --
+ *
+ *    Get a buffer of at least size bytes, from the pool if it has one of
+ *    the right size class.
+ *
+ * Results:
+ *    The buffer, to be released with HSPUBufFree.
+ *
+ * Side effects:
+ *    None.
+ *-----------------------------------------------------------------------------
+ */
+
+static void *
+HSPUBufAlloc(HgfsPacketBufPool *pool,   // IN/OPT: pool
+             size_t size)               // IN: buffer size
+{
+   HSPUBufHeader *hdr = NULL;
+   uint32 sizeClass = 0;
+   size_t allocSize;
+
+   while (sizeClass < HSPU_BUF_POOL_NUM_CLASSES &&
+          size > ((size_t)1 << (HSPU_BUF_POOL_MIN_SHIFT + sizeClass))) {
+      sizeClass++;
+   }
+
+   if (sizeClass == HSPU_BUF_POOL_NO_CLASS) {
+      allocSize = size;
+   } else {
+      allocSize = (size_t)1 << (HSPU_BUF_POOL_MIN_SHIFT + sizeClass);
+
+      if (pool != NULL) {
+         MXUser_AcquireExclLock(pool->lock);
+         hdr = pool->freeList[sizeClass];
+         if (hdr != NULL) {
+            pool->freeList[sizeClass] = hdr->s.next;
+            pool->freeCount[sizeClass]--;
+            pool->cachedBytes -= allocSize;
+         }
+         MXUser_ReleaseExclLock(pool->lock);
+      }
+   }
+
+   if (hdr != NULL) {
+      Atomic_Inc64(&gHSPUBufReuses);
+   } else {
+      hdr = Util_SafeMalloc(sizeof *hdr + allocSize);
+      hdr->s.sizeClass = sizeClass;
+      Atomic_Inc64(&gHSPUBufAllocs);
+   }
+
+   return hdr + 1;
+}
+
+
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * HSPUBufFree --
+ *
+ *    Release a buffer from HSPUBufAlloc, keeping it in the pool unless the
+ *    pool holds enough already.
+ *
+ * Results:
+ *    None.
+ *
+ * Side effects:
+ *    None.
+ *-----------------------------------------------------------------------------
+ */
+
+static void
+HSPUBufFree(HgfsPacketBufPool *pool,   // IN/OPT: pool
+            void *buf)                 // IN: buffer
+{
+   HSPUBufHeader *hdr = (HSPUBufHeader *)buf - 1;
+   uint32 sizeClass = hdr->s.sizeClass;
+
+   if (pool != NULL && sizeClass != HSPU_BUF_POOL_NO_CLASS) {
+      size_t allocSize = (size_t)1 << (HSPU_BUF_POOL_MIN_SHIFT + sizeClass);
+
+      MXUser_AcquireExclLock(pool->lock);
+      if (pool->freeCount[sizeClass] < HSPU_BUF_POOL_MAX_PER_CLASS &&
+          pool->cachedBytes + allocSize <= HSPU_BUF_POOL_MAX_CACHED) {
+         hdr->s.next = pool->freeList[sizeClass];
+         pool->freeList[sizeClass] = hdr;
+         pool->freeCount[sizeClass]++;
+         pool->cachedBytes += allocSize;
+         hdr = NULL;
+      }
+      MXUser_ReleaseExclLock(pool->lock);
+   }
+
+   if (hdr != NULL) {
+      free(hdr);
+      Atomic_Inc64(&gHSPUBufFrees);
+   }
+}
+
 
 /*
  *-----------------------------------------------------------------------------
@@ -204,6 +463,7 @@ exit:
 void *
 HSPU_GetReplyPacket(HgfsPacket *packet,                  // IN/OUT: Hgfs Packet
                     HgfsServerChannelCallbacks *chanCb,  // IN: Channel callbacks
+                    HgfsPacketBufPool *pool,             // IN/OPT: Buffer pool
                     size_t replyDataSize,                // IN: Size of reply data
                     size_t *replyPacketSize)             // OUT: Size of reply Packet
 {
@@ -249,7 +509,7 @@ HSPU_GetReplyPacket(HgfsPacket *packet,                  // IN/OUT: Hgfs Packet
    } else {
       /* For sockets channel we always need to allocate buffer */
       LOG(10, ("%s Allocating reply packet\n", __FUNCTION__));
-      packet->replyPacket = Util_SafeMalloc(replyDataSize);
+      packet->replyPacket = HSPUBufAlloc(pool, replyDataSize);
       packet->replyPacketIsAllocated = TRUE;
       packet->replyPacketDataSize = replyDataSize;
       packet->replyPacketSize = replyDataSize;
@@ -265,7 +525,7 @@ HSPU_GetReplyPacket(HgfsPacket *packet,                  // IN/OUT: Hgfs Packet
  *
  * HSPU_PutReplyPacket --
  *
- *    Free buffer if reply packet was allocated.
+ *    Release buffer to the pool if reply packet was allocated.
  *
  * Results:
  *    None.
@@ -277,7 +537,8 @@ HSPU_GetReplyPacket(HgfsPacket *packet,                  // IN/OUT: Hgfs Packet
 
 void
 HSPU_PutReplyPacket(HgfsPacket *packet,                  // IN/OUT: Hgfs Packet
-                    HgfsServerChannelCallbacks *chanCb)  // IN: Channel callbacks
+                    HgfsServerChannelCallbacks *chanCb,  // IN: Channel callbacks
+                    HgfsPacketBufPool *pool)             // IN/OPT: Buffer pool
 {
    /*
     * If there wasn't an allocated buffer for the reply, there is nothing to
@@ -286,7 +547,7 @@ HSPU_PutReplyPacket(HgfsPacket *packet,                  // IN/OUT: Hgfs Packet
     */
    if (packet->replyPacketIsAllocated) {
       LOG(10, ("%s Freeing reply packet", __FUNCTION__));
-      free(packet->replyPacket);
+      HSPUBufFree(pool, packet->replyPacket);
       packet->replyPacketIsAllocated = FALSE;
       packet->replyPacket = NULL;
       packet->replyPacketSize = 0;
@@ -313,7 +574,8 @@ HSPU_PutReplyPacket(HgfsPacket *packet,                  // IN/OUT: Hgfs Packet
 void *
 HSPU_GetMetaPacket(HgfsPacket *packet,                   // IN/OUT: Hgfs Packet
                    size_t *metaPacketSize,               // OUT: Size of metaPacket
-                   HgfsServerChannelCallbacks *chanCb)   // IN: Channel callbacks
+                   HgfsServerChannelCallbacks *chanCb,   // IN: Channel callbacks
+                   HgfsPacketBufPool *pool)              // IN/OPT: Buffer pool
 {
    *metaPacketSize = packet->metaPacketDataSize;
    if (packet->metaPacket != NULL) {
@@ -327,6 +589,7 @@ HSPU_GetMetaPacket(HgfsPacket *packet,                   // IN/OUT: Hgfs Packet
    packet->metaMappingType = BUF_READWRITEABLE;
 
    return HSPUGetBuf(chanCb,
+                     pool,
                      packet->metaMappingType,
                      packet->iov,
                      packet->iovCount,
@@ -383,7 +646,8 @@ HSPU_ValidateDataPacketSize(HgfsPacket *packet,     // IN: Hgfs Packet
 void *
 HSPU_GetDataPacketBuf(HgfsPacket *packet,                   // IN/OUT: Hgfs Packet
                       MappingType mappingType,              // IN: Writeable/Readable
-                      HgfsServerChannelCallbacks *chanCb)   // IN: Channel callbacks
+                      HgfsServerChannelCallbacks *chanCb,   // IN: Channel callbacks
+                      HgfsPacketBufPool *pool)              // IN/OPT: Buffer pool
 {
    if (packet->dataPacket != NULL) {
       return packet->dataPacket;
@@ -395,6 +659,7 @@ HSPU_GetDataPacketBuf(HgfsPacket *packet,                   // IN/OUT: Hgfs Pack
 
    packet->dataMappingType = mappingType;
    return HSPUGetBuf(chanCb,
+                     pool,
                      packet->dataMappingType,
                      packet->iov,
                      packet->iovCount,
@@ -407,6 +672,83 @@ HSPU_GetDataPacketBuf(HgfsPacket *packet,                   // IN/OUT: Hgfs Pack
 }
 
 
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * HSPU_GetDataPacketIov --
+ *
+ *    Map the data packet of an hgfs packet and return the guest mappings
+ *    themselves, so the data can be transferred with vectored IO instead of
+ *    through the buffer HSPU_GetDataPacketBuf would allocate and copy when
+ *    the data spans several iovs.
+ *
+ * Results:
+ *    TRUE and the mapped iovs, which cover at least the data packet size.
+ *    FALSE if the data packet is contiguous or cannot be mapped; the caller
+ *    uses HSPU_GetDataPacketBuf then, which returns a contiguous data packet
+ *    without mapping it again.
+ *
+ * Side effects:
+ *    Guest mappings may be established, HSPU_PutDataPacketBuf releases them.
+ *-----------------------------------------------------------------------------
+ */
+
+Bool
+HSPU_GetDataPacketIov(HgfsPacket *packet,                   // IN/OUT: Hgfs Packet
+                      MappingType mappingType,              // IN: Writeable/Readable
+                      HgfsServerChannelCallbacks *chanCb,   // IN: Channel callbacks
+                      HgfsVmxIov **iov,                     // OUT: mapped iovs
+                      uint32 *iovCount)                     // OUT: mapped iov count
+{
+   HgfsChannelMapVirtAddrFunc mapVa;
+   uint32 startIndex = packet->dataPacketIovIndex;
+   uint32 iovMapped = 0;
+
+   if (packet->dataPacket != NULL || packet->dataPacketMappedIov != 0 ||
+       packet->dataPacketSize == 0 || chanCb == NULL) {
+      return FALSE;
+   }
+
+   if (mappingType == BUF_WRITEABLE ||
+       mappingType == BUF_READWRITEABLE) {
+      mapVa = chanCb->getWriteVa;
+   } else {
+      ASSERT(mappingType == BUF_READABLE);
+      mapVa = chanCb->getReadVa;
+   }
+
+   /* Looks like we are in the middle of poweroff. */
+   if (mapVa == NULL) {
+      return FALSE;
+   }
+
+   if (!HSPUMapBuf(mapVa,
+                   chanCb->putVa,
+                   packet->dataPacketSize,
+                   startIndex,
+                   packet->iovCount,
+                   packet->iov,
+                   &iovMapped)) {
+      return FALSE;
+   }
+
+   packet->dataMappingType = mappingType;
+   packet->dataPacketMappedIov = iovMapped;
+   packet->dataPacketIsAllocated = FALSE;
+
+   if (iovMapped == 1) {
+      /* A single page buffer is contiguous, no copy needed either way. */
+      packet->dataPacket = packet->iov[startIndex].va;
+      return FALSE;
+   }
+
+   Atomic_Inc64(&gHSPUVectoredIos);
+   *iov = &packet->iov[startIndex];
+   *iovCount = iovMapped;
+   return TRUE;
+}
+
+
 /*
  *-----------------------------------------------------------------------------
  *
@@ -425,6 +767,7 @@ HSPU_GetDataPacketBuf(HgfsPacket *packet,                   // IN/OUT: Hgfs Pack
 
 static void *
 HSPUGetBuf(HgfsServerChannelCallbacks *chanCb,  // IN: Channel callbacks
+           HgfsPacketBufPool *pool,             // IN/OPT: Buffer pool
            MappingType mappingType,             // IN: Access type Readable/Writeable
            HgfsVmxIov *iov,                     // IN: iov array
            uint32 iovCount,                     // IN: iov array size
@@ -483,12 +826,14 @@ HSPUGetBuf(HgfsServerChannelCallbacks *chanCb,  // IN: Channel callbacks
    ASSERT(iov[startIndex].len < bufSize);
 
    LOG(10, ("%s: Hgfs Allocating buffer \n", __FUNCTION__));
-   *buf = Util_SafeMalloc(bufSize);
+   *buf = HSPUBufAlloc(pool, bufSize);
    *isAllocated = TRUE;
 
    if ((mappingType == BUF_READABLE || mappingType == BUF_READWRITEABLE) &&
        (0 != dataSize)) {
       HSPUCopyIovecToBuf(iov, iovMapped, startIndex, *buf, dataSize);
+      Atomic_Inc64(&gHSPUBounces);
+      Atomic_Add64(&gHSPUBounceBytes, dataSize);
    }
    releaseMappings = TRUE;
 
@@ -521,7 +866,8 @@ exit:
 
 void
 HSPU_PutMetaPacket(HgfsPacket *packet,                   // IN/OUT: Hgfs Packet
-                   HgfsServerChannelCallbacks *chanCb)   // IN: Channel callbacks
+                   HgfsServerChannelCallbacks *chanCb,   // IN: Channel callbacks
+                   HgfsPacketBufPool *pool)              // IN/OPT: Buffer pool
 {
    if (packet->metaPacket == NULL) {
       return;
@@ -529,6 +875,7 @@ HSPU_PutMetaPacket(HgfsPacket *packet,                   // IN/OUT: Hgfs Packet
 
    LOG(4, ("%s Hgfs Putting Meta packet\n", __FUNCTION__));
    HSPUPutBuf(chanCb,
+              pool,
               packet->metaMappingType,
               packet->iov,
               packet->iovCount,
@@ -570,8 +917,9 @@ HSPU_SetDataPacketSize(HgfsPacket *packet,            // IN/OUT: Hgfs Packet
  *
  * HSPU_PutDataPacketBuf --
  *
- *    Free data packet buffer if allocated.
- *    Guest mappings will be released.
+ *    Release data packet buffer to the pool if allocated.
+ *    Guest mappings, including those from HSPU_GetDataPacketIov, will be
+ *    released.
  *
  * Results:
  *    void.
@@ -583,14 +931,16 @@ HSPU_SetDataPacketSize(HgfsPacket *packet,            // IN/OUT: Hgfs Packet
 
 void
 HSPU_PutDataPacketBuf(HgfsPacket *packet,                   // IN/OUT: Hgfs Packet
-                      HgfsServerChannelCallbacks *chanCb)   // IN: Channel callbacks
+                      HgfsServerChannelCallbacks *chanCb,   // IN: Channel callbacks
+                      HgfsPacketBufPool *pool)              // IN/OPT: Buffer pool
 {
-   if (packet->dataPacket == NULL) {
+   if (packet->dataPacket == NULL && packet->dataPacketMappedIov == 0) {
       return;
    }
 
    LOG(4, ("%s Hgfs Putting Data packet\n", __FUNCTION__));
    HSPUPutBuf(chanCb,
+              pool,
               packet->dataMappingType,
               packet->iov,
               packet->iovCount,
@@ -607,7 +957,7 @@ HSPU_PutDataPacketBuf(HgfsPacket *packet,                   // IN/OUT: Hgfs Pack
  *
  * HSPUPutBuf --
  *
- *    Free buffer if allocated and release guest mappings.
+ *    Release buffer to the pool if allocated and release guest mappings.
  *
  * Results:
  *    None.
@@ -619,6 +969,7 @@ HSPU_PutDataPacketBuf(HgfsPacket *packet,                   // IN/OUT: Hgfs Pack
 
 void
 HSPUPutBuf(HgfsServerChannelCallbacks *chanCb,  // IN: Channel callbacks
+           HgfsPacketBufPool *pool,             // IN/OPT: Buffer pool
            MappingType mappingType,             // IN: Access type Readable/Writeable
            HgfsVmxIov *iov,                     // IN: iov array
            uint32 iovCount,                     // IN: iov array size
@@ -653,6 +1004,8 @@ HSPUPutBuf(HgfsServerChannelCallbacks *chanCb,  // IN: Channel callbacks
          }
       }
       HSPUCopyBufToIovec(iov, *iovMappedCount, startIndex, *buf, bufSize);
+      Atomic_Inc64(&gHSPUBounces);
+      Atomic_Add64(&gHSPUBounceBytes, bufSize);
    }
 
    if (0 < *iovMappedCount) {
@@ -662,7 +1015,7 @@ HSPUPutBuf(HgfsServerChannelCallbacks *chanCb,  // IN: Channel callbacks
 exit:
    if (*isAllocated) {
       LOG(10, ("%s: Hgfs Freeing buffer \n", __FUNCTION__));
-      free(*buf);
+      HSPUBufFree(pool, *buf);
       *isAllocated = FALSE;
    }
 
@@ -350,6 +350,18 @@ HgfsPackChangeNotificationRequest(void *packet,                    // IN/OUT: Hg
                                   uint32 notifyFlags,              // IN: notify flags
                                   HgfsSessionInfo *session,        // IN: session
                                   size_t *bufferSize);             // IN/OUT: packet size
+Bool
+HgfsPackOplockBreakRequest(void *packet,                    // IN/OUT: Hgfs Packet
+                           HgfsHandle fileId,               // IN: file ID
+                           HgfsLockType serverLock,         // IN: lock type
+                           uint64 sessionId,                // IN: session ID
+                           size_t *bufferSize);             // IN/OUT: size of packet
+Bool
+HgfsUnpackOplockBreakAckReply(const void *packet,            // IN: HGFS packet
+                              size_t packetSize,             // IN: reply packet size
+                              HgfsOp op,                     // IN: operation version
+                              HgfsHandle *fileId,            // OUT: file Id to remove
+                              HgfsLockType *serverLock);     // OUT: lock type
 
 
 #endif // ifndef _HGFS_SERVER_PARAMETERS_H_
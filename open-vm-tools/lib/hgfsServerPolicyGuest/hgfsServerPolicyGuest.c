@@ -265,34 +265,24 @@ HgfsServerPolicyGetShare(HgfsServerPolicyState *state, // IN
 
    for (l = state->shares.next; l != &state->shares; l = l->next) {
       HgfsSharedFolder *share;
-      char *tempName;
+
+      share = DblLnkLst_Container(l, HgfsSharedFolder, links);
+      ASSERT(share);
 
       /*
-       * Null terminate the input name before a case insensitive comparison.
-       * This is just to protect against bad implementations of strnicmp.
+       * The lengths must match first. The share name has no embedded NULs,
+       * so the bounded compare never reads past the end of nameIn and the
+       * input does not need a NUL terminated copy.
        */
 
-      if (!(tempName = (char *)malloc(nameInLen + 1))) {
-         LOG(4, ("HgfsServerPolicyGetShare: couldn't allocate tempName\n"));
-         return NULL;
-      }
-
-      memcpy(tempName, nameIn, nameInLen);
-      tempName[nameInLen] = 0;
-
-      share = DblLnkLst_Container(l, HgfsSharedFolder, links);
-      ASSERT(share);
       if (nameInLen == share->nameLen &&
 #ifdef _WIN32
-          !strnicmp(tempName, share->name, nameInLen)) {
+          !strnicmp(nameIn, share->name, nameInLen)) {
 #else
-          !strncasecmp(tempName, share->name, nameInLen)) {
+          !strncasecmp(nameIn, share->name, nameInLen)) {
 #endif
-         free(tempName);
          return share;
       }
-
-      free(tempName);
    }
 
    return NULL;
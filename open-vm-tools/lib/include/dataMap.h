@@ -73,6 +73,7 @@ typedef enum {
 typedef struct {
    HashMap *map;
    uint64 cookie;   /* so we know the datamap is not some garbage data */
+   uint64 encodedSize;   /* serialized size of all entries */
 } DataMap;
 
 typedef struct {
@@ -91,6 +92,14 @@ ErrorCode
 DataMap_Copy(const DataMap *src,  // IN
              DataMap *dst);       // OUT
 ErrorCode
+DataMap_GetSerializedSize(const DataMap *that,   // IN
+                          uint32 *size);         // OUT
+ErrorCode
+DataMap_SerializeToBuffer(const DataMap *that,   // IN
+                          char *buf,             // OUT
+                          uint32 bufLen,         // IN
+                          uint32 *usedLen);      // OUT
+ErrorCode
 DataMap_Serialize(const DataMap *that,   //IN
                   char **buf,            // OUT
                   uint32 *bufLen);          // OUT
@@ -98,6 +107,10 @@ ErrorCode
 DataMap_Deserialize(const char *bufIn,     // IN
                     const int32 bufLen,    // IN
                     DataMap *that);        // OUT
+ErrorCode
+DataMap_DeserializeView(const char *bufIn,     // IN
+                        const int32 bufLen,    // IN
+                        DataMap *that);        // OUT
 
 ErrorCode
 DataMap_DeserializeContent(const char *bufIn,     // IN
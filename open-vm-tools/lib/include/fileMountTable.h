@@ -0,0 +1,70 @@
+/*********************************************************
+ * Copyright (C) 2016 VMware, Inc. All rights reserved.
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU Lesser General Public License as published
+ * by the Free Software Foundation version 2.1 and no later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+ * or FITNESS FOR A PARTICULAR PURPOSE.  See the Lesser GNU General Public
+ * License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin St, Fifth Floor, Boston, MA  02110-1301 USA.
+ *
+ *********************************************************/
+
+/*
+ * fileMountTable.h --
+ *
+ *      Process-wide cache of the parsed mount table.
+ *
+ *      FileMountTable_Get() returns a reference to an immutable snapshot of
+ *      the mount table.  The snapshot is reparsed only when the kernel
+ *      reports that the mount namespace has changed (POLLPRI on
+ *      /proc/self/mountinfo), or when a regular /etc/mtab has been rewritten,
+ *      so callers that scan the mount table on every poll interval no longer
+ *      pay for a full parse each time.
+ */
+
+#ifndef _FILEMOUNTTABLE_H_
+#define _FILEMOUNTTABLE_H_
+
+#define INCLUDE_ALLOW_USERLEVEL
+#include "includeCheck.h"
+
+#include "vm_basic_types.h"
+
+#if defined(__linux__) && !defined(__ANDROID__)
+
+typedef struct FileMountEntry {
+   char *fsName;      // Mounted device or source
+   char *mountPoint;  // Canonical mount point path
+   char *fsType;      // File system type
+   char *options;     // Comma separated mount options
+} FileMountEntry;
+
+typedef struct FileMountTable FileMountTable;
+
+FileMountTable *FileMountTable_Get(void);
+
+FileMountTable *FileMountTable_Load(const char *pathName);
+
+void FileMountTable_Release(FileMountTable *table);
+
+uint32 FileMountTable_GetGeneration(const FileMountTable *table);
+
+uint32 FileMountTable_GetCount(const FileMountTable *table);
+
+const FileMountEntry *FileMountTable_GetEntry(const FileMountTable *table,
+                                              uint32 index);
+
+const FileMountEntry *FileMountTable_Lookup(const FileMountTable *table,
+                                            const char *canPath,
+                                            size_t *prefixLen);
+
+#endif
+
+#endif // _FILEMOUNTTABLE_H_
@@ -130,6 +130,24 @@ HashTable_ForEach(const HashTable          *ht,           // IN:
                   HashTableForEachCallback  cb,           // IN:
                   void                     *clientData);  // IN:
 
+/*
+ * Chain length statistics, see HashTable_GetStats.
+ */
+
+typedef struct HashTableStats {
+   size_t   numElements;     // elements found in the table
+   uint32   numBuckets;      // current bucket array size
+   uint32   numUsedBuckets;  // non-empty chains
+   uint32   maxChainLength;  // longest chain
+   uint32   numResizes;      // times the bucket array has grown
+   uint64   totalProbes;     // comparisons to find every element once
+   Bool     resizing;        // an incremental resize is in progress
+} HashTableStats;
+
+void
+HashTable_GetStats(const HashTable *ht,      // IN:
+                   HashTableStats  *stats);  // OUT:
+
 /*
  * Specialize hash table that uses the callers data structure as its
  * hash entry as well, the hash key being an address that must be unique.
@@ -206,6 +206,51 @@ Bool HgfsServer_ShareAccessCheck(HgfsOpenMode accessMode,
 uint32 HgfsServer_GetHandleCounter(void);
 void HgfsServer_SetHandleCounter(uint32 newHandleCounter);
 
+/*
+ * Per-operation request statistics, collected once enabled with
+ * HgfsServer_EnableStats. The latency of a request is measured from when it
+ * has been parsed until its reply has been handed to the channel. Histogram
+ * bucket 0 counts requests that took less than 1us, bucket i the ones that
+ * took [2^(i-1), 2^i) us, and the last bucket everything slower.
+ */
+#define HGFS_SERVER_STATS_MAX_OPS      80
+#define HGFS_SERVER_STATS_BUCKETS      24
+
+typedef struct HgfsServerOpStats {
+   uint64 count;                 // Requests completed
+   uint64 errors;                // Requests completed with an error status
+   uint64 bytesIn;               // Request bytes, including headers
+   uint64 bytesOut;              // Reply payload bytes
+   uint64 totalUS;               // Sum of latencies
+   uint64 maxUS;                 // Slowest request
+   uint64 histogram[HGFS_SERVER_STATS_BUCKETS];
+} HgfsServerOpStats;
+
+/*
+ * Packet buffer counters, summed over all transport sessions. Buffers are
+ * allocated when a packet cannot be used in place, e.g. a reply on a
+ * channel without guest mappings, or data that spans several guest pages
+ * and cannot be transferred with vectored IO.
+ */
+typedef struct HgfsServerBufStats {
+   uint64 allocs;                // Buffers allocated from the heap
+   uint64 reuses;                // Buffers handed out again by a session pool
+   uint64 frees;                 // Buffers returned to the heap
+   uint64 bounces;               // Copies between a buffer and guest pages
+   uint64 bounceBytes;           // Bytes copied by those
+   uint64 vectoredIos;           // Data packets used in place as iovs
+} HgfsServerBufStats;
+
+typedef struct HgfsServerStats {
+   uint64 elapsedUS;             // Time since collection started or was reset
+   HgfsServerOpStats ops[HGFS_SERVER_STATS_MAX_OPS];  // Indexed by HgfsOp
+   HgfsServerBufStats buffers;
+} HgfsServerStats;
+
+void HgfsServer_EnableStats(Bool enable);
+Bool HgfsServer_GetStats(HgfsServerStats *stats,
+                         Bool reset);
+
 
 void HgfsServer_Quiesce(Bool freeze);
 
@@ -59,6 +59,9 @@
 #define RANK_hgfsFileIOLock          (RANK_libLockBase + 0x4050)
 #define RANK_hgfsSearchArrayLock     (RANK_libLockBase + 0x4060)
 #define RANK_hgfsNodeArrayLock       (RANK_libLockBase + 0x4070)
+#define RANK_hgfsOplockLock          (RANK_libLockBase + 0x4080)
+#define RANK_hgfsStatsLock           (RANK_libLockBase + 0x4090)
+#define RANK_hgfsPacketBufPoolLock   (RANK_libLockBase + 0x40a0)
 
 /*
  * vigor (must be < VMDB range and < disklib, see bug 741290)
@@ -142,6 +142,12 @@ Bool ProcMgr_ExecSync(char const *cmd,       // UTF-8
                       ProcMgr_ProcArgs *userArgs);
 ProcMgr_AsyncProc *ProcMgr_ExecAsync(char const *cmd,     // UTF-8
                                      ProcMgr_ProcArgs *userArgs);
+#if !defined(_WIN32)
+Bool ProcMgr_ExecSyncArgv(char * const *argv,               // UTF-8
+                          ProcMgr_ProcArgs *userArgs);
+ProcMgr_AsyncProc *ProcMgr_ExecAsyncArgv(char * const *argv,  // UTF-8
+                                         ProcMgr_ProcArgs *userArgs);
+#endif
 void ProcMgr_Kill(ProcMgr_AsyncProc *asyncProc);
 Selectable ProcMgr_GetAsyncProcSelectable(ProcMgr_AsyncProc *asyncProc);
 ProcMgr_Pid ProcMgr_GetPid(ProcMgr_AsyncProc *asyncProc);
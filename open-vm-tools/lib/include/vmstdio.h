@@ -40,5 +40,25 @@ StdIO_ReadNextLine(FILE *stream,         // IN
                    size_t maxBufLength,  // IN
                    size_t *count);       // OUT
 
+/*
+ * Buffered line reader for callers that consume a whole stream line by
+ * line. The reader reads ahead, so the stream must not be used directly
+ * until the reader has been destroyed.
+ */
+
+typedef struct StdIO_LineReader StdIO_LineReader;
+
+StdIO_LineReader *
+StdIO_LineReaderCreate(FILE *stream,         // IN
+                       size_t maxLineLength); // IN
+
+void
+StdIO_LineReaderDestroy(StdIO_LineReader *reader); // IN
+
+StdIO_Status
+StdIO_LineReaderNext(StdIO_LineReader *reader, // IN
+                     char **line,              // OUT
+                     size_t *count);           // OUT
+
 
 #endif /* __VMSTDIO_H__ */
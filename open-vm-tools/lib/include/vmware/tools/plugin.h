@@ -135,6 +135,22 @@ ToolsCore_LogState(guint level,
  */
 #define TOOLS_CORE_SIG_CONF_RELOAD "tcs_conf_reload"
 
+/**
+ * Signal sent when the config file is reloaded and its contents changed,
+ * right before TOOLS_CORE_SIG_CONF_RELOAD. Plugins that only care about
+ * a few config keys can connect to this signal instead, and skip the
+ * work when none of their keys changed.
+ *
+ * @param[in]  src      The source object.
+ * @param[in]  ctx      ToolsAppCtx *: The application context.
+ * @param[in]  changes  GHashTable *: maps the name of each group that was
+ *                      added, removed or modified to a NULL-terminated
+ *                      list (const gchar * const *) of its keys that were
+ *                      added, removed or given a different value.
+ * @param[in]  data     Client data.
+ */
+#define TOOLS_CORE_SIG_CONF_CHANGED "tcs_conf_changed"
+
 /**
  * Signal sent when the service receives a request to dump its internal
  * state to the log. This is for debugging purposes, and plugins can
@@ -568,6 +584,26 @@ typedef struct ToolsPluginData {
  */
 typedef ToolsPluginData *(*ToolsPluginOnLoad)(ToolsAppCtx *ctx);
 
+/**
+ * Signature for the optional deferred initialization function. Plugins that
+ * need to do expensive setup which is not required for registering their
+ * features may export a function called @a ToolsOnLoadDeferred, and move
+ * that work there from @a ToolsOnLoad, so it does not delay the service
+ * from answering RPCs.
+ *
+ * The function is only called for plugins whose @a ToolsOnLoad returned
+ * registration data. It is called from the service's main loop, on the main
+ * thread, once the service is running and all plugins have been registered.
+ * Plugins are initialized one at a time, in the same order they were
+ * loaded, at idle priority. If the service shuts down before a plugin's
+ * turn comes, the function is not called.
+ *
+ * @param[in]  ctx      The application context.
+ * @param[in]  plugin   The plugin's registration data.
+ */
+typedef void (*ToolsPluginOnLoadDeferred)(ToolsAppCtx *ctx,
+                                          ToolsPluginData *plugin);
+
 /** @} */
 
 #endif /* _VMWARE_TOOLS_PLUGIN_H_ */
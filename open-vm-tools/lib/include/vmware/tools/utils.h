@@ -139,6 +139,10 @@ VMTools_ConfigGetString(GKeyFile *config,
                         const gchar *key,
                         gchar *defValue);
 
+GHashTable *
+VMTools_ConfigDiff(GKeyFile *oldConfig,
+                   GKeyFile *newConfig);
+
 #if defined(G_PLATFORM_WIN32)
 
 gboolean
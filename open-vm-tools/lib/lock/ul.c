@@ -28,6 +28,10 @@
 static Bool mxInPanic = FALSE;  // track when involved in a panic
 static Bool mxUserCollectLockingTree = FALSE;
 
+#if !defined(_WIN32)
+int MXUserSpinLimit = -1;
+#endif
+
 Bool (*MXUserTryAcquireForceFail)() = NULL;
 
 static MX_Rank (*MXUserMxCheckRank)(void) = NULL;
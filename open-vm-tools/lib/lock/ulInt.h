@@ -37,11 +37,13 @@ typedef DWORD MXUserThreadID;
 #else
 #include "safetime.h"
 #include <pthread.h>
+#include <unistd.h>
 typedef pthread_t MXUserThreadID;
 #endif
 
 #include "vm_basic_types.h"
 #include "vm_atomic.h"
+#include "vm_basic_asm.h"
 #include "vthreadBase.h"
 #include "hostinfo.h"
 
@@ -65,8 +67,23 @@ typedef struct {
 
    int              referenceCount;   // Acquisition count
    MXUserThreadID   nativeThreadID;   // Native thread ID
+#if !defined(_WIN32)
+   int              spinEstimate;     // Recent spins needed to acquire
+#endif
 } MXRecLock;
 
+#if !defined(_WIN32)
+/*
+ * Contended acquisitions spin for at most this many PAUSEs before sleeping
+ * in the kernel; the same budget the Windows CRITICAL_SECTION is given. The
+ * actual spin is adapted per lock (see MXRecLockAcquireInternal).
+ */
+
+#define MXUSER_MAX_SPIN_COUNT 0x400
+
+extern int MXUserSpinLimit;  // < 0 until probed, 0 on uniprocessors
+#endif
+
 
 /*
  * Environment specific implementations of portable recursive locks.
@@ -174,6 +191,18 @@ MXRecLockReleaseInternal(MXRecLock *lock)  // IN:
 static INLINE int
 MXRecLockCreateInternal(MXRecLock *lock)  // IN/OUT:
 {
+   /*
+    * Spinning cannot help when the owner needs our CPU to make progress.
+    * Races here are benign; every thread computes the same value.
+    */
+
+   if (UNLIKELY(MXUserSpinLimit < 0)) {
+      MXUserSpinLimit = (sysconf(_SC_NPROCESSORS_ONLN) > 1) ?
+                        MXUSER_MAX_SPIN_COUNT : 0;
+   }
+
+   lock->spinEstimate = 0;
+
    return pthread_mutex_init(&lock->nativeLock, NULL);
 }
 
@@ -239,10 +268,56 @@ MXRecLockSetOwner(MXRecLock *lock)  // IN:
 }
 
 
+/*
+ * Most MXUser locks guard short critical sections. When such a lock is
+ * contended it is usually released within a few hundred cycles, so a short
+ * spin is far cheaper than a futex sleep and wake-up. The spin is bounded
+ * by an estimate of how long this particular lock has recently taken to
+ * become free: spinning that succeeds raises the estimate, spinning that
+ * fails decays it, so locks held for long periods quickly stop spinning.
+ * The estimate is only updated while the lock is held.
+ */
+
 static INLINE int
 MXRecLockAcquireInternal(MXRecLock *lock)  // IN:
 {
-   return pthread_mutex_lock(&lock->nativeLock);
+   int err = pthread_mutex_trylock(&lock->nativeLock);
+
+   if (LIKELY(err != EBUSY)) {
+      return err;  // Uncontended (or a real error)
+   }
+
+   if (MXUserSpinLimit > 0) {
+      int limit = MIN(MXUserSpinLimit, 2 * lock->spinEstimate + 16);
+      int delay = 1;
+      int spins = 0;
+
+      do {
+         int i;
+
+         /* Back off exponentially to limit traffic on the lock's line. */
+         for (i = 0; i < delay; i++) {
+            PAUSE();
+         }
+
+         spins += delay;
+         delay = MIN(2 * delay, 64);
+
+         if (pthread_mutex_trylock(&lock->nativeLock) == 0) {
+            lock->spinEstimate += (spins - lock->spinEstimate) / 8;
+
+            return 0;
+         }
+      } while (spins < limit);
+   }
+
+   err = pthread_mutex_lock(&lock->nativeLock);
+
+   if (LIKELY(err == 0)) {
+      lock->spinEstimate -= lock->spinEstimate / 8;
+   }
+
+   return err;
 }
 
 
@@ -39,7 +39,39 @@
 #include "vm_atomic.h"
 
 
-#define HASH_ROTATE     5
+/*
+ * Resizing policy.
+ *
+ * A table doubles its bucket count once the average chain length exceeds
+ * HASH_MAX_LOAD.
+ *
+ * In a non-atomic table entries are not moved all at once; instead each
+ * mutating operation migrates HASH_REHASH_STEP buckets from the old array,
+ * so the cost of a resize is amortized over subsequent inserts and
+ * deletes.
+ *
+ * Lock-free readers of an atomic table may be walking any chain at any
+ * time, so its entries are never relinked.  Instead all entries live on a
+ * single list sorted by bit-reversed hash (a "split-ordered" list), and
+ * each bucket points at a marker entry on that list.  Doubling the bucket
+ * count only splits every bucket's run of entries in two, so growing is a
+ * single compare-and-swap of the bucket count; the marker of a new bucket
+ * is inserted by the first operation that needs it.  The bucket array is
+ * kept in segments of doubling size that are allocated on demand and
+ * never move.
+ */
+
+#define HASH_MAX_LOAD      2
+#define HASH_REHASH_STEP   4
+#define HASH_MAX_BITS      30
+#define HASH_MAX_SEGMENTS  (HASH_MAX_BITS + 1)
+
+/*
+ * FNV-1a parameters, used for string keys.
+ */
+
+#define HASH_FNV_BASIS     2166136261U
+#define HASH_FNV_PRIME     16777619U
 
 
 /*
@@ -65,16 +97,35 @@ typedef Atomic_Ptr HashTableLink;
 
 /*
  * An entry in the hashtable.
+ *
+ * The full hash is cached so that chains can be scanned without
+ * comparing keys of other hash values and so that a resize does not
+ * need to rehash the keys.
+ *
+ * In atomic tables, bucket markers are entries too; their hash is the
+ * bucket index and they have no key or data.
  */
 
 typedef struct HashTableEntry {
    HashTableLink     next;
    const void       *keyStr;
    Atomic_Ptr        clientData;
+   uint32            hash;
+   Bool              isBucket;
 } HashTableEntry;
 
 /*
  * The hashtable structure.
+ *
+ * While a resize is in progress, oldBuckets holds the previous bucket
+ * array.  Old buckets below rehashIdx have been migrated and are empty;
+ * the others still hold their entries.
+ *
+ * Atomic tables never use oldBuckets.  Their buckets are segments[],
+ * the first of which (also 'buckets') has the initial numEntries
+ * buckets; numEntries and numBits keep their initial values and the
+ * current bucket count and number of elements are atomicNumEntries and
+ * atomicNumElements.
  */
 
 struct HashTable {
@@ -87,6 +138,15 @@ struct HashTable {
    HashTableLink         *buckets;
 
    size_t                 numElements;
+
+   HashTableLink         *oldBuckets;
+   uint32                 oldNumEntries;
+   uint32                 rehashIdx;
+   uint32                 numResizes;
+
+   Atomic_uint32          atomicNumEntries;
+   Atomic_uint32          atomicNumElements;
+   Atomic_Ptr            *segments;
 };
 
 
@@ -99,12 +159,43 @@ HashTableEntry *HashTableLookupOrInsert(HashTable *ht,
                                         void *clientData);
 
 
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * HashTableMix --
+ *
+ *      Final avalanche step (from MurmurHash3's fmix32), so that every bit
+ *      of the input affects the low order bits used to select a bucket.
+ *
+ * Results:
+ *      The mixed value.
+ *
+ * Side effects:
+ *      None.
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+static INLINE uint32
+HashTableMix(uint32 h)  // IN:
+{
+   h ^= h >> 16;
+   h *= 0x85ebca6b;
+   h ^= h >> 13;
+   h *= 0xc2b2ae35;
+   h ^= h >> 16;
+
+   return h;
+}
+
+
 /*
  *-----------------------------------------------------------------------------
  *
  * HashTableComputeHash --
  *
- *      Compute hash value based on key type and hash size.
+ *      Compute the full 32-bit hash value of a key based on the key type.
+ *      Use HashTableBucketIndex to reduce it to a bucket index.
  *
  * Results:
  *      The hash value.
@@ -119,26 +210,26 @@ static uint32
 HashTableComputeHash(const HashTable *ht,  // IN: hash table
                      const void *s)        // IN: string to hash
 {
-   uint32 h = 0;
+   uint32 h = HASH_FNV_BASIS;
 
    switch (ht->keyType) {
    case HASH_STRING_KEY: {
          int c;
-         unsigned char *keyPtr = (unsigned char *) s;
+         const unsigned char *keyPtr = (const unsigned char *) s;
 
          while ((c = *keyPtr++)) {
             h ^= c;
-            h = h << HASH_ROTATE | h >> (32 - HASH_ROTATE);
+            h *= HASH_FNV_PRIME;
          }
       }
       break;
    case HASH_ISTRING_KEY: {
          int c;
-         unsigned char *keyPtr = (unsigned char *) s;
+         const unsigned char *keyPtr = (const unsigned char *) s;
 
          while ((c = tolower(*keyPtr++))) {
             h ^= c;
-            h = h << HASH_ROTATE | h >> (32 - HASH_ROTATE);
+            h *= HASH_FNV_PRIME;
          }
       }
       break;
@@ -150,23 +241,178 @@ HashTableComputeHash(const HashTable *ht,  // IN: hash table
       } else {
          h = (uint32) (uintptr_t) s ^ (uint32) ((uint64) (uintptr_t) s >> 32);
       }
-      h *= 48271;  // http://www.google.com/search?q=48271+pseudorandom
       break;
    default:
       NOT_REACHED();
    }
 
-   {
-      int numBits = ht->numBits;
-      uint32 mask = MASK(numBits);
+   return HashTableMix(h);
+}
+
+
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * HashTableBucket --
+ *
+ *      Find the chain that holds (or would hold) an entry with the given
+ *      hash value.  While a resize is in progress this is the old bucket
+ *      if that has not been migrated yet, otherwise the new one.
+ *
+ * Results:
+ *      Pointer to the head link of the chain.
+ *
+ * Side effects:
+ *      None.
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+static INLINE HashTableLink *
+HashTableBucket(const HashTable *ht,  // IN:
+                uint32 hash)          // IN:
+{
+   if (UNLIKELY(ht->oldBuckets != NULL)) {
+      uint32 oldIdx = hash & (ht->oldNumEntries - 1);
 
-      for (; h > mask; h = (h & mask) ^ (h >> numBits)) {
+      if (oldIdx >= ht->rehashIdx) {
+         return &ht->oldBuckets[oldIdx];
       }
    }
 
-   ASSERT(h < ht->numEntries);
+   return &ht->buckets[hash & (ht->numEntries - 1)];
+}
 
-   return h;
+
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * HashTableRehashStep --
+ *
+ *      Move the entries of up to 'count' old buckets into the new bucket
+ *      array.  When the last old bucket has been migrated, the old array
+ *      is freed and the resize is complete.
+ *
+ * Results:
+ *      None.
+ *
+ * Side effects:
+ *      Entries are relinked.
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+static void
+HashTableRehashStep(HashTable *ht,  // IN/OUT:
+                    uint32 count)   // IN: number of old buckets
+{
+   ASSERT(!ht->atomic);
+
+   while (ht->oldBuckets != NULL && count-- > 0) {
+      HashTableLink *oldLink = &ht->oldBuckets[ht->rehashIdx];
+      HashTableEntry *entry;
+
+      while ((entry = ENTRY(*oldLink)) != NULL) {
+         HashTableLink *newLink =
+            &ht->buckets[entry->hash & (ht->numEntries - 1)];
+
+         SETENTRY(*oldLink, ENTRY(entry->next));
+         SETENTRY(entry->next, ENTRY(*newLink));
+         SETENTRY(*newLink, entry);
+      }
+
+      if (++ht->rehashIdx == ht->oldNumEntries) {
+         free(ht->oldBuckets);
+         ht->oldBuckets = NULL;
+         ht->oldNumEntries = 0;
+         ht->rehashIdx = 0;
+      }
+   }
+}
+
+
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * HashTableMaybeResize --
+ *
+ *      Called before each mutating operation on a non-atomic table.
+ *      Continues a resize in progress, or starts a new one if the load
+ *      factor has grown past HASH_MAX_LOAD.
+ *
+ * Results:
+ *      None.
+ *
+ * Side effects:
+ *      May allocate a new bucket array and migrate entries.
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+static void
+HashTableMaybeResize(HashTable *ht)  // IN/OUT:
+{
+   ASSERT(!ht->atomic);
+
+   if (ht->oldBuckets == NULL) {
+      if (ht->numElements <= (size_t) ht->numEntries * HASH_MAX_LOAD ||
+          ht->numBits >= HASH_MAX_BITS) {
+         return;
+      }
+
+      ht->oldBuckets = ht->buckets;
+      ht->oldNumEntries = ht->numEntries;
+      ht->rehashIdx = 0;
+      ht->numBits++;
+      ht->numEntries <<= 1;
+      ht->buckets = Util_SafeCalloc(ht->numEntries, sizeof *ht->buckets);
+      ht->numResizes++;
+   }
+
+   HashTableRehashStep(ht, HASH_REHASH_STEP);
+}
+
+
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * HashTableNumChains --
+ * HashTableChain --
+ *
+ *      Walk every chain of the table, including the old bucket array of
+ *      a resize in progress.  Chains are numbered 0 .. HashTableNumChains()
+ *      - 1; old buckets that have already been migrated are simply empty.
+ *      An atomic table has a single chain, its split-ordered list, on
+ *      which the bucket markers have to be skipped.
+ *
+ * Results:
+ *      The number of chains / the head link of the i-th chain.
+ *
+ * Side effects:
+ *      None.
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+static INLINE uint32
+HashTableNumChains(const HashTable *ht)  // IN:
+{
+   return ht->atomic ? 1 : ht->numEntries + ht->oldNumEntries;
+}
+
+static INLINE HashTableLink *
+HashTableChain(const HashTable *ht,  // IN:
+               uint32 i)             // IN:
+{
+   ASSERT(i < HashTableNumChains(ht));
+
+   if (ht->atomic) {
+      /* The list starts with the marker of bucket 0. */
+      return &ENTRY(ht->buckets[0])->next;
+   }
+
+   return i < ht->numEntries ? &ht->buckets[i]
+                             : &ht->oldBuckets[i - ht->numEntries];
 }
 
 
@@ -204,6 +450,381 @@ HashTableEqualKeys(const HashTable *ht,  // IN: hash table
 }
 
 
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * HashTableNewEntry --
+ * HashTableFreeNewEntry --
+ *
+ *      Allocate an entry to be inserted / free one that ended up not
+ *      being inserted.
+ *
+ * Results:
+ *      The new entry / none.
+ *
+ * Side effects:
+ *      None.
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+static HashTableEntry *
+HashTableNewEntry(const HashTable *ht,  // IN:
+                  const void *keyStr,   // IN:
+                  uint32 hash,          // IN:
+                  void *clientData)     // IN/OPT:
+{
+   HashTableEntry *entry = Util_SafeMalloc(sizeof *entry);
+
+   if (ht->copyKey) {
+      entry->keyStr = Util_SafeStrdup(keyStr);
+   } else {
+      entry->keyStr = keyStr;
+   }
+   Atomic_WritePtr(&entry->clientData, clientData);
+   entry->hash = hash;
+   entry->isBucket = FALSE;
+
+   return entry;
+}
+
+static void
+HashTableFreeNewEntry(const HashTable *ht,    // IN:
+                      HashTableEntry *entry)  // IN/OPT:
+{
+   if (entry != NULL) {
+      if (ht->copyKey) {
+         free((void *) entry->keyStr);
+      }
+      free(entry);
+   }
+}
+
+
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * HashTableSortKey --
+ *
+ *      Position of an entry on the split-ordered list of an atomic table:
+ *      the bit-reversed hash, so that the entries of a bucket, and of the
+ *      two buckets it splits into, are contiguous.  A bucket marker sorts
+ *      right before the entries of its bucket.
+ *
+ * Results:
+ *      The sort key.
+ *
+ * Side effects:
+ *      None.
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+static INLINE uint64
+HashTableSortKey(uint32 hash,     // IN: hash or bucket index
+                 Bool isBucket)   // IN:
+{
+   uint32 r = hash;
+
+   r = ((r >> 1) & 0x55555555) | ((r & 0x55555555) << 1);
+   r = ((r >> 2) & 0x33333333) | ((r & 0x33333333) << 2);
+   r = ((r >> 4) & 0x0f0f0f0f) | ((r & 0x0f0f0f0f) << 4);
+   r = ((r >> 8) & 0x00ff00ff) | ((r & 0x00ff00ff) << 8);
+   r = (r >> 16) | (r << 16);
+
+   return ((uint64) r << 1) | (isBucket ? 0 : 1);
+}
+
+
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * HashTableAtomicSegment --
+ *
+ *      Find the segment of an atomic table that holds a bucket.  Segment 0
+ *      has the initial buckets, segment n > 0 the buckets added by the
+ *      n-th doubling.
+ *
+ * Results:
+ *      The segment index; the bucket's index in it in *offset.
+ *
+ * Side effects:
+ *      None.
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+static INLINE uint32
+HashTableAtomicSegment(const HashTable *ht,  // IN:
+                       uint32 bucket,        // IN:
+                       uint32 *offset)       // OUT:
+{
+   int high;
+
+   if (bucket < ht->numEntries) {
+      *offset = bucket;
+      return 0;
+   }
+
+   high = mssb32_0(bucket);
+   *offset = bucket - (1U << high);
+
+   return high - ht->numBits + 1;
+}
+
+
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * HashTableAtomicParent --
+ *
+ *      The bucket an atomic table's bucket was split from.
+ *
+ * Results:
+ *      The parent bucket.
+ *
+ * Side effects:
+ *      None.
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+static INLINE uint32
+HashTableAtomicParent(uint32 bucket)  // IN: not 0
+{
+   ASSERT(bucket != 0);
+
+   return bucket & ~(1U << mssb32_0(bucket));
+}
+
+
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * HashTableAtomicFind --
+ *
+ *      Walk the split-ordered list of an atomic table from 'start' to the
+ *      entry with the given key (or bucket marker, if isBucket).
+ *
+ * Results:
+ *      The entry if found.  Otherwise NULL; if linkp is not NULL, the link
+ *      the entry would be inserted at is returned in *linkp and the entry
+ *      that link currently points to in *nextp.
+ *
+ * Side effects:
+ *      None.
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+static HashTableEntry *
+HashTableAtomicFind(const HashTable *ht,      // IN:
+                    HashTableEntry *start,    // IN: marker at or before key
+                    const void *keyStr,       // IN: unused if isBucket
+                    uint32 hash,              // IN: hash or bucket index
+                    Bool isBucket,            // IN:
+                    HashTableLink **linkp,    // OUT/OPT:
+                    HashTableEntry **nextp)   // OUT/OPT:
+{
+   uint64 sortKey = HashTableSortKey(hash, isBucket);
+   HashTableLink *link;
+   HashTableEntry *entry;
+
+   for (link = &start->next; (entry = ENTRY(*link)) != NULL;
+        link = &entry->next) {
+      uint64 entryKey = HashTableSortKey(entry->hash, entry->isBucket);
+
+      if (entryKey > sortKey) {
+         break;
+      }
+      if (entryKey == sortKey &&
+          (isBucket || HashTableEqualKeys(ht, entry->keyStr, keyStr))) {
+         return entry;
+      }
+   }
+
+   if (linkp != NULL) {
+      *linkp = link;
+      *nextp = entry;
+   }
+
+   return NULL;
+}
+
+
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * HashTableAtomicBucket --
+ *
+ *      Find where to start looking for an entry with the given hash in an
+ *      atomic table: the marker of its bucket or, if that has not been
+ *      inserted yet, of the closest bucket it was split from.
+ *
+ * Results:
+ *      A bucket marker.
+ *
+ * Side effects:
+ *      None.
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+static HashTableEntry *
+HashTableAtomicBucket(const HashTable *ht,  // IN:
+                      uint32 hash)          // IN:
+{
+   uint32 bucket = hash & (Atomic_Read32(&ht->atomicNumEntries) - 1);
+
+   while (TRUE) {
+      uint32 offset;
+      uint32 seg = HashTableAtomicSegment(ht, bucket, &offset);
+      HashTableLink *links = Atomic_ReadPtr(&ht->segments[seg]);
+
+      if (links != NULL && ENTRY(links[offset]) != NULL) {
+         return ENTRY(links[offset]);
+      }
+      bucket = HashTableAtomicParent(bucket);
+   }
+}
+
+
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * HashTableAtomicInitBucket --
+ *
+ *      Get the marker of a bucket of an atomic table, inserting it (and
+ *      those of the buckets it was split from) if needed.
+ *
+ * Results:
+ *      The bucket marker.
+ *
+ * Side effects:
+ *      May allocate a segment and insert bucket markers.
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+static HashTableEntry *
+HashTableAtomicInitBucket(HashTable *ht,   // IN/OUT:
+                          uint32 bucket)   // IN:
+{
+   uint32 offset;
+   uint32 seg = HashTableAtomicSegment(ht, bucket, &offset);
+   HashTableLink *links = Atomic_ReadPtr(&ht->segments[seg]);
+   HashTableEntry *parent;
+   HashTableEntry *marker;
+   HashTableEntry *next;
+   HashTableLink *link;
+
+   if (links == NULL) {
+      /* Segment 0 is allocated along with the table. */
+      HashTableLink *newLinks =
+         Util_SafeCalloc(1U << (ht->numBits + seg - 1), sizeof *newLinks);
+
+      ASSERT(seg != 0);
+      if (!SETENTRYATOMIC(ht->segments[seg], NULL, newLinks)) {
+         free(newLinks);
+      }
+      links = Atomic_ReadPtr(&ht->segments[seg]);
+   }
+
+   marker = ENTRY(links[offset]);
+   if (marker != NULL) {
+      return marker;
+   }
+
+   parent = HashTableAtomicInitBucket(ht, HashTableAtomicParent(bucket));
+
+   marker = Util_SafeCalloc(1, sizeof *marker);
+   marker->hash = bucket;
+   marker->isBucket = TRUE;
+
+   while (TRUE) {
+      HashTableEntry *found = HashTableAtomicFind(ht, parent, NULL, bucket,
+                                                  TRUE, &link, &next);
+
+      if (found != NULL) {
+         /* Another thread got there first. */
+         free(marker);
+         marker = found;
+         break;
+      }
+
+      SETENTRY(marker->next, next);
+      if (SETENTRYATOMIC(*link, next, marker)) {
+         break;
+      }
+   }
+
+   /* Whoever loses this race stores the same marker. */
+   (void) SETENTRYATOMIC(links[offset], NULL, marker);
+
+   return marker;
+}
+
+
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * HashTableAtomicLookupOrInsert --
+ *
+ *      HashTableLookupOrInsert for atomic tables.  Other threads may be
+ *      inserting concurrently.
+ *
+ * Results:
+ *      Old HashTableEntry or NULL.
+ *
+ * Side effects:
+ *      May double the bucket count.
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+static HashTableEntry *
+HashTableAtomicLookupOrInsert(HashTable *ht,        // IN/OUT:
+                              const void *keyStr,   // IN:
+                              uint32 hash,          // IN:
+                              void *clientData)     // IN/OPT:
+{
+   uint32 numEntries = Atomic_Read32(&ht->atomicNumEntries);
+   HashTableEntry *start = HashTableAtomicInitBucket(ht,
+                                                     hash & (numEntries - 1));
+   HashTableEntry *entry = NULL;
+   HashTableEntry *oldEntry;
+   HashTableEntry *next;
+   HashTableLink *link;
+
+   while ((oldEntry = HashTableAtomicFind(ht, start, keyStr, hash, FALSE,
+                                          &link, &next)) == NULL) {
+      if (entry == NULL) {
+         entry = HashTableNewEntry(ht, keyStr, hash, clientData);
+      }
+      SETENTRY(entry->next, next);
+      if (SETENTRYATOMIC(*link, next, entry)) {
+         break;
+      }
+   }
+
+   if (oldEntry != NULL) {
+      HashTableFreeNewEntry(ht, entry);
+
+      return oldEntry;
+   }
+
+   if (Atomic_ReadInc32(&ht->atomicNumElements) + 1 >
+          numEntries * HASH_MAX_LOAD &&
+       numEntries < (1U << HASH_MAX_BITS)) {
+      /* If this fails, another thread has already grown the table. */
+      Atomic_ReadIfEqualWrite32(&ht->atomicNumEntries, numEntries,
+                                numEntries << 1);
+   }
+
+   return NULL;
+}
+
+
 /*
  *----------------------------------------------------------------------
  *
@@ -211,6 +832,9 @@ HashTableEqualKeys(const HashTable *ht,  // IN: hash table
  *
  *      Create a hash table.
  *
+ *      numEntries is the initial number of buckets.  Tables grow as
+ *      needed, so it only needs to fit the typical case.
+ *
  * Results:
  *      The new hashtable.
  *
@@ -221,7 +845,7 @@ HashTableEqualKeys(const HashTable *ht,  // IN: hash table
  */
 
 HashTable *
-HashTable_Alloc(uint32 numEntries,        // IN: must be a power of 2
+HashTable_Alloc(uint32 numEntries,        // IN: initial size, power of 2
                 int keyType,              // IN: whether keys are strings
                 HashTableFreeEntryFn fn)  // IN: free entry function
 {
@@ -248,12 +872,26 @@ HashTable_Alloc(uint32 numEntries,        // IN: must be a power of 2
    ht->freeEntryFn = fn;
    ht->buckets = Util_SafeCalloc(ht->numEntries, sizeof *ht->buckets);
    ht->numElements = 0;
+   ht->oldBuckets = NULL;
+   ht->oldNumEntries = 0;
+   ht->rehashIdx = 0;
+   ht->numResizes = 0;
+   ht->segments = NULL;
 
-#ifndef NO_ATOMIC_HASHTABLE
    if (ht->atomic) {
+      HashTableEntry *marker = Util_SafeCalloc(1, sizeof *marker);
+
+#ifndef NO_ATOMIC_HASHTABLE
       Atomic_Init();
-   }
 #endif
+      marker->isBucket = TRUE;
+      SETENTRY(ht->buckets[0], marker);
+      ht->segments = Util_SafeCalloc(HASH_MAX_SEGMENTS,
+                                     sizeof *ht->segments);
+      Atomic_WritePtr(&ht->segments[0], ht->buckets);
+      Atomic_Write32(&ht->atomicNumEntries, ht->numEntries);
+      Atomic_Write32(&ht->atomicNumElements, 0);
+   }
 
    return ht;
 }
@@ -323,15 +961,20 @@ HashTable_AllocOnce(Atomic_Ptr *var,          // IN/OUT: the atomic var
 static void
 HashTableClearInternal(HashTable *ht)  // IN/OUT:
 {
-   int i;
+   uint32 i;
 
    ht->numElements = 0;
 
-   for (i = 0; i < ht->numEntries; i++) {
+   for (i = 0; i < HashTableNumChains(ht); i++) {
+      HashTableLink *link = HashTableChain(ht, i);
       HashTableEntry *entry;
 
-      while ((entry = ENTRY(ht->buckets[i])) != NULL) {
-         SETENTRY(ht->buckets[i], ENTRY(entry->next));
+      while ((entry = ENTRY(*link)) != NULL) {
+         SETENTRY(*link, ENTRY(entry->next));
+         if (entry->isBucket) {
+            free(entry);
+            continue;
+         }
          if (ht->copyKey) {
             free((void *) entry->keyStr);
          }
@@ -341,6 +984,11 @@ HashTableClearInternal(HashTable *ht)  // IN/OUT:
          free(entry);
       }
    }
+
+   free(ht->oldBuckets);
+   ht->oldBuckets = NULL;
+   ht->oldNumEntries = 0;
+   ht->rehashIdx = 0;
 }
 
 
@@ -409,6 +1057,16 @@ HashTable_FreeUnsafe(HashTable *ht)  // IN/OUT:
    if (ht != NULL) {
       HashTableClearInternal(ht);
 
+      if (ht->atomic) {
+         uint32 i;
+
+         free(ENTRY(ht->buckets[0]));
+         for (i = 1; i < HASH_MAX_SEGMENTS; i++) {
+            free(Atomic_ReadPtr(&ht->segments[i]));
+         }
+         free(ht->segments);
+      }
+
       free(ht->buckets);
       free(ht);
    }
@@ -438,10 +1096,16 @@ HashTableLookup(const HashTable *ht,  // IN:
 {
    HashTableEntry *entry;
 
-   for (entry = ENTRY(ht->buckets[hash]);
+   if (ht->atomic) {
+      return HashTableAtomicFind(ht, HashTableAtomicBucket(ht, hash), keyStr,
+                                 hash, FALSE, NULL, NULL);
+   }
+
+   for (entry = ENTRY(*HashTableBucket(ht, hash));
         entry != NULL;
         entry = ENTRY(entry->next)) {
-      if (HashTableEqualKeys(ht, entry->keyStr, keyStr)) {
+      if (entry->hash == hash &&
+          HashTableEqualKeys(ht, entry->keyStr, keyStr)) {
          return entry;
       }
    }
@@ -544,10 +1208,13 @@ HashTable_LookupAndDelete(HashTable *ht,       // IN/OUT: the hash table
 
    ASSERT(!ht->atomic);
 
-   for (linkp = &ht->buckets[hash];
+   HashTableMaybeResize(ht);
+
+   for (linkp = HashTableBucket(ht, hash);
         (entry = ENTRY(*linkp)) != NULL;
         linkp = &entry->next) {
-      if (HashTableEqualKeys(ht, entry->keyStr, keyStr)) {
+      if (entry->hash == hash &&
+          HashTableEqualKeys(ht, entry->keyStr, keyStr)) {
          SETENTRY(*linkp, ENTRY(entry->next));
          ht->numElements--;
          if (ht->copyKey) {
@@ -759,42 +1426,24 @@ HashTableLookupOrInsert(HashTable *ht,       // IN/OUT:
                         void *clientData)    // IN/OPT:
 {
    uint32 hash = HashTableComputeHash(ht, keyStr);
-   HashTableEntry *entry = NULL;
-   HashTableEntry *oldEntry = NULL;
-   HashTableEntry *head;
+   HashTableEntry *entry;
+   HashTableLink *bucket;
 
-again:
-   head = ENTRY(ht->buckets[hash]);
+   if (ht->atomic) {
+      return HashTableAtomicLookupOrInsert(ht, keyStr, hash, clientData);
+   }
 
-   oldEntry = HashTableLookup(ht, keyStr, hash);
-   if (oldEntry != NULL) {
-      if (entry != NULL) {
-         if (ht->copyKey) {
-            free((void *) entry->keyStr);
-         }
-         free(entry);
-      }
+   HashTableMaybeResize(ht);
 
-      return oldEntry;
+   entry = HashTableLookup(ht, keyStr, hash);
+   if (entry != NULL) {
+      return entry;
    }
 
-   if (entry == NULL) {
-      entry = Util_SafeMalloc(sizeof *entry);
-      if (ht->copyKey) {
-         entry->keyStr = Util_SafeStrdup(keyStr);
-      } else {
-         entry->keyStr = keyStr;
-      }
-      Atomic_WritePtr(&entry->clientData, clientData);
-   }
-   SETENTRY(entry->next, head);
-   if (ht->atomic) {
-      if (!SETENTRYATOMIC(ht->buckets[hash], head, entry)) {
-         goto again;
-      }
-   } else {
-      SETENTRY(ht->buckets[hash], entry);
-   }
+   entry = HashTableNewEntry(ht, keyStr, hash, clientData);
+   bucket = HashTableBucket(ht, hash);
+   SETENTRY(entry->next, ENTRY(*bucket));
+   SETENTRY(*bucket, entry);
 
    ht->numElements++;
 
@@ -875,10 +1524,10 @@ HashTable_KeyArray(const HashTable *ht,  // IN:
    *keys = Util_SafeMalloc(*size * sizeof **keys);
 
    /* fill array */
-   for (i = 0, j = 0; i < ht->numEntries; i++) {
+   for (i = 0, j = 0; i < HashTableNumChains(ht); i++) {
       HashTableEntry *entry;
 
-      for (entry = ENTRY(ht->buckets[i]);
+      for (entry = ENTRY(*HashTableChain(ht, i));
            entry != NULL;
            entry = ENTRY(entry->next)) {
          (*keys)[j++] = entry->keyStr;
@@ -931,10 +1580,10 @@ HashTable_ToArray(const HashTable *ht,  // IN:
    *clientDatas = Util_SafeMalloc(*size * sizeof **clientDatas);
 
    /* fill array */
-   for (i = 0, j = 0; i < ht->numEntries; i++) {
+   for (i = 0, j = 0; i < HashTableNumChains(ht); i++) {
       HashTableEntry *entry;
 
-      for (entry = ENTRY(ht->buckets[i]);
+      for (entry = ENTRY(*HashTableChain(ht, i));
            entry != NULL;
            entry = ENTRY(entry->next)) {
          (*clientDatas)[j++] = Atomic_ReadPtr(&entry->clientData);
@@ -967,20 +1616,25 @@ HashTable_ForEach(const HashTable *ht,          // IN:
                   HashTableForEachCallback cb,  // IN:
                   void *clientData)             // IN:
 {
-   int i;
+   uint32 i;
 
    ASSERT(ht);
    ASSERT(cb);
 
-   for (i = 0; i < ht->numEntries; i++) {
+   for (i = 0; i < HashTableNumChains(ht); i++) {
       HashTableEntry *entry;
 
-      for (entry = ENTRY(ht->buckets[i]);
+      for (entry = ENTRY(*HashTableChain(ht, i));
            entry != NULL;
            entry = ENTRY(entry->next)) {
-         int result = (*cb)(entry->keyStr, Atomic_ReadPtr(&entry->clientData),
-                            clientData);
+         int result;
 
+         if (entry->isBucket) {
+            continue;
+         }
+
+         result = (*cb)(entry->keyStr, Atomic_ReadPtr(&entry->clientData),
+                        clientData);
          if (result) {
             return result;
          }
@@ -990,6 +1644,77 @@ HashTable_ForEach(const HashTable *ht,          // IN:
    return 0;
 }
 
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * HashTable_GetStats --
+ *
+ *      Compute chain length statistics of the hash table.  The walk is
+ *      O(n), so this is meant for diagnostics and tuning, not for hot
+ *      paths.  It is safe to call on an atomic hash table while other
+ *      threads insert; the result is then a snapshot.
+ *
+ *      totalProbes is the number of key comparisons needed to look up
+ *      every element once; dividing it by numElements gives the mean
+ *      probe length of a successful lookup.  An unsuccessful lookup
+ *      walks a whole chain, so its mean probe length is numElements
+ *      divided by numBuckets.  The chains of an atomic table are the runs
+ *      of entries between two bucket markers.
+ *
+ * Results:
+ *      The statistics in *stats.
+ *
+ * Side effects:
+ *      None.
+ *
+ *----------------------------------------------------------------------
+ */
+
+void
+HashTable_GetStats(const HashTable *ht,    // IN:
+                   HashTableStats *stats)  // OUT:
+{
+   uint32 i;
+
+   ASSERT(ht);
+   ASSERT(stats);
+
+   memset(stats, 0, sizeof *stats);
+
+   if (ht->atomic) {
+      stats->numBuckets = Atomic_Read32(&ht->atomicNumEntries);
+      stats->numResizes = lssb32_0(stats->numBuckets) - ht->numBits;
+   } else {
+      stats->numBuckets = ht->numEntries;
+      stats->numResizes = ht->numResizes;
+      stats->resizing = ht->oldBuckets != NULL;
+   }
+
+   for (i = 0; i < HashTableNumChains(ht); i++) {
+      HashTableEntry *entry = ENTRY(*HashTableChain(ht, i));
+      uint32 chainLength = 0;
+
+      while (TRUE) {
+         if (entry != NULL && !entry->isBucket) {
+            chainLength++;
+            stats->totalProbes += chainLength;
+         } else if (chainLength != 0) {
+            stats->numUsedBuckets++;
+            stats->numElements += chainLength;
+            stats->maxChainLength = MAX(stats->maxChainLength, chainLength);
+            chainLength = 0;
+         }
+
+         if (entry == NULL) {
+            break;
+         }
+         entry = ENTRY(entry->next);
+      }
+   }
+}
+
+
 #if 0
 /*
  *----------------------------------------------------------------------
@@ -1011,21 +1736,21 @@ HashTable_ForEach(const HashTable *ht,          // IN:
 void
 HashPrint(HashTable *ht) // IN
 {
-   int i;
+   uint32 i;
 
-   for (i = 0; i < ht->numEntries; i++) {
-      HashTableEntry *entry;
+   for (i = 0; i < HashTableNumChains(ht); i++) {
+      HashTableEntry *entry = ENTRY(*HashTableChain(ht, i));
 
-      if (ht->buckets[i] == NULL) {
+      if (entry == NULL) {
          continue;
       }
 
       printf("%4d: \n", i);
 
-      for (entry = ENTRY(ht->buckets[i]);
-           entry != NULL;
-           entry = ENTRY(entry->next)) {
-         if (ht->keyType == HASH_INT_KEY) {
+      for (; entry != NULL; entry = ENTRY(entry->next)) {
+         if (entry->isBucket) {
+            printf("   [%u]\n", entry->hash);
+         } else if (ht->keyType == HASH_INT_KEY) {
             printf("\t%p\n", entry->keyStr);
          } else {
             printf("\t%s\n", entry->keyStr);
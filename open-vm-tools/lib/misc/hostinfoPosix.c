@@ -1219,6 +1219,7 @@ Hostinfo_CPUCounts(uint32 *logical,  // OUT
    return TRUE;
 #elif defined __linux__
    FILE *f;
+   StdIO_LineReader *reader;
    char *line;
    unsigned count = 0, coresPerProc = 0, siblingsPerProc = 0;
 
@@ -1227,7 +1228,13 @@ Hostinfo_CPUCounts(uint32 *logical,  // OUT
       return FALSE;
    }
 
-   while (StdIO_ReadNextLine(f, &line, 0, NULL) == StdIO_Success) {
+   reader = StdIO_LineReaderCreate(f, 0);
+   if (reader == NULL) {
+      fclose(f);
+      return FALSE;
+   }
+
+   while (StdIO_LineReaderNext(reader, &line, NULL) == StdIO_Success) {
       if (strncmp(line, "processor", strlen("processor")) == 0) {
          count++;
       }
@@ -1238,9 +1245,9 @@ Hostinfo_CPUCounts(uint32 *logical,  // OUT
       if (siblingsPerProc == 0) {
          sscanf(line, "siblings : %u", &siblingsPerProc);
       }
-      free(line);
    }
 
+   StdIO_LineReaderDestroy(reader);
    fclose(f);
 
    *logical = count;
@@ -1344,6 +1351,7 @@ Hostinfo_NumCPUs(void)
 
    if (count <= 0) {
       FILE *f;
+      StdIO_LineReader *reader;
       char *line;
 
 #if defined(VMX86_SERVER)
@@ -1364,13 +1372,19 @@ Hostinfo_NumCPUs(void)
 	 return -1;
       }
 
-      while (StdIO_ReadNextLine(f, &line, 0, NULL) == StdIO_Success) {
+      reader = StdIO_LineReaderCreate(f, 0);
+      if (reader == NULL) {
+	 fclose(f);
+	 return -1;
+      }
+
+      while (StdIO_LineReaderNext(reader, &line, NULL) == StdIO_Success) {
 	 if (strncmp(line, "processor", strlen("processor")) == 0) {
 	    count++;
 	 }
-	 free(line);
       }
 
+      StdIO_LineReaderDestroy(reader);
       fclose(f);
 
       if (count == 0) {
@@ -2459,6 +2473,7 @@ HostinfoGetCpuInfo(int nCpu,    // IN:
                    char *name)  // IN:
 {
    FILE *f;
+   StdIO_LineReader *reader;
    char *line;
    int cpu = 0;
    char *value = NULL;
@@ -2471,8 +2486,15 @@ HostinfoGetCpuInfo(int nCpu,    // IN:
       return NULL;
    }
 
+   reader = StdIO_LineReaderCreate(f, 0);
+   if (reader == NULL) {
+      fclose(f);
+
+      return NULL;
+   }
+
    while (cpu <= nCpu &&
-          StdIO_ReadNextLine(f, &line, 0, NULL) == StdIO_Success) {
+          StdIO_LineReaderNext(reader, &line, NULL) == StdIO_Success) {
       char *s;
       char *e;
 
@@ -2493,9 +2515,9 @@ HostinfoGetCpuInfo(int nCpu,    // IN:
 
          cpu++;
       }
-      free(line);
    }
 
+   StdIO_LineReaderDestroy(reader);
    fclose(f);
 
    return value;
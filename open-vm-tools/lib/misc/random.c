@@ -34,6 +34,9 @@
 #   include <errno.h>
 #   include <fcntl.h>
 #   include <unistd.h>
+#   if defined(__linux__)
+#      include <sys/syscall.h>
+#   endif
 
 #   define GENERIC_RANDOM_DEVICE "/dev/urandom"
 #endif
@@ -44,6 +47,18 @@
 #include "random.h"
 #include "util.h"
 
+#if defined(__linux__) && defined(SYS_getrandom)
+#   define RANDOM_HAS_GETRANDOM
+
+/* From <linux/random.h>; fail rather than block before the pool is ready. */
+#   ifndef GRND_NONBLOCK
+#      define GRND_NONBLOCK 0x0001
+#   endif
+
+/* Set once the kernel has been found to lack getrandom(2). */
+static Bool gRandomGetrandomUnavailable = FALSE;
+#endif
+
 
 #if defined(_WIN32)
 /*
@@ -154,6 +169,60 @@ RandomBytesPosix(const char *name,  // IN:
 
    return TRUE;
 }
+
+
+#if defined(RANDOM_HAS_GETRANDOM)
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * RandomBytesGetrandom --
+ *
+ *      Generate 'size' bytes of cryptographically strong random bits in
+ *      'buffer' using getrandom(2). The bytes come from the same kernel
+ *      source as /dev/urandom, but there is no device to open and close.
+ *
+ * Results:
+ *      TRUE   success
+ *      FALSE  getrandom(2) is not usable right now; the caller should fall
+ *             back to the random device. This happens on kernels older
+ *             than 3.17, in sandboxes that filter the call, and early in
+ *             boot before the kernel pool is initialized, where
+ *             /dev/urandom keeps its old non-blocking behaviour.
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+static Bool
+RandomBytesGetrandom(size_t size,   // IN:
+                     void *buffer)  // OUT:
+{
+   if (gRandomGetrandomUnavailable) {
+      return FALSE;
+   }
+
+   /* Requests over 256 bytes can return short reads; just loop. */
+   while (size > 0) {
+      long bytesRead = syscall(SYS_getrandom, buffer, size, GRND_NONBLOCK);
+
+      if (bytesRead == -1) {
+         if (errno == EINTR) {
+            continue;
+         }
+
+         if (errno == ENOSYS || errno == EPERM) {
+            gRandomGetrandomUnavailable = TRUE;
+         }
+
+         return FALSE;
+      }
+
+      size -= bytesRead;
+      buffer = ((uint8 *) buffer) + bytesRead;
+   }
+
+   return TRUE;
+}
+#endif
 #endif
 
 
@@ -190,8 +259,16 @@ Random_Crypto(size_t size,   // IN:
    /*
     * We use /dev/urandom and not /dev/random because it is good enough and
     * because it cannot block. --hpreg
+    *
+    * getrandom(2) reads the same pool in a single system call.
     */
 
+#if defined(RANDOM_HAS_GETRANDOM)
+   if (RandomBytesGetrandom(size, buffer)) {
+      return TRUE;
+   }
+#endif
+
    return RandomBytesPosix(GENERIC_RANDOM_DEVICE, size, buffer);
 #endif
 }
@@ -345,6 +422,7 @@ typedef struct {
    uint64 simple;
    uint64 fast;
    uint64 quick;
+   uint64 crypto;
 } RandomSpeedTestResults;
 void Random_SpeedTest(uint64 iters, RandomSpeedTestResults *out);
 
@@ -392,6 +470,14 @@ Random_SpeedTest(uint64 iters,                 // IN:
    }
    out->quick = RDTSC() - start;
 
+   start = RDTSC();
+   for (i = 0; i < iters; i++) {
+      uint32 crypto;
+
+      Random_Crypto(sizeof crypto, &crypto);
+   }
+   out->crypto = RDTSC() - start;
+
    free(rq);
 }
 #endif
@@ -24,6 +24,7 @@
 
 
 #include <stdio.h>
+#include <stdlib.h>
 #include <errno.h>
 #include <string.h>
 
@@ -32,6 +33,42 @@
 #include "vmstdio.h"
 
 
+/*
+ * SuperFgets() reads one byte at a time. Take the stream lock once per
+ * call rather than once per byte where the platform allows it.
+ */
+
+#ifdef _WIN32
+#define StdIOLockStream(stream)
+#define StdIOUnlockStream(stream)
+#define StdIOGetc(stream) getc(stream)
+#else
+#define StdIOLockStream(stream) flockfile(stream)
+#define StdIOUnlockStream(stream) funlockfile(stream)
+#define StdIOGetc(stream) getc_unlocked(stream)
+#endif
+
+/*
+ * Initial size of the line reader buffer; it grows to fit longer lines.
+ * tests/stdioLineReaderTest builds with a tiny one to hit the refill cases.
+ */
+#ifndef STDIO_LINE_READER_BUF_SIZE
+#define STDIO_LINE_READER_BUF_SIZE (64 * 1024)
+#endif
+
+struct StdIO_LineReader {
+   FILE *stream;
+   char *buf;
+   size_t bufSize;        // Allocated size of buf
+   size_t start;          // Offset of the next unread byte
+   size_t end;            // Offset past the last byte read from the stream
+   size_t scanned;        // Bytes past start known to hold no terminator
+   size_t maxLineLength;  // 0 for no limit
+   Bool eof;
+   Bool skipLF;           // Previous line ended with '\r' at the buffer end
+};
+
+
 /*
  *-----------------------------------------------------------------------------
  *
@@ -84,14 +121,17 @@ SuperFgets(FILE *stream,   // IN:
 
    errno = 0;
 
+   StdIOLockStream(stream);
+
    for (size = 0; size < *count; size++) {
       int c;
 
-      c = getc(stream);
+      c = StdIOGetc(stream);
 
       if (c == EOF) {
          if (errno) {
             /* getc returned an error. */
+            StdIOUnlockStream(stream);
             return NULL;
          } else {
             /* Found an end-of-file line terminator. */
@@ -114,11 +154,12 @@ SuperFgets(FILE *stream,   // IN:
           * look-ahead.
           */
 
-         c = getc(stream);
+         c = StdIOGetc(stream);
          if (c != EOF && c != '\n') {
             /* Found a legacy Mac line terminator */
 
             if (ungetc(c, stream) == EOF) {
+               StdIOUnlockStream(stream);
                return NULL;
             }
          }
@@ -133,6 +174,8 @@ SuperFgets(FILE *stream,   // IN:
       buf[size] = c;
    }
 
+   StdIOUnlockStream(stream);
+
    *count = size;
 
    return buf;
@@ -269,3 +312,276 @@ error:
 
    return StdIO_Error;
 }
+
+
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * StdIO_LineReaderCreate --
+ *
+ *      Create a line reader over a stream.
+ *
+ *      The reader fills a large buffer with fread() and finds line
+ *      terminators with memchr(), so reading a large file (/proc/cpuinfo on
+ *      a big host, a long config file) does not cost a function call per
+ *      byte. Lines are split exactly as StdIO_ReadNextLine splits them.
+ *
+ *      If maxLineLength is non-zero, lines longer than maxLineLength bytes
+ *      are reported as an error.
+ *
+ * Results:
+ *      The new reader, or NULL (errno is set to ENOMEM) on failure.
+ *
+ * Side effects:
+ *      The reader reads ahead of the lines it has returned. The caller
+ *      must not use the stream until the reader has been destroyed.
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+StdIO_LineReader *
+StdIO_LineReaderCreate(FILE *stream,          // IN:
+                       size_t maxLineLength)  // IN:
+{
+   StdIO_LineReader *reader;
+
+   ASSERT(stream);
+
+   reader = calloc(1, sizeof *reader);
+   if (reader == NULL) {
+      errno = ENOMEM;
+
+      return NULL;
+   }
+
+   reader->bufSize = STDIO_LINE_READER_BUF_SIZE;
+   if (maxLineLength != 0 && maxLineLength + 2 < reader->bufSize) {
+      reader->bufSize = maxLineLength + 2;
+   }
+
+   reader->buf = malloc(reader->bufSize);
+   if (reader->buf == NULL) {
+      free(reader);
+      errno = ENOMEM;
+
+      return NULL;
+   }
+
+   reader->stream = stream;
+   reader->maxLineLength = maxLineLength;
+
+   return reader;
+}
+
+
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * StdIO_LineReaderDestroy --
+ *
+ *      Destroy a line reader. The stream is not closed.
+ *
+ * Results:
+ *      None
+ *
+ * Side effects:
+ *      Lines returned by the reader are no longer valid.
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+void
+StdIO_LineReaderDestroy(StdIO_LineReader *reader)  // IN:
+{
+   if (reader != NULL) {
+      free(reader->buf);
+      free(reader);
+   }
+}
+
+
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * StdIOLineReaderFill --
+ *
+ *      Move the unread bytes to the start of the buffer, growing it if the
+ *      current line already fills it, and read more of the stream.
+ *
+ * Results:
+ *      TRUE on success, including end-of-stream (reader->eof is set).
+ *      FALSE on failure: errno is set accordingly.
+ *
+ * Side effects:
+ *      Invalidates the line returned by the previous call.
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+static Bool
+StdIOLineReaderFill(StdIO_LineReader *reader)  // IN/OUT:
+{
+   size_t nr;
+
+   if (reader->start != 0) {
+      memmove(reader->buf, reader->buf + reader->start,
+              reader->end - reader->start);
+      reader->end -= reader->start;
+      reader->start = 0;
+   }
+
+   /* Always keep a byte free for the NUL terminator. */
+   if (reader->end + 1 >= reader->bufSize) {
+      size_t newSize = reader->bufSize * 2;
+      char *newBuf;
+
+      if (reader->maxLineLength != 0 && reader->end > reader->maxLineLength) {
+         errno = E2BIG;
+
+         return FALSE;
+      }
+
+      newBuf = realloc(reader->buf, newSize);
+      if (newBuf == NULL) {
+         errno = ENOMEM;
+
+         return FALSE;
+      }
+      reader->buf = newBuf;
+      reader->bufSize = newSize;
+   }
+
+   errno = 0;
+   nr = fread(reader->buf + reader->end, 1,
+              reader->bufSize - 1 - reader->end, reader->stream);
+   if (nr == 0) {
+      if (ferror(reader->stream)) {
+         if (errno == 0) {
+            errno = EIO;
+         }
+
+         return FALSE;
+      }
+      reader->eof = TRUE;
+   }
+   reader->end += nr;
+
+   return TRUE;
+}
+
+
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * StdIO_LineReaderNext --
+ *
+ *      Return the next line of the stream. The line terminators are the
+ *      same as for StdIO_ReadNextLine: \r\n, \n, \r and end-of-stream.
+ *
+ * Results:
+ *      StdIO_Success on success: '*line' points to the NUL terminated line
+ *                                (excluding the line terminator) inside the
+ *                                reader's buffer. The caller may modify it
+ *                                but must not free it; it is valid until the
+ *                                next call. If not NULL, '*count' contains
+ *                                the length of the line.
+ *      StdIO_EOF if there is no next line (end of stream)
+ *      StdIO_Error on failure: errno is set accordingly
+ *
+ * Side effects:
+ *      Reads from the stream.
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+StdIO_Status
+StdIO_LineReaderNext(StdIO_LineReader *reader,  // IN:
+                     char **line,               // OUT:
+                     size_t *count)             // OUT:
+{
+   ASSERT(reader);
+   ASSERT(line);
+
+   for (;;) {
+      char *p = reader->buf + reader->start;
+      char *scan = p + reader->scanned;
+      size_t avail = reader->end - reader->start - reader->scanned;
+      char *term;
+      char *next;
+
+      if (reader->skipLF) {
+         /* The previous line ended with '\r'; swallow a following '\n'. */
+         if (avail == 0 && !reader->eof) {
+            if (!StdIOLineReaderFill(reader)) {
+               return StdIO_Error;
+            }
+            continue;
+         }
+         reader->skipLF = FALSE;
+         if (avail != 0 && *p == '\n') {
+            reader->start++;
+            continue;
+         }
+      }
+
+      term = memchr(scan, '\n', avail);
+      next = memchr(scan, '\r', term == NULL ? avail : term - scan);
+      if (next != NULL) {
+         term = next;
+      }
+
+      if (term == NULL) {
+         if (!reader->eof) {
+            reader->scanned = reader->end - reader->start;
+            if (!StdIOLineReaderFill(reader)) {
+               return StdIO_Error;
+            }
+            continue;
+         }
+
+         /* End-of-stream terminates the last line, if there is one. */
+         if (reader->start == reader->end) {
+            return StdIO_EOF;
+         }
+         term = reader->buf + reader->end;
+         next = term;
+      } else {
+         next = term + 1;
+
+#ifndef _WIN32
+         if (*term == '\r') {
+            /*
+             * A \r\n pair is one terminator. As with SuperFgets, this is
+             * skipped on Windows where text mode already folded the pair.
+             */
+
+            if (next < reader->buf + reader->end) {
+               if (*next == '\n') {
+                  next++;
+               }
+            } else {
+               reader->skipLF = TRUE;
+            }
+         }
+#endif
+      }
+
+      if (reader->maxLineLength != 0 &&
+          (size_t) (term - p) > reader->maxLineLength) {
+         errno = E2BIG;
+
+         return StdIO_Error;
+      }
+
+      *term = '\0';
+      *line = p;
+      if (count) {
+         *count = term - p;
+      }
+
+      reader->start = next - reader->buf;
+      reader->scanned = 0;
+
+      return StdIO_Success;
+   }
+}
@@ -87,6 +87,50 @@
 #include <vmkusercompat.h>
 #endif
 
+/*
+ * On Linux, processes are started with posix_spawn(3). glibc implements it
+ * with clone(CLONE_VM | CLONE_VFORK), so the cost of starting a program does
+ * not grow with the size of the caller the way fork() does. Changing to the
+ * working directory needs glibc 2.29 and closing the inherited descriptors
+ * needs glibc 2.34 (which uses close_range(2)); without them we fork.
+ */
+#if defined(linux) && !defined(USERWORLD) && defined(__GLIBC__)
+#   include <spawn.h>
+#   define PROCMGR_USE_SPAWN
+#   if __GLIBC__ > 2 || (__GLIBC__ == 2 && __GLIBC_MINOR__ >= 29)
+#      define PROCMGR_SPAWN_CHDIR
+#   endif
+#   if __GLIBC__ > 2 || (__GLIBC__ == 2 && __GLIBC_MINOR__ >= 34)
+#      define PROCMGR_SPAWN_CLOSEFROM
+#   endif
+#endif
+
+/*
+ * close_range(2) (Linux 5.9) and pidfd_open(2) (Linux 5.3) have the same
+ * syscall numbers on all architectures that use the generic syscall table;
+ * elsewhere we need them from the headers. Kernels without them fail with
+ * ENOSYS and we fall back.
+ */
+#if defined(linux) && !defined(USERWORLD) && \
+    (defined(__x86_64__) || defined(__i386__) || \
+     defined(__aarch64__) || defined(__arm__))
+#   if !defined(SYS_close_range)
+#      define SYS_close_range 436
+#   endif
+#   if !defined(SYS_pidfd_open)
+#      define SYS_pidfd_open 434
+#   endif
+#endif
+
+#if !defined(__GLIBC__)
+extern char **environ;
+#endif
+
+#if defined(SYS_pidfd_open)
+/* Whether pidfd_open works here: -1 if not yet known. */
+static int gProcMgrHavePidFd = -1;
+#endif
+
 /*
  * All signals that:
  * . Can terminate the process
@@ -106,16 +150,25 @@ static int const cSignals[] = {
  * Keeps track of the posix async proc info.
  */
 struct ProcMgr_AsyncProc {
-   pid_t waiterPid;          // pid of the waiter process
+   pid_t waiterPid;          // pid of the waiter process, or of the process
+                             // itself if fd is a pidfd; -1 once reaped
    pid_t resultPid;          // pid of the process created for the client
-   int fd;                   // fd to write to when the child is done
+   int fd;                   // fd to write to when the child is done, or a
+                             // pidfd for resultPid
+   Bool isPidFd;             // fd is a pidfd and there is no waiter process
    Bool validExitCode;
    int exitCode;
 };
 
 static pid_t ProcMgrStartProcess(char const *cmd,
+                                 char * const *argv,
                                  char * const  *envp,
-                                 char const *workingDir);
+                                 char const *workingDir,
+                                 Bool closeFds);
+
+static ProcMgr_AsyncProc *ProcMgrExecAsync(char const *cmd,
+                                           char * const *argv,
+                                           ProcMgr_ProcArgs *userArgs);
 
 static Bool ProcMgrWaitForProcCompletion(pid_t pid,
                                          Bool *validExitCode,
@@ -1214,8 +1267,10 @@ ProcMgr_ExecSync(char const *cmd,                  // IN: UTF-8 command line
 
    Debug("Executing sync command: %s\n", cmd);
 
-   pid = ProcMgrStartProcess(cmd, userArgs ? userArgs->envp : NULL,
-                             userArgs ? userArgs->workingDirectory : NULL);
+   pid = ProcMgrStartProcess(cmd, NULL,
+                             userArgs ? userArgs->envp : NULL,
+                             userArgs ? userArgs->workingDirectory : NULL,
+                             FALSE);
 
    if (pid == -1) {
       return FALSE;
@@ -1228,10 +1283,213 @@ ProcMgr_ExecSync(char const *cmd,                  // IN: UTF-8 command line
 /*
  *----------------------------------------------------------------------
  *
- * ProcMgrStartProcess --
+ * ProcMgr_ExecSyncArgv --
+ *
+ *      Synchronously execute a program without going through the shell.
+ *      argv[0] is the program; if it does not contain a slash, it is
+ *      looked up in PATH. The arguments are UTF-8 encoded.
+ *
+ * Results:
+ *      TRUE on success (the program had an exit code of 0)
+ *      FALSE on failure or if an error occurred (detail is displayed)
+ *
+ * Side effects:
+ *	Lots, depending on the program.
+ *
+ *----------------------------------------------------------------------
+ */
+
+Bool
+ProcMgr_ExecSyncArgv(char * const *argv,               // IN: UTF-8 arguments
+                     ProcMgr_ProcArgs *userArgs)       // IN: optional
+{
+   pid_t pid;
+
+   ASSERT(argv != NULL && argv[0] != NULL);
+
+   Debug("Executing sync program: %s\n", argv[0]);
+
+   pid = ProcMgrStartProcess(NULL, argv,
+                             userArgs ? userArgs->envp : NULL,
+                             userArgs ? userArgs->workingDirectory : NULL,
+                             FALSE);
+
+   if (pid == -1) {
+      return FALSE;
+   }
+
+   return ProcMgrWaitForProcCompletion(pid, NULL, NULL);
+}
+
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * ProcMgrCloseFds --
+ *
+ *      Close every file descriptor except stdio and keepFd. On Linux this
+ *      is one or two close_range(2) calls or, on older kernels, closes only
+ *      the descriptors listed in /proc/self/fd; elsewhere we close all of
+ *      them up to the descriptor limit, which can take millions of calls.
+ *
+ *      Only called in a fork()ed child.
+ *
+ * Results:
+ *      None.
+ *
+ * Side effects:
+ *      None.
+ *
+ *----------------------------------------------------------------------
+ */
+
+static void
+ProcMgrCloseFds(int keepFd)            // IN: fd to leave open, or -1
+{
+   int minFd = STDERR_FILENO + 1;
+   int maxFd;
+   int fd;
+#if defined(SYS_close_range)
+   DIR *dir;
+
+   if (keepFd < minFd) {
+      if (syscall(SYS_close_range, minFd, ~0U, 0) == 0) {
+         return;
+      }
+   } else if ((keepFd == minFd ||
+               syscall(SYS_close_range, minFd, keepFd - 1, 0) == 0) &&
+              syscall(SYS_close_range, keepFd + 1, ~0U, 0) == 0) {
+      return;
+   }
+
+   dir = opendir("/proc/self/fd");
+   if (dir != NULL) {
+      struct dirent *entry;
+
+      while ((entry = readdir(dir)) != NULL) {
+         fd = atoi(entry->d_name);
+         if (fd >= minFd && fd != keepFd && fd != dirfd(dir)) {
+            close(fd);
+         }
+      }
+      closedir(dir);
+      return;
+   }
+#endif
+
+   maxFd = sysconf(_SC_OPEN_MAX);
+   for (fd = minFd; fd < maxFd; fd++) {
+      if (fd != keepFd) {
+         close(fd);
+      }
+   }
+}
+
+
+#if defined(PROCMGR_USE_SPAWN)
+/*
+ *----------------------------------------------------------------------
+ *
+ * ProcMgrSpawn --
+ *
+ *      Start a program with posix_spawn(3), if this glibc can do what is
+ *      asked. The handlers of cSignals are reset to their defaults, as the
+ *      ExecAsync waiter process does.
+ *
+ * Results:
+ *      FALSE if the program must be started with fork() instead.
+ *      TRUE otherwise, with the pid of the new process, or -1 on an error.
+ *
+ * Side effects:
+ *	Lots, depending on the program
+ *
+ *----------------------------------------------------------------------
+ */
+
+static Bool
+ProcMgrSpawn(char const *path,              // IN: program
+             char * const *args,            // IN: arguments
+             char * const *envp,            // IN: env vars, or NULL
+             char const *workDir,           // IN: working directory, or NULL
+             Bool closeFds,                 // IN: close fds other than stdio
+             Bool searchPath,               // IN: look path up in PATH
+             pid_t *pid)                    // OUT: new process
+{
+   posix_spawn_file_actions_t actions;
+   posix_spawnattr_t attr;
+   sigset_t defaultSignals;
+   unsigned int i;
+   int err;
+
+#if !defined(PROCMGR_SPAWN_CHDIR)
+   if (workDir != NULL) {
+      return FALSE;
+   }
+#endif
+#if !defined(PROCMGR_SPAWN_CLOSEFROM)
+   if (closeFds) {
+      return FALSE;
+   }
+#endif
+
+   posix_spawnattr_init(&attr);
+   sigemptyset(&defaultSignals);
+   for (i = 0; i < ARRAYSIZE(cSignals); i++) {
+      sigaddset(&defaultSignals, cSignals[i]);
+   }
+   posix_spawnattr_setsigdefault(&attr, &defaultSignals);
+   posix_spawnattr_setflags(&attr, POSIX_SPAWN_SETSIGDEF);
+
+   posix_spawn_file_actions_init(&actions);
+#if defined(PROCMGR_SPAWN_CHDIR)
+   if (workDir != NULL) {
+      /*
+       * posix_spawn fails if it cannot change to the directory, where the
+       * fork() child only warns and runs the program anyway.
+       */
+      if (access(workDir, X_OK) == 0) {
+         posix_spawn_file_actions_addchdir_np(&actions, workDir);
+      } else {
+         Warning("%s: Could not chdir(%s) %s\n", __FUNCTION__, workDir,
+                 strerror(errno));
+      }
+   }
+#endif
+#if defined(PROCMGR_SPAWN_CLOSEFROM)
+   if (closeFds) {
+      posix_spawn_file_actions_addclosefrom_np(&actions, STDERR_FILENO + 1);
+   }
+#endif
+
+   if (searchPath) {
+      err = posix_spawnp(pid, path, &actions, &attr, args,
+                         envp != NULL ? envp : environ);
+   } else {
+      err = posix_spawn(pid, path, &actions, &attr, args,
+                        envp != NULL ? envp : environ);
+   }
+
+   posix_spawn_file_actions_destroy(&actions);
+   posix_spawnattr_destroy(&attr);
+
+   if (err != 0) {
+      Warning("Unable to execute \"%s\": %s.\n\n", path, strerror(err));
+      *pid = -1;
+   }
+
+   return TRUE;
+}
+#endif
+
+
+#if !defined(USERWORLD)
+/*
+ *----------------------------------------------------------------------
+ *
+ * ProcMgrForkExec --
  *
- *      Fork and execute a command using the shell. This function returns
- *      immediately after the fork() in the parent process.
+ *      Fork and execute a program. This function returns immediately
+ *      after the fork() in the parent process.
  *
  * Results:
  *      The pid of the forked process, or -1 on an error.
@@ -1242,17 +1500,105 @@ ProcMgr_ExecSync(char const *cmd,                  // IN: UTF-8 command line
  *----------------------------------------------------------------------
  */
 
+static pid_t
+ProcMgrForkExec(char const *path,              // IN: program
+                char * const *args,            // IN: arguments
+                char **envp,                   // IN: env vars, or NULL
+                char const *workDir,           // IN: working directory, or NULL
+                Bool closeFds,                 // IN: close fds other than stdio
+                Bool searchPath)               // IN: look path up in PATH
+{
+   pid_t pid;
+
+   pid = fork();
+
+   if (pid == -1) {
+      Warning("Unable to fork: %s.\n\n", strerror(errno));
+   } else if (pid == 0) {
+      /*
+       * Child
+       */
+
+#ifdef __APPLE__
+      /*
+       * On OS X with security fixes, we cannot revert the real uid if
+       * its changed, so only the effective uid is changed.  But for
+       * running programs we need both.  See comments for
+       * ProcMgr_ImpersonateUserStart() for details.
+       *
+       * If it fails, bail since its a security issue if real uid is still
+       * root.
+       */
+      if (!ProcMgr_PromoteEffectiveToReal()) {
+         Panic("%s: Could not set real uid to effective\n", __FUNCTION__);
+      }
+#endif
+
+      if (closeFds) {
+         ProcMgrCloseFds(-1);
+      }
+
+      if (NULL != workDir) {
+         if (chdir(workDir) != 0) {
+            Warning("%s: Could not chdir(%s) %s\n", __FUNCTION__, workDir,
+                    strerror(errno));
+         }
+      }
+
+      if (NULL != envp) {
+         if (searchPath) {
+            environ = envp;
+            execvp(path, args);
+         } else {
+            execve(path, args, envp);
+         }
+      } else if (searchPath) {
+         execvp(path, args);
+      } else {
+         execv(path, args);
+      }
+
+      /* Failure */
+      Panic("Unable to execute \"%s\": %s.\n\n", path, strerror(errno));
+   }
+
+   return pid;
+}
+#endif
+
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * ProcMgrStartProcess --
+ *
+ *      Start a command using the shell, or a program with its arguments.
+ *      Exactly one of cmd and argv must be given. This function returns
+ *      as soon as the process has been created.
+ *
+ * Results:
+ *      The pid of the new process, or -1 on an error.
+ *
+ * Side effects:
+ *	Lots, depending on the program
+ *
+ *----------------------------------------------------------------------
+ */
+
 static pid_t
 ProcMgrStartProcess(char const *cmd,            // IN: UTF-8 encoded cmd
+                    char * const *argv,         // IN: UTF-8 encoded args
                     char * const *envp,         // IN: UTF-8 encoded env vars
-                    char const *workingDir)     // IN: UTF-8 working directory
+                    char const *workingDir,     // IN: UTF-8 working directory
+                    Bool closeFds)              // IN: close fds but stdio
 {
    pid_t pid;
    char *cmdCurrent = NULL;
+   char **argvCurrent = NULL;
    char **envpCurrent = NULL;
    char *workDir = NULL;
 
-   if (cmd == NULL) {
+   if ((cmd == NULL) == (argv == NULL)) {
       ASSERT(FALSE);
       return -1;
    }
@@ -1262,14 +1608,26 @@ ProcMgrStartProcess(char const *cmd,            // IN: UTF-8 encoded cmd
     * routines may rely on locks that do not survive fork().
     */
 
-   if (!CodeSet_Utf8ToCurrent(cmd, strlen(cmd), &cmdCurrent, NULL)) {
+   if (NULL != cmd &&
+       !CodeSet_Utf8ToCurrent(cmd, strlen(cmd), &cmdCurrent, NULL)) {
       Warning("Could not convert from UTF-8 to current\n");
       return -1;
    }
 
+   if (NULL != argv) {
+      argvCurrent = Unicode_GetAllocList(argv, -1, STRING_ENCODING_DEFAULT);
+      if (NULL == argvCurrent || NULL == argvCurrent[0]) {
+         Warning("Could not convert arguments from UTF-8 to current\n");
+         Util_FreeStringList(argvCurrent, -1);
+         return -1;
+      }
+   }
+
    if ((NULL != workingDir) &&
        !CodeSet_Utf8ToCurrent(workingDir, strlen(workingDir), &workDir, NULL)) {
       Warning("Could not convert workingDir from UTF-8 to current\n");
+      free(cmdCurrent);
+      Util_FreeStringList(argvCurrent, -1);
       return -1;
    }
 
@@ -1280,16 +1638,18 @@ ProcMgrStartProcess(char const *cmd,            // IN: UTF-8 encoded cmd
 #ifdef USERWORLD
    do {
       static const char filePath[] = "/bin/sh";
-      char * const argv[] = { "sh", "++group=host/vim/tmp",
-                              "-c", cmdCurrent, NULL };
+      char * const shellArgv[] = { "sh", "++group=host/vim/tmp",
+                                   "-c", cmdCurrent, NULL };
       int initFds[] = { STDIN_FILENO, STDOUT_FILENO, STDERR_FILENO };
       int workingDirFd;
       VmkuserStatus_Code status;
       int outPid;
 
       workingDirFd = open(workingDir != NULL ? workingDir : "/tmp", O_RDONLY);
-      status = VmkuserCompat_ForkExec(filePath,
-                                      argv,
+      status = VmkuserCompat_ForkExec(cmdCurrent != NULL ? filePath :
+                                                           argvCurrent[0],
+                                      cmdCurrent != NULL ? shellArgv :
+                                                           argvCurrent,
                                       envpCurrent,
                                       workingDirFd,
                                       initFds,
@@ -1309,78 +1669,56 @@ ProcMgrStartProcess(char const *cmd,            // IN: UTF-8 encoded cmd
       }
    } while (FALSE);
 #else
-   pid = fork();
-
-   if (pid == -1) {
-      Warning("Unable to fork: %s.\n\n", strerror(errno));
-   } else if (pid == 0) {
+   do {
       static const char bashShellPath[] = BASH_PATH;
-      char *bashArgs[] = { "bash", "-c", cmdCurrent, NULL };
       static const char bourneShellPath[] = "/bin/sh";
-      char *bourneArgs[] = { "sh", "-c", cmdCurrent, NULL };
-      const char *shellPath;
-      char **args;
+      char *shellArgs[] = { NULL, "-c", cmdCurrent, NULL };
+      const char *path;
+      char * const *args;
+      Bool searchPath = FALSE;
 
-      /*
-       * Check bug 772203. To start the program, we start the shell
-       * and specify the program using the option '-c'. We should return the
-       * PID of the app that gets started.
-       *
-       * When the option '-c' is specified,
-       * - bash shell just uses exec() to replace itself. So, 'bash' returns
-       * the PID of the new application that is started.
-       *
-       * - bourne shell does a fork & exec. So two processes are started. We
-       * see the PID of the shell and not the app that it starts. When the PID
-       * is returned to a user to watch, they'll watch the wrong process.
-       *
-       * In order to return the proper PID, use bash if possible. If bash
-       * is not available, then use the bourne shell.
-       */
-      if (File_Exists(bashShellPath)) {
-         shellPath = bashShellPath;
-         args = bashArgs;
+      if (NULL != cmdCurrent) {
+         /*
+          * Check bug 772203. To start the program, we start the shell
+          * and specify the program using the option '-c'. We should return
+          * the PID of the app that gets started.
+          *
+          * When the option '-c' is specified,
+          * - bash shell just uses exec() to replace itself. So, 'bash'
+          * returns the PID of the new application that is started.
+          *
+          * - bourne shell does a fork & exec. So two processes are started.
+          * We see the PID of the shell and not the app that it starts. When
+          * the PID is returned to a user to watch, they'll watch the wrong
+          * process.
+          *
+          * In order to return the proper PID, use bash if possible. If bash
+          * is not available, then use the bourne shell.
+          */
+         if (File_Exists(bashShellPath)) {
+            path = bashShellPath;
+            shellArgs[0] = "bash";
+         } else {
+            path = bourneShellPath;
+            shellArgs[0] = "sh";
+         }
+         args = shellArgs;
       } else {
-         shellPath = bourneShellPath;
-         args = bourneArgs;
+         path = argvCurrent[0];
+         args = argvCurrent;
+         searchPath = strchr(path, '/') == NULL;
       }
 
-      /*
-       * Child
-       */
-
-#ifdef __APPLE__
-      /*
-       * On OS X with security fixes, we cannot revert the real uid if
-       * its changed, so only the effective uid is changed.  But for
-       * running programs we need both.  See comments for
-       * ProcMgr_ImpersonateUserStart() for details.
-       *
-       * If it fails, bail since its a security issue if real uid is still
-       * root.
-       */
-      if (!ProcMgr_PromoteEffectiveToReal()) {
-         Panic("%s: Could not set real uid to effective\n", __FUNCTION__);
+#if defined(PROCMGR_USE_SPAWN)
+      if (ProcMgrSpawn(path, args, envpCurrent, workDir, closeFds,
+                       searchPath, &pid)) {
+         break;
       }
 #endif
 
-      if (NULL != workDir) {
-         if (chdir(workDir) != 0) {
-            Warning("%s: Could not chdir(%s) %s\n", __FUNCTION__, workDir,
-                    strerror(errno));
-         }
-      }
-
-      if (NULL != envpCurrent) {
-         execve(shellPath, args, envpCurrent);
-      } else  {
-         execv(shellPath, args);
-      }
-
-      /* Failure */
-      Panic("Unable to execute the \"%s\" shell command: %s.\n\n",
-            cmd, strerror(errno));
-   }
+      pid = ProcMgrForkExec(path, args, envpCurrent, workDir, closeFds,
+                            searchPath);
+   } while (FALSE);
 #endif
 
    /*
@@ -1389,6 +1727,7 @@ ProcMgrStartProcess(char const *cmd,            // IN: UTF-8 encoded cmd
 
    free(cmdCurrent);
    free(workDir);
+   Util_FreeStringList(argvCurrent, -1);
    Util_FreeStringList(envpCurrent, -1);
    return pid;
 }
@@ -1479,6 +1818,161 @@ ProcMgrWaitForProcCompletion(pid_t pid,                 // IN
 ProcMgr_AsyncProc *
 ProcMgr_ExecAsync(char const *cmd,                 // IN: UTF-8 command line
                   ProcMgr_ProcArgs *userArgs)      // IN: optional
+{
+   return ProcMgrExecAsync(cmd, NULL, userArgs);
+}
+
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * ProcMgr_ExecAsyncArgv --
+ *
+ *      Execute a program in the background without going through the
+ *      shell, returning immediately. argv[0] is the program; if it does
+ *      not contain a slash, it is looked up in PATH. The arguments are
+ *      UTF-8 encoded.
+ *
+ * Results:
+ *      The async proc (must be freed) or
+ *      NULL if the program failed to be started.
+ *
+ * Side effects:
+ *	The program is run.
+ *
+ *----------------------------------------------------------------------
+ */
+
+ProcMgr_AsyncProc *
+ProcMgr_ExecAsyncArgv(char * const *argv,              // IN: UTF-8 arguments
+                      ProcMgr_ProcArgs *userArgs)      // IN: optional
+{
+   ASSERT(argv != NULL && argv[0] != NULL);
+
+   return ProcMgrExecAsync(NULL, argv, userArgs);
+}
+
+
+#if defined(SYS_pidfd_open)
+/*
+ *----------------------------------------------------------------------
+ *
+ * ProcMgrHavePidFd --
+ *
+ *      Check, once, whether the kernel supports pidfd_open(2).
+ *
+ * Results:
+ *      TRUE if async processes can be tracked with a pidfd.
+ *
+ * Side effects:
+ *	None.
+ *
+ *----------------------------------------------------------------------
+ */
+
+static Bool
+ProcMgrHavePidFd(void)
+{
+   if (gProcMgrHavePidFd == -1) {
+      int fd = syscall(SYS_pidfd_open, getpid(), 0);
+
+      if (fd >= 0) {
+         close(fd);
+         gProcMgrHavePidFd = 1;
+      } else if (errno == ENOSYS || errno == EPERM) {
+         gProcMgrHavePidFd = 0;
+      } else {
+         /* Out of descriptors or similar; try again next time. */
+         return FALSE;
+      }
+   }
+
+   return gProcMgrHavePidFd == 1;
+}
+
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * ProcMgrExecAsyncPidFd --
+ *
+ *      Start the process directly and track it with a pidfd, which becomes
+ *      readable when the process exits. There is no waiter process.
+ *
+ * Results:
+ *      The async proc (must be freed) or
+ *      NULL if the process failed to be started.
+ *
+ * Side effects:
+ *	The process is run.
+ *
+ *----------------------------------------------------------------------
+ */
+
+static ProcMgr_AsyncProc *
+ProcMgrExecAsyncPidFd(char const *cmd,                 // IN: UTF-8 command line
+                      char * const *argv,              // IN: UTF-8 arguments
+                      ProcMgr_ProcArgs *userArgs)      // IN: optional
+{
+   ProcMgr_AsyncProc *asyncProc;
+   pid_t pid;
+   int pidFd;
+
+   pid = ProcMgrStartProcess(cmd, argv,
+                             userArgs ? userArgs->envp : NULL,
+                             userArgs ? userArgs->workingDirectory : NULL,
+                             TRUE);
+   if (pid == -1) {
+      return NULL;
+   }
+
+   pidFd = syscall(SYS_pidfd_open, pid, 0);
+   if (pidFd == -1) {
+      Warning("Unable to open a pidfd for process %"FMTPID": %s.\n",
+              pid, strerror(errno));
+      ProcMgrKill(pid, SIGKILL, -1);
+      return NULL;
+   }
+
+   asyncProc = Util_SafeMalloc(sizeof *asyncProc);
+   asyncProc->fd = pidFd;
+   asyncProc->isPidFd = TRUE;
+   asyncProc->waiterPid = pid;
+   asyncProc->validExitCode = FALSE;
+   asyncProc->exitCode = -1;
+   asyncProc->resultPid = pid;
+
+   return asyncProc;
+}
+#endif
+
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * ProcMgrExecAsync --
+ *
+ *      Execute a command using the shell, or a program with its arguments,
+ *      in the background, returning immediately.
+ *
+ *      Where pidfds are available the process is started directly;
+ *      otherwise a waiter process is forked that starts it, waits for it
+ *      and writes the result to a pipe.
+ *
+ * Results:
+ *      The async proc (must be freed) or
+ *      NULL if the cmd failed to be forked.
+ *
+ * Side effects:
+ *	The cmd is run.
+ *
+ *----------------------------------------------------------------------
+ */
+
+static ProcMgr_AsyncProc *
+ProcMgrExecAsync(char const *cmd,                 // IN: UTF-8 command line
+                 char * const *argv,              // IN: UTF-8 arguments
+                 ProcMgr_ProcArgs *userArgs)      // IN: optional
 {
    ProcMgr_AsyncProc *asyncProc = NULL;
    pid_t pid;
@@ -1489,10 +1983,18 @@ ProcMgr_ExecAsync(char const *cmd,                 // IN: UTF-8 command line
    int readFd, writeFd;
 
    Debug("Executing async command: '%s' in working dir '%s'\n",
-         cmd, (userArgs && userArgs->workingDirectory) ? userArgs->workingDirectory : "");
-   
+         cmd != NULL ? cmd : argv[0],
+         (userArgs && userArgs->workingDirectory) ? userArgs->workingDirectory : "");
+
+#if defined(SYS_pidfd_open)
+   if (ProcMgrHavePidFd()) {
+      return ProcMgrExecAsyncPidFd(cmd, argv, userArgs);
+   }
+#endif
+
    if (pipe(fds) == -1) {
-      Warning("Unable to create the pipe to launch command: %s.\n", cmd);
+      Warning("Unable to create the pipe to launch command: %s.\n",
+              cmd != NULL ? cmd : argv[0]);
       return NULL;
    }
 
@@ -1506,7 +2008,6 @@ ProcMgr_ExecAsync(char const *cmd,                 // IN: UTF-8 command line
       goto abort;
    } else if (pid == 0) {
       struct sigaction olds[ARRAYSIZE(cSignals)];
-      int i, maxfd;
       Bool status = TRUE;
       pid_t childPid = -1;
 
@@ -1522,12 +2023,7 @@ ProcMgr_ExecAsync(char const *cmd,                 // IN: UTF-8 command line
        * should probably call Hostinfo_ResetProcessState(), but that
        * does some stuff with iopl() we don't need
        */
-      maxfd = sysconf(_SC_OPEN_MAX);
-      for (i = STDERR_FILENO + 1; i < maxfd; i++) {
-         if (i != readFd && i != writeFd) {
-            close(i);
-         }
-      }
+      ProcMgrCloseFds(writeFd);
 
       if (Signal_SetGroupHandler(cSignals, olds, ARRAYSIZE(cSignals),
 #ifndef sun
@@ -1539,15 +2035,14 @@ ProcMgr_ExecAsync(char const *cmd,                 // IN: UTF-8 command line
          status = FALSE;
       }
 
-      close(readFd);
-
       /*
        * Only run the program if we have not already experienced a failure.
        */
       if (status) {
-         childPid = ProcMgrStartProcess(cmd,
+         childPid = ProcMgrStartProcess(cmd, argv,
                                         userArgs ? userArgs->envp : NULL,
-                                        userArgs ? userArgs->workingDirectory : NULL);
+                                        userArgs ? userArgs->workingDirectory : NULL,
+                                        FALSE);
          status = childPid != -1;
       }
 
@@ -1655,6 +2150,7 @@ ProcMgr_ExecAsync(char const *cmd,                 // IN: UTF-8 command line
    asyncProc = Util_SafeMalloc(sizeof *asyncProc);
    asyncProc->fd = readFd;
    readFd = -1;
+   asyncProc->isPidFd = FALSE;
    asyncProc->waiterPid = pid;
    asyncProc->validExitCode = FALSE;
    asyncProc->exitCode = -1;
@@ -1944,7 +2440,27 @@ ProcMgr_GetExitCode(ProcMgr_AsyncProc *asyncProc,  // IN
 
    *exitCode = -1;
 
-   if (asyncProc->waiterPid != -1) {
+   if (asyncProc->waiterPid != -1 && asyncProc->isPidFd) {
+      Bool validExitCode;
+      int code = -1;
+
+      /*
+       * There is no waiter: the process is our own child, reap it here.
+       * Like the waiter, report its exit status even if it did not exit
+       * normally.
+       */
+      ProcMgrWaitForProcCompletion(asyncProc->waiterPid, &validExitCode,
+                                   &code);
+      asyncProc->waiterPid = -1;
+      if (code == -1) {
+         goto exit;
+      }
+      asyncProc->exitCode = code;
+      asyncProc->validExitCode = TRUE;
+
+      Debug("Child w/ pidfd %x exited with code=%d\n",
+            asyncProc->fd, asyncProc->exitCode);
+   } else if (asyncProc->waiterPid != -1) {
       Bool status;
 
       if (read(asyncProc->fd, &status, sizeof status) != sizeof status) {
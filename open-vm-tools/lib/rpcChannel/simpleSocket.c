@@ -457,7 +457,7 @@ Socket_DecodePacket(const char *recvBuf,       // IN
    *payloadLen = 0;
 
    /* decoding the packet */
-   res = DataMap_Deserialize(recvBuf, fullPktLen, &map);
+   res = DataMap_DeserializeView(recvBuf, fullPktLen, &map);
    if (res != DMERR_SUCCESS) {
       Debug(LGPFX "Error in dataMap decoding, error=%d\n", res);
       return FALSE;
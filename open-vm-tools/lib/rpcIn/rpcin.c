@@ -851,7 +851,7 @@ RpcInDecodePacket(ConnInfo *conn,       // IN
 
 
    /* decoding the packet */
-   res = DataMap_Deserialize(conn->recvBuf, fullPacketLen, &map);
+   res = DataMap_DeserializeView(conn->recvBuf, fullPacketLen, &map);
    if (res != DMERR_SUCCESS) {
       Debug("RpcIn: Error in dataMap decoding for conn %d, error=%d\n",
             fd, res);
@@ -50,6 +50,7 @@
 #include "fileIO.h"
 #include "vmstdio.h"
 #include "mntinfo.h"
+#include "fileMountTable.h"
 #include "posix.h"
 #include "util.h"
 
@@ -106,6 +107,21 @@ typedef struct WiperState {
    uid_t euid;
 } WiperState;
 
+/*
+ * Iterator over the mounted file systems.  On Linux it walks the cached
+ * mount table instead of reparsing the mount file on every call.
+ */
+typedef struct WiperMountIter {
+#if defined(__linux__)
+   FileMountTable *table;
+   uint32 next;
+#else
+   MNTHANDLE fp;
+#endif
+   /* Changes whenever the set of mounted file systems may have changed */
+   uint32 generation;
+} WiperMountIter;
+
 #ifdef sun
 typedef struct WiperDiskString {
    char *name;
@@ -179,6 +195,7 @@ static unsigned int knownDiskMajor[MAX_DISK_MAJORS] = {
 };
 
 static int numDiskMajors;
+static uint32 diskMajorsGeneration;
 
 
 /*
@@ -189,6 +206,10 @@ static int numDiskMajors;
  *      Collects major numbers of devices that we considering "disks" and
  *      may try to shrink.
  *
+ *      /proc/devices is only reread when the mount table has changed since
+ *      it was last read: a disk whose driver was loaded since then can only
+ *      matter once something on it is mounted.
+ *
  * Results:
  *      None
  *
@@ -200,7 +221,7 @@ static int numDiskMajors;
  */
 
 static void
-WiperCollectDiskMajors(void)
+WiperCollectDiskMajors(uint32 generation)  // IN: mount table generation
 {
    const char diskDevNames[] = "|ide0|ide1|sd|md|nbd|device-mapper|blkext|";
    const char blockSeparator[] = "Block devices:";
@@ -209,15 +230,27 @@ WiperCollectDiskMajors(void)
    int major;
    char device[64];
    FILE *f;
+   StdIO_LineReader *reader;
+
+   if (generation != 0 && generation == diskMajorsGeneration) {
+      return;
+   }
 
    numDiskMajors = NUM_PRESEEDED_MAJORS;
+   diskMajorsGeneration = generation;
 
    f = Posix_Fopen("/proc/devices", "r");
    if (!f) {
       return;
    }
 
-   while (StdIO_ReadNextLine(f, &buf, 0, NULL) == StdIO_Success) {
+   reader = StdIO_LineReaderCreate(f, 0);
+   if (!reader) {
+      fclose(f);
+      return;
+   }
+
+   while (StdIO_LineReaderNext(reader, &buf, NULL) == StdIO_Success) {
 
       if (!seenBlockSeparator) {
          if (!memcmp(buf, blockSeparator, sizeof(blockSeparator) - 1)) {
@@ -234,26 +267,132 @@ WiperCollectDiskMajors(void)
          }
       }
 
-      free(buf);
-
       if (numDiskMajors >= MAX_DISK_MAJORS) {
          break;
       }
    }
 
+   StdIO_LineReaderDestroy(reader);
    fclose(f);
 }
 
 #else
 
 static void
-WiperCollectDiskMajors(void)
+WiperCollectDiskMajors(uint32 generation)  // IN: unused
 {
 }
 
 #endif
 
 
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * WiperMountIterOpen --
+ *
+ *      Starts an iteration over the mounted file systems.
+ *
+ * Results:
+ *      TRUE on success, FALSE if the mount information is unavailable.
+ *
+ * Side effects:
+ *      None
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+static Bool
+WiperMountIterOpen(WiperMountIter *iter)  // OUT
+{
+#if defined(__linux__)
+   iter->table = FileMountTable_Get();
+   if (iter->table == NULL) {
+      return FALSE;
+   }
+   iter->next = 0;
+   iter->generation = FileMountTable_GetGeneration(iter->table);
+#else
+   iter->fp = OPEN_MNTFILE("r");
+   if (iter->fp == NULL) {
+      return FALSE;
+   }
+   iter->generation = 0;
+#endif
+
+   return TRUE;
+}
+
+
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * WiperMountIterNext --
+ *
+ *      Retrieves the next mounted file system.
+ *
+ * Results:
+ *      TRUE and *mnt filled in on success, FALSE when no mounts are left.
+ *      On Linux the strings in *mnt are valid until WiperMountIterClose().
+ *
+ * Side effects:
+ *      None
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+static Bool
+WiperMountIterNext(WiperMountIter *iter,  // IN/OUT
+                   MNTINFO *mnt)          // OUT
+{
+#if defined(__linux__)
+   const FileMountEntry *entry;
+
+   if (iter->next == FileMountTable_GetCount(iter->table)) {
+      return FALSE;
+   }
+
+   entry = FileMountTable_GetEntry(iter->table, iter->next++);
+   memset(mnt, 0, sizeof *mnt);
+   mnt->mnt_fsname = entry->fsName;
+   mnt->mnt_dir = entry->mountPoint;
+   mnt->mnt_type = entry->fsType;
+   mnt->mnt_opts = entry->options;
+
+   return TRUE;
+#else
+   return GETNEXT_MNTINFO(iter->fp, mnt);
+#endif
+}
+
+
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * WiperMountIterClose --
+ *
+ *      Ends an iteration over the mounted file systems.
+ *
+ * Results:
+ *      None
+ *
+ * Side effects:
+ *      None
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+static void
+WiperMountIterClose(WiperMountIter *iter)  // IN
+{
+#if defined(__linux__)
+   FileMountTable_Release(iter->table);
+#else
+   (void) CLOSE_MNTFILE(iter->fp);
+#endif
+}
+
+
 /*
  *-----------------------------------------------------------------------------
  *
@@ -495,15 +634,15 @@ WiperPartition *
 WiperSinglePartition_Open(const char *mountPoint)      // IN
 {
    char *mntpt = NULL;
-   MNTHANDLE fp;
+   WiperMountIter iter;
    int len = 0;
-   DECLARE_MNTINFO(mnt);
+   MNTINFO mntBuf;
+   MNTINFO *mnt = &mntBuf;
    WiperPartition *p = NULL;
 
    ASSERT(initDone);
 
-   fp = OPEN_MNTFILE("r");
-   if (fp == NULL) {
+   if (!WiperMountIterOpen(&iter)) {
       Log("Could not open %s\n", MNTFILE);
       return NULL;
    }
@@ -521,7 +660,7 @@ WiperSinglePartition_Open(const char *mountPoint)      // IN
    }
 
    len = strlen(mntpt);
-   while (GETNEXT_MNTINFO(fp, mnt)) {
+   while (WiperMountIterNext(&iter, mnt)) {
       if (strncmp(MNTINFO_MNTPT(mnt), mntpt, len) == 0) {
 
          p = WiperSinglePartition_Allocate();
@@ -533,7 +672,7 @@ WiperSinglePartition_Open(const char *mountPoint)      // IN
             WiperSinglePartition_Close(p);
             p = NULL;
          } else {
-            WiperCollectDiskMajors();
+            WiperCollectDiskMajors(iter.generation);
             WiperPartitionFilter(p, mnt);
          }
 
@@ -545,7 +684,7 @@ WiperSinglePartition_Open(const char *mountPoint)      // IN
 
  out:
    free(mntpt);
-   (void) CLOSE_MNTFILE(fp);
+   WiperMountIterClose(&iter);
    return p;
 }
 
@@ -624,8 +763,9 @@ WiperSinglePartition_GetSpace(const WiperPartition *p,  // IN
 Bool
 WiperPartition_Open(WiperPartition_List *pl)
 {
-   MNTHANDLE fp;
-   DECLARE_MNTINFO(mnt);
+   WiperMountIter iter;
+   MNTINFO mntBuf;
+   MNTINFO *mnt = &mntBuf;
    Bool rc = TRUE;
 
    ASSERT(initDone);
@@ -633,15 +773,14 @@ WiperPartition_Open(WiperPartition_List *pl)
    DblLnkLst_Init(&pl->link);
 
    /* Basically call functions to parse /etc/mtab ... */
-   fp = OPEN_MNTFILE("r");
-   if (fp == NULL) {
+   if (!WiperMountIterOpen(&iter)) {
       Log("Unable to open mount file.\n");
       return FALSE;
    }
 
-   WiperCollectDiskMajors();
+   WiperCollectDiskMajors(iter.generation);
 
-   while (GETNEXT_MNTINFO(fp, mnt)) {
+   while (WiperMountIterNext(&iter, mnt)) {
       WiperPartition *part = WiperSinglePartition_Allocate();
 
       if (part == NULL) {
@@ -665,7 +804,7 @@ WiperPartition_Open(WiperPartition_List *pl)
    if (!rc)
       WiperPartition_Close(pl);
 
-   (void) CLOSE_MNTFILE(fp);
+   WiperMountIterClose(&iter);
    return rc;
 }
 
@@ -27,16 +27,46 @@
 #include <errno.h>
 #include <unistd.h>
 #include <fcntl.h>
+#include <limits.h>
+#include <time.h>
+#include <sys/poll.h>
+#include <sys/syscall.h>
 #include <sys/wait.h>
 
 #include "util.h"
 
+/*
+ * pidfd_open(2) is Linux 5.3 and has the same number on every architecture,
+ * so define it for older headers. Older kernels fail it with ENOSYS and we
+ * fall back to checking waitpid periodically.
+ */
+#if defined(__linux__) && \
+    (defined(__x86_64__) || defined(__i386__) || \
+     defined(__aarch64__) || defined(__arm__))
+#   if !defined(SYS_pidfd_open)
+#      define SYS_pidfd_open 434
+#   endif
+#endif
+
+/* How often to check for the exit of the process without a pidfd. */
+#define PROCESS_WAIT_POLL_MSEC   100
+
+/* Largest output buffer per stream, with the NUL; the rest is dropped. */
+#define PROCESS_OUTPUT_MAX       (4 * 1024 * 1024)
+
+typedef struct _ProcessOutput {
+   int fd;
+   char *buf;
+   size_t len;
+   size_t size;
+   Bool truncated;
+   const char *name;
+} ProcessOutput;
+
 typedef struct _ProcessInternal {
    pid_t pid;
-   int stdoutFd;
-   int stderrFd;
-   char* stdoutStr;
-   char* stderrStr;
+   ProcessOutput stdoutOut;
+   ProcessOutput stderrOut;
    int exitCode;
    char** args;
    LogFunction log;
@@ -49,8 +79,102 @@ typedef enum _ReadStatus {
    READSTATUS_ERROR
 } ReadStatus;
 
+static ReadStatus
+ProcessRead(ProcessInternal *p, ProcessOutput *out);
+
+
+/*
+ *------------------------------------------------------------------------------
+ *
+ * ProcessOutputInit --
+ *
+ *      Initialize an empty output buffer.
+ *
+ *------------------------------------------------------------------------------
+ */
+
 static void
-ProcessRead(ProcessInternal *p, ReadStatus *status, Bool out, Bool readToEof);
+ProcessOutputInit(ProcessOutput *out, const char *name)
+{
+   out->fd = -1;
+   out->size = 1;
+   out->buf = Util_SafeMalloc(out->size);
+   out->buf[0] = '\0';
+   out->len = 0;
+   out->truncated = FALSE;
+   out->name = name;
+}
+
+
+/*
+ *------------------------------------------------------------------------------
+ *
+ * ProcessOutputClose --
+ *
+ *      Close the read end of an output pipe.
+ *
+ *------------------------------------------------------------------------------
+ */
+
+static void
+ProcessOutputClose(ProcessOutput *out)
+{
+   if (out->fd >= 0) {
+      close(out->fd);
+      out->fd = -1;
+   }
+}
+
+
+/*
+ *------------------------------------------------------------------------------
+ *
+ * ProcessNowMsec --
+ *
+ *      Monotonic time in milliseconds.
+ *
+ *------------------------------------------------------------------------------
+ */
+
+static uint64
+ProcessNowMsec(void)
+{
+   struct timespec ts;
+
+   clock_gettime(CLOCK_MONOTONIC, &ts);
+   return (uint64)ts.tv_sec * 1000 + ts.tv_nsec / 1000000;
+}
+
+
+/*
+ *------------------------------------------------------------------------------
+ *
+ * ProcessOpenPidFd --
+ *
+ *      Get a descriptor that becomes readable when the process exits.
+ *
+ *      Returns -1 if the kernel has no pidfd_open(2).
+ *
+ *------------------------------------------------------------------------------
+ */
+
+static int
+ProcessOpenPidFd(ProcessInternal *p)
+{
+#if defined(SYS_pidfd_open)
+   int fd = syscall(SYS_pidfd_open, p->pid, 0);
+
+   if (fd < 0) {
+      p->log(log_info, "No pidfd for process %d (%s), polling for its exit",
+             p->pid, strerror(errno));
+   } else {
+      fcntl(fd, F_SETFD, FD_CLOEXEC);
+   }
+   return fd;
+#else
+   return -1;
+#endif
+}
 
 
 /*
@@ -71,13 +195,8 @@ Process_Create(ProcessHandle *h, char *args[], void *logPtr)
    LogFunction log = (LogFunction)logPtr;
    log(log_info, "sizeof ProcessInternal is %d\n", sizeof(ProcessInternal));
    p = Util_SafeMalloc(sizeof(ProcessInternal));
-   p->stdoutStr = Util_SafeMalloc(sizeof(char));
-   p->stdoutStr[0] = '\0';
-   p->stderrStr = Util_SafeMalloc(sizeof(char));
-   p->stderrStr[0] = '\0';
-
-   p->stdoutFd = -1;
-   p->stderrFd = -1;
+   ProcessOutputInit(&p->stdoutOut, "stdout");
+   ProcessOutputInit(&p->stderrOut, "stderr");
 
    numArgs = 0;
    while (args[numArgs] != NULL) {
@@ -103,6 +222,11 @@ Process_Create(ProcessHandle *h, char *args[], void *logPtr)
  *      Runs a process until complete, collecting stdout and stderr into the
  *      process object.
  *
+ *      Sleeps in poll(2) on the output pipes and a pidfd for the process, so
+ *      output is collected and the exit noticed as soon as they happen. The
+ *      process is killed if it has not exited after timeoutSec; its output
+ *      is still read until EOF afterwards.
+ *
  *------------------------------------------------------------------------------
  */
 
@@ -112,16 +236,12 @@ Process_RunToComplete(ProcessHandle h, unsigned long timeoutSec)
    int stdout[2];
    int stderr[2];
    int flags;
+   int pidFd;
    ProcessInternal* p;
-   // poll for the process to complete and read the output
-   const unsigned int OneSecMicroSec = 1000000;
-   const unsigned int LoopSleepMicrosec = OneSecMicroSec / 10;
-   const unsigned long timeoutLoopSleeps =
-      timeoutSec * (OneSecMicroSec / LoopSleepMicrosec);
-   unsigned long elapsedTimeLoopSleeps;
-
-   ReadStatus res_stdout = READSTATUS_UNDEFINED;
-   ReadStatus res_stderr = READSTATUS_UNDEFINED;
+   uint64 start;
+   uint64 deadline;
+   Bool exited = FALSE;
+   Bool killed = FALSE;
 
    p = (ProcessInternal*)h;
 
@@ -139,6 +259,7 @@ Process_RunToComplete(ProcessHandle h, unsigned long timeoutSec)
       return PROCESS_FAILED;
    }
 
+   start = ProcessNowMsec();
    p->pid = fork();
    if (p->pid == -1) {
       p->log(log_error, "Failed to fork: %s", strerror(errno));
@@ -150,86 +271,121 @@ Process_RunToComplete(ProcessHandle h, unsigned long timeoutSec)
    } else if (p->pid == 0) {
       // we're in the child. close the read ends of the pipes and exec
       close(stdout[0]);
-      close(stderr[0]);  
+      close(stderr[0]);
       dup2(stdout[1], STDOUT_FILENO);
       dup2(stderr[1], STDERR_FILENO);
       execv(p->args[0], p->args);
 
       // exec failed
-      exit(127);
+      _exit(127);
    }
 
    // close write ends of pipes and make reads nonblocking
    close(stdout[1]);
    close(stderr[1]);
 
-   p->stdoutFd = stdout[0];
-   flags = fcntl(p->stdoutFd, F_GETFL);
-   fcntl(p->stdoutFd, F_SETFL, flags | O_NONBLOCK);
-
-   p->stderrFd = stderr[0];
-   flags = fcntl(p->stderrFd, F_GETFL);
-   fcntl(p->stderrFd, F_SETFL, flags | O_NONBLOCK);
-
-   elapsedTimeLoopSleeps = 0;
-
-   while (1) {
-      int processStatus;
-      int processFinished = (waitpid(p->pid, &processStatus, WNOHANG) > 0);
-
-      if (processFinished) {
-         if (WIFEXITED(processStatus)) {
-            p->exitCode = WEXITSTATUS(processStatus);
-            p->log(log_info,
-                   "Process exited normally after %d seconds, returned %d",
-                   elapsedTimeLoopSleeps * LoopSleepMicrosec / OneSecMicroSec,
-                   p->exitCode);
-         } else if (WIFSIGNALED(processStatus)) {
-            p->exitCode = 127;
-            p->log(log_error,
-                   "Process exited abnormally after %d sec, uncaught signal %d",
-                   elapsedTimeLoopSleeps * LoopSleepMicrosec / OneSecMicroSec,
-                   WTERMSIG(processStatus));
+   p->stdoutOut.fd = stdout[0];
+   flags = fcntl(p->stdoutOut.fd, F_GETFL);
+   fcntl(p->stdoutOut.fd, F_SETFL, flags | O_NONBLOCK);
+
+   p->stderrOut.fd = stderr[0];
+   flags = fcntl(p->stderrOut.fd, F_GETFL);
+   fcntl(p->stderrOut.fd, F_SETFL, flags | O_NONBLOCK);
+
+   pidFd = ProcessOpenPidFd(p);
+   deadline = start + (uint64)timeoutSec * 1000;
+
+   while (!exited || p->stdoutOut.fd >= 0 || p->stderrOut.fd >= 0) {
+      ProcessOutput *outs[2];
+      struct pollfd fds[3];
+      nfds_t nfds = 0;
+      int timeoutMsec = -1;
+      int i;
+
+      if (p->stdoutOut.fd >= 0) {
+         outs[nfds] = &p->stdoutOut;
+         fds[nfds].fd = p->stdoutOut.fd;
+         fds[nfds++].events = POLLIN;
+      }
+      if (p->stderrOut.fd >= 0) {
+         outs[nfds] = &p->stderrOut;
+         fds[nfds].fd = p->stderrOut.fd;
+         fds[nfds++].events = POLLIN;
+      }
+
+      if (!exited) {
+         int processStatus;
+
+         if (waitpid(p->pid, &processStatus, WNOHANG) > 0) {
+            uint64 elapsedSec = (ProcessNowMsec() - start) / 1000;
+
+            exited = TRUE;
+            if (WIFEXITED(processStatus)) {
+               p->exitCode = WEXITSTATUS(processStatus);
+               p->log(log_info,
+                      "Process exited normally after %d seconds, returned %d",
+                      (int)elapsedSec, p->exitCode);
+            } else if (WIFSIGNALED(processStatus)) {
+               p->exitCode = 127;
+               p->log(log_error,
+                      "Process exited abnormally after %d sec, uncaught signal %d",
+                      (int)elapsedSec, WTERMSIG(processStatus));
+            }
+            continue;
          }
 
-         break;
-      } else {
-         if (timeoutLoopSleeps == elapsedTimeLoopSleeps) {
-            p->log(log_error, "Timed out waiting for process exit, killing...");
-            kill(p->pid, SIGKILL);
+         if (!killed) {
+            uint64 now = ProcessNowMsec();
+
+            if (now >= deadline) {
+               p->log(log_error, "Timed out waiting for process exit, killing...");
+               kill(p->pid, SIGKILL);
+               killed = TRUE;
+            } else {
+               timeoutMsec = MIN(deadline - now, INT_MAX);
+            }
          }
 
-         // Empty the pipes.
-         ProcessRead(p, &res_stdout, TRUE, FALSE);
-         if (res_stdout == READSTATUS_ERROR) {
-            p->log(log_error, "Error while reading process output, killing...");
+         if (pidFd >= 0) {
+            fds[nfds].fd = pidFd;
+            fds[nfds++].events = POLLIN;
+         } else if (timeoutMsec < 0 || timeoutMsec > PROCESS_WAIT_POLL_MSEC) {
+            timeoutMsec = PROCESS_WAIT_POLL_MSEC;
+         }
+      }
+
+      if (poll(fds, nfds, timeoutMsec) < 0) {
+         if (errno == EINTR) {
+            continue;
+         }
+         p->log(log_error, "Failed to wait for the process: %s", strerror(errno));
+         if (!exited && !killed) {
             kill(p->pid, SIGKILL);
+            killed = TRUE;
+         }
+         /* Nothing to wait with; just reap it and take what output is left. */
+         ProcessOutputClose(&p->stdoutOut);
+         ProcessOutputClose(&p->stderrOut);
+         if (pidFd >= 0) {
+            close(pidFd);
+            pidFd = -1;
          }
+         continue;
+      }
 
-         ProcessRead(p, &res_stderr, FALSE, FALSE);
-         if (res_stderr == READSTATUS_ERROR) {
+      for (i = 0; i < nfds; i++) {
+         if (fds[i].fd != pidFd && fds[i].revents != 0 &&
+             ProcessRead(p, outs[i]) == READSTATUS_ERROR && !exited && !killed) {
             p->log(log_error, "Error while reading process output, killing...");
             kill(p->pid, SIGKILL);
+            killed = TRUE;
          }
-
-         usleep(LoopSleepMicrosec);
-         elapsedTimeLoopSleeps++;
       }
    }
 
-   // Process completed. Now read all the output to EOF.
-   ProcessRead(p, &res_stdout, TRUE, TRUE);
-   if (res_stdout == READSTATUS_ERROR) {
-      p->log(log_error, "Error while reading process output, killing...");
+   if (pidFd >= 0) {
+      close(pidFd);
    }
-
-   ProcessRead(p, &res_stderr, FALSE, TRUE);
-   if (res_stderr == READSTATUS_ERROR) {
-      p->log(log_error, "Error while reading process output, killing...");
-   }
-
-   close(stdout[1]);
-   close(stderr[1]);
    return PROCESS_SUCCESS;
 }
 
@@ -239,78 +395,60 @@ Process_RunToComplete(ProcessHandle h, unsigned long timeoutSec)
  *
  * ProcessRead --
  *
- *      Read redirected stdout or stderr.
- *
- * status - as IN  - holds the result from previous read operation.
- *          as OUT - returns the status from the read operation.
+ *      Read redirected stdout or stderr until the pipe is empty, appending
+ *      to the output buffer, which grows by doubling up to
+ *      PROCESS_OUTPUT_MAX. Output beyond that is read and dropped so the
+ *      process does not block on a full pipe.
  *
- * There are two modes:
- * readToEof = TRUE - block until the read returns 0 (EOF). This signifies
- *                    that the process has exited and there's nothing left.
- * readToEof = FALSE- Just empty the pipe. This will return even if we get
- *             EAGAIN back from the read. Use this in the midst of the poll
- *             loop so the pipe doesn't fill up and block the process.
+ *      Returns READSTATUS_PENDING if the pipe is empty but still open, and
+ *      READSTATUS_DONE at EOF. The pipe is closed unless more output may
+ *      follow.
  *
  *------------------------------------------------------------------------------
  */
 
-static void
-ProcessRead(ProcessInternal *p, ReadStatus *status, Bool stdout, Bool readToEof)
+static ReadStatus
+ProcessRead(ProcessInternal *p, ProcessOutput *out)
 {
-   char buf[1024];
-   size_t currSize, newSize;
-   ssize_t count;
-   char** saveTo;
-   int fd;
-   char* stdstr = stdout ? "stdout" : "stderr";
-
-   // which fd do we read and which pointer do we save to?
-   fd = stdout ? p->stdoutFd : p->stderrFd;
-   saveTo = stdout ? &p->stdoutStr : &p->stderrStr;
+   char discard[4096];
 
-   // if there's output waiting, read it out. FDs should already be non-blocking
    do {
-      count = read(fd, buf, sizeof buf);
-      if (count > 0) {
-         // save output
-         currSize = strlen(*saveTo);
-         newSize = count + currSize;
-         *saveTo = Util_SafeRealloc(*saveTo, newSize + 1);
-         memcpy(*saveTo + currSize, buf, count);
-         (*saveTo)[newSize] = '\0';
-         p->log(log_info, "Saving output from %s", stdstr);
-      } else if (count == 0) {
-         if (*status != READSTATUS_DONE) {
-            // we're done
-            p->log(log_info, "No more output from %s", stdstr);
-            *status = READSTATUS_DONE;
-         }
+      ssize_t count;
 
-         return;
-      } else if (count < 0) {
-         if (errno == EAGAIN && readToEof) {
-            if (*status != READSTATUS_PENDING) {
-               // waiting for more output, sleep briefly and try again
-               p->log(log_info, "Pending output from %s, trying again", stdstr);
-               *status = READSTATUS_PENDING;
-            }
+      if (out->len + 1 == out->size && out->size < PROCESS_OUTPUT_MAX) {
+         out->size = MIN(out->size < 4096 ? 4096 : 2 * out->size,
+                         PROCESS_OUTPUT_MAX);
+         out->buf = Util_SafeRealloc(out->buf, out->size);
+      }
 
-            usleep(1000);
-         } else if (errno == EAGAIN && !readToEof) {
-            if (*status != READSTATUS_PENDING) {
-               // caller doesn't want to wait until EOF
-               p->log(log_info, "Returning, pending output from %s", stdstr);
-               *status = READSTATUS_PENDING;
-            }
+      if (out->len + 1 < out->size) {
+         count = read(out->fd, out->buf + out->len, out->size - out->len - 1);
+         if (count > 0) {
+            out->len += count;
+            out->buf[out->len] = '\0';
+         }
+      } else {
+         count = read(out->fd, discard, sizeof discard);
+         if (count > 0 && !out->truncated) {
+            p->log(log_warning, "Output from %s is over %d bytes, dropping the rest",
+                   out->name, (int)out->len);
+            out->truncated = TRUE;
+         }
+      }
 
-            return;
-         } else {
-            // error
+      if (count == 0) {
+         p->log(log_info, "No more output from %s, %d bytes saved",
+                out->name, (int)out->len);
+         ProcessOutputClose(out);
+         return READSTATUS_DONE;
+      } else if (count < 0) {
+         if (errno == EAGAIN || errno == EWOULDBLOCK) {
+            return READSTATUS_PENDING;
+         } else if (errno != EINTR) {
             p->log(log_error, "Failed to read from %s: %s",
-                   stdstr, strerror(errno));
-
-            *status = READSTATUS_ERROR;
-            return;
+                   out->name, strerror(errno));
+            ProcessOutputClose(out);
+            return READSTATUS_ERROR;
          }
       }
    } while (1);
@@ -331,7 +469,7 @@ const char *
 Process_GetStdout(ProcessHandle h)
 {
    ProcessInternal *p = (ProcessInternal *)h;
-   return p->stdoutStr;
+   return p->stdoutOut.buf;
 }
 
 
@@ -349,7 +487,7 @@ const char *
 Process_GetStderr(ProcessHandle h)
 {
    ProcessInternal *p = (ProcessInternal *)h;
-   return p->stderrStr;
+   return p->stderrOut.buf;
 }
 
 
@@ -387,14 +525,10 @@ Process_Destroy(ProcessHandle h)
    ProcessInternal* p;
    int i;
    p = (ProcessInternal*)h;
-   if (p->stdoutFd >= 0) {
-      close(p->stdoutFd);
-   }
-   if (p->stderrFd >= 0) {
-      close(p->stderrFd);
-   }
-   free(p->stdoutStr);
-   free(p->stderrStr);
+   ProcessOutputClose(&p->stdoutOut);
+   ProcessOutputClose(&p->stderrOut);
+   free(p->stdoutOut.buf);
+   free(p->stderrOut.buf);
    for (i = 0; p->args[i] != NULL; i++) {
       free(p->args[i]);
    }
@@ -614,6 +614,123 @@ VMTools_ConfigGetInteger(GKeyFile *config,
 }
 
 
+/**
+ * Lists the keys of a group that were added, removed or given a different
+ * value between two config dictionaries.
+ *
+ * @param[in]  oldConfig   Previous config data (may be NULL).
+ * @param[in]  newConfig   New config data (may be NULL).
+ * @param[in]  group       Group to compare.
+ *
+ * @return NULL-terminated list of changed keys. Free with g_strfreev().
+ */
+
+static gchar **
+VMToolsConfigDiffKeys(GKeyFile *oldConfig,
+                      GKeyFile *newConfig,
+                      const gchar *group)
+{
+   GPtrArray *changed = g_ptr_array_new();
+   gchar **keys;
+   gsize i;
+
+   if (newConfig != NULL) {
+      keys = g_key_file_get_keys(newConfig, group, NULL, NULL);
+      for (i = 0; keys != NULL && keys[i] != NULL; i++) {
+         gchar *oldValue = NULL;
+         gchar *newValue;
+
+         if (oldConfig != NULL) {
+            oldValue = g_key_file_get_value(oldConfig, group, keys[i], NULL);
+         }
+         newValue = g_key_file_get_value(newConfig, group, keys[i], NULL);
+
+         if (oldValue == NULL || newValue == NULL ||
+             strcmp(oldValue, newValue) != 0) {
+            g_ptr_array_add(changed, g_strdup(keys[i]));
+         }
+         g_free(oldValue);
+         g_free(newValue);
+      }
+      g_strfreev(keys);
+   }
+
+   if (oldConfig != NULL) {
+      keys = g_key_file_get_keys(oldConfig, group, NULL, NULL);
+      for (i = 0; keys != NULL && keys[i] != NULL; i++) {
+         if (newConfig == NULL ||
+             !g_key_file_has_key(newConfig, group, keys[i], NULL)) {
+            g_ptr_array_add(changed, g_strdup(keys[i]));
+         }
+      }
+      g_strfreev(keys);
+   }
+
+   g_ptr_array_add(changed, NULL);
+   return (gchar **) g_ptr_array_free(changed, FALSE);
+}
+
+
+/**
+ * Compares two config dictionaries and lists what changed, per group. A
+ * group is listed if it was added or removed, or if any of its keys was
+ * added, removed or given a different value. Comments and ordering are
+ * ignored.
+ *
+ * @param[in]  oldConfig   Previous config data (may be NULL).
+ * @param[in]  newConfig   New config data (may be NULL).
+ *
+ * @return Table mapping each changed group name to a NULL-terminated list
+ *         (gchar **) of its changed keys. The list is empty for a group
+ *         that was added or removed without keys. The table is empty if
+ *         the two dictionaries are equivalent. Free with
+ *         g_hash_table_destroy().
+ */
+
+GHashTable *
+VMTools_ConfigDiff(GKeyFile *oldConfig,
+                   GKeyFile *newConfig)
+{
+   GHashTable *changes;
+   gchar **groups;
+   gsize i;
+
+   changes = g_hash_table_new_full(g_str_hash, g_str_equal, g_free,
+                                   (GDestroyNotify) g_strfreev);
+
+   if (newConfig != NULL) {
+      groups = g_key_file_get_groups(newConfig, NULL);
+      for (i = 0; groups[i] != NULL; i++) {
+         gchar **keys = VMToolsConfigDiffKeys(oldConfig, newConfig,
+                                              groups[i]);
+
+         if (keys[0] != NULL || oldConfig == NULL ||
+             !g_key_file_has_group(oldConfig, groups[i])) {
+            g_hash_table_insert(changes, g_strdup(groups[i]), keys);
+         } else {
+            g_strfreev(keys);
+         }
+      }
+      g_strfreev(groups);
+   }
+
+   if (oldConfig != NULL) {
+      groups = g_key_file_get_groups(oldConfig, NULL);
+      for (i = 0; groups[i] != NULL; i++) {
+         if (newConfig == NULL ||
+             !g_key_file_has_group(newConfig, groups[i])) {
+            g_hash_table_insert(changes, g_strdup(groups[i]),
+                                VMToolsConfigDiffKeys(oldConfig, NULL,
+                                                      groups[i]));
+         }
+      }
+      g_strfreev(groups);
+   }
+
+   return changes;
+}
+
+
 /**
  * Loads string value for a key from the specified config section.
  *
@@ -75,18 +75,36 @@
 #include "block.h"
 #include "dbllnklst.h"
 
+/*
+ * Blocks are kept in a fixed-size hash table keyed on the filename.  Each
+ * bucket has its own lock, so accesses to unrelated files never contend, and
+ * a count of the blocks it holds, which lets lookups of files that are not
+ * blocked (by far the common case) return without taking any lock.
+ */
+
+#define BLOCK_HASH_BITS         7
+#define BLOCK_HASH_SIZE         (1 << BLOCK_HASH_BITS)
+#define BLOCK_HASH_MASK         (BLOCK_HASH_SIZE - 1)
+
+#define BLOCK_FNV_BASIS         2166136261U
+#define BLOCK_FNV_PRIME         16777619U
+
 typedef struct BlockInfo {
    DblLnkLst_Links links;
    os_atomic_t refcount;
    os_blocker_id_t blocker;
    os_completion_t completion;
+   unsigned int hash;
    char filename[OS_PATH_MAX];
 } BlockInfo;
 
+typedef struct BlockBucket {
+   DblLnkLst_Links blockedFiles;
+   os_rwlock_t lock;
+   os_atomic_t numBlocks;
+} BlockBucket;
 
-/* XXX: Is it worth turning this into a hash table? */
-static DblLnkLst_Links blockedFiles;
-static os_rwlock_t blockedFilesLock;
+static BlockBucket blockTable[BLOCK_HASH_SIZE];
 static os_kmem_cache_t *blockInfoCache;
 
 
@@ -109,6 +127,8 @@ static os_kmem_cache_t *blockInfoCache;
 int
 BlockInit(void)
 {
+   unsigned int i;
+
    ASSERT(!blockInfoCache);
 
    blockInfoCache = os_kmem_cache_create("blockInfoCache",
@@ -119,8 +139,11 @@ BlockInit(void)
       return OS_ENOMEM;
    }
 
-   DblLnkLst_Init(&blockedFiles);
-   os_rwlock_init(&blockedFilesLock);
+   for (i = 0; i < BLOCK_HASH_SIZE; i++) {
+      DblLnkLst_Init(&blockTable[i].blockedFiles);
+      os_rwlock_init(&blockTable[i].lock);
+      os_atomic_set(&blockTable[i].numBlocks, 0);
+   }
 
    return 0;
 }
@@ -145,14 +168,75 @@ BlockInit(void)
 void
 BlockCleanup(void)
 {
+   unsigned int i;
+
    ASSERT(blockInfoCache);
-   ASSERT(!DblLnkLst_IsLinked(&blockedFiles));
 
-   os_rwlock_destroy(&blockedFilesLock);
+   for (i = 0; i < BLOCK_HASH_SIZE; i++) {
+      ASSERT(!DblLnkLst_IsLinked(&blockTable[i].blockedFiles));
+      os_rwlock_destroy(&blockTable[i].lock);
+   }
+
    os_kmem_cache_destroy(blockInfoCache);
 }
 
 
+/*
+ *----------------------------------------------------------------------------
+ *
+ * BlockHash --
+ *
+ *    Computes the hash of a filename (32-bit FNV-1a).
+ *
+ * Results:
+ *    The hash value.
+ *
+ * Side effects:
+ *    None.
+ *
+ *----------------------------------------------------------------------------
+ */
+
+static unsigned int
+BlockHash(const char *filename)  // IN: filename to hash
+{
+   const unsigned char *p = (const unsigned char *)filename;
+   unsigned int hash = BLOCK_FNV_BASIS;
+
+   while (*p != '\0') {
+      hash ^= *p++;
+      hash *= BLOCK_FNV_PRIME;
+   }
+
+   return hash;
+}
+
+
+/*
+ *----------------------------------------------------------------------------
+ *
+ * BlockGetBucket --
+ *
+ *    Returns the hash table bucket a filename with the given hash lives in.
+ *
+ * Results:
+ *    Pointer to the bucket.
+ *
+ * Side effects:
+ *    None.
+ *
+ *----------------------------------------------------------------------------
+ */
+
+static BlockBucket *
+BlockGetBucket(unsigned int hash)  // IN: hash of filename
+{
+   /* Fold the high bits in; FNV-1a mixes its low bits poorly. */
+   return &blockTable[(hash ^ (hash >> BLOCK_HASH_BITS) ^
+                       (hash >> (2 * BLOCK_HASH_BITS))) & BLOCK_HASH_MASK];
+}
+
+
 /*
  *----------------------------------------------------------------------------
  *
@@ -172,6 +256,7 @@ BlockCleanup(void)
 static BlockInfo *
 AllocBlock(os_kmem_cache_t *cache,        // IN: cache to allocate from
            const char *filename,          // IN: filname of block
+           unsigned int hash,             // IN: hash of filename
            const os_blocker_id_t blocker) // IN: blocker id
 {
    BlockInfo *block;
@@ -194,6 +279,7 @@ AllocBlock(os_kmem_cache_t *cache,        // IN: cache to allocate from
    os_atomic_set(&block->refcount, 1);
    os_completion_init(&block->completion);
    block->blocker = blocker;
+   block->hash = hash;
 
    return block;
 }
@@ -292,11 +378,11 @@ BlockDropReference(BlockInfo *block)
  *
  * GetBlock --
  *
- *    Searches for a block on the provided filename by the provided blocker.
- *    If blocker is NULL, it is ignored and any matching filename is returned.
+ *    Searches the given bucket for a block on the provided filename by the
+ *    provided blocker.  If blocker is NULL, it is ignored and any matching
+ *    filename is returned.
  *
- *    Note that this assumes the proper locking has been done on the data
- *    structure holding the blocked files.
+ *    Note that this assumes the bucket's lock is held by the caller.
  *
  * Results:
  *    A pointer to the corresponding BlockInfo if found, NULL otherwise.
@@ -308,7 +394,9 @@ BlockDropReference(BlockInfo *block)
  */
 
 static BlockInfo *
-GetBlock(const char *filename,          // IN: file to find block for
+GetBlock(BlockBucket *bucket,           // IN: bucket filename hashes to
+         const char *filename,          // IN: file to find block for
+         unsigned int hash,             // IN: hash of filename
          const os_blocker_id_t blocker) // IN: blocker associated with this block
 {
    struct DblLnkLst_Links *curr;
@@ -320,14 +408,15 @@ GetBlock(const char *filename,          // IN: file to find block for
     * different name.
     */
 #ifdef os_assert_rwlock_held
-   os_assert_rwlock_held(&blockedFilesLock);
+   os_assert_rwlock_held(&bucket->lock);
 #else
-   ASSERT(os_rwlock_held(&blockedFilesLock));
+   ASSERT(os_rwlock_held(&bucket->lock));
 #endif
 
-   DblLnkLst_ForEach(curr, &blockedFiles) {
+   DblLnkLst_ForEach(curr, &bucket->blockedFiles) {
       BlockInfo *currBlock = DblLnkLst_Container(curr, BlockInfo, links);
-      if ((blocker == OS_UNKNOWN_BLOCKER || currBlock->blocker == blocker) &&
+      if (currBlock->hash == hash &&
+          (blocker == OS_UNKNOWN_BLOCKER || currBlock->blocker == blocker) &&
           strcmp(currBlock->filename, filename) == 0) {
          return currBlock;
       }
@@ -337,13 +426,58 @@ GetBlock(const char *filename,          // IN: file to find block for
 }
 
 
+/*
+ *----------------------------------------------------------------------------
+ *
+ * BlockFind --
+ *
+ *    Looks up a block on the provided filename and takes a reference on it.
+ *
+ *    Buckets with no blocks are skipped without taking their lock.  A block
+ *    being added concurrently may be missed, but that is no different from
+ *    the lookup having run just before the add.
+ *
+ * Results:
+ *    A referenced BlockInfo if found, NULL otherwise.
+ *
+ * Side effects:
+ *    None.
+ *
+ *----------------------------------------------------------------------------
+ */
+
+static BlockInfo *
+BlockFind(const char *filename,          // IN: file to find block for
+          const os_blocker_id_t blocker) // IN: blocker associated with this block
+{
+   unsigned int hash = BlockHash(filename);
+   BlockBucket *bucket = BlockGetBucket(hash);
+   BlockInfo *block;
+
+   if (os_atomic_read(&bucket->numBlocks) == 0) {
+      return NULL;
+   }
+
+   os_read_lock(&bucket->lock);
+
+   block = GetBlock(bucket, filename, hash, blocker);
+   if (block) {
+      BlockGrabReference(block);
+   }
+
+   os_read_unlock(&bucket->lock);
+
+   return block;
+}
+
+
 /*
  *----------------------------------------------------------------------------
  *
  * BlockDoRemoveBlock --
  *
- *    Removes given block from the block list and notifies waiters that block
- *    is gone.
+ *    Removes given block from its bucket and notifies waiters that block
+ *    is gone.  The bucket must be write-locked by the caller.
  *
  * Results:
  *    None.
@@ -355,11 +489,13 @@ GetBlock(const char *filename,          // IN: file to find block for
  */
 
 static void
-BlockDoRemoveBlock(BlockInfo *block)
+BlockDoRemoveBlock(BlockBucket *bucket,  // IN: bucket holding the block
+                   BlockInfo *block)     // IN: block to remove
 {
    ASSERT(block);
 
    DblLnkLst_Unlink1(&block->links);
+   os_atomic_dec(&bucket->numBlocks);
 
    /* Wake up waiters, if any */
    LOG(4, "Completing block on [%s] (%d waiters)\n",
@@ -399,31 +535,37 @@ int
 BlockAddFileBlock(const char *filename,           // IN: name of file to block
                   const os_blocker_id_t blocker)  // IN: blocker adding the block
 {
+   BlockBucket *bucket;
    BlockInfo *block;
+   unsigned int hash;
    int retval;
 
    ASSERT(filename);
 
-   os_write_lock(&blockedFilesLock);
+   hash = BlockHash(filename);
+   bucket = BlockGetBucket(hash);
+
+   os_write_lock(&bucket->lock);
 
-   if (GetBlock(filename, OS_UNKNOWN_BLOCKER)) {
+   if (GetBlock(bucket, filename, hash, OS_UNKNOWN_BLOCKER)) {
       retval = OS_EEXIST;
       goto out;
    }
 
-   block = AllocBlock(blockInfoCache, filename, blocker);
+   block = AllocBlock(blockInfoCache, filename, hash, blocker);
    if (!block) {
       Warning("BlockAddFileBlock: out of memory\n");
       retval = OS_ENOMEM;
       goto out;
    }
 
-   DblLnkLst_LinkLast(&blockedFiles, &block->links);
+   DblLnkLst_LinkLast(&bucket->blockedFiles, &block->links);
+   os_atomic_inc(&bucket->numBlocks);
    LOG(4, "added block for [%s]\n", filename);
    retval = 0;
 
 out:
-   os_write_unlock(&blockedFilesLock);
+   os_write_unlock(&bucket->lock);
    return retval;
 }
 
@@ -450,24 +592,29 @@ int
 BlockRemoveFileBlock(const char *filename,          // IN: block to remove
                      const os_blocker_id_t blocker) // IN: blocker removing this block
 {
+   BlockBucket *bucket;
    BlockInfo *block;
+   unsigned int hash;
    int retval;
 
    ASSERT(filename);
 
-   os_write_lock(&blockedFilesLock);
+   hash = BlockHash(filename);
+   bucket = BlockGetBucket(hash);
 
-   block = GetBlock(filename, blocker);
+   os_write_lock(&bucket->lock);
+
+   block = GetBlock(bucket, filename, hash, blocker);
    if (!block) {
       retval = OS_ENOENT;
       goto out;
    }
 
-   BlockDoRemoveBlock(block);
+   BlockDoRemoveBlock(bucket, block);
    retval = 0;
 
 out:
-   os_write_unlock(&blockedFilesLock);
+   os_write_unlock(&bucket->lock);
    return retval;
 }
 
@@ -494,24 +641,33 @@ BlockRemoveAllBlocks(const os_blocker_id_t blocker)  // IN: blocker to remove bl
    struct DblLnkLst_Links *curr;
    struct DblLnkLst_Links *tmp;
    unsigned int removed = 0;
+   unsigned int i;
 
-   os_write_lock(&blockedFilesLock);
+   for (i = 0; i < BLOCK_HASH_SIZE; i++) {
+      BlockBucket *bucket = &blockTable[i];
 
-   DblLnkLst_ForEachSafe(curr, tmp, &blockedFiles) {
-      BlockInfo *currBlock = DblLnkLst_Container(curr, BlockInfo, links);
-      if (currBlock->blocker == blocker || blocker == OS_UNKNOWN_BLOCKER) {
+      if (os_atomic_read(&bucket->numBlocks) == 0) {
+         continue;
+      }
+
+      os_write_lock(&bucket->lock);
+
+      DblLnkLst_ForEachSafe(curr, tmp, &bucket->blockedFiles) {
+         BlockInfo *currBlock = DblLnkLst_Container(curr, BlockInfo, links);
+         if (currBlock->blocker == blocker || blocker == OS_UNKNOWN_BLOCKER) {
 
-         BlockDoRemoveBlock(currBlock);
+            BlockDoRemoveBlock(bucket, currBlock);
 
-         /*
-          * We count only entries removed from the -list-, regardless of whether
-          * or not other waiters exist.
-          */
-         ++removed;
+            /*
+             * We count only entries removed from the -list-, regardless of
+             * whether or not other waiters exist.
+             */
+            ++removed;
+         }
       }
-   }
 
-   os_write_unlock(&blockedFilesLock);
+      os_write_unlock(&bucket->lock);
+   }
 
    return removed;
 }
@@ -552,13 +708,7 @@ BlockWaitOnFile(const char *filename,   // IN: file to block on
     * blocking here.)
     */
    if (cookie == NULL) {
-      os_read_lock(&blockedFilesLock);
-      block = GetBlock(filename, OS_UNKNOWN_BLOCKER);
-      if (block) {
-         BlockGrabReference(block);
-      }
-      os_read_unlock(&blockedFilesLock);
-
+      block = BlockFind(filename, OS_UNKNOWN_BLOCKER);
       if (!block) {
          /* This file is not blocked, just return */
          return 0;
@@ -604,18 +754,7 @@ BlockLookup(const char *filename,               // IN: pathname to test for
             const os_blocker_id_t blocker)      // IN: specific blocker to
                                                 //     search for
 {
-   BlockInfo *block;
-
-   os_read_lock(&blockedFilesLock);
-
-   block = GetBlock(filename, blocker);
-   if (block) {
-      BlockGrabReference(block);
-   }
-
-   os_read_unlock(&blockedFilesLock);
-
-   return block;
+   return BlockFind(filename, blocker);
 }
 
 
@@ -641,16 +780,21 @@ BlockListFileBlocks(void)
 {
    DblLnkLst_Links *curr;
    int count = 0;
+   unsigned int i;
 
-   os_read_lock(&blockedFilesLock);
+   for (i = 0; i < BLOCK_HASH_SIZE; i++) {
+      BlockBucket *bucket = &blockTable[i];
 
-   DblLnkLst_ForEach(curr, &blockedFiles) {
-      BlockInfo *currBlock = DblLnkLst_Container(curr, BlockInfo, links);
-      LOG(1, "BlockListFileBlocks: (%d) Filename: [%s], Blocker: [%p]\n",
-          count++, currBlock->filename, currBlock->blocker);
-   }
+      os_read_lock(&bucket->lock);
 
-   os_read_unlock(&blockedFilesLock);
+      DblLnkLst_ForEach(curr, &bucket->blockedFiles) {
+         BlockInfo *currBlock = DblLnkLst_Container(curr, BlockInfo, links);
+         LOG(1, "BlockListFileBlocks: (%d) Filename: [%s], Blocker: [%p]\n",
+             count++, currBlock->filename, currBlock->blocker);
+      }
+
+      os_read_unlock(&bucket->lock);
+   }
 
    if (!count) {
       LOG(1, "BlockListFileBlocks: No blocks currently exist.\n");
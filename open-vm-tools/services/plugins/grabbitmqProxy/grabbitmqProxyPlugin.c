@@ -924,7 +924,7 @@ VmxConnRecvedCb(void *buf,            // IN
       int packetLen = len + sizeof conn->packetLen;
 
       /* decoding the packet */
-      res = DataMap_Deserialize(conn->recvBuf, packetLen, &map);
+      res = DataMap_DeserializeView(conn->recvBuf, packetLen, &map);
       ASSERT(res == DMERR_SUCCESS);
 
       if (ProcessVmxDataPacket(conn->toConn, &map)) {
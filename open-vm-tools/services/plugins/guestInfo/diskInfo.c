@@ -36,14 +36,13 @@
 #include "util.h"
 #include "xdrutil.h"
 #include "netutil.h"
-#include "wiper.h"
 
 
 /*
  ******************************************************************************
  * GuestInfo_FreeDiskInfo --                                             */ /**
  *
- * @brief Frees memory allocated by GuestInfoGetDiskInfo.
+ * @brief Frees memory allocated by GuestInfo_GetDiskInfo.
  *
  * @param[in] di    DiskInfo container.
  *
@@ -59,86 +58,3 @@ GuestInfo_FreeDiskInfo(GuestDiskInfo *di)
    }
 }
 
-
-/*
- * Private library functions.
- */
-
-
-/*
- ******************************************************************************
- * GuestInfoGetDiskInfoWiper --                                          */ /**
- *
- * Uses wiper library to enumerate fixed volumes and lookup utilization data.
- *
- * @return Pointer to a GuestDiskInfo structure on success or NULL on failure.
- *         Caller should free returned pointer with GuestInfoFreeDiskInfo.
- *
- ******************************************************************************
- */
-
-GuestDiskInfo *
-GuestInfoGetDiskInfoWiper(void)
-{
-   WiperPartition_List pl;
-   DblLnkLst_Links *curr;
-   unsigned int partCount = 0;
-   uint64 freeBytes = 0;
-   uint64 totalBytes = 0;
-   unsigned int partNameSize = 0;
-   Bool success = FALSE;
-   GuestDiskInfo *di;
-
-   /* Get partition list. */
-   if (!WiperPartition_Open(&pl)) {
-      g_warning("GetDiskInfo: ERROR: could not get partition list\n");
-      return FALSE;
-   }
-
-   di = Util_SafeCalloc(1, sizeof *di);
-   partNameSize = sizeof (di->partitionList)[0].name;
-
-   DblLnkLst_ForEach(curr, &pl.link) {
-      WiperPartition *part = DblLnkLst_Container(curr, WiperPartition, link);
-
-      if (part->type != PARTITION_UNSUPPORTED) {
-         PPartitionEntry newPartitionList;
-         PPartitionEntry partEntry;
-         unsigned char *error;
-
-         error = WiperSinglePartition_GetSpace(part, &freeBytes, &totalBytes);
-         if (strlen(error)) {
-            g_warning("GetDiskInfo: ERROR: could not get space for partition %s: %s\n",
-                    part->mountPoint, error);
-            goto out;
-         }
-
-         if (strlen(part->mountPoint) + 1 > partNameSize) {
-            g_warning("GetDiskInfo: ERROR: Partition name buffer too small\n");
-            goto out;
-         }
-
-         newPartitionList = Util_SafeRealloc(di->partitionList,
-                                             (partCount + 1) *
-                                             sizeof *di->partitionList);
-
-         partEntry = &newPartitionList[partCount++];
-         Str_Strcpy(partEntry->name, part->mountPoint, partNameSize);
-         partEntry->freeBytes = freeBytes;
-         partEntry->totalBytes = totalBytes;
-
-         di->partitionList = newPartitionList;
-      }
-   }
-
-   di->numEntries = partCount;
-   success = TRUE;
-
-out:
-   if (!success) {
-      GuestInfo_FreeDiskInfo(di);
-      di = NULL;
-   }
-   WiperPartition_Close(&pl);
-   return di;
-}
@@ -20,12 +20,302 @@
  * @file diskInfoPosix.c
  *
  * Contains POSIX-specific bits of gettting disk information.
+ *
+ * Free space is sampled per file system on a private thread pool, so a slow
+ * or hung mount (a dead NFS server, a stuck FUSE daemon) delays the gather by
+ * at most DISKINFO_SAMPLE_TIMEOUT_MS instead of indefinitely, and never ties
+ * up the shared vmtoolsd pool.  A file system whose sample does not arrive in
+ * time is reported with its last known values; one whose previous statfs() is
+ * still stuck is not sampled again until it returns.  The pool has
+ * DISKINFO_MAX_THREADS threads plus one for every such stuck statfs(), so
+ * hung mounts cannot starve the others.
+ *
+ * Small changes in free space are not reported: the values sent for a file
+ * system only change once free space has moved by more than
+ * DISKINFO_CHANGE_FRACTION of its size, which lets DiskInfoChanged() in
+ * guestInfoServer.c suppress the update when nothing significant changed.
  */
 
+#include <string.h>
+
 #include "util.h"
 #include "vmware.h"
+#include "str.h"
+#include "wiper.h"
 #include "guestInfoInt.h"
 
+/** How long a gather waits for statfs() results, in milliseconds. */
+#define DISKINFO_SAMPLE_TIMEOUT_MS  1000
+
+/**
+ * Number of threads sampling file systems, not counting those stuck in a
+ * statfs() since an earlier gather.
+ */
+#define DISKINFO_MAX_THREADS        4
+
+/**
+ * Free space changes smaller than 1/DISKINFO_CHANGE_FRACTION of the file
+ * system size (and than DISKINFO_CHANGE_MIN bytes) are not reported.
+ */
+#define DISKINFO_CHANGE_FRACTION    10000
+#define DISKINFO_CHANGE_MIN         (1024 * 1024)
+
+typedef struct DiskInfoSample {
+   char     *mountPoint;
+   gboolean  queued;         // Submitted, waiting for a thread.
+   gboolean  running;        // A statfs() is running.
+   gboolean  orphaned;       // Dropped while queued or running; freed by
+                             // the worker.
+   guint     round;          // Gather round of the last statfs() submitted.
+   guint     sampledRound;   // Gather round of the last successful statfs().
+   guint     seenRound;      // Last gather round the file system was mounted.
+   gboolean  valid;          // freeBytes and totalBytes hold a sample.
+   uint64    freeBytes;
+   uint64    totalBytes;
+   gboolean  reported;       // reportedFree and reportedTotal are set.
+   uint64    reportedFree;
+   uint64    reportedTotal;
+} DiskInfoSample;
+
+/**
+ * State shared with the workers.  The plugin holds a reference until
+ * GuestInfo_ShutdownDiskInfo() and every queued or running sample holds
+ * one, so workers that are still stuck in statfs() after shutdown keep it
+ * alive until they return.
+ */
+typedef struct DiskInfoState {
+   GMutex      *lock;        // Protects everything below and all samples.
+   GCond       *cond;
+   guint        refCount;
+   GHashTable  *samples;     // Mount point -> DiskInfoSample.
+   guint        round;
+   guint        pending;     // statfs() calls of this round not done yet.
+   guint        numRunning;  // statfs() calls running.
+   uint64       numStale;    // Entries reported with an old sample.
+   uint64       numSkipped;  // Entries not sampled, previous call stuck.
+} DiskInfoState;
+
+static DiskInfoState *gDiskInfo;
+static GThreadPool *gDiskInfoPool;   // NULL if statfs() is called inline.
+
+
+/*
+ ******************************************************************************
+ * DiskInfoSampleFree --                                                 */ /**
+ *
+ * Frees a sample.
+ *
+ * @param[in] sample    The sample.
+ *
+ ******************************************************************************
+ */
+
+static void
+DiskInfoSampleFree(DiskInfoSample *sample)
+{
+   free(sample->mountPoint);
+   free(sample);
+}
+
+
+/*
+ ******************************************************************************
+ * DiskInfoStateUnref --                                                 */ /**
+ *
+ * Drops a reference to the shared state and unlocks it.  The last reference
+ * frees it.
+ *
+ * @param[in] state     The state, locked.
+ *
+ ******************************************************************************
+ */
+
+static void
+DiskInfoStateUnref(DiskInfoState *state)
+{
+   gboolean last;
+
+   ASSERT(state->refCount > 0);
+   last = --state->refCount == 0;
+   g_mutex_unlock(state->lock);
+
+   if (last) {
+      ASSERT(state->samples == NULL);
+      g_cond_free(state->cond);
+      g_mutex_free(state->lock);
+      free(state);
+   }
+}
+
+
+/*
+ ******************************************************************************
+ * DiskInfoSampleWorker --                                               */ /**
+ *
+ * Thread pool worker: calls statfs() on a file system and records the result.
+ *
+ * @param[in] data      The sample to update.
+ * @param[in] userData  The shared state.
+ *
+ ******************************************************************************
+ */
+
+static void
+DiskInfoSampleWorker(gpointer data,
+                     gpointer userData)
+{
+   DiskInfoSample *sample = data;
+   DiskInfoState *state = userData;
+
+   g_mutex_lock(state->lock);
+   sample->queued = FALSE;
+
+   if (!sample->orphaned) {
+      WiperPartition part;
+      uint64 freeBytes = 0;
+      uint64 totalBytes = 0;
+      unsigned char *error;
+
+      sample->running = TRUE;
+      state->numRunning++;
+      g_mutex_unlock(state->lock);
+
+      /* mountPoint never changes and the sample cannot go away meanwhile. */
+      memset(&part, 0, sizeof part);
+      Str_Strcpy((char *) part.mountPoint, sample->mountPoint,
+                 sizeof part.mountPoint);
+      error = WiperSinglePartition_GetSpace(&part, &freeBytes, &totalBytes);
+
+      g_mutex_lock(state->lock);
+      sample->running = FALSE;
+      state->numRunning--;
+
+      if (*error == '\0') {
+         sample->valid = TRUE;
+         sample->freeBytes = freeBytes;
+         sample->totalBytes = totalBytes;
+         sample->sampledRound = sample->round;
+      } else {
+         g_debug("GetDiskInfo: could not get space for partition %s: %s\n",
+                 sample->mountPoint, error);
+      }
+   }
+
+   if (sample->round == state->round && state->pending > 0 &&
+       --state->pending == 0) {
+      g_cond_broadcast(state->cond);
+   }
+
+   if (sample->orphaned) {
+      DiskInfoSampleFree(sample);
+   }
+
+   DiskInfoStateUnref(state);
+}
+
+
+/*
+ ******************************************************************************
+ * DiskInfoSampleSubmit --                                               */ /**
+ *
+ * Queues a statfs() of a file system for this gather round, or runs it
+ * inline if there is no thread pool.
+ *
+ * @param[in] state     The shared state, locked.
+ * @param[in] sample    The sample, neither queued nor running.
+ *
+ ******************************************************************************
+ */
+
+static void
+DiskInfoSampleSubmit(DiskInfoState *state,
+                     DiskInfoSample *sample)
+{
+   ASSERT(!sample->queued && !sample->running);
+
+   sample->queued = TRUE;
+   sample->round = state->round;
+   state->pending++;
+   state->refCount++;
+
+   if (gDiskInfoPool != NULL) {
+      g_thread_pool_push(gDiskInfoPool, sample, NULL);
+   } else {
+      g_mutex_unlock(state->lock);
+      DiskInfoSampleWorker(sample, state);
+      g_mutex_lock(state->lock);
+   }
+}
+
+
+/*
+ ******************************************************************************
+ * DiskInfoSamplePrune --                                                */ /**
+ *
+ * g_hash_table_foreach_remove callback dropping samples of file systems that
+ * are no longer mounted (or all samples, if @a data is TRUE).
+ *
+ * @param[in] key       Unused.
+ * @param[in] value     The sample.
+ * @param[in] data      Whether to drop all samples.
+ *
+ * @return TRUE if the sample was removed.
+ *
+ ******************************************************************************
+ */
+
+static gboolean
+DiskInfoSamplePrune(gpointer key,
+                    gpointer value,
+                    gpointer data)
+{
+   DiskInfoSample *sample = value;
+
+   if (!GPOINTER_TO_INT(data) && sample->seenRound == gDiskInfo->round) {
+      return FALSE;
+   }
+
+   if (sample->queued || sample->running) {
+      sample->orphaned = TRUE;
+   } else {
+      DiskInfoSampleFree(sample);
+   }
+
+   return TRUE;
+}
+
+
+/*
+ ******************************************************************************
+ * DiskInfoSampleUpdateReported --                                       */ /**
+ *
+ * Updates the values reported for a file system from its latest sample,
+ * unless free space changed by less than the reporting threshold.
+ *
+ * @param[in] sample    The sample.
+ *
+ ******************************************************************************
+ */
+
+static void
+DiskInfoSampleUpdateReported(DiskInfoSample *sample)
+{
+   if (sample->reported && sample->totalBytes == sample->reportedTotal) {
+      uint64 delta = sample->freeBytes > sample->reportedFree ?
+                     sample->freeBytes - sample->reportedFree :
+                     sample->reportedFree - sample->freeBytes;
+
+      if (delta < MAX(sample->totalBytes / DISKINFO_CHANGE_FRACTION,
+                      DISKINFO_CHANGE_MIN)) {
+         return;
+      }
+   }
+
+   sample->reported = TRUE;
+   sample->reportedFree = sample->freeBytes;
+   sample->reportedTotal = sample->totalBytes;
+}
+
 
 /*
  ******************************************************************************
@@ -42,5 +332,184 @@
 GuestDiskInfo *
 GuestInfo_GetDiskInfo(void)
 {
-   return GuestInfoGetDiskInfoWiper();
+   WiperPartition_List pl;
+   DblLnkLst_Links *curr;
+   DiskInfoState *state;
+   GuestDiskInfo *di;
+   GTimeVal deadline;
+   unsigned int numParts = 0;
+   unsigned int numStale = 0;
+   unsigned int numSkipped = 0;
+
+   if (!WiperPartition_Open(&pl)) {
+      g_warning("GetDiskInfo: ERROR: could not get partition list\n");
+      return NULL;
+   }
+
+   if (gDiskInfo == NULL) {
+      GError *err = NULL;
+
+      gDiskInfo = Util_SafeCalloc(1, sizeof *gDiskInfo);
+      gDiskInfo->lock = g_mutex_new();
+      gDiskInfo->cond = g_cond_new();
+      gDiskInfo->refCount = 1;
+      gDiskInfo->samples = g_hash_table_new(g_str_hash, g_str_equal);
+
+      gDiskInfoPool = g_thread_pool_new(DiskInfoSampleWorker, gDiskInfo,
+                                        DISKINFO_MAX_THREADS, FALSE, &err);
+      if (err != NULL) {
+         g_warning("GetDiskInfo: could not create thread pool: %s\n",
+                   err->message);
+         g_clear_error(&err);
+         gDiskInfoPool = NULL;
+      }
+   }
+   state = gDiskInfo;
+
+   g_mutex_lock(state->lock);
+
+   state->round++;
+   state->pending = 0;
+
+   /*
+    * Every statfs() still running is stuck since an earlier round and holds
+    * a thread; add as many so that the other file systems still get
+    * DISKINFO_MAX_THREADS.
+    */
+   if (gDiskInfoPool != NULL) {
+      g_thread_pool_set_max_threads(gDiskInfoPool,
+                                    DISKINFO_MAX_THREADS + state->numRunning,
+                                    NULL);
+   }
+
+   /* Start sampling every file system that is not still busy. */
+   DblLnkLst_ForEach(curr, &pl.link) {
+      WiperPartition *part = DblLnkLst_Container(curr, WiperPartition, link);
+      DiskInfoSample *sample;
+
+      if (part->type == PARTITION_UNSUPPORTED) {
+         continue;
+      }
+
+      numParts++;
+
+      sample = g_hash_table_lookup(state->samples, part->mountPoint);
+      if (sample == NULL) {
+         sample = Util_SafeCalloc(1, sizeof *sample);
+         sample->mountPoint = Util_SafeStrdup((char *) part->mountPoint);
+         g_hash_table_insert(state->samples, sample->mountPoint, sample);
+      }
+      sample->seenRound = state->round;
+
+      if (sample->running) {
+         numSkipped++;
+      } else if (sample->queued) {
+         /* Not picked up last round; wait for it in this one. */
+         if (sample->round != state->round) {
+            sample->round = state->round;
+            state->pending++;
+         }
+      } else {
+         DiskInfoSampleSubmit(state, sample);
+      }
+   }
+
+   g_get_current_time(&deadline);
+   g_time_val_add(&deadline, DISKINFO_SAMPLE_TIMEOUT_MS * 1000);
+   while (state->pending > 0) {
+      if (!g_cond_timed_wait(state->cond, state->lock, &deadline)) {
+         break;
+      }
+   }
+
+   /* Report in mount table order, falling back to old samples if needed. */
+   di = Util_SafeCalloc(1, sizeof *di);
+   di->partitionList = Util_SafeCalloc(MAX(numParts, 1),
+                                       sizeof *di->partitionList);
+
+   DblLnkLst_ForEach(curr, &pl.link) {
+      WiperPartition *part = DblLnkLst_Container(curr, WiperPartition, link);
+      DiskInfoSample *sample;
+      PPartitionEntry partEntry;
+
+      if (part->type == PARTITION_UNSUPPORTED) {
+         continue;
+      }
+
+      sample = g_hash_table_lookup(state->samples, part->mountPoint);
+      ASSERT(sample != NULL);
+
+      if (sample->sampledRound != state->round) {
+         numStale++;
+      }
+      if (!sample->valid) {
+         continue;
+      }
+
+      if (strlen(sample->mountPoint) + 1 > sizeof partEntry->name) {
+         g_warning("GetDiskInfo: ERROR: Partition name buffer too small\n");
+         continue;
+      }
+
+      DiskInfoSampleUpdateReported(sample);
+
+      partEntry = &di->partitionList[di->numEntries++];
+      Str_Strcpy(partEntry->name, sample->mountPoint, sizeof partEntry->name);
+      partEntry->freeBytes = sample->reportedFree;
+      partEntry->totalBytes = sample->reportedTotal;
+   }
+
+   g_hash_table_foreach_remove(state->samples, DiskInfoSamplePrune,
+                               GINT_TO_POINTER(FALSE));
+
+   state->numStale += numStale;
+   state->numSkipped += numSkipped;
+
+   if (numStale > 0 || numSkipped > 0) {
+      g_debug("GetDiskInfo: %u of %u file systems not sampled in time, "
+              "%u stuck (%"FMT64"u stale, %"FMT64"u skipped overall)\n",
+              numStale, numParts, numSkipped, state->numStale,
+              state->numSkipped);
+   }
+
+   g_mutex_unlock(state->lock);
+
+   WiperPartition_Close(&pl);
+   return di;
+}
+
+
+/*
+ ******************************************************************************
+ * GuestInfo_ShutdownDiskInfo --                                         */ /**
+ *
+ * Drops the cached samples and stops the sampling thread pool. Workers stuck
+ * in statfs() are not waited for; they free their sample and, if they are
+ * the last, the shared state when they return.
+ *
+ ******************************************************************************
+ */
+
+void
+GuestInfo_ShutdownDiskInfo(void)
+{
+   DiskInfoState *state = gDiskInfo;
+
+   if (state == NULL) {
+      return;
+   }
+
+   g_mutex_lock(state->lock);
+   g_hash_table_foreach_remove(state->samples, DiskInfoSamplePrune,
+                               GINT_TO_POINTER(TRUE));
+   g_hash_table_destroy(state->samples);
+   state->samples = NULL;
+   gDiskInfo = NULL;
+   DiskInfoStateUnref(state);
+
+   /* Queued samples are orphaned now; the workers just drop them. */
+   if (gDiskInfoPool != NULL) {
+      g_thread_pool_free(gDiskInfoPool, FALSE, FALSE);
+      gDiskInfoPool = NULL;
+   }
 }
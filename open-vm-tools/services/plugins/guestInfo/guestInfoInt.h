@@ -60,12 +60,14 @@ GuestInfo_ServerReportStats(ToolsAppCtx *ctx,  // IN
 gboolean
 GuestInfo_StatProviderPoll(gpointer data);
 
-GuestDiskInfo *
-GuestInfoGetDiskInfoWiper(void);
-
 GuestDiskInfo *
 GuestInfo_GetDiskInfo(void);
 
+#if !defined(_WIN32)
+void
+GuestInfo_ShutdownDiskInfo(void);
+#endif
+
 void
 GuestInfo_FreeDiskInfo(GuestDiskInfo *di);
 
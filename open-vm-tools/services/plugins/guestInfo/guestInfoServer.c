@@ -1466,23 +1466,36 @@ GuestInfo_ServerReportStats(
 
 /*
  ******************************************************************************
- * GuestInfoServerConfReload --                                          */ /**
+ * GuestInfoServerConfChanged --                                         */ /**
  *
- * @brief Reconfigures the poll loop interval upon config file reload.
+ * @brief Reconfigures the gather loops when one of the keys they read from
+ * the guestinfo section of the config file changes.
  *
  * @param[in]  src     The source object.
  * @param[in]  ctx     The application context.
+ * @param[in]  changes Changed keys, per config group.
  * @param[in]  data    Unused.
  *
  ******************************************************************************
  */
 
 static void
-GuestInfoServerConfReload(gpointer src,
-                          ToolsAppCtx *ctx,
-                          gpointer data)
+GuestInfoServerConfChanged(gpointer src,
+                           ToolsAppCtx *ctx,
+                           GHashTable *changes,
+                           gpointer data)
 {
-   TweakGatherLoops(ctx, TRUE);
+   const gchar * const *keys = g_hash_table_lookup(changes,
+                                                   CONFGROUPNAME_GUESTINFO);
+
+   for (; keys != NULL && *keys != NULL; keys++) {
+      if (strcmp(*keys, CONFNAME_GUESTINFO_POLLINTERVAL) == 0 ||
+          strcmp(*keys, CONFNAME_GUESTINFO_STATSINTERVAL) == 0 ||
+          strcmp(*keys, CONFNAME_GUESTINFO_DISABLEPERFMON) == 0) {
+         TweakGatherLoops(ctx, TRUE);
+         break;
+      }
+   }
 }
 
 
@@ -1544,6 +1557,8 @@ GuestInfoServerShutdown(gpointer src,
 #ifdef _WIN32
    GuestInfo_StatProviderShutdown();
    NetUtil_FreeIpHlpApiDll();
+#else
+   GuestInfo_ShutdownDiskInfo();
 #endif
 }
 
@@ -1688,7 +1703,7 @@ ToolsOnLoad(ToolsAppCtx *ctx)
       };
       ToolsPluginSignalCb sigs[] = {
          { TOOLS_CORE_SIG_CAPABILITIES, GuestInfoServerSendCaps, NULL },
-         { TOOLS_CORE_SIG_CONF_RELOAD, GuestInfoServerConfReload, NULL },
+         { TOOLS_CORE_SIG_CONF_CHANGED, GuestInfoServerConfChanged, NULL },
          { TOOLS_CORE_SIG_IO_FREEZE, GuestInfoServerIOFreeze, NULL },
          { TOOLS_CORE_SIG_RESET, GuestInfoServerReset, NULL },
          { TOOLS_CORE_SIG_SET_OPTION, GuestInfoServerSetOption, NULL },
@@ -226,6 +226,14 @@ char *gImpersonatedUsername = NULL;
  * secret form of authentication.
  */
 #define  VIX_TOOLS_CONFIG_API_AUTHENTICATION          "Authentication"
+
+/*
+ * Seconds a successful name/password authentication is remembered;
+ * 0 disables the cache. Off unless configured, since a cache hit skips
+ * the PAM account checks.
+ */
+#define  VIX_TOOLS_CONFIG_AUTH_CACHE_TIMEOUT          "authCacheTimeout"
+#define  VIX_TOOLS_CONFIG_AUTH_CACHE_TIMEOUT_DEFAULT  0
 #define  VIX_TOOLS_CONFIG_AUTHTYPE_AGENTS             "InfrastructureAgents"
 
 #define VIX_TOOLS_CONFIG_INFRA_AGENT_DISABLED_DEFAULT  TRUE
@@ -306,10 +314,10 @@ typedef struct VixToolsStartProgramState {
  * Tracks processes started via StartProgram, so their exit information can
  * be returned with ListProcessesEx()
  *
- * We need live and dead because the exit status is fetched by from
- * a timer loop, and StartProgram of a very short lived program
- * followed immediately by a ListProcesses could miss the program
- * if we don't save it off for before the timer fires.
+ * We need live and dead because the exit status is fetched from the main
+ * loop when the process' selectable fires, and StartProgram of a very
+ * short lived program followed immediately by a ListProcesses could miss
+ * the program if we don't save it off before that happens.
  *
  * This data is also useful to optimize ListProcessesEx.
  *
@@ -329,10 +337,16 @@ typedef struct VixToolsStartedProgramState {
    time_t endTime;
    Bool isRunning;
    ProcMgr_AsyncProc *procState;
-   struct VixToolsStartedProgramState *next;
+   GList *expiryLink;
 } VixToolsStartedProgramState;
 
-static VixToolsStartedProgramState *startedProcessList = NULL;
+/*
+ * Started programs, keyed by pid. Exited ones are also on
+ * exitedProgramQueue, oldest endTime first, so expired records can be
+ * dropped without looking at the others.
+ */
+static GHashTable *startedProgramTable = NULL;
+static GQueue exitedProgramQueue = G_QUEUE_INIT;
 
 /*
  * How long we keep the info of exited processes.
@@ -409,7 +423,6 @@ static GKeyFile *gConfDictRef = NULL;
  */
 static gboolean gRestrictCommands = FALSE;
 
-#ifndef _WIN32
 typedef struct VixToolsEnvironmentTableIterator {
    char **envp;
    size_t pos;
@@ -431,25 +444,30 @@ static VixError VixToolsSetFileAttributes(VixCommandRequestHeader *requestMsg);
 
 static gboolean VixToolsMonitorAsyncProc(void *clientData);
 static gboolean VixToolsMonitorStartProgram(void *clientData);
+static void VixToolsWatchAsyncProc(ProcMgr_AsyncProc *procState,
+                                   void *eventQueue,
+                                   GSourceFunc callback,
+                                   void *clientData);
 static void VixToolsRegisterHgfsSessionInvalidator(void *clientData);
 static gboolean VixToolsInvalidateInactiveHGFSSessions(void *clientData);
 
 static GSource *gHgfsSessionInvalidatorTimer = NULL;
 static guint gHgfsSessionInvalidatorTimerId;
 
-static void VixToolsPrintFileInfo(const char *filePathName,
+static void VixToolsPrintFileInfo(const VixToolsFileStat *fileStat,
                                   char *fileName,
                                   Bool escapeStrs,
                                   char **destPtr,
                                   char *endDestPtr);
 
-static int VixToolsGetFileExtendedInfoLength(const char *filePathName,
+static int VixToolsGetFileExtendedInfoLength(const VixToolsFileStat *fileStat,
                                              const char *fileName);
 
 static char *VixToolsPrintFileExtendedInfoEx(const char *filePathName,
                                              const char *fileName);
 
 static void VixToolsPrintFileExtendedInfo(const char *filePathName,
+                                          const VixToolsFileStat *fileStat,
                                           const char *fileName,
                                           char **destPtr,
                                           char *endDestPtr);
@@ -649,6 +667,10 @@ static VixError VixToolsImpersonateUserImplEx(char const *credentialTypeStr,
 
 static VixError VixToolsDoesUsernameMatchCurrentUser(const char *username);
 
+#ifndef _WIN32
+static int VixToolsAuthCacheTimeout(void);
+#endif
+
 static Bool VixToolsPidRefersToThisProcess(ProcMgr_Pid pid);
 
 #ifndef _WIN32
@@ -750,6 +772,8 @@ VixTools_Initialize(Bool thisProcessRunsAsRootParam,
                                                      NULL,
                                                      VixToolsFreeCachedResult);
 
+   startedProgramTable = g_hash_table_new(g_int64_hash, g_int64_equal);
+
 #if SUPPORT_VGAUTH
    /*
     * We don't set up the VGAuth log handler, since the default
@@ -800,6 +824,10 @@ VixTools_Uninitialize(void) // IN
    }
 
    HgfsServerManager_Unregister(&gVixHgfsBkdrConn);
+
+#ifndef _WIN32
+   VixToolsAuthCacheFlush();
+#endif
 }
 
 
@@ -1349,7 +1377,7 @@ VixTools_StartProgram(VixCommandRequestHeader *requestMsg, // IN
       spState->exitCode = 0;
       spState->endTime = 0;
       spState->isRunning = TRUE;
-      spState->next = NULL;
+      spState->expiryLink = NULL;
       spState->procState = NULL;
 
       // add it to the list of started programs
@@ -1416,7 +1444,6 @@ VixToolsRunProgramImpl(char *requestName,      // IN
    STARTUPINFO si;
    wchar_t *envBlock = NULL;
 #endif
-   GSource *timer;
 
    if (NULL != pid) {
       *pid = (int64) -1;
@@ -1549,13 +1576,11 @@ VixToolsRunProgramImpl(char *requestName,      // IN
    }
 
    /*
-    * Start a periodic procedure to check the app periodically
+    * Get called back when the app exits.
     */
    asyncState->eventQueue = eventQueue;
-   timer = g_timeout_source_new(SECONDS_BETWEEN_POLL_TEST_FINISHED * 1000);
-   g_source_set_callback(timer, VixToolsMonitorAsyncProc, asyncState, NULL);
-   g_source_attach(timer, g_main_loop_get_context(eventQueue));
-   g_source_unref(timer);
+   VixToolsWatchAsyncProc(asyncState->procState, eventQueue,
+                          VixToolsMonitorAsyncProc, asyncState);
 
    /*
     * VixToolsMonitorAsyncProc will clean asyncState up when the program finishes.
@@ -1624,7 +1649,6 @@ VixToolsStartProgramImpl(const char *requestName,            // IN
    wchar_t *envBlock = NULL;
    Bool envBlockFromMalloc = TRUE;
 #endif
-   GSource *timer;
 
    /*
     * Initialize this here so we can call free on its member variables in abort
@@ -1805,13 +1829,11 @@ VixToolsStartProgramImpl(const char *requestName,            // IN
            __FUNCTION__, fullCommandLine, *pid);
 
    /*
-    * Start a periodic procedure to check the app periodically
+    * Get called back when the app exits.
     */
    asyncState->eventQueue = eventQueue;
-   timer = g_timeout_source_new(SECONDS_BETWEEN_POLL_TEST_FINISHED * 1000);
-   g_source_set_callback(timer, VixToolsMonitorStartProgram, asyncState, NULL);
-   g_source_attach(timer, g_main_loop_get_context(eventQueue));
-   g_source_unref(timer);
+   VixToolsWatchAsyncProc(asyncState->procState, eventQueue,
+                          VixToolsMonitorStartProgram, asyncState);
 
    /*
     * VixToolsMonitorStartProgram will clean asyncState up when the program
@@ -1845,9 +1867,9 @@ abort:
  *
  * VixToolsMonitorAsyncProc --
  *
- *    This polls a program running in the guest to see if it has completed.
- *    It is used by the test/dev code to detect when a test application
- *    completes.
+ *    Called when a program running in the guest has completed, or may
+ *    have. It is used by the test/dev code to detect when a test
+ *    application completes.
  *
  * Return value:
  *    TRUE on non-glib implementation.
@@ -1882,15 +1904,22 @@ VixToolsMonitorAsyncProc(void *clientData) // IN
     * that freeze the filesystem.
     */
    procIsRunning = ProcMgr_IsAsyncProcRunning(asyncState->procState);
-   if (!procIsRunning) {
-      if (gRestrictCommands) {
-         g_debug("%s: Deferring RunScript cleanup due to IO freeze\n",
-                 __FUNCTION__);
-      } else {
-         goto cleanup;
-      }
+   if (procIsRunning) {
+      VixToolsWatchAsyncProc(asyncState->procState, asyncState->eventQueue,
+                             VixToolsMonitorAsyncProc, asyncState);
+      return FALSE;
+   }
+
+   if (!gRestrictCommands) {
+      goto cleanup;
    }
 
+   /*
+    * The process' selectable stays signalled until it is cleaned up, so
+    * watching it again would spin; retry on a timer instead.
+    */
+   g_debug("%s: Deferring RunScript cleanup due to IO freeze\n",
+           __FUNCTION__);
    timer = g_timeout_source_new(SECONDS_BETWEEN_POLL_TEST_FINISHED * 1000);
    g_source_set_callback(timer, VixToolsMonitorAsyncProc, asyncState, NULL);
    g_source_attach(timer, g_main_loop_get_context(asyncState->eventQueue));
@@ -1933,6 +1962,101 @@ cleanup:
 } // VixToolsMonitorAsyncProc
 
 
+#if !defined(_WIN32)
+/*
+ * Completion callback of a program watched by VixToolsWatchAsyncProc.
+ */
+typedef struct VixToolsAsyncProcWatch {
+   GSourceFunc callback;
+   void *clientData;
+} VixToolsAsyncProcWatch;
+
+
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * VixToolsAsyncProcWatchDispatch --
+ *
+ *    GIOChannel watch callback for VixToolsWatchAsyncProc.
+ *
+ * Return value:
+ *    Whatever the program's completion callback returns.
+ *
+ * Side effects:
+ *    None
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+static gboolean
+VixToolsAsyncProcWatchDispatch(GIOChannel *chan,    // IN: unused
+                               GIOCondition cond,   // IN: unused
+                               gpointer data)       // IN
+{
+   VixToolsAsyncProcWatch *watch = data;
+
+   return watch->callback(watch->clientData);
+}
+#endif
+
+
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * VixToolsWatchAsyncProc --
+ *
+ *    Arranges for callback to run on eventQueue once the program has
+ *    exited. This waits on the process' selectable: a pidfd or the
+ *    procMgr waiter pipe on POSIX, the process handle on Windows, so
+ *    the callback runs as soon as the program is done rather than on
+ *    the next poll.
+ *
+ *    The watch goes away when the callback returns FALSE, which it must
+ *    do once it has seen the exit, as the selectable stays signalled.
+ *
+ * Return value:
+ *    None
+ *
+ * Side effects:
+ *    Attaches a source to eventQueue.
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+static void
+VixToolsWatchAsyncProc(ProcMgr_AsyncProc *procState,   // IN
+                       void *eventQueue,               // IN
+                       GSourceFunc callback,           // IN
+                       void *clientData)               // IN
+{
+   GSource *watchSource;
+#if !defined(_WIN32)
+   GIOChannel *chan;
+   VixToolsAsyncProcWatch *watch;
+#endif
+
+#if defined(_WIN32)
+   watchSource =
+      VMTools_NewHandleSource(ProcMgr_GetAsyncProcSelectable(procState));
+   g_source_set_callback(watchSource, callback, clientData, NULL);
+#else
+   chan = g_io_channel_unix_new(ProcMgr_GetAsyncProcSelectable(procState));
+   watchSource = g_io_create_watch(chan, G_IO_IN | G_IO_HUP | G_IO_ERR);
+   g_io_channel_unref(chan);   // Ownership transferred to watchSource.
+
+   watch = g_new(VixToolsAsyncProcWatch, 1);
+   watch->callback = callback;
+   watch->clientData = clientData;
+   g_source_set_callback(watchSource,
+                         (GSourceFunc) VixToolsAsyncProcWatchDispatch,
+                         watch, g_free);
+#endif
+
+   g_source_attach(watchSource, g_main_loop_get_context(eventQueue));
+   g_source_unref(watchSource);
+} // VixToolsWatchAsyncProc
+
+
 /*
  *----------------------------------------------------------------------------
  *
@@ -2024,9 +2148,9 @@ VixToolsRegisterHgfsSessionInvalidator(void *clientData)    // IN:
  *
  * VixToolsMonitorStartProgram --
  *
- *    This polls a program started by StartProgram to see if it has completed.
- *    If it has, saves off its exitCode and endTime so they can be queried
- *    via ListProcessesEx.
+ *    Called when a program started by StartProgram has completed, or may
+ *    have. If it has, saves off its exitCode and endTime so they can be
+ *    queried via ListProcessesEx.
  *
  * Return value:
  *    TRUE on non-glib implementation.
@@ -2047,7 +2171,6 @@ VixToolsMonitorStartProgram(void *clientData) // IN
    ProcMgr_Pid pid = -1;
    int result = -1;
    VixToolsStartedProgramState *spState;
-   GSource *timer;
 
    asyncState = (VixToolsStartProgramState *) clientData;
    ASSERT(asyncState);
@@ -2060,10 +2183,8 @@ VixToolsMonitorStartProgram(void *clientData) // IN
       goto done;
    }
 
-   timer = g_timeout_source_new(SECONDS_BETWEEN_POLL_TEST_FINISHED * 1000);
-   g_source_set_callback(timer, VixToolsMonitorStartProgram, asyncState, NULL);
-   g_source_attach(timer, g_main_loop_get_context(asyncState->eventQueue));
-   g_source_unref(timer);
+   VixToolsWatchAsyncProc(asyncState->procState, asyncState->eventQueue,
+                          VixToolsMonitorStartProgram, asyncState);
    return FALSE;
 
 done:
@@ -2091,7 +2212,7 @@ done:
    spState->exitCode = exitCode;
    spState->endTime = time(NULL);
    spState->isRunning = FALSE;
-   spState->next = NULL;
+   spState->expiryLink = NULL;
    spState->procState = asyncState->procState;
 
    // add it to the list of exited programs
@@ -2103,13 +2224,42 @@ done:
 } // VixToolsMonitorStartProgram
 
 
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * VixToolsRemoveStartedProgramState --
+ *
+ *    Takes a started program's state out of the table and the expiry
+ *    queue, and frees it.
+ *
+ * Return value:
+ *    None
+ *
+ * Side effects:
+ *    None
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+static void
+VixToolsRemoveStartedProgramState(VixToolsStartedProgramState *spState) // IN
+{
+   g_hash_table_remove(startedProgramTable, &spState->pid);
+   if (NULL != spState->expiryLink) {
+      g_queue_delete_link(&exitedProgramQueue, spState->expiryLink);
+   }
+   VixToolsFreeStartedProgramState(spState);
+} // VixToolsRemoveStartedProgramState
+
+
 /*
  *-----------------------------------------------------------------------------
  *
  * VixToolsUpdateStartedProgramList --
  *
- *    Adds a new started program's state to the saved list, and
- *    removes any that have been there too long.
+ *    Adds a new started program's state to the saved table, or records
+ *    the exit of one already there, and removes any that have been there
+ *    too long.
  *
  * Return value:
  *    None
@@ -2122,99 +2272,76 @@ done:
 static void
 VixToolsUpdateStartedProgramList(VixToolsStartedProgramState *state)        // IN
 {
-   VixToolsStartedProgramState *spList = NULL;
-   VixToolsStartedProgramState *last = NULL;
-   VixToolsStartedProgramState *old = NULL;
+   VixToolsStartedProgramState *spState;
    time_t now;
 
    now = time(NULL);
 
    /*
-    * Update the 'running' record if the process has completed.
+    * Find and toss any old records. The queue is in exit order, so stop
+    * at the first one that is still young enough.
     */
-   if (state && (state->isRunning == FALSE)) {
-      spList = startedProcessList;
-      while (spList) {
-         if (spList->pid == state->pid) {
-            /*
-             * Update the two exit fields now that we have them
-             */
-            spList->exitCode = state->exitCode;
-            spList->endTime = state->endTime;
-            spList->isRunning = FALSE;
-
-            /*
-             * Don't let the procState be free'd on Windows to
-             * keep OS from reusing the pid. We need to free
-             * procState in case of Posix to avoid unnecessary
-             * caching of FDs, which might make the service run
-             * out of FDs as FDs are limited (usually 1024 by
-             * default) for a process.
-             */
-#ifdef WIN32
-            spList->procState = state->procState;
-            state->procState = NULL;
-#else
-            spList->procState = NULL;
-#endif
+   while ((spState = g_queue_peek_head(&exitedProgramQueue)) != NULL &&
+          spState->endTime < (now - VIX_TOOLS_EXITED_PROGRAM_REAP_TIME)) {
+      VixToolsRemoveStartedProgramState(spState);
+   }
 
-            VixToolsFreeStartedProgramState(state);
-            // NULL it out so we don't try to add it later in this function
-            state  = NULL;
-            break;
-         } else {
-            spList = spList->next;
-         }
-      }
+   if (NULL == state) {
+      return;
    }
 
+   spState = g_hash_table_lookup(startedProgramTable, &state->pid);
 
    /*
-    * Find and toss any old records.
+    * Update the 'running' record if the process has completed.
     */
-   last = NULL;
-   spList = startedProcessList;
-   while (spList) {
+   if (!state->isRunning && NULL != spState && spState->isRunning) {
       /*
-       * Sanity check we don't have a duplicate entry -- this should
-       * only happen when the OS re-uses the PID before we reap the record
-       * of its exit status.
+       * Update the two exit fields now that we have them
        */
-      if (state) {
-         if (state->pid == spList->pid) {
-            // XXX just whine for M/N, needs better fix in *main
-            g_warning("%s: found duplicate entry in startedProcessList\n",
-                      __FUNCTION__);
-         }
-      }
-      if (!spList->isRunning &&
-          (spList->endTime < (now - VIX_TOOLS_EXITED_PROGRAM_REAP_TIME))) {
-         if (last) {
-            last->next = spList->next;
-         } else {
-            startedProcessList = spList->next;
-         }
-         old = spList;
-         spList = spList->next;
-         VixToolsFreeStartedProgramState(old);
-      } else {
-         last = spList;
-         spList = spList->next;
-      }
-   }
+      spState->exitCode = state->exitCode;
+      spState->endTime = state->endTime;
+      spState->isRunning = FALSE;
+
+      /*
+       * Don't let the procState be free'd on Windows to
+       * keep OS from reusing the pid. We need to free
+       * procState in case of Posix to avoid unnecessary
+       * caching of FDs, which might make the service run
+       * out of FDs as FDs are limited (usually 1024 by
+       * default) for a process.
+       */
+#ifdef WIN32
+      spState->procState = state->procState;
+      state->procState = NULL;
+#endif
 
+      g_queue_push_tail(&exitedProgramQueue, spState);
+      spState->expiryLink = g_queue_peek_tail_link(&exitedProgramQueue);
+
+      VixToolsFreeStartedProgramState(state);
+      return;
+   }
 
    /*
-    * Add any new record to the list
+    * A record with the same pid should only exist when the OS re-uses
+    * the PID before we reap the record of its exit status. The new
+    * process is the one that can still be asked about, so drop the old.
     */
-   if (state) {
-      if (last) {
-         last->next = state;
-      } else {
-         startedProcessList = state;
-      }
+   if (NULL != spState) {
+      g_warning("%s: found duplicate entry for pid %"FMT64"u\n",
+                __FUNCTION__, state->pid);
+      VixToolsRemoveStartedProgramState(spState);
    }
 
+   /*
+    * Add the new record to the table
+    */
+   g_hash_table_insert(startedProgramTable, &state->pid, state);
+   if (!state->isRunning) {
+      g_queue_push_tail(&exitedProgramQueue, state);
+      state->expiryLink = g_queue_peek_tail_link(&exitedProgramQueue);
+   }
 } // VixToolsUpdateStartedProgramList
 
 
@@ -2257,8 +2384,8 @@ VixToolsFreeStartedProgramState(VixToolsStartedProgramState *spState) // IN
  *
  * VixToolsFindStartedProgramState --
  *
- *    Searches the list of running/exited apps to see if the given
- *    pid was started via StartProgram.
+ *    Looks up the given pid in the table of running/exited apps to see
+ *    if it was started via StartProgram.
  *
  * Results:
  *    Any state matching the given pid.
@@ -2272,17 +2399,7 @@ VixToolsFreeStartedProgramState(VixToolsStartedProgramState *spState) // IN
 VixToolsStartedProgramState *
 VixToolsFindStartedProgramState(uint64 pid)
 {
-   VixToolsStartedProgramState *spList;
-
-   spList = startedProcessList;
-   while (spList) {
-      if (spList->pid == pid) {
-         return spList;
-      }
-      spList = spList->next;
-   }
-
-   return NULL;
+   return g_hash_table_lookup(startedProgramTable, &pid);
 }
 
 
@@ -5210,7 +5327,8 @@ VixToolsListProcessesExGenerateData(uint32 numPids,          // IN
    ProcMgrProcInfoArray *procList = NULL;
    ProcMgrProcInfo *procInfo;
    DynBuf dynBuffer;
-   VixToolsStartedProgramState *spList;
+   VixToolsStartedProgramState *spState;
+   GHashTableIter iter;
    int numReported = 0;
    int i;
    int j;
@@ -5226,41 +5344,36 @@ VixToolsListProcessesExGenerateData(uint32 numPids,          // IN
    VixToolsUpdateStartedProgramList(NULL);
    if (numPids > 0) {
       for (i = 0; i < numPids; i++) {
-         spList = startedProcessList;
-         while (spList) {
-            if (pids[i] == spList->pid) {
-               err = VixToolsPrintProcInfoEx(&dynBuffer,
-                                             spList->cmdName,
-                                             spList->fullCommandLine,
-                                             spList->pid,
-                                             spList->user,
-                                             (int) spList->startTime,
-                                             spList->exitCode,
-                                             (int) spList->endTime);
-               if (VIX_OK != err) {
-                  goto abort;
-               }
-               numReported++;
-               break;
+         spState = VixToolsFindStartedProgramState(pids[i]);
+         if (NULL != spState) {
+            err = VixToolsPrintProcInfoEx(&dynBuffer,
+                                          spState->cmdName,
+                                          spState->fullCommandLine,
+                                          spState->pid,
+                                          spState->user,
+                                          (int) spState->startTime,
+                                          spState->exitCode,
+                                          (int) spState->endTime);
+            if (VIX_OK != err) {
+               goto abort;
             }
-            spList = spList->next;
+            numReported++;
          }
       }
    } else {
-      spList = startedProcessList;
-      while (spList) {
+      g_hash_table_iter_init(&iter, startedProgramTable);
+      while (g_hash_table_iter_next(&iter, NULL, (gpointer *) &spState)) {
          err = VixToolsPrintProcInfoEx(&dynBuffer,
-                                       spList->cmdName,
-                                       spList->fullCommandLine,
-                                       spList->pid,
-                                       spList->user,
-                                       (int) spList->startTime,
-                                       spList->exitCode,
-                                       (int) spList->endTime);
+                                       spState->cmdName,
+                                       spState->fullCommandLine,
+                                       spState->pid,
+                                       spState->user,
+                                       (int) spState->startTime,
+                                       spState->exitCode,
+                                       (int) spState->endTime);
          if (VIX_OK != err) {
             goto abort;
          }
-         spList = spList->next;
       }
    }
 
@@ -6039,6 +6152,7 @@ VixToolsListDirectory(VixCommandRequestHeader *requestMsg,    // IN
    VMAutomationRequestParser parser;
    int dirPathLen;
    Bool escapeStrs;
+   int dirFd = -1;
 
    legacyListRequest = (VixMsgSimpleFileRequest *) requestMsg;
    if (legacyListRequest->fileOptions & VIX_LIST_DIRECTORY_USE_OFFSET) {
@@ -6103,6 +6217,7 @@ VixToolsListDirectory(VixCommandRequestHeader *requestMsg,    // IN
       err = FoundryToolsDaemon_TranslateSystemErr();
       goto abort;
    }
+   dirFd = VixToolsOpenDirectory(dirPathName);
 
    /*
     * Calculate the size of the result buffer and keep track of the
@@ -6170,20 +6285,24 @@ VixToolsListDirectory(VixCommandRequestHeader *requestMsg,    // IN
    for (fileNum = offset; fileNum < lastGoodNumFiles; fileNum++) {
       /* File_ListDirectory never returns "." or ".." */
       char *pathName;
+      VixToolsFileStat fileStat;
 
       currentFileName = fileNameList[fileNum];
 
       pathName = Str_SafeAsprintf(NULL, "%s%s%s", dirPathName, DIRSEPS,
                                   currentFileName);
 
-      VixToolsPrintFileInfo(pathName, currentFileName, escapeStrs, &destPtr,
+      VixToolsGetFileStat(dirFd, pathName, currentFileName, FALSE, &fileStat);
+      VixToolsPrintFileInfo(&fileStat, currentFileName, escapeStrs, &destPtr,
                             endDestPtr);
+      VixToolsFreeFileStat(&fileStat);
 
       free(pathName);
    } // for (fileNum = 0; fileNum < lastGoodNumFiles; fileNum++)
    *destPtr = '\0';
 
 abort:
+   VixToolsCloseDirectory(dirFd);
    if (impersonatingVMWareUser) {
       VixToolsUnimpersonateUser(userToken);
    }
@@ -6258,6 +6377,10 @@ VixToolsListFiles(VixCommandRequestHeader *requestMsg,    // IN
    GError *gerr = NULL;
    char *pathName;
    VMAutomationRequestParser parser;
+   int dirFd = -1;
+   VixToolsFileStat *fileStats = NULL;
+   int numFileStats = 0;
+   int fileStatsSize = 0;
 
    ASSERT(NULL != requestMsg);
 
@@ -6328,6 +6451,7 @@ VixToolsListFiles(VixCommandRequestHeader *requestMsg,    // IN
          err = FoundryToolsDaemon_TranslateSystemErr();
          goto abort;
       }
+      dirFd = VixToolsOpenDirectory(dirPathName);
       /*
        * File_ListDirectory() doesn't return '.' and '..', but we want them,
        * so add '.' and '..' to the list.  Place them in front since that's
@@ -6390,16 +6514,29 @@ VixToolsListFiles(VixCommandRequestHeader *requestMsg,    // IN
          continue;   // stop computing buffersize
       }
 
+      /*
+       * Collect what is printed below now, while we need the link target
+       * for the length anyway; the printing loop visits the same files.
+       */
+      if (numFileStats == fileStatsSize) {
+         fileStatsSize = MAX(16, 2 * fileStatsSize);
+         fileStats = Util_SafeRealloc(fileStats,
+                                      fileStatsSize * sizeof *fileStats);
+      }
+
       if (listingSingleFile) {
-         resultBufferSize += VixToolsGetFileExtendedInfoLength(currentFileName,
-                                                               currentFileName);
+         pathName = Util_SafeStrdup(currentFileName);
       } else {
          pathName = Str_SafeAsprintf(NULL, "%s%s%s", dirPathName, DIRSEPS,
                                      currentFileName);
-         resultBufferSize += VixToolsGetFileExtendedInfoLength(pathName,
-                                                               currentFileName);
-         free(pathName);
       }
+      VixToolsGetFileStat(dirFd, pathName, currentFileName, TRUE,
+                          &fileStats[numFileStats]);
+      free(pathName);
+
+      resultBufferSize +=
+         VixToolsGetFileExtendedInfoLength(&fileStats[numFileStats++],
+                                           currentFileName);
 
       if (resultBufferSize < maxBufferSize) {
          lastGoodResultBufferSize = resultBufferSize;
@@ -6454,8 +6591,9 @@ VixToolsListFiles(VixCommandRequestHeader *requestMsg,    // IN
                                      currentFileName);
       }
 
-      VixToolsPrintFileExtendedInfo(pathName, currentFileName,
-                                    &destPtr, endDestPtr);
+      ASSERT(count < numFileStats);
+      VixToolsPrintFileExtendedInfo(pathName, &fileStats[count],
+                                    currentFileName, &destPtr, endDestPtr);
 
       free(pathName);
       count++;
@@ -6463,6 +6601,12 @@ VixToolsListFiles(VixCommandRequestHeader *requestMsg,    // IN
    *destPtr = '\0';
 
 abort:
+   VixToolsCloseDirectory(dirFd);
+   for (fileNum = 0; fileNum < numFileStats; fileNum++) {
+      VixToolsFreeFileStat(&fileStats[fileNum]);
+   }
+   free(fileStats);
+
    if (impersonatingVMWareUser) {
       VixToolsUnimpersonateUser(userToken);
    }
@@ -6507,12 +6651,12 @@ abort:
  */
 
 int
-VixToolsGetFileExtendedInfoLength(const char *filePathName,   // IN
-                                  const char *fileName)       // IN
+VixToolsGetFileExtendedInfoLength(const VixToolsFileStat *fileStat,  // IN
+                                  const char *fileName)              // IN
 {
    int fileExtendedInfoBufferSize = 0;
 
-   ASSERT(NULL != filePathName);
+   ASSERT(NULL != fileStat);
    ASSERT(NULL != fileName);
 
 #ifdef _WIN32
@@ -6530,14 +6674,9 @@ VixToolsGetFileExtendedInfoLength(const char *filePathName,   // IN
 #endif
 
 #if defined(linux) || defined(sun) || defined(__FreeBSD__)
-   if (File_IsSymLink(filePathName)) {
-      char *symlinkTarget;
-      symlinkTarget = Posix_ReadLink(filePathName);
-      if (NULL != symlinkTarget) {
-         fileExtendedInfoBufferSize +=
-            VixToolsXMLStringEscapedLen(symlinkTarget, TRUE);
-      }
-      free(symlinkTarget);
+   if (NULL != fileStat->symlinkTarget) {
+      fileExtendedInfoBufferSize +=
+         VixToolsXMLStringEscapedLen(fileStat->symlinkTarget, TRUE);
    }
 #endif
 
@@ -6575,6 +6714,7 @@ VixToolsGetFileInfo(VixCommandRequestHeader *requestMsg,    // IN
    const char *filePathName;
    VixMsgSimpleFileRequest *simpleFileReq;
    VMAutomationRequestParser parser;
+   VixToolsFileStat fileStat;
 
    err = VMAutomationRequestParserInit(&parser,
                                        requestMsg, sizeof *simpleFileReq);
@@ -6622,7 +6762,9 @@ VixToolsGetFileInfo(VixCommandRequestHeader *requestMsg,    // IN
     * Print the result buffer
     */
    destPtr = resultBuffer;
-   VixToolsPrintFileInfo(filePathName, "", FALSE, &destPtr, resultBuffer + resultBufferSize);
+   VixToolsGetFileStat(-1, filePathName, filePathName, FALSE, &fileStat);
+   VixToolsPrintFileInfo(&fileStat, "", FALSE, &destPtr, resultBuffer + resultBufferSize);
+   VixToolsFreeFileStat(&fileStat);
 
 abort:
    if (impersonatingVMWareUser) {
@@ -6910,26 +7052,26 @@ abort:
  */
 
 static void
-VixToolsPrintFileInfo(const char *filePathName,     // IN
-                      char *fileName,               // IN
-                      Bool escapeStrs,              // IN
-                      char **destPtr,               // IN/OUT
-                      char *endDestPtr)             // IN
+VixToolsPrintFileInfo(const VixToolsFileStat *fileStat,   // IN
+                      char *fileName,                     // IN
+                      Bool escapeStrs,                    // IN
+                      char **destPtr,                     // IN/OUT
+                      char *endDestPtr)                   // IN
 {
    int64 fileSize = 0;
    int64 modTime;
    int32 fileProperties = 0;
    char *escapedFileName = NULL;
 
-   modTime = File_GetModTime(filePathName);
-   if (File_IsDirectory(filePathName)) {
+   modTime = fileStat->statOk ? fileStat->statbuf.st_mtime : -1;
+   if (fileStat->isDirectory) {
       fileProperties |= VIX_FILE_ATTRIBUTES_DIRECTORY;
    } else {
-      if (File_IsSymLink(filePathName)) {
+      if (fileStat->isSymLink) {
          fileProperties |= VIX_FILE_ATTRIBUTES_SYMLINK;
       }
-      if (File_IsFile(filePathName)) {
-         fileSize = File_GetSize(filePathName);
+      if (fileStat->isFile) {
+         fileSize = fileStat->fileSize;
       }
    }
 
@@ -6964,10 +7106,11 @@ VixToolsPrintFileInfo(const char *filePathName,     // IN
  */
 
 static void
-VixToolsPrintFileExtendedInfo(const char *filePathName,     // IN
-                              const char *fileName,         // IN
-                              char **destPtr,               // IN/OUT
-                              char *endDestPtr)             // IN
+VixToolsPrintFileExtendedInfo(const char *filePathName,           // IN
+                              const VixToolsFileStat *fileStat,   // IN
+                              const char *fileName,               // IN
+                              char **destPtr,                     // IN/OUT
+                              char *endDestPtr)                   // IN
 {
    int64 fileSize = 0;
    VmTimeType modTime = 0;
@@ -6983,43 +7126,29 @@ VixToolsPrintFileExtendedInfo(const char *filePathName,     // IN
    int ownerId = 0;
    int groupId = 0;
    char *symlinkTarget = NULL;
-   char *tmp;
 #endif
-   struct stat statbuf;
    char *escapedFileName = NULL;
 
    /*
-    * First check for symlink -- File_IsDirectory() will lie
+    * First check for symlink -- isDirectory will lie
     * if its a symlink to a directory.
     */
-   if (File_IsSymLink(filePathName)) {
+   if (fileStat->isSymLink) {
       fileProperties |= VIX_FILE_ATTRIBUTES_SYMLINK;
-   } else if (File_IsDirectory(filePathName)) {
+   } else if (fileStat->isDirectory) {
       fileProperties |= VIX_FILE_ATTRIBUTES_DIRECTORY;
-   } else if (File_IsFile(filePathName)) {
-      fileSize = File_GetSize(filePathName);
+   } else if (fileStat->isFile) {
+      fileSize = fileStat->fileSize;
    }
 
 #if !defined(_WIN32)
-   /*
-    * If the file is a symlink, figure out where it points.
-    */
-   if (fileProperties & VIX_FILE_ATTRIBUTES_SYMLINK) {
-      symlinkTarget = Posix_ReadLink(filePathName);
-   }
-
    /*
     * Have a nice empty value if it's not a link or there's some error
     * reading the link.
     */
-   if (NULL == symlinkTarget) {
-      symlinkTarget = Util_SafeStrdup("");
-   }
-
-   tmp = VixToolsEscapeXMLString(symlinkTarget);
-   ASSERT_MEM_ALLOC(NULL != tmp);
-   free(symlinkTarget);
-   symlinkTarget = tmp;
+   symlinkTarget = VixToolsEscapeXMLString(NULL != fileStat->symlinkTarget ?
+                                           fileStat->symlinkTarget : "");
+   ASSERT_MEM_ALLOC(NULL != symlinkTarget);
 #endif
 
 #ifdef _WIN32
@@ -7034,24 +7163,24 @@ VixToolsPrintFileExtendedInfo(const char *filePathName,     // IN
    }
 #endif
 
-   if (Posix_Stat(filePathName, &statbuf) != -1) {
+   if (fileStat->statOk) {
 #if !defined(_WIN32)
-      ownerId = statbuf.st_uid;
-      groupId = statbuf.st_gid;
-      permissions = statbuf.st_mode;
+      ownerId = fileStat->statbuf.st_uid;
+      groupId = fileStat->statbuf.st_gid;
+      permissions = fileStat->statbuf.st_mode;
 #endif
       /*
        * We want create time.  ctime is the inode change time for Linux,
        * so we can't report anything.
        */
 #ifdef _WIN32
-      createTime = statbuf.st_ctime;
+      createTime = fileStat->statbuf.st_ctime;
 #endif
-      modTime = statbuf.st_mtime;
-      accessTime = statbuf.st_atime;
+      modTime = fileStat->statbuf.st_mtime;
+      accessTime = fileStat->statbuf.st_atime;
    } else {
-      g_warning("%s: Posix_Stat(%s) failed with %d\n",
-                __FUNCTION__, filePathName, errno);
+      g_warning("%s: stat(%s) failed with %d\n",
+                __FUNCTION__, filePathName, fileStat->statError);
    }
 
    escapedFileName = VixToolsEscapeXMLString(fileName);
@@ -7115,15 +7244,18 @@ VixToolsPrintFileExtendedInfoEx(const char *filePathName,          // IN
    char *destPtr = NULL;
    char *endDestPtr = NULL;
    char *resultBuffer = NULL;
+   VixToolsFileStat fileStat;
 
-   resultBufferSize = VixToolsGetFileExtendedInfoLength(filePathName,
-                                                        fileName);
+   VixToolsGetFileStat(-1, filePathName, filePathName, TRUE, &fileStat);
+
+   resultBufferSize = VixToolsGetFileExtendedInfoLength(&fileStat, fileName);
    resultBuffer = Util_SafeMalloc(resultBufferSize);
    destPtr = resultBuffer;
    endDestPtr = resultBuffer + resultBufferSize;
 
-   VixToolsPrintFileExtendedInfo(filePathName, filePathName, &destPtr,
-                                 endDestPtr);
+   VixToolsPrintFileExtendedInfo(filePathName, &fileStat, filePathName,
+                                 &destPtr, endDestPtr);
+   VixToolsFreeFileStat(&fileStat);
 
    *destPtr = '\0';
    return resultBuffer;
@@ -7215,7 +7347,6 @@ VixToolsRunScript(VixCommandRequestHeader *requestMsg,  // IN
    Bool forcedRoot = FALSE;
    wchar_t *envBlock = NULL;
 #endif
-   GSource *timer;
    VMAutomationRequestParser parser;
 
    err = VMAutomationRequestParserInit(&parser,
@@ -7478,10 +7609,8 @@ VixToolsRunScript(VixCommandRequestHeader *requestMsg,  // IN
    pid = (int64) ProcMgr_GetPid(asyncState->procState);
 
    asyncState->eventQueue = eventQueue;
-   timer = g_timeout_source_new(SECONDS_BETWEEN_POLL_TEST_FINISHED * 1000);
-   g_source_set_callback(timer, VixToolsMonitorAsyncProc, asyncState, NULL);
-   g_source_attach(timer, g_main_loop_get_context(eventQueue));
-   g_source_unref(timer);
+   VixToolsWatchAsyncProc(asyncState->procState, eventQueue,
+                          VixToolsMonitorAsyncProc, asyncState);
 
    /*
     * VixToolsMonitorAsyncProc will clean asyncState up when the program finishes.
@@ -7688,6 +7817,46 @@ VixToolsImpersonateUserImpl(char const *credentialTypeStr,         // IN
                                                   userToken));
 } // VixToolsImpersonateUserImpl
 
+#ifndef _WIN32
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * VixToolsAuthCacheTimeout --
+ *
+ *    Get the configured lifetime of an authentication cache entry.
+ *
+ * Return value:
+ *    The lifetime in seconds; 0 if the cache is disabled.
+ *
+ * Side effects:
+ *    None
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+static int
+VixToolsAuthCacheTimeout(void)
+{
+   GError *gErr = NULL;
+   int timeout;
+
+   if (NULL == gConfDictRef) {
+      return VIX_TOOLS_CONFIG_AUTH_CACHE_TIMEOUT_DEFAULT;
+   }
+
+   timeout = g_key_file_get_integer(gConfDictRef,
+                                    VIX_TOOLS_CONFIG_API_GROUPNAME,
+                                    VIX_TOOLS_CONFIG_AUTH_CACHE_TIMEOUT,
+                                    &gErr);
+   if (NULL != gErr) {
+      g_clear_error(&gErr);
+      timeout = VIX_TOOLS_CONFIG_AUTH_CACHE_TIMEOUT_DEFAULT;
+   }
+
+   return MAX(timeout, 0);
+}
+#endif
+
 
 /*
  *-----------------------------------------------------------------------------
@@ -7892,8 +8061,14 @@ VixToolsImpersonateUserImplEx(char const *credentialTypeStr,         // IN
             goto abort;
          }
 
+#ifdef _WIN32
          authToken = Auth_AuthenticateUser(unobfuscatedUserName,
                                            unobfuscatedPassword);
+#else
+         authToken = VixToolsAuthenticateUser(unobfuscatedUserName,
+                                              unobfuscatedPassword,
+                                              VixToolsAuthCacheTimeout());
+#endif
          if (NULL == authToken) {
             err = VIX_E_INVALID_LOGIN_CREDENTIALS;
             goto abort;
@@ -7911,6 +8086,9 @@ VixToolsImpersonateUserImplEx(char const *credentialTypeStr,         // IN
                                                 authToken);
 #endif
          if (!success) {
+#ifndef _WIN32
+            VixToolsAuthCacheForget(unobfuscatedUserName);
+#endif
             err = VIX_E_INVALID_LOGIN_CREDENTIALS;
             goto abort;
          }
@@ -0,0 +1,414 @@
+/*********************************************************
+ * Copyright (C) 2016 VMware, Inc. All rights reserved.
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU Lesser General Public License as published
+ * by the Free Software Foundation version 2.1 and no later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+ * or FITNESS FOR A PARTICULAR PURPOSE.  See the Lesser GNU General Public
+ * License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin St, Fifth Floor, Boston, MA  02110-1301 USA.
+ *
+ *********************************************************/
+
+/*
+ * vixToolsAuthCache.c --
+ *
+ *      Cache of recent successful name/password authentications.
+ *
+ *      Automation often issues hundreds of guest operations with the same
+ *      credentials, and each one would otherwise run a full PAM
+ *      conversation. Entries are keyed by a salted SHA-256 of the user name
+ *      and password, so the password itself is never kept. The whole cache
+ *      is dropped when any of the account databases changes, and an entry
+ *      is dropped as soon as authentication or impersonation fails for its
+ *      user.
+ *
+ *      A hit does not run the PAM account stack, so an account that is
+ *      locked or expired only in a remote directory (LDAP, SSSD) keeps
+ *      working until its entry expires. The cache is therefore off unless
+ *      authCacheTimeout is set in tools.conf.
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+
+#include <glib.h>
+
+#include "vmware.h"
+#include "auth.h"
+#include "hostinfo.h"
+#include "random.h"
+#include "util.h"
+#include "vixToolsInt.h"
+
+
+#define VIX_TOOLS_AUTH_CACHE_SIZE   8
+#define VIX_TOOLS_AUTH_DIGEST_LEN   32   // SHA-256
+#define VIX_TOOLS_AUTH_SALT_LEN     32
+
+typedef struct VixToolsAuthCacheEntry {
+   char *userName;                                 // NULL if unused
+   guint8 digest[VIX_TOOLS_AUTH_DIGEST_LEN];
+   VmTimeType expires;                             // Hostinfo_SystemTimerNS
+} VixToolsAuthCacheEntry;
+
+static VixToolsAuthCacheEntry gAuthCache[VIX_TOOLS_AUTH_CACHE_SIZE];
+static guint8 gAuthCacheSalt[VIX_TOOLS_AUTH_SALT_LEN];
+static Bool gAuthCacheSaltValid = FALSE;
+
+static const char *gAuthCacheFiles[] = {
+   "/etc/passwd",
+   "/etc/shadow",
+   "/etc/group",
+};
+
+/* The state of gAuthCacheFiles when the cache was last filled. */
+static struct stat gAuthCacheFileStamps[ARRAYSIZE(gAuthCacheFiles)];
+
+
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * VixToolsAuthCacheDigest --
+ *
+ *    Compute the cache key for a user name and password.
+ *
+ * Return value:
+ *    TRUE on success, FALSE if no salt could be generated.
+ *
+ * Side effects:
+ *    Generates the process-wide salt on first use.
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+static Bool
+VixToolsAuthCacheDigest(const char *userName,                   // IN
+                        const char *password,                   // IN
+                        guint8 digest[VIX_TOOLS_AUTH_DIGEST_LEN]) // OUT
+{
+   GChecksum *checksum;
+   gsize digestLen = VIX_TOOLS_AUTH_DIGEST_LEN;
+
+   if (!gAuthCacheSaltValid) {
+      if (!Random_Crypto(sizeof gAuthCacheSalt, gAuthCacheSalt)) {
+         return FALSE;
+      }
+      gAuthCacheSaltValid = TRUE;
+   }
+
+   checksum = g_checksum_new(G_CHECKSUM_SHA256);
+   g_checksum_update(checksum, gAuthCacheSalt, sizeof gAuthCacheSalt);
+   g_checksum_update(checksum, (const guchar *) userName,
+                     strlen(userName) + 1);
+   g_checksum_update(checksum, (const guchar *) password, strlen(password));
+   g_checksum_get_digest(checksum, digest, &digestLen);
+   g_checksum_free(checksum);
+
+   ASSERT(digestLen == VIX_TOOLS_AUTH_DIGEST_LEN);
+
+   return TRUE;
+}
+
+
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * VixToolsAuthCacheFilesChanged --
+ *
+ *    Check whether any of the account databases changed since the cache
+ *    was last filled.
+ *
+ * Return value:
+ *    TRUE if a file was modified, replaced, created or removed.
+ *
+ * Side effects:
+ *    If 'update' is set, records the current state of the files.
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+static Bool
+VixToolsAuthCacheFilesChanged(Bool update)  // IN
+{
+   Bool changed = FALSE;
+   size_t i;
+
+   for (i = 0; i < ARRAYSIZE(gAuthCacheFiles); i++) {
+      struct stat st;
+      struct stat *stamp = &gAuthCacheFileStamps[i];
+
+      if (stat(gAuthCacheFiles[i], &st) != 0) {
+         memset(&st, 0, sizeof st);
+      }
+
+      if (st.st_ino != stamp->st_ino ||
+          st.st_dev != stamp->st_dev ||
+          st.st_size != stamp->st_size ||
+          st.st_mtime != stamp->st_mtime ||
+          st.st_ctime != stamp->st_ctime) {
+         changed = TRUE;
+      }
+
+      if (update) {
+         *stamp = st;
+      }
+   }
+
+   return changed;
+}
+
+
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * VixToolsAuthCacheFreeEntry --
+ *
+ *    Empty an authentication cache entry.
+ *
+ * Return value:
+ *    None
+ *
+ * Side effects:
+ *    None
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+static void
+VixToolsAuthCacheFreeEntry(VixToolsAuthCacheEntry *entry)  // IN/OUT
+{
+   free(entry->userName);
+   memset(entry, 0, sizeof *entry);
+}
+
+
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * VixToolsAuthCacheFlush --
+ *
+ *    Empty the authentication cache.
+ *
+ * Return value:
+ *    None
+ *
+ * Side effects:
+ *    None
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+void
+VixToolsAuthCacheFlush(void)
+{
+   size_t i;
+
+   for (i = 0; i < ARRAYSIZE(gAuthCache); i++) {
+      VixToolsAuthCacheFreeEntry(&gAuthCache[i]);
+   }
+}
+
+
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * VixToolsAuthCacheLookup --
+ *
+ *    Check whether the user was recently authenticated with this password.
+ *
+ * Return value:
+ *    TRUE if a live cache entry matches.
+ *
+ * Side effects:
+ *    Flushes the cache if it is disabled or an account database changed.
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+static Bool
+VixToolsAuthCacheLookup(const char *userName,  // IN
+                        const char *password,  // IN
+                        int timeout)           // IN: entry lifetime, seconds
+{
+   guint8 digest[VIX_TOOLS_AUTH_DIGEST_LEN];
+   VmTimeType now;
+   size_t i;
+
+   if (timeout == 0 ||
+       VixToolsAuthCacheFilesChanged(FALSE)) {
+      VixToolsAuthCacheFlush();
+      return FALSE;
+   }
+
+   if (!VixToolsAuthCacheDigest(userName, password, digest)) {
+      return FALSE;
+   }
+
+   now = Hostinfo_SystemTimerNS();
+
+   for (i = 0; i < ARRAYSIZE(gAuthCache); i++) {
+      VixToolsAuthCacheEntry *entry = &gAuthCache[i];
+
+      if (NULL == entry->userName) {
+         continue;
+      }
+
+      if (now >= entry->expires) {
+         VixToolsAuthCacheFreeEntry(entry);
+         continue;
+      }
+
+      if (strcmp(entry->userName, userName) == 0 &&
+          memcmp(entry->digest, digest, sizeof digest) == 0) {
+         g_debug("%s: using cached authentication for '%s'\n",
+                 __FUNCTION__, userName);
+         return TRUE;
+      }
+   }
+
+   return FALSE;
+}
+
+
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * VixToolsAuthCacheAdd --
+ *
+ *    Remember a successful authentication.
+ *
+ * Return value:
+ *    None
+ *
+ * Side effects:
+ *    May evict the entry closest to expiring.
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+static void
+VixToolsAuthCacheAdd(const char *userName,  // IN
+                     const char *password,  // IN
+                     int timeout)           // IN: entry lifetime, seconds
+{
+   VixToolsAuthCacheEntry *victim = NULL;
+   guint8 digest[VIX_TOOLS_AUTH_DIGEST_LEN];
+   size_t i;
+
+   if (timeout == 0 ||
+       !VixToolsAuthCacheDigest(userName, password, digest)) {
+      return;
+   }
+
+   /*
+    * Every entry must have been validated against the same state of the
+    * account databases.
+    */
+
+   if (VixToolsAuthCacheFilesChanged(TRUE)) {
+      VixToolsAuthCacheFlush();
+   }
+
+   /* An older password for the same user is no longer interesting. */
+   VixToolsAuthCacheForget(userName);
+
+   for (i = 0; i < ARRAYSIZE(gAuthCache); i++) {
+      VixToolsAuthCacheEntry *entry = &gAuthCache[i];
+
+      if (NULL == entry->userName) {
+         victim = entry;
+         break;
+      }
+      if (NULL == victim || entry->expires < victim->expires) {
+         victim = entry;
+      }
+   }
+
+   VixToolsAuthCacheFreeEntry(victim);
+   victim->userName = Util_SafeStrdup(userName);
+   memcpy(victim->digest, digest, sizeof digest);
+   victim->expires = Hostinfo_SystemTimerNS() +
+                     (VmTimeType) timeout * 1000 * 1000 * 1000;
+}
+
+
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * VixToolsAuthCacheForget --
+ *
+ *    Drop any cached authentication for a user.
+ *
+ * Return value:
+ *    None
+ *
+ * Side effects:
+ *    None
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+void
+VixToolsAuthCacheForget(const char *userName)  // IN
+{
+   size_t i;
+
+   for (i = 0; i < ARRAYSIZE(gAuthCache); i++) {
+      VixToolsAuthCacheEntry *entry = &gAuthCache[i];
+
+      if (NULL != entry->userName && strcmp(entry->userName, userName) == 0) {
+         VixToolsAuthCacheFreeEntry(entry);
+      }
+   }
+}
+
+
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * VixToolsAuthenticateUser --
+ *
+ *    Authenticate a user name and password. A recent successful
+ *    authentication with the same credentials only needs the account
+ *    looked up again, not another PAM run.
+ *
+ * Return value:
+ *    The user's token, NULL if authentication failed.
+ *
+ * Side effects:
+ *    Updates the cache.
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+AuthToken
+VixToolsAuthenticateUser(const char *userName,  // IN
+                         const char *password,  // IN
+                         int cacheTimeout)      // IN: seconds, 0 for no cache
+{
+   AuthToken authToken = NULL;
+
+   if (VixToolsAuthCacheLookup(userName, password, cacheTimeout)) {
+      authToken = Auth_GetPwnam(userName);
+   }
+
+   if (NULL == authToken) {
+      authToken = Auth_AuthenticateUser(userName, password);
+      if (NULL == authToken) {
+         VixToolsAuthCacheForget(userName);
+      } else {
+         VixToolsAuthCacheAdd(userName, password, cacheTimeout);
+      }
+   }
+
+   return authToken;
+}
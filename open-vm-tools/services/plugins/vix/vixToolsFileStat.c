@@ -0,0 +1,268 @@
+/*********************************************************
+ * Copyright (C) 2016 VMware, Inc. All rights reserved.
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU Lesser General Public License as published
+ * by the Free Software Foundation version 2.1 and no later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+ * or FITNESS FOR A PARTICULAR PURPOSE.  See the Lesser GNU General Public
+ * License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin St, Fifth Floor, Boston, MA  02110-1301 USA.
+ *
+ *********************************************************/
+
+/*
+ * vixToolsFileStat.c --
+ *
+ *      Collects the metadata the file listing and file info commands
+ *      report about a file.
+ *
+ *      Asking File_IsDirectory(), File_IsSymLink(), File_IsFile(),
+ *      File_GetSize() and File_GetModTime() one after the other costs a
+ *      lookup of the full path (and File_GetSize() an open) each. On POSIX
+ *      systems the entries of a directory are instead looked up relative to
+ *      a descriptor for the directory, with one fstatat() per entry and a
+ *      second one only for symlinks.
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+#ifndef _WIN32
+#include <unistd.h>
+#endif
+
+#include "vmware.h"
+#include "util.h"
+#include "unicode.h"
+#include "file.h"
+#include "posix.h"
+#include "vixToolsInt.h"
+
+
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * VixToolsOpenDirectory --
+ *
+ *      Opens a directory whose entries are going to be passed to
+ *      VixToolsGetFileStat().
+ *
+ * Results:
+ *      A descriptor for the directory, or -1 if it can't be opened or
+ *      entries are looked up by path on this platform.
+ *
+ * Side effects:
+ *      None.
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+int
+VixToolsOpenDirectory(const char *dirPathName)   // IN
+{
+#ifdef _WIN32
+   return -1;
+#else
+   return Posix_Open(dirPathName, O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+#endif
+}
+
+
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * VixToolsCloseDirectory --
+ *
+ *      Closes a descriptor returned by VixToolsOpenDirectory().
+ *
+ * Results:
+ *      None.
+ *
+ * Side effects:
+ *      None.
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+void
+VixToolsCloseDirectory(int dirFd)   // IN
+{
+#ifndef _WIN32
+   if (dirFd >= 0) {
+      close(dirFd);
+   }
+#endif
+}
+
+
+#ifndef _WIN32
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * VixToolsReadLinkAt --
+ *
+ *      readlinkat() that returns the target as a UTF-8 string.
+ *
+ * Results:
+ *      The target, or NULL on failure.
+ *
+ * Side effects:
+ *      None.
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+static char *
+VixToolsReadLinkAt(int dirFd,          // IN
+                   const char *path)   // IN: in the current encoding
+{
+   size_t size = 256;
+   char *result = NULL;
+
+   while (TRUE) {
+      char *linkPath = Util_SafeMalloc(size);
+      ssize_t len = readlinkat(dirFd, path, linkPath, size);
+
+      if (len == -1) {
+         free(linkPath);
+         break;
+      }
+
+      if (len < size) {
+         linkPath[len] = '\0';
+         result = Unicode_Alloc(linkPath, STRING_ENCODING_DEFAULT);
+         free(linkPath);
+         break;
+      }
+      free(linkPath);
+
+      size *= 2;
+   }
+
+   return result;
+}
+#endif
+
+
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * VixToolsGetFileStat --
+ *
+ *      Collects the metadata of a file.
+ *
+ *      If dirFd is a descriptor from VixToolsOpenDirectory(), fileName is
+ *      looked up in that directory; otherwise filePathName is used.
+ *
+ * Results:
+ *      TRUE if the file exists, even as a dangling symlink.
+ *
+ * Side effects:
+ *      Fills in fileStat, to be released with VixToolsFreeFileStat().
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+Bool
+VixToolsGetFileStat(int dirFd,                    // IN
+                    const char *filePathName,     // IN: full path
+                    const char *fileName,         // IN: name in dirFd
+                    Bool getSymlinkTarget,        // IN
+                    VixToolsFileStat *fileStat)   // OUT
+{
+#ifdef _WIN32
+   memset(fileStat, 0, sizeof *fileStat);
+
+   fileStat->isSymLink = File_IsSymLink(filePathName);
+   fileStat->statOk = Posix_Stat(filePathName, &fileStat->statbuf) == 0;
+   fileStat->statError = fileStat->statOk ? 0 : errno;
+   fileStat->isDirectory = File_IsDirectory(filePathName);
+   fileStat->isFile = File_IsFile(filePathName);
+   if (fileStat->isFile) {
+      fileStat->fileSize = File_GetSize(filePathName);
+   }
+
+   return fileStat->statOk || fileStat->isSymLink;
+#else
+   char *path;
+   int atFd;
+
+   memset(fileStat, 0, sizeof *fileStat);
+
+   if (dirFd >= 0) {
+      atFd = dirFd;
+      path = Unicode_GetAllocBytes(fileName, STRING_ENCODING_DEFAULT);
+   } else {
+      atFd = AT_FDCWD;
+      path = Unicode_GetAllocBytes(filePathName, STRING_ENCODING_DEFAULT);
+   }
+   if (path == NULL) {
+      fileStat->statError = errno = UNICODE_CONVERSION_ERRNO;
+      return FALSE;
+   }
+
+   if (fstatat(atFd, path, &fileStat->statbuf, AT_SYMLINK_NOFOLLOW) == -1) {
+      fileStat->statError = errno;
+      free(path);
+      return FALSE;
+   }
+
+   fileStat->statOk = TRUE;
+   if (S_ISLNK(fileStat->statbuf.st_mode)) {
+      fileStat->isSymLink = TRUE;
+      if (getSymlinkTarget) {
+         fileStat->symlinkTarget = VixToolsReadLinkAt(atFd, path);
+      }
+
+      /* The rest describes what the link points to, if anything. */
+      if (fstatat(atFd, path, &fileStat->statbuf, 0) == -1) {
+         fileStat->statOk = FALSE;
+         fileStat->statError = errno;
+      }
+   }
+   free(path);
+
+   if (fileStat->statOk) {
+      fileStat->isDirectory = S_ISDIR(fileStat->statbuf.st_mode);
+      fileStat->isFile = S_ISREG(fileStat->statbuf.st_mode);
+      if (fileStat->isFile) {
+         fileStat->fileSize = fileStat->statbuf.st_size;
+      }
+   }
+
+   return TRUE;
+#endif
+}
+
+
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * VixToolsFreeFileStat --
+ *
+ *      Releases what VixToolsGetFileStat() allocated.
+ *
+ * Results:
+ *      None.
+ *
+ * Side effects:
+ *      None.
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+void
+VixToolsFreeFileStat(VixToolsFileStat *fileStat)   // IN
+{
+   free(fileStat->symlinkTarget);
+   fileStat->symlinkTarget = NULL;
+}
@@ -29,7 +29,10 @@
 #include "vmware.h"
 #include "vix.h"
 #include "vixCommands.h"
+#include "auth.h"
 #include <glib.h>
+#include <sys/types.h>
+#include <sys/stat.h>
 
 
 #define PROCESS_CREATOR_USER_TOKEN       ((void *)1)
@@ -137,6 +140,43 @@ char *VixToolsGetEnvVarFromEnvBlock(const wchar_t *envBlock,
 
 char *VixToolsEscapeXMLString(const char *str);
 
+/*
+ * What the file listing commands report about a file. The type, size and
+ * statbuf describe the file a symlink points to.
+ */
+typedef struct VixToolsFileStat {
+   Bool isSymLink;
+   Bool isDirectory;
+   Bool isFile;
+   Bool statOk;              // statbuf is valid, else statError is set
+   int statError;
+   int64 fileSize;           // 0 unless isFile
+   struct stat statbuf;
+   char *symlinkTarget;      // Only if asked for; NULL if unreadable
+} VixToolsFileStat;
+
+int VixToolsOpenDirectory(const char *dirPathName);
+
+void VixToolsCloseDirectory(int dirFd);
+
+Bool VixToolsGetFileStat(int dirFd,
+                         const char *filePathName,
+                         const char *fileName,
+                         Bool getSymlinkTarget,
+                         VixToolsFileStat *fileStat);
+
+void VixToolsFreeFileStat(VixToolsFileStat *fileStat);
+
+#ifndef _WIN32
+AuthToken VixToolsAuthenticateUser(const char *userName,
+                                   const char *password,
+                                   int cacheTimeout);
+
+void VixToolsAuthCacheForget(const char *userName);
+
+void VixToolsAuthCacheFlush(void);
+#endif
+
 #ifdef _WIN32
 VixError VixToolsInitializeWin32();
 
@@ -29,6 +29,12 @@
 #endif
 
 #include <stdlib.h>
+#if defined(__linux__)
+#  include <errno.h>
+#  include <string.h>
+#  include <unistd.h>
+#  include <sys/inotify.h>
+#endif
 #include "toolsCoreInt.h"
 #include "conf.h"
 #include "guestApp.h"
@@ -55,9 +61,13 @@
  ******************************************************************************
  */
 
+static void
+ToolsCoreStopConfigCheck(ToolsServiceState *state);
+
 static void
 ToolsCoreCleanup(ToolsServiceState *state)
 {
+   ToolsCoreStopConfigCheck(state);
    ToolsCorePool_Shutdown(&state->ctx);
    ToolsCore_UnloadPlugins(state);
 #if defined(__linux__)
@@ -146,6 +156,234 @@ ToolsCoreConfFileCb(gpointer clientData)
 }
 
 
+#if defined(__linux__)
+
+/*
+ * How long to wait after the last change notification before reloading the
+ * config file, in milliseconds. Editors and config management tools usually
+ * generate a burst of events when saving a file.
+ */
+#define CONF_RELOAD_DELAY  250
+
+
+/**
+ * Timer callback that reloads the config file after a change notification.
+ * The file is always re-read, since the mtime of the file has a one second
+ * granularity; the config diff takes care of ignoring no-op updates.
+ *
+ * @param[in]  clientData  Service state.
+ *
+ * @return FALSE.
+ */
+
+static gboolean
+ToolsCoreConfReloadCb(gpointer clientData)
+{
+   ToolsServiceState *state = clientData;
+
+   state->configReloadTask = 0;
+   state->configMtime = 0;
+   ToolsCore_ReloadConfig(state, FALSE);
+   return FALSE;
+}
+
+
+/**
+ * Schedules a reload of the config file, unless one is already pending.
+ *
+ * @param[in]  state    Service state.
+ */
+
+static void
+ToolsCoreScheduleConfReload(ToolsServiceState *state)
+{
+   if (state->configReloadTask == 0) {
+      state->configReloadTask = g_timeout_add(CONF_RELOAD_DELAY,
+                                              ToolsCoreConfReloadCb,
+                                              state);
+   }
+}
+
+
+/**
+ * Handles inotify events for the directory containing the config file.
+ * Events for other files in the directory are ignored. If the directory
+ * itself goes away, or the watch fails, the service falls back to polling
+ * the config file.
+ *
+ * @param[in]  chan        The inotify channel.
+ * @param[in]  cond        Condition that triggered the callback.
+ * @param[in]  clientData  Service state.
+ *
+ * @return Whether to keep watching the directory.
+ */
+
+static gboolean
+ToolsCoreConfWatchCb(GIOChannel *chan,
+                     GIOCondition cond,
+                     gpointer clientData)
+{
+   ToolsServiceState *state = clientData;
+   int fd = g_io_channel_unix_get_fd(chan);
+   gboolean watch = (cond & (G_IO_ERR | G_IO_HUP | G_IO_NVAL)) == 0;
+
+   while (watch) {
+      char buf[4096]
+         __attribute__ ((aligned(__alignof__(struct inotify_event))));
+      ssize_t len = read(fd, buf, sizeof buf);
+      char *p;
+
+      if (len <= 0) {
+         if (len == -1 && errno != EAGAIN && errno != EINTR) {
+            g_warning("Error reading config file events: %s\n",
+                      strerror(errno));
+            watch = FALSE;
+         }
+         break;
+      }
+
+      for (p = buf; p < buf + len; ) {
+         struct inotify_event *event = (struct inotify_event *) p;
+
+         if (event->mask & IN_IGNORED) {
+            watch = FALSE;
+         } else if ((event->mask & IN_Q_OVERFLOW) ||
+                    (event->len > 0 &&
+                     strcmp(event->name, state->configWatchName) == 0)) {
+            ToolsCoreScheduleConfReload(state);
+         }
+         p += sizeof *event + event->len;
+      }
+   }
+
+   if (!watch) {
+      g_debug("Config directory watch stopped, polling the config file.\n");
+      ToolsCoreScheduleConfReload(state);
+      state->configCheckTask = g_timeout_add(CONF_POLL_TIME * 1000,
+                                             ToolsCoreConfFileCb,
+                                             state);
+   }
+   return watch;
+}
+
+
+/**
+ * Starts watching the directory containing the config file with inotify.
+ * The directory is watched instead of the file so that the watch survives
+ * the file being replaced through a rename, which is how most editors save
+ * files.
+ *
+ * @param[in]  state    Service state.
+ *
+ * @return The ID of the watch source, 0 on failure.
+ */
+
+static guint
+ToolsCoreWatchConfigFile(ToolsServiceState *state)
+{
+   gchar *path;
+   gchar *dir;
+   GIOChannel *chan;
+   guint id = 0;
+   int fd;
+
+   if (state->configFile != NULL) {
+      path = g_strdup(state->configFile);
+   } else {
+      char *confPath = GuestApp_GetConfPath();
+
+      if (confPath == NULL) {
+         return 0;
+      }
+      path = g_build_filename(confPath, CONF_FILE, NULL);
+      free(confPath);
+   }
+
+   fd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+   if (fd == -1) {
+      g_debug("Cannot create inotify instance: %s\n", strerror(errno));
+      goto exit;
+   }
+
+   dir = g_path_get_dirname(path);
+   if (inotify_add_watch(fd, dir, IN_CLOSE_WRITE | IN_MOVED_TO |
+                         IN_MOVED_FROM | IN_CREATE | IN_DELETE |
+                         IN_ONLYDIR) == -1) {
+      g_debug("Cannot watch %s: %s\n", dir, strerror(errno));
+      g_free(dir);
+      close(fd);
+      goto exit;
+   }
+   g_free(dir);
+
+   g_free(state->configWatchName);
+   state->configWatchName = g_path_get_basename(path);
+
+   chan = g_io_channel_unix_new(fd);
+   g_io_channel_set_close_on_unref(chan, TRUE);
+   id = g_io_add_watch(chan, G_IO_IN | G_IO_ERR | G_IO_HUP | G_IO_NVAL,
+                       ToolsCoreConfWatchCb, state);
+   g_io_channel_unref(chan);
+
+exit:
+   g_free(path);
+   return id;
+}
+
+#endif
+
+
+/**
+ * Starts monitoring the config file for changes. On Linux, inotify is used
+ * so that changes are picked up right away; if that is not available, or on
+ * other platforms, the config file is polled every CONF_POLL_TIME seconds.
+ *
+ * @param[in]  state    Service state.
+ */
+
+static void
+ToolsCoreStartConfigCheck(ToolsServiceState *state)
+{
+   ASSERT(state->configCheckTask == 0);
+
+#if defined(__linux__)
+   state->configCheckTask = ToolsCoreWatchConfigFile(state);
+   if (state->configCheckTask != 0) {
+      return;
+   }
+#endif
+
+   state->configCheckTask = g_timeout_add(CONF_POLL_TIME * 1000,
+                                          ToolsCoreConfFileCb,
+                                          state);
+}
+
+
+/**
+ * Stops monitoring the config file, cancelling any pending reload.
+ *
+ * @param[in]  state    Service state.
+ */
+
+static void
+ToolsCoreStopConfigCheck(ToolsServiceState *state)
+{
+   if (state->configCheckTask > 0) {
+      g_source_remove(state->configCheckTask);
+      state->configCheckTask = 0;
+   }
+
+#if defined(__linux__)
+   if (state->configReloadTask > 0) {
+      g_source_remove(state->configReloadTask);
+      state->configReloadTask = 0;
+   }
+   g_free(state->configWatchName);
+   state->configWatchName = NULL;
+#endif
+}
+
+
 /**
  * IO freeze signal handler. Disables the conf file check task if I/O is
  * frozen, re-enable it otherwise. See bug 529653.
@@ -163,14 +401,15 @@ ToolsCoreIOFreezeCb(gpointer src,
                     ToolsServiceState *state)
 {
    if (state->configCheckTask > 0 && freeze) {
-      g_source_remove(state->configCheckTask);
-      state->configCheckTask = 0;
+      ToolsCoreStopConfigCheck(state);
       VMTools_SuspendLogIO();
    } else if (state->configCheckTask == 0 && !freeze) {
       VMTools_ResumeLogIO();
-      state->configCheckTask = g_timeout_add(CONF_POLL_TIME * 1000,
-                                             ToolsCoreConfFileCb,
-                                             state);
+      ToolsCoreStartConfigCheck(state);
+#if defined(__linux__)
+      /* Changes made while frozen were not seen by the watch. */
+      ToolsCoreScheduleConfReload(state);
+#endif
    }
 }
 
@@ -245,9 +484,7 @@ ToolsCoreRunLoop(ToolsServiceState *state)
                           state);
       }
 
-      state->configCheckTask = g_timeout_add(CONF_POLL_TIME * 1000,
-                                             ToolsCoreConfFileCb,
-                                             state);
+      ToolsCoreStartConfigCheck(state);
 
 #if defined(__APPLE__)
       ToolsCore_CFRunLoop(state);
@@ -344,6 +581,10 @@ ToolsCore_GetTcloName(ToolsServiceState *state)
  * time, try to upgrade it to the new version if an old version is
  * detected.
  *
+ * Plugins are only notified when the contents of the file actually changed;
+ * TOOLS_CORE_SIG_CONF_CHANGED carries the changed keys of each modified
+ * group, and is followed by TOOLS_CORE_SIG_CONF_RELOAD.
+ *
  * @param[in]  state       Service state.
  * @param[in]  reset       Whether to reset the logging subsystem.
  */
@@ -353,23 +594,39 @@ ToolsCore_ReloadConfig(ToolsServiceState *state,
                        gboolean reset)
 {
    gboolean first = state->ctx.config == NULL;
+   gboolean changed = FALSE;
    gboolean loaded;
+   GKeyFile *config = NULL;
 
    loaded = VMTools_LoadConfig(state->configFile,
                                G_KEY_FILE_NONE,
-                               &state->ctx.config,
+                               &config,
                                &state->configMtime);
+   if (loaded) {
+      GHashTable *changes = VMTools_ConfigDiff(state->ctx.config, config);
 
-   if (!first && loaded) {
-      g_debug("Config file reloaded.\n");
-
-      /*
-       * Inform plugins of config file update.
-       */
-      ASSERT(state->ctx.serviceObj != NULL);
-      g_signal_emit_by_name(state->ctx.serviceObj,
-                            TOOLS_CORE_SIG_CONF_RELOAD,
-                            &state->ctx);
+      changed = (g_hash_table_size(changes) > 0);
+      if (state->ctx.config != NULL) {
+         g_key_file_free(state->ctx.config);
+      }
+      state->ctx.config = config;
+
+      if (!first && changed) {
+         g_debug("Config file reloaded.\n");
+
+         /*
+          * Inform plugins of config file update.
+          */
+         ASSERT(state->ctx.serviceObj != NULL);
+         g_signal_emit_by_name(state->ctx.serviceObj,
+                               TOOLS_CORE_SIG_CONF_CHANGED,
+                               &state->ctx,
+                               changes);
+         g_signal_emit_by_name(state->ctx.serviceObj,
+                               TOOLS_CORE_SIG_CONF_RELOAD,
+                               &state->ctx);
+      }
+      g_hash_table_destroy(changes);
    }
 
    if (state->ctx.config == NULL) {
@@ -377,7 +634,7 @@ ToolsCore_ReloadConfig(ToolsServiceState *state,
       state->ctx.config = g_key_file_new();
    }
 
-   if (reset || loaded) {
+   if (reset || (loaded && (first || changed))) {
       VMTools_ConfigLogging(state->name,
                             state->ctx.config,
                             TRUE,
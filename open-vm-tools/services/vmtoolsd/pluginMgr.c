@@ -23,6 +23,10 @@
  */
 
 #include <string.h>
+#if defined(__linux__)
+#  include <fcntl.h>
+#  include <unistd.h>
+#endif
 #include "toolsCoreInt.h"
 
 #include "vm_assert.h"
@@ -36,10 +40,12 @@
 
 /** Defines the internal data about a plugin. */
 typedef struct ToolsPlugin {
-   gchar               *fileName;
-   GModule             *module;
-   ToolsPluginOnLoad    onload;
-   ToolsPluginData     *data;
+   gchar                      *fileName;
+   GModule                    *module;
+   ToolsPluginOnLoad           onload;
+   ToolsPluginOnLoadDeferred   onloadDeferred;
+   ToolsPluginData            *data;
+   gdouble                     loadTime;   // Time spent opening, in ms.
 } ToolsPlugin;
 
 
@@ -488,6 +494,39 @@ ToolsCoreStrPtrCompare(gconstpointer _str1,
 }
 
 
+#if defined(__linux__)
+/**
+ * Asks the kernel to start reading all the plugin files in the background.
+ * The dynamic loader serializes g_module_open() calls, so the files are then
+ * opened one at a time, but on a cold cache the reads of the later plugins
+ * overlap with the loading of the earlier ones instead of happening on
+ * demand, one page fault at a time.
+ *
+ * @param[in]  pluginPath  Directory containing the plugins.
+ * @param[in]  plugins     File names of the plugins.
+ */
+
+static void
+ToolsCorePrefetchPlugins(const gchar *pluginPath,
+                         GPtrArray *plugins)
+{
+   guint i;
+
+   for (i = 0; i < plugins->len; i++) {
+      gchar *path = g_strdup_printf("%s%c%s", pluginPath, DIRSEPC,
+                                    (gchar *) g_ptr_array_index(plugins, i));
+      int fd = open(path, O_RDONLY);
+
+      if (fd != -1) {
+         (void) posix_fadvise(fd, 0, 0, POSIX_FADV_WILLNEED);
+         close(fd);
+      }
+      g_free(path);
+   }
+}
+#endif
+
+
 /**
  * Loads all the plugins found in the given directory, adding the registration
  * data to the given array.
@@ -508,6 +547,7 @@ ToolsCoreLoadDirectory(ToolsAppCtx *ctx,
    GDir *dir = NULL;
    GError *err = NULL;
    GPtrArray *plugins;
+   GTimer *timer;
 
    dir = g_dir_open(pluginPath, 0, &err);
    if (dir == NULL) {
@@ -531,13 +571,21 @@ ToolsCoreLoadDirectory(ToolsAppCtx *ctx,
 
    g_ptr_array_sort(plugins, ToolsCoreStrPtrCompare);
 
+#if defined(__linux__)
+   ToolsCorePrefetchPlugins(pluginPath, plugins);
+#endif
+
+   timer = g_timer_new();
+
    for (i = 0; i < plugins->len; i++) {
       gchar *entry;
       gchar *path;
       GModule *module = NULL;
       ToolsPlugin *plugin = NULL;
       ToolsPluginOnLoad onload;
+      ToolsPluginOnLoadDeferred onloadDeferred;
 
+      g_timer_start(timer);
       entry = g_ptr_array_index(plugins, i);
       path = g_strdup_printf("%s%c%s", pluginPath, DIRSEPC, entry);
 
@@ -578,11 +626,18 @@ ToolsCoreLoadDirectory(ToolsAppCtx *ctx,
          goto next;
       }
 
+      if (!g_module_symbol(module, "ToolsOnLoadDeferred",
+                           (gpointer *) &onloadDeferred)) {
+         onloadDeferred = NULL;
+      }
+
       plugin = g_malloc(sizeof *plugin);
       plugin->fileName = entry;
       plugin->data = NULL;
       plugin->module = module;
       plugin->onload = onload;
+      plugin->onloadDeferred = onloadDeferred;
+      plugin->loadTime = g_timer_elapsed(timer, NULL) * 1000.0;
       g_ptr_array_add(regs, plugin);
 
    next:
@@ -594,6 +649,7 @@ ToolsCoreLoadDirectory(ToolsAppCtx *ctx,
       }
    }
 
+   g_timer_destroy(timer);
    g_ptr_array_free(plugins, TRUE);
    ret = TRUE;
 
@@ -637,6 +693,7 @@ ToolsCore_LoadPlugins(ToolsServiceState *state)
    gchar *pluginRoot;
    guint i;
    GPtrArray *plugins = NULL;
+   GTimer *timer = g_timer_new();
 
 #if defined(sun) && defined(__x86_64__)
    const char *subdir = "/amd64";
@@ -726,6 +783,7 @@ ToolsCore_LoadPlugins(ToolsServiceState *state)
 
    for (i = 0; i < plugins->len; i++) {
       ToolsPlugin *plugin = g_ptr_array_index(plugins, i);
+      gdouble initStart = g_timer_elapsed(timer, NULL);
 
       plugin->data = plugin->onload(&state->ctx);
 
@@ -742,10 +800,15 @@ ToolsCore_LoadPlugins(ToolsServiceState *state)
          g_module_make_resident(plugin->module);
          g_ptr_array_add(state->plugins, plugin);
          VMTools_BindTextDomain(plugin->data->name, NULL, NULL);
-         g_message("Plugin '%s' initialized.\n", plugin->data->name);
+         g_message("Plugin '%s' initialized (load %.1f ms, init %.1f ms).\n",
+                   plugin->data->name, plugin->loadTime,
+                   (g_timer_elapsed(timer, NULL) - initStart) * 1000.0);
       }
    }
 
+   g_message("Plugins loaded in %.1f ms.\n",
+             g_timer_elapsed(timer, NULL) * 1000.0);
+
 
    /*
     * If there is a debug plugin, see if it exports standard plugin registration
@@ -756,6 +819,9 @@ ToolsCore_LoadPlugins(ToolsServiceState *state)
       ToolsPlugin *plugin = g_malloc(sizeof *plugin);
       plugin->fileName = NULL;
       plugin->module = NULL;
+      plugin->onload = NULL;
+      plugin->onloadDeferred = NULL;
+      plugin->loadTime = 0;
       plugin->data = data;
       VMTools_BindTextDomain(data->name, NULL, NULL);
       g_ptr_array_add(state->plugins, plugin);
@@ -767,11 +833,47 @@ exit:
    if (plugins != NULL) {
       g_ptr_array_free(plugins, TRUE);
    }
+   g_timer_destroy(timer);
    g_free(pluginRoot);
    return ret;
 }
 
 
+/**
+ * Idle callback that runs the deferred initialization function of the next
+ * plugin that provides one. Only one plugin is initialized per main loop
+ * iteration, so that pending RPCs and other events are not held up.
+ *
+ * @param[in]  _state   The service state.
+ *
+ * @return Whether there may be more plugins to initialize.
+ */
+
+static gboolean
+ToolsCoreDeferredInitCb(gpointer _state)
+{
+   ToolsServiceState *state = _state;
+
+   while (state->pluginInitNext < state->plugins->len) {
+      ToolsPlugin *plugin = g_ptr_array_index(state->plugins,
+                                              state->pluginInitNext++);
+
+      if (plugin->onloadDeferred != NULL) {
+         GTimer *timer = g_timer_new();
+
+         plugin->onloadDeferred(&state->ctx, plugin->data);
+         g_message("Plugin '%s' deferred initialization done (%.1f ms).\n",
+                   plugin->data->name, g_timer_elapsed(timer, NULL) * 1000.0);
+         g_timer_destroy(timer);
+         return TRUE;
+      }
+   }
+
+   state->pluginInitTask = 0;
+   return FALSE;
+}
+
+
 /**
  * Registers all RPC handlers provided by the loaded and enabled plugins.
  *
@@ -852,6 +954,16 @@ ToolsCore_RegisterPlugins(ToolsServiceState *state)
     * individual app providers as necessary.
     */
    ToolsCoreForEachPlugin(state, NULL, ToolsCoreRegisterApp);
+
+   /*
+    * Finally, schedule the deferred initialization of the plugins that asked
+    * for it; it will run once the main loop is idle.
+    */
+   state->pluginInitNext = 0;
+   state->pluginInitTask = g_idle_add_full(G_PRIORITY_LOW,
+                                           ToolsCoreDeferredInitCb,
+                                           state,
+                                           NULL);
 }
 
 
@@ -877,6 +989,11 @@ ToolsCore_UnloadPlugins(ToolsServiceState *state)
       return;
    }
 
+   if (state->pluginInitTask != 0) {
+      g_source_remove(state->pluginInitTask);
+      state->pluginInitTask = 0;
+   }
+
    if (state->capsRegistered) {
       GArray *pcaps = NULL;
       g_signal_emit_by_name(state->ctx.serviceObj,
@@ -71,11 +71,17 @@ typedef struct ToolsServiceState {
    gchar         *configFile;
    time_t         configMtime;
    guint          configCheckTask;
+#if defined(__linux__)
+   gchar         *configWatchName;
+   guint          configReloadTask;
+#endif
    gboolean       mainService;
    gboolean       capsRegistered;
    gchar         *commonPath;
    gchar         *pluginPath;
    GPtrArray     *plugins;
+   guint          pluginInitTask;
+   guint          pluginInitNext;
 #if defined(_WIN32)
    gchar         *displayName;
 #else
@@ -0,0 +1,570 @@
+/*********************************************************
+ * Copyright (C) 2016 VMware, Inc. All rights reserved.
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU Lesser General Public License as published
+ * by the Free Software Foundation version 2.1 and no later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+ * or FITNESS FOR A PARTICULAR PURPOSE.  See the Lesser GNU General Public
+ * License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin St, Fifth Floor, Boston, MA  02110-1301 USA.
+ *
+ *********************************************************/
+
+/*
+ * confReloadBench.c --
+ *
+ *      Benchmark of the cost of a tools.conf reload in vmtoolsd with many
+ *      plugins loaded. The config has one group per simulated plugin, and
+ *      each save changes one key of one group. The save goes through a
+ *      rename, as editors do, and is picked up by an inotify watch on the
+ *      directory set up like ToolsCoreWatchConfigFile's; the watch callback
+ *      follows ToolsCoreConfWatchCb. Each save is then timed in steps:
+ *
+ *      - event:  from the end of the save to the watch callback;
+ *      - load:   VMTools_LoadConfig, as in ToolsCore_ReloadConfig;
+ *      - diff:   VMTools_ConfigDiff against the current dictionary;
+ *      - notify: the plugins' handlers, in two ways:
+ *        - reload all:   every plugin re-reads all its keys and restarts
+ *                        its timer, which is what TOOLS_CORE_SIG_CONF_RELOAD
+ *                        handlers do;
+ *        - changed keys: a plugin only does so if the diff passed in
+ *                        TOOLS_CORE_SIG_CONF_CHANGED lists keys of its group.
+ *
+ *      The handlers are called directly; signal emission adds a small fixed
+ *      cost per handler to both. The 250 ms debounce of vmtoolsd is not
+ *      included. For comparison, "poll" is one wakeup of the fallback timer
+ *      when the file did not change (a stat), and the polling fallback only
+ *      notices a change after up to CONF_POLL_TIME seconds.
+ */
+
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/inotify.h>
+#include <sys/time.h>
+
+#include <glib.h>
+#include <glib/gstdio.h>
+
+#include "vmware.h"
+#include "vmware/tools/utils.h"
+
+#define BENCH_MAX_PLUGINS      256
+#define BENCH_MAX_KEYS         64
+#define BENCH_CONF_FILE        "tools.conf"
+
+typedef struct {
+   gchar        *group;
+   guint         timer;
+} BenchPlugin;
+
+typedef struct {
+   gchar        *dir;
+   gchar        *path;
+   GKeyFile     *config;
+   GMainLoop    *mainLoop;
+   BenchPlugin   plugins[BENCH_MAX_PLUGINS];
+   gchar        *keys[BENCH_MAX_KEYS];
+   unsigned int  numPlugins;
+   unsigned int  numKeys;
+   uint64        savedUS;
+   uint64        eventUS;
+} BenchState;
+
+typedef struct {
+   uint64        eventUS;
+   uint64        maxEventUS;
+   uint64        loadUS;
+   uint64        diffUS;
+   uint64        allUS;
+   uint64        changedUS;
+   unsigned int  allRestarts;
+   unsigned int  changedRestarts;
+} BenchResult;
+
+
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * BenchNowUS --
+ *
+ *      Returns the current time in microseconds.
+ *
+ * Results:
+ *      The time.
+ *
+ * Side effects:
+ *      None.
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+static uint64
+BenchNowUS(void)
+{
+   struct timeval tv;
+
+   gettimeofday(&tv, NULL);
+   return (uint64)tv.tv_sec * 1000000 + tv.tv_usec;
+}
+
+
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * BenchTimerCb --
+ *
+ *      Stand-in for a plugin's periodic work. Never runs, since the main
+ *      loop only runs until the next inotify event.
+ *
+ * Results:
+ *      TRUE.
+ *
+ * Side effects:
+ *      None.
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+static gboolean
+BenchTimerCb(gpointer data)   // IN: unused
+{
+   return TRUE;
+}
+
+
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * BenchPluginReload --
+ *
+ *      What a plugin typically does when its config may have changed:
+ *      re-reads all its keys and restarts its timer.
+ *
+ * Results:
+ *      None.
+ *
+ * Side effects:
+ *      Replaces the plugin's timer.
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+static void
+BenchPluginReload(BenchState *state,     // IN
+                  BenchPlugin *plugin)   // IN/OUT
+{
+   gint interval = 0;
+   unsigned int i;
+
+   for (i = 0; i < state->numKeys; i++) {
+      interval += VMTools_ConfigGetInteger(state->config, plugin->group,
+                                           state->keys[i], 0);
+   }
+
+   if (plugin->timer != 0) {
+      g_source_remove(plugin->timer);
+   }
+   plugin->timer = g_timeout_add(1000 + interval % 1000, BenchTimerCb, NULL);
+}
+
+
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * BenchWatchCb --
+ *
+ *      Handles inotify events for the config directory the way
+ *      ToolsCoreConfWatchCb does, and quits the main loop once the config
+ *      file was replaced.
+ *
+ * Results:
+ *      Whether to keep watching the directory.
+ *
+ * Side effects:
+ *      Records the time of the event.
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+static gboolean
+BenchWatchCb(GIOChannel *chan,     // IN
+             GIOCondition cond,    // IN
+             gpointer data)        // IN: BenchState
+{
+   BenchState *state = data;
+   int fd = g_io_channel_unix_get_fd(chan);
+   gboolean watch = (cond & (G_IO_ERR | G_IO_HUP | G_IO_NVAL)) == 0;
+
+   while (watch) {
+      char buf[4096]
+         __attribute__ ((aligned(__alignof__(struct inotify_event))));
+      ssize_t len = read(fd, buf, sizeof buf);
+      char *p;
+
+      if (len <= 0) {
+         if (len == -1 && errno != EAGAIN && errno != EINTR) {
+            fprintf(stderr, "Error reading events: %s\n", strerror(errno));
+            watch = FALSE;
+         }
+         break;
+      }
+
+      for (p = buf; p < buf + len; ) {
+         struct inotify_event *event = (struct inotify_event *) p;
+
+         if (event->mask & IN_IGNORED) {
+            watch = FALSE;
+         } else if (event->len > 0 &&
+                    strcmp(event->name, BENCH_CONF_FILE) == 0 &&
+                    state->eventUS == 0) {
+            state->eventUS = BenchNowUS();
+            g_main_loop_quit(state->mainLoop);
+         }
+         p += sizeof *event + event->len;
+      }
+   }
+
+   if (!watch) {
+      g_main_loop_quit(state->mainLoop);
+   }
+   return watch;
+}
+
+
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * BenchSave --
+ *
+ *      Writes the config file through a temporary file and a rename.
+ *
+ * Results:
+ *      TRUE on success.
+ *
+ * Side effects:
+ *      Replaces the config file.
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+static Bool
+BenchSave(BenchState *state,    // IN/OUT
+          GKeyFile *config)     // IN: new contents
+{
+   gchar *data;
+   gsize length;
+   GError *err = NULL;
+   Bool ok;
+
+   data = g_key_file_to_data(config, &length, NULL);
+   ok = g_file_set_contents(state->path, data, length, &err);
+   if (!ok) {
+      fprintf(stderr, "Cannot write config: %s\n", err->message);
+      g_clear_error(&err);
+   }
+   g_free(data);
+
+   state->eventUS = 0;
+   state->savedUS = BenchNowUS();
+   return ok;
+}
+
+
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * BenchReload --
+ *
+ *      Waits for the watch to see the last save, then reloads the config
+ *      and runs the plugins' handlers both ways.
+ *
+ * Results:
+ *      TRUE if the save was seen and the diff is the expected one.
+ *
+ * Side effects:
+ *      Replaces the current config; adds the timings to result.
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+static Bool
+BenchReload(BenchState *state,         // IN/OUT
+            const gchar *group,        // IN: group changed by the save
+            BenchResult *result)       // IN/OUT
+{
+   GKeyFile *config = NULL;
+   GHashTable *changes;
+   const gchar * const *keys;
+   uint64 start;
+   uint64 end;
+   unsigned int i;
+
+   g_main_loop_run(state->mainLoop);
+   if (state->eventUS == 0) {
+      fprintf(stderr, "The config directory watch stopped.\n");
+      return FALSE;
+   }
+   result->eventUS += state->eventUS - state->savedUS;
+   result->maxEventUS = MAX(result->maxEventUS,
+                            state->eventUS - state->savedUS);
+
+   start = BenchNowUS();
+   if (!VMTools_LoadConfig(state->path, G_KEY_FILE_NONE, &config, NULL)) {
+      fprintf(stderr, "Cannot load the config.\n");
+      return FALSE;
+   }
+   end = BenchNowUS();
+   result->loadUS += end - start;
+
+   start = end;
+   changes = VMTools_ConfigDiff(state->config, config);
+   end = BenchNowUS();
+   result->diffUS += end - start;
+
+   g_key_file_free(state->config);
+   state->config = config;
+
+   keys = g_hash_table_lookup(changes, group);
+   if (g_hash_table_size(changes) != 1 || keys == NULL ||
+       g_strv_length((gchar **) keys) != 1) {
+      fprintf(stderr, "Unexpected config diff for [%s].\n", group);
+      g_hash_table_destroy(changes);
+      return FALSE;
+   }
+
+   start = BenchNowUS();
+   for (i = 0; i < state->numPlugins; i++) {
+      BenchPluginReload(state, &state->plugins[i]);
+      result->allRestarts++;
+   }
+   end = BenchNowUS();
+   result->allUS += end - start;
+
+   start = end;
+   for (i = 0; i < state->numPlugins; i++) {
+      BenchPlugin *plugin = &state->plugins[i];
+
+      keys = g_hash_table_lookup(changes, plugin->group);
+      if (keys != NULL && keys[0] != NULL) {
+         BenchPluginReload(state, plugin);
+         result->changedRestarts++;
+      }
+   }
+   result->changedUS += BenchNowUS() - start;
+
+   g_hash_table_destroy(changes);
+   return TRUE;
+}
+
+
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * BenchUsage --
+ *
+ *      Prints the usage.
+ *
+ * Results:
+ *      None.
+ *
+ * Side effects:
+ *      None.
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+static void
+BenchUsage(const char *name)   // IN: program name
+{
+   fprintf(stderr,
+           "Usage: %s [options]\n"
+           "  -n count   plugins, one config group each (default: 32, max %d)\n"
+           "  -k count   keys per group (default: 8, max %d)\n"
+           "  -i count   config saves (default: 200)\n",
+           name, BENCH_MAX_PLUGINS, BENCH_MAX_KEYS);
+}
+
+
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * main --
+ *
+ *      Main entry point.
+ *
+ * Results:
+ *      EXIT_SUCCESS if every save was seen and diffed as expected.
+ *
+ * Side effects:
+ *      Creates and removes a temporary directory.
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+int
+main(int argc,          // IN
+     char *argv[])      // IN
+{
+   BenchState state;
+   BenchResult result;
+   GKeyFile *config;
+   GIOChannel *chan;
+   unsigned int iterations = 200;
+   unsigned int i;
+   unsigned int j;
+   time_t mtime;
+   uint64 start;
+   uint64 pollUS;
+   guint watch;
+   Bool ok = TRUE;
+   int opt;
+   int fd;
+
+   memset(&state, 0, sizeof state);
+   memset(&result, 0, sizeof result);
+   state.numPlugins = 32;
+   state.numKeys = 8;
+
+   while ((opt = getopt(argc, argv, "n:k:i:")) != -1) {
+      switch (opt) {
+      case 'n':
+         state.numPlugins = strtoul(optarg, NULL, 10);
+         break;
+      case 'k':
+         state.numKeys = strtoul(optarg, NULL, 10);
+         break;
+      case 'i':
+         iterations = strtoul(optarg, NULL, 10);
+         break;
+      default:
+         BenchUsage(argv[0]);
+         return EXIT_FAILURE;
+      }
+   }
+
+   if (state.numPlugins == 0 || state.numPlugins > BENCH_MAX_PLUGINS ||
+       state.numKeys == 0 || state.numKeys > BENCH_MAX_KEYS ||
+       iterations == 0) {
+      BenchUsage(argv[0]);
+      return EXIT_FAILURE;
+   }
+
+   state.dir = g_build_filename(g_get_tmp_dir(), "confReloadBench.XXXXXX",
+                                NULL);
+   if (mkdtemp(state.dir) == NULL) {
+      perror("mkdtemp");
+      return EXIT_FAILURE;
+   }
+   state.path = g_build_filename(state.dir, BENCH_CONF_FILE, NULL);
+   state.mainLoop = g_main_loop_new(NULL, FALSE);
+
+   config = g_key_file_new();
+   for (j = 0; j < state.numKeys; j++) {
+      state.keys[j] = g_strdup_printf("key%02u", j);
+   }
+   for (i = 0; i < state.numPlugins; i++) {
+      state.plugins[i].group = g_strdup_printf("plugin%03u", i);
+      for (j = 0; j < state.numKeys; j++) {
+         g_key_file_set_integer(config, state.plugins[i].group,
+                                state.keys[j], j);
+      }
+   }
+
+   if (!BenchSave(&state, config) ||
+       !VMTools_LoadConfig(state.path, G_KEY_FILE_NONE, &state.config,
+                           NULL)) {
+      fprintf(stderr, "Cannot set up the config file.\n");
+      return EXIT_FAILURE;
+   }
+   for (i = 0; i < state.numPlugins; i++) {
+      BenchPluginReload(&state, &state.plugins[i]);
+   }
+
+   fd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+   if (fd == -1 ||
+       inotify_add_watch(fd, state.dir, IN_CLOSE_WRITE | IN_MOVED_TO |
+                         IN_MOVED_FROM | IN_CREATE | IN_DELETE |
+                         IN_ONLYDIR) == -1) {
+      fprintf(stderr, "Cannot watch %s: %s\n", state.dir, strerror(errno));
+      return EXIT_FAILURE;
+   }
+   chan = g_io_channel_unix_new(fd);
+   g_io_channel_set_close_on_unref(chan, TRUE);
+   watch = g_io_add_watch(chan, G_IO_IN | G_IO_ERR | G_IO_HUP | G_IO_NVAL,
+                          BenchWatchCb, &state);
+   g_io_channel_unref(chan);
+
+   for (i = 0; ok && i < iterations; i++) {
+      const gchar *group = state.plugins[i % state.numPlugins].group;
+
+      g_key_file_set_integer(config, group, state.keys[i % state.numKeys],
+                             1000 + i);
+      ok = BenchSave(&state, config) && BenchReload(&state, group, &result);
+   }
+
+   /* One wakeup of the polling fallback when nothing changed. */
+   mtime = time(NULL);
+   start = BenchNowUS();
+   for (i = 0; i < iterations; i++) {
+      GKeyFile *unchanged = NULL;
+
+      if (VMTools_LoadConfig(state.path, G_KEY_FILE_NONE, &unchanged,
+                             &mtime)) {
+         g_key_file_free(unchanged);
+      }
+   }
+   pollUS = BenchNowUS() - start;
+
+   g_source_remove(watch);
+   for (i = 0; i < state.numPlugins; i++) {
+      if (state.plugins[i].timer != 0) {
+         g_source_remove(state.plugins[i].timer);
+      }
+      g_free(state.plugins[i].group);
+   }
+   for (j = 0; j < state.numKeys; j++) {
+      g_free(state.keys[j]);
+   }
+   g_key_file_free(config);
+   g_key_file_free(state.config);
+   g_main_loop_unref(state.mainLoop);
+   g_unlink(state.path);
+   g_rmdir(state.dir);
+   g_free(state.path);
+   g_free(state.dir);
+
+   if (!ok) {
+      return EXIT_FAILURE;
+   }
+
+   printf("%u plugins, %u keys each, %u saves\n", state.numPlugins,
+          state.numKeys, iterations);
+   printf("%-22s %10s %14s\n", "step", "us/save", "timer restarts");
+   printf("%-22s %10.1f %14s (max %.1f us)\n", "event",
+          (double)result.eventUS / iterations, "",
+          (double)result.maxEventUS);
+   printf("%-22s %10.1f\n", "load",
+          (double)result.loadUS / iterations);
+   printf("%-22s %10.1f\n", "diff",
+          (double)result.diffUS / iterations);
+   printf("%-22s %10.1f %14.1f\n", "notify, reload all",
+          (double)result.allUS / iterations,
+          (double)result.allRestarts / iterations);
+   printf("%-22s %10.1f %14.1f\n", "notify, changed keys",
+          (double)result.changedUS / iterations,
+          (double)result.changedRestarts / iterations);
+   printf("%-22s %10.1f\n", "poll, no change",
+          (double)pollUS / iterations);
+
+   return EXIT_SUCCESS;
+}
@@ -0,0 +1,372 @@
+/*********************************************************
+ * Copyright (C) 2016 VMware, Inc. All rights reserved.
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU Lesser General Public License as published
+ * by the Free Software Foundation version 2.1 and no later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+ * or FITNESS FOR A PARTICULAR PURPOSE.  See the Lesser GNU General Public
+ * License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin St, Fifth Floor, Boston, MA  02110-1301 USA.
+ *
+ *********************************************************/
+
+/*
+ * configDiffTest.c --
+ *
+ *      Unit test for VMTools_ConfigDiff in libvmtools, which decides which
+ *      groups and keys vmtoolsd reports in TOOLS_CORE_SIG_CONF_CHANGED when
+ *      tools.conf is reloaded.
+ *
+ *      Each case parses an old and a new tools.conf and checks the changed
+ *      keys of each changed group; the order of the key lists is not part
+ *      of the contract.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <glib.h>
+
+#include "vmware.h"
+#include "vmware/tools/utils.h"
+
+typedef struct {
+   const char *name;
+   const char *oldConf;      // NULL for no config
+   const char *newConf;      // NULL for no config
+   const char *expected;     // See TestSameChanges
+} TestCase;
+
+static const TestCase testCases[] = {
+   {
+      "no config at all",
+      NULL,
+      NULL,
+      "",
+   },
+   {
+      "identical",
+      "[logging]\nlog=true\n[guestinfo]\npoll-interval=30\n",
+      "[logging]\nlog=true\n[guestinfo]\npoll-interval=30\n",
+      "",
+   },
+   {
+      "comments, blank lines, spacing and order",
+      "[logging]\nlog=true\nlevel=debug\n[guestinfo]\npoll-interval=30\n",
+      "# tools.conf\n[guestinfo]\n\npoll-interval = 30\n"
+      "[logging]\n# quiet\nlevel=debug\nlog=true\n",
+      "",
+   },
+   {
+      "value changed",
+      "[logging]\nlog=true\n[guestinfo]\npoll-interval=30\n",
+      "[logging]\nlog=true\n[guestinfo]\npoll-interval=60\n",
+      "guestinfo:poll-interval",
+   },
+   {
+      "value changed in one of two groups with the same key",
+      "[a]\nkey=1\n[b]\nkey=1\n",
+      "[a]\nkey=1\n[b]\nkey=2\n",
+      "b:key",
+   },
+   {
+      "key added",
+      "[guestinfo]\npoll-interval=30\n",
+      "[guestinfo]\npoll-interval=30\ndisable-perf-mon=true\n",
+      "guestinfo:disable-perf-mon",
+   },
+   {
+      "key removed",
+      "[guestinfo]\npoll-interval=30\ndisable-perf-mon=true\n",
+      "[guestinfo]\npoll-interval=30\n",
+      "guestinfo:disable-perf-mon",
+   },
+   {
+      "key renamed, same key count",
+      "[guestinfo]\npoll-interval=30\n",
+      "[guestinfo]\npoll-intervall=30\n",
+      "guestinfo:poll-interval poll-intervall",
+   },
+   {
+      "value set to empty",
+      "[vmsvc]\ndisabled=x\n",
+      "[vmsvc]\ndisabled=\n",
+      "vmsvc:disabled",
+   },
+   {
+      "group added",
+      "[logging]\nlog=true\n",
+      "[logging]\nlog=true\n[guestinfo]\npoll-interval=30\n",
+      "guestinfo:poll-interval",
+   },
+   {
+      "group removed",
+      "[logging]\nlog=true\n[guestinfo]\npoll-interval=30\n",
+      "[logging]\nlog=true\n",
+      "guestinfo:poll-interval",
+   },
+   {
+      "empty group added",
+      "[logging]\nlog=true\n",
+      "[logging]\nlog=true\n[powerops]\n",
+      "powerops:",
+   },
+   {
+      "group emptied",
+      "[powerops]\npoweron-script=on.sh\n",
+      "[powerops]\n",
+      "powerops:poweron-script",
+   },
+   {
+      "one of several keys changed",
+      "[guestinfo]\npoll-interval=30\nstats-interval=20\n"
+      "disable-perf-mon=false\n",
+      "[guestinfo]\npoll-interval=30\nstats-interval=40\n"
+      "disable-perf-mon=false\n",
+      "guestinfo:stats-interval",
+   },
+   {
+      "empty group removed",
+      "[logging]\nlog=true\n[powerops]\n",
+      "[logging]\nlog=true\n",
+      "powerops:",
+   },
+   {
+      "empty group in both",
+      "[powerops]\n",
+      "[powerops]\n",
+      "",
+   },
+   {
+      "first load",
+      NULL,
+      "[logging]\nlog=true\n[guestinfo]\npoll-interval=30\n",
+      "logging:log;guestinfo:poll-interval",
+   },
+   {
+      "config removed",
+      "[logging]\nlog=true\n[guestinfo]\npoll-interval=30\n",
+      NULL,
+      "logging:log;guestinfo:poll-interval",
+   },
+   {
+      "added, removed and changed together",
+      "[logging]\nlog=true\n[guestinfo]\npoll-interval=30\n[vmbackup]\n"
+      "enableSyncDriver=true\n",
+      "[logging]\nlog=false\n[guestinfo]\npoll-interval=30\n[unity]\n"
+      "pbrpc.enable=true\n",
+      "logging:log;vmbackup:enableSyncDriver;unity:pbrpc.enable",
+   },
+};
+
+
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * TestLoad --
+ *
+ *      Parses config data.
+ *
+ * Results:
+ *      The dictionary, NULL if data is NULL.
+ *
+ * Side effects:
+ *      Exits if the data does not parse.
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+static GKeyFile *
+TestLoad(const char *data)   // IN: tools.conf contents
+{
+   GKeyFile *config;
+   GError *err = NULL;
+
+   if (data == NULL) {
+      return NULL;
+   }
+
+   config = g_key_file_new();
+   if (!g_key_file_load_from_data(config, data, strlen(data),
+                                  G_KEY_FILE_NONE, &err)) {
+      fprintf(stderr, "Cannot parse test config: %s\n", err->message);
+      exit(EXIT_FAILURE);
+   }
+
+   return config;
+}
+
+
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * TestSameKeys --
+ *
+ *      Compares a list of changed keys with the expected ones.
+ *
+ * Results:
+ *      TRUE if both hold the same keys, each once.
+ *
+ * Side effects:
+ *      None.
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+static Bool
+TestSameKeys(const gchar * const *keys,   // IN: changed keys of a group
+             const char *expected)        // IN: space separated keys
+{
+   gchar **wanted = g_strsplit(expected, " ", -1);
+   guint numKeys = g_strv_length((gchar **) keys);
+   guint numWanted = expected[0] == '\0' ? 0 : g_strv_length(wanted);
+   Bool same = numKeys == numWanted;
+   guint i;
+   guint j;
+
+   for (i = 0; same && i < numWanted; i++) {
+      guint found = 0;
+
+      for (j = 0; j < numKeys; j++) {
+         if (strcmp(keys[j], wanted[i]) == 0) {
+            found++;
+         }
+      }
+      same = found == 1;
+   }
+
+   g_strfreev(wanted);
+   return same;
+}
+
+
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * TestSameChanges --
+ *
+ *      Compares the changes reported by VMTools_ConfigDiff with the expected
+ *      ones, given as "group:key key;group:key". A group with no keys is
+ *      written as "group:".
+ *
+ * Results:
+ *      TRUE if both hold the same groups, with the same keys.
+ *
+ * Side effects:
+ *      None.
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+static Bool
+TestSameChanges(GHashTable *changes,      // IN: VMTools_ConfigDiff result
+                const char *expected)     // IN: expected changes
+{
+   gchar **wanted = g_strsplit(expected, ";", -1);
+   guint numWanted = expected[0] == '\0' ? 0 : g_strv_length(wanted);
+   Bool same = g_hash_table_size(changes) == numWanted;
+   guint i;
+
+   for (i = 0; same && i < numWanted; i++) {
+      gchar **groupKeys = g_strsplit(wanted[i], ":", 2);
+      const gchar * const *keys = g_hash_table_lookup(changes, groupKeys[0]);
+
+      same = keys != NULL && TestSameKeys(keys, groupKeys[1]);
+      g_strfreev(groupKeys);
+   }
+
+   g_strfreev(wanted);
+   return same;
+}
+
+
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * TestPrintGroup --
+ *
+ *      Hash table callback that prints the changed keys of a group in the
+ *      format of the expected results.
+ *
+ * Results:
+ *      None.
+ *
+ * Side effects:
+ *      Writes to stderr.
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+static void
+TestPrintGroup(gpointer group,      // IN: group name
+               gpointer keys,       // IN: changed keys
+               gpointer first)      // IN/OUT: Bool, whether nothing printed
+{
+   gchar *joined = g_strjoinv(" ", keys);
+
+   fprintf(stderr, "%s%s:%s", *(Bool *) first ? "" : ";",
+           (const gchar *) group, joined);
+   g_free(joined);
+   *(Bool *) first = FALSE;
+}
+
+
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * main --
+ *
+ *      Main entry point.
+ *
+ * Results:
+ *      EXIT_SUCCESS if every case passed.
+ *
+ * Side effects:
+ *      None.
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+int
+main(int argc,          // IN
+     char *argv[])      // IN
+{
+   unsigned int failures = 0;
+   unsigned int i;
+
+   for (i = 0; i < ARRAYSIZE(testCases); i++) {
+      const TestCase *test = &testCases[i];
+      GKeyFile *oldConfig = TestLoad(test->oldConf);
+      GKeyFile *newConfig = TestLoad(test->newConf);
+      GHashTable *changes = VMTools_ConfigDiff(oldConfig, newConfig);
+
+      if (!TestSameChanges(changes, test->expected)) {
+         Bool first = TRUE;
+
+         fprintf(stderr, "%s: changes '", test->name);
+         g_hash_table_foreach(changes, TestPrintGroup, &first);
+         fprintf(stderr, "', expected '%s'\n", test->expected);
+         failures++;
+      }
+
+      g_hash_table_destroy(changes);
+      if (oldConfig != NULL) {
+         g_key_file_free(oldConfig);
+      }
+      if (newConfig != NULL) {
+         g_key_file_free(newConfig);
+      }
+   }
+
+   printf("%u of %u cases failed\n", failures,
+          (unsigned int)ARRAYSIZE(testCases));
+
+   return failures == 0 ? EXIT_SUCCESS : EXIT_FAILURE;
+}
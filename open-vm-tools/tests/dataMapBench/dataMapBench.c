@@ -0,0 +1,564 @@
+/*********************************************************
+ * Copyright (C) 2016 VMware, Inc. All rights reserved.
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU Lesser General Public License as published
+ * by the Free Software Foundation version 2.1 and no later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+ * or FITNESS FOR A PARTICULAR PURPOSE.  See the Lesser GNU General Public
+ * License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin St, Fifth Floor, Boston, MA  02110-1301 USA.
+ *
+ *********************************************************/
+
+/*
+ * dataMapBench.c --
+ *
+ *      Round trip test and benchmark for DataMap serialization.
+ *
+ *      Builds maps with hundreds of fields of every type, from short strings
+ *      to multi-megabyte ones, and times:
+ *
+ *      - alloc:  DataMap_Serialize, which allocates the output;
+ *      - buffer: DataMap_SerializeToBuffer into a buffer that is reused;
+ *      - copy:   DataMap_Deserialize, which copies every string;
+ *      - view:   DataMap_DeserializeView, which points into the input.
+ *
+ *      Every decoded map is checked field by field against the original and
+ *      must serialize back to the same bytes, and the strings of the view
+ *      must lie in the input buffer.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/time.h>
+
+#include "vmware.h"
+#include "util.h"
+#include "dataMap.h"
+
+typedef enum {
+   BENCH_ALLOC,
+   BENCH_BUFFER,
+   BENCH_COPY,
+   BENCH_VIEW,
+   BENCH_NUM_MODES,
+} BenchMode;
+
+typedef struct BenchConfig {
+   int32 numFields;
+   int32 strLen;
+} BenchConfig;
+
+static const BenchConfig benchConfigs[] = {
+   { 300, 16 },
+   { 300, 1024 },
+   { 300, 65536 },
+   { 16, 4 << 20 },
+};
+
+#define BENCH_LIST_LEN  8
+
+
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * BenchNowUS --
+ *
+ *      Returns the current time in microseconds.
+ *
+ * Results:
+ *      The time.
+ *
+ * Side effects:
+ *      None.
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+static uint64
+BenchNowUS(void)
+{
+   struct timeval tv;
+
+   gettimeofday(&tv, NULL);
+   return (uint64)tv.tv_sec * 1000000 + tv.tv_usec;
+}
+
+
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * BenchString --
+ *
+ *      Allocates a string of len bytes whose content depends on the field.
+ *
+ * Results:
+ *      The string, NUL terminated.
+ *
+ * Side effects:
+ *      None.
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+static char *
+BenchString(DMKeyType fieldId,   // IN
+            int32 len)           // IN
+{
+   char *str = Util_SafeMalloc(len + 1);
+   int32 i;
+
+   for (i = 0; i < len; i++) {
+      str[i] = 'a' + (fieldId + i) % 26;
+   }
+   str[len] = '\0';
+
+   return str;
+}
+
+
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * BenchBuildMap --
+ *
+ *      Fills a map with numFields fields, cycling through the field types.
+ *      Strings and list elements are strLen bytes long.
+ *
+ * Results:
+ *      TRUE on success.
+ *
+ * Side effects:
+ *      None.
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+static Bool
+BenchBuildMap(DataMap *map,        // OUT
+              int32 numFields,     // IN
+              int32 strLen)        // IN
+{
+   DMKeyType fieldId;
+
+   if (DataMap_Create(map) != DMERR_SUCCESS) {
+      return FALSE;
+   }
+
+   for (fieldId = 0; fieldId < numFields; fieldId++) {
+      ErrorCode res;
+      int32 i;
+
+      switch (fieldId % 4) {
+      case 0:
+         res = DataMap_SetInt64(map, fieldId, -(int64)fieldId << 20, TRUE);
+         break;
+      case 1:
+         res = DataMap_SetString(map, fieldId, BenchString(fieldId, strLen),
+                                 strLen, TRUE);
+         break;
+      case 2: {
+         int64 *numList = Util_SafeMalloc(BENCH_LIST_LEN * sizeof *numList);
+
+         for (i = 0; i < BENCH_LIST_LEN; i++) {
+            numList[i] = (int64)fieldId * i;
+         }
+         res = DataMap_SetInt64List(map, fieldId, numList, BENCH_LIST_LEN,
+                                    TRUE);
+         break;
+      }
+      default: {
+         /* Short strings, the last one empty. */
+         char **strList = Util_SafeCalloc(BENCH_LIST_LEN + 1,
+                                          sizeof *strList);
+         int32 *strLens = Util_SafeMalloc(BENCH_LIST_LEN * sizeof *strLens);
+
+         for (i = 0; i < BENCH_LIST_LEN; i++) {
+            strLens[i] = i < BENCH_LIST_LEN - 1 ? MIN(strLen, 64) : 0;
+            strList[i] = BenchString(fieldId + i, strLens[i]);
+         }
+         res = DataMap_SetStringList(map, fieldId, strList, strLens, TRUE);
+         break;
+      }
+      }
+
+      if (res != DMERR_SUCCESS) {
+         DataMap_Destroy(map);
+         return FALSE;
+      }
+   }
+
+   return TRUE;
+}
+
+
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * BenchInBuffer --
+ *
+ *      Whether str lies within [buf, buf + bufLen).
+ *
+ * Results:
+ *      TRUE if it does.
+ *
+ * Side effects:
+ *      None.
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+static Bool
+BenchInBuffer(const char *str,   // IN
+              const char *buf,   // IN
+              uint32 bufLen)     // IN
+{
+   return str >= buf && str < buf + bufLen;
+}
+
+
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * BenchCheckMap --
+ *
+ *      Compares a decoded map with the original field by field.  For views,
+ *      also checks that the non-empty strings point into the input buffer.
+ *
+ * Results:
+ *      TRUE if the maps match.
+ *
+ * Side effects:
+ *      None.
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+static Bool
+BenchCheckMap(const DataMap *orig,    // IN
+              const DataMap *map,     // IN
+              int32 numFields,        // IN
+              Bool isView,            // IN
+              const char *buf,        // IN: what map was decoded from
+              uint32 bufLen)          // IN
+{
+   DMKeyType fieldId;
+
+   for (fieldId = 0; fieldId < numFields; fieldId++) {
+      DMFieldType type = DataMap_GetType(orig, fieldId);
+      int64 n1, n2;
+      int64 *l1, *l2;
+      char *s1, *s2;
+      char **sl1, **sl2;
+      int32 len1, len2;
+      int32 *lens1, *lens2;
+      int32 i;
+
+      if (DataMap_GetType(map, fieldId) != type) {
+         return FALSE;
+      }
+
+      switch (type) {
+      case DMFIELDTYPE_INT64:
+         if (DataMap_GetInt64(orig, fieldId, &n1) != DMERR_SUCCESS ||
+             DataMap_GetInt64(map, fieldId, &n2) != DMERR_SUCCESS ||
+             n1 != n2) {
+            return FALSE;
+         }
+         break;
+      case DMFIELDTYPE_STRING:
+         if (DataMap_GetString(orig, fieldId, &s1, &len1) != DMERR_SUCCESS ||
+             DataMap_GetString(map, fieldId, &s2, &len2) != DMERR_SUCCESS ||
+             len1 != len2 || memcmp(s1, s2, len1) != 0 ||
+             (len2 > 0 && isView != BenchInBuffer(s2, buf, bufLen))) {
+            return FALSE;
+         }
+         break;
+      case DMFIELDTYPE_INT64LIST:
+         if (DataMap_GetInt64List(orig, fieldId, &l1,
+                                  &len1) != DMERR_SUCCESS ||
+             DataMap_GetInt64List(map, fieldId, &l2,
+                                  &len2) != DMERR_SUCCESS ||
+             len1 != len2 || memcmp(l1, l2, len1 * sizeof *l1) != 0) {
+            return FALSE;
+         }
+         break;
+      case DMFIELDTYPE_STRINGLIST:
+         if (DataMap_GetStringList(orig, fieldId, &sl1,
+                                   &lens1) != DMERR_SUCCESS ||
+             DataMap_GetStringList(map, fieldId, &sl2,
+                                   &lens2) != DMERR_SUCCESS) {
+            return FALSE;
+         }
+         for (i = 0; sl1[i] != NULL; i++) {
+            if (sl2[i] == NULL || lens1[i] != lens2[i] ||
+                memcmp(sl1[i], sl2[i], lens1[i]) != 0 ||
+                (lens2[i] > 0 && isView != BenchInBuffer(sl2[i], buf,
+                                                         bufLen))) {
+               return FALSE;
+            }
+         }
+         if (sl2[i] != NULL) {
+            return FALSE;
+         }
+         break;
+      default:
+         return FALSE;
+      }
+   }
+
+   return TRUE;
+}
+
+
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * BenchCheckRoundTrip --
+ *
+ *      Decodes buf in both modes, checks the maps against the original and
+ *      checks that they serialize back to buf.
+ *
+ * Results:
+ *      TRUE if everything matched.
+ *
+ * Side effects:
+ *      None.
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+static Bool
+BenchCheckRoundTrip(const DataMap *orig,   // IN
+                    int32 numFields,       // IN
+                    const char *buf,       // IN
+                    uint32 bufLen)         // IN
+{
+   Bool ok = TRUE;
+   int isView;
+
+   for (isView = 0; isView < 2 && ok; isView++) {
+      DataMap map;
+      char *buf2;
+      uint32 bufLen2;
+      ErrorCode res;
+
+      res = isView ? DataMap_DeserializeView(buf, bufLen, &map)
+                   : DataMap_Deserialize(buf, bufLen, &map);
+      if (res != DMERR_SUCCESS) {
+         return FALSE;
+      }
+
+      ok = BenchCheckMap(orig, &map, numFields, isView, buf, bufLen) &&
+           DataMap_Serialize(&map, &buf2, &bufLen2) == DMERR_SUCCESS;
+      if (ok) {
+         ok = bufLen2 == bufLen && memcmp(buf, buf2, bufLen) == 0;
+         free(buf2);
+      }
+      DataMap_Destroy(&map);
+   }
+
+   /* A truncated buffer is rejected, not read past. */
+   if (ok) {
+      DataMap map;
+
+      ok = DataMap_DeserializeView(buf, bufLen - 1, &map) != DMERR_SUCCESS;
+   }
+
+   return ok;
+}
+
+
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * BenchRun --
+ *
+ *      Runs one configuration.
+ *
+ * Results:
+ *      TRUE if the round trip checks passed and no operation failed.
+ *
+ * Side effects:
+ *      None.
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+static Bool
+BenchRun(const BenchConfig *config,   // IN
+         unsigned int rounds)         // IN
+{
+   static const char *modeNames[BENCH_NUM_MODES] = {
+      "alloc", "buffer", "copy", "view",
+   };
+   uint64 best[BENCH_NUM_MODES];
+   DataMap orig;
+   char *buf;
+   char *outBuf;
+   uint32 bufLen;
+   uint32 size;
+   unsigned int errors = 0;
+   unsigned int r;
+   int mode;
+
+   if (!BenchBuildMap(&orig, config->numFields, config->strLen) ||
+       DataMap_Serialize(&orig, &buf, &bufLen) != DMERR_SUCCESS) {
+      return FALSE;
+   }
+
+   if (DataMap_GetSerializedSize(&orig, &size) != DMERR_SUCCESS ||
+       size != bufLen || !BenchCheckRoundTrip(&orig, config->numFields,
+                                              buf, bufLen)) {
+      errors++;
+   }
+
+   outBuf = Util_SafeMalloc(bufLen);
+   for (mode = 0; mode < BENCH_NUM_MODES; mode++) {
+      best[mode] = ~0ULL;
+   }
+
+   for (r = 0; r < rounds; r++) {
+      for (mode = 0; mode < BENCH_NUM_MODES; mode++) {
+         uint64 start = BenchNowUS();
+         DataMap map;
+         char *buf2;
+         uint32 bufLen2;
+         ErrorCode res;
+
+         switch (mode) {
+         case BENCH_ALLOC:
+            res = DataMap_Serialize(&orig, &buf2, &bufLen2);
+            if (res == DMERR_SUCCESS) {
+               free(buf2);
+            }
+            break;
+         case BENCH_BUFFER:
+            res = DataMap_SerializeToBuffer(&orig, outBuf, bufLen, &bufLen2);
+            break;
+         case BENCH_COPY:
+         case BENCH_VIEW:
+            res = mode == BENCH_VIEW
+                     ? DataMap_DeserializeView(buf, bufLen, &map)
+                     : DataMap_Deserialize(buf, bufLen, &map);
+            if (res == DMERR_SUCCESS) {
+               DataMap_Destroy(&map);
+            }
+            break;
+         default:
+            NOT_REACHED();
+         }
+
+         best[mode] = MIN(best[mode], BenchNowUS() - start);
+         errors += res != DMERR_SUCCESS;
+      }
+   }
+
+   if (memcmp(outBuf, buf, bufLen) != 0) {
+      errors++;
+   }
+
+   for (mode = 0; mode < BENCH_NUM_MODES; mode++) {
+      printf("%6d %8d %10u  %-7s %10"FMT64"u %9.1f %6u\n", config->numFields,
+             config->strLen, bufLen, modeNames[mode], best[mode],
+             best[mode] > 0 ? bufLen / (double)best[mode] : 0.0, errors);
+   }
+   fflush(stdout);
+
+   free(outBuf);
+   free(buf);
+   DataMap_Destroy(&orig);
+
+   return errors == 0;
+}
+
+
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * BenchUsage --
+ *
+ *      Prints the usage.
+ *
+ * Results:
+ *      None.
+ *
+ * Side effects:
+ *      None.
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+static void
+BenchUsage(const char *name)   // IN: program name
+{
+   fprintf(stderr,
+           "Usage: %s [options]\n"
+           "  -r count   rounds per mode; the best is reported (default: 20)\n",
+           name);
+}
+
+
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * main --
+ *
+ *      Main entry point.
+ *
+ * Results:
+ *      EXIT_SUCCESS if every round trip matched.
+ *
+ * Side effects:
+ *      None.
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+int
+main(int argc,          // IN
+     char *argv[])      // IN
+{
+   unsigned int rounds = 20;
+   unsigned int failures = 0;
+   unsigned int i;
+   int opt;
+
+   while ((opt = getopt(argc, argv, "r:")) != -1) {
+      switch (opt) {
+      case 'r':
+         rounds = strtoul(optarg, NULL, 10);
+         break;
+      default:
+         BenchUsage(argv[0]);
+         return EXIT_FAILURE;
+      }
+   }
+
+   if (rounds == 0) {
+      BenchUsage(argv[0]);
+      return EXIT_FAILURE;
+   }
+
+   printf("%6s %8s %10s  %-7s %10s %9s %6s\n", "fields", "strlen", "bytes",
+          "mode", "best(us)", "MB/s", "errors");
+   fflush(stdout);
+
+   for (i = 0; i < ARRAYSIZE(benchConfigs); i++) {
+      if (!BenchRun(&benchConfigs[i], rounds)) {
+         fprintf(stderr, "%d fields of %d bytes: round trip failed\n",
+                 benchConfigs[i].numFields, benchConfigs[i].strLen);
+         failures++;
+      }
+   }
+
+   return failures == 0 ? EXIT_SUCCESS : EXIT_FAILURE;
+}
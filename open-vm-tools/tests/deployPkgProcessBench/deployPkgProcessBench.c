@@ -0,0 +1,333 @@
+/*********************************************************
+ * Copyright (C) 2016 VMware, Inc. All rights reserved.
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU Lesser General Public License as published
+ * by the Free Software Foundation version 2.1 and no later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+ * or FITNESS FOR A PARTICULAR PURPOSE.  See the Lesser GNU General Public
+ * License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin St, Fifth Floor, Boston, MA  02110-1301 USA.
+ *
+ *********************************************************/
+
+/*
+ * deployPkgProcessBench.c --
+ *
+ *      End to end overhead benchmark for the libDeployPkg process runner.
+ *
+ *      Guest customization runs a long series of short commands through
+ *      Process_RunToComplete. This runs a few such commands over and over,
+ *      from no output to a MB of it, and reports the time from
+ *      Process_Create until Process_Destroy and the size of the output that
+ *      was collected.
+ */
+
+#include <stdarg.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/time.h>
+
+#include "vmware.h"
+#include "util.h"
+#include "imgcust-common/log.h"
+#include "imgcust-common/process.h"
+
+/* Same timeout linuxDeployment.c uses. */
+#define BENCH_TIMEOUT_SEC  100
+
+typedef struct BenchCommand {
+   const char *name;
+   char *argv[4];
+} BenchCommand;
+
+static BenchCommand benchCommands[] = {
+   { "true",   { "/bin/true", NULL } },
+   { "echo",   { "/bin/echo", "hello", NULL } },
+   { "stderr", { "/bin/sh", "-c", "echo hello >&2; exit 3", NULL } },
+   { "64k",    { "/bin/sh", "-c", "head -c 65536 /dev/zero | tr '\\0' x", NULL } },
+   { "1m",     { "/bin/sh", "-c", "head -c 1048576 /dev/zero | tr '\\0' x",
+                 NULL } },
+};
+
+static Bool gVerbose = FALSE;
+
+
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * BenchLog --
+ *
+ *      LogFunction for the runner; prints only with -v.
+ *
+ * Results:
+ *      None.
+ *
+ * Side effects:
+ *      None.
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+static void
+BenchLog(int level,            // IN
+         const char *fmtstr,   // IN
+         ...)                  // IN
+{
+   va_list args;
+
+   if (!gVerbose) {
+      return;
+   }
+
+   va_start(args, fmtstr);
+   fprintf(stderr, "[%d] ", level);
+   vfprintf(stderr, fmtstr, args);
+   fputc('\n', stderr);
+   va_end(args);
+}
+
+
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * BenchNowUS --
+ *
+ *      Returns the current time in microseconds.
+ *
+ * Results:
+ *      The time.
+ *
+ * Side effects:
+ *      None.
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+static uint64
+BenchNowUS(void)
+{
+   struct timeval tv;
+
+   gettimeofday(&tv, NULL);
+   return (uint64)tv.tv_sec * 1000000 + tv.tv_usec;
+}
+
+
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * BenchCompare --
+ *
+ *      qsort comparison function for latencies.
+ *
+ * Results:
+ *      <0, 0 or >0.
+ *
+ * Side effects:
+ *      None.
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+static int
+BenchCompare(const void *a,   // IN
+             const void *b)   // IN
+{
+   uint64 x = *(const uint64 *)a;
+   uint64 y = *(const uint64 *)b;
+
+   return x < y ? -1 : x > y;
+}
+
+
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * BenchRun --
+ *
+ *      Runs the command the given number of times and prints the latency
+ *      distribution.
+ *
+ * Results:
+ *      Number of runs that failed or collected a different output than the
+ *      first one.
+ *
+ * Side effects:
+ *      None.
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+static unsigned int
+BenchRun(BenchCommand *cmd,         // IN
+         unsigned int count,        // IN: runs
+         uint64 *latencies)         // IN: scratch space for count values
+{
+   unsigned int failures = 0;
+   size_t outLen = 0;
+   size_t errLen = 0;
+   int exitCode = 0;
+   uint64 total = 0;
+   unsigned int i;
+
+   for (i = 0; i < count; i++) {
+      uint64 start = BenchNowUS();
+      ProcessHandle h;
+
+      if (Process_Create(&h, cmd->argv, BenchLog) != PROCESS_SUCCESS) {
+         failures++;
+         latencies[i] = 0;
+         continue;
+      }
+
+      if (Process_RunToComplete(h, BENCH_TIMEOUT_SEC) != PROCESS_SUCCESS) {
+         failures++;
+      } else if (i == 0) {
+         outLen = strlen(Process_GetStdout(h));
+         errLen = strlen(Process_GetStderr(h));
+         exitCode = Process_GetExitCode(h);
+      } else if (strlen(Process_GetStdout(h)) != outLen ||
+                 strlen(Process_GetStderr(h)) != errLen ||
+                 Process_GetExitCode(h) != exitCode) {
+         failures++;
+      }
+      Process_Destroy(h);
+
+      latencies[i] = BenchNowUS() - start;
+      total += latencies[i];
+   }
+
+   qsort(latencies, count, sizeof *latencies, BenchCompare);
+   printf("%-7s %6u %8lu %6lu %4d %8.0f %8"FMT64"u %8"FMT64"u %8"FMT64"u "
+          "%8.1f %6u\n",
+          cmd->name, count, (unsigned long)outLen, (unsigned long)errLen,
+          exitCode, (double)total / count, latencies[count / 2],
+          latencies[(count * 99) / 100], latencies[count - 1],
+          count / (total / 1e6), failures);
+   fflush(stdout);
+
+   return failures;
+}
+
+
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * BenchUsage --
+ *
+ *      Prints the usage.
+ *
+ * Results:
+ *      None.
+ *
+ * Side effects:
+ *      None.
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+static void
+BenchUsage(const char *name)   // IN: program name
+{
+   unsigned int i;
+
+   fprintf(stderr,
+           "Usage: %s [options] [command ...]\n"
+           "  -n count   runs per command (default: 200)\n"
+           "  -v         print the runner's log to stderr\n"
+           "Commands:",
+           name);
+   for (i = 0; i < ARRAYSIZE(benchCommands); i++) {
+      fprintf(stderr, " %s", benchCommands[i].name);
+   }
+   fprintf(stderr, " (default: all)\n");
+}
+
+
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * main --
+ *
+ *      Main entry point.
+ *
+ * Results:
+ *      EXIT_SUCCESS if every run succeeded.
+ *
+ * Side effects:
+ *      None.
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+int
+main(int argc,          // IN
+     char *argv[])      // IN
+{
+   unsigned int count = 200;
+   unsigned int failures = 0;
+   uint64 *latencies;
+   unsigned int i;
+   int opt;
+
+   while ((opt = getopt(argc, argv, "n:v")) != -1) {
+      switch (opt) {
+      case 'n':
+         count = strtoul(optarg, NULL, 10);
+         break;
+      case 'v':
+         gVerbose = TRUE;
+         break;
+      default:
+         BenchUsage(argv[0]);
+         return EXIT_FAILURE;
+      }
+   }
+
+   if (count == 0) {
+      BenchUsage(argv[0]);
+      return EXIT_FAILURE;
+   }
+
+   for (opt = optind; opt < argc; opt++) {
+      for (i = 0; i < ARRAYSIZE(benchCommands); i++) {
+         if (strcmp(argv[opt], benchCommands[i].name) == 0) {
+            break;
+         }
+      }
+      if (i == ARRAYSIZE(benchCommands)) {
+         BenchUsage(argv[0]);
+         return EXIT_FAILURE;
+      }
+   }
+
+   latencies = Util_SafeCalloc(count, sizeof *latencies);
+
+   printf("%-7s %6s %8s %6s %4s %8s %8s %8s %8s %8s %6s\n", "command",
+          "count", "stdout", "stderr", "exit", "avg(us)", "p50", "p99", "max",
+          "runs/s", "failed");
+   fflush(stdout);
+
+   for (i = 0; i < ARRAYSIZE(benchCommands); i++) {
+      Bool selected = optind == argc;
+
+      for (opt = optind; opt < argc && !selected; opt++) {
+         selected = strcmp(argv[opt], benchCommands[i].name) == 0;
+      }
+      if (selected) {
+         failures += BenchRun(&benchCommands[i], count, latencies);
+      }
+   }
+
+   free(latencies);
+
+   return failures == 0 ? EXIT_SUCCESS : EXIT_FAILURE;
+}
@@ -0,0 +1,429 @@
+/*********************************************************
+ * Copyright (C) 2016 VMware, Inc. All rights reserved.
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU Lesser General Public License as published
+ * by the Free Software Foundation version 2.1 and no later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+ * or FITNESS FOR A PARTICULAR PURPOSE.  See the Lesser GNU General Public
+ * License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin St, Fifth Floor, Boston, MA  02110-1301 USA.
+ *
+ *********************************************************/
+
+/*
+ * diskInfoTest.c --
+ *
+ *      Test for the guestInfo disk info sampler (diskInfoPosix.c) with real
+ *      mounts: a tmpfs, and FUSE mounts whose statfs() hangs because nothing
+ *      ever answers on their /dev/fuse descriptor.
+ *
+ *      The hung mounts are listed first and outnumber the sampler's threads.
+ *      The tmpfs must still be sampled by the second gather, no gather may
+ *      wait much longer than the sample timeout, and free space changes must
+ *      be reported only above the threshold.  The sampler is then shut down
+ *      while the hung statfs() calls are outstanding, and the calls are
+ *      released by aborting the FUSE connections; run under valgrind or
+ *      ASan to check that the workers do not touch freed state.
+ *
+ *      The wiper only lists disk backed file systems, so this program
+ *      replaces WiperPartition_Open() and WiperPartition_Close() with
+ *      versions listing the test mounts.  statfs() goes through the real
+ *      WiperSinglePartition_GetSpace().
+ *
+ *      Needs root and /dev/fuse; exits with 77 (skipped) without them.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mount.h>
+#include <sys/stat.h>
+#include <sys/time.h>
+
+#include "vmware.h"
+#include "str.h"
+#include "util.h"
+#include "wiper.h"
+#include "guestInfoInt.h"
+
+/* More than the sampler's DISKINFO_MAX_THREADS. */
+#define TEST_NUM_HUNG      6
+
+/* The sampler's DISKINFO_SAMPLE_TIMEOUT_MS, plus slack. */
+#define TEST_MAX_GATHER_MS 3000
+
+#define TEST_TMPFS_SIZE    (64 * 1024 * 1024)
+#define TEST_EXIT_SKIP     77
+
+static char *testMounts[TEST_NUM_HUNG + 1];
+static unsigned int testNumMounts;
+static int testFuseFds[TEST_NUM_HUNG];
+
+
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * WiperPartition_Open --
+ *
+ *      Lists the test mounts as supported partitions.
+ *
+ * Results:
+ *      TRUE.
+ *
+ * Side effects:
+ *      None.
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+Bool
+WiperPartition_Open(WiperPartition_List *pl)   // OUT
+{
+   unsigned int i;
+
+   DblLnkLst_Init(&pl->link);
+
+   for (i = 0; i < testNumMounts; i++) {
+      WiperPartition *part = Util_SafeCalloc(1, sizeof *part);
+
+      Str_Strcpy((char *) part->mountPoint, testMounts[i],
+                 sizeof part->mountPoint);
+      part->type = PARTITION_EXT4;
+      DblLnkLst_Init(&part->link);
+      DblLnkLst_LinkLast(&pl->link, &part->link);
+   }
+
+   return TRUE;
+}
+
+
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * WiperPartition_Close --
+ *
+ *      Frees what WiperPartition_Open() returned.
+ *
+ * Results:
+ *      None.
+ *
+ * Side effects:
+ *      None.
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+void
+WiperPartition_Close(WiperPartition_List *pl)   // IN/OUT
+{
+   DblLnkLst_Links *curr;
+   DblLnkLst_Links *next;
+
+   DblLnkLst_ForEachSafe(curr, next, &pl->link) {
+      WiperPartition *part = DblLnkLst_Container(curr, WiperPartition, link);
+
+      DblLnkLst_Unlink1(curr);
+      free(part);
+   }
+}
+
+
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * TestNowMS --
+ *
+ *      Returns the current time in milliseconds.
+ *
+ * Results:
+ *      The time.
+ *
+ * Side effects:
+ *      None.
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+static uint64
+TestNowMS(void)
+{
+   struct timeval tv;
+
+   gettimeofday(&tv, NULL);
+   return (uint64)tv.tv_sec * 1000 + tv.tv_usec / 1000;
+}
+
+
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * TestGather --
+ *
+ *      Runs one gather and looks up a mount point in the result.
+ *
+ * Results:
+ *      TRUE if the gather was quick enough and reported no hung mount.
+ *      *found tells whether the mount point was reported, and *freeBytes
+ *      and *totalBytes what for.
+ *
+ * Side effects:
+ *      None.
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+static Bool
+TestGather(const char *mountPoint,   // IN
+           Bool *found,              // OUT
+           uint64 *freeBytes,        // OUT
+           uint64 *totalBytes)       // OUT
+{
+   uint64 start = TestNowMS();
+   GuestDiskInfo *di = GuestInfo_GetDiskInfo();
+   uint64 elapsed = TestNowMS() - start;
+   Bool ok = elapsed < TEST_MAX_GATHER_MS;
+   unsigned int i;
+
+   *found = FALSE;
+   if (di == NULL) {
+      fprintf(stderr, "GuestInfo_GetDiskInfo failed\n");
+      return FALSE;
+   }
+
+   for (i = 0; i < di->numEntries; i++) {
+      if (strcmp(di->partitionList[i].name, mountPoint) == 0) {
+         *found = TRUE;
+         *freeBytes = di->partitionList[i].freeBytes;
+         *totalBytes = di->partitionList[i].totalBytes;
+      } else {
+         fprintf(stderr, "%s reported, it never answered\n",
+                 di->partitionList[i].name);
+         ok = FALSE;
+      }
+   }
+   GuestInfo_FreeDiskInfo(di);
+
+   printf("gather: %"FMT64"u ms, %s %s\n", elapsed, mountPoint,
+          *found ? "reported" : "not reported");
+   fflush(stdout);
+
+   return ok;
+}
+
+
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * TestWriteFile --
+ *
+ *      Appends size bytes to a file.
+ *
+ * Results:
+ *      TRUE on success.
+ *
+ * Side effects:
+ *      Writes the file.
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+static Bool
+TestWriteFile(const char *path,   // IN
+              size_t size)        // IN
+{
+   static char buf[64 * 1024];
+   int fd = open(path, O_WRONLY | O_CREAT | O_APPEND, 0644);
+   Bool ok = fd >= 0;
+
+   while (ok && size > 0) {
+      size_t n = MIN(size, sizeof buf);
+
+      ok = write(fd, buf, n) == n;
+      size -= n;
+   }
+   if (fd >= 0) {
+      ok = close(fd) == 0 && ok;
+   }
+
+   return ok;
+}
+
+
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * TestMountHung --
+ *
+ *      Mounts a FUSE file system nothing serves: every request to it,
+ *      statfs() included, blocks until the descriptor is closed.
+ *
+ * Results:
+ *      The /dev/fuse descriptor, or -1.
+ *
+ * Side effects:
+ *      Mounts a file system.
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+static int
+TestMountHung(const char *dir)   // IN
+{
+   char options[128];
+   int fd = open("/dev/fuse", O_RDWR | O_CLOEXEC);
+
+   if (fd < 0) {
+      return -1;
+   }
+
+   Str_Sprintf(options, sizeof options,
+               "fd=%d,rootmode=40000,user_id=0,group_id=0", fd);
+   if (mount("diskInfoTest", dir, "fuse.diskInfoTest", MS_NOSUID | MS_NODEV,
+             options) != 0) {
+      close(fd);
+      return -1;
+   }
+
+   return fd;
+}
+
+
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * main --
+ *
+ *      Main entry point.
+ *
+ * Results:
+ *      EXIT_SUCCESS if the sampler behaved, TEST_EXIT_SKIP if the mounts
+ *      could not be set up.
+ *
+ * Side effects:
+ *      Mounts and unmounts file systems.
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+int
+main(int argc,          // IN
+     char *argv[])      // IN
+{
+   char base[] = "/tmp/diskInfoTest.XXXXXX";
+   char *tmpfsDir;
+   char *filePath;
+   char options[64];
+   uint64 freeBytes = 0;
+   uint64 totalBytes = 0;
+   uint64 lastFree;
+   unsigned int failures = 0;
+   unsigned int round;
+   unsigned int i;
+   Bool found = FALSE;
+   int result = EXIT_SUCCESS;
+
+   if (mkdtemp(base) == NULL) {
+      fprintf(stderr, "mkdtemp: %s\n", strerror(errno));
+      return EXIT_FAILURE;
+   }
+
+   for (i = 0; i < TEST_NUM_HUNG; i++) {
+      testMounts[i] = Str_SafeAsprintf(NULL, "%s/hung%u", base, i);
+      testFuseFds[i] = -1;
+      if (mkdir(testMounts[i], 0755) == 0) {
+         testFuseFds[i] = TestMountHung(testMounts[i]);
+      }
+      if (testFuseFds[i] < 0) {
+         fprintf(stderr, "Cannot mount FUSE on %s, skipping\n",
+                 testMounts[i]);
+         result = TEST_EXIT_SKIP;
+         goto cleanup;
+      }
+   }
+
+   tmpfsDir = Str_SafeAsprintf(NULL, "%s/tmpfs", base);
+   testMounts[TEST_NUM_HUNG] = tmpfsDir;
+   Str_Sprintf(options, sizeof options, "size=%u", TEST_TMPFS_SIZE);
+   if (mkdir(tmpfsDir, 0755) != 0 ||
+       mount("tmpfs", tmpfsDir, "tmpfs", 0, options) != 0) {
+      fprintf(stderr, "Cannot mount tmpfs on %s, skipping\n", tmpfsDir);
+      result = TEST_EXIT_SKIP;
+      goto cleanup;
+   }
+   testNumMounts = TEST_NUM_HUNG + 1;
+   filePath = Str_SafeAsprintf(NULL, "%s/file", tmpfsDir);
+
+   /*
+    * The hung mounts take every thread of the first gather; the tmpfs must
+    * get one by the second.
+    */
+   for (round = 0; round < 2 && !found; round++) {
+      failures += !TestGather(tmpfsDir, &found, &freeBytes, &totalBytes);
+   }
+   if (!found || totalBytes != TEST_TMPFS_SIZE) {
+      fprintf(stderr, "%s not sampled behind the hung mounts\n", tmpfsDir);
+      failures++;
+   }
+
+   /* 8 MB is above the reporting threshold, 4 KB more is not. */
+   lastFree = freeBytes;
+   if (!TestWriteFile(filePath, 8 * 1024 * 1024) ||
+       !TestGather(tmpfsDir, &found, &freeBytes, &totalBytes) ||
+       !found || lastFree - freeBytes < 8 * 1024 * 1024) {
+      fprintf(stderr, "8 MB written to %s not reported\n", tmpfsDir);
+      failures++;
+   }
+
+   lastFree = freeBytes;
+   if (!TestWriteFile(filePath, 4096) ||
+       !TestGather(tmpfsDir, &found, &freeBytes, &totalBytes) ||
+       !found || freeBytes != lastFree) {
+      fprintf(stderr, "4 KB written to %s reported\n", tmpfsDir);
+      failures++;
+   }
+   unlink(filePath);
+   free(filePath);
+
+   /* Unmounted file systems drop out. */
+   testNumMounts = TEST_NUM_HUNG;
+   if (!TestGather(tmpfsDir, &found, &freeBytes, &totalBytes) || found) {
+      fprintf(stderr, "%s still reported after it went away\n", tmpfsDir);
+      failures++;
+   }
+
+   /*
+    * Shut down with every hung statfs() outstanding, then let them fail;
+    * the workers must clean up after themselves.
+    */
+   GuestInfo_ShutdownDiskInfo();
+   for (i = 0; i < TEST_NUM_HUNG; i++) {
+      close(testFuseFds[i]);
+      testFuseFds[i] = -1;
+   }
+   usleep(500 * 1000);
+
+   result = failures == 0 ? EXIT_SUCCESS : EXIT_FAILURE;
+   printf("%s\n", failures == 0 ? "passed" : "FAILED");
+
+cleanup:
+   for (i = 0; i <= TEST_NUM_HUNG && testMounts[i] != NULL; i++) {
+      if (i < TEST_NUM_HUNG && testFuseFds[i] >= 0) {
+         close(testFuseFds[i]);
+      }
+      umount2(testMounts[i], MNT_DETACH);
+      rmdir(testMounts[i]);
+      free(testMounts[i]);
+   }
+   rmdir(base);
+
+   return result;
+}
@@ -0,0 +1,539 @@
+/*********************************************************
+ * Copyright (C) 2016 VMware, Inc. All rights reserved.
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU Lesser General Public License as published
+ * by the Free Software Foundation version 2.1 and no later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+ * or FITNESS FOR A PARTICULAR PURPOSE.  See the Lesser GNU General Public
+ * License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin St, Fifth Floor, Boston, MA  02110-1301 USA.
+ *
+ *********************************************************/
+
+/*
+ * fileMountTableBench.c --
+ *
+ *      Mount point lookup benchmark for the lib/file mount table cache.
+ *
+ *      Writes a synthetic mount table shaped like that of a Kubernetes node
+ *      (secret volumes, container root file systems, sandbox shm mounts and
+ *      a few disks) and resolves paths to the mount they live on in three
+ *      ways:
+ *
+ *      - rescan: what FilePosixLookupMountPoint() used to do, reparse the
+ *                table looking for an exact match, once per ancestor of
+ *                the path;
+ *      - scan:   the same linear search for each ancestor, over the parsed
+ *                snapshot;
+ *      - trie:   FileMountTable_Lookup().
+ *
+ *      The three must find the same entry for every path.  The time to
+ *      parse the table and that of a cached FileMountTable_Get() on the
+ *      real table are reported too.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <mntent.h>
+#include <unistd.h>
+#include <sys/time.h>
+
+#include "vmware.h"
+#include "str.h"
+#include "util.h"
+#include "fileMountTable.h"
+
+typedef enum {
+   BENCH_RESCAN,
+   BENCH_SCAN,
+   BENCH_TRIE,
+   BENCH_NUM_MODES,
+} BenchMode;
+
+static const char *benchModeNames[BENCH_NUM_MODES] = {
+   "rescan", "scan", "trie",
+};
+
+
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * BenchNowUS --
+ *
+ *      Returns the current time in microseconds.
+ *
+ * Results:
+ *      The time.
+ *
+ * Side effects:
+ *      None.
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+static uint64
+BenchNowUS(void)
+{
+   struct timeval tv;
+
+   gettimeofday(&tv, NULL);
+   return (uint64)tv.tv_sec * 1000000 + tv.tv_usec;
+}
+
+
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * BenchMountPoint --
+ *
+ *      Returns the mount point of the i-th synthetic entry.  Entry 0 is the
+ *      root; the /mnt disks share 25 mount points, so these are mounted over
+ *      many times.
+ *
+ * Results:
+ *      The mount point, to be freed by the caller.  The device is returned
+ *      in *fsName and the type in *fsType.
+ *
+ * Side effects:
+ *      None.
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+static char *
+BenchMountPoint(unsigned int i,          // IN
+                char **fsName,           // OUT
+                const char **fsType)     // OUT
+{
+   if (i == 0) {
+      *fsName = Util_SafeStrdup("/dev/sda1");
+      *fsType = "ext4";
+      return Util_SafeStrdup("/");
+   }
+
+   switch (i % 4) {
+   case 0:
+      *fsName = Str_SafeAsprintf(NULL, "tmpfs%u", i);
+      *fsType = "tmpfs";
+      return Str_SafeAsprintf(NULL, "/var/lib/kubelet/pods/%08x-aaaa/volumes/"
+                              "kubernetes.io~secret/token", i);
+   case 1:
+      *fsName = Str_SafeAsprintf(NULL, "overlay%u", i);
+      *fsType = "overlay";
+      return Str_SafeAsprintf(NULL, "/run/containerd/io.containerd.runtime."
+                              "v2.task/k8s.io/%u/rootfs", i);
+   case 2:
+      *fsName = Str_SafeAsprintf(NULL, "shm%u", i);
+      *fsType = "tmpfs";
+      return Str_SafeAsprintf(NULL, "/run/containerd/io.containerd.grpc.v1."
+                              "cri/sandboxes/%u/shm", i);
+   default:
+      *fsName = Str_SafeAsprintf(NULL, "/dev/sdb%u", i);
+      *fsType = "ext4";
+      return Str_SafeAsprintf(NULL, "/mnt/d%u", i % 50);
+   }
+}
+
+
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * BenchWriteTable --
+ *
+ *      Writes count synthetic entries in the getmntent(3) format.
+ *
+ * Results:
+ *      TRUE on success.
+ *
+ * Side effects:
+ *      Writes the file.
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+static Bool
+BenchWriteTable(const char *pathName,   // IN
+                unsigned int count)     // IN
+{
+   FILE *f = setmntent(pathName, "w");
+   unsigned int i;
+   Bool ok = f != NULL;
+
+   for (i = 0; ok && i < count; i++) {
+      struct mntent mnt;
+      char *fsName;
+      const char *fsType;
+      char *mountPoint = BenchMountPoint(i, &fsName, &fsType);
+
+      mnt.mnt_fsname = fsName;
+      mnt.mnt_dir = mountPoint;
+      mnt.mnt_type = (char *)fsType;
+      mnt.mnt_opts = "rw,relatime";
+      mnt.mnt_freq = 0;
+      mnt.mnt_passno = 0;
+      ok = addmntent(f, &mnt) == 0;
+
+      free(mountPoint);
+      free(fsName);
+   }
+
+   if (f != NULL) {
+      endmntent(f);
+   }
+
+   return ok;
+}
+
+
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * BenchParentPath --
+ *
+ *      Strips the last component of a canonical path, in place.
+ *
+ * Results:
+ *      FALSE if the path was "/" already.
+ *
+ * Side effects:
+ *      None.
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+static Bool
+BenchParentPath(char *path)   // IN/OUT
+{
+   char *slash = strrchr(path, '/');
+
+   if (slash == NULL || strcmp(path, "/") == 0) {
+      return FALSE;
+   }
+
+   if (slash == path) {
+      slash++;
+   }
+   *slash = '\0';
+
+   return TRUE;
+}
+
+
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * BenchRescan --
+ *
+ *      Resolves a path the way FilePosixLookupMountPoint() and
+ *      FilePosixGetBlockDevice() used to: parse the table looking for an
+ *      exact match, once per ancestor, starting from the path itself.
+ *
+ * Results:
+ *      The device of the mount, to be freed by the caller, or NULL.
+ *
+ * Side effects:
+ *      None.
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+static char *
+BenchRescan(const char *tablePath,   // IN
+            const char *canPath)     // IN
+{
+   char *path = Util_SafeStrdup(canPath);
+   char *ret = NULL;
+
+   do {
+      FILE *f = setmntent(tablePath, "r");
+      struct mntent *mnt;
+
+      if (f == NULL) {
+         break;
+      }
+      while ((mnt = getmntent(f)) != NULL) {
+         if (strcmp(mnt->mnt_dir, path) == 0) {
+            ret = Util_SafeStrdup(mnt->mnt_fsname);
+            break;
+         }
+      }
+      endmntent(f);
+   } while (ret == NULL && BenchParentPath(path));
+
+   free(path);
+
+   return ret;
+}
+
+
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * BenchScan --
+ *
+ *      The same search as BenchRescan() over a parsed snapshot.
+ *
+ * Results:
+ *      The entry of the mount, or NULL.
+ *
+ * Side effects:
+ *      None.
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+static const FileMountEntry *
+BenchScan(const FileMountTable *table,   // IN
+          const char *canPath)           // IN
+{
+   uint32 count = FileMountTable_GetCount(table);
+   char *path = Util_SafeStrdup(canPath);
+   const FileMountEntry *ret = NULL;
+
+   do {
+      uint32 i;
+
+      for (i = 0; i < count; i++) {
+         const FileMountEntry *entry = FileMountTable_GetEntry(table, i);
+
+         if (strcmp(entry->mountPoint, path) == 0) {
+            ret = entry;
+            break;
+         }
+      }
+   } while (ret == NULL && BenchParentPath(path));
+
+   free(path);
+
+   return ret;
+}
+
+
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * BenchQueries --
+ *
+ *      Builds the paths to resolve: in and on mount points spread over the
+ *      table, the root, and a few paths that only the root covers.
+ *
+ * Results:
+ *      The number of paths stored in queries.
+ *
+ * Side effects:
+ *      None.
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+static unsigned int
+BenchQueries(unsigned int count,     // IN: entries in the table
+             char **queries,         // OUT
+             unsigned int maxQueries) // IN
+{
+   static const char *extra[] = {
+      "/", "/etc/passwd", "/mnt/d70/data", "/run/containerd",
+      "/var/lib/kubelet/pods/ffffffff-aaaa/volumes",
+   };
+   unsigned int n = 0;
+   unsigned int i;
+
+   for (i = 0; i < ARRAYSIZE(extra) && n < maxQueries; i++) {
+      queries[n++] = Util_SafeStrdup(extra[i]);
+   }
+
+   for (i = 1; n < maxQueries && i < count; i += 1 + count / maxQueries) {
+      char *fsName;
+      const char *fsType;
+      char *mountPoint = BenchMountPoint(i, &fsName, &fsType);
+
+      queries[n++] = i % 3 == 0
+                        ? Util_SafeStrdup(mountPoint)
+                        : Str_SafeAsprintf(NULL, "%s/usr/lib/file%u",
+                                           mountPoint, i);
+      free(mountPoint);
+      free(fsName);
+   }
+
+   return n;
+}
+
+
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * BenchUsage --
+ *
+ *      Prints the usage.
+ *
+ * Results:
+ *      None.
+ *
+ * Side effects:
+ *      None.
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+static void
+BenchUsage(const char *name)   // IN: program name
+{
+   fprintf(stderr,
+           "Usage: %s [options]\n"
+           "  -n count   entries in the synthetic table (default: 10000)\n"
+           "  -q count   paths to resolve (default: 50)\n"
+           "  -d dir     where to write the table (default: /tmp)\n",
+           name);
+}
+
+
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * main --
+ *
+ *      Main entry point.
+ *
+ * Results:
+ *      EXIT_SUCCESS if all three ways found the same mounts.
+ *
+ * Side effects:
+ *      Creates and removes a file.
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+int
+main(int argc,          // IN
+     char *argv[])      // IN
+{
+   unsigned int count = 10000;
+   unsigned int numQueries = 50;
+   const char *dir = "/tmp";
+   uint64 times[BENCH_NUM_MODES] = { 0 };
+   unsigned int repeats[BENCH_NUM_MODES] = { 1, 100, 10000 };
+   FileMountTable *table;
+   char **queries;
+   char *tablePath;
+   unsigned int mismatches = 0;
+   unsigned int n;
+   unsigned int i;
+   uint64 start;
+   BenchMode mode;
+   int opt;
+
+   while ((opt = getopt(argc, argv, "n:q:d:")) != -1) {
+      switch (opt) {
+      case 'n':
+         count = strtoul(optarg, NULL, 10);
+         break;
+      case 'q':
+         numQueries = strtoul(optarg, NULL, 10);
+         break;
+      case 'd':
+         dir = optarg;
+         break;
+      default:
+         BenchUsage(argv[0]);
+         return EXIT_FAILURE;
+      }
+   }
+
+   if (count == 0 || numQueries == 0) {
+      BenchUsage(argv[0]);
+      return EXIT_FAILURE;
+   }
+
+   tablePath = Str_SafeAsprintf(NULL, "%s/fileMountTableBench.%d", dir,
+                                (int)getpid());
+   if (!BenchWriteTable(tablePath, count)) {
+      fprintf(stderr, "Cannot write %s: %s\n", tablePath, strerror(errno));
+      unlink(tablePath);
+      free(tablePath);
+      return EXIT_FAILURE;
+   }
+
+   start = BenchNowUS();
+   table = FileMountTable_Load(tablePath);
+   printf("parse %u entries: %.2f ms\n", count,
+          (BenchNowUS() - start) / 1e3);
+   if (table == NULL || FileMountTable_GetCount(table) != count) {
+      fprintf(stderr, "Cannot parse %s\n", tablePath);
+      unlink(tablePath);
+      free(tablePath);
+      FileMountTable_Release(table);
+      return EXIT_FAILURE;
+   }
+
+   queries = Util_SafeCalloc(numQueries, sizeof *queries);
+   n = BenchQueries(count, queries, numQueries);
+
+   for (i = 0; i < n; i++) {
+      const FileMountEntry *scan = BenchScan(table, queries[i]);
+      const FileMountEntry *trie = FileMountTable_Lookup(table, queries[i],
+                                                         NULL);
+      char *rescan = BenchRescan(tablePath, queries[i]);
+
+      if (scan != trie || scan == NULL || rescan == NULL ||
+          strcmp(rescan, scan->fsName) != 0) {
+         fprintf(stderr, "%s: rescan %s, scan %s, trie %s\n", queries[i],
+                 rescan != NULL ? rescan : "-",
+                 scan != NULL ? scan->fsName : "-",
+                 trie != NULL ? trie->fsName : "-");
+         mismatches++;
+      }
+      free(rescan);
+   }
+
+   for (mode = 0; mode < BENCH_NUM_MODES; mode++) {
+      unsigned int r;
+
+      start = BenchNowUS();
+      for (r = 0; r < repeats[mode]; r++) {
+         for (i = 0; i < n; i++) {
+            switch (mode) {
+            case BENCH_RESCAN:
+               free(BenchRescan(tablePath, queries[i]));
+               break;
+            case BENCH_SCAN:
+               BenchScan(table, queries[i]);
+               break;
+            case BENCH_TRIE:
+               FileMountTable_Lookup(table, queries[i], NULL);
+               break;
+            default:
+               NOT_REACHED();
+            }
+         }
+      }
+      times[mode] = BenchNowUS() - start;
+
+      printf("%-7s lookup: %12.1f ns\n", benchModeNames[mode],
+             times[mode] * 1e3 / ((uint64)repeats[mode] * n));
+   }
+
+   start = BenchNowUS();
+   for (i = 0; i < 10000; i++) {
+      FileMountTable_Release(FileMountTable_Get());
+   }
+   printf("cached get:     %12.1f ns\n", (BenchNowUS() - start) / 10.0);
+   printf("mismatches: %u\n", mismatches);
+
+   for (i = 0; i < n; i++) {
+      free(queries[i]);
+   }
+   free(queries);
+   FileMountTable_Release(table);
+   unlink(tablePath);
+   free(tablePath);
+
+   return mismatches == 0 ? EXIT_SUCCESS : EXIT_FAILURE;
+}
@@ -0,0 +1,731 @@
+/*********************************************************
+ * Copyright (C) 2016 VMware, Inc. All rights reserved.
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU Lesser General Public License as published
+ * by the Free Software Foundation version 2.1 and no later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+ * or FITNESS FOR A PARTICULAR PURPOSE.  See the Lesser GNU General Public
+ * License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin St, Fifth Floor, Boston, MA  02110-1301 USA.
+ *
+ *********************************************************/
+
+/*
+ * hashMapBench.c --
+ *
+ *    Self test and benchmark for the lib/hashMap HashMap.
+ *
+ *    The test applies a long sequence of random puts, gets and removes both
+ *    to a HashMap and to a trivial directly indexed reference map, and
+ *    compares the two after every step.  Small initial sizes and both low
+ *    and high alpha values are used so that resizes, compaction of removed
+ *    entries and wrap around of the probe groups are all exercised.  It
+ *    then checks that put/remove churn on a small set of keys does not
+ *    grow the map.
+ *
+ *    The benchmark times puts, hit and miss gets, removes and put/remove
+ *    churn on maps of several sizes, for HashMap and for the linear
+ *    probing map it replaced, which is reproduced below.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/time.h>
+#include <sys/resource.h>
+
+#include "vmware.h"
+#include "hashMap.h"
+
+#define BENCH_TEST_KEYS   4096
+#define BENCH_TEST_STEPS  200000
+
+/* put/remove cycles of the churn check, and the growth it tolerates. */
+#define BENCH_CHURN_CYCLES     4000000
+#define BENCH_CHURN_MAX_KB     8192
+
+typedef struct BenchTestRef {
+   Bool present[BENCH_TEST_KEYS];
+   uint64 value[BENCH_TEST_KEYS];
+   uint32 order[BENCH_TEST_KEYS];   // insertion sequence number
+   uint32 count;
+} BenchTestRef;
+
+typedef struct BenchTestIter {
+   const BenchTestRef *ref;
+   uint32 seen;
+   uint32 lastOrder;
+   Bool ok;
+} BenchTestIter;
+
+/*
+ * The map before the separate index: linear probing over the entries
+ * array itself, with a state in each entry header and the plain djb2 hash.
+ */
+
+typedef enum {
+   OLD_EMPTY = 0,
+   OLD_FILLED,
+   OLD_DELETED,
+} OldState;
+
+typedef struct OldHeader {
+   uint32 state;
+   uint32 hash;
+} OldHeader;
+
+typedef struct OldMap {
+   uint8 *entries;
+   uint32 numEntries;
+   uint32 count;
+   uint32 alpha;
+   size_t keySize;
+   size_t dataSize;
+   size_t entrySize;
+} OldMap;
+
+
+/*
+ * ----------------------------------------------------------------------------
+ *
+ * BenchNowUS --
+ *
+ *    Returns the current time in microseconds.
+ *
+ * Results:
+ *    The time.
+ *
+ * Side Effects:
+ *    None.
+ *
+ * ----------------------------------------------------------------------------
+ */
+
+static uint64
+BenchNowUS(void)
+{
+   struct timeval tv;
+
+   gettimeofday(&tv, NULL);
+   return (uint64)tv.tv_sec * 1000000 + tv.tv_usec;
+}
+
+
+/*
+ * ----------------------------------------------------------------------------
+ *
+ * BenchRandom --
+ *
+ *    Small deterministic generator (xorshift32), so that failures are
+ *    reproducible.
+ *
+ * Results:
+ *    The next pseudo random number.
+ *
+ * Side Effects:
+ *    Advances the state.
+ *
+ * ----------------------------------------------------------------------------
+ */
+
+static uint32
+BenchRandom(uint32 *state)  // IN/OUT
+{
+   uint32 x = *state;
+
+   x ^= x << 13;
+   x ^= x >> 17;
+   x ^= x << 5;
+   *state = x;
+
+   return x;
+}
+
+
+/*
+ * ----------------------------------------------------------------------------
+ *
+ * BenchTestIterCb --
+ *
+ *    HashMap_Iterate callback: checks each visited entry against the
+ *    reference map, and that entries come in insertion order.
+ *
+ * Results:
+ *    None.
+ *
+ * Side Effects:
+ *    Updates the iteration state.
+ *
+ * ----------------------------------------------------------------------------
+ */
+
+static void
+BenchTestIterCb(void *key,       // IN
+                void *data,      // IN
+                void *userData)  // IN/OUT
+{
+   BenchTestIter *iter = userData;
+   uint32 k;
+   uint64 value;
+
+   /* Entries are only 4-byte aligned. */
+   memcpy(&k, key, sizeof k);
+   memcpy(&value, data, sizeof value);
+
+   if (k >= BENCH_TEST_KEYS || !iter->ref->present[k] ||
+       iter->ref->value[k] != value ||
+       (iter->seen > 0 && iter->ref->order[k] <= iter->lastOrder)) {
+      iter->ok = FALSE;
+      return;
+   }
+   iter->lastOrder = iter->ref->order[k];
+   iter->seen++;
+}
+
+
+/*
+ * ----------------------------------------------------------------------------
+ *
+ * BenchTestRun --
+ *
+ *    Run one randomized comparison with the given map parameters.
+ *
+ * Results:
+ *    TRUE if the HashMap always agreed with the reference map.
+ *
+ * Side Effects:
+ *    None.
+ *
+ * ----------------------------------------------------------------------------
+ */
+
+static Bool
+BenchTestRun(uint32 numEntries,  // IN
+             uint32 alpha,       // IN
+             uint32 keyRange,    // IN
+             uint32 seed)        // IN
+{
+   BenchTestRef *ref = calloc(1, sizeof *ref);
+   HashMap *map = HashMap_AllocMapAlpha(numEntries, alpha, sizeof (uint32),
+                                        sizeof (uint64));
+   uint32 sequence = 0;
+   uint32 step;
+   Bool ok = ref != NULL && map != NULL;
+
+   ASSERT(keyRange <= BENCH_TEST_KEYS);
+
+   for (step = 0; ok && step < BENCH_TEST_STEPS; step++) {
+      uint32 op = BenchRandom(&seed) % 8;
+      uint32 key = BenchRandom(&seed) % keyRange;
+      uint64 value;
+      void *data;
+
+      if (op < 4) {
+         value = ((uint64) BenchRandom(&seed) << 32) | step;
+         ok = HashMap_Put(map, &key, &value);
+         if (!ref->present[key]) {
+            ref->present[key] = TRUE;
+            ref->order[key] = sequence++;
+            ref->count++;
+         }
+         ref->value[key] = value;
+      } else if (op < 7) {
+         ok = HashMap_Remove(map, &key) == ref->present[key];
+         if (ref->present[key]) {
+            ref->present[key] = FALSE;
+            ref->count--;
+         }
+      } else if (step % 1024 == 0) {
+         HashMap_Clear(map);
+         memset(ref->present, 0, sizeof ref->present);
+         ref->count = 0;
+      }
+
+      data = HashMap_Get(map, &key);
+      if (data != NULL) {
+         memcpy(&value, data, sizeof value);
+      }
+      ok = ok && (data != NULL) == ref->present[key] &&
+           (data == NULL || value == ref->value[key]) &&
+           HashMap_Count(map) == ref->count;
+
+      if (ok && step % 4096 == 0) {
+         BenchTestIter iter = { ref, 0, 0, TRUE };
+
+         HashMap_Iterate(map, BenchTestIterCb, FALSE, &iter);
+         ok = iter.ok && iter.seen == ref->count;
+      }
+   }
+
+   if (ok) {
+      uint32 key;
+
+      for (key = 0; ok && key < keyRange; key++) {
+         ok = (HashMap_Get(map, &key) != NULL) == ref->present[key];
+      }
+   }
+
+   HashMap_DestroyMap(map);
+   free(ref);
+
+   return ok;
+}
+
+
+/*
+ * ----------------------------------------------------------------------------
+ *
+ * BenchMaxRSS --
+ *
+ *    Returns the peak resident set size of the process.
+ *
+ * Results:
+ *    The size in KB.
+ *
+ * Side Effects:
+ *    None.
+ *
+ * ----------------------------------------------------------------------------
+ */
+
+static long
+BenchMaxRSS(void)
+{
+   struct rusage usage;
+
+   getrusage(RUSAGE_SELF, &usage);
+   return usage.ru_maxrss;
+}
+
+
+/*
+ * ----------------------------------------------------------------------------
+ *
+ * BenchTestChurn --
+ *
+ *    Puts and removes the same few keys over and over.  The map never
+ *    holds more than a handful of entries, so its memory use must not grow.
+ *
+ * Results:
+ *    TRUE if the peak RSS grew by less than BENCH_CHURN_MAX_KB.
+ *
+ * Side Effects:
+ *    None.
+ *
+ * ----------------------------------------------------------------------------
+ */
+
+static Bool
+BenchTestChurn(void)
+{
+   HashMap *map = HashMap_AllocMap(16, sizeof (uint32), sizeof (uint64));
+   long before = BenchMaxRSS();
+   uint64 value = 0;
+   uint32 i;
+   Bool ok = map != NULL;
+
+   for (i = 0; ok && i < BENCH_CHURN_CYCLES; i++) {
+      uint32 key = i % 4;
+
+      ok = HashMap_Put(map, &key, &value) && HashMap_Remove(map, &key);
+   }
+   ok = ok && HashMap_Count(map) == 0 &&
+        BenchMaxRSS() - before < BENCH_CHURN_MAX_KB;
+
+   HashMap_DestroyMap(map);
+
+   return ok;
+}
+
+
+/*
+ * ----------------------------------------------------------------------------
+ *
+ * OldGetEntry --
+ * OldLookup --
+ *
+ *    Entry access and lookup of the old map.
+ *
+ * Results:
+ *    OldLookup returns TRUE if the key was found, the entry of the key or
+ *    the first free entry of its probe sequence in *header.
+ *
+ * Side Effects:
+ *    None.
+ *
+ * ----------------------------------------------------------------------------
+ */
+
+static OldHeader *
+OldGetEntry(const OldMap *map,  // IN
+            uint32 i)           // IN
+{
+   return (OldHeader *) (map->entries + map->entrySize * i);
+}
+
+static uint32
+OldHash(const OldMap *map,  // IN
+        const void *key)    // IN
+{
+   const uint8 *keyByte = key;
+   uint32 h = 5381;
+   size_t i;
+
+   for (i = 0; i < map->keySize; i++) {
+      h = h * 33 + keyByte[i];
+   }
+   return h;
+}
+
+static Bool
+OldLookup(const OldMap *map,    // IN
+          const void *key,      // IN
+          uint32 hash,          // IN
+          OldHeader **header)   // OUT
+{
+   OldHeader *free = NULL;
+   uint32 probe;
+
+   for (probe = 0; probe < map->numEntries; probe++) {
+      OldHeader *h = OldGetEntry(map, (hash + probe) % map->numEntries);
+
+      if (h->state == OLD_EMPTY) {
+         *header = free != NULL ? free : h;
+         return FALSE;
+      }
+      if (h->state == OLD_DELETED) {
+         if (free == NULL) {
+            free = h;
+         }
+      } else if (h->hash == hash &&
+                 memcmp(h + 1, key, map->keySize) == 0) {
+         *header = h;
+         return TRUE;
+      }
+   }
+
+   *header = free;
+   return FALSE;
+}
+
+
+/*
+ * ----------------------------------------------------------------------------
+ *
+ * OldInit --
+ * OldPut --
+ * OldGet --
+ * OldRemove --
+ *
+ *    The operations of the old map.
+ *
+ * Results:
+ *    As for the HashMap_* equivalents.
+ *
+ * Side Effects:
+ *    OldPut doubles the entries array and reinserts every entry when the
+ *    load factor would exceed 1 / alpha.
+ *
+ * ----------------------------------------------------------------------------
+ */
+
+static void
+OldInit(OldMap *map,         // OUT
+        uint32 numEntries,   // IN
+        uint32 alpha,        // IN
+        size_t keySize,      // IN
+        size_t dataSize)     // IN
+{
+   map->numEntries = numEntries;
+   map->count = 0;
+   map->alpha = alpha;
+   map->keySize = keySize;
+   map->dataSize = dataSize;
+   map->entrySize = sizeof (OldHeader) + ROUNDUP(keySize, 4) +
+                    ROUNDUP(dataSize, 4);
+   map->entries = calloc(numEntries, map->entrySize);
+}
+
+static void
+OldPut(OldMap *map,        // IN/OUT
+       const void *key,    // IN
+       const void *data)   // IN
+{
+   uint32 hash = OldHash(map, key);
+   OldHeader *header;
+
+   if (!OldLookup(map, key, hash, &header)) {
+      if ((uint64) (map->count + 1) * map->alpha >= map->numEntries) {
+         OldMap old = *map;
+         uint32 i;
+
+         map->numEntries *= 2;
+         map->count = 0;
+         map->entries = calloc(map->numEntries, map->entrySize);
+         for (i = 0; i < old.numEntries; i++) {
+            OldHeader *h = OldGetEntry(&old, i);
+
+            if (h->state == OLD_FILLED) {
+               OldLookup(map, h + 1, h->hash, &header);
+               memcpy(header, h, map->entrySize);
+               map->count++;
+            }
+         }
+         free(old.entries);
+         OldLookup(map, key, hash, &header);
+      }
+      header->state = OLD_FILLED;
+      header->hash = hash;
+      memcpy(header + 1, key, map->keySize);
+      map->count++;
+   }
+   memcpy((uint8 *) (header + 1) + ROUNDUP(map->keySize, 4), data,
+          map->dataSize);
+}
+
+static void *
+OldGet(const OldMap *map,   // IN
+       const void *key)     // IN
+{
+   OldHeader *header;
+
+   if (!OldLookup(map, key, OldHash(map, key), &header)) {
+      return NULL;
+   }
+   return (uint8 *) (header + 1) + ROUNDUP(map->keySize, 4);
+}
+
+static Bool
+OldRemove(OldMap *map,       // IN/OUT
+          const void *key)   // IN
+{
+   OldHeader *header;
+
+   if (!OldLookup(map, key, OldHash(map, key), &header)) {
+      return FALSE;
+   }
+   header->state = OLD_DELETED;
+   map->count--;
+   return TRUE;
+}
+
+
+/*
+ * ----------------------------------------------------------------------------
+ *
+ * BenchRun --
+ *
+ *    Times each operation on one map of numKeys keys, the way DataMap uses
+ *    it: 4-byte keys and pointer sized data.  The keys are sparse, as
+ *    field IDs are.
+ *
+ * Results:
+ *    TRUE if the map returned the right data throughout.
+ *
+ * Side Effects:
+ *    None.
+ *
+ * ----------------------------------------------------------------------------
+ */
+
+static Bool
+BenchRun(Bool useOld,        // IN
+         uint32 numKeys)     // IN
+{
+   HashMap *map = NULL;
+   OldMap old;
+   uint64 times[5];
+   uint64 start;
+   uint32 errors = 0;
+   uint32 i;
+
+   if (useOld) {
+      OldInit(&old, 16, 2, sizeof (uint32), sizeof (uint64));
+   } else {
+      map = HashMap_AllocMap(16, sizeof (uint32), sizeof (uint64));
+   }
+
+#define BENCH_KEY(i)  ((uint32) (i) * 2654435761U)
+#define BENCH_PUT(k, v)                                               \
+   (useOld ? (OldPut(&old, (k), (v)), TRUE) : HashMap_Put(map, (k), (v)))
+#define BENCH_GET(k)                                                  \
+   (useOld ? OldGet(&old, (k)) : HashMap_Get(map, (k)))
+#define BENCH_REMOVE(k)                                               \
+   (useOld ? OldRemove(&old, (k)) : HashMap_Remove(map, (k)))
+
+   start = BenchNowUS();
+   for (i = 0; i < numKeys; i++) {
+      uint32 key = BENCH_KEY(i);
+      uint64 value = i;
+
+      errors += !BENCH_PUT(&key, &value);
+   }
+   times[0] = BenchNowUS() - start;
+
+   start = BenchNowUS();
+   for (i = 0; i < numKeys; i++) {
+      uint32 key = BENCH_KEY(i);
+      void *data = BENCH_GET(&key);
+      uint64 value;
+
+      if (data == NULL) {
+         errors++;
+      } else {
+         memcpy(&value, data, sizeof value);
+         errors += value != i;
+      }
+   }
+   times[1] = BenchNowUS() - start;
+
+   start = BenchNowUS();
+   for (i = numKeys; i < 2 * numKeys; i++) {
+      uint32 key = BENCH_KEY(i);
+
+      errors += BENCH_GET(&key) != NULL;
+   }
+   times[2] = BenchNowUS() - start;
+
+   start = BenchNowUS();
+   for (i = 0; i < numKeys; i += 2) {
+      uint32 key = BENCH_KEY(i);
+
+      errors += !BENCH_REMOVE(&key);
+   }
+   times[3] = BenchNowUS() - start;
+
+   /* Replace the removed keys by new ones, one at a time. */
+   start = BenchNowUS();
+   for (i = 0; i < numKeys; i++) {
+      uint32 key = BENCH_KEY(2 * numKeys + i);
+      uint64 value = i;
+
+      errors += !BENCH_PUT(&key, &value) || !BENCH_REMOVE(&key);
+   }
+   times[4] = BenchNowUS() - start;
+
+#undef BENCH_KEY
+#undef BENCH_PUT
+#undef BENCH_GET
+#undef BENCH_REMOVE
+
+   if (useOld) {
+      free(old.entries);
+   } else {
+      HashMap_DestroyMap(map);
+   }
+
+   printf("%8u  %-4s %9.1f %9.1f %9.1f %9.1f %9.1f %6u\n", numKeys,
+          useOld ? "old" : "new", times[0] * 1e3 / numKeys,
+          times[1] * 1e3 / numKeys, times[2] * 1e3 / numKeys,
+          times[3] * 2e3 / numKeys, times[4] * 1e3 / numKeys, errors);
+   fflush(stdout);
+
+   return errors == 0;
+}
+
+
+/*
+ * ----------------------------------------------------------------------------
+ *
+ * BenchUsage --
+ *
+ *    Prints the usage.
+ *
+ * Results:
+ *    None.
+ *
+ * Side Effects:
+ *    None.
+ *
+ * ----------------------------------------------------------------------------
+ */
+
+static void
+BenchUsage(const char *name)   // IN: program name
+{
+   fprintf(stderr,
+           "Usage: %s [options]\n"
+           "  -b         run the benchmark only\n"
+           "  -t         run the tests only\n",
+           name);
+}
+
+
+/*
+ * ----------------------------------------------------------------------------
+ *
+ * main --
+ *
+ *    Main entry point.
+ *
+ * Results:
+ *    EXIT_SUCCESS if all tests passed and every map returned the right data.
+ *
+ * Side Effects:
+ *    None.
+ *
+ * ----------------------------------------------------------------------------
+ */
+
+int
+main(int argc,          // IN
+     char *argv[])      // IN
+{
+   static const uint32 sizes[] = { 64, 4096, 262144, 1048576 };
+   Bool runTests = TRUE;
+   Bool runBench = TRUE;
+   Bool ok = TRUE;
+   int opt;
+
+   while ((opt = getopt(argc, argv, "bt")) != -1) {
+      switch (opt) {
+      case 'b':
+         runTests = FALSE;
+         break;
+      case 't':
+         runBench = FALSE;
+         break;
+      default:
+         BenchUsage(argv[0]);
+         return EXIT_FAILURE;
+      }
+   }
+
+   if (runTests) {
+      ok = BenchTestRun(1, 1, 16, 0x12345678) &&
+           BenchTestRun(4, 2, 64, 0x9e3779b9) &&
+           BenchTestRun(16, 2, 4096, 0xdeadbeef) &&
+           BenchTestRun(7, 3, 1000, 0x2545f491) &&
+           BenchTestRun(1024, 1, 4096, 0x7f4a7c15);
+      printf("randomized test: %s\n", ok ? "passed" : "FAILED");
+
+      if (!BenchTestChurn()) {
+         ok = FALSE;
+         printf("put/remove churn: FAILED, the map grew\n");
+      } else {
+         printf("put/remove churn: passed\n");
+      }
+      fflush(stdout);
+   }
+
+   if (runBench) {
+      unsigned int i;
+
+      printf("%8s  %-4s %9s %9s %9s %9s %9s %6s\n", "keys", "impl",
+             "put/ns", "hit/ns", "miss/ns", "remove/ns", "churn/ns",
+             "errors");
+      for (i = 0; i < ARRAYSIZE(sizes); i++) {
+         ok = BenchRun(TRUE, sizes[i]) && ok;
+         ok = BenchRun(FALSE, sizes[i]) && ok;
+      }
+   }
+
+   return ok ? EXIT_SUCCESS : EXIT_FAILURE;
+}
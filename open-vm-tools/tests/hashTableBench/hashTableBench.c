@@ -0,0 +1,599 @@
+/*********************************************************
+ * Copyright (C) 2016 VMware, Inc. All rights reserved.
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU Lesser General Public License as published
+ * by the Free Software Foundation version 2.1 and no later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+ * or FITNESS FOR A PARTICULAR PURPOSE.  See the Lesser GNU General Public
+ * License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin St, Fifth Floor, Boston, MA  02110-1301 USA.
+ *
+ *********************************************************/
+
+/*
+ * hashTableBench.c --
+ *
+ *      Insert and lookup benchmark for the lib/misc HashTable.
+ *
+ *      Tables are created with a fixed initial bucket count, the way the
+ *      callers size them for their typical case, and then filled to
+ *      several times that. Three implementations are compared:
+ *
+ *      - old:    the fixed-size table with the rotate-xor hash that
+ *                HashTable used to be, reproduced below;
+ *      - new:    HashTable;
+ *      - atomic: HashTable with HASH_FLAG_ATOMIC, filled by -t threads
+ *                concurrently.
+ *
+ *      String keys look like lock names, integer keys like thread IDs.
+ *      Every run also checks that all keys are found with their data and
+ *      no others are, so it doubles as a test of concurrent atomic inserts.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <sys/time.h>
+
+#include "vmware.h"
+#include "vm_basic_asm.h"
+#include "hashTable.h"
+#include "str.h"
+#include "util.h"
+
+typedef enum {
+   BENCH_OLD,
+   BENCH_NEW,
+   BENCH_ATOMIC,
+   BENCH_NUM_IMPLS,
+} BenchImpl;
+
+static const char *benchImplNames[BENCH_NUM_IMPLS] = {
+   "old", "new", "atomic",
+};
+
+/* Average number of elements per initial bucket. */
+static const double benchLoads[] = { 0.5, 1, 4, 16, 64 };
+
+/*
+ * The table before incremental resizing: a fixed bucket array, with the
+ * rotate-xor string hash folded down to the bucket index bits.
+ */
+
+#define OLD_HASH_ROTATE 5
+
+typedef struct OldEntry {
+   struct OldEntry *next;
+   const void      *keyStr;
+   void            *clientData;
+} OldEntry;
+
+typedef struct OldTable {
+   uint32     numEntries;
+   uint32     numBits;
+   int        keyType;
+   OldEntry **buckets;
+} OldTable;
+
+typedef struct BenchThread {
+   pthread_t     thread;
+   HashTable    *ht;
+   const void  **keys;
+   unsigned int  first;
+   unsigned int  count;
+} BenchThread;
+
+
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * BenchNowUS --
+ *
+ *      Returns the current time in microseconds.
+ *
+ * Results:
+ *      The time.
+ *
+ * Side effects:
+ *      None.
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+static uint64
+BenchNowUS(void)
+{
+   struct timeval tv;
+
+   gettimeofday(&tv, NULL);
+   return (uint64)tv.tv_sec * 1000000 + tv.tv_usec;
+}
+
+
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * OldHash --
+ *
+ *      The bucket index the old table computed for a key.
+ *
+ * Results:
+ *      The bucket index.
+ *
+ * Side effects:
+ *      None.
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+static uint32
+OldHash(const OldTable *t,   // IN:
+        const void *s)       // IN:
+{
+   uint32 mask = MASK(t->numBits);
+   uint32 h = 0;
+
+   if (t->keyType == HASH_STRING_KEY) {
+      const unsigned char *keyPtr = s;
+      int c;
+
+      while ((c = *keyPtr++)) {
+         h ^= c;
+         h = h << OLD_HASH_ROTATE | h >> (32 - OLD_HASH_ROTATE);
+      }
+   } else {
+      h = (uint32) (uintptr_t) s ^ (uint32) ((uint64) (uintptr_t) s >> 32);
+      h *= 48271;
+   }
+
+   for (; h > mask; h = (h & mask) ^ (h >> t->numBits)) {
+   }
+
+   return h;
+}
+
+
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * OldLookup --
+ * OldInsert --
+ *
+ *      Lookup and insert of the old table.
+ *
+ * Results:
+ *      The entry, or NULL / FALSE if the key already exists.
+ *
+ * Side effects:
+ *      OldInsert adds an entry.
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+static OldEntry *
+OldLookup(const OldTable *t,   // IN:
+          const void *keyStr)  // IN:
+{
+   OldEntry *entry;
+
+   for (entry = t->buckets[OldHash(t, keyStr)];
+        entry != NULL;
+        entry = entry->next) {
+      if (t->keyType == HASH_STRING_KEY ?
+             strcmp(entry->keyStr, keyStr) == 0 : entry->keyStr == keyStr) {
+         return entry;
+      }
+   }
+
+   return NULL;
+}
+
+static Bool
+OldInsert(OldTable *t,          // IN/OUT:
+          const void *keyStr,   // IN:
+          void *clientData)     // IN:
+{
+   uint32 h = OldHash(t, keyStr);
+   OldEntry *entry;
+
+   if (OldLookup(t, keyStr) != NULL) {
+      return FALSE;
+   }
+
+   entry = Util_SafeMalloc(sizeof *entry);
+   entry->keyStr = keyStr;
+   entry->clientData = clientData;
+   entry->next = t->buckets[h];
+   t->buckets[h] = entry;
+
+   return TRUE;
+}
+
+
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * OldStats --
+ *
+ *      Chain statistics of the old table, as HashTable_GetStats reports
+ *      them.
+ *
+ * Results:
+ *      The statistics in *stats.
+ *
+ * Side effects:
+ *      None.
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+static void
+OldStats(const OldTable *t,       // IN:
+         HashTableStats *stats)   // OUT:
+{
+   uint32 i;
+
+   memset(stats, 0, sizeof *stats);
+   stats->numBuckets = t->numEntries;
+
+   for (i = 0; i < t->numEntries; i++) {
+      uint32 chainLength = 0;
+      OldEntry *entry;
+
+      for (entry = t->buckets[i]; entry != NULL; entry = entry->next) {
+         chainLength++;
+         stats->totalProbes += chainLength;
+      }
+      stats->numElements += chainLength;
+      stats->maxChainLength = MAX(stats->maxChainLength, chainLength);
+   }
+}
+
+
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * OldFree --
+ *
+ *      Frees the old table.
+ *
+ * Results:
+ *      None.
+ *
+ * Side effects:
+ *      None.
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+static void
+OldFree(OldTable *t)   // IN:
+{
+   uint32 i;
+
+   for (i = 0; i < t->numEntries; i++) {
+      while (t->buckets[i] != NULL) {
+         OldEntry *entry = t->buckets[i];
+
+         t->buckets[i] = entry->next;
+         free(entry);
+      }
+   }
+   free(t->buckets);
+}
+
+
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * BenchInsertThread --
+ *
+ *      Inserts a slice of the keys into an atomic table.
+ *
+ * Results:
+ *      NULL.
+ *
+ * Side effects:
+ *      None.
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+static void *
+BenchInsertThread(void *data)   // IN: BenchThread
+{
+   BenchThread *t = data;
+   unsigned int i;
+
+   for (i = t->first; i < t->first + t->count; i++) {
+      HashTable_Insert(t->ht, t->keys[i], (void *) (uintptr_t) (i + 1));
+   }
+
+   return NULL;
+}
+
+
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * BenchRun --
+ *
+ *      Fills a table of one implementation with the keys, then looks up
+ *      every key and as many keys that are not in the table, and prints
+ *      the cost of each and the resulting chain statistics.
+ *
+ * Results:
+ *      TRUE if every key was found with its data and no other key was.
+ *
+ * Side effects:
+ *      None.
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+static Bool
+BenchRun(BenchImpl impl,           // IN:
+         int keyType,              // IN: HASH_STRING_KEY or HASH_INT_KEY
+         uint32 numBuckets,        // IN: initial
+         const void **keys,        // IN: numKeys keys, then numKeys misses
+         unsigned int numKeys,     // IN:
+         unsigned int numThreads)  // IN: for BENCH_ATOMIC
+{
+   OldTable old;
+   HashTable *ht = NULL;
+   HashTableStats stats;
+   uint64 start;
+   uint64 insertUS;
+   uint64 hitUS;
+   uint64 missUS;
+   unsigned int errors = 0;
+   unsigned int i;
+
+   start = BenchNowUS();
+   switch (impl) {
+   case BENCH_OLD:
+      old.numEntries = numBuckets;
+      old.numBits = lssb32_0(numBuckets);
+      old.keyType = keyType;
+      old.buckets = Util_SafeCalloc(numBuckets, sizeof *old.buckets);
+      for (i = 0; i < numKeys; i++) {
+         OldInsert(&old, keys[i], (void *) (uintptr_t) (i + 1));
+      }
+      break;
+   case BENCH_NEW:
+      ht = HashTable_Alloc(numBuckets, keyType, NULL);
+      for (i = 0; i < numKeys; i++) {
+         HashTable_Insert(ht, keys[i], (void *) (uintptr_t) (i + 1));
+      }
+      break;
+   case BENCH_ATOMIC: {
+      BenchThread *threads = Util_SafeCalloc(numThreads, sizeof *threads);
+
+      ht = HashTable_Alloc(numBuckets, keyType | HASH_FLAG_ATOMIC, NULL);
+      for (i = 0; i < numThreads; i++) {
+         threads[i].ht = ht;
+         threads[i].keys = keys;
+         threads[i].first = (uint64) numKeys * i / numThreads;
+         threads[i].count = (uint64) numKeys * (i + 1) / numThreads -
+                            threads[i].first;
+         pthread_create(&threads[i].thread, NULL, BenchInsertThread,
+                        &threads[i]);
+      }
+      for (i = 0; i < numThreads; i++) {
+         pthread_join(threads[i].thread, NULL);
+      }
+      free(threads);
+      break;
+   }
+   default:
+      NOT_REACHED();
+   }
+   insertUS = BenchNowUS() - start;
+
+   start = BenchNowUS();
+   for (i = 0; i < numKeys; i++) {
+      void *data = NULL;
+
+      if (impl == BENCH_OLD) {
+         OldEntry *entry = OldLookup(&old, keys[i]);
+
+         data = entry != NULL ? entry->clientData : NULL;
+      } else {
+         HashTable_Lookup(ht, keys[i], &data);
+      }
+      errors += (uintptr_t) data != i + 1;
+   }
+   hitUS = BenchNowUS() - start;
+
+   start = BenchNowUS();
+   for (i = numKeys; i < 2 * numKeys; i++) {
+      if (impl == BENCH_OLD) {
+         errors += OldLookup(&old, keys[i]) != NULL;
+      } else {
+         errors += HashTable_Lookup(ht, keys[i], NULL);
+      }
+   }
+   missUS = BenchNowUS() - start;
+
+   if (impl == BENCH_OLD) {
+      OldStats(&old, &stats);
+      OldFree(&old);
+   } else {
+      HashTable_GetStats(ht, &stats);
+      if (impl == BENCH_ATOMIC) {
+         HashTable_FreeUnsafe(ht);
+      } else {
+         HashTable_Free(ht);
+      }
+   }
+   errors += stats.numElements != numKeys;
+
+   printf("%-4s %8u %6u %6.1f  %-7s %9.1f %9.1f %9.1f %8u %6u %6.2f %6u\n",
+          keyType == HASH_STRING_KEY ? "str" : "int", numKeys, numBuckets,
+          (double) numKeys / numBuckets, benchImplNames[impl],
+          insertUS * 1e3 / numKeys, hitUS * 1e3 / numKeys,
+          missUS * 1e3 / numKeys, stats.numBuckets, stats.maxChainLength,
+          (double) stats.totalProbes / MAX(stats.numElements, 1), errors);
+   fflush(stdout);
+
+   return errors == 0;
+}
+
+
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * BenchMakeKeys --
+ *
+ *      Makes count keys of the given type, then count more that differ from
+ *      all of them.
+ *
+ * Results:
+ *      The keys; free with BenchFreeKeys().
+ *
+ * Side effects:
+ *      None.
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+static const void **
+BenchMakeKeys(int keyType,          // IN:
+              unsigned int count)   // IN:
+{
+   const void **keys = Util_SafeCalloc(2 * count, sizeof *keys);
+   unsigned int i;
+
+   for (i = 0; i < 2 * count; i++) {
+      if (keyType == HASH_STRING_KEY) {
+         keys[i] = Str_SafeAsprintf(NULL, "mxUserLock.%u", i);
+      } else {
+         /* pthread_t values: page aligned addresses of thread stacks. */
+         keys[i] = (const void *) (uintptr_t) (0x7f0000000000ULL +
+                                               ((uint64) i << 23) + 0x700);
+      }
+   }
+
+   return keys;
+}
+
+static void
+BenchFreeKeys(int keyType,          // IN:
+              const void **keys,    // IN:
+              unsigned int count)   // IN:
+{
+   unsigned int i;
+
+   if (keyType == HASH_STRING_KEY) {
+      for (i = 0; i < 2 * count; i++) {
+         free((void *) keys[i]);
+      }
+   }
+   free(keys);
+}
+
+
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * BenchUsage --
+ *
+ *      Prints the usage.
+ *
+ * Results:
+ *      None.
+ *
+ * Side effects:
+ *      None.
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+static void
+BenchUsage(const char *name)   // IN: program name
+{
+   fprintf(stderr,
+           "Usage: %s [options]\n"
+           "  -b buckets  initial bucket count, a power of 2 (default: 256)\n"
+           "  -t threads  threads filling the atomic table (default: 4)\n",
+           name);
+}
+
+
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * main --
+ *
+ *      Main entry point.
+ *
+ * Results:
+ *      EXIT_SUCCESS if every table held exactly the keys put in it.
+ *
+ * Side effects:
+ *      None.
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+int
+main(int argc,          // IN
+     char *argv[])      // IN
+{
+   static const int keyTypes[] = { HASH_STRING_KEY, HASH_INT_KEY };
+   uint32 numBuckets = 256;
+   unsigned int numThreads = 4;
+   unsigned int failures = 0;
+   unsigned int k;
+   unsigned int l;
+   int opt;
+
+   while ((opt = getopt(argc, argv, "b:t:")) != -1) {
+      switch (opt) {
+      case 'b':
+         numBuckets = strtoul(optarg, NULL, 10);
+         break;
+      case 't':
+         numThreads = strtoul(optarg, NULL, 10);
+         break;
+      default:
+         BenchUsage(argv[0]);
+         return EXIT_FAILURE;
+      }
+   }
+
+   if (numBuckets == 0 || (numBuckets & (numBuckets - 1)) != 0 ||
+       numThreads == 0 || optind != argc) {
+      BenchUsage(argv[0]);
+      return EXIT_FAILURE;
+   }
+
+   printf("%-4s %8s %6s %6s  %-7s %9s %9s %9s %8s %6s %6s %6s\n", "key",
+          "elements", "init", "load", "impl", "insert/ns", "hit/ns",
+          "miss/ns", "buckets", "chain", "probes", "errors");
+   fflush(stdout);
+
+   for (k = 0; k < ARRAYSIZE(keyTypes); k++) {
+      for (l = 0; l < ARRAYSIZE(benchLoads); l++) {
+         unsigned int numKeys = numBuckets * benchLoads[l];
+         const void **keys = BenchMakeKeys(keyTypes[k], numKeys);
+         BenchImpl impl;
+
+         for (impl = 0; impl < BENCH_NUM_IMPLS; impl++) {
+            failures += !BenchRun(impl, keyTypes[k], numBuckets, keys,
+                                  numKeys, numThreads);
+         }
+         BenchFreeKeys(keyTypes[k], keys, numKeys);
+      }
+   }
+
+   return failures == 0 ? EXIT_SUCCESS : EXIT_FAILURE;
+}
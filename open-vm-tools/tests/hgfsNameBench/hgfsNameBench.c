@@ -0,0 +1,595 @@
+/*********************************************************
+ * Copyright (C) 2016 VMware, Inc. All rights reserved.
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU Lesser General Public License as published
+ * by the Free Software Foundation version 2.1 and no later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+ * or FITNESS FOR A PARTICULAR PURPOSE.  See the Lesser GNU General Public
+ * License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin St, Fifth Floor, Boston, MA  02110-1301 USA.
+ *
+ *********************************************************/
+
+/*
+ * hgfsNameBench.c --
+ *
+ *      Benchmark for the translation of HGFS cross-platform names to local
+ *      paths, HgfsServerGetLocalNameInfo in lib/hgfsServer and the share
+ *      lookup of the guest policy, HgfsServerPolicyGetShare.
+ *
+ *      Both are static, so the server is registered in-process through the
+ *      guest server manager, as in hgfsServerBench, and getattr requests by
+ *      name are handed to it: each one translates its name once. The names
+ *      lead to files in two directory chains below a local directory, one
+ *      with ASCII and one with UTF-8 names, reached through the guest
+ *      policy's root share. A third variant sends the ASCII names with the
+ *      share name in upper case and asks for a case insensitive lookup,
+ *      which takes the share lookup's fallback and has the server check
+ *      that the name exists as sent. The search of each directory for
+ *      names in another case is not reached: it starts from the share's
+ *      path, which is empty for the root share.
+ *
+ *      The program first checks the replies for each variant and for names
+ *      that must fail, then times the requests for files at increasing
+ *      depths. A stat(2) of the same file is timed alongside, for the part
+ *      of a request that is the filesystem's.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <limits.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <ctype.h>
+#include <sys/stat.h>
+#include <sys/time.h>
+
+#include "vmware.h"
+#include "str.h"
+#include "hgfs.h"
+#include "hgfsProto.h"
+#include "hgfsServerManager.h"
+#include "hgfsServerPolicy.h"
+#include "cpNameUtil.h"
+
+#define BENCH_MAX_DEPTH        64
+
+typedef enum {
+   BENCH_ASCII,
+   BENCH_UTF8,
+   BENCH_ASCII_SHARE_CASE,
+   BENCH_NUM_NAMES,
+} BenchNames;
+
+static const char *benchNamesLabels[BENCH_NUM_NAMES] = {
+   "ascii", "utf-8", "share case",
+};
+
+/* Directory names of the chains; the share case variant uses the ASCII one. */
+static const char *benchDirNames[BENCH_NUM_NAMES] = {
+   "repertoire",
+   "r\xc3\xa9pertoire-\xe6\x97\xa5\xe6\x9c\xac\xe8\xaa\x9e",
+   "repertoire",
+};
+
+static HgfsServerMgrData gMgr;
+static Bool gRegistered;
+static char gRequest[HGFS_LARGE_PACKET_MAX];
+static char gReply[HGFS_LARGE_PACKET_MAX];
+static uint32 gRequestId;
+
+static char gDir[PATH_MAX];
+static Bool gRemoveDir;
+static unsigned int gMaxDepth = 32;
+
+
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * BenchNowUS --
+ *
+ *      Returns the current time in microseconds.
+ *
+ * Results:
+ *      The time.
+ *
+ * Side effects:
+ *      None.
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+static uint64
+BenchNowUS(void)
+{
+   struct timeval tv;
+
+   gettimeofday(&tv, NULL);
+   return (uint64)tv.tv_sec * 1000000 + tv.tv_usec;
+}
+
+
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * BenchDeepPath --
+ *
+ *      Builds the local path of the directory depth levels down a chain, or
+ *      of the file in it.
+ *
+ * Results:
+ *      None.
+ *
+ * Side effects:
+ *      None.
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+static void
+BenchDeepPath(BenchNames names,     // IN: chain
+              unsigned int depth,   // IN: directory levels
+              Bool file,            // IN: path of the file in it
+              char *path,           // OUT: path
+              size_t pathSize)      // IN: size of path
+{
+   unsigned int i;
+
+   Str_Strcpy(path, gDir, pathSize);
+   Str_Strcat(path, names == BENCH_UTF8 ? "/utf8" : "/ascii", pathSize);
+   for (i = 1; i <= depth; i++) {
+      Str_Strcat(path, "/", pathSize);
+      Str_Strcat(path, benchDirNames[names], pathSize);
+   }
+   if (file) {
+      Str_Strcat(path, "/file", pathSize);
+   }
+}
+
+
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * BenchPackName --
+ *
+ *      Packs an absolute local path as a name in the guest policy's root
+ *      share. For the share case variant, the share name is upper cased and
+ *      a case insensitive lookup is requested.
+ *
+ * Results:
+ *      Size of the name beyond sizeof *name, or -1 if it does not fit.
+ *
+ * Side effects:
+ *      None.
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+static int
+BenchPackName(BenchNames names,        // IN: variant
+              const char *path,        // IN: absolute path
+              HgfsFileNameV3 *name,    // OUT: packed name
+              size_t space)            // IN: space left for the name
+{
+   int len;
+
+   len = CPNameUtil_ConvertToRoot(path, space, name->name);
+   if (len < 0) {
+      return -1;
+   }
+   name->length = len;
+   name->flags = 0;
+   name->caseType = HGFS_FILE_NAME_DEFAULT_CASE;
+   name->fid = HGFS_INVALID_HANDLE;
+
+   if (names == BENCH_ASCII_SHARE_CASE) {
+      size_t i;
+
+      for (i = 0; i < strlen(HGFS_SERVER_POLICY_ROOT_SHARE_NAME); i++) {
+         name->name[i] = toupper((unsigned char)name->name[i]);
+      }
+      name->caseType = HGFS_FILE_NAME_CASE_INSENSITIVE;
+   }
+
+   return len;
+}
+
+
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * BenchGetattr --
+ *
+ *      Gets the attributes of a file by name.
+ *
+ * Results:
+ *      The reply status, HGFS_STATUS_PROTOCOL_ERROR if there was no reply.
+ *
+ * Side effects:
+ *      The reply is in gReply.
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+static HgfsStatus
+BenchGetattr(BenchNames names,     // IN: variant
+             const char *path)     // IN: file
+{
+   HgfsRequest *header = (HgfsRequest *)gRequest;
+   HgfsRequestGetattrV3 *request = (HgfsRequestGetattrV3 *)(gRequest + sizeof *header);
+   size_t size = sizeof *header + sizeof *request;
+   size_t replySize = sizeof gReply;
+   int len;
+
+   memset(request, 0, sizeof *request);
+   len = BenchPackName(names, path, &request->fileName, sizeof gRequest - size);
+   if (len < 0) {
+      return HGFS_STATUS_NAME_TOO_LONG;
+   }
+
+   header->id = gRequestId++;
+   header->op = HGFS_OP_GETATTR_V3;
+
+   if (!HgfsServerManager_ProcessPacket(&gMgr, gRequest, size + len,
+                                        gReply, &replySize) ||
+       replySize < sizeof (HgfsReply)) {
+      return HGFS_STATUS_PROTOCOL_ERROR;
+   }
+
+   return ((HgfsReply *)gReply)->status;
+}
+
+
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * BenchStat --
+ *
+ *      Stats a file, the filesystem's share of a getattr request.
+ *
+ * Results:
+ *      HGFS_STATUS_SUCCESS, or HGFS_STATUS_NO_SUCH_FILE_OR_DIR.
+ *
+ * Side effects:
+ *      None.
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+static HgfsStatus
+BenchStat(BenchNames names,        // IN: variant, unused
+          const char *path)        // IN: file
+{
+   struct stat st;
+
+   return stat(path, &st) == 0 ? HGFS_STATUS_SUCCESS
+                               : HGFS_STATUS_NO_SUCH_FILE_OR_DIR;
+}
+
+
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * BenchSetup --
+ *
+ *      Creates the directory chains with a file in every directory and
+ *      registers the server.
+ *
+ * Results:
+ *      TRUE on success, FALSE otherwise.
+ *
+ * Side effects:
+ *      None.
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+static Bool
+BenchSetup(void)
+{
+   char path[PATH_MAX];
+   BenchNames names;
+   unsigned int depth;
+
+   if (gDir[0] == '\0') {
+      Str_Strcpy(gDir, "/tmp/hgfsNameBench.XXXXXX", sizeof gDir);
+      if (mkdtemp(gDir) == NULL) {
+         fprintf(stderr, "Cannot create a directory: %s\n", strerror(errno));
+         return FALSE;
+      }
+      gRemoveDir = TRUE;
+   }
+
+   for (names = BENCH_ASCII; names <= BENCH_UTF8; names++) {
+      for (depth = 0; depth <= gMaxDepth; depth++) {
+         int fd;
+
+         BenchDeepPath(names, depth, FALSE, path, sizeof path);
+         if (mkdir(path, 0755) != 0) {
+            fprintf(stderr, "Cannot create %s: %s\n", path, strerror(errno));
+            return FALSE;
+         }
+         BenchDeepPath(names, depth, TRUE, path, sizeof path);
+         fd = open(path, O_CREAT | O_WRONLY, 0644);
+         if (fd < 0) {
+            fprintf(stderr, "Cannot create %s: %s\n", path, strerror(errno));
+            return FALSE;
+         }
+         close(fd);
+      }
+   }
+
+   HgfsServerManager_DataInit(&gMgr, "hgfsNameBench", NULL, NULL);
+   if (!HgfsServerManager_Register(&gMgr)) {
+      fprintf(stderr, "Cannot register the HGFS server\n");
+      return FALSE;
+   }
+   gRegistered = TRUE;
+
+   return TRUE;
+}
+
+
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * BenchCleanup --
+ *
+ *      Unregisters the server and removes what BenchSetup created.
+ *
+ * Results:
+ *      None.
+ *
+ * Side effects:
+ *      None.
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+static void
+BenchCleanup(void)
+{
+   char path[PATH_MAX];
+   BenchNames names;
+   int depth;
+
+   if (gRegistered) {
+      HgfsServerManager_Unregister(&gMgr);
+   }
+
+   if (gDir[0] == '\0') {
+      return;
+   }
+   for (names = BENCH_ASCII; names <= BENCH_UTF8; names++) {
+      for (depth = gMaxDepth; depth >= 0; depth--) {
+         BenchDeepPath(names, depth, TRUE, path, sizeof path);
+         unlink(path);
+         BenchDeepPath(names, depth, FALSE, path, sizeof path);
+         rmdir(path);
+      }
+   }
+   if (gRemoveDir) {
+      rmdir(gDir);
+   }
+}
+
+
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * BenchCheckReplies --
+ *
+ *      Checks that the server finds the files at the top and at the bottom
+ *      of each chain, reports them as regular files, and fails names that
+ *      lead nowhere.
+ *
+ * Results:
+ *      Number of failed checks.
+ *
+ * Side effects:
+ *      None.
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+static unsigned int
+BenchCheckReplies(void)
+{
+   HgfsReplyGetattrV3 *reply = (HgfsReplyGetattrV3 *)(gReply + sizeof (HgfsReply));
+   char path[PATH_MAX];
+   unsigned int failures = 0;
+   unsigned int checks = 0;
+   BenchNames names;
+   HgfsStatus status;
+
+   for (names = 0; names < BENCH_NUM_NAMES; names++) {
+      unsigned int depths[] = { 0, gMaxDepth };
+      unsigned int i;
+
+      for (i = 0; i < ARRAYSIZE(depths); i++) {
+         BenchDeepPath(names, depths[i], TRUE, path, sizeof path);
+         status = BenchGetattr(names, path);
+         checks++;
+         if (status != HGFS_STATUS_SUCCESS ||
+             reply->attr.type != HGFS_FILE_TYPE_REGULAR) {
+            fprintf(stderr, "%s, depth %u: status %d, type %d\n",
+                    benchNamesLabels[names], depths[i], status,
+                    status == HGFS_STATUS_SUCCESS ? reply->attr.type : -1);
+            failures++;
+         }
+      }
+   }
+
+   /* A missing file, and one the exact case lookup must not find. */
+   BenchDeepPath(BENCH_UTF8, gMaxDepth, FALSE, path, sizeof path);
+   Str_Strcat(path, "/missing", sizeof path);
+   checks++;
+   if (BenchGetattr(BENCH_UTF8, path) == HGFS_STATUS_SUCCESS) {
+      fprintf(stderr, "Found the missing file %s\n", path);
+      failures++;
+   }
+   BenchDeepPath(BENCH_ASCII, gMaxDepth, FALSE, path, sizeof path);
+   Str_Strcat(path, "/FILE", sizeof path);
+   checks++;
+   if (BenchGetattr(BENCH_ASCII, path) == HGFS_STATUS_SUCCESS) {
+      fprintf(stderr, "Found %s with an exact case lookup\n", path);
+      failures++;
+   }
+
+   printf("%u of %u reply checks failed\n", failures, checks);
+   return failures;
+}
+
+
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * BenchTime --
+ *
+ *      Times requests for the file depth levels down a chain.
+ *
+ * Results:
+ *      Microseconds per request, or a negative value if a request failed.
+ *
+ * Side effects:
+ *      None.
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+static double
+BenchTime(HgfsStatus (*request)(BenchNames, const char *), // IN: request
+          BenchNames names,                                 // IN: variant
+          unsigned int depth,                               // IN: levels
+          unsigned long iterations)                         // IN: requests
+{
+   char path[PATH_MAX];
+   unsigned long i;
+   uint64 start;
+
+   BenchDeepPath(names, depth, TRUE, path, sizeof path);
+   start = BenchNowUS();
+   for (i = 0; i < iterations; i++) {
+      if (request(names, path) != HGFS_STATUS_SUCCESS) {
+         return -1;
+      }
+   }
+   return (double)(BenchNowUS() - start) / iterations;
+}
+
+
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * BenchUsage --
+ *
+ *      Prints the usage.
+ *
+ * Results:
+ *      None.
+ *
+ * Side effects:
+ *      None.
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+static void
+BenchUsage(const char *name)   // IN: program name
+{
+   fprintf(stderr,
+           "Usage: %s [options]\n"
+           "  -d dir     directory for the files (default: a new temporary "
+           "directory)\n"
+           "  -n count   requests per depth and variant (default: 20000)\n"
+           "  -D depth   directory levels, timed at powers of two\n"
+           "             (default: 32, max %d)\n",
+           name, BENCH_MAX_DEPTH);
+}
+
+
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * main --
+ *
+ *      Main entry point.
+ *
+ * Results:
+ *      EXIT_SUCCESS if every check and request succeeded.
+ *
+ * Side effects:
+ *      None.
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+int
+main(int argc,          // IN
+     char *argv[])      // IN
+{
+   unsigned long iterations = 20000;
+   unsigned int failures;
+   unsigned int depth;
+   int opt;
+
+   while ((opt = getopt(argc, argv, "d:n:D:")) != -1) {
+      switch (opt) {
+      case 'd':
+         Str_Strcpy(gDir, optarg, sizeof gDir);
+         break;
+      case 'n':
+         iterations = strtoul(optarg, NULL, 10);
+         break;
+      case 'D':
+         gMaxDepth = strtoul(optarg, NULL, 10);
+         break;
+      default:
+         BenchUsage(argv[0]);
+         return EXIT_FAILURE;
+      }
+   }
+
+   if (iterations == 0 || gMaxDepth == 0 || gMaxDepth > BENCH_MAX_DEPTH) {
+      BenchUsage(argv[0]);
+      return EXIT_FAILURE;
+   }
+
+   if (!BenchSetup()) {
+      BenchCleanup();
+      return EXIT_FAILURE;
+   }
+
+   failures = BenchCheckReplies();
+
+   printf("%8s %10s %12s %12s\n", "depth", "names", "getattr us", "stat us");
+   for (depth = 1; depth <= gMaxDepth; depth *= 2) {
+      BenchNames names;
+
+      for (names = 0; names < BENCH_NUM_NAMES; names++) {
+         double server = BenchTime(BenchGetattr, names, depth, iterations);
+         double reference = BenchTime(BenchStat, names, depth, iterations);
+
+         if (server < 0 || reference < 0) {
+            fprintf(stderr, "Request failed at depth %u, %s names\n", depth,
+                    benchNamesLabels[names]);
+            failures++;
+            continue;
+         }
+         printf("%8u %10s %12.2f %12.2f\n", depth, benchNamesLabels[names],
+                server, reference);
+      }
+   }
+
+   BenchCleanup();
+
+   return failures == 0 ? EXIT_SUCCESS : EXIT_FAILURE;
+}
@@ -0,0 +1,779 @@
+/*********************************************************
+ * Copyright (C) 2016 VMware, Inc. All rights reserved.
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU Lesser General Public License as published
+ * by the Free Software Foundation version 2.1 and no later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+ * or FITNESS FOR A PARTICULAR PURPOSE.  See the Lesser GNU General Public
+ * License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin St, Fifth Floor, Boston, MA  02110-1301 USA.
+ *
+ *********************************************************/
+
+/*
+ * hgfsPacketBench.c --
+ *
+ *      Packet buffer benchmark for the HGFS server in lib/hgfsServer.
+ *
+ *      Unlike the backdoor, which hands the server one contiguous request
+ *      and reply buffer, a shared memory channel passes guest pages: the
+ *      request and reply share a buffer that spans a few pages, and the
+ *      data of HGFS_OP_READ_FAST_V4 and HGFS_OP_WRITE_FAST_V4 sits in pages
+ *      of its own. This program registers such a channel with the server
+ *      in-process, its "guest" pages being ordinary memory mapped one to
+ *      one, and streams fast reads and writes through it. It reports the
+ *      throughput together with the server's packet buffer counters, see
+ *      HgfsServerBufStats.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <limits.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/time.h>
+
+#include "vmware.h"
+#include "str.h"
+#include "hgfs.h"
+#include "hgfsProto.h"
+#include "hgfsServer.h"
+#include "hgfsServerPolicy.h"
+#include "cpNameUtil.h"
+#include "util.h"
+
+typedef enum {
+   BENCH_READ,
+   BENCH_WRITE,
+   BENCH_NUM_OPS,
+} BenchOp;
+
+static const char *benchOpNames[BENCH_NUM_OPS] = {
+   "read", "write",
+};
+
+static void *BenchMapVa(uint64 pa, uint32 size, void **context);
+static void BenchUnmapVa(void **context);
+static Bool BenchSendReply(void *opaqueSession, HgfsPacket *packet,
+                           HgfsSendFlags flags);
+
+static HgfsServerConfig gConfig = {
+   HGFS_CONFIG_SHARE_ALL_HOST_DRIVES_ENABLED | HGFS_CONFIG_VOL_INFO_MIN,
+   HGFS_MAX_CACHED_FILENODES
+};
+static HgfsServerChannelCallbacks gChannelCb = {
+   BenchMapVa,
+   BenchMapVa,
+   BenchUnmapVa,
+   BenchSendReply,
+};
+static HgfsServerChannelData gChannelData = {
+   HGFS_CHANNEL_SHARED_MEM,
+   HGFS_LARGE_PACKET_MAX,
+};
+static HgfsServerMgrCallbacks gMgrCb;
+static HgfsServerCallbacks *gServerCb;
+static void *gTransportSession;
+static Bool gPolicyInit;
+static Bool gServerInit;
+static uint64 gSessionId;
+static uint32 gRequestId;
+
+static HgfsPacket *gPacket;
+static char *gMeta;
+static size_t gMetaSize = 4 * PAGE_SIZE;
+static char *gData;
+static size_t gIoSize = HGFS_LARGE_IO_MAX;
+static size_t gReplySize;
+
+static char gDir[PATH_MAX];
+static char gPath[PATH_MAX];
+static Bool gRemoveDir;
+static Bool gCreatedFile;
+static size_t gFileSize = 16 * 1024 * 1024;
+static HgfsHandle gHandle = HGFS_INVALID_HANDLE;
+
+
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * BenchNowUS --
+ *
+ *      Returns the current time in microseconds.
+ *
+ * Results:
+ *      The time.
+ *
+ * Side effects:
+ *      None.
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+static uint64
+BenchNowUS(void)
+{
+   struct timeval tv;
+
+   gettimeofday(&tv, NULL);
+   return (uint64)tv.tv_sec * 1000000 + tv.tv_usec;
+}
+
+
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * BenchMapVa --
+ *
+ *      Channel callback mapping a guest page. The "guest" is this process,
+ *      so the address passed in is already the one to use.
+ *
+ * Results:
+ *      The address.
+ *
+ * Side effects:
+ *      None.
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+static void *
+BenchMapVa(uint64 pa,         // IN: page address
+           uint32 size,       // IN: unused
+           void **context)    // OUT: mapping context
+{
+   /* The server expects a context for every mapping it releases. */
+   *context = (void *)(uintptr_t)pa;
+   return (void *)(uintptr_t)pa;
+}
+
+
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * BenchUnmapVa --
+ *
+ *      Channel callback releasing a mapping from BenchMapVa.
+ *
+ * Results:
+ *      None.
+ *
+ * Side effects:
+ *      None.
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+static void
+BenchUnmapVa(void **context)   // IN/OUT: mapping context
+{
+   *context = NULL;
+}
+
+
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * BenchSendReply --
+ *
+ *      Channel callback for a reply. Completes the send right away, which
+ *      is when the server writes the reply back to the guest pages.
+ *
+ * Results:
+ *      TRUE.
+ *
+ * Side effects:
+ *      None.
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+static Bool
+BenchSendReply(void *opaqueSession,      // IN: unused
+               HgfsPacket *packet,       // IN/OUT: packet
+               HgfsSendFlags flags)      // IN: send flags
+{
+   gReplySize = packet->replyPacketDataSize;
+   if (!(flags & HGFS_SEND_NO_COMPLETE)) {
+      gServerCb->session.sendComplete(packet, gTransportSession);
+   }
+   return TRUE;
+}
+
+
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * BenchAddIovs --
+ *
+ *      Describes a buffer as page sized iovs, the way a shared memory
+ *      channel receives it from the guest.
+ *
+ * Results:
+ *      Index of the next iov.
+ *
+ * Side effects:
+ *      None.
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+static uint32
+BenchAddIovs(HgfsPacket *packet,   // IN/OUT: packet
+             uint32 index,         // IN: first iov to fill in
+             char *buf,            // IN: page aligned buffer
+             size_t size)          // IN: buffer size
+{
+   size_t offset;
+
+   for (offset = 0; offset < size; offset += PAGE_SIZE) {
+      packet->iov[index].pa = (uintptr_t)(buf + offset);
+      packet->iov[index].len = MIN(PAGE_SIZE, size - offset);
+      packet->iov[index].va = NULL;
+      packet->iov[index].context = NULL;
+      index++;
+   }
+   return index;
+}
+
+
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * BenchSend --
+ *
+ *      Sends the request in the meta pages to the server and waits for the
+ *      reply, which replaces the request.
+ *
+ * Results:
+ *      The reply status, HGFS_STATUS_PROTOCOL_ERROR if there was no reply.
+ *
+ * Side effects:
+ *      None.
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+static HgfsStatus
+BenchSend(HgfsOp op,               // IN: request operation
+          size_t payloadSize,      // IN: size of the request after the header
+          size_t dataSize)         // IN: size of the data pages
+{
+   HgfsHeader *header = (HgfsHeader *)gMeta;
+   uint32 index;
+
+   memset(header, 0, sizeof *header);
+   header->version = HGFS_HEADER_VERSION;
+   header->dummy = HGFS_OP_NEW_HEADER;
+   header->packetSize = sizeof *header + payloadSize;
+   header->headerSize = sizeof *header;
+   header->requestId = gRequestId++;
+   header->op = op;
+   header->flags = HGFS_PACKET_FLAG_REQUEST;
+   header->sessionId = gSessionId;
+
+   memset(gPacket, 0, sizeof *gPacket);
+   index = BenchAddIovs(gPacket, 0, gMeta, gMetaSize);
+   gPacket->dataPacketIovIndex = index;
+   gPacket->iovCount = BenchAddIovs(gPacket, index, gData, dataSize);
+   gPacket->metaPacketSize = gMetaSize;
+   gPacket->metaPacketDataSize = header->packetSize;
+   gPacket->dataPacketSize = dataSize;
+   gPacket->state = HGFS_STATE_CLIENT_REQUEST;
+
+   gReplySize = 0;
+   gServerCb->session.receive(gPacket, gTransportSession);
+
+   if (gReplySize < sizeof *header) {
+      return HGFS_STATUS_PROTOCOL_ERROR;
+   }
+   return header->status;
+}
+
+
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * BenchCreateSession --
+ *
+ *      Creates the HGFS session the fast read and write requests need.
+ *
+ * Results:
+ *      The reply status.
+ *
+ * Side effects:
+ *      None.
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+static HgfsStatus
+BenchCreateSession(void)
+{
+   HgfsRequestCreateSessionV4 *request =
+      (HgfsRequestCreateSessionV4 *)(gMeta + sizeof (HgfsHeader));
+   HgfsStatus status;
+
+   memset(request, 0, sizeof *request);
+   request->maxPacketSize = HGFS_LARGE_PACKET_MAX;
+
+   status = BenchSend(HGFS_OP_CREATE_SESSION_V4, sizeof *request, 0);
+   if (status == HGFS_STATUS_SUCCESS) {
+      gSessionId = ((HgfsReplyCreateSessionV4 *)
+                    (gMeta + sizeof (HgfsHeader)))->sessionId;
+   }
+   return status;
+}
+
+
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * BenchOpen --
+ *
+ *      Opens a file for reading and writing, by its path in the guest
+ *      policy's root share.
+ *
+ * Results:
+ *      The reply status. The handle on success.
+ *
+ * Side effects:
+ *      None.
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+static HgfsStatus
+BenchOpen(const char *path,        // IN: file to open
+          HgfsHandle *handle)      // OUT: file handle
+{
+   HgfsRequestOpenV3 *request = (HgfsRequestOpenV3 *)(gMeta + sizeof (HgfsHeader));
+   size_t space = gMetaSize - sizeof (HgfsHeader) - sizeof *request;
+   HgfsStatus status;
+   int len;
+
+   memset(request, 0, sizeof *request);
+   request->mask = HGFS_OPEN_VALID_MODE | HGFS_OPEN_VALID_FLAGS |
+                   HGFS_OPEN_VALID_FILE_NAME;
+   request->mode = HGFS_OPEN_MODE_READ_WRITE;
+   request->flags = HGFS_OPEN;
+   len = CPNameUtil_ConvertToRoot(path, space, request->fileName.name);
+   if (len < 0) {
+      return HGFS_STATUS_NAME_TOO_LONG;
+   }
+   request->fileName.length = len;
+   request->fileName.caseType = HGFS_FILE_NAME_DEFAULT_CASE;
+   request->fileName.fid = HGFS_INVALID_HANDLE;
+
+   status = BenchSend(HGFS_OP_OPEN_V3, sizeof *request + len, 0);
+   if (status == HGFS_STATUS_SUCCESS) {
+      *handle = ((HgfsReplyOpenV3 *)(gMeta + sizeof (HgfsHeader)))->file;
+   }
+   return status;
+}
+
+
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * BenchClose --
+ *
+ *      Closes a file.
+ *
+ * Results:
+ *      The reply status.
+ *
+ * Side effects:
+ *      None.
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+static HgfsStatus
+BenchClose(HgfsHandle handle)      // IN: file handle
+{
+   HgfsRequestCloseV3 *request = (HgfsRequestCloseV3 *)(gMeta + sizeof (HgfsHeader));
+
+   memset(request, 0, sizeof *request);
+   request->file = handle;
+
+   return BenchSend(HGFS_OP_CLOSE_V3, sizeof *request, 0);
+}
+
+
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * BenchReadWrite --
+ *
+ *      Reads or writes gIoSize bytes through the data pages.
+ *
+ * Results:
+ *      The reply status, HGFS_STATUS_PROTOCOL_ERROR if less was transferred.
+ *
+ * Side effects:
+ *      None.
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+static HgfsStatus
+BenchReadWrite(BenchOp op,           // IN: read or write
+               uint64 offset)        // IN: file offset
+{
+   void *payload = gMeta + sizeof (HgfsHeader);
+   HgfsStatus status;
+   uint32 actualSize;
+
+   if (op == BENCH_READ) {
+      HgfsRequestReadV3 *request = payload;
+
+      memset(request, 0, sizeof *request);
+      request->file = gHandle;
+      request->offset = offset;
+      request->requiredSize = gIoSize;
+      status = BenchSend(HGFS_OP_READ_FAST_V4, sizeof *request, gIoSize);
+      actualSize = ((HgfsReplyReadV3 *)payload)->actualSize;
+   } else {
+      HgfsRequestWriteV3 *request = payload;
+
+      memset(request, 0, sizeof *request);
+      request->file = gHandle;
+      request->offset = offset;
+      request->requiredSize = gIoSize;
+      status = BenchSend(HGFS_OP_WRITE_FAST_V4, sizeof *request, gIoSize);
+      actualSize = ((HgfsReplyWriteV3 *)payload)->actualSize;
+   }
+
+   if (status == HGFS_STATUS_SUCCESS && actualSize != gIoSize) {
+      status = HGFS_STATUS_PROTOCOL_ERROR;
+   }
+   return status;
+}
+
+
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * BenchSetup --
+ *
+ *      Creates the file, starts the server, connects the channel and opens
+ *      the file through it.
+ *
+ * Results:
+ *      TRUE on success, FALSE otherwise.
+ *
+ * Side effects:
+ *      Statistics collection is enabled in the server.
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+static Bool
+BenchSetup(void)
+{
+   size_t numIovs;
+   size_t done;
+   HgfsStatus status;
+   int fd;
+
+   if (gDir[0] == '\0') {
+      Str_Strcpy(gDir, "/tmp/hgfsPacketBench.XXXXXX", sizeof gDir);
+      if (mkdtemp(gDir) == NULL) {
+         fprintf(stderr, "Cannot create a directory: %s\n", strerror(errno));
+         return FALSE;
+      }
+      gRemoveDir = TRUE;
+   }
+
+   if (posix_memalign((void **)&gMeta, PAGE_SIZE, gMetaSize) != 0 ||
+       posix_memalign((void **)&gData, PAGE_SIZE, gIoSize) != 0) {
+      fprintf(stderr, "Cannot allocate the packet pages\n");
+      return FALSE;
+   }
+   numIovs = CEILING(gMetaSize, PAGE_SIZE) + CEILING(gIoSize, PAGE_SIZE);
+   gPacket = Util_SafeCalloc(1, sizeof *gPacket +
+                                numIovs * sizeof gPacket->iov[0]);
+
+   if (snprintf(gPath, sizeof gPath, "%s/file", gDir) >= sizeof gPath) {
+      fprintf(stderr, "Directory name too long: %s\n", gDir);
+      return FALSE;
+   }
+   fd = open(gPath, O_CREAT | O_TRUNC | O_WRONLY, 0644);
+   if (fd < 0) {
+      fprintf(stderr, "Cannot create %s: %s\n", gPath, strerror(errno));
+      return FALSE;
+   }
+   gCreatedFile = TRUE;
+   memset(gData, 'h', gIoSize);
+   for (done = 0; done < gFileSize; done += gIoSize) {
+      if (write(fd, gData, MIN(gIoSize, gFileSize - done)) < 0) {
+         fprintf(stderr, "Cannot write %s: %s\n", gPath, strerror(errno));
+         close(fd);
+         return FALSE;
+      }
+   }
+   close(fd);
+
+   /* The guest policy shares the whole file system as its root share. */
+   if (!HgfsServerPolicy_Init(NULL, NULL, &gMgrCb.enumResources)) {
+      fprintf(stderr, "Cannot initialize the HGFS server policy\n");
+      return FALSE;
+   }
+   gPolicyInit = TRUE;
+
+   if (!HgfsServer_InitState(&gServerCb, &gConfig, &gMgrCb)) {
+      fprintf(stderr, "Cannot initialize the HGFS server\n");
+      return FALSE;
+   }
+   gServerInit = TRUE;
+
+   if (!gServerCb->session.connect(NULL, &gChannelCb, &gChannelData,
+                                   &gTransportSession)) {
+      fprintf(stderr, "Cannot connect to the HGFS server\n");
+      gTransportSession = NULL;
+      return FALSE;
+   }
+
+   status = BenchCreateSession();
+   if (status != HGFS_STATUS_SUCCESS) {
+      fprintf(stderr, "Cannot create a session: status %d\n", status);
+      return FALSE;
+   }
+
+   status = BenchOpen(gPath, &gHandle);
+   if (status != HGFS_STATUS_SUCCESS) {
+      fprintf(stderr, "Cannot open %s: status %d\n", gPath, status);
+      return FALSE;
+   }
+
+   HgfsServer_EnableStats(TRUE);
+
+   return TRUE;
+}
+
+
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * BenchCleanup --
+ *
+ *      Closes the file, tears the server down and removes the file, and the
+ *      directory if it was created by us.
+ *
+ * Results:
+ *      None.
+ *
+ * Side effects:
+ *      None.
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+static void
+BenchCleanup(void)
+{
+   if (gTransportSession != NULL) {
+      HgfsServer_EnableStats(FALSE);
+      if (gHandle != HGFS_INVALID_HANDLE) {
+         BenchClose(gHandle);
+      }
+      gServerCb->session.disconnect(gTransportSession);
+      gServerCb->session.close(gTransportSession);
+   }
+   if (gServerInit) {
+      HgfsServer_ExitState();
+   }
+   if (gPolicyInit) {
+      HgfsServerPolicy_Cleanup();
+   }
+
+   if (gCreatedFile) {
+      unlink(gPath);
+   }
+   if (gRemoveDir) {
+      rmdir(gDir);
+   }
+   free(gPacket);
+   free(gMeta);
+   free(gData);
+}
+
+
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * BenchRun --
+ *
+ *      Streams reads or writes over the file and prints the throughput and
+ *      the packet buffer counters.
+ *
+ * Results:
+ *      Number of failed requests.
+ *
+ * Side effects:
+ *      Resets the server statistics.
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+static unsigned long
+BenchRun(BenchOp op,               // IN: read or write
+         unsigned long count)      // IN: requests to send
+{
+   HgfsOp hgfsOp = op == BENCH_READ ? HGFS_OP_READ_FAST_V4 :
+                                      HGFS_OP_WRITE_FAST_V4;
+   uint64 slots = gFileSize / gIoSize;
+   const HgfsServerBufStats *buf;
+   HgfsServerStats stats;
+   unsigned long failures = 0;
+   unsigned long n;
+   uint64 start;
+   double seconds;
+
+   HgfsServer_GetStats(&stats, TRUE);
+   start = BenchNowUS();
+   for (n = 0; n < count; n++) {
+      if (BenchReadWrite(op, (n % slots) * gIoSize) != HGFS_STATUS_SUCCESS) {
+         failures++;
+      }
+   }
+   seconds = (BenchNowUS() - start) / 1000000.0;
+   HgfsServer_GetStats(&stats, FALSE);
+   buf = &stats.buffers;
+
+   printf("%-6s %8lu %9.0f %8.1f %8.1f %8"FMT64"u %8"FMT64"u %8"FMT64"u "
+          "%8"FMT64"u %9.1f %8"FMT64"u %6lu\n",
+          benchOpNames[op], count, count / seconds,
+          (double)count * gIoSize / seconds / (1024 * 1024),
+          stats.ops[hgfsOp].count == 0 ? 0.0 :
+             (double)stats.ops[hgfsOp].totalUS / stats.ops[hgfsOp].count,
+          buf->allocs, buf->reuses, buf->frees, buf->bounces,
+          buf->bounceBytes / (1024.0 * 1024), buf->vectoredIos, failures);
+   fflush(stdout);
+
+   return failures;
+}
+
+
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * BenchUsage --
+ *
+ *      Prints the usage.
+ *
+ * Results:
+ *      None.
+ *
+ * Side effects:
+ *      None.
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+static void
+BenchUsage(const char *name)   // IN: program name
+{
+   fprintf(stderr,
+           "Usage: %s [options]\n"
+           "  -d dir     directory for the file (default: a new temporary directory)\n"
+           "  -n count   requests per operation (default: 20000)\n"
+           "  -m op      'read', 'write' or 'all' (default: all)\n"
+           "  -S size    file size (default: 16777216)\n"
+           "  -s size    read and write size (default: %u)\n"
+           "  -M size    request and reply buffer size (default: %u)\n",
+           name, HGFS_LARGE_IO_MAX, 4 * PAGE_SIZE);
+}
+
+
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * main --
+ *
+ *      Main entry point.
+ *
+ * Results:
+ *      EXIT_SUCCESS if every request succeeded.
+ *
+ * Side effects:
+ *      None.
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+int
+main(int argc,          // IN
+     char *argv[])      // IN
+{
+   unsigned long count = 20000;
+   const char *opName = "all";
+   unsigned long failures = 0;
+   BenchOp op;
+   int opt;
+
+   while ((opt = getopt(argc, argv, "d:n:m:S:s:M:")) != -1) {
+      switch (opt) {
+      case 'd':
+         Str_Strcpy(gDir, optarg, sizeof gDir);
+         break;
+      case 'n':
+         count = strtoul(optarg, NULL, 10);
+         break;
+      case 'm':
+         opName = optarg;
+         break;
+      case 'S':
+         gFileSize = strtoul(optarg, NULL, 10);
+         break;
+      case 's':
+         gIoSize = strtoul(optarg, NULL, 10);
+         break;
+      case 'M':
+         gMetaSize = strtoul(optarg, NULL, 10);
+         break;
+      default:
+         BenchUsage(argv[0]);
+         return EXIT_FAILURE;
+      }
+   }
+
+   if (count == 0 || gIoSize == 0 || gIoSize > HGFS_LARGE_IO_MAX ||
+       gFileSize < gIoSize ||
+       gMetaSize < PAGE_SIZE ||
+       gMetaSize > HGFS_LARGE_PACKET_MAX ||
+       (strcmp(opName, "all") != 0 &&
+        strcmp(opName, benchOpNames[BENCH_READ]) != 0 &&
+        strcmp(opName, benchOpNames[BENCH_WRITE]) != 0)) {
+      BenchUsage(argv[0]);
+      return EXIT_FAILURE;
+   }
+
+   if (!BenchSetup()) {
+      BenchCleanup();
+      return EXIT_FAILURE;
+   }
+
+   printf("%-6s %8s %9s %8s %8s %8s %8s %8s %8s %9s %8s %6s\n", "op",
+          "count", "req/s", "MB/s", "avg(us)", "allocs", "reuses", "frees",
+          "bounces", "bounceMB", "vectored", "failed");
+   for (op = 0; op < BENCH_NUM_OPS; op++) {
+      if (strcmp(opName, "all") == 0 ||
+          strcmp(opName, benchOpNames[op]) == 0) {
+         failures += BenchRun(op, count);
+      }
+   }
+
+   BenchCleanup();
+
+   return failures == 0 ? EXIT_SUCCESS : EXIT_FAILURE;
+}
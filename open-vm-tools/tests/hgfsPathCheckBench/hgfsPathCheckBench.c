@@ -0,0 +1,526 @@
+/*********************************************************
+ * Copyright (C) 2016 VMware, Inc. All rights reserved.
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU Lesser General Public License as published
+ * by the Free Software Foundation version 2.1 and no later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+ * or FITNESS FOR A PARTICULAR PURPOSE.  See the Lesser GNU General Public
+ * License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin St, Fifth Floor, Boston, MA  02110-1301 USA.
+ *
+ *********************************************************/
+
+/*
+ * hgfsPathCheckBench.c --
+ *
+ *      Benchmark for the share confinement check of the HGFS server,
+ *      HgfsPlatformPathHasSymlink in lib/hgfsServer.
+ *
+ *      The guest policy only exports the root share, for which the server
+ *      skips the check, so hgfsServerBench never reaches it. This program
+ *      calls it directly on a share built in a local directory. It first
+ *      checks that it returns the same name status as a plain realpath(3)
+ *      check of the parent directory, which is what the server did before
+ *      it used openat2, for names that escape the share through a symlink
+ *      or "..", follow an absolute symlink back into the share, have a
+ *      missing or non-directory parent, or sit in a sibling directory whose
+ *      name starts with the share's. It then times both checks for files
+ *      at increasing depths below the share root.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <limits.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include <sys/time.h>
+
+#include "vmware.h"
+#include "str.h"
+#include "util.h"
+#include "hgfsServerInt.h"
+
+#define BENCH_MAX_DEPTH        64
+
+static char gDir[PATH_MAX];
+static char gShare[PATH_MAX];
+static char gOutside[PATH_MAX];
+static char gSibling[PATH_MAX];
+static Bool gRemoveDir;
+static unsigned int gMaxDepth = 32;
+
+
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * BenchNowUS --
+ *
+ *      Returns the current time in microseconds.
+ *
+ * Results:
+ *      The time.
+ *
+ * Side effects:
+ *      None.
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+static uint64
+BenchNowUS(void)
+{
+   struct timeval tv;
+
+   gettimeofday(&tv, NULL);
+   return (uint64)tv.tv_sec * 1000000 + tv.tv_usec;
+}
+
+
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * BenchDeepPath --
+ *
+ *      Builds the path of the directory depth levels below the share root,
+ *      or of the file in it.
+ *
+ * Results:
+ *      None.
+ *
+ * Side effects:
+ *      None.
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+static void
+BenchDeepPath(unsigned int depth,   // IN: directory levels
+              Bool file,            // IN: path of the file in it
+              char *path,           // OUT: path
+              size_t pathSize)      // IN: size of path
+{
+   unsigned int i;
+
+   Str_Strcpy(path, gShare, pathSize);
+   for (i = 1; i <= depth; i++) {
+      Str_Strcat(path, "/d", pathSize);
+   }
+   if (file) {
+      Str_Strcat(path, "/file", pathSize);
+   }
+}
+
+
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * BenchRealPathCheck --
+ *
+ *      The share check as the server did it before openat2: resolve the
+ *      parent of fileName with realpath(3) and compare it with the share.
+ *
+ * Results:
+ *      The name status.
+ *
+ * Side effects:
+ *      None.
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+static HgfsNameStatus
+BenchRealPathCheck(const char *fileName)   // IN: file to check
+{
+   char parent[PATH_MAX];
+   char resolved[PATH_MAX];
+   char *sep;
+
+   Str_Strcpy(parent, fileName, sizeof parent);
+   sep = strrchr(parent, DIRSEPC);
+   if (sep == parent) {
+      sep[1] = '\0';
+   } else if (sep != NULL) {
+      *sep = '\0';
+   }
+
+   if (realpath(parent, resolved) == NULL) {
+      switch (errno) {
+      case ENOENT:
+         return HGFS_NAME_STATUS_DOES_NOT_EXIST;
+      case ENOTDIR:
+         return HGFS_NAME_STATUS_NOT_A_DIRECTORY;
+      default:
+         return HGFS_NAME_STATUS_FAILURE;
+      }
+   }
+
+   if (strncmp(gShare, resolved, strlen(gShare)) != 0) {
+      return HGFS_NAME_STATUS_ACCESS_DENIED;
+   }
+   return HGFS_NAME_STATUS_COMPLETE;
+}
+
+
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * BenchServerCheck --
+ *
+ *      The share check as the server does it.
+ *
+ * Results:
+ *      The name status.
+ *
+ * Side effects:
+ *      None.
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+static HgfsNameStatus
+BenchServerCheck(const char *fileName)   // IN: file to check
+{
+   return HgfsPlatformPathHasSymlink(fileName, strlen(fileName),
+                                     gShare, strlen(gShare));
+}
+
+
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * BenchSetup --
+ *
+ *      Creates the share, the directory chain below it, a directory outside
+ *      of it and the symlinks the checks use.
+ *
+ * Results:
+ *      TRUE on success, FALSE otherwise.
+ *
+ * Side effects:
+ *      None.
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+static Bool
+BenchSetup(void)
+{
+   char path[PATH_MAX];
+   char target[PATH_MAX];
+   unsigned int depth;
+   int fd;
+
+   if (gDir[0] == '\0') {
+      Str_Strcpy(gDir, "/tmp/hgfsPathCheckBench.XXXXXX", sizeof gDir);
+      if (mkdtemp(gDir) == NULL) {
+         fprintf(stderr, "Cannot create a directory: %s\n", strerror(errno));
+         return FALSE;
+      }
+      gRemoveDir = TRUE;
+   }
+
+   /* The server compares against the resolved share path. */
+   if (realpath(gDir, path) == NULL) {
+      fprintf(stderr, "Cannot resolve %s: %s\n", gDir, strerror(errno));
+      return FALSE;
+   }
+   Str_Sprintf(gShare, sizeof gShare, "%s/share", path);
+   Str_Sprintf(gOutside, sizeof gOutside, "%s/outside", path);
+   Str_Sprintf(gSibling, sizeof gSibling, "%s/share-sibling", path);
+
+   if (mkdir(gShare, 0755) != 0 || mkdir(gOutside, 0755) != 0 ||
+       mkdir(gSibling, 0755) != 0) {
+      fprintf(stderr, "Cannot create the share: %s\n", strerror(errno));
+      return FALSE;
+   }
+
+   for (depth = 1; depth <= gMaxDepth; depth++) {
+      BenchDeepPath(depth, FALSE, path, sizeof path);
+      if (mkdir(path, 0755) != 0) {
+         fprintf(stderr, "Cannot create %s: %s\n", path, strerror(errno));
+         return FALSE;
+      }
+   }
+
+   Str_Sprintf(path, sizeof path, "%s/file", gShare);
+   fd = open(path, O_CREAT | O_WRONLY, 0644);
+   if (fd < 0) {
+      fprintf(stderr, "Cannot create %s: %s\n", path, strerror(errno));
+      return FALSE;
+   }
+   close(fd);
+
+   /* Out of the share, and back into it with an absolute target. */
+   Str_Sprintf(path, sizeof path, "%s/escape", gShare);
+   if (symlink(gOutside, path) != 0) {
+      fprintf(stderr, "Cannot create %s: %s\n", path, strerror(errno));
+      return FALSE;
+   }
+   Str_Sprintf(path, sizeof path, "%s/inside", gShare);
+   BenchDeepPath(1, FALSE, target, sizeof target);
+   if (symlink(target, path) != 0) {
+      fprintf(stderr, "Cannot create %s: %s\n", path, strerror(errno));
+      return FALSE;
+   }
+
+   return TRUE;
+}
+
+
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * BenchCleanup --
+ *
+ *      Removes what BenchSetup created.
+ *
+ * Results:
+ *      None.
+ *
+ * Side effects:
+ *      None.
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+static void
+BenchCleanup(void)
+{
+   char path[PATH_MAX];
+   unsigned int depth;
+
+   if (gShare[0] == '\0') {
+      return;
+   }
+
+   Str_Sprintf(path, sizeof path, "%s/escape", gShare);
+   unlink(path);
+   Str_Sprintf(path, sizeof path, "%s/inside", gShare);
+   unlink(path);
+   Str_Sprintf(path, sizeof path, "%s/file", gShare);
+   unlink(path);
+   for (depth = gMaxDepth; depth >= 1; depth--) {
+      BenchDeepPath(depth, FALSE, path, sizeof path);
+      rmdir(path);
+   }
+   rmdir(gShare);
+   rmdir(gOutside);
+   rmdir(gSibling);
+   if (gRemoveDir) {
+      rmdir(gDir);
+   }
+}
+
+
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * BenchCheckParity --
+ *
+ *      Checks that the server's share check returns the expected name
+ *      status, and the same one as the realpath check, for each case.
+ *
+ * Results:
+ *      Number of mismatches.
+ *
+ * Side effects:
+ *      None.
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+static unsigned int
+BenchCheckParity(void)
+{
+   static const struct {
+      const char *name;
+      const char *suffix;
+      HgfsNameStatus expected;
+   } cases[] = {
+      { "in the share root",       "/file",               HGFS_NAME_STATUS_COMPLETE },
+      { "in a subdirectory",       "/d/file",             HGFS_NAME_STATUS_COMPLETE },
+      { "through a symlink out",   "/escape/file",        HGFS_NAME_STATUS_ACCESS_DENIED },
+      { "through .. out",          "/d/../../outside/f",  HGFS_NAME_STATUS_ACCESS_DENIED },
+      { "through .. back in",      "/d/../d/file",        HGFS_NAME_STATUS_COMPLETE },
+      { "through an absolute "
+        "symlink back in",         "/inside/file",        HGFS_NAME_STATUS_COMPLETE },
+      { "missing parent",          "/missing/file",       HGFS_NAME_STATUS_DOES_NOT_EXIST },
+      { "non-directory ancestor",  "/file/d/file",        HGFS_NAME_STATUS_NOT_A_DIRECTORY },
+      /*
+       * The realpath check accepts a regular file as the parent and only
+       * compares a prefix of the share; keep what it accepts.
+       */
+      { "non-directory parent",    "/file/file",          HGFS_NAME_STATUS_COMPLETE },
+      { "in a sibling directory",  "-sibling/file",       HGFS_NAME_STATUS_COMPLETE },
+   };
+   char path[PATH_MAX];
+   unsigned int mismatches = 0;
+   unsigned int i;
+
+   for (i = 0; i < ARRAYSIZE(cases); i++) {
+      HgfsNameStatus server;
+      HgfsNameStatus reference;
+
+      Str_Sprintf(path, sizeof path, "%s%s", gShare, cases[i].suffix);
+      server = BenchServerCheck(path);
+      reference = BenchRealPathCheck(path);
+      if (server != cases[i].expected || reference != cases[i].expected) {
+         fprintf(stderr, "%s: %s: status %d, realpath %d, expected %d\n",
+                 cases[i].name, path, server, reference, cases[i].expected);
+         mismatches++;
+      }
+   }
+
+   printf("%u of %u parity cases failed\n", mismatches,
+          (unsigned int)ARRAYSIZE(cases));
+   return mismatches;
+}
+
+
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * BenchTime --
+ *
+ *      Times a share check on the file depth levels below the share root.
+ *
+ * Results:
+ *      Microseconds per check, or a negative value if a check failed.
+ *
+ * Side effects:
+ *      None.
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+static double
+BenchTime(HgfsNameStatus (*check)(const char *),  // IN: check to time
+          unsigned int depth,                      // IN: directory levels
+          unsigned long iterations)                // IN: checks to run
+{
+   char path[PATH_MAX];
+   unsigned long i;
+   uint64 start;
+
+   BenchDeepPath(depth, TRUE, path, sizeof path);
+   start = BenchNowUS();
+   for (i = 0; i < iterations; i++) {
+      if (check(path) != HGFS_NAME_STATUS_COMPLETE) {
+         return -1;
+      }
+   }
+   return (double)(BenchNowUS() - start) / iterations;
+}
+
+
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * BenchUsage --
+ *
+ *      Prints the usage.
+ *
+ * Results:
+ *      None.
+ *
+ * Side effects:
+ *      None.
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+static void
+BenchUsage(const char *name)   // IN: program name
+{
+   fprintf(stderr,
+           "Usage: %s [options]\n"
+           "  -d dir     directory for the share (default: a new temporary "
+           "directory)\n"
+           "  -n count   checks per depth (default: 100000)\n"
+           "  -D depth   directory levels below the share, timed at powers of "
+           "two\n"
+           "             (default: 32, max %d)\n",
+           name, BENCH_MAX_DEPTH);
+}
+
+
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * main --
+ *
+ *      Main entry point.
+ *
+ * Results:
+ *      EXIT_SUCCESS if both checks agree on every case.
+ *
+ * Side effects:
+ *      None.
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+int
+main(int argc,          // IN
+     char *argv[])      // IN
+{
+   unsigned long iterations = 100000;
+   unsigned int mismatches;
+   unsigned int depth;
+   int opt;
+
+   while ((opt = getopt(argc, argv, "d:n:D:")) != -1) {
+      switch (opt) {
+      case 'd':
+         Str_Strcpy(gDir, optarg, sizeof gDir);
+         break;
+      case 'n':
+         iterations = strtoul(optarg, NULL, 10);
+         break;
+      case 'D':
+         gMaxDepth = strtoul(optarg, NULL, 10);
+         break;
+      default:
+         BenchUsage(argv[0]);
+         return EXIT_FAILURE;
+      }
+   }
+
+   if (iterations == 0 || gMaxDepth == 0 || gMaxDepth > BENCH_MAX_DEPTH) {
+      BenchUsage(argv[0]);
+      return EXIT_FAILURE;
+   }
+
+   if (!BenchSetup()) {
+      BenchCleanup();
+      return EXIT_FAILURE;
+   }
+
+   mismatches = BenchCheckParity();
+
+   printf("%8s %12s %12s\n", "depth", "server us", "realpath us");
+   for (depth = 1; depth <= gMaxDepth; depth *= 2) {
+      double server = BenchTime(BenchServerCheck, depth, iterations);
+      double reference = BenchTime(BenchRealPathCheck, depth, iterations);
+
+      if (server < 0 || reference < 0) {
+         fprintf(stderr, "Check failed at depth %u\n", depth);
+         mismatches++;
+         break;
+      }
+      printf("%8u %12.2f %12.2f\n", depth, server, reference);
+   }
+
+   BenchCleanup();
+
+   return mismatches == 0 ? EXIT_SUCCESS : EXIT_FAILURE;
+}
@@ -0,0 +1,955 @@
+/*********************************************************
+ * Copyright (C) 2016 VMware, Inc. All rights reserved.
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU Lesser General Public License as published
+ * by the Free Software Foundation version 2.1 and no later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+ * or FITNESS FOR A PARTICULAR PURPOSE.  See the Lesser GNU General Public
+ * License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin St, Fifth Floor, Boston, MA  02110-1301 USA.
+ *
+ *********************************************************/
+
+/*
+ * hgfsLeaseTest.c --
+ *
+ *      Loopback test of the Linux HGFS server oplocks, which are kernel
+ *      leases (hgfsServerOplockLinux.c).
+ *
+ *      The guest server manager neither enables oplocks nor can send a
+ *      request to the client, so the lease code is built into this program
+ *      and the server functions it calls back are implemented here: a break
+ *      the server sends is recorded, and the test answers it the way a
+ *      client would, with HgfsAckOplockBreak. Breaks come from a child
+ *      process opening the leased file, as they would from any other
+ *      program on the host.
+ *
+ *      Two checks cover file descriptor reuse: a stale break signal for a
+ *      descriptor that now holds a lease which is not being broken, and a
+ *      descriptor that is closed and reused while the break thread is
+ *      sending the breaks it collected.
+ *
+ *      After the functional checks, the grant/break/ack round trip is timed
+ *      over a number of iterations. Each includes forking the opener.
+ */
+
+#ifndef _GNU_SOURCE
+#define _GNU_SOURCE   // F_GETLEASE
+#endif
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <limits.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <sys/time.h>
+#include <sys/wait.h>
+
+#include "vmware.h"
+#include "str.h"
+#include "hgfsServerInt.h"
+#include "hgfsServerOplock.h"
+#include "hgfsServerOplockInt.h"
+
+/* How long to wait for a break before failing (ms). */
+#define TEST_BREAK_WAIT        2000
+
+/* How long to wait to be sure no break is sent (ms). */
+#define TEST_NO_BREAK_WAIT     300
+
+/* Above the file descriptors the test opens. */
+#define TEST_MAX_FD            64
+
+static HgfsSessionInfo gSession;
+static pthread_mutex_t gTestLock = PTHREAD_MUTEX_INITIALIZER;
+static int gSessionRefs;
+static unsigned int gNumBreaks;
+static HgfsLockType gBreakTo;
+static unsigned int gFailSends;
+static HgfsLockType gNodeLock;
+
+/* Holds up the break thread after a send, see TestStaleSignal. */
+static Bool gHoldSends;
+
+/* Descriptor reuse while sending breaks, see TestReuseWhileSending. */
+static int gReuseFrom = -1;
+static int gReuseFd = -1;
+static unsigned int gReuseSeen;
+static Bool gReuseGranted;
+
+static char gDir[PATH_MAX];
+static char gPath[PATH_MAX];
+static char gOtherPath[PATH_MAX];
+static char gSparePath[PATH_MAX];
+static unsigned int gFailures;
+
+
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * HgfsServerOplockBreak --
+ *
+ *      Stands in for the server sending an oplock break to the client.
+ *
+ *      While gHoldSends is set, a send does not return until it is
+ *      cleared, so that break signals queue up for the break thread.
+ *
+ *      When a reuse is set up, sends fail until breaks of both gReuseFrom
+ *      and gReuseFd have been attempted; the next send for gReuseFrom then
+ *      closes and reuses gReuseFd before it succeeds.
+ *
+ * Results:
+ *      FALSE for the next gFailSends calls, as if the open had not
+ *      completed yet, and while waiting for a reuse; TRUE otherwise.
+ *
+ * Side effects:
+ *      Records the break.
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+Bool
+HgfsServerOplockBreak(ServerLockData *lockData)   // IN: break to send
+{
+   Bool sent = TRUE;
+   int reuseFd = -1;
+
+   pthread_mutex_lock(&gTestLock);
+   if (gFailSends > 0) {
+      gFailSends--;
+      sent = FALSE;
+   } else if (gReuseFd != -1 &&
+              (lockData->fileDesc != gReuseFrom || gReuseSeen != 3)) {
+      gReuseSeen |= lockData->fileDesc == gReuseFrom ? 1 : 2;
+      sent = FALSE;
+   } else {
+      reuseFd = gReuseFd;
+      gReuseFd = -1;
+      gBreakTo = lockData->serverLock;
+      gNumBreaks++;
+   }
+   pthread_mutex_unlock(&gTestLock);
+
+   if (reuseFd != -1) {
+      HgfsLockType lock = HGFS_LOCK_EXCLUSIVE;
+      int fd;
+
+      /* The client closes the file, and opens another one in its place. */
+      HgfsReleaseServerLock(reuseFd);
+      fd = open(gSparePath, O_RDONLY);
+      dup2(fd, reuseFd);
+      close(fd);
+      fd = HgfsAcquireServerLock(reuseFd, &gSession, &lock);
+
+      pthread_mutex_lock(&gTestLock);
+      gReuseGranted = fd;
+      pthread_mutex_unlock(&gTestLock);
+   }
+
+   for (;;) {
+      Bool hold;
+
+      pthread_mutex_lock(&gTestLock);
+      hold = sent && gHoldSends;
+      pthread_mutex_unlock(&gTestLock);
+
+      if (!hold) {
+         break;
+      }
+      usleep(1000);
+   }
+
+   return sent;
+}
+
+
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * HgfsUpdateNodeServerLock --
+ *
+ *      Stands in for the server updating the lock of its file node.
+ *
+ * Results:
+ *      TRUE.
+ *
+ * Side effects:
+ *      Records the lock.
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+Bool
+HgfsUpdateNodeServerLock(fileDesc fd,                // IN: OS handle
+                         HgfsSessionInfo *session,   // IN: session info
+                         HgfsLockType serverLock)    // IN: new oplock
+{
+   pthread_mutex_lock(&gTestLock);
+   gNodeLock = serverLock;
+   pthread_mutex_unlock(&gTestLock);
+
+   return TRUE;
+}
+
+
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * HgfsServerSessionGet --
+ * HgfsServerSessionPut --
+ *
+ *      Session reference counting, checked at the end of the test.
+ *
+ * Results:
+ *      None.
+ *
+ * Side effects:
+ *      None.
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+void
+HgfsServerSessionGet(HgfsSessionInfo *session)   // IN: session context
+{
+   pthread_mutex_lock(&gTestLock);
+   gSessionRefs++;
+   pthread_mutex_unlock(&gTestLock);
+}
+
+void
+HgfsServerSessionPut(HgfsSessionInfo *session)   // IN: session context
+{
+   pthread_mutex_lock(&gTestLock);
+   gSessionRefs--;
+   pthread_mutex_unlock(&gTestLock);
+}
+
+
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * HgfsIsServerLockAllowed --
+ *
+ *      The test session never has more files open than the server allows
+ *      oplocks for.
+ *
+ * Results:
+ *      TRUE.
+ *
+ * Side effects:
+ *      None.
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+Bool
+HgfsIsServerLockAllowed(HgfsSessionInfo *session)   // IN: session info
+{
+   return TRUE;
+}
+
+
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * TestNowUS --
+ *
+ *      Returns the current time in microseconds.
+ *
+ * Results:
+ *      The time.
+ *
+ * Side effects:
+ *      None.
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+static uint64
+TestNowUS(void)
+{
+   struct timeval tv;
+
+   gettimeofday(&tv, NULL);
+   return (uint64)tv.tv_sec * 1000000 + tv.tv_usec;
+}
+
+
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * TestCheck --
+ *
+ *      Reports a failed check.
+ *
+ * Results:
+ *      The check's value.
+ *
+ * Side effects:
+ *      Counts the failure.
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+static Bool
+TestCheck(Bool ok,            // IN: check result
+          const char *what,   // IN: check text
+          int line)           // IN: source line
+{
+   if (!ok) {
+      fprintf(stderr, "line %d: check failed: %s\n", line, what);
+      gFailures++;
+   }
+   return ok;
+}
+
+#define TEST_CHECK(cond) TestCheck((cond), #cond, __LINE__)
+
+
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * TestOpenInChild --
+ *
+ *      Opens the test file from a child process. The open blocks until the
+ *      lease held on the file is downgraded or released.
+ *
+ * Results:
+ *      The child's pid, -1 on error.
+ *
+ * Side effects:
+ *      Forks.
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+static pid_t
+TestOpenInChild(const char *path,   // IN: file to open
+                int flags)          // IN: open flags
+{
+   pid_t pid = fork();
+
+   if (pid == 0) {
+      int fd;
+
+      /*
+       * Do not hold on to the leased files: a lease goes away only when its
+       * file is closed everywhere, and the tests close files to reuse their
+       * descriptors.
+       */
+      for (fd = STDERR_FILENO + 1; fd < TEST_MAX_FD; fd++) {
+         close(fd);
+      }
+      _exit(open(path, flags) >= 0 ? EXIT_SUCCESS : EXIT_FAILURE);
+   }
+   if (pid == -1) {
+      fprintf(stderr, "Cannot fork: %s\n", strerror(errno));
+   }
+   return pid;
+}
+
+
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * TestWaitChild --
+ *
+ *      Waits for a child started by TestOpenInChild.
+ *
+ * Results:
+ *      TRUE if the child's open succeeded.
+ *
+ * Side effects:
+ *      None.
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+static Bool
+TestWaitChild(pid_t pid)   // IN: child
+{
+   int status;
+
+   return pid != -1 &&
+          waitpid(pid, &status, 0) == pid &&
+          WIFEXITED(status) && WEXITSTATUS(status) == EXIT_SUCCESS;
+}
+
+
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * TestWaitBreak --
+ *
+ *      Waits for the server to send a break.
+ *
+ * Results:
+ *      TRUE if numBreaks breaks were sent within waitMS; the last one's lock
+ *      is in breakTo.
+ *
+ * Side effects:
+ *      None.
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+static Bool
+TestWaitBreak(unsigned int numBreaks,   // IN: breaks expected so far
+              unsigned int waitMS,      // IN: how long to wait
+              HgfsLockType *breakTo)    // OUT: lock left after the break
+{
+   uint64 deadline = TestNowUS() + waitMS * 1000;
+
+   for (;;) {
+      Bool sent;
+
+      pthread_mutex_lock(&gTestLock);
+      sent = gNumBreaks >= numBreaks;
+      *breakTo = gBreakTo;
+      pthread_mutex_unlock(&gTestLock);
+
+      if (sent) {
+         return TRUE;
+      }
+      if (TestNowUS() >= deadline) {
+         return FALSE;
+      }
+      usleep(1000);
+   }
+}
+
+
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * TestAck --
+ *
+ *      Acknowledges a break, or gives up a lock, as the client would.
+ *
+ * Results:
+ *      None.
+ *
+ * Side effects:
+ *      None.
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+static void
+TestAck(int fd,                   // IN: leased file
+        HgfsLockType replyLock)   // IN: lock the client keeps
+{
+   ServerLockData lockData;
+
+   lockData.fileDesc = fd;
+   lockData.event = 0;
+   lockData.serverLock = HGFS_LOCK_NONE;
+   lockData.session = &gSession;
+   HgfsAckOplockBreak(&lockData, replyLock);
+}
+
+
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * TestNodeLock --
+ *
+ *      Returns the last lock the server set on the file node.
+ *
+ * Results:
+ *      The lock.
+ *
+ * Side effects:
+ *      None.
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+static HgfsLockType
+TestNodeLock(void)
+{
+   HgfsLockType lock;
+
+   pthread_mutex_lock(&gTestLock);
+   lock = gNodeLock;
+   pthread_mutex_unlock(&gTestLock);
+   return lock;
+}
+
+
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * TestNumBreaks --
+ *
+ *      Returns the number of breaks sent so far.
+ *
+ * Results:
+ *      The number of breaks.
+ *
+ * Side effects:
+ *      None.
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+static unsigned int
+TestNumBreaks(void)
+{
+   unsigned int numBreaks;
+
+   pthread_mutex_lock(&gTestLock);
+   numBreaks = gNumBreaks;
+   pthread_mutex_unlock(&gTestLock);
+   return numBreaks;
+}
+
+
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * TestGrantAndBreak --
+ *
+ *      Checks lease grants, breaks to read and to none, a break whose
+ *      sending has to be retried, and voluntary release.
+ *
+ * Results:
+ *      None.
+ *
+ * Side effects:
+ *      Counts failed checks.
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+static void
+TestGrantAndBreak(void)
+{
+   HgfsLockType lock;
+   HgfsLockType breakTo;
+   pid_t pid;
+   int fd;
+
+   /* Opportunistic gets a write lease; a reader breaks it to read. */
+   fd = open(gPath, O_RDONLY);
+   lock = HGFS_LOCK_OPPORTUNISTIC;
+   TEST_CHECK(HgfsAcquireServerLock(fd, &gSession, &lock));
+   TEST_CHECK(lock == HGFS_LOCK_EXCLUSIVE);
+   TEST_CHECK(fcntl(fd, F_GETLEASE) == F_WRLCK);
+
+   pid = TestOpenInChild(gPath, O_RDONLY);
+   if (TEST_CHECK(TestWaitBreak(1, TEST_BREAK_WAIT, &breakTo))) {
+      TEST_CHECK(breakTo == HGFS_LOCK_SHARED);
+      TestAck(fd, HGFS_LOCK_SHARED);
+   }
+   TEST_CHECK(TestWaitChild(pid));
+   TEST_CHECK(TestNodeLock() == HGFS_LOCK_SHARED);
+   TEST_CHECK(fcntl(fd, F_GETLEASE) == F_RDLCK);
+
+   /* A writer breaks the read lease; the first sends fail and are retried. */
+   pthread_mutex_lock(&gTestLock);
+   gFailSends = 3;
+   pthread_mutex_unlock(&gTestLock);
+
+   pid = TestOpenInChild(gPath, O_WRONLY);
+   if (TEST_CHECK(TestWaitBreak(2, TEST_BREAK_WAIT, &breakTo))) {
+      TEST_CHECK(breakTo == HGFS_LOCK_NONE);
+      TestAck(fd, HGFS_LOCK_SHARED);
+   }
+   TEST_CHECK(TestWaitChild(pid));
+   TEST_CHECK(TestNodeLock() == HGFS_LOCK_NONE);
+   TEST_CHECK(fcntl(fd, F_GETLEASE) == F_UNLCK);
+   close(fd);
+
+   /* No lease while the file is open for writing, not even a read lease. */
+   {
+      int writer = open(gPath, O_WRONLY);
+
+      fd = open(gPath, O_RDONLY);
+      lock = HGFS_LOCK_SHARED;
+      TEST_CHECK(!HgfsAcquireServerLock(fd, &gSession, &lock));
+      TEST_CHECK(lock == HGFS_LOCK_NONE);
+      lock = HGFS_LOCK_OPPORTUNISTIC;
+      TEST_CHECK(!HgfsAcquireServerLock(fd, &gSession, &lock));
+      TEST_CHECK(lock == HGFS_LOCK_NONE);
+      TEST_CHECK(fcntl(fd, F_GETLEASE) == F_UNLCK);
+      close(fd);
+      close(writer);
+   }
+
+   /* A session without oplocks gets none. */
+   fd = open(gPath, O_RDONLY);
+   gSession.flags &= ~HGFS_SESSION_OPLOCK_ENABLED;
+   lock = HGFS_LOCK_SHARED;
+   TEST_CHECK(!HgfsAcquireServerLock(fd, &gSession, &lock));
+   TEST_CHECK(lock == HGFS_LOCK_NONE);
+   gSession.flags |= HGFS_SESSION_OPLOCK_ENABLED;
+
+   /* Shared gets a read lease, which the client can give up. */
+   lock = HGFS_LOCK_SHARED;
+   TEST_CHECK(HgfsAcquireServerLock(fd, &gSession, &lock));
+   TEST_CHECK(lock == HGFS_LOCK_SHARED);
+   TEST_CHECK(fcntl(fd, F_GETLEASE) == F_RDLCK);
+   TestAck(fd, HGFS_LOCK_NONE);
+   TEST_CHECK(TestNodeLock() == HGFS_LOCK_NONE);
+   TEST_CHECK(fcntl(fd, F_GETLEASE) == F_UNLCK);
+   close(fd);
+
+   /* A lease released with its file does not break anymore. */
+   fd = open(gPath, O_RDONLY);
+   lock = HGFS_LOCK_EXCLUSIVE;
+   TEST_CHECK(HgfsAcquireServerLock(fd, &gSession, &lock));
+   HgfsReleaseServerLock(fd);
+   close(fd);
+   pid = TestOpenInChild(gPath, O_WRONLY);
+   TEST_CHECK(TestWaitChild(pid));
+   TEST_CHECK(TestNumBreaks() == 2);
+}
+
+
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * TestStaleSignal --
+ *
+ *      Checks that a break signal left queued for a file descriptor that was
+ *      closed and reused for a lease which is not being broken does not
+ *      start a break. The break thread is held up sending one break while
+ *      a second file's lease breaks and its descriptor is reused.
+ *
+ * Results:
+ *      None.
+ *
+ * Side effects:
+ *      Counts failed checks.
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+static void
+TestStaleSignal(void)
+{
+   HgfsLockType lock;
+   HgfsLockType breakTo;
+   unsigned int numBreaks = TestNumBreaks();
+   uint64 deadline;
+   pid_t pid;
+   pid_t otherPid;
+   int fd = open(gPath, O_RDONLY);
+   int otherFd = open(gOtherPath, O_RDONLY);
+   int spareFd;
+
+   lock = HGFS_LOCK_EXCLUSIVE;
+   TEST_CHECK(HgfsAcquireServerLock(fd, &gSession, &lock));
+   lock = HGFS_LOCK_EXCLUSIVE;
+   TEST_CHECK(HgfsAcquireServerLock(otherFd, &gSession, &lock));
+
+   pthread_mutex_lock(&gTestLock);
+   gHoldSends = TRUE;
+   pthread_mutex_unlock(&gTestLock);
+
+   pid = TestOpenInChild(gPath, O_WRONLY);
+   if (TEST_CHECK(TestWaitBreak(numBreaks + 1, TEST_BREAK_WAIT, &breakTo))) {
+      TEST_CHECK(breakTo == HGFS_LOCK_NONE);
+   }
+
+   /*
+    * The break thread is now held up. Break the second lease, which queues
+    * its signal, then close the file and lease another one on its
+    * descriptor before the signal is handled.
+    */
+   otherPid = TestOpenInChild(gOtherPath, O_WRONLY);
+   deadline = TestNowUS() + TEST_BREAK_WAIT * 1000;
+   while (fcntl(otherFd, F_GETLEASE) == F_WRLCK && TestNowUS() < deadline) {
+      usleep(1000);
+   }
+   TEST_CHECK(fcntl(otherFd, F_GETLEASE) == F_UNLCK);
+
+   HgfsReleaseServerLock(otherFd);
+   spareFd = open(gSparePath, O_RDONLY);
+   dup2(spareFd, otherFd);
+   close(spareFd);
+   lock = HGFS_LOCK_EXCLUSIVE;
+   TEST_CHECK(HgfsAcquireServerLock(otherFd, &gSession, &lock));
+
+   pthread_mutex_lock(&gTestLock);
+   gHoldSends = FALSE;
+   pthread_mutex_unlock(&gTestLock);
+
+   TEST_CHECK(!TestWaitBreak(numBreaks + 2, TEST_NO_BREAK_WAIT, &breakTo));
+   TEST_CHECK(fcntl(otherFd, F_GETLEASE) == F_WRLCK);
+   TEST_CHECK(TestWaitChild(otherPid));
+
+   TestAck(fd, HGFS_LOCK_NONE);
+   TEST_CHECK(TestWaitChild(pid));
+
+   HgfsReleaseServerLock(otherFd);
+   close(otherFd);
+   HgfsReleaseServerLock(fd);
+   close(fd);
+}
+
+
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * TestReuseWhileSending --
+ *
+ *      Checks that a break the break thread collected is not sent once its
+ *      file descriptor was closed and reused for a new lease. Breaks are
+ *      pending on two files; sending the first one's break closes the
+ *      second file and leases another file on the same descriptor, see
+ *      HgfsServerOplockBreak above.
+ *
+ * Results:
+ *      None.
+ *
+ * Side effects:
+ *      Counts failed checks.
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+static void
+TestReuseWhileSending(void)
+{
+   HgfsLockType lock;
+   HgfsLockType breakTo;
+   unsigned int numBreaks = TestNumBreaks();
+   pid_t pid;
+   pid_t otherPid;
+   int fd = open(gPath, O_RDONLY);
+   int otherFd = open(gOtherPath, O_RDONLY);
+   Bool granted;
+
+   lock = HGFS_LOCK_EXCLUSIVE;
+   TEST_CHECK(HgfsAcquireServerLock(fd, &gSession, &lock));
+   lock = HGFS_LOCK_EXCLUSIVE;
+   TEST_CHECK(HgfsAcquireServerLock(otherFd, &gSession, &lock));
+
+   pthread_mutex_lock(&gTestLock);
+   gReuseFrom = fd;
+   gReuseFd = otherFd;
+   gReuseSeen = 0;
+   gReuseGranted = FALSE;
+   pthread_mutex_unlock(&gTestLock);
+
+   pid = TestOpenInChild(gPath, O_WRONLY);
+   otherPid = TestOpenInChild(gOtherPath, O_WRONLY);
+
+   if (TEST_CHECK(TestWaitBreak(numBreaks + 1, TEST_BREAK_WAIT, &breakTo))) {
+      TEST_CHECK(breakTo == HGFS_LOCK_NONE);
+   }
+   TEST_CHECK(!TestWaitBreak(numBreaks + 2, TEST_NO_BREAK_WAIT, &breakTo));
+
+   pthread_mutex_lock(&gTestLock);
+   granted = gReuseGranted;
+   gReuseFd = -1;
+   pthread_mutex_unlock(&gTestLock);
+
+   TEST_CHECK(granted);
+   TEST_CHECK(fcntl(otherFd, F_GETLEASE) == F_WRLCK);
+   TEST_CHECK(TestWaitChild(otherPid));
+
+   TestAck(fd, HGFS_LOCK_NONE);
+   TEST_CHECK(TestWaitChild(pid));
+
+   HgfsReleaseServerLock(otherFd);
+   close(otherFd);
+   HgfsReleaseServerLock(fd);
+   close(fd);
+}
+
+
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * TestTimeBreaks --
+ *
+ *      Times grant, break and acknowledgement round trips.
+ *
+ * Results:
+ *      None.
+ *
+ * Side effects:
+ *      Counts failed checks.
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+static void
+TestTimeBreaks(unsigned int iterations)   // IN: round trips
+{
+   uint64 total = 0;
+   uint64 slowest = 0;
+   unsigned int done = 0;
+   unsigned int i;
+
+   for (i = 0; i < iterations; i++) {
+      HgfsLockType lock = HGFS_LOCK_EXCLUSIVE;
+      HgfsLockType breakTo;
+      Bool ok;
+      uint64 start;
+      uint64 elapsed;
+      pid_t pid;
+      int fd = open(gPath, O_RDONLY);
+
+      if (!TEST_CHECK(HgfsAcquireServerLock(fd, &gSession, &lock))) {
+         close(fd);
+         break;
+      }
+
+      start = TestNowUS();
+      pid = TestOpenInChild(gPath, O_WRONLY);
+      ok = TestWaitBreak(TestNumBreaks() + 1, TEST_BREAK_WAIT, &breakTo);
+      TestAck(fd, HGFS_LOCK_NONE);
+      ok = TestWaitChild(pid) && ok;
+      elapsed = TestNowUS() - start;
+
+      HgfsReleaseServerLock(fd);
+      close(fd);
+
+      if (!TEST_CHECK(ok)) {
+         break;
+      }
+      total += elapsed;
+      slowest = MAX(slowest, elapsed);
+      done++;
+   }
+
+   if (done > 0) {
+      printf("%u grant/break/ack round trips: average %.3f ms, "
+             "slowest %.3f ms\n", done, total / 1000.0 / done,
+             slowest / 1000.0);
+   }
+}
+
+
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * TestUsage --
+ *
+ *      Prints the usage.
+ *
+ * Results:
+ *      None.
+ *
+ * Side effects:
+ *      None.
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+static void
+TestUsage(const char *name)   // IN: program name
+{
+   fprintf(stderr,
+           "Usage: %s [options]\n"
+           "  -d dir     directory for the test file; it must support leases\n"
+           "             (default: a new temporary directory)\n"
+           "  -n count   timed round trips (default: 100)\n",
+           name);
+}
+
+
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * main --
+ *
+ *      Main entry point.
+ *
+ * Results:
+ *      EXIT_SUCCESS if every check passed.
+ *
+ * Side effects:
+ *      None.
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+int
+main(int argc,          // IN
+     char *argv[])      // IN
+{
+   const char *paths[] = { gPath, gOtherPath, gSparePath };
+   unsigned int iterations = 100;
+   Bool removeDir = FALSE;
+   unsigned int i;
+   int fd;
+   int opt;
+
+   while ((opt = getopt(argc, argv, "d:n:")) != -1) {
+      switch (opt) {
+      case 'd':
+         Str_Strcpy(gDir, optarg, sizeof gDir);
+         break;
+      case 'n':
+         iterations = strtoul(optarg, NULL, 10);
+         break;
+      default:
+         TestUsage(argv[0]);
+         return EXIT_FAILURE;
+      }
+   }
+
+   if (gDir[0] == '\0') {
+      Str_Strcpy(gDir, "/tmp/hgfsLeaseTest.XXXXXX", sizeof gDir);
+      if (mkdtemp(gDir) == NULL) {
+         fprintf(stderr, "Cannot create a directory: %s\n", strerror(errno));
+         return EXIT_FAILURE;
+      }
+      removeDir = TRUE;
+   }
+
+   Str_Sprintf(gPath, sizeof gPath, "%s/leased", gDir);
+   Str_Sprintf(gOtherPath, sizeof gOtherPath, "%s/other", gDir);
+   Str_Sprintf(gSparePath, sizeof gSparePath, "%s/spare", gDir);
+   for (i = 0; i < ARRAYSIZE(paths); i++) {
+      fd = open(paths[i], O_CREAT | O_TRUNC | O_RDWR, 0644);
+      if (fd < 0) {
+         fprintf(stderr, "Cannot create %s: %s\n", paths[i], strerror(errno));
+         return EXIT_FAILURE;
+      }
+      close(fd);
+   }
+
+   gSession.state = HGFS_SESSION_STATE_OPEN;
+   gSession.flags = HGFS_SESSION_OPLOCK_ENABLED;
+
+   if (!HgfsPlatformOplockInit()) {
+      fprintf(stderr, "Cannot start the lease break thread\n");
+      return EXIT_FAILURE;
+   }
+
+   TestGrantAndBreak();
+   TestStaleSignal();
+   TestReuseWhileSending();
+   if (gFailures == 0) {
+      TestTimeBreaks(iterations);
+   }
+
+   HgfsPlatformOplockDestroy();
+   TEST_CHECK(gSessionRefs == 0);
+
+   for (i = 0; i < ARRAYSIZE(paths); i++) {
+      unlink(paths[i]);
+   }
+   if (removeDir) {
+      rmdir(gDir);
+   }
+
+   printf("%u checks failed\n", gFailures);
+   return gFailures == 0 ? EXIT_SUCCESS : EXIT_FAILURE;
+}
@@ -0,0 +1,1037 @@
+/*********************************************************
+ * Copyright (C) 2016 VMware, Inc. All rights reserved.
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU Lesser General Public License as published
+ * by the Free Software Foundation version 2.1 and no later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+ * or FITNESS FOR A PARTICULAR PURPOSE.  See the Lesser GNU General Public
+ * License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin St, Fifth Floor, Boston, MA  02110-1301 USA.
+ *
+ *********************************************************/
+
+/*
+ * hgfsServerBench.c --
+ *
+ *      Loopback load generator for the HGFS server in lib/hgfsServer.
+ *
+ *      The server is registered in-process through the guest server manager,
+ *      the same way the vix plugin uses it, and requests are handed to it
+ *      with HgfsServerManager_ProcessPacket, so no VM or host is needed.
+ *      A mix of open, read, write, getattr, search and rename requests is
+ *      replayed against files in a local directory, which is reached
+ *      through the guest policy's root share. The per-opcode latency
+ *      histograms and throughput are the ones the server collects itself,
+ *      see HgfsServer_EnableStats.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <limits.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include <sys/time.h>
+
+#include "vmware.h"
+#include "str.h"
+#include "hgfs.h"
+#include "hgfsProto.h"
+#include "hgfsServer.h"
+#include "hgfsServerManager.h"
+#include "cpNameUtil.h"
+
+#define BENCH_MAX_FILES        4096
+
+typedef enum {
+   BENCH_OPEN,
+   BENCH_READ,
+   BENCH_WRITE,
+   BENCH_GETATTR,
+   BENCH_SEARCH,
+   BENCH_RENAME,
+   BENCH_NUM_OPS,
+} BenchOp;
+
+static const char *benchOpNames[BENCH_NUM_OPS] = {
+   "open", "read", "write", "getattr", "search", "rename",
+};
+
+/* Relative weights of the operations in the mix. */
+static unsigned int benchMix[BENCH_NUM_OPS] = { 1, 4, 2, 4, 1, 1 };
+
+static HgfsServerMgrData gMgr;
+static Bool gRegistered;
+static char gRequest[HGFS_LARGE_PACKET_MAX];
+static char gReply[HGFS_LARGE_PACKET_MAX];
+static char gIoBuffer[HGFS_LARGE_PACKET_MAX];
+static uint32 gRequestId;
+
+static char gDir[PATH_MAX];
+static Bool gRemoveDir;
+static unsigned int gNumFiles = 64;
+static unsigned int gNumHandles = 16;
+static size_t gFileSize = 1024 * 1024;
+static size_t gIoSize = 4096;
+static HgfsHandle gHandles[BENCH_MAX_FILES];
+
+
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * BenchNowUS --
+ *
+ *      Returns the current time in microseconds.
+ *
+ * Results:
+ *      The time.
+ *
+ * Side effects:
+ *      None.
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+static uint64
+BenchNowUS(void)
+{
+   struct timeval tv;
+
+   gettimeofday(&tv, NULL);
+   return (uint64)tv.tv_sec * 1000000 + tv.tv_usec;
+}
+
+
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * BenchFilePath --
+ *
+ *      Builds the path of a file in the share directory.
+ *
+ * Results:
+ *      None.
+ *
+ * Side effects:
+ *      None.
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+static void
+BenchFilePath(unsigned int index,   // IN: file number
+              const char *suffix,   // IN: name suffix
+              char *path,           // OUT: path
+              size_t pathSize)      // IN: size of path
+{
+   snprintf(path, pathSize, "%s/file%04u%s", gDir, index, suffix);
+}
+
+
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * BenchPackName --
+ *
+ *      Packs an absolute local path as a name in the guest policy's root share.
+ *
+ * Results:
+ *      Size of the name beyond sizeof *name, or -1 if it does not fit.
+ *
+ * Side effects:
+ *      None.
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+static int
+BenchPackName(const char *path,        // IN: absolute path
+              HgfsFileNameV3 *name,    // OUT: packed name
+              size_t space)            // IN: space left for the name
+{
+   int len;
+
+   len = CPNameUtil_ConvertToRoot(path, space, name->name);
+   if (len < 0) {
+      return -1;
+   }
+   name->length = len;
+   name->flags = 0;
+   name->caseType = HGFS_FILE_NAME_DEFAULT_CASE;
+   name->fid = HGFS_INVALID_HANDLE;
+
+   return len;
+}
+
+
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * BenchSend --
+ *
+ *      Sends the request in gRequest to the server and waits for the reply.
+ *
+ * Results:
+ *      The reply status, HGFS_STATUS_PROTOCOL_ERROR if there was no reply.
+ *
+ * Side effects:
+ *      The reply is in gReply.
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+static HgfsStatus
+BenchSend(HgfsOp op,               // IN: request operation
+          size_t requestSize)      // IN: size of the request, with header
+{
+   HgfsRequest *header = (HgfsRequest *)gRequest;
+   size_t replySize = sizeof gReply;
+
+   header->id = gRequestId++;
+   header->op = op;
+
+   if (!HgfsServerManager_ProcessPacket(&gMgr, gRequest, requestSize,
+                                        gReply, &replySize) ||
+       replySize < sizeof (HgfsReply)) {
+      return HGFS_STATUS_PROTOCOL_ERROR;
+   }
+
+   return ((HgfsReply *)gReply)->status;
+}
+
+
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * BenchOpen --
+ *
+ *      Opens a file.
+ *
+ * Results:
+ *      The reply status. The handle on success.
+ *
+ * Side effects:
+ *      None.
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+static HgfsStatus
+BenchOpen(const char *path,        // IN: file to open
+          HgfsOpenMode mode,       // IN: access mode
+          HgfsHandle *handle)      // OUT: file handle
+{
+   HgfsRequestOpenV3 *request = (HgfsRequestOpenV3 *)(gRequest + sizeof (HgfsRequest));
+   size_t size = sizeof (HgfsRequest) + sizeof *request;
+   HgfsStatus status;
+   int len;
+
+   memset(request, 0, sizeof *request);
+   request->mask = HGFS_OPEN_VALID_MODE | HGFS_OPEN_VALID_FLAGS |
+                   HGFS_OPEN_VALID_FILE_NAME;
+   request->mode = mode;
+   request->flags = HGFS_OPEN;
+   len = BenchPackName(path, &request->fileName, sizeof gRequest - size);
+   if (len < 0) {
+      return HGFS_STATUS_NAME_TOO_LONG;
+   }
+
+   status = BenchSend(HGFS_OP_OPEN_V3, size + len);
+   if (status == HGFS_STATUS_SUCCESS) {
+      *handle = ((HgfsReplyOpenV3 *)(gReply + sizeof (HgfsReply)))->file;
+   }
+   return status;
+}
+
+
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * BenchClose --
+ *
+ *      Closes a file.
+ *
+ * Results:
+ *      The reply status.
+ *
+ * Side effects:
+ *      None.
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+static HgfsStatus
+BenchClose(HgfsHandle handle)      // IN: file handle
+{
+   HgfsRequestCloseV3 *request = (HgfsRequestCloseV3 *)(gRequest + sizeof (HgfsRequest));
+
+   memset(request, 0, sizeof *request);
+   request->file = handle;
+
+   return BenchSend(HGFS_OP_CLOSE_V3, sizeof (HgfsRequest) + sizeof *request);
+}
+
+
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * BenchRead --
+ *
+ *      Reads gIoSize bytes from a file.
+ *
+ * Results:
+ *      The reply status.
+ *
+ * Side effects:
+ *      None.
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+static HgfsStatus
+BenchRead(HgfsHandle handle,       // IN: file handle
+          uint64 offset)           // IN: file offset
+{
+   HgfsRequestReadV3 *request = (HgfsRequestReadV3 *)(gRequest + sizeof (HgfsRequest));
+
+   memset(request, 0, sizeof *request);
+   request->file = handle;
+   request->offset = offset;
+   request->requiredSize = gIoSize;
+
+   return BenchSend(HGFS_OP_READ_V3, sizeof (HgfsRequest) + sizeof *request);
+}
+
+
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * BenchWrite --
+ *
+ *      Writes gIoSize bytes to a file.
+ *
+ * Results:
+ *      The reply status.
+ *
+ * Side effects:
+ *      None.
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+static HgfsStatus
+BenchWrite(HgfsHandle handle,      // IN: file handle
+           uint64 offset)          // IN: file offset
+{
+   HgfsRequestWriteV3 *request = (HgfsRequestWriteV3 *)(gRequest + sizeof (HgfsRequest));
+
+   memset(request, 0, sizeof *request);
+   request->file = handle;
+   request->offset = offset;
+   request->requiredSize = gIoSize;
+   memcpy(request->payload, gIoBuffer, gIoSize);
+
+   return BenchSend(HGFS_OP_WRITE_V3,
+                    sizeof (HgfsRequest) + sizeof *request - 1 + gIoSize);
+}
+
+
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * BenchGetattr --
+ *
+ *      Gets the attributes of a file by name.
+ *
+ * Results:
+ *      The reply status.
+ *
+ * Side effects:
+ *      None.
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+static HgfsStatus
+BenchGetattr(const char *path)     // IN: file
+{
+   HgfsRequestGetattrV3 *request = (HgfsRequestGetattrV3 *)(gRequest + sizeof (HgfsRequest));
+   size_t size = sizeof (HgfsRequest) + sizeof *request;
+   int len;
+
+   memset(request, 0, sizeof *request);
+   len = BenchPackName(path, &request->fileName, sizeof gRequest - size);
+   if (len < 0) {
+      return HGFS_STATUS_NAME_TOO_LONG;
+   }
+
+   return BenchSend(HGFS_OP_GETATTR_V3, size + len);
+}
+
+
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * BenchSearch --
+ *
+ *      Lists a directory: opens a search, reads every entry, one per request,
+ *      and closes the search.
+ *
+ * Results:
+ *      The status of the first failing request, or HGFS_STATUS_SUCCESS.
+ *
+ * Side effects:
+ *      None.
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+static HgfsStatus
+BenchSearch(const char *path)      // IN: directory
+{
+   HgfsRequestSearchOpenV3 *openRequest =
+      (HgfsRequestSearchOpenV3 *)(gRequest + sizeof (HgfsRequest));
+   HgfsRequestSearchReadV3 *readRequest =
+      (HgfsRequestSearchReadV3 *)(gRequest + sizeof (HgfsRequest));
+   HgfsRequestSearchCloseV3 *closeRequest =
+      (HgfsRequestSearchCloseV3 *)(gRequest + sizeof (HgfsRequest));
+   size_t size = sizeof (HgfsRequest) + sizeof *openRequest;
+   HgfsHandle search;
+   HgfsStatus status;
+   uint32 offset;
+   int len;
+
+   memset(openRequest, 0, sizeof *openRequest);
+   len = BenchPackName(path, &openRequest->dirName, sizeof gRequest - size);
+   if (len < 0) {
+      return HGFS_STATUS_NAME_TOO_LONG;
+   }
+   status = BenchSend(HGFS_OP_SEARCH_OPEN_V3, size + len);
+   if (status != HGFS_STATUS_SUCCESS) {
+      return status;
+   }
+   search = ((HgfsReplySearchOpenV3 *)(gReply + sizeof (HgfsReply)))->search;
+
+   for (offset = 0; ; offset++) {
+      HgfsReplySearchReadV3 *reply =
+         (HgfsReplySearchReadV3 *)(gReply + sizeof (HgfsReply));
+
+      memset(readRequest, 0, sizeof *readRequest);
+      readRequest->search = search;
+      readRequest->offset = offset;
+      status = BenchSend(HGFS_OP_SEARCH_READ_V3,
+                         sizeof (HgfsRequest) + sizeof *readRequest);
+
+      /* The end of the directory is an entry with an empty name. */
+      if (status != HGFS_STATUS_SUCCESS || reply->count == 0 ||
+          ((HgfsDirEntry *)reply->payload)->fileName.length == 0) {
+         break;
+      }
+   }
+
+   memset(closeRequest, 0, sizeof *closeRequest);
+   closeRequest->search = search;
+   if (status == HGFS_STATUS_SUCCESS) {
+      status = BenchSend(HGFS_OP_SEARCH_CLOSE_V3,
+                         sizeof (HgfsRequest) + sizeof *closeRequest);
+   } else {
+      BenchSend(HGFS_OP_SEARCH_CLOSE_V3,
+                sizeof (HgfsRequest) + sizeof *closeRequest);
+   }
+   return status;
+}
+
+
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * BenchRename --
+ *
+ *      Renames a file.
+ *
+ * Results:
+ *      The reply status.
+ *
+ * Side effects:
+ *      None.
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+static HgfsStatus
+BenchRename(const char *from,      // IN: old name
+            const char *to)        // IN: new name
+{
+   HgfsRequestRenameV3 *request = (HgfsRequestRenameV3 *)(gRequest + sizeof (HgfsRequest));
+   size_t size = sizeof (HgfsRequest) + sizeof *request;
+   HgfsFileNameV3 *newName;
+   int oldLen;
+   int newLen;
+
+   memset(request, 0, sizeof *request);
+   oldLen = BenchPackName(from, &request->oldName, sizeof gRequest - size);
+   if (oldLen < 0) {
+      return HGFS_STATUS_NAME_TOO_LONG;
+   }
+
+   /* The new name follows the variable length old name. */
+   newName = (HgfsFileNameV3 *)(request->oldName.name + oldLen + 1);
+   newLen = BenchPackName(to, newName, sizeof gRequest - size - oldLen);
+   if (newLen < 0) {
+      return HGFS_STATUS_NAME_TOO_LONG;
+   }
+
+   return BenchSend(HGFS_OP_RENAME_V3, size + oldLen + newLen);
+}
+
+
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * BenchSetup --
+ *
+ *      Creates the files in the share directory, registers the server and
+ *      opens the handles the read and write requests use.
+ *
+ * Results:
+ *      TRUE on success, FALSE otherwise.
+ *
+ * Side effects:
+ *      Statistics collection is enabled in the server.
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+static Bool
+BenchSetup(void)
+{
+   char path[PATH_MAX];
+   unsigned int i;
+
+   if (gDir[0] == '\0') {
+      Str_Strcpy(gDir, "/tmp/hgfsServerBench.XXXXXX", sizeof gDir);
+      if (mkdtemp(gDir) == NULL) {
+         fprintf(stderr, "Cannot create a directory: %s\n", strerror(errno));
+         return FALSE;
+      }
+      gRemoveDir = TRUE;
+   }
+
+   memset(gIoBuffer, 'h', sizeof gIoBuffer);
+   for (i = 0; i < gNumFiles; i++) {
+      size_t done;
+      int fd;
+
+      BenchFilePath(i, "", path, sizeof path);
+      fd = open(path, O_CREAT | O_TRUNC | O_WRONLY, 0644);
+      if (fd < 0) {
+         fprintf(stderr, "Cannot create %s: %s\n", path, strerror(errno));
+         return FALSE;
+      }
+      for (done = 0; done < gFileSize; done += gIoSize) {
+         if (write(fd, gIoBuffer, MIN(gIoSize, gFileSize - done)) < 0) {
+            fprintf(stderr, "Cannot write %s: %s\n", path, strerror(errno));
+            close(fd);
+            return FALSE;
+         }
+      }
+      close(fd);
+   }
+
+   HgfsServerManager_DataInit(&gMgr, "hgfsServerBench", NULL, NULL);
+   if (!HgfsServerManager_Register(&gMgr)) {
+      fprintf(stderr, "Cannot register the HGFS server\n");
+      return FALSE;
+   }
+   gRegistered = TRUE;
+
+   for (i = 0; i < gNumHandles; i++) {
+      HgfsStatus status;
+
+      BenchFilePath(i, "", path, sizeof path);
+      status = BenchOpen(path, HGFS_OPEN_MODE_READ_WRITE, &gHandles[i]);
+      if (status != HGFS_STATUS_SUCCESS) {
+         fprintf(stderr, "Cannot open %s: status %d\n", path, status);
+         return FALSE;
+      }
+   }
+
+   /* Only account for the requests of the run itself. */
+   HgfsServer_EnableStats(TRUE);
+
+   return TRUE;
+}
+
+
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * BenchCleanup --
+ *
+ *      Closes the handles, unregisters the server and removes the files if
+ *      the directory was created by us.
+ *
+ * Results:
+ *      None.
+ *
+ * Side effects:
+ *      None.
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+static void
+BenchCleanup(void)
+{
+   char path[PATH_MAX];
+   unsigned int i;
+
+   if (gRegistered) {
+      HgfsServer_EnableStats(FALSE);
+      for (i = 0; i < gNumHandles; i++) {
+         BenchClose(gHandles[i]);
+      }
+      HgfsServerManager_Unregister(&gMgr);
+   }
+
+   for (i = 0; i < gNumFiles; i++) {
+      BenchFilePath(i, "", path, sizeof path);
+      unlink(path);
+      BenchFilePath(i, ".renamed", path, sizeof path);
+      unlink(path);
+   }
+   if (gRemoveDir) {
+      rmdir(gDir);
+   }
+}
+
+
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * BenchRun --
+ *
+ *      Replays the operation mix until the iteration count or the duration
+ *      is reached.
+ *
+ * Results:
+ *      Number of failed operations.
+ *
+ * Side effects:
+ *      None.
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+static unsigned long
+BenchRun(unsigned long iterations,     // IN: operations to run, 0 for no limit
+         unsigned int seconds,         // IN: how long to run, 0 for no limit
+         unsigned long *done)          // OUT: operations run
+{
+   uint64 deadline = seconds == 0 ? 0 : BenchNowUS() + seconds * 1000000ULL;
+   unsigned int totalWeight = 0;
+   unsigned long failures = 0;
+   unsigned long n;
+   unsigned int seed = 1;
+   BenchOp op;
+
+   for (op = 0; op < BENCH_NUM_OPS; op++) {
+      totalWeight += benchMix[op];
+   }
+
+   for (n = 0; iterations == 0 || n < iterations; n++) {
+      unsigned int pick = rand_r(&seed) % totalWeight;
+      unsigned int file = rand_r(&seed) % gNumFiles;
+      unsigned int handle = rand_r(&seed) % gNumHandles;
+      uint64 offset = (rand_r(&seed) % (gFileSize / gIoSize)) * gIoSize;
+      char path[PATH_MAX];
+      char newPath[PATH_MAX];
+      HgfsHandle fileHandle;
+      HgfsStatus status = HGFS_STATUS_SUCCESS;
+
+      if (deadline != 0 && (n % 64) == 0 && BenchNowUS() >= deadline) {
+         break;
+      }
+
+      for (op = 0; pick >= benchMix[op]; op++) {
+         pick -= benchMix[op];
+      }
+
+      BenchFilePath(file, "", path, sizeof path);
+      switch (op) {
+      case BENCH_OPEN:
+         status = BenchOpen(path, HGFS_OPEN_MODE_READ_ONLY, &fileHandle);
+         if (status == HGFS_STATUS_SUCCESS) {
+            status = BenchClose(fileHandle);
+         }
+         break;
+      case BENCH_READ:
+         status = BenchRead(gHandles[handle], offset);
+         break;
+      case BENCH_WRITE:
+         status = BenchWrite(gHandles[handle], offset);
+         break;
+      case BENCH_GETATTR:
+         status = BenchGetattr(path);
+         break;
+      case BENCH_SEARCH:
+         status = BenchSearch(gDir);
+         break;
+      case BENCH_RENAME:
+         /* Files with an open handle are left alone. */
+         file = gNumHandles + file % (gNumFiles - gNumHandles);
+         BenchFilePath(file, "", path, sizeof path);
+         BenchFilePath(file, ".renamed", newPath, sizeof newPath);
+         status = BenchRename(path, newPath);
+         if (status == HGFS_STATUS_SUCCESS) {
+            status = BenchRename(newPath, path);
+         }
+         break;
+      default:
+         NOT_REACHED();
+      }
+
+      if (status != HGFS_STATUS_SUCCESS) {
+         failures++;
+      }
+   }
+
+   *done = n;
+   return failures;
+}
+
+
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * BenchPercentile --
+ *
+ *      Estimates a latency percentile from a histogram.
+ *
+ * Results:
+ *      Upper bound of the histogram bucket holding the percentile, in us.
+ *
+ * Side effects:
+ *      None.
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+static uint64
+BenchPercentile(const HgfsServerOpStats *opStats,    // IN: statistics
+                double percentile)                   // IN: 0-100
+{
+   uint64 wanted = (uint64)(opStats->count * percentile / 100.0 + 0.5);
+   uint64 seen = 0;
+   unsigned int i;
+
+   for (i = 0; i < HGFS_SERVER_STATS_BUCKETS; i++) {
+      seen += opStats->histogram[i];
+      if (seen >= wanted && seen > 0) {
+         break;
+      }
+   }
+   return i == 0 ? 1 : MIN(1ULL << i, opStats->maxUS);
+}
+
+
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * BenchOpName --
+ *
+ *      Returns a name for an HGFS operation.
+ *
+ * Results:
+ *      The name.
+ *
+ * Side effects:
+ *      None.
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+static const char *
+BenchOpName(HgfsOp op)     // IN: operation
+{
+   static char buf[32];
+
+   switch (op) {
+   case HGFS_OP_OPEN_V3:          return "OPEN_V3";
+   case HGFS_OP_READ_V3:          return "READ_V3";
+   case HGFS_OP_WRITE_V3:         return "WRITE_V3";
+   case HGFS_OP_CLOSE_V3:         return "CLOSE_V3";
+   case HGFS_OP_GETATTR_V3:       return "GETATTR_V3";
+   case HGFS_OP_SEARCH_OPEN_V3:   return "SEARCH_OPEN_V3";
+   case HGFS_OP_SEARCH_READ_V3:   return "SEARCH_READ_V3";
+   case HGFS_OP_SEARCH_CLOSE_V3:  return "SEARCH_CLOSE_V3";
+   case HGFS_OP_RENAME_V3:        return "RENAME_V3";
+   default:
+      snprintf(buf, sizeof buf, "op %d", op);
+      return buf;
+   }
+}
+
+
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * BenchReport --
+ *
+ *      Prints the statistics collected by the server, and optionally writes
+ *      them with the raw histograms to a CSV file.
+ *
+ * Results:
+ *      None.
+ *
+ * Side effects:
+ *      None.
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+static void
+BenchReport(const HgfsServerStats *stats,  // IN: server statistics
+            const char *csvPath)           // IN: CSV file or NULL
+{
+   double seconds = stats->elapsedUS / 1000000.0;
+   FILE *csv = NULL;
+   unsigned int op;
+   unsigned int i;
+
+   if (csvPath != NULL) {
+      csv = fopen(csvPath, "w");
+      if (csv == NULL) {
+         fprintf(stderr, "Cannot create %s: %s\n", csvPath, strerror(errno));
+      } else {
+         fprintf(csv, "op,name,count,errors,bytesIn,bytesOut,totalUS,maxUS");
+         for (i = 0; i < HGFS_SERVER_STATS_BUCKETS; i++) {
+            fprintf(csv, ",lt%"FMT64"uus", (uint64)1 << i);
+         }
+         fprintf(csv, "\n");
+      }
+   }
+
+   printf("%-16s %9s %6s %8s %7s %7s %7s %8s %9s %8s\n", "op", "count",
+          "errors", "avg(us)", "p50", "p90", "p99", "max", "ops/s", "MB/s");
+   for (op = 0; op < HGFS_SERVER_STATS_MAX_OPS; op++) {
+      const HgfsServerOpStats *opStats = &stats->ops[op];
+
+      if (opStats->count == 0) {
+         continue;
+      }
+      printf("%-16s %9"FMT64"u %6"FMT64"u %8.1f %7"FMT64"u %7"FMT64"u "
+             "%7"FMT64"u %8"FMT64"u %9.0f %8.1f\n",
+             BenchOpName(op), opStats->count, opStats->errors,
+             (double)opStats->totalUS / opStats->count,
+             BenchPercentile(opStats, 50), BenchPercentile(opStats, 90),
+             BenchPercentile(opStats, 99), opStats->maxUS,
+             opStats->count / seconds,
+             (opStats->bytesIn + opStats->bytesOut) / seconds / (1024 * 1024));
+      if (csv != NULL) {
+         fprintf(csv, "%u,%s,%"FMT64"u,%"FMT64"u,%"FMT64"u,%"FMT64"u,"
+                 "%"FMT64"u,%"FMT64"u", op, BenchOpName(op), opStats->count,
+                 opStats->errors, opStats->bytesIn, opStats->bytesOut,
+                 opStats->totalUS, opStats->maxUS);
+         for (i = 0; i < HGFS_SERVER_STATS_BUCKETS; i++) {
+            fprintf(csv, ",%"FMT64"u", opStats->histogram[i]);
+         }
+         fprintf(csv, "\n");
+      }
+   }
+   printf("Percentiles are histogram bucket upper bounds.\n");
+
+   if (csv != NULL) {
+      fclose(csv);
+   }
+}
+
+
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * BenchParseMix --
+ *
+ *      Parses an operation mix such as "open=1,read=4,write=2". Operations
+ *      that are not listed are not run.
+ *
+ * Results:
+ *      TRUE on success, FALSE if the mix is invalid.
+ *
+ * Side effects:
+ *      Updates benchMix.
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+static Bool
+BenchParseMix(char *mix)   // IN: mix, modified
+{
+   unsigned int total = 0;
+   char *item;
+   char *save;
+   BenchOp op;
+
+   memset(benchMix, 0, sizeof benchMix);
+   for (item = strtok_r(mix, ",", &save); item != NULL;
+        item = strtok_r(NULL, ",", &save)) {
+      char *weight = strchr(item, '=');
+
+      if (weight != NULL) {
+         *weight++ = '\0';
+      }
+      for (op = 0; op < BENCH_NUM_OPS; op++) {
+         if (strcmp(item, benchOpNames[op]) == 0) {
+            break;
+         }
+      }
+      if (op == BENCH_NUM_OPS) {
+         fprintf(stderr, "Unknown operation \"%s\"\n", item);
+         return FALSE;
+      }
+      benchMix[op] = weight != NULL ? strtoul(weight, NULL, 10) : 1;
+      total += benchMix[op];
+   }
+   return total > 0;
+}
+
+
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * BenchUsage --
+ *
+ *      Prints the usage.
+ *
+ * Results:
+ *      None.
+ *
+ * Side effects:
+ *      None.
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+static void
+BenchUsage(const char *name)   // IN: program name
+{
+   fprintf(stderr,
+           "Usage: %s [options]\n"
+           "  -d dir     share directory (default: a new temporary directory)\n"
+           "  -n count   operations to run (default: 100000)\n"
+           "  -t secs    run for this long instead\n"
+           "  -m mix     weighted operations (default: "
+           "open=1,read=4,write=2,getattr=4,search=1,rename=1)\n"
+           "  -f files   files in the directory (default: 64)\n"
+           "  -h handles files kept open for read and write (default: 16)\n"
+           "  -S size    file size (default: 1048576)\n"
+           "  -s size    read and write size (default: 4096)\n"
+           "  -c file    write the statistics and histograms as CSV\n",
+           name);
+}
+
+
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * main --
+ *
+ *      Main entry point.
+ *
+ * Results:
+ *      EXIT_SUCCESS if every operation succeeded.
+ *
+ * Side effects:
+ *      None.
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+int
+main(int argc,          // IN
+     char *argv[])      // IN
+{
+   unsigned long iterations = 100000;
+   unsigned int seconds = 0;
+   const char *csvPath = NULL;
+   unsigned long failures;
+   unsigned long done;
+   HgfsServerStats stats;
+   uint64 start;
+   uint64 elapsed;
+   int opt;
+
+   while ((opt = getopt(argc, argv, "d:n:t:m:f:h:S:s:c:")) != -1) {
+      switch (opt) {
+      case 'd':
+         Str_Strcpy(gDir, optarg, sizeof gDir);
+         break;
+      case 'n':
+         iterations = strtoul(optarg, NULL, 10);
+         break;
+      case 't':
+         seconds = strtoul(optarg, NULL, 10);
+         iterations = 0;
+         break;
+      case 'm':
+         if (!BenchParseMix(optarg)) {
+            BenchUsage(argv[0]);
+            return EXIT_FAILURE;
+         }
+         break;
+      case 'f':
+         gNumFiles = strtoul(optarg, NULL, 10);
+         break;
+      case 'h':
+         gNumHandles = strtoul(optarg, NULL, 10);
+         break;
+      case 'S':
+         gFileSize = strtoul(optarg, NULL, 10);
+         break;
+      case 's':
+         gIoSize = strtoul(optarg, NULL, 10);
+         break;
+      case 'c':
+         csvPath = optarg;
+         break;
+      default:
+         BenchUsage(argv[0]);
+         return EXIT_FAILURE;
+      }
+   }
+
+   if (gNumFiles == 0 || gNumFiles > BENCH_MAX_FILES ||
+       gNumHandles == 0 || gNumHandles >= gNumFiles ||
+       gIoSize == 0 || gIoSize > HGFS_LARGE_IO_MAX || gFileSize < gIoSize ||
+       (iterations == 0 && seconds == 0)) {
+      BenchUsage(argv[0]);
+      return EXIT_FAILURE;
+   }
+
+   if (!BenchSetup()) {
+      BenchCleanup();
+      return EXIT_FAILURE;
+   }
+
+   start = BenchNowUS();
+   failures = BenchRun(iterations, seconds, &done);
+   elapsed = BenchNowUS() - start;
+
+   HgfsServer_GetStats(&stats, FALSE);
+   printf("%lu operations in %.3f s (%.0f ops/s), %lu failed, directory %s\n",
+          done, elapsed / 1000000.0, done / (elapsed / 1000000.0), failures,
+          gDir);
+   BenchReport(&stats, csvPath);
+
+   BenchCleanup();
+
+   return failures == 0 ? EXIT_SUCCESS : EXIT_FAILURE;
+}
@@ -0,0 +1,361 @@
+/*********************************************************
+ * Copyright (C) 2016 VMware, Inc. All rights reserved.
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU Lesser General Public License as published
+ * by the Free Software Foundation version 2.1 and no later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+ * or FITNESS FOR A PARTICULAR PURPOSE.  See the Lesser GNU General Public
+ * License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin St, Fifth Floor, Boston, MA  02110-1301 USA.
+ *
+ *********************************************************/
+
+/*
+ * mxUserLockBench.c --
+ *
+ *      Contention benchmark for the MXUser exclusive lock in lib/lock.
+ *
+ *      Threads repeatedly take one lock, increment a shared counter a given
+ *      number of times while holding it, and do a little work of their own
+ *      after releasing it. Each combination of thread count and critical
+ *      section length is run twice:
+ *
+ *      - block: MXUserSpinLimit is 0, so a contended acquire goes straight
+ *               to pthread_mutex_lock(), as it did before MXRecLock spun;
+ *      - spin:  the limit MXRecLock picks itself, which is 0 on a
+ *               uniprocessor, or the Windows 0x400 with -f.
+ *
+ *      The counter is checked against the number of acquisitions, so every
+ *      run also tests that the lock excludes.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <sys/time.h>
+
+#include "vmware.h"
+#include "userlock.h"
+#include "ulInt.h"
+
+#define BENCH_MAX_THREADS      64
+#define BENCH_MAX_VALUES       16
+
+/* Work each thread does between acquisitions. */
+#define BENCH_OUTSIDE_WORK     50
+
+typedef struct {
+   pthread_t     thread;
+   unsigned long acquisitions;
+} BenchThread;
+
+static MXUserExclLock *gLock;
+static volatile unsigned long gShared;
+static volatile Bool gStop;
+static unsigned int gSectionLength;
+
+
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * BenchNowUS --
+ *
+ *      Returns the current time in microseconds.
+ *
+ * Results:
+ *      The time.
+ *
+ * Side effects:
+ *      None.
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+static uint64
+BenchNowUS(void)
+{
+   struct timeval tv;
+
+   gettimeofday(&tv, NULL);
+   return (uint64)tv.tv_sec * 1000000 + tv.tv_usec;
+}
+
+
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * BenchWorker --
+ *
+ *      Takes the lock until told to stop.
+ *
+ * Results:
+ *      NULL.
+ *
+ * Side effects:
+ *      Increments the shared counter gSectionLength times per acquisition.
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+static void *
+BenchWorker(void *data)   // IN: BenchThread
+{
+   BenchThread *self = data;
+   unsigned long acquisitions = 0;
+
+   while (!gStop) {
+      volatile unsigned int work;
+      unsigned int i;
+
+      MXUser_AcquireExclLock(gLock);
+      for (i = 0; i < gSectionLength; i++) {
+         gShared++;
+      }
+      MXUser_ReleaseExclLock(gLock);
+
+      for (work = 0; work < BENCH_OUTSIDE_WORK; work++) {
+      }
+      acquisitions++;
+   }
+
+   self->acquisitions = acquisitions;
+   return NULL;
+}
+
+
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * BenchRun --
+ *
+ *      Runs the threads against a new lock for the given time.
+ *
+ * Results:
+ *      Acquisitions per second, or a negative value if the lock failed to
+ *      exclude or a thread could not be started.
+ *
+ * Side effects:
+ *      None.
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+static double
+BenchRun(unsigned int numThreads,      // IN: threads
+         unsigned int sectionLength,   // IN: increments under the lock
+         int spinLimit,                // IN: MXUserSpinLimit, < 0 to probe
+         unsigned int durationMS)      // IN: how long to run
+{
+   BenchThread threads[BENCH_MAX_THREADS];
+   unsigned long acquisitions = 0;
+   unsigned int started;
+   unsigned int t;
+   uint64 start;
+   uint64 elapsed;
+
+   /* The limit is probed when a lock is created; set it afterwards. */
+   MXUserSpinLimit = -1;
+   gLock = MXUser_CreateExclLock("mxUserLockBench", RANK_UNRANKED);
+   if (spinLimit >= 0) {
+      MXUserSpinLimit = spinLimit;
+   }
+
+   gShared = 0;
+   gStop = FALSE;
+   gSectionLength = sectionLength;
+
+   start = BenchNowUS();
+   for (started = 0; started < numThreads; started++) {
+      int err;
+
+      threads[started].acquisitions = 0;
+      err = pthread_create(&threads[started].thread, NULL, BenchWorker,
+                           &threads[started]);
+      if (err != 0) {
+         fprintf(stderr, "Cannot start a thread: %s\n", strerror(err));
+         break;
+      }
+   }
+   if (started == numThreads) {
+      usleep(durationMS * 1000);
+   }
+   gStop = TRUE;
+
+   for (t = 0; t < started; t++) {
+      pthread_join(threads[t].thread, NULL);
+      acquisitions += threads[t].acquisitions;
+   }
+   elapsed = BenchNowUS() - start;
+
+   MXUser_DestroyExclLock(gLock);
+   gLock = NULL;
+
+   if (started != numThreads) {
+      return -1;
+   }
+   if (gShared != (unsigned long)acquisitions * sectionLength) {
+      fprintf(stderr, "Counter is %lu after %lu acquisitions of %u increments\n",
+              (unsigned long)gShared, acquisitions, sectionLength);
+      return -1;
+   }
+
+   return acquisitions / (elapsed / 1000000.0);
+}
+
+
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * BenchParseList --
+ *
+ *      Parses a comma separated list of positive numbers.
+ *
+ * Results:
+ *      Number of values, 0 if the list is not valid.
+ *
+ * Side effects:
+ *      list is modified.
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+static unsigned int
+BenchParseList(char *list,                          // IN: list, modified
+               unsigned int max,                    // IN: largest value
+               unsigned int values[BENCH_MAX_VALUES]) // OUT: values
+{
+   unsigned int count = 0;
+   char *save = NULL;
+   char *token;
+
+   for (token = strtok_r(list, ",", &save); token != NULL;
+        token = strtok_r(NULL, ",", &save)) {
+      unsigned long value = strtoul(token, NULL, 10);
+
+      if (count == BENCH_MAX_VALUES || value == 0 || value > max) {
+         return 0;
+      }
+      values[count++] = value;
+   }
+
+   return count;
+}
+
+
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * BenchUsage --
+ *
+ *      Prints the usage.
+ *
+ * Results:
+ *      None.
+ *
+ * Side effects:
+ *      None.
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+static void
+BenchUsage(const char *name)   // IN: program name
+{
+   fprintf(stderr,
+           "Usage: %s [options]\n"
+           "  -t list    thread counts (default: 1,2,4,8, max %d)\n"
+           "  -c list    increments under the lock (default: 10,200,5000)\n"
+           "  -d ms      duration of each run (default: 300)\n"
+           "  -f         spin even on a uniprocessor\n",
+           name, BENCH_MAX_THREADS);
+}
+
+
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * main --
+ *
+ *      Main entry point.
+ *
+ * Results:
+ *      EXIT_SUCCESS if the lock excluded in every run.
+ *
+ * Side effects:
+ *      None.
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+int
+main(int argc,          // IN
+     char *argv[])      // IN
+{
+   unsigned int threadCounts[BENCH_MAX_VALUES] = { 1, 2, 4, 8 };
+   unsigned int sectionLengths[BENCH_MAX_VALUES] = { 10, 200, 5000 };
+   unsigned int numThreadCounts = 4;
+   unsigned int numSectionLengths = 3;
+   unsigned int durationMS = 300;
+   int spinLimit = -1;
+   Bool ok = TRUE;
+   unsigned int c;
+   unsigned int t;
+   int opt;
+
+   while ((opt = getopt(argc, argv, "t:c:d:f")) != -1) {
+      switch (opt) {
+      case 't':
+         numThreadCounts = BenchParseList(optarg, BENCH_MAX_THREADS,
+                                          threadCounts);
+         break;
+      case 'c':
+         numSectionLengths = BenchParseList(optarg, 1000000, sectionLengths);
+         break;
+      case 'd':
+         durationMS = strtoul(optarg, NULL, 10);
+         break;
+      case 'f':
+         spinLimit = MXUSER_MAX_SPIN_COUNT;
+         break;
+      default:
+         BenchUsage(argv[0]);
+         return EXIT_FAILURE;
+      }
+   }
+
+   if (numThreadCounts == 0 || numSectionLengths == 0 || durationMS == 0) {
+      BenchUsage(argv[0]);
+      return EXIT_FAILURE;
+   }
+
+   printf("%ld online CPUs, %s\n", sysconf(_SC_NPROCESSORS_ONLN),
+          spinLimit < 0 ? "spin limit probed" : "spinning forced");
+   printf("%8s %8s %14s %14s %8s\n",
+          "threads", "section", "block acq/s", "spin acq/s", "ratio");
+
+   for (c = 0; c < numSectionLengths; c++) {
+      for (t = 0; t < numThreadCounts; t++) {
+         double block = BenchRun(threadCounts[t], sectionLengths[c], 0,
+                                 durationMS);
+         double spin = BenchRun(threadCounts[t], sectionLengths[c], spinLimit,
+                                durationMS);
+
+         if (block < 0 || spin < 0) {
+            ok = FALSE;
+            continue;
+         }
+         printf("%8u %8u %14.0f %14.0f %8.2f\n", threadCounts[t],
+                sectionLengths[c], block, spin, spin / block);
+      }
+   }
+
+   return ok ? EXIT_SUCCESS : EXIT_FAILURE;
+}
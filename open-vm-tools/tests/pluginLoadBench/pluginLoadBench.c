@@ -0,0 +1,428 @@
+/*********************************************************
+ * Copyright (C) 2016 VMware, Inc. All rights reserved.
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU Lesser General Public License as published
+ * by the Free Software Foundation version 2.1 and no later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+ * or FITNESS FOR A PARTICULAR PURPOSE.  See the Lesser GNU General Public
+ * License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin St, Fifth Floor, Boston, MA  02110-1301 USA.
+ *
+ *********************************************************/
+
+/*
+ * pluginLoadBench.c --
+ *
+ *      Startup benchmark for ToolsOnLoadDeferred. Loads copies of a
+ *      synthetic plugin (slowPlugin.c) whose setup sleeps for a given time,
+ *      the way vmtoolsd's plugin manager does: every plugin is opened and
+ *      its ToolsOnLoad called before the main loop starts, then the
+ *      deferred entry points run from a low-priority idle source, one
+ *      plugin per main loop iteration. Each run is done twice:
+ *
+ *      - eager:    the setup happens in ToolsOnLoad;
+ *      - deferred: the setup happens in ToolsOnLoadDeferred.
+ *
+ *      "ready" is when the main loop starts, which is when vmtoolsd starts
+ *      answering RPCs. "stall" is the longest a default priority timeout,
+ *      standing in for an incoming RPC, was held up once the loop started.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/time.h>
+
+#include <glib.h>
+#include <glib/gstdio.h>
+#include <gmodule.h>
+
+#include "vmware.h"
+#include "vmware/tools/plugin.h"
+
+#define BENCH_MAX_PLUGINS      64
+#define BENCH_PROBE_MS         5
+
+typedef struct {
+   GModule                   *module;
+   ToolsPluginData           *data;
+   ToolsPluginOnLoadDeferred  onloadDeferred;
+} BenchPlugin;
+
+typedef struct {
+   ToolsAppCtx   ctx;
+   BenchPlugin   plugins[BENCH_MAX_PLUGINS];
+   unsigned int  numPlugins;
+   unsigned int  initNext;
+   uint64        lastProbeUS;
+   uint64        maxStallUS;
+} BenchState;
+
+typedef struct {
+   double        readyMS;
+   double        doneMS;
+   double        stallMS;
+} BenchResult;
+
+
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * BenchNowUS --
+ *
+ *      Returns the current time in microseconds.
+ *
+ * Results:
+ *      The time.
+ *
+ * Side effects:
+ *      None.
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+static uint64
+BenchNowUS(void)
+{
+   struct timeval tv;
+
+   gettimeofday(&tv, NULL);
+   return (uint64)tv.tv_sec * 1000000 + tv.tv_usec;
+}
+
+
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * BenchDeferredInitCb --
+ *
+ *      Runs the deferred entry point of the next plugin that has one, like
+ *      ToolsCoreDeferredInitCb in vmtoolsd.
+ *
+ * Results:
+ *      TRUE while there may be more plugins to initialize.
+ *
+ * Side effects:
+ *      Quits the main loop once all plugins are initialized.
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+static gboolean
+BenchDeferredInitCb(gpointer data)   // IN: BenchState
+{
+   BenchState *state = data;
+
+   while (state->initNext < state->numPlugins) {
+      BenchPlugin *plugin = &state->plugins[state->initNext++];
+
+      if (plugin->onloadDeferred != NULL) {
+         plugin->onloadDeferred(&state->ctx, plugin->data);
+         return TRUE;
+      }
+   }
+
+   g_main_loop_quit(state->ctx.mainLoop);
+   return FALSE;
+}
+
+
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * BenchProbeCb --
+ *
+ *      Periodic default priority timeout; records how late it fires.
+ *
+ * Results:
+ *      TRUE.
+ *
+ * Side effects:
+ *      Updates the longest stall.
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+static gboolean
+BenchProbeCb(gpointer data)   // IN: BenchState
+{
+   BenchState *state = data;
+   uint64 now = BenchNowUS();
+   uint64 gap = now - state->lastProbeUS;
+
+   if (gap > BENCH_PROBE_MS * 1000 &&
+       gap - BENCH_PROBE_MS * 1000 > state->maxStallUS) {
+      state->maxStallUS = gap - BENCH_PROBE_MS * 1000;
+   }
+   state->lastProbeUS = now;
+   return TRUE;
+}
+
+
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * BenchCopyPlugins --
+ *
+ *      Copies the plugin into a new temporary directory under different
+ *      names, so that each copy is a separate module.
+ *
+ * Results:
+ *      The directory, NULL on error.
+ *
+ * Side effects:
+ *      Creates files.
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+static gchar *
+BenchCopyPlugins(const char *modulePath,   // IN: plugin to copy
+                 unsigned int numPlugins)  // IN: number of copies
+{
+   gchar *dir = g_build_filename(g_get_tmp_dir(), "pluginLoadBench.XXXXXX",
+                                 NULL);
+   gchar *contents = NULL;
+   gsize length;
+   GError *err = NULL;
+   unsigned int i;
+
+   if (mkdtemp(dir) == NULL) {
+      perror("mkdtemp");
+      goto error;
+   }
+
+   if (!g_file_get_contents(modulePath, &contents, &length, &err)) {
+      fprintf(stderr, "Cannot read plugin: %s\n", err->message);
+      goto error;
+   }
+
+   for (i = 0; i < numPlugins; i++) {
+      gchar *name = g_strdup_printf("slow%02u.%s", i, G_MODULE_SUFFIX);
+      gchar *path = g_build_filename(dir, name, NULL);
+      gboolean ok = g_file_set_contents(path, contents, length, &err);
+
+      g_free(path);
+      g_free(name);
+      if (!ok) {
+         fprintf(stderr, "Cannot copy plugin: %s\n", err->message);
+         goto error;
+      }
+   }
+
+   g_free(contents);
+   return dir;
+
+error:
+   g_clear_error(&err);
+   g_free(contents);
+   g_free(dir);
+   return NULL;
+}
+
+
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * BenchRun --
+ *
+ *      Loads fresh copies of the plugin and initializes them.
+ *
+ * Results:
+ *      TRUE if every copy loaded; the timings are in result.
+ *
+ * Side effects:
+ *      Loads and unloads modules, creates and removes files.
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+static Bool
+BenchRun(const char *modulePath,   // IN: plugin to load
+         unsigned int numPlugins,  // IN: number of copies
+         unsigned int initMS,      // IN: setup time per plugin
+         Bool deferred,            // IN: do the setup in ToolsOnLoadDeferred
+         BenchResult *result)      // OUT: timings
+{
+   BenchState state;
+   gchar *dir = BenchCopyPlugins(modulePath, numPlugins);
+   Bool ok = TRUE;
+   uint64 start;
+   uint64 ready;
+   unsigned int i;
+   guint probe;
+
+   if (dir == NULL) {
+      return FALSE;
+   }
+
+   memset(&state, 0, sizeof state);
+   state.ctx.name = "bench";
+   state.ctx.config = g_key_file_new();
+   state.ctx.mainLoop = g_main_loop_new(NULL, FALSE);
+   g_key_file_set_integer(state.ctx.config, "slowPlugin", "init-ms", initMS);
+   g_key_file_set_boolean(state.ctx.config, "slowPlugin", "deferred",
+                          deferred);
+
+   start = BenchNowUS();
+
+   for (i = 0; i < numPlugins; i++) {
+      BenchPlugin *plugin = &state.plugins[state.numPlugins];
+      ToolsPluginOnLoad onload;
+      gchar *name = g_strdup_printf("slow%02u.%s", i, G_MODULE_SUFFIX);
+      gchar *path = g_build_filename(dir, name, NULL);
+
+      plugin->module = g_module_open(path, G_MODULE_BIND_LOCAL);
+      if (plugin->module == NULL ||
+          !g_module_symbol(plugin->module, "ToolsOnLoad",
+                           (gpointer *) &onload) ||
+          !g_module_symbol(plugin->module, "ToolsOnLoadDeferred",
+                           (gpointer *) &plugin->onloadDeferred)) {
+         fprintf(stderr, "Cannot load '%s': %s\n", path, g_module_error());
+         ok = FALSE;
+      } else {
+         plugin->data = onload(&state.ctx);
+         state.numPlugins++;
+      }
+
+      g_unlink(path);
+      g_free(path);
+      g_free(name);
+   }
+
+   ready = BenchNowUS();
+
+   state.lastProbeUS = ready;
+   probe = g_timeout_add(BENCH_PROBE_MS, BenchProbeCb, &state);
+   g_idle_add_full(G_PRIORITY_LOW, BenchDeferredInitCb, &state, NULL);
+   g_main_loop_run(state.ctx.mainLoop);
+   g_source_remove(probe);
+
+   result->readyMS = (ready - start) / 1000.0;
+   result->doneMS = (BenchNowUS() - start) / 1000.0;
+   result->stallMS = state.maxStallUS / 1000.0;
+
+   for (i = 0; i < state.numPlugins; i++) {
+      g_module_close(state.plugins[i].module);
+   }
+   g_main_loop_unref(state.ctx.mainLoop);
+   g_key_file_free(state.ctx.config);
+   g_rmdir(dir);
+   g_free(dir);
+
+   return ok;
+}
+
+
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * BenchUsage --
+ *
+ *      Prints the usage.
+ *
+ * Results:
+ *      None.
+ *
+ * Side effects:
+ *      None.
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+static void
+BenchUsage(const char *name)   // IN: program name
+{
+   fprintf(stderr,
+           "Usage: %s [options]\n"
+           "  -n count   plugins to load (default: 8, max %d)\n"
+           "  -m ms      setup time of each plugin (default: 50)\n"
+           "  -p path    synthetic plugin (default: .libs/libslowPlugin.%s)\n",
+           name, BENCH_MAX_PLUGINS, G_MODULE_SUFFIX);
+}
+
+
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * main --
+ *
+ *      Main entry point.
+ *
+ * Results:
+ *      EXIT_SUCCESS if every plugin loaded in both runs.
+ *
+ * Side effects:
+ *      None.
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+int
+main(int argc,          // IN
+     char *argv[])      // IN
+{
+   gchar *modulePath = NULL;
+   unsigned int numPlugins = 8;
+   unsigned int initMS = 50;
+   BenchResult eager;
+   BenchResult deferred;
+   Bool ok;
+   int opt;
+
+   while ((opt = getopt(argc, argv, "n:m:p:")) != -1) {
+      switch (opt) {
+      case 'n':
+         numPlugins = strtoul(optarg, NULL, 10);
+         break;
+      case 'm':
+         initMS = strtoul(optarg, NULL, 10);
+         break;
+      case 'p':
+         g_free(modulePath);
+         modulePath = g_strdup(optarg);
+         break;
+      default:
+         BenchUsage(argv[0]);
+         return EXIT_FAILURE;
+      }
+   }
+
+   if (numPlugins == 0 || numPlugins > BENCH_MAX_PLUGINS) {
+      BenchUsage(argv[0]);
+      return EXIT_FAILURE;
+   }
+
+   if (!g_module_supported()) {
+      fprintf(stderr, "Modules are not supported.\n");
+      return EXIT_FAILURE;
+   }
+
+   if (modulePath == NULL) {
+      modulePath = g_strdup_printf(".libs/libslowPlugin.%s", G_MODULE_SUFFIX);
+   }
+
+   ok = BenchRun(modulePath, numPlugins, initMS, FALSE, &eager) &&
+        BenchRun(modulePath, numPlugins, initMS, TRUE, &deferred);
+   g_free(modulePath);
+
+   if (!ok) {
+      return EXIT_FAILURE;
+   }
+
+   printf("%u plugins, %u ms setup each\n", numPlugins, initMS);
+   printf("%10s %12s %12s %12s\n", "", "ready ms", "done ms", "stall ms");
+   printf("%10s %12.1f %12.1f %12.1f\n", "eager",
+          eager.readyMS, eager.doneMS, eager.stallMS);
+   printf("%10s %12.1f %12.1f %12.1f\n", "deferred",
+          deferred.readyMS, deferred.doneMS, deferred.stallMS);
+
+   return EXIT_SUCCESS;
+}
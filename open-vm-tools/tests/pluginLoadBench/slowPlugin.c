@@ -0,0 +1,99 @@
+/*********************************************************
+ * Copyright (C) 2016 VMware, Inc. All rights reserved.
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU Lesser General Public License as published
+ * by the Free Software Foundation version 2.1 and no later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+ * or FITNESS FOR A PARTICULAR PURPOSE.  See the Lesser GNU General Public
+ * License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin St, Fifth Floor, Boston, MA  02110-1301 USA.
+ *
+ *********************************************************/
+
+/**
+ * @file slowPlugin.c
+ *
+ *    Synthetic plugin for the plugin load benchmark. It registers nothing
+ *    and just burns the time set in the "slowPlugin" group of the config,
+ *    either in ToolsOnLoad or, if "deferred" is set, in ToolsOnLoadDeferred.
+ */
+
+#define G_LOG_DOMAIN "slowPlugin"
+
+#include <glib.h>
+
+#include "vmware/tools/plugin.h"
+#include "vmware/tools/utils.h"
+
+#define SLOW_PLUGIN_GROUP  "slowPlugin"
+
+
+/**
+ * Simulates the plugin's expensive setup.
+ *
+ * @param[in]  ctx   The app context.
+ */
+
+static void
+SlowPluginSetup(ToolsAppCtx *ctx)
+{
+   gint initMS = VMTools_ConfigGetInteger(ctx->config, SLOW_PLUGIN_GROUP,
+                                          "init-ms", 0);
+
+   if (initMS > 0) {
+      g_usleep(initMS * 1000);
+   }
+}
+
+
+/**
+ * Deferred initialization entry point. Does the setup if the config asks
+ * for it to be deferred.
+ *
+ * @param[in]  ctx      The app context.
+ * @param[in]  plugin   Plugin registration data.
+ */
+
+TOOLS_MODULE_EXPORT void
+ToolsOnLoadDeferred(ToolsAppCtx *ctx,
+                    ToolsPluginData *plugin)
+{
+   if (VMTools_ConfigGetBoolean(ctx->config, SLOW_PLUGIN_GROUP,
+                                "deferred", FALSE)) {
+      SlowPluginSetup(ctx);
+   }
+}
+
+
+/**
+ * Plugin entry point. Does the setup unless the config asks for it to be
+ * deferred.
+ *
+ * @param[in]  ctx   The app context.
+ *
+ * @return The registration data.
+ */
+
+TOOLS_MODULE_EXPORT ToolsPluginData *
+ToolsOnLoad(ToolsAppCtx *ctx)
+{
+   static ToolsPluginData regData = {
+      "slowPlugin",
+      NULL,
+      NULL,
+      NULL
+   };
+
+   if (!VMTools_ConfigGetBoolean(ctx->config, SLOW_PLUGIN_GROUP,
+                                 "deferred", FALSE)) {
+      SlowPluginSetup(ctx);
+   }
+
+   return &regData;
+}
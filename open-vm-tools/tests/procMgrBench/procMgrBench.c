@@ -0,0 +1,413 @@
+/*********************************************************
+ * Copyright (C) 2016 VMware, Inc. All rights reserved.
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU Lesser General Public License as published
+ * by the Free Software Foundation version 2.1 and no later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+ * or FITNESS FOR A PARTICULAR PURPOSE.  See the Lesser GNU General Public
+ * License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin St, Fifth Floor, Boston, MA  02110-1301 USA.
+ *
+ *********************************************************/
+
+/*
+ * procMgrBench.c --
+ *
+ *      Process launch latency benchmark for lib/procMgr.
+ *
+ *      Runs a short command over and over through ProcMgr_ExecSync,
+ *      ProcMgr_ExecAsync and their argv counterparts. Each run is repeated
+ *      for every combination of descriptor limit (RLIMIT_NOFILE) and
+ *      resident set size given on the command line, since those are what
+ *      made launching from a large vmtoolsd slow: the fork() of the whole
+ *      process and closing every descriptor up to the limit.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/resource.h>
+#include <sys/select.h>
+#include <sys/time.h>
+
+#include "vmware.h"
+#include "procMgr.h"
+#include "util.h"
+
+#define BENCH_MAX_VALUES      16
+
+typedef enum {
+   BENCH_SYNC_SHELL,
+   BENCH_SYNC_ARGV,
+   BENCH_ASYNC_SHELL,
+   BENCH_ASYNC_ARGV,
+   BENCH_NUM_MODES,
+} BenchMode;
+
+static const char *benchModeNames[BENCH_NUM_MODES] = {
+   "sync shell", "sync argv", "async shell", "async argv",
+};
+
+
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * BenchNowUS --
+ *
+ *      Returns the current time in microseconds.
+ *
+ * Results:
+ *      The time.
+ *
+ * Side effects:
+ *      None.
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+static uint64
+BenchNowUS(void)
+{
+   struct timeval tv;
+
+   gettimeofday(&tv, NULL);
+   return (uint64)tv.tv_sec * 1000000 + tv.tv_usec;
+}
+
+
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * BenchCompare --
+ *
+ *      qsort comparison function for latencies.
+ *
+ * Results:
+ *      <0, 0 or >0.
+ *
+ * Side effects:
+ *      None.
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+static int
+BenchCompare(const void *a,   // IN
+             const void *b)   // IN
+{
+   uint64 x = *(const uint64 *)a;
+   uint64 y = *(const uint64 *)b;
+
+   return x < y ? -1 : x > y;
+}
+
+
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * BenchLaunch --
+ *
+ *      Runs the command once and waits for it to finish.
+ *
+ * Results:
+ *      TRUE if the command ran and exited with 0.
+ *
+ * Side effects:
+ *      None.
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+static Bool
+BenchLaunch(BenchMode mode,          // IN: how to run it
+            const char *cmd,         // IN: command line
+            char * const *argv)      // IN: same command as arguments
+{
+   ProcMgr_AsyncProc *proc;
+   Selectable fd;
+   fd_set readFds;
+   int exitCode;
+   Bool ok;
+
+   switch (mode) {
+   case BENCH_SYNC_SHELL:
+      return ProcMgr_ExecSync(cmd, NULL);
+   case BENCH_SYNC_ARGV:
+      return ProcMgr_ExecSyncArgv(argv, NULL);
+   case BENCH_ASYNC_SHELL:
+      proc = ProcMgr_ExecAsync(cmd, NULL);
+      break;
+   case BENCH_ASYNC_ARGV:
+      proc = ProcMgr_ExecAsyncArgv(argv, NULL);
+      break;
+   default:
+      NOT_REACHED();
+   }
+
+   if (proc == NULL) {
+      return FALSE;
+   }
+
+   /* Wait the way the plugins do, on the selectable. */
+   fd = ProcMgr_GetAsyncProcSelectable(proc);
+   FD_ZERO(&readFds);
+   FD_SET(fd, &readFds);
+   while (select(fd + 1, &readFds, NULL, NULL, NULL) == -1 && errno == EINTR) {
+      FD_SET(fd, &readFds);
+   }
+
+   ok = ProcMgr_GetExitCode(proc, &exitCode) == 0 && exitCode == 0;
+   ProcMgr_Free(proc);
+
+   return ok;
+}
+
+
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * BenchRun --
+ *
+ *      Runs the command the given number of times and prints the launch
+ *      latency distribution.
+ *
+ * Results:
+ *      Number of failed launches.
+ *
+ * Side effects:
+ *      None.
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+static unsigned int
+BenchRun(BenchMode mode,             // IN: how to run it
+         const char *cmd,            // IN: command line
+         char * const *argv,         // IN: same command as arguments
+         unsigned int count,         // IN: launches
+         uint64 *latencies,          // IN: scratch space for count values
+         rlim_t noFile,              // IN: descriptor limit, for the report
+         unsigned int rssMB)         // IN: resident set size, for the report
+{
+   unsigned int failures = 0;
+   uint64 total = 0;
+   unsigned int i;
+
+   for (i = 0; i < count; i++) {
+      uint64 start = BenchNowUS();
+
+      if (!BenchLaunch(mode, cmd, argv)) {
+         failures++;
+      }
+      latencies[i] = BenchNowUS() - start;
+      total += latencies[i];
+   }
+
+   qsort(latencies, count, sizeof *latencies, BenchCompare);
+   printf("%9lu %7u  %-12s %8.0f %8"FMT64"u %8"FMT64"u %8"FMT64"u %6u\n",
+          (unsigned long)noFile, rssMB, benchModeNames[mode],
+          (double)total / count, latencies[count / 2],
+          latencies[(count * 99) / 100], latencies[count - 1], failures);
+   fflush(stdout);
+
+   return failures;
+}
+
+
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * BenchParseList --
+ *
+ *      Parses a comma separated list of numbers.
+ *
+ * Results:
+ *      Number of values, 0 if the list is invalid.
+ *
+ * Side effects:
+ *      None.
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+static unsigned int
+BenchParseList(const char *list,       // IN: list
+               unsigned long *values)  // OUT: BENCH_MAX_VALUES values
+{
+   unsigned int n = 0;
+   const char *p = list;
+
+   while (*p != '\0' && n < BENCH_MAX_VALUES) {
+      char *end;
+
+      values[n++] = strtoul(p, &end, 10);
+      if (end == p || (*end != ',' && *end != '\0')) {
+         return 0;
+      }
+      p = *end == ',' ? end + 1 : end;
+   }
+   return *p == '\0' ? n : 0;
+}
+
+
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * BenchUsage --
+ *
+ *      Prints the usage.
+ *
+ * Results:
+ *      None.
+ *
+ * Side effects:
+ *      None.
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+static void
+BenchUsage(const char *name)   // IN: program name
+{
+   fprintf(stderr,
+           "Usage: %s [options]\n"
+           "  -n count   launches per mode (default: 200)\n"
+           "  -f list    RLIMIT_NOFILE values (default: 1024,65536,1048576)\n"
+           "  -m list    resident set sizes in MB (default: 0,256,1024)\n"
+           "  -o count   extra descriptors held open (default: 64)\n"
+           "  -c path    program to run, without arguments (default: /bin/true)\n",
+           name);
+}
+
+
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * main --
+ *
+ *      Main entry point.
+ *
+ * Results:
+ *      EXIT_SUCCESS if every launch succeeded.
+ *
+ * Side effects:
+ *      Changes the descriptor limit of the process.
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+int
+main(int argc,          // IN
+     char *argv[])      // IN
+{
+   unsigned long noFiles[BENCH_MAX_VALUES] = { 1024, 65536, 1048576 };
+   unsigned long rssSizes[BENCH_MAX_VALUES] = { 0, 256, 1024 };
+   unsigned int numNoFiles = 3;
+   unsigned int numRssSizes = 3;
+   unsigned int count = 200;
+   unsigned int openFds = 64;
+   char *program = "/bin/true";
+   char *programArgv[2];
+   unsigned int failures = 0;
+   uint64 *latencies;
+   char *memory = NULL;
+   size_t memorySize = 0;
+   unsigned int r;
+   unsigned int f;
+   unsigned int i;
+   int opt;
+
+   while ((opt = getopt(argc, argv, "n:f:m:o:c:")) != -1) {
+      switch (opt) {
+      case 'n':
+         count = strtoul(optarg, NULL, 10);
+         break;
+      case 'f':
+         numNoFiles = BenchParseList(optarg, noFiles);
+         break;
+      case 'm':
+         numRssSizes = BenchParseList(optarg, rssSizes);
+         break;
+      case 'o':
+         openFds = strtoul(optarg, NULL, 10);
+         break;
+      case 'c':
+         program = optarg;
+         break;
+      default:
+         BenchUsage(argv[0]);
+         return EXIT_FAILURE;
+      }
+   }
+
+   if (count == 0 || numNoFiles == 0 || numRssSizes == 0) {
+      BenchUsage(argv[0]);
+      return EXIT_FAILURE;
+   }
+
+   programArgv[0] = program;
+   programArgv[1] = NULL;
+   latencies = Util_SafeCalloc(count, sizeof *latencies);
+
+   /* A daemon has a few descriptors open; make the child close them. */
+   for (i = 0; i < openFds; i++) {
+      if (open("/dev/null", O_RDONLY) == -1) {
+         fprintf(stderr, "Cannot open /dev/null: %s\n", strerror(errno));
+         return EXIT_FAILURE;
+      }
+   }
+
+   printf("%9s %7s  %-12s %8s %8s %8s %8s %6s\n", "nofile", "rss(MB)",
+          "mode", "avg(us)", "p50", "p99", "max", "failed");
+   fflush(stdout);
+
+   for (r = 0; r < numRssSizes; r++) {
+      size_t size = (size_t)rssSizes[r] << 20;
+
+      /* Grow the heap and touch every page so it is resident. */
+      if (size > memorySize) {
+         memory = Util_SafeRealloc(memory, size);
+         memset(memory + memorySize, 0xa5, size - memorySize);
+         memorySize = size;
+      }
+
+      for (f = 0; f < numNoFiles; f++) {
+         struct rlimit limit;
+         BenchMode mode;
+
+         /* Raising the hard limit needs privileges; never lower it. */
+         getrlimit(RLIMIT_NOFILE, &limit);
+         limit.rlim_cur = noFiles[f];
+         limit.rlim_max = MAX(limit.rlim_max, limit.rlim_cur);
+         if (setrlimit(RLIMIT_NOFILE, &limit) != 0) {
+            getrlimit(RLIMIT_NOFILE, &limit);
+            limit.rlim_cur = MIN(noFiles[f], limit.rlim_max);
+            if (setrlimit(RLIMIT_NOFILE, &limit) != 0) {
+               fprintf(stderr, "Cannot set RLIMIT_NOFILE to %lu: %s\n",
+                       noFiles[f], strerror(errno));
+               continue;
+            }
+         }
+
+         for (mode = 0; mode < BENCH_NUM_MODES; mode++) {
+            failures += BenchRun(mode, program, programArgv, count,
+                                 latencies, limit.rlim_cur,
+                                 rssSizes[r]);
+         }
+      }
+   }
+
+   free(memory);
+   free(latencies);
+
+   return failures == 0 ? EXIT_SUCCESS : EXIT_FAILURE;
+}
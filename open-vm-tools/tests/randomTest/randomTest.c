@@ -0,0 +1,612 @@
+/*********************************************************
+ * Copyright (C) 2016 VMware, Inc. All rights reserved.
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU Lesser General Public License as published
+ * by the Free Software Foundation version 2.1 and no later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+ * or FITNESS FOR A PARTICULAR PURPOSE.  See the Lesser GNU General Public
+ * License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin St, Fifth Floor, Boston, MA  02110-1301 USA.
+ *
+ *********************************************************/
+
+/*
+ * randomTest.c --
+ *
+ *      Test of the kernel randomness readers: Random_Crypto in lib/misc and,
+ *      when VGAuth is built, its copy ServiceRandomBytes in
+ *      vgauth/serviceImpl. Both read getrandom(2) with GRND_NONBLOCK and fall
+ *      back to /dev/urandom.
+ *
+ *      Each check runs in a child process with a seccomp filter that makes
+ *      getrandom(2) fail with ENOSYS, as on kernels before 3.17, or EAGAIN,
+ *      as before the pool is initialized, and that can deny opening the
+ *      device. A reader must still succeed when the device is the only
+ *      source, and must fail when neither is available, which shows the
+ *      bytes came from the fallback and not from a failed call. With the
+ *      device denied and getrandom(2) working, it must succeed without it.
+ *
+ *      The output of both paths then goes through byte frequency, monobit
+ *      and runs checks, and both paths are timed for a few request sizes.
+ */
+
+#ifndef _GNU_SOURCE
+#define _GNU_SOURCE
+#endif
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <stddef.h>
+#include <unistd.h>
+#include <sys/prctl.h>
+#include <sys/syscall.h>
+#include <sys/time.h>
+#include <sys/wait.h>
+#include <linux/audit.h>
+#include <linux/filter.h>
+#include <linux/seccomp.h>
+
+#include "vmware.h"
+#include "random.h"
+
+#ifdef RANDOM_TEST_VGAUTH
+#include "VGAuthError.h"
+
+/* From serviceInt.h, which needs the whole VGAuth service to build. */
+VGAuthError ServiceRandomBytes(int size, unsigned char *buffer);
+#endif
+
+/* Architectures the filter knows; the readers only use getrandom(2) here. */
+#if !defined(SYS_getrandom)
+#elif defined(__x86_64__)
+#   define TEST_AUDIT_ARCH     AUDIT_ARCH_X86_64
+#elif defined(__i386__)
+#   define TEST_AUDIT_ARCH     AUDIT_ARCH_I386
+#elif defined(__aarch64__)
+#   define TEST_AUDIT_ARCH     AUDIT_ARCH_AARCH64
+#endif
+
+/* Exit status of a child that could not install its filter. */
+#define TEST_EXIT_NO_FILTER    77
+
+/*
+ * Square of the largest deviation accepted by the monobit and runs checks,
+ * in standard deviations. A good generator fails one in about 150000 runs.
+ */
+#define TEST_MAX_Z2            (4.5 * 4.5)
+
+/*
+ * Bounds of the byte frequency chi-square, 255 degrees of freedom, at the
+ * same 4.5 standard deviations (Wilson-Hilferty).
+ */
+#define TEST_MIN_CHI2          165.8
+#define TEST_MAX_CHI2          369.8
+
+/* Request size of the statistics checks, that of a typical caller. */
+#define TEST_STATS_REQUEST     16
+
+/* Results a test body returns: one per request size, or statistics. */
+#define TEST_NUM_RESULTS       3
+
+typedef Bool (*TestReader)(size_t size, void *buffer);
+typedef Bool (*TestBody)(TestReader reader, double *results);
+
+static const size_t testSizes[TEST_NUM_RESULTS] = { 16, 256, 4096 };
+
+static unsigned long gIterations = 20000;
+static size_t gStatsBytes = 1024 * 1024;
+
+
+#ifdef RANDOM_TEST_VGAUTH
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * TestVGAuthBytes --
+ *
+ *      ServiceRandomBytes, with the signature of Random_Crypto.
+ *
+ * Results:
+ *      TRUE on success, FALSE otherwise.
+ *
+ * Side effects:
+ *      None.
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+static Bool
+TestVGAuthBytes(size_t size,     // IN: bytes to generate
+                void *buffer)    // OUT: random bytes
+{
+   return ServiceRandomBytes(size, buffer) == VGAUTH_E_OK;
+}
+#endif
+
+
+static const struct {
+   const char *name;
+   TestReader reader;
+} testReaders[] = {
+   { "Random_Crypto",      Random_Crypto },
+#ifdef RANDOM_TEST_VGAUTH
+   { "ServiceRandomBytes", TestVGAuthBytes },
+#endif
+};
+
+
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * TestNowUS --
+ *
+ *      Returns the current time in microseconds.
+ *
+ * Results:
+ *      The time.
+ *
+ * Side effects:
+ *      None.
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+static uint64
+TestNowUS(void)
+{
+   struct timeval tv;
+
+   gettimeofday(&tv, NULL);
+   return (uint64)tv.tv_sec * 1000000 + tv.tv_usec;
+}
+
+
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * TestInstallFilter --
+ *
+ *      Installs a seccomp filter that fails getrandom(2) and opening files.
+ *
+ * Results:
+ *      TRUE on success, FALSE if the kernel does not support it.
+ *
+ * Side effects:
+ *      The filter stays for the life of the process.
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+static Bool
+TestInstallFilter(int getrandomErrno,   // IN: error of getrandom(2), 0 for none
+                  int openErrno)        // IN: error of openat(2), 0 for none
+{
+#ifdef TEST_AUDIT_ARCH
+   struct sock_filter filter[] = {
+      BPF_STMT(BPF_LD | BPF_W | BPF_ABS, offsetof(struct seccomp_data, arch)),
+      BPF_JUMP(BPF_JMP | BPF_JEQ | BPF_K, TEST_AUDIT_ARCH, 0, 5),
+      BPF_STMT(BPF_LD | BPF_W | BPF_ABS, offsetof(struct seccomp_data, nr)),
+      BPF_JUMP(BPF_JMP | BPF_JEQ | BPF_K, SYS_getrandom, 0, 1),
+      BPF_STMT(BPF_RET | BPF_K,
+               getrandomErrno == 0 ? SECCOMP_RET_ALLOW
+                                   : SECCOMP_RET_ERRNO | getrandomErrno),
+      BPF_JUMP(BPF_JMP | BPF_JEQ | BPF_K, SYS_openat, 0, 1),
+      BPF_STMT(BPF_RET | BPF_K,
+               openErrno == 0 ? SECCOMP_RET_ALLOW
+                              : SECCOMP_RET_ERRNO | openErrno),
+      BPF_STMT(BPF_RET | BPF_K, SECCOMP_RET_ALLOW),
+   };
+   struct sock_fprog program = { ARRAYSIZE(filter), filter };
+
+   return prctl(PR_SET_NO_NEW_PRIVS, 1, 0, 0, 0) == 0 &&
+          prctl(PR_SET_SECCOMP, SECCOMP_MODE_FILTER, &program) == 0;
+#else
+   return FALSE;
+#endif
+}
+
+
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * TestInChild --
+ *
+ *      Runs a test body in a child process, behind a seccomp filter.
+ *
+ * Results:
+ *      The child's exit status: EXIT_SUCCESS or EXIT_FAILURE from the body,
+ *      TEST_EXIT_NO_FILTER if the filter could not be installed. The
+ *      TEST_NUM_RESULTS results of the body.
+ *
+ * Side effects:
+ *      None.
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+static int
+TestInChild(TestBody body,          // IN: test body
+            TestReader reader,      // IN: reader to test
+            int getrandomErrno,     // IN: error of getrandom(2), 0 for none
+            int openErrno,          // IN: error of openat(2), 0 for none
+            double *results)        // OUT: TEST_NUM_RESULTS results, optional
+{
+   double childResults[TEST_NUM_RESULTS] = { 0 };
+   int fds[2];
+   int status;
+   pid_t pid;
+
+   fflush(stdout);
+   fflush(stderr);
+   if (pipe(fds) != 0) {
+      fprintf(stderr, "Cannot create a pipe: %s\n", strerror(errno));
+      return EXIT_FAILURE;
+   }
+
+   pid = fork();
+   if (pid == 0) {
+      int exitCode = TEST_EXIT_NO_FILTER;
+
+      close(fds[0]);
+      if ((getrandomErrno == 0 && openErrno == 0) ||
+          TestInstallFilter(getrandomErrno, openErrno)) {
+         exitCode = body(reader, childResults) ? EXIT_SUCCESS : EXIT_FAILURE;
+         if (write(fds[1], childResults, sizeof childResults) !=
+             sizeof childResults) {
+            exitCode = EXIT_FAILURE;
+         }
+      }
+      fflush(stdout);
+      fflush(stderr);
+      _exit(exitCode);
+   }
+
+   close(fds[1]);
+   if (pid == -1) {
+      fprintf(stderr, "Cannot fork: %s\n", strerror(errno));
+      close(fds[0]);
+      return EXIT_FAILURE;
+   }
+
+   if (read(fds[0], childResults, sizeof childResults) != sizeof childResults) {
+      memset(childResults, 0, sizeof childResults);
+   }
+   close(fds[0]);
+   if (results != NULL) {
+      memcpy(results, childResults, sizeof childResults);
+   }
+
+   if (waitpid(pid, &status, 0) != pid || !WIFEXITED(status)) {
+      return EXIT_FAILURE;
+   }
+   return WEXITSTATUS(status);
+}
+
+
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * TestFill --
+ *
+ *      Test body: reads two buffers, which must differ.
+ *
+ * Results:
+ *      TRUE if both reads succeeded and the buffers differ.
+ *
+ * Side effects:
+ *      None.
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+static Bool
+TestFill(TestReader reader,     // IN: reader to test
+         double *results)       // OUT: unused
+{
+   uint8 first[64];
+   uint8 second[64];
+
+   return reader(sizeof first, first) && reader(sizeof second, second) &&
+          memcmp(first, second, sizeof first) != 0;
+}
+
+
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * TestStats --
+ *
+ *      Test body: reads gStatsBytes in small requests and checks the byte
+ *      frequencies with a chi-square test, and the bits with the monobit
+ *      and runs tests of NIST SP 800-22.
+ *
+ * Results:
+ *      TRUE if every read succeeded and every check passed. The chi-square
+ *      and the monobit and runs deviations, in standard deviations squared.
+ *
+ * Side effects:
+ *      None.
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+static Bool
+TestStats(TestReader reader,    // IN: reader to test
+          double *results)      // OUT: statistics
+{
+   uint8 *buffer = malloc(gStatsBytes);
+   uint64 counts[256] = { 0 };
+   uint64 ones = 0;
+   uint64 runs = 1;
+   unsigned int last;
+   double numBits = gStatsBytes * 8.0;
+   double expected = gStatsBytes / 256.0;
+   double chi2 = 0;
+   double pi;
+   size_t i;
+
+   if (buffer == NULL) {
+      return FALSE;
+   }
+   for (i = 0; i < gStatsBytes; i += TEST_STATS_REQUEST) {
+      if (!reader(MIN(TEST_STATS_REQUEST, gStatsBytes - i), buffer + i)) {
+         free(buffer);
+         return FALSE;
+      }
+   }
+
+   last = buffer[0] >> 7;
+   for (i = 0; i < gStatsBytes; i++) {
+      int bit;
+
+      counts[buffer[i]]++;
+      for (bit = 7; bit >= 0; bit--) {
+         unsigned int value = (buffer[i] >> bit) & 1;
+
+         ones += value;
+         runs += value != last;
+         last = value;
+      }
+   }
+   free(buffer);
+
+   for (i = 0; i < ARRAYSIZE(counts); i++) {
+      chi2 += (counts[i] - expected) * (counts[i] - expected) / expected;
+   }
+   pi = ones / numBits;
+
+   results[0] = chi2;
+   results[1] = (ones - numBits / 2) * (ones - numBits / 2) / (numBits / 4);
+   results[2] = (runs - 2 * numBits * pi * (1 - pi)) *
+                (runs - 2 * numBits * pi * (1 - pi)) /
+                (4 * numBits * pi * pi * (1 - pi) * (1 - pi));
+
+   return chi2 >= TEST_MIN_CHI2 && chi2 <= TEST_MAX_CHI2 &&
+          results[1] < TEST_MAX_Z2 && results[2] < TEST_MAX_Z2;
+}
+
+
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * TestTime --
+ *
+ *      Test body: times gIterations reads of each of testSizes.
+ *
+ * Results:
+ *      TRUE if every read succeeded. Microseconds per read for each size.
+ *
+ * Side effects:
+ *      None.
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+static Bool
+TestTime(TestReader reader,     // IN: reader to test
+         double *results)       // OUT: microseconds per read
+{
+   uint8 buffer[4096];
+   unsigned int size;
+
+   for (size = 0; size < TEST_NUM_RESULTS; size++) {
+      uint64 start = TestNowUS();
+      unsigned long i;
+
+      ASSERT(testSizes[size] <= sizeof buffer);
+      for (i = 0; i < gIterations; i++) {
+         if (!reader(testSizes[size], buffer)) {
+            return FALSE;
+         }
+      }
+      results[size] = (double)(TestNowUS() - start) / gIterations;
+   }
+   return TRUE;
+}
+
+
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * TestReaderAll --
+ *
+ *      Runs the fallback checks, the statistics checks and the timing of
+ *      one reader.
+ *
+ * Results:
+ *      Number of failed checks.
+ *
+ * Side effects:
+ *      None.
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+static unsigned int
+TestReaderAll(const char *name,     // IN: reader name
+              TestReader reader)    // IN: reader to test
+{
+   static const struct {
+      const char *name;
+      int getrandomErrno;
+      int openErrno;
+      Bool succeeds;
+   } cases[] = {
+      { "getrandom only",         0,      EACCES, TRUE },
+      { "ENOSYS, device",         ENOSYS, 0,      TRUE },
+      { "ENOSYS, no device",      ENOSYS, EACCES, FALSE },
+      { "EAGAIN, device",         EAGAIN, 0,      TRUE },
+      { "EAGAIN, no device",      EAGAIN, EACCES, FALSE },
+   };
+   static const struct {
+      const char *name;
+      int getrandomErrno;
+   } paths[] = {
+      { "getrandom",    0 },
+      { "/dev/urandom", ENOSYS },
+   };
+   double times[ARRAYSIZE(paths)][TEST_NUM_RESULTS];
+   unsigned int failures = 0;
+   unsigned int i;
+
+   printf("%s:\n", name);
+
+   for (i = 0; i < ARRAYSIZE(cases); i++) {
+      int status = TestInChild(TestFill, reader, cases[i].getrandomErrno,
+                               cases[i].openErrno, NULL);
+
+      if (status == TEST_EXIT_NO_FILTER) {
+         printf("   %-20s skipped, no seccomp filter\n", cases[i].name);
+         continue;
+      }
+      if ((status == EXIT_SUCCESS) != cases[i].succeeds) {
+         failures++;
+      }
+      printf("   %-20s %s, expected to %s\n", cases[i].name,
+             status == EXIT_SUCCESS ? "succeeds" : "fails",
+             cases[i].succeeds ? "succeed" : "fail");
+   }
+
+   for (i = 0; i < ARRAYSIZE(paths); i++) {
+      double stats[TEST_NUM_RESULTS];
+      int status = TestInChild(TestStats, reader, paths[i].getrandomErrno, 0,
+                               stats);
+
+      if (status == TEST_EXIT_NO_FILTER) {
+         continue;
+      }
+      if (status != EXIT_SUCCESS) {
+         failures++;
+      }
+      printf("   %-20s chi-square %.1f, monobit z^2 %.2f, runs z^2 %.2f: %s\n",
+             paths[i].name, stats[0], stats[1], stats[2],
+             status == EXIT_SUCCESS ? "ok" : "FAILED");
+   }
+
+   for (i = 0; i < ARRAYSIZE(paths); i++) {
+      int status = TestInChild(TestTime, reader, paths[i].getrandomErrno, 0,
+                               times[i]);
+
+      if (status == TEST_EXIT_NO_FILTER) {
+         memset(times[i], 0, sizeof times[i]);
+      } else if (status != EXIT_SUCCESS) {
+         fprintf(stderr, "%s: reads through %s failed\n", name, paths[i].name);
+         failures++;
+      }
+   }
+   printf("   %8s %14s %14s\n", "bytes", "getrandom us", "urandom us");
+   for (i = 0; i < TEST_NUM_RESULTS; i++) {
+      printf("   %8"FMTSZ"u %14.3f %14.3f\n", testSizes[i], times[0][i],
+             times[1][i]);
+   }
+
+   return failures;
+}
+
+
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * TestUsage --
+ *
+ *      Prints the usage.
+ *
+ * Results:
+ *      None.
+ *
+ * Side effects:
+ *      None.
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+static void
+TestUsage(const char *name)   // IN: program name
+{
+   fprintf(stderr,
+           "Usage: %s [options]\n"
+           "  -n count   timed reads per size (default: 20000)\n"
+           "  -b bytes   bytes for the statistics checks (default: 1048576)\n",
+           name);
+}
+
+
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * main --
+ *
+ *      Main entry point.
+ *
+ * Results:
+ *      EXIT_SUCCESS if every check passed.
+ *
+ * Side effects:
+ *      None.
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+int
+main(int argc,          // IN
+     char *argv[])      // IN
+{
+   unsigned int failures = 0;
+   unsigned int i;
+   int opt;
+
+   while ((opt = getopt(argc, argv, "n:b:")) != -1) {
+      switch (opt) {
+      case 'n':
+         gIterations = strtoul(optarg, NULL, 10);
+         break;
+      case 'b':
+         gStatsBytes = strtoul(optarg, NULL, 10);
+         break;
+      default:
+         TestUsage(argv[0]);
+         return EXIT_FAILURE;
+      }
+   }
+
+   /* The runs test wants at least 100 bits, the chi-square more. */
+   if (gIterations == 0 || gStatsBytes < 64 * 1024) {
+      TestUsage(argv[0]);
+      return EXIT_FAILURE;
+   }
+
+   for (i = 0; i < ARRAYSIZE(testReaders); i++) {
+      failures += TestReaderAll(testReaders[i].name, testReaders[i].reader);
+   }
+
+   printf("%u checks failed\n", failures);
+
+   return failures == 0 ? EXIT_SUCCESS : EXIT_FAILURE;
+}
@@ -0,0 +1,428 @@
+/*********************************************************
+ * Copyright (C) 2016 VMware, Inc. All rights reserved.
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU Lesser General Public License as published
+ * by the Free Software Foundation version 2.1 and no later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+ * or FITNESS FOR A PARTICULAR PURPOSE.  See the Lesser GNU General Public
+ * License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin St, Fifth Floor, Boston, MA  02110-1301 USA.
+ *
+ *********************************************************/
+
+/*
+ * stdioLineReaderTest.c --
+ *
+ *      Parity test for StdIO_LineReader in lib/misc/vmstdio.c.
+ *
+ *      Random inputs mixing \n, \r, NUL and text are split into lines both
+ *      by StdIO_ReadNextLine, which reads a byte at a time, and by the
+ *      buffered StdIO_LineReader; the lines and statuses must be the same.
+ *      vmstdio.c is built into this program with an 8 byte initial reader
+ *      buffer, so lines and \r\n pairs regularly straddle a refill and long
+ *      lines grow the buffer. The maximum line length is checked as well.
+ *
+ *      With -f, both readers are also timed on the given file.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <sys/time.h>
+
+#include "vmware.h"
+#include "vmstdio.h"
+
+#define TEST_NUM_INPUTS        20000
+#define TEST_MAX_INPUT         200
+
+/* One input in this many is long enough to grow the reader buffer. */
+#define TEST_LONG_INPUT_RATE   100
+#define TEST_MAX_LONG_INPUT    4096
+
+
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * TestNowUS --
+ *
+ *      Returns the current time in microseconds.
+ *
+ * Results:
+ *      The time.
+ *
+ * Side effects:
+ *      None.
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+static uint64
+TestNowUS(void)
+{
+   struct timeval tv;
+
+   gettimeofday(&tv, NULL);
+   return (uint64)tv.tv_sec * 1000000 + tv.tv_usec;
+}
+
+
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * TestOpen --
+ *
+ *      Creates a temporary stream holding data.
+ *
+ * Results:
+ *      The stream, positioned at its start, or NULL on failure.
+ *
+ * Side effects:
+ *      None.
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+static FILE *
+TestOpen(const char *data,    // IN: contents
+         size_t size)         // IN: size of data
+{
+   FILE *stream = tmpfile();
+
+   if (stream == NULL) {
+      fprintf(stderr, "Cannot create a temporary file: %s\n", strerror(errno));
+      return NULL;
+   }
+   if (size > 0 && fwrite(data, 1, size, stream) != size) {
+      fprintf(stderr, "Cannot write a temporary file: %s\n", strerror(errno));
+      fclose(stream);
+      return NULL;
+   }
+   rewind(stream);
+
+   return stream;
+}
+
+
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * TestCompare --
+ *
+ *      Splits data with both readers.
+ *
+ * Results:
+ *      TRUE if both returned the same lines and statuses, FALSE otherwise.
+ *
+ * Side effects:
+ *      None.
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+static Bool
+TestCompare(const char *data,    // IN: input
+            size_t size)         // IN: size of data
+{
+   FILE *expectedStream = TestOpen(data, size);
+   FILE *actualStream = TestOpen(data, size);
+   StdIO_LineReader *reader;
+   Bool same = TRUE;
+
+   if (expectedStream == NULL || actualStream == NULL) {
+      if (expectedStream != NULL) {
+         fclose(expectedStream);
+      }
+      if (actualStream != NULL) {
+         fclose(actualStream);
+      }
+      return FALSE;
+   }
+
+   reader = StdIO_LineReaderCreate(actualStream, 0);
+   for (;;) {
+      StdIO_Status expected;
+      StdIO_Status actual;
+      char *expectedLine = NULL;
+      char *actualLine = NULL;
+      size_t expectedCount = 0;
+      size_t actualCount = 0;
+
+      expected = StdIO_ReadNextLine(expectedStream, &expectedLine, 0,
+                                    &expectedCount);
+      actual = StdIO_LineReaderNext(reader, &actualLine, &actualCount);
+      if (expected != actual ||
+          (expected == StdIO_Success &&
+           (expectedCount != actualCount ||
+            memcmp(expectedLine, actualLine, expectedCount) != 0 ||
+            actualLine[actualCount] != '\0'))) {
+         same = FALSE;
+      }
+      free(expectedLine);
+      if (!same || expected != StdIO_Success) {
+         break;
+      }
+   }
+
+   StdIO_LineReaderDestroy(reader);
+   fclose(expectedStream);
+   fclose(actualStream);
+
+   return same;
+}
+
+
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * TestParity --
+ *
+ *      Compares both readers on random inputs.
+ *
+ * Results:
+ *      Number of inputs the readers split differently.
+ *
+ * Side effects:
+ *      None.
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+static unsigned int
+TestParity(unsigned int seed)   // IN: random seed
+{
+   static char data[TEST_MAX_LONG_INPUT];
+   unsigned int mismatches = 0;
+   unsigned int i;
+
+   srand(seed);
+   for (i = 0; i < TEST_NUM_INPUTS; i++) {
+      size_t size = rand() % ((i % TEST_LONG_INPUT_RATE) == 0 ?
+                              TEST_MAX_LONG_INPUT : TEST_MAX_INPUT);
+      size_t j;
+
+      /* Mostly terminators, so empty lines and \r\n pairs are common. */
+      for (j = 0; j < size; j++) {
+         switch (rand() % 6) {
+         case 0:
+            data[j] = '\n';
+            break;
+         case 1:
+            data[j] = '\r';
+            break;
+         case 2:
+            data[j] = '\0';
+            break;
+         default:
+            data[j] = 'a' + rand() % 3;
+            break;
+         }
+      }
+
+      if (!TestCompare(data, size)) {
+         fprintf(stderr, "Input %u (seed %u, %u bytes) split differently\n",
+                 i, seed, (unsigned int)size);
+         mismatches++;
+      }
+   }
+
+   printf("%u of %u inputs split differently\n", mismatches, TEST_NUM_INPUTS);
+
+   return mismatches;
+}
+
+
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * TestMaxLineLength --
+ *
+ *      Checks that a line of the maximum length is returned and that a
+ *      longer one fails with E2BIG.
+ *
+ * Results:
+ *      TRUE on success, FALSE otherwise.
+ *
+ * Side effects:
+ *      None.
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+static Bool
+TestMaxLineLength(void)
+{
+   static const char data[] = "12345\n123456\n";
+   FILE *stream = TestOpen(data, sizeof data - 1);
+   StdIO_LineReader *reader;
+   StdIO_Status status;
+   char *line;
+   size_t count;
+   Bool ok = TRUE;
+
+   if (stream == NULL) {
+      return FALSE;
+   }
+
+   reader = StdIO_LineReaderCreate(stream, 5);
+   status = StdIO_LineReaderNext(reader, &line, &count);
+   if (status != StdIO_Success || count != 5 || strcmp(line, "12345") != 0) {
+      fprintf(stderr, "A line of the maximum length was not returned\n");
+      ok = FALSE;
+   }
+   errno = 0;
+   status = StdIO_LineReaderNext(reader, &line, &count);
+   if (status != StdIO_Error || errno != E2BIG) {
+      fprintf(stderr, "A line over the maximum length did not fail: %d\n",
+              status);
+      ok = FALSE;
+   }
+
+   StdIO_LineReaderDestroy(reader);
+   fclose(stream);
+
+   return ok;
+}
+
+
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * TestTime --
+ *
+ *      Times both readers on a file.
+ *
+ * Results:
+ *      TRUE on success, FALSE if the file cannot be read or the readers
+ *      returned different amounts of data.
+ *
+ * Side effects:
+ *      None.
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+static Bool
+TestTime(const char *path)   // IN: file to read
+{
+   StdIO_LineReader *reader;
+   FILE *stream;
+   uint64 start;
+   uint64 byteByByte;
+   uint64 buffered;
+   size_t total = 0;
+   char *line;
+   size_t count;
+
+   stream = fopen(path, "r");
+   if (stream == NULL) {
+      fprintf(stderr, "Cannot open %s: %s\n", path, strerror(errno));
+      return FALSE;
+   }
+   start = TestNowUS();
+   while (StdIO_ReadNextLine(stream, &line, 0, &count) == StdIO_Success) {
+      total += count;
+      free(line);
+   }
+   byteByByte = TestNowUS() - start;
+
+   rewind(stream);
+   start = TestNowUS();
+   reader = StdIO_LineReaderCreate(stream, 0);
+   while (StdIO_LineReaderNext(reader, &line, &count) == StdIO_Success) {
+      total -= count;
+   }
+   StdIO_LineReaderDestroy(reader);
+   buffered = TestNowUS() - start;
+   fclose(stream);
+
+   printf("%s: StdIO_ReadNextLine %.2f ms, StdIO_LineReader %.2f ms\n",
+          path, byteByByte / 1000.0, buffered / 1000.0);
+
+   /* Both readers must have returned the same number of bytes. */
+   return total == 0;
+}
+
+
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * TestUsage --
+ *
+ *      Prints the usage.
+ *
+ * Results:
+ *      None.
+ *
+ * Side effects:
+ *      None.
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+static void
+TestUsage(const char *name)   // IN: program name
+{
+   fprintf(stderr,
+           "Usage: %s [options]\n"
+           "  -s seed    random seed (default: 1)\n"
+           "  -f file    also time both readers on this file\n",
+           name);
+}
+
+
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * main --
+ *
+ *      Main entry point.
+ *
+ * Results:
+ *      EXIT_SUCCESS if the readers agree on every input.
+ *
+ * Side effects:
+ *      None.
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+int
+main(int argc,          // IN
+     char *argv[])      // IN
+{
+   unsigned int seed = 1;
+   const char *path = NULL;
+   Bool ok;
+   int opt;
+
+   while ((opt = getopt(argc, argv, "s:f:")) != -1) {
+      switch (opt) {
+      case 's':
+         seed = strtoul(optarg, NULL, 10);
+         break;
+      case 'f':
+         path = optarg;
+         break;
+      default:
+         TestUsage(argv[0]);
+         return EXIT_FAILURE;
+      }
+   }
+
+   ok = TestParity(seed) == 0;
+   ok = TestMaxLineLength() && ok;
+   if (path != NULL) {
+      ok = TestTime(path) && ok;
+   }
+
+   return ok ? EXIT_SUCCESS : EXIT_FAILURE;
+}
@@ -53,6 +53,7 @@ static gboolean gInvalidAppError = FALSE;
 static gboolean gInvalidAppProvider = FALSE;
 static gboolean gInvalidSigError = FALSE;
 static gboolean gValidAppRegistration = FALSE;
+static gboolean gDeferredInit = FALSE;
 
 
 /**
@@ -247,6 +248,11 @@ TestPluginShutdown(gpointer src,
    CU_ASSERT(gInvalidAppError);
    CU_ASSERT(gInvalidAppProvider);
    CU_ASSERT(gValidAppRegistration);
+
+   /* Deferred initialization does not run if the service stops first. */
+   if (!gDeferredInit) {
+      g_debug("shutdown before deferred initialization.");
+   }
 }
 
 
@@ -415,3 +421,26 @@ ToolsOnLoad(ToolsAppCtx *ctx)
    return &regData;
 }
 
+
+/**
+ * Deferred initialization entry point. This is called once by the service
+ * after all plugins have been registered, from the running main loop; make
+ * sure that's the case.
+ *
+ * @param[in]  ctx      The app context.
+ * @param[in]  plugin   Plugin registration data.
+ */
+
+TOOLS_MODULE_EXPORT void
+ToolsOnLoadDeferred(ToolsAppCtx *ctx,
+                    ToolsPluginData *plugin)
+{
+   vm_info("deferred initialization of test plugin...");
+
+   CU_ASSERT(ctx != NULL);
+   CU_ASSERT_STRING_EQUAL(plugin->name, "testPlugin");
+   CU_ASSERT(g_main_loop_is_running(ctx->mainLoop));
+   CU_ASSERT(gValidAppRegistration);
+   CU_ASSERT(!gDeferredInit);
+   gDeferredInit = TRUE;
+}
@@ -0,0 +1,436 @@
+/*********************************************************
+ * Copyright (C) 2008-2016 VMware, Inc. All rights reserved.
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU Lesser General Public License as published
+ * by the Free Software Foundation version 2.1 and no later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+ * or FITNESS FOR A PARTICULAR PURPOSE.  See the Lesser GNU General Public
+ * License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin St, Fifth Floor, Boston, MA  02110-1301 USA.
+ *
+ *********************************************************/
+
+/*
+ * block-table-bench.c --
+ *
+ *      Stress test and throughput benchmark for the vmblock block table.
+ *      Links the shared block.c directly against the vmblock-fuse os.h, so
+ *      neither FUSE nor a mounted file system is needed.
+ *
+ *      Accessor threads look up random files the way the vmblock-fuse
+ *      getattr/open/readlink handlers do, waiting on any block they find.
+ *      A blocker thread keeps lifting and re-adding blocks on a subset of
+ *      the files, and a churn thread adds and removes short-lived blocks.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <sys/time.h>
+
+#include "os.h"
+#include "block.h"
+
+#define MAX_ACCESSORS   64
+#define CHURN_FILES     256
+
+typedef struct AccessorInfo {
+   pthread_t thread;
+   unsigned int seed;
+   unsigned long lookups;
+   unsigned long waits;
+} AccessorInfo;
+
+#ifdef VMX86_DEVEL
+int LOGLEVEL_THRESHOLD = 0;
+#endif
+
+static char blockerTag;
+static char churnTag;
+static char otherTag;
+#define BLOCKER_ID      ((os_blocker_id_t)&blockerTag)
+#define CHURN_ID        ((os_blocker_id_t)&churnTag)
+#define OTHER_ID        ((os_blocker_id_t)&otherTag)
+
+static char **fileNames;
+static char **churnNames;
+static unsigned int numFiles = 4096;
+static unsigned int numBlocked = 64;
+static volatile Bool accessorsQuit = FALSE;
+static volatile Bool blockersQuit = FALSE;
+static unsigned long blockerOps;
+static unsigned long churnOps;
+
+
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * NowUsec --
+ *
+ *      Returns the current time in microseconds.
+ *
+ * Results:
+ *      Time in microseconds.
+ *
+ * Side effects:
+ *      None.
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+static double
+NowUsec(void)
+{
+   struct timeval tv;
+
+   gettimeofday(&tv, NULL);
+   return tv.tv_sec * 1000000.0 + tv.tv_usec;
+}
+
+
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * MakeNames --
+ *
+ *      Builds an array of file names that look like the ones DnD blocks.
+ *
+ * Results:
+ *      The array.
+ *
+ * Side effects:
+ *      Exits on allocation failure.
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+static char **
+MakeNames(const char *dir,     // IN: directory component
+          unsigned int count)  // IN: number of names
+{
+   char **names = calloc(count, sizeof *names);
+   unsigned int i;
+
+   if (names == NULL) {
+      fprintf(stderr, "out of memory\n");
+      exit(EXIT_FAILURE);
+   }
+
+   for (i = 0; i < count; i++) {
+      names[i] = malloc(64);
+      if (names[i] == NULL) {
+         fprintf(stderr, "out of memory\n");
+         exit(EXIT_FAILURE);
+      }
+      snprintf(names[i], 64, "/tmp/VMwareDnD/%s/file%u.dat", dir, i);
+   }
+
+   return names;
+}
+
+
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * CheckSemantics --
+ *
+ *      Single-threaded checks of the add/lookup/remove contract.
+ *
+ * Results:
+ *      TRUE if all checks pass.
+ *
+ * Side effects:
+ *      Leaves the block table empty.
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+static Bool
+CheckSemantics(void)
+{
+   const char *name = "/tmp/VMwareDnD/semantics/foo";
+   BlockHandle handle;
+   unsigned int i;
+
+#define CHECK(cond)                                                     \
+   do {                                                                 \
+      if (!(cond)) {                                                    \
+         fprintf(stderr, "%s:%d: check failed: %s\n",                   \
+                 __FILE__, __LINE__, #cond);                            \
+         return FALSE;                                                  \
+      }                                                                 \
+   } while (0)
+
+   CHECK(BlockLookup(name, OS_UNKNOWN_BLOCKER) == NULL);
+   CHECK(BlockWaitOnFile(name, NULL) == 0);
+   CHECK(BlockAddFileBlock(name, BLOCKER_ID) == 0);
+   CHECK(BlockAddFileBlock(name, BLOCKER_ID) == OS_EEXIST);
+   CHECK(BlockAddFileBlock(name, OTHER_ID) == OS_EEXIST);
+   CHECK(BlockLookup(name, OTHER_ID) == NULL);
+   CHECK(BlockRemoveFileBlock(name, OTHER_ID) == OS_ENOENT);
+
+   handle = BlockLookup(name, OS_UNKNOWN_BLOCKER);
+   CHECK(handle != NULL);
+   CHECK(BlockLookup(name, BLOCKER_ID) == handle);
+   CHECK(BlockRemoveFileBlock(name, BLOCKER_ID) == 0);
+   CHECK(BlockLookup(name, OS_UNKNOWN_BLOCKER) == NULL);
+
+   /* Both references are still valid after the block has been lifted. */
+   CHECK(BlockWaitOnFile(name, handle) == 0);
+   CHECK(BlockWaitOnFile(name, handle) == 0);
+
+   for (i = 0; i < numFiles; i++) {
+      CHECK(BlockAddFileBlock(fileNames[i],
+                              (i & 1) ? BLOCKER_ID : OTHER_ID) == 0);
+   }
+   for (i = 0; i < numFiles; i++) {
+      handle = BlockLookup(fileNames[i], OS_UNKNOWN_BLOCKER);
+      CHECK(handle != NULL);
+      CHECK(BlockLookup(fileNames[i], (i & 1) ? OTHER_ID : BLOCKER_ID) == NULL);
+      BlockRemoveFileBlock(fileNames[i], (i & 1) ? BLOCKER_ID : OTHER_ID);
+      CHECK(BlockWaitOnFile(fileNames[i], handle) == 0);
+      if (i % 2 == 0) {
+         CHECK(BlockAddFileBlock(fileNames[i], OTHER_ID) == 0);
+      }
+   }
+   CHECK(BlockRemoveAllBlocks(BLOCKER_ID) == 0);
+   CHECK(BlockRemoveAllBlocks(OTHER_ID) == (numFiles + 1) / 2);
+   CHECK(BlockRemoveAllBlocks(OS_UNKNOWN_BLOCKER) == 0);
+
+#undef CHECK
+
+   return TRUE;
+}
+
+
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * Accessor --
+ *
+ *      Looks up random files, waiting on the ones that are blocked.
+ *
+ * Results:
+ *      NULL.
+ *
+ * Side effects:
+ *      None.
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+static void *
+Accessor(void *arg)  // IN: AccessorInfo
+{
+   AccessorInfo *info = arg;
+
+   while (!accessorsQuit) {
+      const char *name = fileNames[rand_r(&info->seed) % numFiles];
+      BlockHandle handle = BlockLookup(name, OS_UNKNOWN_BLOCKER);
+
+      info->lookups++;
+      if (handle != NULL) {
+         BlockWaitOnFile(name, handle);
+         info->waits++;
+      }
+   }
+
+   return NULL;
+}
+
+
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * Blocker --
+ *
+ *      Repeatedly lifts and re-adds the blocks on the first numBlocked files,
+ *      waking any accessors waiting on them.
+ *
+ * Results:
+ *      NULL.
+ *
+ * Side effects:
+ *      None.
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+static void *
+Blocker(void *arg)  // IN: unused
+{
+   unsigned int i = 0;
+
+   while (!blockersQuit) {
+      const char *name = fileNames[i];
+
+      if (BlockRemoveFileBlock(name, BLOCKER_ID) != 0 ||
+          BlockAddFileBlock(name, BLOCKER_ID) != 0) {
+         fprintf(stderr, "blocker: unexpected result on %s\n", name);
+         abort();
+      }
+      blockerOps += 2;
+      i = (i + 1) % numBlocked;
+   }
+
+   return NULL;
+}
+
+
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * Churn --
+ *
+ *      Adds and removes short-lived blocks on files nobody looks up, the way
+ *      a large drag and drop operation does.
+ *
+ * Results:
+ *      NULL.
+ *
+ * Side effects:
+ *      None.
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+static void *
+Churn(void *arg)  // IN: unused
+{
+   unsigned int i;
+
+   while (!blockersQuit) {
+      for (i = 0; i < CHURN_FILES; i++) {
+         if (BlockAddFileBlock(churnNames[i], CHURN_ID) != 0) {
+            fprintf(stderr, "churn: add failed on %s\n", churnNames[i]);
+            abort();
+         }
+      }
+      for (i = 0; i < CHURN_FILES; i++) {
+         if (BlockRemoveFileBlock(churnNames[i], CHURN_ID) != 0) {
+            fprintf(stderr, "churn: remove failed on %s\n", churnNames[i]);
+            abort();
+         }
+      }
+      churnOps += 2 * CHURN_FILES;
+   }
+
+   return NULL;
+}
+
+
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * main --
+ *
+ *      Usage: vmware-testvmblock-table [threads [seconds [files [blocked]]]]
+ *
+ * Results:
+ *      EXIT_SUCCESS or EXIT_FAILURE.
+ *
+ * Side effects:
+ *      None.
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+int
+main(int argc,
+     char *argv[])
+{
+   AccessorInfo accessors[MAX_ACCESSORS];
+   unsigned int numAccessors = 4;
+   unsigned int seconds = 5;
+   unsigned long lookups = 0;
+   unsigned long waits = 0;
+   pthread_t blockerThread;
+   pthread_t churnThread;
+   double start;
+   double elapsed;
+   unsigned int i;
+
+   if (argc > 1) {
+      numAccessors = atoi(argv[1]);
+   }
+   if (argc > 2) {
+      seconds = atoi(argv[2]);
+   }
+   if (argc > 3) {
+      numFiles = atoi(argv[3]);
+   }
+   if (argc > 4) {
+      numBlocked = atoi(argv[4]);
+   }
+   if (numAccessors == 0 || numAccessors > MAX_ACCESSORS ||
+       numFiles == 0 || numBlocked == 0 || numBlocked > numFiles) {
+      fprintf(stderr, "usage: %s [threads (1-%d) [seconds [files "
+              "[blocked (1-files)]]]]\n", argv[0], MAX_ACCESSORS);
+      return EXIT_FAILURE;
+   }
+
+   fileNames = MakeNames("accessed", numFiles);
+   churnNames = MakeNames("churn", CHURN_FILES);
+
+   if (BlockInit() != 0) {
+      fprintf(stderr, "BlockInit failed\n");
+      return EXIT_FAILURE;
+   }
+
+   if (!CheckSemantics()) {
+      return EXIT_FAILURE;
+   }
+
+   for (i = 0; i < numBlocked; i++) {
+      BlockAddFileBlock(fileNames[i], BLOCKER_ID);
+   }
+
+   start = NowUsec();
+   pthread_create(&blockerThread, NULL, Blocker, NULL);
+   pthread_create(&churnThread, NULL, Churn, NULL);
+   for (i = 0; i < numAccessors; i++) {
+      memset(&accessors[i], 0, sizeof accessors[i]);
+      accessors[i].seed = i + 1;
+      pthread_create(&accessors[i].thread, NULL, Accessor, &accessors[i]);
+   }
+
+   sleep(seconds);
+
+   /*
+    * Stop the blockers first and lift whatever they left behind, so that no
+    * accessor is left waiting on a block nobody will remove.
+    */
+   blockersQuit = TRUE;
+   pthread_join(blockerThread, NULL);
+   pthread_join(churnThread, NULL);
+   accessorsQuit = TRUE;
+   BlockRemoveAllBlocks(OS_UNKNOWN_BLOCKER);
+
+   for (i = 0; i < numAccessors; i++) {
+      pthread_join(accessors[i].thread, NULL);
+      lookups += accessors[i].lookups;
+      waits += accessors[i].waits;
+   }
+   elapsed = (NowUsec() - start) / 1000000.0;
+
+   BlockCleanup();
+
+   printf("%u accessors, %u files (%u blocked), %.2f s\n",
+          numAccessors, numFiles, numBlocked, elapsed);
+   printf("  lookups:        %12lu (%.0f/s, %lu waited)\n",
+          lookups, lookups / elapsed, waits);
+   printf("  blocker ops:    %12lu (%.0f/s)\n",
+          blockerOps, blockerOps / elapsed);
+   printf("  churn ops:      %12lu (%.0f/s)\n",
+          churnOps, churnOps / elapsed);
+
+   return EXIT_SUCCESS;
+}
@@ -0,0 +1,238 @@
+/*********************************************************
+ * Copyright (C) 2016 VMware, Inc. All rights reserved.
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU Lesser General Public License as published
+ * by the Free Software Foundation version 2.1 and no later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+ * or FITNESS FOR A PARTICULAR PURPOSE.  See the Lesser GNU General Public
+ * License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin St, Fifth Floor, Boston, MA  02110-1301 USA.
+ *
+ *********************************************************/
+
+/*
+ * vixAuthBench.c --
+ *
+ *      Benchmark of name/password authentication in the vix plugin, which
+ *      every guest operation started with those credentials goes through.
+ *      VixToolsAuthenticateUser() is timed:
+ *
+ *      - uncached: with the cache off (the default), so every call runs
+ *                  the PAM stack of the vmtoolsd service;
+ *      - cached:   with a cache lifetime set, so after the first call a
+ *                  call only hashes the credentials, stats the account
+ *                  databases and looks up the account.
+ *
+ *      It also checks that a wrong password is refused with the right one
+ *      cached. PAM usually delays failures, so that check takes a while.
+ *
+ *      The password is read from the first line of stdin. Run as root, or
+ *      as the user being authenticated, so that PAM can check passwords.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/time.h>
+
+#include "vmware.h"
+#include "auth.h"
+#include "str.h"
+#include "vixToolsInt.h"
+
+#define BENCH_CACHE_TIMEOUT    300
+
+
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * BenchNowUS --
+ *
+ *      Returns the current time in microseconds.
+ *
+ * Results:
+ *      The time.
+ *
+ * Side effects:
+ *      None.
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+static uint64
+BenchNowUS(void)
+{
+   struct timeval tv;
+
+   gettimeofday(&tv, NULL);
+   return (uint64)tv.tv_sec * 1000000 + tv.tv_usec;
+}
+
+
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * BenchAuthenticate --
+ *
+ *      Authenticates the user a number of times.
+ *
+ * Results:
+ *      The average time per call in microseconds, or a negative value if
+ *      a call failed.
+ *
+ * Side effects:
+ *      Updates the authentication cache.
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+static double
+BenchAuthenticate(const char *userName,      // IN
+                  const char *password,      // IN
+                  int cacheTimeout,          // IN
+                  unsigned int iterations)   // IN
+{
+   uint64 start = BenchNowUS();
+   unsigned int i;
+
+   for (i = 0; i < iterations; i++) {
+      AuthToken token = VixToolsAuthenticateUser(userName, password,
+                                                 cacheTimeout);
+
+      if (NULL == token) {
+         fprintf(stderr, "Authentication of '%s' failed.\n", userName);
+         return -1.0;
+      }
+      Auth_CloseToken(token);
+   }
+
+   return (double)(BenchNowUS() - start) / iterations;
+}
+
+
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * BenchUsage --
+ *
+ *      Prints the usage.
+ *
+ * Results:
+ *      None.
+ *
+ * Side effects:
+ *      None.
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+static void
+BenchUsage(const char *name)   // IN: program name
+{
+   fprintf(stderr,
+           "Usage: %s -u user [options] < password-file\n"
+           "  -u user    user to authenticate\n"
+           "  -n count   authentications per run (default: 50)\n",
+           name);
+}
+
+
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * main --
+ *
+ *      Main entry point.
+ *
+ * Results:
+ *      EXIT_SUCCESS if the right password was always accepted and the wrong
+ *      one refused.
+ *
+ * Side effects:
+ *      None.
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+int
+main(int argc,          // IN
+     char *argv[])      // IN
+{
+   const char *userName = NULL;
+   unsigned int iterations = 50;
+   char password[256];
+   char *wrongPassword;
+   AuthToken token;
+   double uncachedUS;
+   double firstUS;
+   double cachedUS;
+   size_t len;
+   int opt;
+
+   while ((opt = getopt(argc, argv, "u:n:")) != -1) {
+      switch (opt) {
+      case 'u':
+         userName = optarg;
+         break;
+      case 'n':
+         iterations = strtoul(optarg, NULL, 10);
+         break;
+      default:
+         BenchUsage(argv[0]);
+         return EXIT_FAILURE;
+      }
+   }
+
+   if (NULL == userName || iterations == 0) {
+      BenchUsage(argv[0]);
+      return EXIT_FAILURE;
+   }
+
+   if (fgets(password, sizeof password, stdin) == NULL) {
+      fprintf(stderr, "Cannot read the password from stdin.\n");
+      return EXIT_FAILURE;
+   }
+   len = strcspn(password, "\r\n");
+   password[len] = '\0';
+
+   uncachedUS = BenchAuthenticate(userName, password, 0, iterations);
+   if (uncachedUS < 0) {
+      return EXIT_FAILURE;
+   }
+
+   VixToolsAuthCacheFlush();
+   firstUS = BenchAuthenticate(userName, password, BENCH_CACHE_TIMEOUT, 1);
+   cachedUS = BenchAuthenticate(userName, password, BENCH_CACHE_TIMEOUT,
+                                iterations);
+   if (firstUS < 0 || cachedUS < 0) {
+      return EXIT_FAILURE;
+   }
+
+   wrongPassword = Str_Asprintf(NULL, "%s-wrong", password);
+   token = VixToolsAuthenticateUser(userName, wrongPassword,
+                                    BENCH_CACHE_TIMEOUT);
+   free(wrongPassword);
+   memset(password, 0, sizeof password);
+   VixToolsAuthCacheFlush();
+
+   if (NULL != token) {
+      fprintf(stderr, "A wrong password was accepted with the cache on.\n");
+      Auth_CloseToken(token);
+      return EXIT_FAILURE;
+   }
+
+   printf("%u authentications of '%s' per run\n", iterations, userName);
+   printf("%-24s %12.1f us\n", "uncached", uncachedUS);
+   printf("%-24s %12.1f us\n", "cached, first (miss)", firstUS);
+   printf("%-24s %12.1f us\n", "cached", cachedUS);
+   printf("%-24s %12.1fx\n", "speedup", uncachedUS / cachedUS);
+
+   return EXIT_SUCCESS;
+}
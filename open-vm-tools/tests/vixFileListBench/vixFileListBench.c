@@ -0,0 +1,444 @@
+/*********************************************************
+ * Copyright (C) 2016 VMware, Inc. All rights reserved.
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU Lesser General Public License as published
+ * by the Free Software Foundation version 2.1 and no later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+ * or FITNESS FOR A PARTICULAR PURPOSE.  See the Lesser GNU General Public
+ * License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin St, Fifth Floor, Boston, MA  02110-1301 USA.
+ *
+ *********************************************************/
+
+/*
+ * vixFileListBench.c --
+ *
+ *      Metadata collection benchmark for the vix file listing commands.
+ *
+ *      Fills a directory under each of the given paths with many entries
+ *      (mostly regular files, some directories and symlinks) and collects
+ *      what ListDirectory/GetFileInfo and ListFiles report about every
+ *      entry, in two ways:
+ *
+ *      - path:  the File_* calls on the full path the commands used to make,
+ *               one lookup per question;
+ *      - dirfd: VixToolsGetFileStat() relative to the open directory, as
+ *               they do now.
+ *
+ *      Run it once per file system of interest, e.g. on /dev/shm and on an
+ *      ext4 directory. The caches are warm; the cost measured is the path
+ *      walking and the system calls, not the disk.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include <sys/time.h>
+
+#include "vmware.h"
+#include "file.h"
+#include "posix.h"
+#include "str.h"
+#include "util.h"
+#include "vixToolsInt.h"
+
+typedef enum {
+   BENCH_INFO_PATH,
+   BENCH_INFO_DIRFD,
+   BENCH_EXT_PATH,
+   BENCH_EXT_DIRFD,
+   BENCH_NUM_MODES,
+} BenchMode;
+
+static const char *benchModeNames[BENCH_NUM_MODES] = {
+   "info path", "info dirfd", "ext path", "ext dirfd",
+};
+
+
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * BenchNowUS --
+ *
+ *      Returns the current time in microseconds.
+ *
+ * Results:
+ *      The time.
+ *
+ * Side effects:
+ *      None.
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+static uint64
+BenchNowUS(void)
+{
+   struct timeval tv;
+
+   gettimeofday(&tv, NULL);
+   return (uint64)tv.tv_sec * 1000000 + tv.tv_usec;
+}
+
+
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * BenchPopulate --
+ *
+ *      Creates count entries in dirPath: every 64th is a directory, every
+ *      16th a symlink to the previous entry and the rest small files.
+ *
+ * Results:
+ *      TRUE on success.
+ *
+ * Side effects:
+ *      Creates files.
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+static Bool
+BenchPopulate(const char *dirPath,   // IN
+              unsigned int count)    // IN
+{
+   unsigned int i;
+
+   for (i = 0; i < count; i++) {
+      char *path = Str_SafeAsprintf(NULL, "%s/entry%07u", dirPath, i);
+      int ret;
+
+      if (i % 64 == 63) {
+         ret = mkdir(path, 0755);
+      } else if (i % 16 == 15) {
+         char target[16];
+
+         Str_Sprintf(target, sizeof target, "entry%07u", i - 1);
+         ret = symlink(target, path);
+      } else {
+         int fd = open(path, O_WRONLY | O_CREAT | O_EXCL, 0644);
+
+         ret = fd;
+         if (fd >= 0) {
+            ret = write(fd, path, i % 512) == i % 512 ? 0 : -1;
+            close(fd);
+         }
+      }
+
+      if (ret < 0) {
+         fprintf(stderr, "Cannot create %s: %s\n", path, strerror(errno));
+         free(path);
+         return FALSE;
+      }
+      free(path);
+   }
+
+   return TRUE;
+}
+
+
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * BenchCollect --
+ *
+ *      Collects the metadata of every entry in the given mode.
+ *
+ * Results:
+ *      A checksum of what was collected, the same for both ways of
+ *      collecting the same information.
+ *
+ * Side effects:
+ *      None.
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+static uint64
+BenchCollect(BenchMode mode,           // IN
+             const char *dirPath,      // IN
+             char **names,             // IN
+             int numNames)             // IN
+{
+   uint64 sum = 0;
+   int dirFd = -1;
+   int i;
+
+   if (mode == BENCH_INFO_DIRFD || mode == BENCH_EXT_DIRFD) {
+      dirFd = VixToolsOpenDirectory(dirPath);
+   }
+
+   for (i = 0; i < numNames; i++) {
+      char *pathName = Str_SafeAsprintf(NULL, "%s%s%s", dirPath, DIRSEPS,
+                                        names[i]);
+      VixToolsFileStat fileStat;
+      struct stat statbuf;
+      int64 fileSize = 0;
+      int64 modTime = -1;
+      int type = 0;
+      char *target = NULL;
+
+      switch (mode) {
+      case BENCH_INFO_PATH:
+         /* What VixToolsPrintFileInfo() used to ask. */
+         modTime = File_GetModTime(pathName);
+         if (File_IsDirectory(pathName)) {
+            type = 1;
+         } else {
+            if (File_IsSymLink(pathName)) {
+               type = 2;
+            }
+            if (File_IsFile(pathName)) {
+               fileSize = File_GetSize(pathName);
+            }
+         }
+         break;
+      case BENCH_EXT_PATH:
+         /*
+          * What VixToolsGetFileExtendedInfoLength() and
+          * VixToolsPrintFileExtendedInfo() used to ask.
+          */
+         if (File_IsSymLink(pathName)) {
+            free(Posix_ReadLink(pathName));
+         }
+         if (File_IsSymLink(pathName)) {
+            type = 2;
+            target = Posix_ReadLink(pathName);
+         } else if (File_IsDirectory(pathName)) {
+            type = 1;
+         } else if (File_IsFile(pathName)) {
+            fileSize = File_GetSize(pathName);
+         }
+         if (Posix_Stat(pathName, &statbuf) == 0) {
+            modTime = statbuf.st_mtime;
+         }
+         break;
+      case BENCH_INFO_DIRFD:
+      case BENCH_EXT_DIRFD:
+         VixToolsGetFileStat(dirFd, pathName, names[i],
+                             mode == BENCH_EXT_DIRFD, &fileStat);
+         if (fileStat.statOk) {
+            modTime = fileStat.statbuf.st_mtime;
+         }
+         if (mode == BENCH_INFO_DIRFD) {
+            if (fileStat.isDirectory) {
+               type = 1;
+            } else {
+               if (fileStat.isSymLink) {
+                  type = 2;
+               }
+               if (fileStat.isFile) {
+                  fileSize = fileStat.fileSize;
+               }
+            }
+         } else if (fileStat.isSymLink) {
+            type = 2;
+         } else if (fileStat.isDirectory) {
+            type = 1;
+         } else if (fileStat.isFile) {
+            fileSize = fileStat.fileSize;
+         }
+         if (fileStat.symlinkTarget != NULL) {
+            target = Util_SafeStrdup(fileStat.symlinkTarget);
+         }
+         VixToolsFreeFileStat(&fileStat);
+         break;
+      default:
+         NOT_REACHED();
+      }
+
+      sum += type + 3 * fileSize + 7 * modTime +
+             (target != NULL ? 11 * strlen(target) : 0);
+      free(target);
+      free(pathName);
+   }
+
+   VixToolsCloseDirectory(dirFd);
+   return sum;
+}
+
+
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * BenchRemove --
+ *
+ *      Removes the entries created by BenchPopulate() and the directory.
+ *
+ * Results:
+ *      None.
+ *
+ * Side effects:
+ *      Removes files.
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+static void
+BenchRemove(const char *dirPath,   // IN
+            char **names,          // IN
+            int numNames)          // IN
+{
+   int i;
+
+   for (i = 0; i < numNames; i++) {
+      char *path = Str_SafeAsprintf(NULL, "%s/%s", dirPath, names[i]);
+
+      if (unlink(path) != 0 && errno == EISDIR) {
+         rmdir(path);
+      }
+      free(path);
+   }
+   rmdir(dirPath);
+}
+
+
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * BenchUsage --
+ *
+ *      Prints the usage.
+ *
+ * Results:
+ *      None.
+ *
+ * Side effects:
+ *      None.
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+static void
+BenchUsage(const char *name)   // IN: program name
+{
+   fprintf(stderr,
+           "Usage: %s [options] directory ...\n"
+           "  -n count   entries to create in each directory (default: 100000)\n"
+           "  -r count   rounds per mode; the best is reported (default: 3)\n",
+           name);
+}
+
+
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * main --
+ *
+ *      Main entry point.
+ *
+ * Results:
+ *      EXIT_SUCCESS if both ways collected the same information.
+ *
+ * Side effects:
+ *      Creates and removes a directory in every given directory.
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+int
+main(int argc,          // IN
+     char *argv[])      // IN
+{
+   unsigned int count = 100000;
+   unsigned int rounds = 3;
+   unsigned int failures = 0;
+   int opt;
+
+   while ((opt = getopt(argc, argv, "n:r:")) != -1) {
+      switch (opt) {
+      case 'n':
+         count = strtoul(optarg, NULL, 10);
+         break;
+      case 'r':
+         rounds = strtoul(optarg, NULL, 10);
+         break;
+      default:
+         BenchUsage(argv[0]);
+         return EXIT_FAILURE;
+      }
+   }
+
+   if (count == 0 || rounds == 0 || optind == argc) {
+      BenchUsage(argv[0]);
+      return EXIT_FAILURE;
+   }
+
+   printf("%-24s %8s  %-10s %9s %9s %11s\n", "directory", "entries", "mode",
+          "best(ms)", "ns/entry", "entries/s");
+   fflush(stdout);
+
+   for (; optind < argc; optind++) {
+      char *dirPath = Str_SafeAsprintf(NULL, "%s/vixFileListBench.%d",
+                                       argv[optind], (int)getpid());
+      uint64 sums[BENCH_NUM_MODES];
+      char **names = NULL;
+      int numNames = -1;
+      BenchMode mode;
+
+      if (mkdir(dirPath, 0755) != 0) {
+         fprintf(stderr, "Cannot create %s: %s\n", dirPath, strerror(errno));
+         free(dirPath);
+         failures++;
+         continue;
+      }
+
+      if (!BenchPopulate(dirPath, count)) {
+         failures++;
+         goto next;
+      }
+
+      numNames = File_ListDirectory(dirPath, &names);
+      if (numNames < 0) {
+         fprintf(stderr, "Cannot list %s\n", dirPath);
+         failures++;
+         goto next;
+      }
+
+      for (mode = 0; mode < BENCH_NUM_MODES; mode++) {
+         uint64 best = ~0ULL;
+         unsigned int r;
+
+         for (r = 0; r < rounds; r++) {
+            uint64 start = BenchNowUS();
+
+            sums[mode] = BenchCollect(mode, dirPath, names, numNames);
+            best = MIN(best, BenchNowUS() - start);
+         }
+
+         printf("%-24s %8d  %-10s %9.1f %9.0f %11.0f\n", argv[optind],
+                numNames, benchModeNames[mode], best / 1e3,
+                best * 1e3 / numNames, numNames / (best / 1e6));
+         fflush(stdout);
+      }
+
+      if (sums[BENCH_INFO_PATH] != sums[BENCH_INFO_DIRFD] ||
+          sums[BENCH_EXT_PATH] != sums[BENCH_EXT_DIRFD]) {
+         fprintf(stderr, "%s: path and dirfd collected different data\n",
+                 argv[optind]);
+         failures++;
+      }
+
+next:
+      if (numNames < 0) {
+         numNames = File_ListDirectory(dirPath, &names);
+      }
+      if (numNames >= 0) {
+         BenchRemove(dirPath, names, numNames);
+         Util_FreeStringList(names, numNames);
+      }
+      free(dirPath);
+   }
+
+   return failures == 0 ? EXIT_SUCCESS : EXIT_FAILURE;
+}
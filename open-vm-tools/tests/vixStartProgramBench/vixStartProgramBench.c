@@ -0,0 +1,458 @@
+/*********************************************************
+ * Copyright (C) 2016 VMware, Inc. All rights reserved.
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU Lesser General Public License as published
+ * by the Free Software Foundation version 2.1 and no later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+ * or FITNESS FOR A PARTICULAR PURPOSE.  See the Lesser GNU General Public
+ * License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin St, Fifth Floor, Boston, MA  02110-1301 USA.
+ *
+ *********************************************************/
+
+/*
+ * vixStartProgramBench.c --
+ *
+ *      Completion latency benchmark for programs started the way the vix
+ *      plugin starts them.
+ *
+ *      Launches many short-lived programs with ProcMgr_ExecAsync from a
+ *      glib main loop, keeping a number of them in flight, and notices
+ *      their exit either by polling every second, as StartProgram and
+ *      RunProgram used to, or by watching the process' selectable, as
+ *      they do now. Reports throughput and the time from launch until the
+ *      exit was seen.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/time.h>
+#include <glib.h>
+
+#include "vmware.h"
+#include "procMgr.h"
+#include "util.h"
+
+/* Same interval as SECONDS_BETWEEN_POLL_TEST_FINISHED in vixTools.c. */
+#define BENCH_POLL_INTERVAL_MS   1000
+
+typedef enum {
+   BENCH_POLL,
+   BENCH_WATCH,
+   BENCH_NUM_MODES,
+} BenchMode;
+
+static const char *benchModeNames[BENCH_NUM_MODES] = {
+   "poll", "watch",
+};
+
+typedef struct BenchProc {
+   ProcMgr_AsyncProc *proc;
+   uint64 startUS;
+} BenchProc;
+
+static struct {
+   BenchMode mode;
+   char **argv;
+   unsigned int count;
+   unsigned int concurrency;
+   unsigned int launched;
+   unsigned int completed;
+   unsigned int inFlight;
+   unsigned int failures;
+   uint64 *latencies;
+   GMainLoop *loop;
+} gBench;
+
+static void BenchLaunchMore(void);
+
+
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * BenchNowUS --
+ *
+ *      Returns the current time in microseconds.
+ *
+ * Results:
+ *      The time.
+ *
+ * Side effects:
+ *      None.
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+static uint64
+BenchNowUS(void)
+{
+   struct timeval tv;
+
+   gettimeofday(&tv, NULL);
+   return (uint64)tv.tv_sec * 1000000 + tv.tv_usec;
+}
+
+
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * BenchCompare --
+ *
+ *      qsort comparison function for latencies.
+ *
+ * Results:
+ *      <0, 0 or >0.
+ *
+ * Side effects:
+ *      None.
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+static int
+BenchCompare(const void *a,   // IN
+             const void *b)   // IN
+{
+   uint64 x = *(const uint64 *)a;
+   uint64 y = *(const uint64 *)b;
+
+   return x < y ? -1 : x > y;
+}
+
+
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * BenchReap --
+ *
+ *      Collects an exited program, records how long it took to notice and
+ *      starts the next one.
+ *
+ * Results:
+ *      None.
+ *
+ * Side effects:
+ *      Frees bp. Quits the main loop after the last program.
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+static void
+BenchReap(BenchProc *bp)   // IN
+{
+   int exitCode;
+
+   if (ProcMgr_GetExitCode(bp->proc, &exitCode) != 0 || exitCode != 0) {
+      gBench.failures++;
+   }
+   gBench.latencies[gBench.completed++] = BenchNowUS() - bp->startUS;
+   gBench.inFlight--;
+
+   ProcMgr_Free(bp->proc);
+   free(bp);
+
+   if (gBench.completed == gBench.count) {
+      g_main_loop_quit(gBench.loop);
+   } else {
+      BenchLaunchMore();
+   }
+}
+
+
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * BenchPollCb --
+ *
+ *      Timer callback for the poll mode; checks whether the program is
+ *      done and re-arms the timer if not.
+ *
+ * Results:
+ *      FALSE, the timer is one-shot.
+ *
+ * Side effects:
+ *      None.
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+static gboolean
+BenchPollCb(gpointer data)   // IN
+{
+   BenchProc *bp = data;
+
+   if (ProcMgr_IsAsyncProcRunning(bp->proc)) {
+      GSource *timer = g_timeout_source_new(BENCH_POLL_INTERVAL_MS);
+
+      g_source_set_callback(timer, BenchPollCb, bp, NULL);
+      g_source_attach(timer, NULL);
+      g_source_unref(timer);
+   } else {
+      BenchReap(bp);
+   }
+
+   return FALSE;
+}
+
+
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * BenchWatchCb --
+ *
+ *      Selectable watch callback for the watch mode.
+ *
+ * Results:
+ *      FALSE once the program is done.
+ *
+ * Side effects:
+ *      None.
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+static gboolean
+BenchWatchCb(GIOChannel *chan,    // IN: unused
+             GIOCondition cond,   // IN: unused
+             gpointer data)       // IN
+{
+   BenchProc *bp = data;
+
+   if (ProcMgr_IsAsyncProcRunning(bp->proc)) {
+      return TRUE;
+   }
+
+   BenchReap(bp);
+   return FALSE;
+}
+
+
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * BenchLaunchMore --
+ *
+ *      Starts programs until the concurrency limit or the total count is
+ *      reached.
+ *
+ * Results:
+ *      None.
+ *
+ * Side effects:
+ *      Attaches sources to the default main context.
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+static void
+BenchLaunchMore(void)
+{
+   while (gBench.inFlight < gBench.concurrency &&
+          gBench.launched < gBench.count) {
+      BenchProc *bp = Util_SafeMalloc(sizeof *bp);
+      GSource *src;
+
+      gBench.launched++;
+      bp->startUS = BenchNowUS();
+      bp->proc = ProcMgr_ExecAsyncArgv(gBench.argv, NULL);
+      if (bp->proc == NULL) {
+         gBench.failures++;
+         gBench.latencies[gBench.completed++] = 0;
+         free(bp);
+         continue;
+      }
+      gBench.inFlight++;
+
+      if (gBench.mode == BENCH_POLL) {
+         src = g_timeout_source_new(BENCH_POLL_INTERVAL_MS);
+         g_source_set_callback(src, BenchPollCb, bp, NULL);
+      } else {
+         GIOChannel *chan;
+
+         chan = g_io_channel_unix_new(ProcMgr_GetAsyncProcSelectable(bp->proc));
+         src = g_io_create_watch(chan, G_IO_IN | G_IO_HUP | G_IO_ERR);
+         g_io_channel_unref(chan);
+         g_source_set_callback(src, (GSourceFunc) BenchWatchCb, bp, NULL);
+      }
+      g_source_attach(src, NULL);
+      g_source_unref(src);
+   }
+
+   /* Every launch failed; nothing will wake the loop up. */
+   if (gBench.completed == gBench.count && gBench.inFlight == 0) {
+      g_main_loop_quit(gBench.loop);
+   }
+}
+
+
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * BenchRun --
+ *
+ *      Runs count programs in the given mode and prints the results.
+ *
+ * Results:
+ *      Number of failed programs.
+ *
+ * Side effects:
+ *      None.
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+static unsigned int
+BenchRun(BenchMode mode)   // IN
+{
+   uint64 start;
+   uint64 elapsed;
+   uint64 total = 0;
+   unsigned int i;
+
+   gBench.mode = mode;
+   gBench.launched = 0;
+   gBench.completed = 0;
+   gBench.inFlight = 0;
+   gBench.failures = 0;
+
+   start = BenchNowUS();
+   BenchLaunchMore();
+   if (gBench.completed < gBench.count) {
+      g_main_loop_run(gBench.loop);
+   }
+   elapsed = BenchNowUS() - start;
+
+   for (i = 0; i < gBench.count; i++) {
+      total += gBench.latencies[i];
+   }
+   qsort(gBench.latencies, gBench.count, sizeof *gBench.latencies,
+         BenchCompare);
+
+   printf("%-6s %7u %5u %9.2f %9.1f %9.2f %9.2f %9.2f %9.2f %6u\n",
+          benchModeNames[mode], gBench.count, gBench.concurrency,
+          elapsed / 1e6, gBench.count / (elapsed / 1e6),
+          total / 1e3 / gBench.count,
+          gBench.latencies[gBench.count / 2] / 1e3,
+          gBench.latencies[(gBench.count * 99) / 100] / 1e3,
+          gBench.latencies[gBench.count - 1] / 1e3, gBench.failures);
+   fflush(stdout);
+
+   return gBench.failures;
+}
+
+
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * BenchUsage --
+ *
+ *      Prints the usage.
+ *
+ * Results:
+ *      None.
+ *
+ * Side effects:
+ *      None.
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+static void
+BenchUsage(const char *name)   // IN: program name
+{
+   fprintf(stderr,
+           "Usage: %s [options]\n"
+           "  -n count   programs per mode (default: 2000)\n"
+           "  -j count   programs in flight at once (default: 32)\n"
+           "  -m mode    'poll', 'watch' or 'all' (default: all)\n"
+           "  -c path    program to run, without arguments (default: /bin/true)\n",
+           name);
+}
+
+
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * main --
+ *
+ *      Main entry point.
+ *
+ * Results:
+ *      EXIT_SUCCESS if every program ran and exited with 0.
+ *
+ * Side effects:
+ *      None.
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+int
+main(int argc,          // IN
+     char *argv[])      // IN
+{
+   char *programArgv[2] = { "/bin/true", NULL };
+   const char *modeName = "all";
+   unsigned int failures = 0;
+   BenchMode mode;
+   int opt;
+
+   gBench.count = 2000;
+   gBench.concurrency = 32;
+
+   while ((opt = getopt(argc, argv, "n:j:m:c:")) != -1) {
+      switch (opt) {
+      case 'n':
+         gBench.count = strtoul(optarg, NULL, 10);
+         break;
+      case 'j':
+         gBench.concurrency = strtoul(optarg, NULL, 10);
+         break;
+      case 'm':
+         modeName = optarg;
+         break;
+      case 'c':
+         programArgv[0] = optarg;
+         break;
+      default:
+         BenchUsage(argv[0]);
+         return EXIT_FAILURE;
+      }
+   }
+
+   if (gBench.count == 0 || gBench.concurrency == 0 ||
+       (strcmp(modeName, "all") != 0 &&
+        strcmp(modeName, benchModeNames[BENCH_POLL]) != 0 &&
+        strcmp(modeName, benchModeNames[BENCH_WATCH]) != 0)) {
+      BenchUsage(argv[0]);
+      return EXIT_FAILURE;
+   }
+
+   gBench.argv = programArgv;
+   gBench.latencies = Util_SafeCalloc(gBench.count, sizeof *gBench.latencies);
+   gBench.loop = g_main_loop_new(NULL, FALSE);
+
+   printf("%-6s %7s %5s %9s %9s %9s %9s %9s %9s %6s\n", "mode", "count",
+          "jobs", "total(s)", "progs/s", "avg(ms)", "p50", "p99", "max",
+          "failed");
+   fflush(stdout);
+
+   for (mode = 0; mode < BENCH_NUM_MODES; mode++) {
+      if (strcmp(modeName, "all") == 0 ||
+          strcmp(modeName, benchModeNames[mode]) == 0) {
+         failures += BenchRun(mode);
+      }
+   }
+
+   g_main_loop_unref(gBench.loop);
+   free(gBench.latencies);
+
+   return failures == 0 ? EXIT_SUCCESS : EXIT_FAILURE;
+}
@@ -32,9 +32,19 @@
 #include <unistd.h>
 #include <sys/types.h>
 #include <fcntl.h>
+#ifdef __linux__
+#include <sys/syscall.h>
+#endif
 #define GENERIC_RANDOM_DEVICE "/dev/urandom"
 #endif
 
+#if defined(__linux__) && defined(SYS_getrandom)
+#define USE_GETRANDOM
+#ifndef GRND_NONBLOCK
+#define GRND_NONBLOCK 0x0001
+#endif
+#endif
+
 /*
  ******************************************************************************
  * ServiceRandomBytes --                                                 */ /**
@@ -76,6 +86,34 @@ ServiceRandomBytes(int size,
 #else
    int fd;
 
+#ifdef USE_GETRANDOM
+   /*
+    * getrandom(2) reads the same pool as /dev/urandom without opening a
+    * device.  Fall back to the device if the kernel lacks the call or the
+    * pool is not yet initialized (GRND_NONBLOCK keeps us from blocking).
+    */
+   {
+      guchar *p = buffer;
+      int left = size;
+
+      while (left > 0) {
+         long n = syscall(SYS_getrandom, p, left, GRND_NONBLOCK);
+
+         if (n == -1) {
+            if (errno == EINTR) {
+               continue;
+            }
+            break;
+         }
+         left -= n;
+         p += n;
+      }
+      if (left == 0) {
+         return VGAUTH_E_OK;
+      }
+   }
+#endif
+
    /*
     * We use /dev/urandom and not /dev/random because it is good enough and
     * because it cannot block. --hpreg